@@ -0,0 +1,91 @@
+/*
+ * Copyright (c) 2016, Markus Achtelik, ASL, ETH Zurich, Switzerland
+ * Copyright (c) 2016, Michael Burri, ASL, ETH Zurich, Switzerland
+ * Copyright (c) 2016, Helen Oleynikova, ASL, ETH Zurich, Switzerland
+ * Copyright (c) 2016, Rik Bähnemann, ASL, ETH Zurich, Switzerland
+ * Copyright (c) 2016, Marija Popovic, ASL, ETH Zurich, Switzerland
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef MAV_TRAJECTORY_GENERATION_ARC_LENGTH_TABLE_H_
+#define MAV_TRAJECTORY_GENERATION_ARC_LENGTH_TABLE_H_
+
+#include <vector>
+
+#include "mav_trajectory_generation/trajectory.h"
+
+namespace mav_trajectory_generation {
+
+// Arc length of the position, i.e. the first (up to) three dimensions, over
+// time. Knots are placed by adaptive Gauss-Legendre quadrature of the speed
+// until the quadrature and the monotone cubic interpolation in between agree
+// within the tolerance [m] over the whole trajectory. Both directions of the
+// lookup are O(1) through uniform buckets over the knots.
+// Trajectory::getArcLengthTable() keeps one table per trajectory.
+class ArcLengthTable {
+ public:
+  ArcLengthTable()
+      : length_(0.0), time_bucket_width_(0.0), arc_length_bucket_width_(0.0) {}
+  explicit ArcLengthTable(const Trajectory& trajectory,
+                          double tolerance = 1.0e-4);
+
+  bool empty() const { return times_.empty(); }
+  double getLength() const { return length_; }
+  double getMaxTime() const { return times_.empty() ? 0.0 : times_.back(); }
+  size_t getNumberKnots() const { return times_.size(); }
+
+  // Arc length at time t, clamped to the trajectory.
+  double getArcLength(double t) const;
+  // Inverse of getArcLength(): the first time at which arc_length is
+  // reached, clamped to [0, getLength()].
+  double getTimeAtArcLength(double arc_length) const;
+
+  // Times at arc lengths i * ds, i = 0 ... floor(getLength() / ds), e.g. for
+  // equally spaced markers or collision checks.
+  void sampleByArcLength(double ds, std::vector<double>* times) const;
+
+ private:
+  // Appends the knots after t_start up to t_end of the segment, given the
+  // integral of the speed over that interval.
+  void addKnots(const Segment& segment, double t_segment, double t_start,
+                double t_end, double integral, double tolerance_per_time,
+                int depth);
+  static int findInterval(const std::vector<double>& values,
+                          const std::vector<int>& buckets,
+                          double bucket_width, double value);
+  void setupBuckets(const std::vector<double>& values, double bucket_width,
+                    std::vector<int>* buckets) const;
+  // Interpolated arc length and optionally its derivative by u at fraction u
+  // of the interval after knot i.
+  double interpolate(int i, double u, double* derivative = nullptr) const;
+
+  double length_;
+  // Knots.
+  std::vector<double> times_;
+  std::vector<double> arc_lengths_;
+  // Derivatives of the arc length at the start and end of every interval
+  // between knots, limited for a monotone interpolation. Kept per interval,
+  // as the speed may jump on vertices.
+  std::vector<double> start_slopes_;
+  std::vector<double> end_slopes_;
+  // First interval that may contain a value of the bucket.
+  std::vector<int> time_buckets_;
+  std::vector<int> arc_length_buckets_;
+  double time_bucket_width_;
+  double arc_length_bucket_width_;
+};
+
+}  // namespace mav_trajectory_generation
+
+#endif  // MAV_TRAJECTORY_GENERATION_ARC_LENGTH_TABLE_H_
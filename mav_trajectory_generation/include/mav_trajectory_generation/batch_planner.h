@@ -0,0 +1,131 @@
+/*
+ * Copyright (c) 2016, Markus Achtelik, ASL, ETH Zurich, Switzerland
+ * Copyright (c) 2016, Michael Burri, ASL, ETH Zurich, Switzerland
+ * Copyright (c) 2016, Helen Oleynikova, ASL, ETH Zurich, Switzerland
+ * Copyright (c) 2016, Rik Bähnemann, ASL, ETH Zurich, Switzerland
+ * Copyright (c) 2016, Marija Popovic, ASL, ETH Zurich, Switzerland
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef MAV_TRAJECTORY_GENERATION_BATCH_PLANNER_H_
+#define MAV_TRAJECTORY_GENERATION_BATCH_PLANNER_H_
+
+#include <map>
+#include <memory>
+#include <vector>
+
+#include "mav_trajectory_generation/polynomial_optimization_linear.h"
+#include "mav_trajectory_generation/polynomial_optimization_nonlinear.h"
+#include "mav_trajectory_generation/segment_time_initializer.h"
+#include "mav_trajectory_generation/solution_cache.h"
+#include "mav_trajectory_generation/thread_pool.h"
+
+namespace mav_trajectory_generation {
+
+// Solves many independent trajectory optimization problems in parallel on a
+// fixed-size ThreadPool. Every worker keeps its own linear optimizer, whose
+// memory is re-used for all jobs of the same dimension.
+// _N specifies the number of coefficients for the underlying polynomials.
+template <int _N = 10>
+class BatchPlanner {
+  static_assert(_N % 2 == 0, "The number of coefficients has to be even.");
+
+ public:
+  enum { N = _N };
+
+  // Independent optimization problem.
+  struct Job {
+    Job()
+        : derivative_to_optimize(
+              PolynomialOptimization<N>::kHighestDerivativeToOptimize),
+          segment_time_initializer(nullptr),
+          optimize_nonlinear(false),
+          optimize_time_only(true) {}
+
+    Vertex::Vector vertices;
+    std::vector<double> segment_times;
+    int derivative_to_optimize;
+    // Estimates the segment times if segment_times is empty. Not owned, has
+    // to be thread-safe if shared by jobs.
+    const SegmentTimeInitializer* segment_time_initializer;
+
+    // Runs PolynomialOptimizationNonLinear instead of only solving the linear
+    // problem with the given segment times.
+    bool optimize_nonlinear;
+    bool optimize_time_only;
+    NonlinearOptimizationParameters parameters;
+    // Maximum magnitudes by derivative for the nonlinear optimization.
+    std::map<int, double> maximum_magnitude_constraints;
+  };
+
+  struct Result {
+    Result()
+        : success(false), from_cache(false), nlopt_result(nlopt::FAILURE) {}
+
+    bool success;
+    // True if the trajectory was taken from the solution cache. The
+    // optimization info is not cached.
+    bool from_cache;
+    Trajectory trajectory;
+    // Only set for nonlinear optimization.
+    int nlopt_result;
+    OptimizationInfo optimization_info;
+  };
+
+  // Input: n_threads = Number of worker threads. Uses the number of hardware
+  // threads if 0.
+  explicit BatchPlanner(size_t n_threads = 0);
+
+  // Solves all jobs. Blocks until all jobs are done.
+  // Output: results = One result per job, in the order of the jobs.
+  void solve(const std::vector<Job>& jobs, std::vector<Result>* results);
+
+  size_t getNumberThreads() const { return thread_pool_.getNumberThreads(); }
+
+  // Looks up jobs in the cache before solving them and stores successful
+  // solutions. Nonlinear jobs are only cached if they are deterministic,
+  // i.e. without a negative random seed or a deadline. The cache is not
+  // owned and can be shared among planners. nullptr disables it.
+  void setSolutionCache(SolutionCache* solution_cache) {
+    solution_cache_ = solution_cache;
+  }
+
+ private:
+  // Optimizer state re-used by a worker.
+  struct WorkerState {
+    std::unique_ptr<PolynomialOptimization<N> > linear_optimizer;
+  };
+
+  // Solves a single job with the state of the calling worker.
+  static void solveJob(const Job& job, WorkerState* worker_state,
+                       Result* result);
+  // Solves a job through the solution cache, if any.
+  void solveJobCached(const Job& job, WorkerState* worker_state,
+                      Result* result) const;
+  // Everything besides the vertices and segment times the solution of a job
+  // depends on. Returns false if the solution is not deterministic or not
+  // translation invariant, e.g. with a position magnitude constraint.
+  static bool getCacheParameters(const Job& job,
+                                 std::vector<double>* parameters);
+
+  ThreadPool thread_pool_;
+  std::vector<WorkerState> worker_states_;
+  SolutionCache* solution_cache_;
+};
+
+}  // namespace mav_trajectory_generation
+
+#endif  // MAV_TRAJECTORY_GENERATION_BATCH_PLANNER_H_
+
+#include "mav_trajectory_generation/impl/batch_planner_impl.h"
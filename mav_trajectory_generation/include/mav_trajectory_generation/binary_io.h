@@ -0,0 +1,140 @@
+/*
+ * Copyright (c) 2016, Markus Achtelik, ASL, ETH Zurich, Switzerland
+ * Copyright (c) 2016, Michael Burri, ASL, ETH Zurich, Switzerland
+ * Copyright (c) 2016, Helen Oleynikova, ASL, ETH Zurich, Switzerland
+ * Copyright (c) 2016, Rik Bähnemann, ASL, ETH Zurich, Switzerland
+ * Copyright (c) 2016, Marija Popovic, ASL, ETH Zurich, Switzerland
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef MAV_TRAJECTORY_GENERATION_BINARY_IO_H_
+#define MAV_TRAJECTORY_GENERATION_BINARY_IO_H_
+
+#include <Eigen/Core>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "mav_trajectory_generation/flat_trajectory.h"
+#include "mav_trajectory_generation/motion_defines.h"
+#include "mav_trajectory_generation/segment.h"
+#include "mav_trajectory_generation/trajectory.h"
+
+namespace mav_trajectory_generation {
+
+// Binary trajectory file, in native byte order:
+// [BinaryTrajectoryHeader]
+// [K segment times in seconds (double)]
+// [K * D * N coefficients (double), ordered by segment, then dimension, with
+//  increasing powers of t]
+// All segments have the same N and D. Every block is 8-byte aligned, so a
+// mapped file can be read in place.
+struct BinaryTrajectoryHeader {
+  static constexpr uint32_t kMagic = 0x4a52544d;  // "MTRJ"
+  static constexpr uint32_t kVersion = 1;
+
+  uint32_t magic;
+  uint32_t version;
+  uint32_t N;
+  uint32_t D;
+  uint64_t K;
+  uint64_t reserved;
+};
+
+bool segmentsToBinaryFile(const std::string& filename,
+                          const Segment::Vector& segments);
+
+inline bool trajectoryToBinaryFile(const std::string& filename,
+                                   const Trajectory& trajectory) {
+  return segmentsToBinaryFile(filename, trajectory.segments());
+}
+
+bool segmentsFromBinaryFile(const std::string& filename,
+                            Segment::Vector* segments);
+
+inline bool trajectoryFromBinaryFile(const std::string& filename,
+                                     Trajectory* trajectory) {
+  CHECK_NOTNULL(trajectory);
+  Segment::Vector segments;
+  if (!segmentsFromBinaryFile(filename, &segments) || segments.empty()) {
+    return false;
+  }
+  trajectory->setSegments(segments);
+  return true;
+}
+
+// Converters between the YAML format of io.h and the binary format.
+bool yamlToBinaryFile(const std::string& yaml_filename,
+                      const std::string& binary_filename);
+bool binaryToYamlFile(const std::string& binary_filename,
+                      const std::string& yaml_filename);
+
+// Read-only view of a memory-mapped binary trajectory file. Opening only
+// validates the header and accumulates the segment start times, the
+// coefficients are read in place and paged in on demand.
+class MappedTrajectory {
+ public:
+  MappedTrajectory();
+  ~MappedTrajectory();
+
+  MappedTrajectory(const MappedTrajectory&) = delete;
+  MappedTrajectory& operator=(const MappedTrajectory&) = delete;
+
+  // Maps the file, closing a previously opened one. Returns false if the file
+  // cannot be mapped or is not a valid binary trajectory file.
+  bool open(const std::string& filename);
+  void close();
+  bool isOpen() const { return data_ != nullptr; }
+
+  int N() const { return N_; }
+  int D() const { return D_; }
+  int K() const { return K_; }
+  bool empty() const { return K_ == 0; }
+
+  double getMinTime() const { return 0.0; }
+  double getMaxTime() const { return max_time_; }
+  double getSegmentTime(int segment_idx) const;
+
+  // Coefficients of one polynomial, pointing into the mapped file. Only valid
+  // while the file is open.
+  Eigen::Map<const Eigen::VectorXd> getCoefficients(int segment_idx,
+                                                    int dimension) const;
+
+  // Same as Trajectory::evaluate().
+  Eigen::VectorXd evaluate(
+      double t, int derivative_order = derivative_order::POSITION) const;
+
+  // Deep copy into segments, e.g. to modify or optimize the trajectory.
+  void getSegments(Segment::Vector* segments) const;
+  bool getTrajectory(Trajectory* trajectory) const;
+  // Copy of the whole file with one copy per buffer, to keep the trajectory
+  // after closing.
+  bool getFlatTrajectory(FlatTrajectory* trajectory) const;
+
+ private:
+  void* data_;
+  size_t size_;
+  int N_;
+  int D_;
+  int K_;
+  double max_time_;
+  const double* times_;
+  const double* coefficients_;
+  // Start time of every segment.
+  std::vector<double> segment_start_times_;
+};
+
+}  // namespace mav_trajectory_generation
+
+#endif  // MAV_TRAJECTORY_GENERATION_BINARY_IO_H_
@@ -0,0 +1,177 @@
+/*
+ * Copyright (c) 2016, Markus Achtelik, ASL, ETH Zurich, Switzerland
+ * Copyright (c) 2016, Michael Burri, ASL, ETH Zurich, Switzerland
+ * Copyright (c) 2016, Helen Oleynikova, ASL, ETH Zurich, Switzerland
+ * Copyright (c) 2016, Rik Bähnemann, ASL, ETH Zurich, Switzerland
+ * Copyright (c) 2016, Marija Popovic, ASL, ETH Zurich, Switzerland
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef MAV_TRAJECTORY_GENERATION_FIXED_POLYNOMIAL_H_
+#define MAV_TRAJECTORY_GENERATION_FIXED_POLYNOMIAL_H_
+
+#include <glog/logging.h>
+#include <Eigen/Core>
+#include <vector>
+
+#include "mav_trajectory_generation/polynomial.h"
+
+namespace mav_trajectory_generation {
+
+namespace internal {
+
+// Base coefficient of the n-th derivative of t^i, i.e., i! / (i - n)!.
+// Zero if the derivative vanishes (n > i).
+constexpr double baseCoefficient(int n, int i) {
+  return n > i ? 0.0 : (n == 0 ? 1.0 : i * baseCoefficient(n - 1, i - 1));
+}
+
+// C++11 replacement for std::integer_sequence.
+template <int... Is>
+struct IndexSequence {};
+
+template <int Size, int... Is>
+struct MakeIndexSequence : MakeIndexSequence<Size - 1, Size - 1, Is...> {};
+
+template <int... Is>
+struct MakeIndexSequence<0, Is...> {
+  typedef IndexSequence<Is...> type;
+};
+
+// Row-major Size x Size table of base coefficients, computed at compile time.
+template <int Size, typename Sequence>
+struct BaseCoefficientTable;
+
+template <int Size, int... Is>
+struct BaseCoefficientTable<Size, IndexSequence<Is...> > {
+  static constexpr double kValues[sizeof...(Is)] = {
+      baseCoefficient(Is / Size, Is % Size)...};
+};
+
+template <int Size, int... Is>
+constexpr double
+    BaseCoefficientTable<Size, IndexSequence<Is...> >::kValues[sizeof...(Is)];
+
+}  // namespace internal
+
+// Compile-time counterpart of Polynomial::base_coefficients_, up to
+// Polynomial::kMaxN coefficients.
+typedef internal::BaseCoefficientTable<
+    Polynomial::kMaxN,
+    internal::MakeIndexSequence<Polynomial::kMaxN * Polynomial::kMaxN>::type>
+    FixedBaseCoefficients;
+
+// Returns the base coefficient of the given derivative for t^i.
+constexpr double fixedBaseCoefficient(int derivative, int i) {
+  return FixedBaseCoefficients::kValues[derivative * Polynomial::kMaxN + i];
+}
+
+// Returns the coefficients of the Derivative-th derivative of a polynomial
+// with N coefficients, i.e., the N - Derivative lowest powers of t. The
+// products with the base coefficients are resolved at compile time.
+template <int N, int Derivative>
+inline Eigen::Matrix<double, N - Derivative, 1> fixedDerivativeCoefficients(
+    const Eigen::Ref<const Eigen::VectorXd>& coefficients) {
+  static_assert(Derivative >= 0 && Derivative < N,
+                "Derivative has to be in [0, N).");
+  static_assert(N <= Polynomial::kMaxN, "N has to be at most kMaxN.");
+  DCHECK_EQ(N, coefficients.size());
+  Eigen::Matrix<double, N - Derivative, 1> result;
+  for (int i = 0; i < N - Derivative; ++i) {
+    result[i] = fixedBaseCoefficient(Derivative, i + Derivative) *
+                coefficients[i + Derivative];
+  }
+  return result;
+}
+
+// Polynomial with a number of coefficients known at compile time.
+// Coefficients are stored inline with increasing powers,
+// i.e. c_0 + c_1*t ... c_{N-1} * t^{N-1}, so that evaluation never allocates.
+// Use the dynamic Polynomial for everything that changes N (convolution,
+// root finding, appending coefficients).
+template <int _N>
+class FixedPolynomial {
+  static_assert(_N > 0 && _N <= Polynomial::kMaxN,
+                "The number of coefficients has to be in [1, kMaxN].");
+
+ public:
+  enum { N = _N };
+  typedef Eigen::Matrix<double, N, 1, Eigen::ColMajor | Eigen::DontAlign>
+      Coefficients;
+  typedef std::vector<FixedPolynomial> Vector;
+
+  FixedPolynomial() { coefficients_.setZero(); }
+
+  FixedPolynomial(const Coefficients& coeffs) : coefficients_(coeffs) {}
+
+  // Converts a dynamic polynomial with the same number of coefficients.
+  explicit FixedPolynomial(const Polynomial& polynomial) {
+    CHECK_EQ(N, polynomial.N()) << "Number of coefficients has to match.";
+    coefficients_ = polynomial.getCoefficients();
+  }
+
+  inline bool operator==(const FixedPolynomial& rhs) const {
+    return coefficients_ == rhs.coefficients_;
+  }
+  inline bool operator!=(const FixedPolynomial& rhs) const {
+    return !operator==(rhs);
+  }
+
+  const Coefficients& getCoefficients() const { return coefficients_; }
+  void setCoefficients(const Coefficients& coeffs) { coefficients_ = coeffs; }
+
+  // Converts back to a dynamic polynomial.
+  Polynomial toPolynomial() const {
+    return Polynomial(Eigen::VectorXd(coefficients_));
+  }
+
+  // Evaluates the specified derivative of the polynomial at time t.
+  double evaluate(double t, int derivative) const {
+    if (derivative >= N) {
+      return 0.0;
+    }
+    double result =
+        fixedBaseCoefficient(derivative, N - 1) * coefficients_[N - 1];
+    for (int j = N - 2; j >= derivative; --j) {
+      result *= t;
+      result += fixedBaseCoefficient(derivative, j) * coefficients_[j];
+    }
+    return result;
+  }
+
+  // Same as above with the derivative known at compile time.
+  template <int Derivative>
+  double evaluate(double t) const {
+    static_assert(Derivative >= 0, "Derivative has to be non-negative.");
+    return evaluate(t, Derivative);
+  }
+
+  // Evaluates the polynomial at time t and fills in all derivatives up to
+  // M-1 (that is, if result is a 3-vector, derivatives 0, 1, and 2).
+  template <int M>
+  void evaluate(double t, Eigen::Matrix<double, M, 1>* result) const {
+    static_assert(M > 0 && M <= N, "Can only evaluate 1 to N derivatives.");
+    CHECK_NOTNULL(result);
+    for (int i = 0; i < M; i++) {
+      (*result)[i] = evaluate(t, i);
+    }
+  }
+
+ private:
+  Coefficients coefficients_;
+};
+
+}  // namespace mav_trajectory_generation
+
+#endif  // MAV_TRAJECTORY_GENERATION_FIXED_POLYNOMIAL_H_
@@ -0,0 +1,111 @@
+/*
+ * Copyright (c) 2016, Markus Achtelik, ASL, ETH Zurich, Switzerland
+ * Copyright (c) 2016, Michael Burri, ASL, ETH Zurich, Switzerland
+ * Copyright (c) 2016, Helen Oleynikova, ASL, ETH Zurich, Switzerland
+ * Copyright (c) 2016, Rik Bähnemann, ASL, ETH Zurich, Switzerland
+ * Copyright (c) 2016, Marija Popovic, ASL, ETH Zurich, Switzerland
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef MAV_TRAJECTORY_GENERATION_FIXED_SEGMENT_H_
+#define MAV_TRAJECTORY_GENERATION_FIXED_SEGMENT_H_
+
+#include <glog/logging.h>
+#include <Eigen/Core>
+#include <array>
+#include <vector>
+
+#include "mav_trajectory_generation/fixed_polynomial.h"
+#include "mav_trajectory_generation/motion_defines.h"
+#include "mav_trajectory_generation/segment.h"
+
+namespace mav_trajectory_generation {
+
+// Segment with number of coefficients N and dimension D known at compile
+// time. All coefficients are stored inline, so evaluation never allocates.
+// Convert from and to Segment at the boundaries of allocation-critical code,
+// e.g. sampling and feasibility loops.
+template <int _N, int _D>
+class FixedSegment {
+  static_assert(_D > 0, "The dimension has to be positive.");
+
+ public:
+  enum { N = _N, D = _D };
+  typedef std::vector<FixedSegment> Vector;
+  typedef Eigen::Matrix<double, D, 1, Eigen::ColMajor | Eigen::DontAlign>
+      Point;
+
+  FixedSegment() : time_(0.0) {}
+
+  // Converts a dynamic segment with the same N and D.
+  explicit FixedSegment(const Segment& segment) : time_(segment.getTime()) {
+    CHECK_EQ(N, segment.N()) << "Number of coefficients has to match.";
+    CHECK_EQ(D, segment.D()) << "Dimension has to match.";
+    for (int i = 0; i < D; ++i) {
+      polynomials_[i] = FixedPolynomial<N>(segment[i]);
+    }
+  }
+
+  bool operator==(const FixedSegment& rhs) const {
+    return time_ == rhs.time_ && polynomials_ == rhs.polynomials_;
+  }
+  inline bool operator!=(const FixedSegment& rhs) const {
+    return !operator==(rhs);
+  }
+
+  double getTime() const { return time_; }
+  void setTime(double time_sec) { time_ = time_sec; }
+
+  FixedPolynomial<N>& operator[](size_t idx) {
+    CHECK_LT(idx, static_cast<size_t>(D));
+    return polynomials_[idx];
+  }
+  const FixedPolynomial<N>& operator[](size_t idx) const {
+    CHECK_LT(idx, static_cast<size_t>(D));
+    return polynomials_[idx];
+  }
+
+  // Converts back to a dynamic segment.
+  Segment toSegment() const {
+    Segment segment(N, D);
+    segment.setTime(time_);
+    for (int i = 0; i < D; ++i) {
+      segment[i] = polynomials_[i].toPolynomial();
+    }
+    return segment;
+  }
+
+  // Evaluates the specified derivative of all dimensions at time t.
+  void evaluate(double t, int derivative, Point* result) const {
+    CHECK_NOTNULL(result);
+    for (int i = 0; i < D; ++i) {
+      (*result)[i] = polynomials_[i].evaluate(t, derivative);
+    }
+  }
+
+  Point evaluate(double t,
+                 int derivative = derivative_order::POSITION) const {
+    Point result;
+    evaluate(t, derivative, &result);
+    return result;
+  }
+
+ private:
+  std::array<FixedPolynomial<N>, D> polynomials_;
+  double time_;
+};
+
+}  // namespace mav_trajectory_generation
+
+#endif  // MAV_TRAJECTORY_GENERATION_FIXED_SEGMENT_H_
@@ -0,0 +1,121 @@
+/*
+ * Copyright (c) 2016, Markus Achtelik, ASL, ETH Zurich, Switzerland
+ * Copyright (c) 2016, Michael Burri, ASL, ETH Zurich, Switzerland
+ * Copyright (c) 2016, Helen Oleynikova, ASL, ETH Zurich, Switzerland
+ * Copyright (c) 2016, Rik Bähnemann, ASL, ETH Zurich, Switzerland
+ * Copyright (c) 2016, Marija Popovic, ASL, ETH Zurich, Switzerland
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef MAV_TRAJECTORY_GENERATION_FLAT_TRAJECTORY_H_
+#define MAV_TRAJECTORY_GENERATION_FLAT_TRAJECTORY_H_
+
+#include <vector>
+
+#include "mav_trajectory_generation/trajectory.h"
+
+namespace mav_trajectory_generation {
+
+// Read-only trajectory with all coefficients in one contiguous buffer,
+// ordered [segment][dimension][increasing powers], the layout of the binary
+// trajectory files. Copying or building it costs a few allocations in total
+// instead of one per polynomial, and evaluation walks linear memory. Use
+// getTrajectory() to get a Trajectory to modify or optimize.
+class FlatTrajectory {
+ public:
+  // Non-owning view of one segment. Only valid as long as the FlatTrajectory
+  // it was taken from is not modified or destroyed.
+  class SegmentView {
+   public:
+    int N() const { return N_; }
+    int D() const { return D_; }
+    double getTime() const { return time_; }
+
+    // Coefficients of the polynomial of dimension dim.
+    Eigen::Map<const Eigen::VectorXd> operator[](int dim) const {
+      return Eigen::Map<const Eigen::VectorXd>(coefficients_ + dim * N_, N_);
+    }
+
+    // Same as Segment::evaluate(), without range check.
+    Eigen::VectorXd evaluate(
+        double t, int derivative_order = derivative_order::POSITION) const;
+
+   private:
+    friend class FlatTrajectory;
+    SegmentView(const double* coefficients, double time, int N, int D)
+        : coefficients_(coefficients), time_(time), N_(N), D_(D) {}
+
+    const double* coefficients_;
+    double time_;
+    int N_;
+    int D_;
+  };
+
+  FlatTrajectory() : N_(0), D_(0) {}
+  // Segments of lower order are padded with zero coefficients to the highest
+  // N of the trajectory.
+  explicit FlatTrajectory(const Trajectory& trajectory);
+  explicit FlatTrajectory(const Segment::Vector& segments);
+  // Copies K segment times and K * D * N coefficients in the layout above,
+  // e.g. from a MappedTrajectory.
+  FlatTrajectory(int N, int D, int K, const double* times,
+                 const double* coefficients);
+
+  int N() const { return N_; }
+  int D() const { return D_; }
+  int K() const { return static_cast<int>(times_.size()); }
+  bool empty() const { return times_.empty(); }
+
+  double getMinTime() const { return 0.0; }
+  double getMaxTime() const {
+    return empty() ? 0.0 : segment_start_times_.back() + times_.back();
+  }
+  double getSegmentTime(int segment_idx) const { return times_[segment_idx]; }
+  double getSegmentStartTime(int segment_idx) const {
+    return segment_start_times_[segment_idx];
+  }
+
+  const std::vector<double>& times() const { return times_; }
+  const std::vector<double>& coefficients() const { return coefficients_; }
+
+  SegmentView getSegment(int segment_idx) const {
+    return SegmentView(&coefficients_[segment_idx * D_ * N_],
+                       times_[segment_idx], N_, D_);
+  }
+  Eigen::Map<const Eigen::VectorXd> getCoefficients(int segment_idx,
+                                                    int dimension) const {
+    return getSegment(segment_idx)[dimension];
+  }
+
+  // Same as Trajectory::evaluate().
+  Eigen::VectorXd evaluate(
+      double t, int derivative_order = derivative_order::POSITION) const;
+
+  // Deep copy into segments, e.g. to modify or optimize the trajectory.
+  void getSegments(Segment::Vector* segments) const;
+  bool getTrajectory(Trajectory* trajectory) const;
+
+ private:
+  void setSegmentStartTimes();
+
+  int N_;
+  int D_;
+  std::vector<double> times_;
+  std::vector<double> segment_start_times_;
+  std::vector<double> coefficients_;
+};
+
+}  // namespace mav_trajectory_generation
+
+#endif  // MAV_TRAJECTORY_GENERATION_FLAT_TRAJECTORY_H_
@@ -0,0 +1,127 @@
+/*
+ * Copyright (c) 2016, Markus Achtelik, ASL, ETH Zurich, Switzerland
+ * Copyright (c) 2016, Michael Burri, ASL, ETH Zurich, Switzerland
+ * Copyright (c) 2016, Helen Oleynikova, ASL, ETH Zurich, Switzerland
+ * Copyright (c) 2016, Rik Bähnemann, ASL, ETH Zurich, Switzerland
+ * Copyright (c) 2016, Marija Popovic, ASL, ETH Zurich, Switzerland
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef MAV_TRAJECTORY_GENERATION_FLOAT_TRAJECTORY_H_
+#define MAV_TRAJECTORY_GENERATION_FLOAT_TRAJECTORY_H_
+
+#include <Eigen/Core>
+#include <vector>
+
+#include "mav_trajectory_generation/motion_defines.h"
+#include "mav_trajectory_generation/segment.h"
+#include "mav_trajectory_generation/trajectory.h"
+
+namespace mav_trajectory_generation {
+
+// Single precision copy of a segment for sampling commands, e.g. on
+// hardware that processes twice as many floats as doubles per cycle. The
+// polynomials are shifted to the segment midpoint in double precision and
+// their derivative coefficients are converted to float once. Only the
+// relative time to the midpoint is rounded to float, which halves its range
+// and keeps the rounding error small. Optimization stays in double.
+class FloatSegment {
+ public:
+  typedef std::vector<FloatSegment> Vector;
+  static constexpr int kNumLanes = 8;
+
+  FloatSegment() : N_(0), D_(0), max_derivative_(0), time_(0.0) {}
+  FloatSegment(const Segment& segment, int max_derivative);
+
+  int D() const { return D_; }
+  int N() const { return N_; }
+  int getMaxDerivative() const { return max_derivative_; }
+  double getTime() const { return time_; }
+
+  // Same as Segment::evaluate() up to max_derivative, t is relative to the
+  // segment start.
+  Eigen::VectorXf evaluate(
+      double t, int derivative_order = derivative_order::POSITION) const;
+
+  // Evaluates a derivative at n_times times relative to the segment start,
+  // running Horner's scheme on kNumLanes times at once.
+  // Output: result = n_times consecutive vectors of D floats.
+  void evaluate(const double* times, size_t n_times, int derivative_order,
+                float* result) const;
+
+  // Upper bound on the absolute error of every dimension of the derivative
+  // within [0, getTime()], compared to evaluating the double coefficients
+  // exactly. Covers the rounding of the coefficients, of the relative time
+  // and of Horner's scheme.
+  double getErrorBound(int derivative_order) const;
+
+ private:
+  inline float coefficient(int derivative, int j, int d) const {
+    return coefficients_[(derivative * N_ + j) * D_ + d];
+  }
+
+  int N_;
+  int D_;
+  int max_derivative_;
+  double time_;
+  // Derivative coefficients in powers of the time relative to the midpoint,
+  // indexed by [derivative][power][dimension].
+  std::vector<float> coefficients_;
+  std::vector<double> error_bounds_;
+};
+
+// Single precision copy of a trajectory, see FloatSegment.
+class FloatTrajectory {
+ public:
+  FloatTrajectory() : D_(0), max_derivative_(0), max_time_(0.0) {}
+  FloatTrajectory(const Trajectory& trajectory,
+                  int max_derivative = derivative_order::SNAP);
+
+  int D() const { return D_; }
+  int K() const { return segments_.size(); }
+  bool empty() const { return segments_.empty(); }
+  int getMaxDerivative() const { return max_derivative_; }
+  double getMaxTime() const { return max_time_; }
+  const FloatSegment& getSegment(int segment_idx) const {
+    return segments_[segment_idx];
+  }
+
+  // Same as Trajectory::evaluate(). The time is kept in double, such that
+  // long trajectories do not lose precision.
+  Eigen::VectorXf evaluate(
+      double t, int derivative_order = derivative_order::POSITION) const;
+
+  // Same samples as Trajectory::evaluateRange(). The vectors of result are
+  // only reallocated if their number or size changes.
+  void evaluateRange(double t_start, double t_end, double dt,
+                     int derivative_order, std::vector<Eigen::VectorXf>* result,
+                     std::vector<double>* sampling_times = nullptr) const;
+
+  // Largest FloatSegment::getErrorBound() of all segments.
+  double getErrorBound(int derivative_order) const;
+
+ private:
+  int getSegmentIndex(double t) const;
+
+  int D_;
+  int max_derivative_;
+  double max_time_;
+  FloatSegment::Vector segments_;
+  // Start time of every segment.
+  std::vector<double> segment_start_times_;
+};
+
+}  // namespace mav_trajectory_generation
+
+#endif  // MAV_TRAJECTORY_GENERATION_FLOAT_TRAJECTORY_H_
@@ -0,0 +1,180 @@
+/*
+ * Copyright (c) 2016, Markus Achtelik, ASL, ETH Zurich, Switzerland
+ * Copyright (c) 2016, Michael Burri, ASL, ETH Zurich, Switzerland
+ * Copyright (c) 2016, Helen Oleynikova, ASL, ETH Zurich, Switzerland
+ * Copyright (c) 2016, Rik Bähnemann, ASL, ETH Zurich, Switzerland
+ * Copyright (c) 2016, Marija Popovic, ASL, ETH Zurich, Switzerland
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef MAV_TRAJECTORY_GENERATION_IMPL_BATCH_PLANNER_IMPL_H_
+#define MAV_TRAJECTORY_GENERATION_IMPL_BATCH_PLANNER_IMPL_H_
+
+#include <glog/logging.h>
+#include <iterator>
+
+namespace mav_trajectory_generation {
+
+template <int _N>
+BatchPlanner<_N>::BatchPlanner(size_t n_threads)
+    : thread_pool_(n_threads),
+      worker_states_(thread_pool_.getNumberThreads()),
+      solution_cache_(nullptr) {}
+
+template <int _N>
+void BatchPlanner<_N>::solve(const std::vector<Job>& jobs,
+                             std::vector<Result>* results) {
+  CHECK_NOTNULL(results);
+  results->clear();
+  results->resize(jobs.size());
+  thread_pool_.parallelFor(
+      jobs.size(), [this, &jobs, results](size_t job_idx, size_t worker_idx) {
+        solveJobCached(jobs[job_idx], &worker_states_[worker_idx],
+                       &(*results)[job_idx]);
+      });
+}
+
+template <int _N>
+void BatchPlanner<_N>::solveJobCached(const Job& job,
+                                      WorkerState* worker_state,
+                                      Result* result) const {
+  if (job.segment_times.empty() && job.segment_time_initializer != nullptr) {
+    Job estimated_job(job);
+    estimated_job.segment_time_initializer = nullptr;
+    if (!job.segment_time_initializer->estimateSegmentTimes(
+            job.vertices, &estimated_job.segment_times)) {
+      LOG(WARNING) << "Could not estimate the segment times of a job.";
+      return;
+    }
+    solveJobCached(estimated_job, worker_state, result);
+    return;
+  }
+  std::vector<double> parameters;
+  if (solution_cache_ == nullptr || job.vertices.empty() ||
+      !getCacheParameters(job, &parameters)) {
+    solveJob(job, worker_state, result);
+    return;
+  }
+  SolutionCache::Key key;
+  Eigen::VectorXd translation;
+  solution_cache_->computeKey(job.vertices, job.segment_times,
+                              job.derivative_to_optimize, parameters, &key,
+                              &translation);
+  if (solution_cache_->lookup(key, translation, &result->trajectory,
+                              &result->nlopt_result)) {
+    result->success = true;
+    result->from_cache = true;
+    return;
+  }
+  solveJob(job, worker_state, result);
+  if (result->success) {
+    solution_cache_->insert(key, translation, result->trajectory,
+                            result->nlopt_result);
+  }
+}
+
+template <int _N>
+bool BatchPlanner<_N>::getCacheParameters(const Job& job,
+                                          std::vector<double>* parameters) {
+  CHECK_NOTNULL(parameters);
+  parameters->clear();
+  parameters->push_back(N);
+  parameters->push_back(job.optimize_nonlinear);
+  if (!job.optimize_nonlinear) {
+    return true;
+  }
+  const NonlinearOptimizationParameters& p = job.parameters;
+  if (p.random_seed < 0 || p.max_time > 0.0) {
+    return false;
+  }
+  const double values[] = {static_cast<double>(job.optimize_time_only),
+                           p.f_abs,
+                           p.f_rel,
+                           p.x_rel,
+                           p.x_abs,
+                           p.initial_stepsize_rel,
+                           p.equality_constraint_tolerance,
+                           p.inequality_constraint_tolerance,
+                           static_cast<double>(p.max_iterations),
+                           p.time_penalty,
+                           static_cast<double>(p.algorithm),
+                           static_cast<double>(p.random_seed),
+                           static_cast<double>(p.use_soft_constraints),
+                           p.soft_constraint_weight};
+  parameters->insert(parameters->end(), std::begin(values), std::end(values));
+  for (const std::pair<const int, double>& constraint :
+       job.maximum_magnitude_constraints) {
+    // A limit on the position magnitude changes under translation, so a
+    // solution cannot be moved to translated vertices.
+    if (constraint.first == derivative_order::POSITION) {
+      return false;
+    }
+    parameters->push_back(constraint.first);
+    parameters->push_back(constraint.second);
+  }
+  return true;
+}
+
+template <int _N>
+void BatchPlanner<_N>::solveJob(const Job& job, WorkerState* worker_state,
+                                Result* result) {
+  CHECK_NOTNULL(worker_state);
+  CHECK_NOTNULL(result);
+  if (job.vertices.size() < 2 ||
+      job.segment_times.size() + 1 != job.vertices.size()) {
+    LOG(WARNING) << "Invalid job with " << job.vertices.size()
+                 << " vertices and " << job.segment_times.size()
+                 << " segment times.";
+    return;
+  }
+  const size_t dimension = job.vertices.front().D();
+
+  if (!job.optimize_nonlinear) {
+    std::unique_ptr<PolynomialOptimization<N> >& optimizer =
+        worker_state->linear_optimizer;
+    if (!optimizer || optimizer->getDimension() != dimension) {
+      optimizer.reset(new PolynomialOptimization<N>(dimension));
+    }
+    result->success = optimizer->setupFromVertices(
+                          job.vertices, job.segment_times,
+                          job.derivative_to_optimize) &&
+                      optimizer->solveLinear();
+    if (result->success) {
+      optimizer->getTrajectory(&result->trajectory);
+    }
+    return;
+  }
+
+  // The nonlinear optimizer accumulates constraints and its nlopt setup per
+  // problem, thus it is set up for every job.
+  PolynomialOptimizationNonLinear<N> optimizer(dimension, job.parameters,
+                                               job.optimize_time_only);
+  if (!optimizer.setupFromVertices(job.vertices, job.segment_times,
+                                   job.derivative_to_optimize)) {
+    return;
+  }
+  for (const std::pair<const int, double>& constraint :
+       job.maximum_magnitude_constraints) {
+    optimizer.addMaximumMagnitudeConstraint(constraint.first,
+                                            constraint.second);
+  }
+  result->nlopt_result = optimizer.optimize();
+  result->success = result->nlopt_result > 0;
+  result->optimization_info = optimizer.getOptimizationInfo();
+  optimizer.getTrajectory(&result->trajectory);
+}
+
+}  // namespace mav_trajectory_generation
+
+#endif  // MAV_TRAJECTORY_GENERATION_IMPL_BATCH_PLANNER_IMPL_H_
@@ -0,0 +1,144 @@
+/*
+ * Copyright (c) 2016, Markus Achtelik, ASL, ETH Zurich, Switzerland
+ * Copyright (c) 2016, Michael Burri, ASL, ETH Zurich, Switzerland
+ * Copyright (c) 2016, Helen Oleynikova, ASL, ETH Zurich, Switzerland
+ * Copyright (c) 2016, Rik Bähnemann, ASL, ETH Zurich, Switzerland
+ * Copyright (c) 2016, Marija Popovic, ASL, ETH Zurich, Switzerland
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef MAV_TRAJECTORY_GENERATION_IMPL_POLYNOMIAL_OPTIMIZATION_DECOUPLED_IMPL_H_
+#define MAV_TRAJECTORY_GENERATION_IMPL_POLYNOMIAL_OPTIMIZATION_DECOUPLED_IMPL_H_
+
+#include <glog/logging.h>
+
+#include "mav_trajectory_generation/thread_pool.h"
+
+namespace mav_trajectory_generation {
+
+template <int _N, int _N_yaw>
+PolynomialOptimizationDecoupledYaw<_N, _N_yaw>::
+    PolynomialOptimizationDecoupledYaw(
+        size_t dimension, const NonlinearOptimizationParameters& parameters,
+        bool optimize_time_only)
+    : dimension_(dimension),
+      position_opt_(dimension - 1, parameters, optimize_time_only),
+      yaw_opt_(1) {
+  CHECK_GE(dimension, 2u);
+}
+
+template <int _N, int _N_yaw>
+bool PolynomialOptimizationDecoupledYaw<_N, _N_yaw>::setupFromVertices(
+    const Vertex::Vector& vertices, const std::vector<double>& segment_times,
+    int derivative_to_optimize, int yaw_derivative_to_optimize) {
+  Vertex::Vector position_vertices;
+  Vertex::Vector yaw_vertices;
+  position_vertices.reserve(vertices.size());
+  yaw_vertices.reserve(vertices.size());
+  for (const Vertex& vertex : vertices) {
+    CHECK_EQ(static_cast<size_t>(vertex.D()), dimension_);
+    position_vertices.push_back(
+        vertex.getVertexWithDimensions(0, dimension_ - 1));
+    yaw_vertices.push_back(vertex.getVertexWithDimensions(dimension_ - 1, 1));
+    for (int derivative = N_yaw / 2; derivative <= N / 2; ++derivative) {
+      yaw_vertices.back().removeConstraint(derivative);
+    }
+  }
+  return yaw_opt_.setupFromVertices(yaw_vertices, segment_times,
+                                    yaw_derivative_to_optimize) &&
+         position_opt_.setupFromVertices(position_vertices, segment_times,
+                                         derivative_to_optimize);
+}
+
+template <int _N, int _N_yaw>
+bool PolynomialOptimizationDecoupledYaw<_N, _N_yaw>::
+    addMaximumMagnitudeConstraint(int derivative_order, double maximum_value) {
+  return position_opt_.addMaximumMagnitudeConstraint(derivative_order,
+                                                     maximum_value);
+}
+
+template <int _N, int _N_yaw>
+bool PolynomialOptimizationDecoupledYaw<_N, _N_yaw>::solveLinear(
+    ThreadPool* thread_pool) {
+  std::vector<double> segment_times;
+  position_opt_.getPolynomialOptimizationRef().getSegmentTimes(&segment_times);
+  yaw_opt_.updateSegmentTimes(segment_times);
+
+  bool success[2] = {false, false};
+  const ThreadPool::Job job = [this, &success](size_t job_idx, size_t) {
+    success[job_idx] =
+        job_idx == 0 ? position_opt_.solveLinear() : yaw_opt_.solveLinear();
+  };
+  if (thread_pool != nullptr && thread_pool->getNumberThreads() > 1) {
+    thread_pool->parallelFor(2, job);
+  } else {
+    job(0, 0);
+    job(1, 0);
+  }
+  return success[0] && success[1];
+}
+
+template <int _N, int _N_yaw>
+int PolynomialOptimizationDecoupledYaw<_N, _N_yaw>::optimize(
+    ThreadPool* thread_pool) {
+  position_opt_.setCoupledCost(
+      [this](const std::vector<double>& segment_times,
+             std::vector<double>* gradient) {
+        return computeYawCost(segment_times, gradient);
+      },
+      thread_pool);
+  const int result = position_opt_.optimize();
+  position_opt_.setCoupledCost(
+      typename PolynomialOptimizationNonLinear<N>::CoupledCost());
+
+  // The last objective evaluation may not have been at the solution.
+  std::vector<double> segment_times;
+  position_opt_.getPolynomialOptimizationRef().getSegmentTimes(&segment_times);
+  computeYawCost(segment_times, nullptr);
+  return result;
+}
+
+template <int _N, int _N_yaw>
+bool PolynomialOptimizationDecoupledYaw<_N, _N_yaw>::getTrajectory(
+    Trajectory* trajectory) const {
+  CHECK_NOTNULL(trajectory);
+  Trajectory position_trajectory;
+  Trajectory yaw_trajectory;
+  position_opt_.getTrajectory(&position_trajectory);
+  yaw_opt_.getTrajectory(&yaw_trajectory);
+  return position_trajectory.getTrajectoryWithAppendedDimension(yaw_trajectory,
+                                                                trajectory);
+}
+
+template <int _N, int _N_yaw>
+double PolynomialOptimizationDecoupledYaw<_N, _N_yaw>::computeYawCost(
+    const std::vector<double>& segment_times, std::vector<double>* gradient) {
+  yaw_opt_.updateSegmentTimes(segment_times);
+  yaw_opt_.solveLinear();
+  if (gradient != nullptr) {
+    // The free constraints are optimal, thus the partial derivatives w.r.t.
+    // the segment times are the total ones.
+    std::vector<double> gradient_segment_times;
+    yaw_opt_.computeCostGradient(&gradient_segment_times, nullptr);
+    CHECK_EQ(gradient->size(), gradient_segment_times.size());
+    for (size_t i = 0; i < gradient->size(); ++i) {
+      (*gradient)[i] += gradient_segment_times[i];
+    }
+  }
+  return yaw_opt_.computeCost();
+}
+
+}  // namespace mav_trajectory_generation
+
+#endif  // MAV_TRAJECTORY_GENERATION_IMPL_POLYNOMIAL_OPTIMIZATION_DECOUPLED_IMPL_H_
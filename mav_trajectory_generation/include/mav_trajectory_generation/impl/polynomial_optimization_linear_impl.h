@@ -22,25 +22,38 @@
 #define MAV_TRAJECTORY_GENERATION_IMPL_POLYNOMIAL_OPTIMIZATION_LINEAR_IMPL_H_
 
 #include <glog/logging.h>
+#include <Eigen/Dense>
 #include <Eigen/Sparse>
-#include <set>
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <numeric>
 #include <tuple>
 
 #include "mav_trajectory_generation/convolution.h"
+#include "mav_trajectory_generation/thread_pool.h"
+#include "mav_trajectory_generation/timing.h"
 
 namespace mav_trajectory_generation {
 
 template <int _N>
 PolynomialOptimization<_N>::PolynomialOptimization(size_t dimension)
-    : dimension_(dimension),
+    : vertices_valid_(false),
+      dimension_(dimension),
       derivative_to_optimize_(derivative_order::INVALID),
       n_vertices_(0),
       n_segments_(0),
       n_all_constraints_(0),
       n_fixed_constraints_(0),
-      n_free_constraints_(0) {
-  fixed_constraints_compact_.resize(dimension_);
-  free_constraints_compact_.resize(dimension_);
+      n_free_constraints_(0),
+      free_constraints_set_(false),
+      linear_solver_type_(kLinearSolverDefault),
+      R_pattern_valid_(false),
+      normalize_(false),
+      condition_estimate_(0.0),
+      factorized_solver_type_(kLinearSolverDefault) {
+  fixed_constraints_compact_.resize(0, dimension_);
+  free_constraints_compact_.resize(0, dimension_);
 }
 
 template <int _N>
@@ -56,22 +69,66 @@ bool PolynomialOptimization<_N>::setupFromVertices(
 
   derivative_to_optimize_ = derivative_to_optimize;
   vertices_ = vertices;
-  segment_times_ = times;
-
-  n_vertices_ = vertices.size();
-  n_segments_ = n_vertices_ - 1;
+  vertices_valid_ = true;
+  setupFromCurrentVertices(times);
+  return true;
+}
 
-  segments_.resize(n_segments_, Segment(N, dimension_));
+template <int _N>
+bool PolynomialOptimization<_N>::setupFromMatrices(
+    const std::vector<Eigen::MatrixXd>& derivatives,
+    const ConstraintMask& constraint_mask,
+    const std::vector<double>& segment_times, int derivative_to_optimize) {
+  CHECK(derivative_to_optimize >= 0 &&
+        derivative_to_optimize <= kHighestDerivativeToOptimize)
+      << "You tried to optimize the " << derivative_to_optimize
+      << "th derivative of position on a " << N << "th order polynomial.";
+  const size_t n_vertices = constraint_mask.cols();
+  CHECK_EQ(derivatives.size(), static_cast<size_t>(constraint_mask.rows()));
+  CHECK_EQ(n_vertices, segment_times.size() + 1)
+      << "Size of times must be one less than the number of vertices.";
+  for (const Eigen::MatrixXd& values : derivatives) {
+    CHECK_EQ(static_cast<size_t>(values.rows()), dimension_);
+    CHECK_EQ(static_cast<size_t>(values.cols()), n_vertices);
+  }
+  const int n_derivatives =
+      std::min<int>(constraint_mask.rows(), kHighestDerivativeToOptimize + 1);
+  if (constraint_mask.rows() > n_derivatives &&
+      constraint_mask.bottomRows(constraint_mask.rows() - n_derivatives)
+          .any()) {
+    LOG(WARNING) << "Invalid constraints: maximum possible derivative is "
+                 << kHighestDerivativeToOptimize << ". Ignoring constraints.";
+  }
 
-  CHECK(n_vertices_ == times.size() + 1)
-      << "Size of times must be one less than positions.";
+  derivative_to_optimize_ = derivative_to_optimize;
+  vertices_.clear();
+  vertices_valid_ = false;
+  fixed_constraint_mask_ = ConstraintMask::Constant(N / 2, n_vertices, false);
+  fixed_constraint_mask_.topRows(n_derivatives) =
+      constraint_mask.topRows(n_derivatives);
+  fixed_constraints_compact_.resize(fixed_constraint_mask_.count(),
+                                    dimension_);
+  int row = 0;
+  for (size_t vertex_idx = 0; vertex_idx < n_vertices; ++vertex_idx) {
+    for (int derivative = 0; derivative < n_derivatives; ++derivative) {
+      if (fixed_constraint_mask_(derivative, vertex_idx)) {
+        fixed_constraints_compact_.row(row++) =
+            derivatives[derivative].col(vertex_idx).transpose();
+      }
+    }
+  }
+  setupFromCurrentConstraints(segment_times);
+  return true;
+}
 
-  inverse_mapping_matrices_.resize(n_segments_);
-  cost_matrices_.resize(n_segments_);
+template <int _N>
+void PolynomialOptimization<_N>::setupFromCurrentVertices(
+    const std::vector<double>& times) {
+  const size_t n_vertices = vertices_.size();
 
   // Iterate through all vertices and remove invalid constraints (order too
   // high).
-  for (size_t vertex_idx = 0; vertex_idx < n_vertices_; ++vertex_idx) {
+  for (size_t vertex_idx = 0; vertex_idx < n_vertices; ++vertex_idx) {
     Vertex& vertex = vertices_[vertex_idx];
 
     // Check if we have valid constraints.
@@ -93,8 +150,252 @@ bool PolynomialOptimization<_N>::setupFromVertices(
       vertex = vertex_tmp;
     }
   }
+
+  // The fixed constraints, ordered by vertex and derivative.
+  fixed_constraint_mask_.resize(N / 2, n_vertices);
+  for (size_t vertex_idx = 0; vertex_idx < n_vertices; ++vertex_idx) {
+    for (int derivative = 0; derivative < N / 2; ++derivative) {
+      fixed_constraint_mask_(derivative, vertex_idx) =
+          vertices_[vertex_idx].hasConstraint(derivative);
+    }
+  }
+  fixed_constraints_compact_.resize(fixed_constraint_mask_.count(),
+                                    dimension_);
+  int row = 0;
+  Vertex::ConstraintValue value;
+  for (size_t vertex_idx = 0; vertex_idx < n_vertices; ++vertex_idx) {
+    for (int derivative = 0; derivative < N / 2; ++derivative) {
+      if (vertices_[vertex_idx].getConstraint(derivative, &value)) {
+        fixed_constraints_compact_.row(row++) = value.transpose();
+      }
+    }
+  }
+  setupFromCurrentConstraints(times);
+}
+
+template <int _N>
+void PolynomialOptimization<_N>::setupFromCurrentConstraints(
+    const std::vector<double>& times) {
+  MAV_TRAJECTORY_GENERATION_ALLOCATION_PHASE("poly_opt_setup");
+  segment_times_ = times;
+
+  n_vertices_ = fixed_constraint_mask_.cols();
+  n_segments_ = n_vertices_ - 1;
+
+  segments_.resize(n_segments_, Segment(N, dimension_));
+
+  CHECK(n_vertices_ == times.size() + 1)
+      << "Size of times must be one less than positions.";
+
+  inverse_mapping_matrices_.resize(n_segments_);
+  cost_matrices_.resize(n_segments_);
+  cost_unconstrained_blocks_.resize(n_segments_);
+  segment_changed_.assign(n_segments_, true);
+  segment_outdated_.assign(n_segments_, true);
+  R_pattern_valid_ = false;
+  free_constraints_set_ = false;
+
   updateSegmentTimes(times);
   setupConstraintReorderingMatrix();
+}
+
+template <int _N>
+void PolynomialOptimization<_N>::getVerticesFromConstraints(
+    Vertex::Vector* vertices) const {
+  CHECK_NOTNULL(vertices);
+  vertices->assign(fixed_constraint_mask_.cols(), Vertex(dimension_));
+  int row = 0;
+  for (size_t vertex_idx = 0; vertex_idx < vertices->size(); ++vertex_idx) {
+    for (int derivative = 0; derivative < N / 2; ++derivative) {
+      if (fixed_constraint_mask_(derivative, vertex_idx)) {
+        (*vertices)[vertex_idx].addConstraint(
+            derivative, fixed_constraints_compact_.row(row++).transpose());
+      }
+    }
+  }
+}
+
+template <int _N>
+void PolynomialOptimization<_N>::updateVertices() {
+  if (!vertices_valid_) {
+    getVerticesFromConstraints(&vertices_);
+    vertices_valid_ = true;
+  }
+}
+
+template <int _N>
+void PolynomialOptimization<_N>::updateHorizon(
+    const Vertex::Vector& vertices, const std::vector<double>& segment_times,
+    int vertex_offset) {
+  CHECK_GE(vertices.size(), 2u);
+  std::vector<ConstraintKey> previous_keys;
+  getFreeConstraintKeys(&previous_keys);
+  const bool has_previous_free_constraints = free_constraints_set_;
+  Eigen::MatrixXd previous_free_constraints;
+  previous_free_constraints.swap(free_constraints_compact_);
+
+  vertices_ = vertices;
+  vertices_valid_ = true;
+  setupFromCurrentVertices(segment_times);
+
+  std::vector<ConstraintKey> keys;
+  getFreeConstraintKeys(&keys);
+  CHECK_EQ(keys.size(), n_free_constraints_);
+  free_constraints_compact_.setZero(n_free_constraints_, dimension_);
+
+  // Both sets of keys are sorted by vertex and derivative.
+  size_t previous_idx = 0;
+  for (size_t idx = 0;
+       has_previous_free_constraints && idx < keys.size(); ++idx) {
+    const int previous_vertex =
+        static_cast<int>(keys[idx].first) + vertex_offset;
+    if (previous_vertex < 0) {
+      continue;
+    }
+    const ConstraintKey previous_key(previous_vertex, keys[idx].second);
+    while (previous_idx < previous_keys.size() &&
+           previous_keys[previous_idx] < previous_key) {
+      ++previous_idx;
+    }
+    if (previous_idx == previous_keys.size()) {
+      break;
+    }
+    if (previous_keys[previous_idx] == previous_key) {
+      free_constraints_compact_.row(idx) =
+          previous_free_constraints.row(previous_idx);
+    }
+  }
+  free_constraints_set_ = true;
+  updateSegmentsFromCompactConstraints();
+}
+
+template <int _N>
+void PolynomialOptimization<_N>::getFreeConstraintKeys(
+    std::vector<ConstraintKey>* keys) const {
+  CHECK_NOTNULL(keys);
+  keys->clear();
+  keys->reserve(n_free_constraints_);
+  for (size_t vertex_idx = 0; vertex_idx < n_vertices_; ++vertex_idx) {
+    for (int derivative = 0; derivative < N / 2; ++derivative) {
+      if (!fixed_constraint_mask_(derivative, vertex_idx)) {
+        keys->emplace_back(vertex_idx, derivative);
+      }
+    }
+  }
+}
+
+template <int _N>
+bool PolynomialOptimization<_N>::removeVertices(size_t n_front,
+                                                size_t n_back) {
+  CHECK_GT(n_vertices_, 0u) << "setupFromVertices() has to be called first.";
+  updateVertices();
+  if (n_front + n_back + 2 > n_vertices_) {
+    LOG(WARNING) << "Cannot remove " << n_front + n_back << " of "
+                 << n_vertices_ << " vertices, at least two have to remain.";
+    return false;
+  }
+  const Vertex::Vector vertices(vertices_.begin() + n_front,
+                                vertices_.end() - n_back);
+  const std::vector<double> segment_times(segment_times_.begin() + n_front,
+                                          segment_times_.end() - n_back);
+  updateHorizon(vertices, segment_times, n_front);
+  return true;
+}
+
+template <int _N>
+bool PolynomialOptimization<_N>::prependVertices(
+    const Vertex::Vector& vertices, const std::vector<double>& segment_times) {
+  CHECK_GT(n_vertices_, 0u) << "setupFromVertices() has to be called first.";
+  updateVertices();
+  CHECK_EQ(vertices.size(), segment_times.size());
+  Vertex::Vector new_vertices(vertices);
+  new_vertices.insert(new_vertices.end(), vertices_.begin(), vertices_.end());
+  std::vector<double> new_segment_times(segment_times);
+  new_segment_times.insert(new_segment_times.end(), segment_times_.begin(),
+                           segment_times_.end());
+  updateHorizon(new_vertices, new_segment_times,
+                -static_cast<int>(vertices.size()));
+  return true;
+}
+
+template <int _N>
+bool PolynomialOptimization<_N>::appendVertices(
+    const Vertex::Vector& vertices, const std::vector<double>& segment_times) {
+  CHECK_GT(n_vertices_, 0u) << "setupFromVertices() has to be called first.";
+  updateVertices();
+  CHECK_EQ(vertices.size(), segment_times.size());
+  Vertex::Vector new_vertices(vertices_);
+  new_vertices.insert(new_vertices.end(), vertices.begin(), vertices.end());
+  std::vector<double> new_segment_times(segment_times_);
+  new_segment_times.insert(new_segment_times.end(), segment_times.begin(),
+                           segment_times.end());
+  updateHorizon(new_vertices, new_segment_times, 0);
+  return true;
+}
+
+template <int _N>
+bool PolynomialOptimization<_N>::pinStartToTrajectory(
+    const Trajectory& trajectory, double t) {
+  CHECK_GT(n_vertices_, 0u) << "setupFromVertices() has to be called first.";
+  updateVertices();
+  CHECK_EQ(static_cast<size_t>(trajectory.D()), dimension_);
+  if (t < trajectory.getMinTime() || t > trajectory.getMaxTime()) {
+    LOG(WARNING) << "Time " << t << " is outside of the trajectory ["
+                 << trajectory.getMinTime() << ", " << trajectory.getMaxTime()
+                 << "].";
+    return false;
+  }
+  Vertex::Vector vertices(vertices_);
+  for (int derivative = 0; derivative <= derivative_to_optimize_;
+       ++derivative) {
+    vertices.front().addConstraint(derivative,
+                                   trajectory.evaluate(t, derivative));
+  }
+  updateHorizon(vertices, segment_times_, 0);
+  return true;
+}
+
+template <int _N>
+bool PolynomialOptimization<_N>::advanceStart(const Trajectory& trajectory,
+                                              double t) {
+  CHECK_GT(n_vertices_, 0u) << "setupFromVertices() has to be called first.";
+  updateVertices();
+  CHECK_EQ(static_cast<size_t>(trajectory.D()), dimension_);
+  // Segments shorter than this are merged with the next one.
+  constexpr double kMinimumSegmentTime = 1.0e-3;
+
+  double t_segment_end = 0.0;
+  size_t segment_idx = 0;
+  for (; segment_idx < n_segments_; ++segment_idx) {
+    t_segment_end += segment_times_[segment_idx];
+    if (t_segment_end - t >= kMinimumSegmentTime) {
+      break;
+    }
+  }
+  if (t < 0.0 || segment_idx == n_segments_) {
+    LOG(WARNING) << "Cannot advance the start to time " << t
+                 << " of a problem with a duration of " << t_segment_end
+                 << ".";
+    return false;
+  }
+  if (std::abs(trajectory.getMaxTime() - std::accumulate(
+                                             segment_times_.begin(),
+                                             segment_times_.end(), 0.0)) >
+      kMinimumSegmentTime) {
+    LOG(WARNING) << "The trajectory is not a solution of this problem.";
+    return false;
+  }
+
+  Vertex::Vector vertices(vertices_.begin() + segment_idx, vertices_.end());
+  std::vector<double> segment_times(segment_times_.begin() + segment_idx,
+                                    segment_times_.end());
+  segment_times.front() = t_segment_end - t;
+  for (int derivative = 0; derivative <= derivative_to_optimize_;
+       ++derivative) {
+    vertices.front().addConstraint(derivative,
+                                   trajectory.evaluate(t, derivative));
+  }
+  updateHorizon(vertices, segment_times, segment_idx);
   return true;
 }
 
@@ -110,6 +411,96 @@ void PolynomialOptimization<_N>::setupMappingMatrix(double segment_time,
   }
 }
 
+template <int _N>
+const typename PolynomialOptimization<_N>::SquareMatrix&
+PolynomialOptimization<_N>::getUnitInverseMappingMatrix() {
+  static const SquareMatrix unit_inverse_mapping_matrix = []() {
+    SquareMatrix A, A_inv;
+    setupMappingMatrix(1.0, &A);
+    invertMappingMatrix(A, &A_inv);
+    return A_inv;
+  }();
+  return unit_inverse_mapping_matrix;
+}
+
+template <int _N>
+const typename PolynomialOptimization<_N>::SquareMatrix&
+PolynomialOptimization<_N>::getUnitCostMatrix(int derivative) {
+  CHECK_GE(derivative, 0);
+  CHECK_LE(derivative, kHighestDerivativeToOptimize);
+  static const SquareMatrixVector unit_cost_matrices = []() {
+    SquareMatrixVector cost_matrices(kHighestDerivativeToOptimize + 1);
+    for (int r = 0; r <= kHighestDerivativeToOptimize; ++r) {
+      computeQuadraticCostJacobian(r, 1.0, &cost_matrices[r]);
+    }
+    return cost_matrices;
+  }();
+  return unit_cost_matrices[derivative];
+}
+
+template <int _N>
+const typename PolynomialOptimization<_N>::SquareMatrix&
+PolynomialOptimization<_N>::getUnitCostBlock(int derivative) {
+  CHECK_GE(derivative, 0);
+  CHECK_LE(derivative, kHighestDerivativeToOptimize);
+  static const SquareMatrixVector unit_cost_blocks = []() {
+    const SquareMatrix& A_inv = getUnitInverseMappingMatrix();
+    SquareMatrixVector cost_blocks(kHighestDerivativeToOptimize + 1);
+    for (int r = 0; r <= kHighestDerivativeToOptimize; ++r) {
+      cost_blocks[r] = A_inv.transpose() * getUnitCostMatrix(r) * A_inv;
+    }
+    return cost_blocks;
+  }();
+  return unit_cost_blocks[derivative];
+}
+
+template <int _N>
+void PolynomialOptimization<_N>::computeTimeScaledCostBlock(
+    int derivative, double segment_time, SquareMatrix* cost_block) {
+  CHECK_NOTNULL(cost_block);
+  const int half_n = N / 2;
+  Eigen::Matrix<double, N, 1> constraint_scaling;
+  constraint_scaling[0] = 1.0;
+  for (int k = 1; k < half_n; ++k) {
+    constraint_scaling[k] = constraint_scaling[k - 1] * segment_time;
+  }
+  constraint_scaling.template tail<half_n>() =
+      constraint_scaling.template head<half_n>();
+  const double cost_scaling = std::pow(segment_time, 1 - 2 * derivative);
+  *cost_block = cost_scaling * constraint_scaling.asDiagonal() *
+                getUnitCostBlock(derivative) * constraint_scaling.asDiagonal();
+}
+
+template <int _N>
+void PolynomialOptimization<_N>::computeTimeScaledMatrices(
+    int derivative, double segment_time, SquareMatrix* inverse_mapping_matrix,
+    SquareMatrix* cost_matrix) {
+  CHECK_NOTNULL(inverse_mapping_matrix);
+  CHECK_NOTNULL(cost_matrix);
+  Eigen::Matrix<double, N, 1> t_powers, t_inverse_powers;
+  t_powers[0] = 1.0;
+  t_inverse_powers[0] = 1.0;
+  const double t_inverse = 1.0 / segment_time;
+  for (int k = 1; k < N; ++k) {
+    t_powers[k] = t_powers[k - 1] * segment_time;
+    t_inverse_powers[k] = t_inverse_powers[k - 1] * t_inverse;
+  }
+
+  // The constraints are [d^0 .. d^{N/2-1} at t=0, d^0 .. d^{N/2-1} at t=T].
+  const int half_n = N / 2;
+  Eigen::Matrix<double, N, 1> constraint_scaling;
+  constraint_scaling << t_powers.template head<half_n>(),
+      t_powers.template head<half_n>();
+  *inverse_mapping_matrix = t_inverse_powers.asDiagonal() *
+                            getUnitInverseMappingMatrix() *
+                            constraint_scaling.asDiagonal();
+
+  // t^(1 - 2r) = t * (1/t)^(2r), 2r < N.
+  const double cost_scaling = segment_time * t_inverse_powers[2 * derivative];
+  *cost_matrix = cost_scaling * t_powers.asDiagonal() *
+                 getUnitCostMatrix(derivative) * t_powers.asDiagonal();
+}
+
 template <int _N>
 double PolynomialOptimization<_N>::computeCost() const {
   CHECK(n_segments_ == segments_.size() &&
@@ -120,9 +511,9 @@ double PolynomialOptimization<_N>::computeCost() const {
     const Segment& segment = segments_[segment_idx];
     for (size_t dimension_idx = 0; dimension_idx < dimension_;
          ++dimension_idx) {
-      const Eigen::VectorXd c =
-          segment[dimension_idx].getCoefficients(derivative_order::POSITION);
-      const double partial_cost = c.transpose() * Q * c;
+      const Eigen::Map<const Eigen::Matrix<double, N, 1>> c(
+          segment[dimension_idx].getCoefficientsRef().data());
+      const double partial_cost = c.dot(Q * c);
       cost += partial_cost;
     }
   }
@@ -170,104 +561,100 @@ void PolynomialOptimization<_N>::invertMappingMatrix(
 
 template <int _N>
 void PolynomialOptimization<_N>::setupConstraintReorderingMatrix() {
-  typedef Eigen::Triplet<double> Triplet;
-  std::vector<Triplet> reordering_list;
-
-  const size_t n_vertices = vertices_.size();
-
-  std::vector<Constraint> all_constraints;
-  std::set<Constraint> fixed_constraints;
-  std::set<Constraint> free_constraints;
-
-  all_constraints.reserve(
-      n_vertices_ * N /
-      2);  // Will have exactly this number of elements in the end.
-
-  for (size_t vertex_idx = 0; vertex_idx < n_vertices; ++vertex_idx) {
-    const Vertex& vertex = vertices_[vertex_idx];
-
-    // Extract constraints and sort them to fixed and free. For the start and
-    // end Vertex, we need to do this once, while we need to do it twice for the
-    // other vertices, since constraints are shared and enforce continuity.
-    int n_constraint_occurence = 2;
-    if (vertex_idx == 0 || vertex_idx == (n_segments_))
-      n_constraint_occurence = 1;
-    for (int co = 0; co < n_constraint_occurence; ++co) {
-      for (size_t constraint_idx = 0; constraint_idx < N / 2;
-           ++constraint_idx) {
-        Constraint constraint;
-        constraint.vertex_idx = vertex_idx;
-        constraint.constraint_idx = constraint_idx;
-        bool has_constraint =
-            vertex.getConstraint(constraint_idx, &(constraint.value));
-        if (has_constraint) {
-          all_constraints.push_back(constraint);
-          fixed_constraints.insert(constraint);
-        } else {
-          constraint.value = Vertex::ConstraintValue::Constant(dimension_, 0);
-          all_constraints.push_back(constraint);
-          free_constraints.insert(constraint);
-        }
-      }
+  const int n_constraints_per_vertex = N / 2;
+  CHECK_EQ(fixed_constraint_mask_.rows(), n_constraints_per_vertex);
+
+  // The column of a constraint is its rank among the fixed constraints, or
+  // the number of fixed constraints plus its rank among the free ones, both
+  // ordered by vertex and derivative.
+  n_fixed_constraints_ = fixed_constraint_mask_.count();
+  n_free_constraints_ = fixed_constraint_mask_.size() - n_fixed_constraints_;
+  std::vector<int> constraint_columns(fixed_constraint_mask_.size());
+  int fixed_col = 0;
+  int free_col = n_fixed_constraints_;
+  for (size_t vertex_idx = 0; vertex_idx < n_vertices_; ++vertex_idx) {
+    for (int derivative = 0; derivative < n_constraints_per_vertex;
+         ++derivative) {
+      constraint_columns[vertex_idx * n_constraints_per_vertex + derivative] =
+          fixed_constraint_mask_(derivative, vertex_idx) ? fixed_col++
+                                                         : free_col++;
     }
   }
 
-  n_all_constraints_ = all_constraints.size();
-  n_fixed_constraints_ = fixed_constraints.size();
-  n_free_constraints_ = free_constraints.size();
+  // Segment i has the constraints of vertex i followed by those of vertex
+  // i + 1, thus the constraints of inner vertices appear twice.
+  n_all_constraints_ = n_segments_ * N;
+  constraint_reordered_indices_.resize(n_all_constraints_);
+  for (size_t i = 0; i < n_segments_; ++i) {
+    std::copy(constraint_columns.begin() + i * n_constraints_per_vertex,
+              constraint_columns.begin() + i * n_constraints_per_vertex + N,
+              constraint_reordered_indices_.begin() + i * N);
+  }
 
-  reordering_list.reserve(n_all_constraints_);
-  constraint_reordering_ = Eigen::SparseMatrix<double>(
-      n_all_constraints_, n_fixed_constraints_ + n_free_constraints_);
+  // C has a single 1 per row.
+  const int n_constraints = n_fixed_constraints_ + n_free_constraints_;
+  Eigen::VectorXi column_nonzeros = Eigen::VectorXi::Zero(n_constraints);
+  for (int col : constraint_reordered_indices_) {
+    ++column_nonzeros[col];
+  }
+  constraint_reordering_ =
+      Eigen::SparseMatrix<double>(n_all_constraints_, n_constraints);
+  constraint_reordering_.reserve(column_nonzeros);
+  for (size_t row = 0; row < n_all_constraints_; ++row) {
+    constraint_reordering_.insert(row, constraint_reordered_indices_[row]) =
+        1.0;
+  }
+  constraint_reordering_.makeCompressed();
 
-  for (Eigen::VectorXd& df : fixed_constraints_compact_)
-    df.resize(n_fixed_constraints_, Eigen::NoChange);
+  setupCachedRPattern();
+}
 
-  int row = 0;
-  int col = 0;
-  for (const Constraint& ca : all_constraints) {
-    for (const Constraint& cf : fixed_constraints) {
-      if (ca == cf) {
-        reordering_list.emplace_back(Triplet(row, col, 1.0));
-        for (size_t d = 0; d < dimension_; ++d) {
-          Eigen::VectorXd& df = fixed_constraints_compact_[d];
-          const Eigen::VectorXd constraint_all_dimensions = cf.value;
-          df[col] = constraint_all_dimensions[d];
-        }
-      }
-      ++col;
+template <int _N>
+void PolynomialOptimization<_N>::updateSegmentsFromCompactConstraints() {
+  Eigen::Matrix<double, N, 1> new_d;
+  for (size_t i = 0; i < n_segments_; ++i) {
+    if (!segment_outdated_[i]) {
+      continue;
     }
-    for (const Constraint& cp : free_constraints) {
-      if (ca == cp) reordering_list.emplace_back(Triplet(row, col, 1.0));
-      ++col;
+    Segment& segment = segments_[i];
+    segment.setTime(segment_times_[i]);
+    for (size_t dimension_idx = 0; dimension_idx < dimension_;
+         ++dimension_idx) {
+      // new_d = C * [df; dp] for this segment.
+      getSegmentConstraints(i, fixed_constraints_compact_.col(dimension_idx),
+                            free_constraints_compact_.col(dimension_idx),
+                            &new_d);
+      segment[dimension_idx].setCoefficients(inverse_mapping_matrices_[i] *
+                                             new_d);
     }
-    col = 0;
-    ++row;
+    segment_outdated_[i] = false;
   }
-
-  constraint_reordering_.setFromTriplets(reordering_list.begin(),
-                                         reordering_list.end());
 }
 
 template <int _N>
-void PolynomialOptimization<_N>::updateSegmentsFromCompactConstraints() {
-  const size_t n_all_constraints = n_fixed_constraints_ + n_free_constraints_;
-
-  for (size_t dimension_idx = 0; dimension_idx < dimension_; ++dimension_idx) {
-    const Eigen::VectorXd& df = fixed_constraints_compact_[dimension_idx];
-    const Eigen::VectorXd& dp_opt = free_constraints_compact_[dimension_idx];
-
-    Eigen::VectorXd d_all(n_all_constraints);
-    d_all << df, dp_opt;
-
-    for (size_t i = 0; i < n_segments_; ++i) {
-      const Eigen::Matrix<double, N, 1> new_d =
-          constraint_reordering_.block(i * N, 0, N, n_all_constraints) * d_all;
-      const Eigen::Matrix<double, N, 1> coeffs =
-          inverse_mapping_matrices_[i] * new_d;
-      Segment& segment = segments_[i];
-      segment.setTime(segment_times_[i]);
-      segment[dimension_idx] = Polynomial(N, coeffs);
+void PolynomialOptimization<_N>::markSegmentsOfChangedFreeConstraints(
+    const Eigen::Ref<const Eigen::MatrixXd>& free_constraints) {
+  if (!free_constraints_set_ ||
+      free_constraints_compact_.rows() != free_constraints.rows() ||
+      free_constraints_compact_.cols() != free_constraints.cols()) {
+    segment_outdated_.assign(n_segments_, true);
+    return;
+  }
+  free_constraint_changed_.assign(n_free_constraints_, false);
+  for (size_t idx = 0; idx < n_free_constraints_; ++idx) {
+    free_constraint_changed_[idx] =
+        (free_constraints.row(idx).array() !=
+         free_constraints_compact_.row(idx).array())
+            .any();
+  }
+  // A free constraint is shared by the segments before and after its vertex.
+  for (size_t i = 0; i < n_segments_; ++i) {
+    for (int j = 0; j < N && !segment_outdated_[i]; ++j) {
+      const int idx = constraint_reordered_indices_[i * N + j];
+      if (idx >= static_cast<int>(n_fixed_constraints_) &&
+          free_constraint_changed_[idx - n_fixed_constraints_]) {
+        segment_outdated_[i] = true;
+      }
     }
   }
 }
@@ -275,58 +662,284 @@ void PolynomialOptimization<_N>::updateSegmentsFromCompactConstraints() {
 template <int _N>
 void PolynomialOptimization<_N>::updateSegmentTimes(
     const std::vector<double>& segment_times) {
+  MAV_TRAJECTORY_GENERATION_SCOPED_TIMER("poly_opt_update_segment_times");
   const size_t n_segment_times = segment_times.size();
   CHECK(n_segment_times == n_segments_)
       << "Number of segment times (" << n_segment_times
       << ") does not match number of segments (" << n_segments_ << ")";
 
-  segment_times_ = segment_times;
-
   for (size_t i = 0; i < n_segments_; ++i) {
     const double segment_time = segment_times[i];
     CHECK_GT(segment_time, 0) << "Segment times need to be greater than zero";
+    if (!segment_changed_[i] && segment_time == segment_times_[i]) {
+      continue;
+    }
 
-    computeQuadraticCostJacobian(derivative_to_optimize_, segment_time,
-                                 &cost_matrices_[i]);
-    SquareMatrix A;
-    setupMappingMatrix(segment_time, &A);
-    invertMappingMatrix(A, &inverse_mapping_matrices_[i]);
+    computeTimeScaledMatrices(derivative_to_optimize_, segment_time,
+                              &inverse_mapping_matrices_[i],
+                              &cost_matrices_[i]);
+    segment_changed_[i] = true;
+    segment_outdated_[i] = true;
   };
+
+  segment_times_ = segment_times;
 }
 
 template <int _N>
 void PolynomialOptimization<_N>::constructR(
     Eigen::SparseMatrix<double>* R) const {
+  MAV_TRAJECTORY_GENERATION_SCOPED_TIMER("poly_opt_construct_r");
   CHECK_NOTNULL(R);
+  // [1]: R = C^T * H * C. C: constraint_reodering_ ; H: cost_unconstrained,
+  // assembled from the block-H of each segment. C has a single 1 per row, thus
+  // element (row, col) of a block moves to the reordered indices of row and
+  // col, and elements of shared constraints are summed up.
+  const std::vector<int>& reordered_index = constraint_reordered_indices_;
   typedef Eigen::Triplet<double> Triplet;
-  std::vector<Triplet> cost_unconstrained_triplets;
-  cost_unconstrained_triplets.reserve(N * N * n_segments_);
+  std::vector<Triplet> R_triplets;
+  R_triplets.reserve(N * N * n_segments_);
 
   for (size_t i = 0; i < n_segments_; ++i) {
-    const SquareMatrix& Ai = inverse_mapping_matrices_[i];
-    const SquareMatrix& Q = cost_matrices_[i];
-    const SquareMatrix H = Ai.transpose() * Q * Ai;
-    const int start_pos = i * N;
-    for (int row = 0; row < N; ++row) {
-      for (int col = 0; col < N; ++col) {
-        cost_unconstrained_triplets.emplace_back(
-            Triplet(start_pos + row, start_pos + col, H(row, col)));
+    SquareMatrix H;
+    computeTimeScaledCostBlock(derivative_to_optimize_, segment_times_[i], &H);
+    for (int col = 0; col < N; ++col) {
+      for (int row = 0; row < N; ++row) {
+        R_triplets.emplace_back(reordered_index[i * N + row],
+                                reordered_index[i * N + col], H(row, col));
       }
     }
   }
-  Eigen::SparseMatrix<double> cost_unconstrained(N * n_segments_,
-                                                 N * n_segments_);
-  cost_unconstrained.setFromTriplets(cost_unconstrained_triplets.begin(),
-                                     cost_unconstrained_triplets.end());
+  const int n_constraints = n_fixed_constraints_ + n_free_constraints_;
+  R->resize(n_constraints, n_constraints);
+  R->setFromTriplets(R_triplets.begin(), R_triplets.end());
+}
 
-  // [1]: R = C^T * H * C. C: constraint_reodering_ ; H: cost_unconstrained,
-  // assembled from the block-H above.
-  *R = constraint_reordering_.transpose() * cost_unconstrained *
-       constraint_reordering_;
+template <int _N>
+void PolynomialOptimization<_N>::setupCachedRPattern() {
+  const std::vector<int>& reordered_index = constraint_reordered_indices_;
+  const int n_fixed = n_fixed_constraints_;
+
+  // Only the rows of free constraints of R are needed to solve for d_p, thus
+  // the elements of every block H are scattered directly into Rpp and Rpf.
+  // The constraints of vertex v couple to those of the vertices v - 1 to
+  // v + 1 through the segments on both sides. Iterating the vertices and
+  // derivatives in order gives the columns of Rpp and Rpf and the rows within
+  // each column in increasing order, such that the pattern is built directly.
+  const int n_constraints_per_vertex = N / 2;
+  std::vector<int> vertex_columns(n_vertices_ * n_constraints_per_vertex);
+  for (size_t vertex_idx = 0; vertex_idx < n_vertices_; ++vertex_idx) {
+    const size_t row = vertex_idx < n_segments_
+                           ? vertex_idx * N
+                           : (vertex_idx - 1) * N + n_constraints_per_vertex;
+    std::copy(reordered_index.begin() + row,
+              reordered_index.begin() + row + n_constraints_per_vertex,
+              vertex_columns.begin() + vertex_idx * n_constraints_per_vertex);
+  }
+  std::vector<int> Rpp_outer(1, 0);
+  std::vector<int> Rpf_outer(1, 0);
+  std::vector<int> Rpp_inner;
+  std::vector<int> Rpf_inner;
+  Rpp_outer.reserve(n_free_constraints_ + 1);
+  Rpf_outer.reserve(n_fixed_constraints_ + 1);
+  Rpp_inner.reserve(3 * n_constraints_per_vertex * n_free_constraints_);
+  Rpf_inner.reserve(3 * n_constraints_per_vertex * n_fixed_constraints_);
+  for (size_t vertex_idx = 0; vertex_idx < n_vertices_; ++vertex_idx) {
+    const size_t first_vertex = vertex_idx == 0 ? 0 : vertex_idx - 1;
+    const size_t last_vertex = std::min(vertex_idx + 1, n_vertices_ - 1);
+    for (int derivative = 0; derivative < n_constraints_per_vertex;
+         ++derivative) {
+      const bool is_Rpf =
+          vertex_columns[vertex_idx * n_constraints_per_vertex + derivative] <
+          n_fixed;
+      std::vector<int>& inner = is_Rpf ? Rpf_inner : Rpp_inner;
+      for (size_t u = first_vertex * n_constraints_per_vertex;
+           u < (last_vertex + 1) * n_constraints_per_vertex; ++u) {
+        if (vertex_columns[u] >= n_fixed) {
+          inner.push_back(vertex_columns[u] - n_fixed);
+        }
+      }
+      (is_Rpf ? Rpf_outer : Rpp_outer).push_back(inner.size());
+    }
+  }
+  const std::vector<double> zeros(std::max(Rpp_inner.size(), Rpf_inner.size()),
+                                  0.0);
+  Rpp_cached_ = Eigen::Map<const Eigen::SparseMatrix<double>>(
+      n_free_constraints_, n_free_constraints_, Rpp_inner.size(),
+      Rpp_outer.data(), Rpp_inner.data(), zeros.data());
+  Rpf_cached_ = Eigen::Map<const Eigen::SparseMatrix<double>>(
+      n_free_constraints_, n_fixed_constraints_, Rpf_inner.size(),
+      Rpf_outer.data(), Rpf_inner.data(), zeros.data());
+  Rpp_normalized_ = Rpp_cached_;
+
+  // Values of Rpp come first, followed by the values of Rpf.
+  const int n_Rpp_values = Rpp_cached_.nonZeros();
+  cost_block_value_indices_.resize(N * N * n_segments_);
+  for (size_t i = 0; i < n_segments_; ++i) {
+    for (int col = 0; col < N; ++col) {
+      for (int row = 0; row < N; ++row) {
+        const int R_row = reordered_index[i * N + row];
+        const int R_col = reordered_index[i * N + col];
+        int value_idx = -1;
+        if (R_row >= n_fixed) {
+          const bool is_Rpf = R_col < n_fixed;
+          const Eigen::SparseMatrix<double>& block =
+              is_Rpf ? Rpf_cached_ : Rpp_cached_;
+          const int block_col = is_Rpf ? R_col : R_col - n_fixed;
+          const int* outer = block.outerIndexPtr();
+          const int* inner = block.innerIndexPtr();
+          value_idx = std::lower_bound(inner + outer[block_col],
+                                       inner + outer[block_col + 1],
+                                       R_row - n_fixed) -
+                      inner;
+          if (is_Rpf) {
+            value_idx += n_Rpp_values;
+          }
+        }
+        cost_block_value_indices_[(i * N + col) * N + row] = value_idx;
+      }
+    }
+  }
+
+  R_element_changed_.assign(n_Rpp_values + Rpf_cached_.nonZeros(), false);
+  segment_to_add_.assign(n_segments_, false);
+  rhs_.resize(n_free_constraints_, dimension_);
+
+  segment_changed_.assign(n_segments_, true);
+  R_pattern_valid_ = true;
+  banded_ldlt_.analyzed = false;
+  factorized_solver_type_ = kLinearSolverDefault;
+}
+
+template <int _N>
+void PolynomialOptimization<_N>::updateCachedR() {
+  if (!R_pattern_valid_) {
+    setupCachedRPattern();
+  }
+  const int n_Rpp_values = Rpp_cached_.nonZeros();
+  double* Rpp_values = Rpp_cached_.valuePtr();
+  double* Rpf_values = Rpf_cached_.valuePtr();
+  // Elements of R at shared vertices sum up blocks of adjacent segments.
+  // Reset all elements touched by changed segments and sum them up again from
+  // the changed segments and their neighbors.
+  std::vector<bool>& element_changed = R_element_changed_;
+  std::vector<bool>& segment_to_add = segment_to_add_;
+  std::fill(element_changed.begin(), element_changed.end(), false);
+  std::fill(segment_to_add.begin(), segment_to_add.end(), false);
+  for (size_t i = 0; i < n_segments_; ++i) {
+    if (!segment_changed_[i]) {
+      continue;
+    }
+    computeTimeScaledCostBlock(derivative_to_optimize_, segment_times_[i],
+                               &cost_unconstrained_blocks_[i]);
+    for (int j = 0; j < N * N; ++j) {
+      const int value_idx = cost_block_value_indices_[i * N * N + j];
+      if (value_idx < 0) {
+        continue;
+      }
+      if (value_idx < n_Rpp_values) {
+        Rpp_values[value_idx] = 0.0;
+      } else {
+        Rpf_values[value_idx - n_Rpp_values] = 0.0;
+      }
+      element_changed[value_idx] = true;
+    }
+    segment_to_add[i] = true;
+    if (i > 0) segment_to_add[i - 1] = true;
+    if (i + 1 < n_segments_) segment_to_add[i + 1] = true;
+  }
+  for (size_t i = 0; i < n_segments_; ++i) {
+    if (!segment_to_add[i]) {
+      continue;
+    }
+    const double* H = cost_unconstrained_blocks_[i].data();
+    for (int j = 0; j < N * N; ++j) {
+      const int value_idx = cost_block_value_indices_[i * N * N + j];
+      if (value_idx < 0 || !element_changed[value_idx]) {
+        continue;
+      }
+      if (value_idx < n_Rpp_values) {
+        Rpp_values[value_idx] += H[j];
+      } else {
+        Rpf_values[value_idx - n_Rpp_values] += H[j];
+      }
+    }
+  }
+  segment_changed_.assign(n_segments_, false);
+}
+
+template <int _N>
+template <typename Solver>
+bool PolynomialOptimization<_N>::solveFreeConstraints(const Solver& solver) {
+  if (solver.info() != Eigen::Success) {
+    return false;
+  }
+  // Compute dp_opt of all dimensions with a single product and solve with
+  // one right hand side per dimension.
+  rhs_.noalias() = Rpf_cached_ * fixed_constraints_compact_;  // Rpf = Rfp^T
+  rhs_ = -rhs_;
+  free_constraints_compact_.resize(n_free_constraints_, dimension_);
+  if (!normalize_) {
+    free_constraints_compact_ = solver.solve(rhs_);  // dp = -Rpp^-1 * Rpf * df
+    return solver.info() == Eigen::Success;
+  }
+  // dp = S * (S * Rpp * S)^-1 * S * (-Rpf * df).
+  rhs_ = free_constraint_scaling_.asDiagonal() * rhs_;
+  free_constraints_compact_ = solver.solve(rhs_);
+  free_constraints_compact_ =
+      free_constraint_scaling_.asDiagonal() * free_constraints_compact_;
+  return solver.info() == Eigen::Success;
+}
+
+template <int _N>
+const Eigen::SparseMatrix<double>&
+PolynomialOptimization<_N>::getRppToFactorize() const {
+  return normalize_ ? Rpp_normalized_ : Rpp_cached_;
+}
+
+template <int _N>
+template <typename Derived>
+double PolynomialOptimization<_N>::computePivotRatio(
+    const Eigen::MatrixBase<Derived>& pivots) {
+  if (pivots.size() == 0) {
+    return 0.0;
+  }
+  const double min_pivot = pivots.cwiseAbs().minCoeff();
+  if (min_pivot <= 0.0) {
+    return std::numeric_limits<double>::infinity();
+  }
+  return pivots.cwiseAbs().maxCoeff() / min_pivot;
+}
+
+template <int _N>
+void PolynomialOptimization<_N>::normalizeRpp() {
+  // Jacobi scaling by the diagonal of Rpp, i.e. each free constraint is
+  // measured in units of unit cost.
+  const Eigen::SparseMatrix<double>& Rpp = Rpp_cached_;
+  free_constraint_scaling_.setOnes(n_free_constraints_);
+  for (int col = 0; col < Rpp.outerSize(); ++col) {
+    for (Eigen::SparseMatrix<double>::InnerIterator it(Rpp, col); it; ++it) {
+      if (it.row() == col && it.value() > 0.0) {
+        free_constraint_scaling_[col] = 1.0 / std::sqrt(it.value());
+      }
+    }
+  }
+  // Has the sparsity pattern of Rpp from setupCachedRPattern(), such that
+  // the symbolic factorization of the banded LDLT stays valid.
+  const double* values = Rpp.valuePtr();
+  double* normalized_values = Rpp_normalized_.valuePtr();
+  for (int col = 0; col < Rpp.outerSize(); ++col) {
+    for (int idx = Rpp.outerIndexPtr()[col];
+         idx < Rpp.outerIndexPtr()[col + 1]; ++idx) {
+      const int row = Rpp.innerIndexPtr()[idx];
+      normalized_values[idx] = free_constraint_scaling_[row] * values[idx] *
+                               free_constraint_scaling_[col];
+    }
+  }
 }
 
 template <int _N>
 bool PolynomialOptimization<_N>::solveLinear() {
+  MAV_TRAJECTORY_GENERATION_SCOPED_TIMER("poly_opt_solve_linear");
   CHECK(derivative_to_optimize_ >= 0 &&
         derivative_to_optimize_ <= kHighestDerivativeToOptimize);
   // Catch the fully constrained case:
@@ -334,37 +947,316 @@ bool PolynomialOptimization<_N>::solveLinear() {
     LOG(WARNING)
         << "No free constraints set in the vertices. Polynomial can "
            "not be optimized. Outputting fully constrained polynomial.";
+    segment_outdated_.assign(n_segments_, true);
     updateSegmentsFromCompactConstraints();
     return true;
   }
 
-  // TODO(acmarkus): figure out if sparse becomes less efficient for small
-  // problems, and switch back to dense in case.
-
   // Compute cost matrix for the unconstrained optimization problem.
   // Block-wise H = A^{-T}QA^{-1} according to [1]
-  Eigen::SparseMatrix<double> R;
-  constructR(&R);
-
-  // Extract block matrices and prepare solver.
-  Eigen::SparseMatrix<double> Rpf = R.block(
-      n_fixed_constraints_, 0, n_free_constraints_, n_fixed_constraints_);
-  Eigen::SparseMatrix<double> Rpp =
-      R.block(n_fixed_constraints_, n_fixed_constraints_, n_free_constraints_,
-              n_free_constraints_);
+  updateCachedR();
+  if (normalize_) {
+    normalizeRpp();
+  }
+
+  const Eigen::SparseMatrix<double>& Rpp = getRppToFactorize();
+  condition_estimate_ = 0.0;
+
+  LinearSolverType solver_type = linear_solver_type_;
+  if (solver_type == kLinearSolverDefault) {
+    solver_type = n_free_constraints_ <= kMaxFreeConstraintsDenseSolver
+                      ? kLinearSolverDenseLDLT
+                      : kLinearSolverBandedLDLT;
+  }
+
+  bool success = false;
+  if (solver_type == kLinearSolverDenseLDLT) {
+    // Keeps its memory as long as the number of free constraints is equal.
+    Rpp_dense_.setZero(n_free_constraints_, n_free_constraints_);
+    for (int col = 0; col < Rpp.outerSize(); ++col) {
+      for (Eigen::SparseMatrix<double>::InnerIterator it(Rpp, col); it; ++it) {
+        Rpp_dense_(it.row(), col) = it.value();
+      }
+    }
+    dense_ldlt_.compute(Rpp_dense_);
+    success = dense_ldlt_.isPositive() && solveFreeConstraints(dense_ldlt_);
+    if (success) {
+      condition_estimate_ = computePivotRatio(dense_ldlt_.vectorD());
+    }
+  } else if (solver_type == kLinearSolverBandedLDLT) {
+    // The sparsity pattern of Rpp only changes with setupFromVertices().
+    if (!banded_ldlt_.analyzed) {
+      banded_ldlt_.solver.analyzePattern(Rpp);
+      banded_ldlt_.analyzed = true;
+    }
+    banded_ldlt_.solver.factorizeInPlace(Rpp);
+    success = solveFreeConstraints(banded_ldlt_.solver);
+    if (success) {
+      condition_estimate_ = computePivotRatio(banded_ldlt_.solver.diagonal());
+    }
+  }
+
+  if (!success) {
+    if (solver_type != kLinearSolverSparseQR) {
+      VLOG(1) << "LDLT of Rpp failed, falling back to SparseQR.";
+    }
+    Eigen::SparseQR<Eigen::SparseMatrix<double>, Eigen::COLAMDOrdering<int>>
+        solver;
+    solver.compute(Rpp);
+    if (!solveFreeConstraints(solver)) {
+      LOG(WARNING) << "Could not solve for the free constraints.";
+      factorized_solver_type_ = kLinearSolverDefault;
+      return false;
+    }
+    condition_estimate_ = computePivotRatio(solver.matrixR().diagonal());
+    solver_type = kLinearSolverSparseQR;
+  }
+  factorized_solver_type_ = solver_type;
+  free_constraints_set_ = true;
+
+  segment_outdated_.assign(n_segments_, true);
+  updateSegmentsFromCompactConstraints();
+  return true;
+}
+
+template <int _N>
+bool PolynomialOptimization<_N>::solveFactorizedRpp(const Eigen::MatrixXd& rhs,
+                                                    Eigen::MatrixXd* x) const {
+  CHECK_NOTNULL(x);
+  if (!normalize_) {
+    return solveFactorizedRppToFactorize(rhs, x);
+  }
+  // Rpp^-1 = S * (S * Rpp * S)^-1 * S.
+  const Eigen::MatrixXd normalized_rhs =
+      free_constraint_scaling_.asDiagonal() * rhs;
+  if (!solveFactorizedRppToFactorize(normalized_rhs, x)) {
+    return false;
+  }
+  *x = free_constraint_scaling_.asDiagonal() * (*x);
+  return true;
+}
+
+template <int _N>
+bool PolynomialOptimization<_N>::solveFactorizedRppToFactorize(
+    const Eigen::MatrixXd& rhs, Eigen::MatrixXd* x) const {
+  if (factorized_solver_type_ == kLinearSolverDenseLDLT) {
+    *x = dense_ldlt_.solve(rhs);
+    return dense_ldlt_.info() == Eigen::Success;
+  }
+  if (factorized_solver_type_ == kLinearSolverBandedLDLT &&
+      banded_ldlt_.analyzed) {
+    *x = banded_ldlt_.solver.solve(rhs);
+    return banded_ldlt_.solver.info() == Eigen::Success;
+  }
+  // SparseQR, or a copy without factorization.
+  CHECK(R_pattern_valid_) << "solveLinear() has not been called.";
   Eigen::SparseQR<Eigen::SparseMatrix<double>, Eigen::COLAMDOrdering<int>>
       solver;
-  solver.compute(Rpp);
+  solver.compute(getRppToFactorize());
+  if (solver.info() != Eigen::Success) {
+    return false;
+  }
+  *x = solver.solve(rhs);
+  return solver.info() == Eigen::Success;
+}
+
+template <int _N>
+void PolynomialOptimization<_N>::getSegmentConstraints(
+    size_t segment_idx, const Eigen::Ref<const Eigen::VectorXd>& df,
+    const Eigen::Ref<const Eigen::VectorXd>& dp,
+    Eigen::Matrix<double, N, 1>* d_segment) const {
+  for (int i = 0; i < N; ++i) {
+    const int idx = constraint_reordered_indices_[segment_idx * N + i];
+    (*d_segment)[i] = idx < static_cast<int>(n_fixed_constraints_)
+                          ? df[idx]
+                          : dp[idx - n_fixed_constraints_];
+  }
+}
 
-  // Compute dp_opt for every dimension.
+template <int _N>
+void PolynomialOptimization<_N>::addToFreeConstraintGradient(
+    size_t segment_idx, const Eigen::Matrix<double, N, 1>& gradient_segment,
+    Eigen::VectorXd* gradient_free_constraints) const {
+  for (int i = 0; i < N; ++i) {
+    const int idx = constraint_reordered_indices_[segment_idx * N + i];
+    if (idx >= static_cast<int>(n_fixed_constraints_)) {
+      (*gradient_free_constraints)[idx - n_fixed_constraints_] +=
+          gradient_segment[i];
+    }
+  }
+}
+
+template <int _N>
+double PolynomialOptimization<_N>::computeCostBlockTimeDerivative(
+    size_t segment_idx, const Eigen::Matrix<double, N, 1>& x,
+    const Eigen::Matrix<double, N, 1>& y) const {
+  // With the time scaling of computeTimeScaledMatrices():
+  // dA^{-1}/dT * x = (-diag(k) * A^{-1} * x + A^{-1} * diag(d) * x) / T and
+  // dQ/dT = ((1 - 2r) * Q + diag(k) * Q + Q * diag(k)) / T. The diag(k) terms
+  // cancel in y^T * dH/dT * x.
+  const SquareMatrix& A_inv = inverse_mapping_matrices_[segment_idx];
+  const SquareMatrix& Q = cost_matrices_[segment_idx];
+  Eigen::Matrix<double, N, 1> constraint_derivatives;
+  for (int i = 0; i < N; ++i) {
+    constraint_derivatives[i] = i % (N / 2);
+  }
+  const Eigen::Matrix<double, N, 1> c_x = A_inv * x;
+  const Eigen::Matrix<double, N, 1> c_y = A_inv * y;
+  const Eigen::Matrix<double, N, 1> Q_c_x = Q * c_x;
+  const Eigen::Matrix<double, N, 1> Q_c_y = Q * c_y;
+  const double result =
+      (A_inv * constraint_derivatives.cwiseProduct(y)).dot(Q_c_x) +
+      (A_inv * constraint_derivatives.cwiseProduct(x)).dot(Q_c_y) +
+      (1.0 - 2.0 * derivative_to_optimize_) * c_y.dot(Q_c_x);
+  return result / segment_times_[segment_idx];
+}
+
+template <int _N>
+void PolynomialOptimization<_N>::computeCostGradient(
+    std::vector<double>* gradient_segment_times,
+    std::vector<Eigen::VectorXd>* gradient_free_constraints) const {
+  CHECK_NOTNULL(gradient_segment_times);
+  gradient_segment_times->assign(n_segments_, 0.0);
+  if (gradient_free_constraints != nullptr) {
+    gradient_free_constraints->assign(
+        dimension_, Eigen::VectorXd::Zero(n_free_constraints_));
+  }
+
+  Eigen::Matrix<double, N, 1> d_segment;
   for (size_t dimension_idx = 0; dimension_idx < dimension_; ++dimension_idx) {
-    Eigen::VectorXd df =
-        -Rpf * fixed_constraints_compact_[dimension_idx];  // Rpf = Rfp^T
-    free_constraints_compact_[dimension_idx] =
-        solver.solve(df);  // dp = -Rpp^-1 * Rpf * df
+    for (size_t i = 0; i < n_segments_; ++i) {
+      getSegmentConstraints(i, fixed_constraints_compact_.col(dimension_idx),
+                            free_constraints_compact_.col(dimension_idx),
+                            &d_segment);
+      // J = 0.5 * d^T * H * d.
+      (*gradient_segment_times)[i] +=
+          0.5 * computeCostBlockTimeDerivative(i, d_segment, d_segment);
+      if (gradient_free_constraints != nullptr) {
+        const SquareMatrix& A_inv = inverse_mapping_matrices_[i];
+        const Eigen::Matrix<double, N, 1> gradient_segment =
+            A_inv.transpose() * (cost_matrices_[i] * (A_inv * d_segment));
+        addToFreeConstraintGradient(
+            i, gradient_segment, &(*gradient_free_constraints)[dimension_idx]);
+      }
+    }
   }
+}
 
-  updateSegmentsFromCompactConstraints();
+template <int _N>
+void PolynomialOptimization<_N>::computeMagnitudeGradient(
+    int derivative, const Extremum& extremum,
+    std::vector<double>* gradient_segment_times,
+    std::vector<Eigen::VectorXd>* gradient_free_constraints) const {
+  CHECK_NOTNULL(gradient_segment_times);
+  CHECK_NOTNULL(gradient_free_constraints);
+  CHECK_GE(derivative, 0);
+  CHECK_LT(derivative, N);
+  CHECK_GE(extremum.segment_idx, 0);
+  CHECK_LT(static_cast<size_t>(extremum.segment_idx), n_segments_);
+  gradient_segment_times->assign(n_segments_, 0.0);
+  gradient_free_constraints->assign(
+      dimension_, Eigen::VectorXd::Zero(n_free_constraints_));
+
+  const size_t segment_idx = extremum.segment_idx;
+  const double segment_time = segment_times_[segment_idx];
+  const double t = extremum.time;
+  const Eigen::Matrix<double, N, 1> base_coefficients =
+      Polynomial::baseCoeffsWithTime(N, derivative, t);
+  Eigen::Matrix<double, N, 1> base_coefficients_next_derivative;
+  if (derivative + 1 < N) {
+    base_coefficients_next_derivative =
+        Polynomial::baseCoeffsWithTime(N, derivative + 1, t);
+  } else {
+    base_coefficients_next_derivative.setZero();
+  }
+
+  const SquareMatrix& A_inv = inverse_mapping_matrices_[segment_idx];
+  std::vector<Eigen::Matrix<double, N, 1>,
+              Eigen::aligned_allocator<Eigen::Matrix<double, N, 1>>>
+      d_segments(dimension_), coefficients(dimension_);
+  Eigen::VectorXd values(dimension_);
+  double value_time_derivative = 0.0;
+  for (size_t dimension_idx = 0; dimension_idx < dimension_; ++dimension_idx) {
+    getSegmentConstraints(segment_idx,
+                          fixed_constraints_compact_.col(dimension_idx),
+                          free_constraints_compact_.col(dimension_idx),
+                          &d_segments[dimension_idx]);
+    coefficients[dimension_idx] = A_inv * d_segments[dimension_idx];
+    values[dimension_idx] = base_coefficients.dot(coefficients[dimension_idx]);
+    value_time_derivative += values[dimension_idx] *
+                             base_coefficients_next_derivative.dot(
+                                 coefficients[dimension_idx]);
+  }
+  const double magnitude = values.norm();
+  if (magnitude <= 0.0) {
+    return;
+  }
+
+  Eigen::Matrix<double, N, 1> powers, constraint_derivatives;
+  for (int i = 0; i < N; ++i) {
+    powers[i] = i;
+    constraint_derivatives[i] = i % (N / 2);
+  }
+
+  // The extremum moves with t = s * T at constant s.
+  double gradient_time = value_time_derivative / magnitude * t / segment_time;
+  for (size_t dimension_idx = 0; dimension_idx < dimension_; ++dimension_idx) {
+    // dF/dc of the coefficients of this dimension.
+    const Eigen::Matrix<double, N, 1> gradient_coefficients =
+        values[dimension_idx] / magnitude * base_coefficients;
+    const Eigen::Matrix<double, N, 1> coefficients_time_derivative =
+        (A_inv * constraint_derivatives.cwiseProduct(
+                     d_segments[dimension_idx]) -
+         powers.cwiseProduct(coefficients[dimension_idx])) /
+        segment_time;
+    gradient_time += gradient_coefficients.dot(coefficients_time_derivative);
+    addToFreeConstraintGradient(segment_idx,
+                                A_inv.transpose() * gradient_coefficients,
+                                &(*gradient_free_constraints)[dimension_idx]);
+  }
+  (*gradient_segment_times)[segment_idx] = gradient_time;
+}
+
+template <int _N>
+bool PolynomialOptimization<_N>::addFreeConstraintSensitivity(
+    const std::vector<Eigen::VectorXd>& gradient_free_constraints,
+    std::vector<double>* gradient_segment_times) const {
+  CHECK_NOTNULL(gradient_segment_times);
+  CHECK_EQ(gradient_free_constraints.size(), dimension_);
+  CHECK_EQ(gradient_segment_times->size(), n_segments_);
+  if (n_free_constraints_ == 0) {
+    return true;
+  }
+
+  // Rpp * dp + Rpf * df = 0, thus ddp/dT = -Rpp^-1 * (dR/dT * d)_p.
+  // The adjoint systems of all dimensions are solved at once.
+  Eigen::MatrixXd gradient_free(n_free_constraints_, dimension_);
+  for (size_t dimension_idx = 0; dimension_idx < dimension_; ++dimension_idx) {
+    CHECK_EQ(
+        static_cast<size_t>(gradient_free_constraints[dimension_idx].size()),
+        n_free_constraints_);
+    gradient_free.col(dimension_idx) = gradient_free_constraints[dimension_idx];
+  }
+  Eigen::MatrixXd lambda;
+  if (!solveFactorizedRpp(gradient_free, &lambda)) {
+    LOG(WARNING) << "Could not solve the adjoint system.";
+    return false;
+  }
+
+  const Eigen::VectorXd zero_fixed =
+      Eigen::VectorXd::Zero(n_fixed_constraints_);
+  Eigen::Matrix<double, N, 1> d_segment, lambda_segment;
+  for (size_t dimension_idx = 0; dimension_idx < dimension_; ++dimension_idx) {
+    for (size_t i = 0; i < n_segments_; ++i) {
+      getSegmentConstraints(i, fixed_constraints_compact_.col(dimension_idx),
+                            free_constraints_compact_.col(dimension_idx),
+                            &d_segment);
+      getSegmentConstraints(i, zero_fixed, lambda.col(dimension_idx),
+                            &lambda_segment);
+      (*gradient_segment_times)[i] -=
+          computeCostBlockTimeDerivative(i, d_segment, lambda_segment);
+    }
+  }
   return true;
 }
 
@@ -378,43 +1270,38 @@ template <int _N>
 template <int Derivative>
 bool PolynomialOptimization<_N>::computeSegmentMaximumMagnitudeCandidates(
     const Segment& segment, double t_start, double t_stop,
-    std::vector<double>* candidates) {
+    std::vector<double>* candidates, RootFindingMethod method) {
   CHECK(candidates);
+  CHECK_EQ(N, segment.N()) << "Number of coefficients has to match.";
   static_assert(N - Derivative - 1 > 0, "N-Derivative-1 has to be greater 0");
+  internal::countRootFindingCall();
 
   const int n_d = N - Derivative;
   const int n_dd = N - Derivative - 1;
   const int convolved_coefficients_length =
       ConvolutionDimension<n_d, n_dd>::length;
 
-  Eigen::VectorXcd roots;
+  // Stored inline, the root finders take it without copying.
+  Polynomial::ConvolutionCoefficients coefficients;
 
   if (segment.D() > 1) {
-    Eigen::Matrix<double, convolved_coefficients_length, 1>
-        convolved_coefficients;  // Column vector.
-    convolved_coefficients.setZero();
+    coefficients.setZero(convolved_coefficients_length);
     for (const Polynomial& p : segment.getPolynomialsRef()) {
-      // Our coefficients are INCREASING, so when you take the derivative,
-      // only the lower powers of t have non-zero coefficients.
-      // So we take the head.
-      Eigen::Matrix<double, n_d, 1> d = p.getCoefficients(Derivative).head(n_d);
-      Eigen::Matrix<double, n_dd, 1> dd =
-          p.getCoefficients(Derivative + 1).head(n_dd);
-      convolved_coefficients += convolve(d, dd);
+      p.addMagnitudeDerivativeCoefficients(Derivative, coefficients);
     }
-
-    Polynomial polynomial_convolved(convolved_coefficients_length);
-    polynomial_convolved.setCoefficients(convolved_coefficients);
-    roots = polynomial_convolved.computeRoots();
   }
   // For dimension == 1, it doesn't make a difference, thus we can simply
   // compute the roots of the derivative.
   else {
-    const Polynomial d(n_dd,
-                       segment[0].getCoefficients(Derivative + 1).head(n_dd));
-    roots = d.computeRoots();
+    coefficients = fixedDerivativeCoefficients<N, Derivative + 1>(
+        segment[0].getCoefficientsRef());
   }
 
+  if (method == kRealIntervalRoots) {
+    return findRealRootsInInterval(coefficients, t_start, t_stop, candidates);
+  }
+
+  const Eigen::VectorXcd roots = findRootsJenkinsTraub(coefficients);
   if (roots.size() == 0) {
     // Then Jenkins-Traub failed! :( Should fall back to something else.
     return false;
@@ -502,6 +1389,135 @@ Extremum PolynomialOptimization<_N>::computeMaximumOfMagnitude(
   return extremum;
 }
 
+template <int _N>
+void PolynomialOptimization<_N>::computeMaximaOfMagnitude(
+    const std::vector<int>& derivatives, std::vector<Extremum>* maxima,
+    ThreadPool* thread_pool) const {
+  CHECK_NOTNULL(maxima);
+  CHECK_LE(derivatives.size(), derivative_order::SNAP + 1u);
+  for (int derivative : derivatives) {
+    CHECK_GE(derivative, derivative_order::POSITION);
+    CHECK_LE(derivative, derivative_order::SNAP);
+    CHECK_GT(N - derivative - 1, 0) << "N-Derivative-1 has to be greater 0";
+  }
+  const size_t n_derivatives = derivatives.size();
+  maxima->assign(n_derivatives, Extremum());
+  if (n_derivatives == 0 || segments_.empty()) {
+    return;
+  }
+
+  // Reduced in segment order below, such that ties are resolved as in
+  // computeMaximumOfMagnitude().
+  std::vector<Extremum> segment_maxima(segments_.size() * n_derivatives);
+  std::vector<std::vector<double> > extrema_times(
+      thread_pool != nullptr ? thread_pool->getNumberThreads() : 1);
+  const ThreadPool::Job job = [&](size_t segment_idx, size_t worker_idx) {
+    computeSegmentMaximaOfMagnitude(
+        segments_[segment_idx], segment_idx, derivatives,
+        &extrema_times[worker_idx],
+        &segment_maxima[segment_idx * n_derivatives]);
+  };
+  if (thread_pool != nullptr && segments_.size() > 1) {
+    thread_pool->parallelFor(segments_.size(), job);
+  } else {
+    for (size_t segment_idx = 0; segment_idx < segments_.size();
+         ++segment_idx) {
+      job(segment_idx, 0);
+    }
+  }
+
+  for (size_t segment_idx = 0; segment_idx < segments_.size(); ++segment_idx) {
+    for (size_t i = 0; i < n_derivatives; ++i) {
+      const Extremum& candidate =
+          segment_maxima[segment_idx * n_derivatives + i];
+      if ((*maxima)[i] < candidate) (*maxima)[i] = candidate;
+    }
+  }
+  // Check last time at last segment.
+  const Segment& last_segment = segments_.back();
+  for (size_t i = 0; i < n_derivatives; ++i) {
+    const Extremum candidate(
+        last_segment.getTime(),
+        last_segment.evaluate(last_segment.getTime(), derivatives[i]).norm(),
+        n_segments_ - 1);
+    if ((*maxima)[i] < candidate) (*maxima)[i] = candidate;
+  }
+}
+
+template <int _N>
+void PolynomialOptimization<_N>::computeSegmentMaximaOfMagnitude(
+    const Segment& segment, int segment_idx,
+    const std::vector<int>& derivatives, std::vector<double>* extrema_times,
+    Extremum* maxima) {
+  CHECK_EQ(N, segment.N()) << "Number of coefficients has to match.";
+  constexpr int kNumDerivatives = derivative_order::SNAP + 2;
+  int max_derivative = 0;
+  for (int derivative : derivatives) {
+    max_derivative = std::max(max_derivative, derivative);
+  }
+  const int n_rows = std::min(max_derivative + 2, static_cast<int>(N));
+
+  // Same polynomials as computeSegmentMaximumMagnitudeCandidates(), one per
+  // derivative.
+  Polynomial::ConvolutionCoefficients
+      root_coefficients[derivative_order::SNAP + 1];
+  for (size_t i = 0; i < derivatives.size(); ++i) {
+    const int n_d = N - derivatives[i];
+    root_coefficients[i].setZero(
+        segment.D() > 1 ? Polynomial::getConvolutionLength(n_d, n_d - 1)
+                        : n_d - 1);
+  }
+  for (int dim = 0; dim < segment.D(); ++dim) {
+    // Computed once for all derivatives, row k holds the coefficients of
+    // the k-th derivative.
+    const Eigen::VectorXd& coefficients = segment[dim].getCoefficientsRef();
+    double derivative_coefficients[kNumDerivatives][N];
+    for (int k = 0; k < n_rows; ++k) {
+      for (int j = 0; j < N - k; ++j) {
+        derivative_coefficients[k][j] =
+            fixedBaseCoefficient(k, j + k) * coefficients[j + k];
+      }
+    }
+    for (size_t i = 0; i < derivatives.size(); ++i) {
+      const int k = derivatives[i];
+      const int n_d = N - k;
+      const int n_dd = n_d - 1;
+      if (segment.D() == 1) {
+        for (int j = 0; j < n_dd; ++j) {
+          root_coefficients[i][j] = derivative_coefficients[k + 1][j];
+        }
+        continue;
+      }
+      for (int a = 0; a < n_d; ++a) {
+        for (int b = 0; b < n_dd; ++b) {
+          root_coefficients[i][a + b] +=
+              derivative_coefficients[k][a] * derivative_coefficients[k + 1][b];
+        }
+      }
+    }
+  }
+
+  for (size_t i = 0; i < derivatives.size(); ++i) {
+    internal::countRootFindingCall();
+    extrema_times->clear();
+    // Add the beginning as well. Call below appends its extrema.
+    extrema_times->push_back(0.0);
+    findRealRootsInInterval(root_coefficients[i], 0.0, segment.getTime(),
+                            extrema_times);
+
+    maxima[i] = Extremum(0.0, 0.0, segment_idx);
+    for (double t : *extrema_times) {
+      double magnitude_squared = 0.0;
+      for (int dim = 0; dim < segment.D(); ++dim) {
+        const double value = segment[dim].evaluate(t, derivatives[i]);
+        magnitude_squared += value * value;
+      }
+      const Extremum candidate(t, std::sqrt(magnitude_squared), segment_idx);
+      if (maxima[i] < candidate) maxima[i] = candidate;
+    }
+  }
+}
+
 template <int _N>
 void PolynomialOptimization<_N>::setFreeConstraints(
     const std::vector<Eigen::VectorXd>& free_constraints) {
@@ -509,10 +1525,38 @@ void PolynomialOptimization<_N>::setFreeConstraints(
   for (const Eigen::VectorXd& v : free_constraints)
     CHECK(static_cast<size_t>(v.size()) == n_free_constraints_);
 
+  free_constraints_compact_.resize(n_free_constraints_, dimension_);
+  for (size_t d = 0; d < dimension_; ++d) {
+    free_constraints_compact_.col(d) = free_constraints[d];
+  }
+  free_constraints_set_ = true;
+  segment_outdated_.assign(n_segments_, true);
+  updateSegmentsFromCompactConstraints();
+}
+
+template <int _N>
+void PolynomialOptimization<_N>::setFreeConstraints(
+    const Eigen::Ref<const Eigen::MatrixXd>& free_constraints) {
+  CHECK_EQ(static_cast<size_t>(free_constraints.rows()), n_free_constraints_);
+  CHECK_EQ(static_cast<size_t>(free_constraints.cols()), dimension_);
+
+  // Only segments adjacent to changed free constraints are recomputed.
+  markSegmentsOfChangedFreeConstraints(free_constraints);
   free_constraints_compact_ = free_constraints;
+  free_constraints_set_ = true;
   updateSegmentsFromCompactConstraints();
 }
 
+template <int _N>
+void PolynomialOptimization<_N>::getColumns(
+    const Eigen::MatrixXd& matrix, std::vector<Eigen::VectorXd>* columns) {
+  CHECK_NOTNULL(columns);
+  columns->resize(matrix.cols());
+  for (int col = 0; col < matrix.cols(); ++col) {
+    (*columns)[col] = matrix.col(col);
+  }
+}
+
 template <int _N>
 void PolynomialOptimization<_N>::getAInverse(Eigen::MatrixXd* A_inv) const {
   CHECK_NOTNULL(A_inv);
@@ -581,8 +1625,8 @@ void PolynomialOptimization<_N>::computeQuadraticCostJacobian(
       double exponent = (N - 1 - derivative) * 2 + 1 - row - col;
 
       (*cost_jacobian)(N - 1 - row, N - 1 - col) =
-          Polynomial::base_coefficients_(derivative, N - 1 - row) *
-          Polynomial::base_coefficients_(derivative, N - 1 - col) *
+          fixedBaseCoefficient(derivative, N - 1 - row) *
+          fixedBaseCoefficient(derivative, N - 1 - col) *
           pow(t, exponent) * 2.0 / exponent;
     }
   }
@@ -18,9 +18,13 @@
 #ifndef MAV_TRAJECTORY_GENERATION_IMPL_POLYNOMIAL_OPTIMIZATION_NONLINEAR_IMPL_H_
 #define MAV_TRAJECTORY_GENERATION_IMPL_POLYNOMIAL_OPTIMIZATION_NONLINEAR_IMPL_H_
 
+#include <algorithm>
 #include <chrono>
+#include <random>
 
+#include "mav_trajectory_generation/memory_tracking.h"
 #include "mav_trajectory_generation/polynomial_optimization_linear.h"
+#include "mav_trajectory_generation/thread_pool.h"
 #include "mav_trajectory_generation/timing.h"
 
 namespace mav_trajectory_generation {
@@ -34,6 +38,11 @@ inline void OptimizationInfo::print(std::ostream& stream) const {
   stream << "  cost trajectory:       " << cost_trajectory << std::endl;
   stream << "  cost time:             " << cost_time << std::endl;
   stream << "  cost soft constraints: " << cost_soft_constraints << std::endl;
+  stream << "  max condition:         " << max_condition_estimate << std::endl;
+  if (memory_tracking::isEnabled()) {
+    stream << "  n_allocations:         " << n_allocations << std::endl;
+    stream << "  peak heap bytes:       " << peak_heap_bytes << std::endl;
+  }
   stream << "  maxima: " << std::endl;
   for (const std::pair<int, Extremum>& m : maxima) {
     stream << "    " << positionDerivativeToString(m.first) << ": "
@@ -48,7 +57,20 @@ PolynomialOptimizationNonLinear<_N>::PolynomialOptimizationNonLinear(
     bool optimize_time_only)
     : poly_opt_(dimension),
       optimization_parameters_(parameters),
-      optimize_time_only_(optimize_time_only) {}
+      optimize_time_only_(optimize_time_only),
+      record_trace_(false),
+      trace_time_constraints_(0.0),
+      trace_root_finding_calls_(0),
+      multi_start_stop_(nullptr),
+      multi_start_target_cost_(-1.0),
+      cancel_token_(nullptr),
+      has_deadline_(false),
+      track_iterates_(false),
+      iterate_cost_(0.0),
+      iterate_feasible_(false),
+      maxima_valid_(false),
+      coupled_cost_thread_pool_(nullptr),
+      best_iterate_cost_(0.0) {}
 
 template <int _N>
 bool PolynomialOptimizationNonLinear<_N>::setupFromVertices(
@@ -56,18 +78,51 @@ bool PolynomialOptimizationNonLinear<_N>::setupFromVertices(
     int derivative_to_optimize) {
   bool ret = poly_opt_.setupFromVertices(vertices, segment_times,
                                          derivative_to_optimize);
+  setupNlopt();
+  return ret;
+}
+
+template <int _N>
+void PolynomialOptimizationNonLinear<_N>::computeConstraintMaxima() {
+  std::vector<int> derivatives;
+  for (const std::shared_ptr<ConstraintData>& constraint :
+       inequality_constraints_) {
+    if (constraint->derivative >= derivative_order::POSITION &&
+        constraint->derivative <= derivative_order::SNAP &&
+        std::find(derivatives.begin(), derivatives.end(),
+                  constraint->derivative) == derivatives.end()) {
+      derivatives.push_back(constraint->derivative);
+    }
+  }
+  if (optimization_parameters_.n_constraint_threads != 1 &&
+      !constraint_thread_pool_) {
+    constraint_thread_pool_ = std::make_shared<ThreadPool>(
+        optimization_parameters_.n_constraint_threads);
+  }
 
-  size_t n_optimization_parameters;
+  std::vector<Extremum> maxima;
+  poly_opt_.computeMaximaOfMagnitude(derivatives, &maxima,
+                                     constraint_thread_pool_.get());
+  for (size_t i = 0; i < derivatives.size(); ++i) {
+    optimization_info_.maxima[derivatives[i]] = maxima[i];
+  }
+  maxima_valid_ = true;
+}
+
+template <int _N>
+size_t PolynomialOptimizationNonLinear<_N>::getNumberOptimizationVariables()
+    const {
   if (optimize_time_only_) {
-    n_optimization_parameters = segment_times.size();
-  } else {
-    n_optimization_parameters =
-        segment_times.size() +
-        poly_opt_.getNumberFreeConstraints() * poly_opt_.getDimension();
+    return poly_opt_.getNumberSegments();
   }
+  return poly_opt_.getNumberSegments() +
+         poly_opt_.getNumberFreeConstraints() * poly_opt_.getDimension();
+}
 
+template <int _N>
+void PolynomialOptimizationNonLinear<_N>::setupNlopt() {
   nlopt_.reset(new nlopt::opt(optimization_parameters_.algorithm,
-                              n_optimization_parameters));
+                              getNumberOptimizationVariables()));
   nlopt_->set_ftol_rel(optimization_parameters_.f_rel);
   nlopt_->set_ftol_abs(optimization_parameters_.f_abs);
   nlopt_->set_xtol_rel(optimization_parameters_.x_rel);
@@ -79,7 +134,22 @@ bool PolynomialOptimizationNonLinear<_N>::setupFromVertices(
   else
     nlopt_srand(optimization_parameters_.random_seed);
 
-  return ret;
+  if (optimization_parameters_.use_soft_constraints) {
+    return;
+  }
+  for (const std::shared_ptr<ConstraintData>& constraint_data :
+       inequality_constraints_) {
+    try {
+      nlopt_->add_inequality_constraint(
+          &PolynomialOptimizationNonLinear<
+              N>::evaluateMaximumMagnitudeConstraint,
+          constraint_data.get(),
+          optimization_parameters_.inequality_constraint_tolerance);
+    } catch (std::exception& e) {
+      LOG(ERROR) << "ERROR while setting inequality constraint " << e.what()
+                 << std::endl;
+    }
+  }
 }
 
 template <int _N>
@@ -89,8 +159,39 @@ bool PolynomialOptimizationNonLinear<_N>::solveLinear() {
 
 template <int _N>
 int PolynomialOptimizationNonLinear<_N>::optimize() {
+  const bool has_deadline = optimization_parameters_.max_time > 0.0;
+  return optimizeUntil(
+      has_deadline,
+      std::chrono::steady_clock::now() +
+          std::chrono::duration_cast<std::chrono::steady_clock::duration>(
+              std::chrono::duration<double>(
+                  has_deadline ? optimization_parameters_.max_time : 0.0)));
+}
+
+template <int _N>
+int PolynomialOptimizationNonLinear<_N>::optimizeUntil(
+    bool has_deadline, const std::chrono::steady_clock::time_point& deadline) {
   optimization_info_ = OptimizationInfo();
   int result = nlopt::FAILURE;
+  memory_tracking::AllocationScope allocations;
+
+  // Receding-horizon updates of the linear problem change the number of
+  // optimization variables.
+  CHECK(nlopt_) << "setupFromVertices() has to be called first.";
+  if (nlopt_->get_dimension() != getNumberOptimizationVariables()) {
+    setupNlopt();
+  }
+  trace_.reset(optimization_parameters_.trace_capacity,
+               poly_opt_.getNumberSegments());
+  record_trace_ = trace_.enabled();
+  trace_time_constraints_ = 0.0;
+  trace_root_finding_calls_ = internal::getNumRootFindingCalls();
+  has_deadline_ = has_deadline;
+  deadline_ = deadline;
+  track_iterates_ = has_deadline_ || cancel_token_ != nullptr;
+  maxima_valid_ = false;
+  iterate_.clear();
+  best_iterate_.clear();
 
   const std::chrono::high_resolution_clock::time_point t_start =
       std::chrono::high_resolution_clock::now();
@@ -108,7 +209,14 @@ int PolynomialOptimizationNonLinear<_N>::optimize() {
                                                                  t_start)
           .count();
 
+  track_iterates_ = false;
+  if (optimization_info_.deadline_reached) {
+    result = nlopt::MAXTIME_REACHED;
+  }
   optimization_info_.stopping_reason = result;
+  allocations.stop();
+  optimization_info_.n_allocations = allocations.getNumAllocations();
+  optimization_info_.peak_heap_bytes = allocations.getPeakBytes();
 
   return result;
 }
@@ -144,10 +252,13 @@ int PolynomialOptimizationNonLinear<_N>::optimizeTime() {
 
   try {
     result = nlopt_->optimize(segment_times, final_cost);
+  } catch (nlopt::forced_stop& e) {
+    result = nlopt::FORCED_STOP;
   } catch (std::exception& e) {
     LOG(ERROR) << "error while running nlopt: " << e.what() << std::endl;
     return nlopt::FAILURE;
   }
+  restoreSolution(segment_times);
 
   return result;
 }
@@ -162,15 +273,16 @@ int PolynomialOptimizationNonLinear<_N>::optimizeTimeAndFreeConstraints() {
   // Set a lower bound on segment time per segment to avoid numerical issues
   constexpr double kOptimizationTimeLowerBound = 0.1;
 
-  // compute initial solution
-  poly_opt_.solveLinear();
-  std::vector<Eigen::VectorXd> free_constraints;
-  poly_opt_.getFreeConstraints(&free_constraints);
+  // Start from the free constraints of a previous solution or a
+  // receding-horizon update, otherwise compute the initial solution.
+  if (!poly_opt_.hasFreeConstraints()) {
+    poly_opt_.solveLinear();
+    updateConditionEstimate();
+  }
+  const Eigen::MatrixXd& free_constraints = poly_opt_.getFreeConstraintsRef();
   CHECK(free_constraints.size() > 0);
-  CHECK(free_constraints.front().size() > 0);
 
-  const size_t n_optmization_variables =
-      n_segments + free_constraints.size() * free_constraints.front().size();
+  const size_t n_optmization_variables = n_segments + free_constraints.size();
 
   initial_solution.reserve(n_optmization_variables);
   initial_step.reserve(n_optmization_variables);
@@ -182,16 +294,13 @@ int PolynomialOptimizationNonLinear<_N>::optimizeTimeAndFreeConstraints() {
     initial_solution.push_back(t);
   }
 
-  for (const Eigen::VectorXd& c : free_constraints) {
-    for (int i = 0; i < c.size(); ++i) {
-      initial_solution.push_back(c[i]);
-    }
-  }
+  // The free constraints are stored contiguously by dimension.
+  initial_solution.insert(initial_solution.end(), free_constraints.data(),
+                          free_constraints.data() + free_constraints.size());
 
   // Setup for getting bounds on the free endpoint derivatives
   std::vector<double> lower_bounds_free, upper_bounds_free;
-  const size_t n_optmization_variables_free =
-          free_constraints.size() * free_constraints.front().size();
+  const size_t n_optmization_variables_free = free_constraints.size();
   lower_bounds_free.reserve(n_optmization_variables_free);
   upper_bounds_free.reserve(n_optmization_variables_free);
 
@@ -238,14 +347,227 @@ int PolynomialOptimizationNonLinear<_N>::optimizeTimeAndFreeConstraints() {
     timing::Timer timer_solve("optimize_nonlinear_full_total_time");
     result = nlopt_->optimize(initial_solution, final_cost);
     timer_solve.Stop();
+  } catch (nlopt::forced_stop& e) {
+    result = nlopt::FORCED_STOP;
   } catch (std::exception& e) {
     LOG(ERROR) << "error while running nlopt: " << e.what() << std::endl;
     return nlopt::FAILURE;
   }
+  restoreSolution(initial_solution);
 
   return result;
 }
 
+template <int _N>
+void PolynomialOptimizationNonLinear<_N>::restoreSolution(
+    const std::vector<double>& optimization_variables) {
+  // After a deadline or cancellation, prefer the best iterate that meets the
+  // constraints over the best one of nlopt.
+  keepBestIterate();
+  const bool stopped_early =
+      optimization_info_.deadline_reached || optimization_info_.cancelled;
+  const std::vector<double>& solution =
+      stopped_early && !best_iterate_.empty() ? best_iterate_
+                                              : optimization_variables;
+
+  // Not an iteration of the optimizer.
+  const int n_iterations = optimization_info_.n_iterations;
+  std::vector<double> no_gradient;
+  std::atomic<bool>* multi_start_stop = multi_start_stop_;
+  multi_start_stop_ = nullptr;
+  const bool record_trace = record_trace_;
+  record_trace_ = false;
+  track_iterates_ = false;
+  if (optimize_time_only_) {
+    objectiveFunctionTime(solution, no_gradient, this);
+  } else {
+    objectiveFunctionTimeAndConstraints(solution, no_gradient, this);
+  }
+  record_trace_ = record_trace;
+  multi_start_stop_ = multi_start_stop;
+  optimization_info_.n_iterations = n_iterations;
+}
+
+template <int _N>
+void PolynomialOptimizationNonLinear<_N>::addTraceEntry(
+    const std::vector<double>& segment_times, OptimizationTraceEntry* entry) {
+  CHECK_NOTNULL(entry);
+  const size_t n_root_finding_calls = internal::getNumRootFindingCalls();
+  entry->iteration = optimization_info_.n_iterations;
+  entry->time_constraints += trace_time_constraints_;
+  entry->n_root_finding_calls =
+      n_root_finding_calls - trace_root_finding_calls_;
+  trace_.add(*entry, segment_times);
+  trace_time_constraints_ = 0.0;
+  trace_root_finding_calls_ = n_root_finding_calls;
+}
+
+template <int _N>
+void PolynomialOptimizationNonLinear<_N>::checkMultiStartStop(double cost) {
+  if (multi_start_stop_ == nullptr) {
+    return;
+  }
+  if (multi_start_target_cost_ >= 0.0 && cost <= multi_start_target_cost_) {
+    // This start stops by itself through the stop value of nlopt.
+    multi_start_stop_->store(true);
+  } else if (multi_start_stop_->load()) {
+    nlopt_->force_stop();
+  }
+}
+
+template <int _N>
+void PolynomialOptimizationNonLinear<_N>::updateConditionEstimate() {
+  optimization_info_.max_condition_estimate =
+      std::max(optimization_info_.max_condition_estimate,
+               poly_opt_.getConditionEstimate());
+}
+
+template <int _N>
+void PolynomialOptimizationNonLinear<_N>::beginObjectiveEvaluation() {
+  maxima_valid_ = false;
+  if (!track_iterates_) {
+    return;
+  }
+  keepBestIterate();
+  iterate_feasible_ = true;
+}
+
+template <int _N>
+void PolynomialOptimizationNonLinear<_N>::endObjectiveEvaluation(
+    const std::vector<double>& optimization_variables, double cost) {
+  if (track_iterates_) {
+    iterate_.assign(optimization_variables.begin(),
+                    optimization_variables.end());
+    iterate_cost_ = cost;
+    if (cancel_token_ != nullptr && cancel_token_->load()) {
+      optimization_info_.cancelled = true;
+      nlopt_->force_stop();
+    } else if (has_deadline_ && std::chrono::steady_clock::now() >= deadline_) {
+      optimization_info_.deadline_reached = true;
+      nlopt_->force_stop();
+    }
+  }
+  checkMultiStartStop(cost);
+}
+
+template <int _N>
+void PolynomialOptimizationNonLinear<_N>::keepBestIterate() {
+  if (iterate_.empty()) {
+    return;
+  }
+  if (iterate_feasible_ &&
+      (best_iterate_.empty() || iterate_cost_ < best_iterate_cost_)) {
+    best_iterate_.swap(iterate_);
+    best_iterate_cost_ = iterate_cost_;
+  }
+  iterate_.clear();
+}
+
+template <int _N>
+int PolynomialOptimizationNonLinear<_N>::optimizeMultiStart(
+    const MultiStartParameters& multi_start_parameters,
+    std::vector<OptimizationInfo>* start_infos) {
+  CHECK_GE(multi_start_parameters.n_starts, 1);
+  CHECK_GE(multi_start_parameters.perturbation_magnitude, 0.0);
+  CHECK(nlopt_) << "setupFromVertices() has to be called first.";
+  LOG_IF(WARNING, coupled_cost_)
+      << "The coupled cost is not used by the starts.";
+
+  Vertex::Vector vertices;
+  std::vector<double> segment_times;
+  poly_opt_.getVertices(&vertices);
+  poly_opt_.getSegmentTimes(&segment_times);
+  const int derivative_to_optimize = poly_opt_.getDerivativeToOptimize();
+  const size_t n_starts = multi_start_parameters.n_starts;
+
+  // Draw all perturbations up-front, such that they do not depend on the
+  // scheduling of the starts.
+  std::mt19937 generator(optimization_parameters_.random_seed < 0
+                             ? std::random_device()()
+                             : optimization_parameters_.random_seed);
+  std::uniform_real_distribution<double> log_scale_distribution(
+      -std::log1p(multi_start_parameters.perturbation_magnitude),
+      std::log1p(multi_start_parameters.perturbation_magnitude));
+  std::vector<std::vector<double> > start_segment_times(n_starts,
+                                                        segment_times);
+  for (size_t i = 1; i < n_starts; ++i) {
+    const double total_time_scale = std::exp(log_scale_distribution(generator));
+    for (double& t : start_segment_times[i]) {
+      t *= multi_start_parameters.perturbation == kScaleTotalTime
+               ? total_time_scale
+               : std::exp(log_scale_distribution(generator));
+    }
+  }
+
+  // All starts share the deadline.
+  const bool has_deadline = optimization_parameters_.max_time > 0.0;
+  const std::chrono::steady_clock::time_point deadline =
+      std::chrono::steady_clock::now() +
+      std::chrono::duration_cast<std::chrono::steady_clock::duration>(
+          std::chrono::duration<double>(
+              has_deadline ? optimization_parameters_.max_time : 0.0));
+
+  std::atomic<bool> stop(false);
+  std::vector<std::unique_ptr<PolynomialOptimizationNonLinear<N> > > starts(
+      n_starts);
+  std::vector<int> results(n_starts, nlopt::FAILURE);
+  ThreadPool thread_pool(
+      std::min(n_starts, multi_start_parameters.n_threads == 0
+                             ? static_cast<size_t>(std::max(
+                                   1u, std::thread::hardware_concurrency()))
+                             : multi_start_parameters.n_threads));
+  thread_pool.parallelFor(n_starts, [&](size_t start_idx, size_t) {
+    PolynomialOptimizationNonLinear<N>* start =
+        new PolynomialOptimizationNonLinear<N>(poly_opt_.getDimension(),
+                                               optimization_parameters_,
+                                               optimize_time_only_);
+    starts[start_idx].reset(start);
+    if (!start->setupFromVertices(vertices, start_segment_times[start_idx],
+                                  derivative_to_optimize)) {
+      return;
+    }
+    for (const std::shared_ptr<ConstraintData>& constraint :
+         inequality_constraints_) {
+      start->addMaximumMagnitudeConstraint(constraint->derivative,
+                                           constraint->value);
+    }
+    start->multi_start_stop_ = &stop;
+    start->multi_start_target_cost_ = multi_start_parameters.target_cost;
+    if (multi_start_parameters.target_cost >= 0.0) {
+      start->nlopt_->set_stopval(multi_start_parameters.target_cost);
+    }
+    start->cancel_token_ = cancel_token_;
+    results[start_idx] = start->optimizeUntil(has_deadline, deadline);
+    start->multi_start_stop_ = nullptr;
+  });
+
+  // Keep the start with the lowest cost that produced a solution.
+  int best_idx = -1;
+  double best_cost = std::numeric_limits<double>::infinity();
+  if (start_infos != nullptr) start_infos->clear();
+  for (size_t i = 0; i < n_starts; ++i) {
+    const OptimizationInfo& info = starts[i]->getOptimizationInfo();
+    if (start_infos != nullptr) start_infos->push_back(info);
+    const bool has_solution = results[i] > 0 ||
+                              results[i] == nlopt::FORCED_STOP ||
+                              results[i] == nlopt::ROUNDOFF_LIMITED;
+    const double cost =
+        info.cost_trajectory + info.cost_time + info.cost_soft_constraints;
+    if (has_solution && cost < best_cost) {
+      best_cost = cost;
+      best_idx = i;
+    }
+  }
+  if (best_idx < 0) {
+    LOG(WARNING) << "None of the " << n_starts << " starts succeeded.";
+    return nlopt::FAILURE;
+  }
+
+  poly_opt_ = starts[best_idx]->getPolynomialOptimizationRef();
+  optimization_info_ = starts[best_idx]->getOptimizationInfo();
+  return results[best_idx];
+}
+
 template <int _N>
 bool PolynomialOptimizationNonLinear<_N>::addMaximumMagnitudeConstraint(
     int derivative, double maximum_value) {
@@ -276,12 +598,45 @@ bool PolynomialOptimizationNonLinear<_N>::addMaximumMagnitudeConstraint(
   return true;
 }
 
+template <int _N>
+void PolynomialOptimizationNonLinear<_N>::evaluateWithCoupledCost(
+    const std::function<void()>& evaluate_cost,
+    const std::vector<double>& segment_times, bool compute_gradient,
+    double* coupled_cost, std::vector<double>* coupled_gradient) {
+  CHECK_NOTNULL(coupled_cost);
+  CHECK_NOTNULL(coupled_gradient);
+  *coupled_cost = 0.0;
+  coupled_gradient->clear();
+  if (!coupled_cost_) {
+    evaluate_cost();
+    return;
+  }
+  if (compute_gradient) {
+    coupled_gradient->assign(segment_times.size(), 0.0);
+  }
+  const auto evaluate_coupled_cost = [&]() {
+    *coupled_cost = coupled_cost_(
+        segment_times, compute_gradient ? coupled_gradient : nullptr);
+  };
+  if (coupled_cost_thread_pool_ == nullptr ||
+      coupled_cost_thread_pool_->getNumberThreads() < 2) {
+    evaluate_cost();
+    evaluate_coupled_cost();
+    return;
+  }
+  coupled_cost_thread_pool_->parallelFor(2, [&](size_t job_idx, size_t) {
+    if (job_idx == 0) {
+      evaluate_cost();
+    } else {
+      evaluate_coupled_cost();
+    }
+  });
+}
+
 template <int _N>
 double PolynomialOptimizationNonLinear<_N>::objectiveFunctionTime(
     const std::vector<double>& segment_times, std::vector<double>& gradient,
     void* data) {
-  CHECK(gradient.empty())
-      << "computing gradient not possible, choose a gradient free method";
   CHECK_NOTNULL(data);
 
   PolynomialOptimizationNonLinear<N>* optimization_data =
@@ -290,9 +645,23 @@ double PolynomialOptimizationNonLinear<_N>::objectiveFunctionTime(
   CHECK_EQ(segment_times.size(),
            optimization_data->poly_opt_.getNumberSegments());
 
-  optimization_data->poly_opt_.updateSegmentTimes(segment_times);
-  optimization_data->poly_opt_.solveLinear();
-  double cost_trajectory = optimization_data->poly_opt_.computeCost();
+  optimization_data->beginObjectiveEvaluation();
+  OptimizationTraceEntry trace_entry;
+  OptimizationTraceTimer trace_timer(optimization_data->record_trace_);
+  const bool compute_gradient = !gradient.empty();
+  double cost_trajectory = 0.0;
+  double cost_coupled = 0.0;
+  std::vector<double> gradient_coupled;
+  optimization_data->evaluateWithCoupledCost(
+      [optimization_data, &segment_times, &cost_trajectory]() {
+        optimization_data->poly_opt_.updateSegmentTimes(segment_times);
+        optimization_data->poly_opt_.solveLinear();
+        cost_trajectory = optimization_data->poly_opt_.computeCost();
+      },
+      segment_times, compute_gradient, &cost_coupled, &gradient_coupled);
+  optimization_data->updateConditionEstimate();
+  cost_trajectory += cost_coupled;
+  trace_entry.time_linear_solve = trace_timer.lap();
   double cost_time = 0;
   double cost_constraints = 0;
   const double total_time = computeTotalTrajectoryTime(segment_times);
@@ -307,12 +676,37 @@ double PolynomialOptimizationNonLinear<_N>::objectiveFunctionTime(
     std::cout << "  time: " << cost_time << std::endl;
   }
 
+  std::vector<double> gradient_segment_times;
+  std::vector<Eigen::VectorXd> gradient_free_constraints;
+  if (compute_gradient) {
+    optimization_data->poly_opt_.computeCostGradient(
+        &gradient_segment_times, &gradient_free_constraints);
+    for (size_t i = 0; i < gradient_segment_times.size(); ++i) {
+      gradient_segment_times[i] +=
+          2.0 * total_time *
+          optimization_data->optimization_parameters_.time_penalty;
+      if (!gradient_coupled.empty()) {
+        gradient_segment_times[i] += gradient_coupled[i];
+      }
+    }
+  }
+  trace_entry.time_gradient = trace_timer.lap();
+
   if (optimization_data->optimization_parameters_.use_soft_constraints) {
     cost_constraints =
         optimization_data->evaluateMaximumMagnitudeAsSoftConstraint(
             optimization_data->inequality_constraints_,
-            optimization_data->optimization_parameters_.soft_constraint_weight);
+            optimization_data->optimization_parameters_.soft_constraint_weight,
+            compute_gradient ? &gradient_segment_times : nullptr,
+            compute_gradient ? &gradient_free_constraints : nullptr);
+  }
+  trace_entry.time_constraints = trace_timer.lap();
+
+  if (compute_gradient) {
+    optimization_data->computeOptimizationVariableGradient(
+        gradient_segment_times, gradient_free_constraints, &gradient);
   }
+  trace_entry.time_gradient += trace_timer.lap();
 
   if (optimization_data->optimization_parameters_.print_debug_info) {
     std::cout << "  sum: " << cost_trajectory + cost_time + cost_constraints
@@ -326,14 +720,22 @@ double PolynomialOptimizationNonLinear<_N>::objectiveFunctionTime(
   optimization_data->optimization_info_.cost_soft_constraints =
       cost_constraints;
 
-  return cost_trajectory + cost_time + cost_constraints;
+  if (optimization_data->record_trace_) {
+    trace_entry.cost_trajectory = cost_trajectory;
+    trace_entry.cost_time = cost_time;
+    trace_entry.cost_soft_constraints = cost_constraints;
+    trace_entry.total_time = total_time;
+    optimization_data->addTraceEntry(segment_times, &trace_entry);
+  }
+
+  const double cost = cost_trajectory + cost_time + cost_constraints;
+  optimization_data->endObjectiveEvaluation(segment_times, cost);
+  return cost;
 }
 
 template <int _N>
 double PolynomialOptimizationNonLinear<_N>::objectiveFunctionTimeAndConstraints(
     const std::vector<double>& x, std::vector<double>& gradient, void* data) {
-  CHECK(gradient.empty())
-      << "computing gradient not possible, choose a gradient free method";
   CHECK_NOTNULL(data);
 
   PolynomialOptimizationNonLinear<N>* optimization_data =
@@ -346,27 +748,31 @@ double PolynomialOptimizationNonLinear<_N>::objectiveFunctionTimeAndConstraints(
 
   CHECK_EQ(x.size(), n_segments + n_free_constraints * dim);
 
-  std::vector<Eigen::VectorXd> free_constraints;
-  free_constraints.resize(dim);
   std::vector<double> segment_times;
   segment_times.reserve(n_segments);
 
   for (size_t i = 0; i < n_segments; ++i) segment_times.push_back(x[i]);
 
-  for (size_t d = 0; d < dim; ++d) {
-    const size_t idx_start = n_segments + d * n_free_constraints;
-
-    Eigen::VectorXd& free_constraints_dim = free_constraints[d];
-    free_constraints_dim.resize(n_free_constraints, Eigen::NoChange);
-    for (size_t i = 0; i < n_free_constraints; ++i) {
-      free_constraints_dim[i] = x[idx_start + i];
-    }
-  }
-
+  // The free constraints of all dimensions follow the segment times.
   optimization_data->poly_opt_.updateSegmentTimes(segment_times);
-  optimization_data->poly_opt_.setFreeConstraints(free_constraints);
-
-  double cost_trajectory = optimization_data->poly_opt_.computeCost();
+  optimization_data->beginObjectiveEvaluation();
+  OptimizationTraceEntry trace_entry;
+  OptimizationTraceTimer trace_timer(optimization_data->record_trace_);
+  const bool compute_gradient = !gradient.empty();
+  double cost_trajectory = 0.0;
+  double cost_coupled = 0.0;
+  std::vector<double> gradient_coupled;
+  optimization_data->evaluateWithCoupledCost(
+      [optimization_data, &x, n_segments, n_free_constraints, dim,
+       &cost_trajectory]() {
+        optimization_data->poly_opt_.setFreeConstraints(
+            Eigen::Map<const Eigen::MatrixXd>(x.data() + n_segments,
+                                              n_free_constraints, dim));
+        cost_trajectory = optimization_data->poly_opt_.computeCost();
+      },
+      segment_times, compute_gradient, &cost_coupled, &gradient_coupled);
+  cost_trajectory += cost_coupled;
+  trace_entry.time_linear_solve = trace_timer.lap();
   double cost_time = 0;
   double cost_constraints = 0;
 
@@ -382,12 +788,37 @@ double PolynomialOptimizationNonLinear<_N>::objectiveFunctionTimeAndConstraints(
     std::cout << "  time: " << cost_time << std::endl;
   }
 
+  std::vector<double> gradient_segment_times;
+  std::vector<Eigen::VectorXd> gradient_free_constraints;
+  if (compute_gradient) {
+    optimization_data->poly_opt_.computeCostGradient(
+        &gradient_segment_times, &gradient_free_constraints);
+    for (size_t i = 0; i < gradient_segment_times.size(); ++i) {
+      gradient_segment_times[i] +=
+          2.0 * total_time *
+          optimization_data->optimization_parameters_.time_penalty;
+      if (!gradient_coupled.empty()) {
+        gradient_segment_times[i] += gradient_coupled[i];
+      }
+    }
+  }
+  trace_entry.time_gradient = trace_timer.lap();
+
   if (optimization_data->optimization_parameters_.use_soft_constraints) {
     cost_constraints =
         optimization_data->evaluateMaximumMagnitudeAsSoftConstraint(
             optimization_data->inequality_constraints_,
-            optimization_data->optimization_parameters_.soft_constraint_weight);
+            optimization_data->optimization_parameters_.soft_constraint_weight,
+            compute_gradient ? &gradient_segment_times : nullptr,
+            compute_gradient ? &gradient_free_constraints : nullptr);
+  }
+  trace_entry.time_constraints = trace_timer.lap();
+
+  if (compute_gradient) {
+    optimization_data->computeOptimizationVariableGradient(
+        gradient_segment_times, gradient_free_constraints, &gradient);
   }
+  trace_entry.time_gradient += trace_timer.lap();
 
   if (optimization_data->optimization_parameters_.print_debug_info) {
     std::cout << "  sum: " << cost_trajectory + cost_time + cost_constraints
@@ -401,56 +832,62 @@ double PolynomialOptimizationNonLinear<_N>::objectiveFunctionTimeAndConstraints(
   optimization_data->optimization_info_.cost_soft_constraints =
       cost_constraints;
 
-  return cost_trajectory + cost_time + cost_constraints;
+  if (optimization_data->record_trace_) {
+    trace_entry.cost_trajectory = cost_trajectory;
+    trace_entry.cost_time = cost_time;
+    trace_entry.cost_soft_constraints = cost_constraints;
+    trace_entry.total_time = total_time;
+    optimization_data->addTraceEntry(segment_times, &trace_entry);
+  }
+
+  const double cost = cost_trajectory + cost_time + cost_constraints;
+  optimization_data->endObjectiveEvaluation(x, cost);
+  return cost;
 }
 
 template <int _N>
 double PolynomialOptimizationNonLinear<_N>::evaluateMaximumMagnitudeConstraint(
     const std::vector<double>& segment_times, std::vector<double>& gradient,
     void* data) {
-  CHECK(gradient.empty())
-      << "computing gradient not possible, choose a gradient free method";
   ConstraintData* constraint_data =
       static_cast<ConstraintData*>(data);  // wheee ...
   PolynomialOptimizationNonLinear<N>* optimization_data =
       constraint_data->this_object;
-
-  Extremum max;
+  // Soft constraints are timed by the objective function.
+  OptimizationTraceTimer trace_timer(
+      optimization_data->record_trace_ &&
+      !optimization_data->optimization_parameters_.use_soft_constraints);
+
+  if (constraint_data->derivative < derivative_order::POSITION ||
+      constraint_data->derivative > derivative_order::SNAP) {
+    LOG(WARNING) << "[Nonlinear inequality constraint evaluation]: no "
+                    "implementation for derivative: "
+                 << constraint_data->derivative;
+    std::fill(gradient.begin(), gradient.end(), 0.0);
+    return 0;
+  }
   // for now, let's assume that the optimization has been done
-  switch (constraint_data->derivative) {
-    case derivative_order::POSITION:
-      max = optimization_data->poly_opt_
-                .template computeMaximumOfMagnitude<derivative_order::POSITION>(
-                    nullptr);
-      break;
-    case derivative_order::VELOCITY:
-      max = optimization_data->poly_opt_
-                .template computeMaximumOfMagnitude<derivative_order::VELOCITY>(
-                    nullptr);
-      break;
-    case derivative_order::ACCELERATION:
-      max = optimization_data->poly_opt_.template computeMaximumOfMagnitude<
-          derivative_order::ACCELERATION>(nullptr);
-      break;
-    case derivative_order::JERK:
-      max = optimization_data->poly_opt_
-                .template computeMaximumOfMagnitude<derivative_order::JERK>(
-                    nullptr);
-      break;
-    case derivative_order::SNAP:
-      max = optimization_data->poly_opt_
-                .template computeMaximumOfMagnitude<derivative_order::SNAP>(
-                    nullptr);
-      break;
-    default:
-      LOG(WARNING) << "[Nonlinear inequality constraint evaluation]: no "
-                      "implementation for derivative: "
-                   << constraint_data->derivative;
-      return 0;
+  if (!optimization_data->maxima_valid_) {
+    optimization_data->computeConstraintMaxima();
+  }
+  const Extremum max =
+      optimization_data->optimization_info_.maxima[constraint_data->derivative];
+  if (max.value - constraint_data->value >
+      optimization_data->optimization_parameters_
+          .inequality_constraint_tolerance) {
+    optimization_data->iterate_feasible_ = false;
   }
 
-  optimization_data->optimization_info_.maxima[constraint_data->derivative] =
-      max;
+  if (!gradient.empty()) {
+    std::vector<double> gradient_segment_times;
+    std::vector<Eigen::VectorXd> gradient_free_constraints;
+    optimization_data->poly_opt_.computeMagnitudeGradient(
+        constraint_data->derivative, max, &gradient_segment_times,
+        &gradient_free_constraints);
+    optimization_data->computeOptimizationVariableGradient(
+        gradient_segment_times, gradient_free_constraints, &gradient);
+  }
+  optimization_data->trace_time_constraints_ += trace_timer.lap();
 
   return max.value - constraint_data->value;
 }
@@ -459,9 +896,13 @@ template <int _N>
 double
 PolynomialOptimizationNonLinear<_N>::evaluateMaximumMagnitudeAsSoftConstraint(
     const std::vector<std::shared_ptr<ConstraintData> >& inequality_constraints,
-    double weight, double maximum_cost) const {
+    double weight, std::vector<double>* gradient_segment_times,
+    std::vector<Eigen::VectorXd>* gradient_free_constraints,
+    double maximum_cost) const {
   std::vector<double> dummy;
   double cost = 0;
+  std::vector<double> constraint_gradient_segment_times;
+  std::vector<Eigen::VectorXd> constraint_gradient_free_constraints;
 
   if (optimization_parameters_.print_debug_info)
     std::cout << "  soft_constraints: " << std::endl;
@@ -477,6 +918,26 @@ PolynomialOptimizationNonLinear<_N>::evaluateMaximumMagnitudeAsSoftConstraint(
     const double current_cost =
         std::min(maximum_cost, exp(relative_violation * weight));
     cost += current_cost;
+
+    // The gradient vanishes where the cost is capped.
+    const std::map<int, Extremum>::const_iterator max =
+        optimization_info_.maxima.find(constraint->derivative);
+    if (gradient_segment_times != nullptr && current_cost < maximum_cost &&
+        max != optimization_info_.maxima.end()) {
+      CHECK_NOTNULL(gradient_free_constraints);
+      poly_opt_.computeMagnitudeGradient(constraint->derivative, max->second,
+                                         &constraint_gradient_segment_times,
+                                         &constraint_gradient_free_constraints);
+      const double scale = current_cost * weight / constraint->value;
+      for (size_t i = 0; i < gradient_segment_times->size(); ++i) {
+        (*gradient_segment_times)[i] +=
+            scale * constraint_gradient_segment_times[i];
+      }
+      for (size_t d = 0; d < gradient_free_constraints->size(); ++d) {
+        (*gradient_free_constraints)[d] +=
+            scale * constraint_gradient_free_constraints[d];
+      }
+    }
     if (optimization_parameters_.print_debug_info) {
       std::cout << "    derivative " << constraint->derivative
                 << " abs violation: " << abs_violation
@@ -487,6 +948,36 @@ PolynomialOptimizationNonLinear<_N>::evaluateMaximumMagnitudeAsSoftConstraint(
   return cost;
 }
 
+template <int _N>
+void PolynomialOptimizationNonLinear<_N>::computeOptimizationVariableGradient(
+    const std::vector<double>& gradient_segment_times,
+    const std::vector<Eigen::VectorXd>& gradient_free_constraints,
+    std::vector<double>* gradient) const {
+  CHECK_NOTNULL(gradient);
+  const size_t n_segments = gradient_segment_times.size();
+  if (optimize_time_only_) {
+    CHECK_EQ(gradient->size(), n_segments);
+    *gradient = gradient_segment_times;
+    if (!poly_opt_.addFreeConstraintSensitivity(gradient_free_constraints,
+                                                gradient)) {
+      LOG(WARNING) << "Gradient ignores the change of the free constraints.";
+    }
+    return;
+  }
+
+  const size_t n_free_constraints = poly_opt_.getNumberFreeConstraints();
+  CHECK_EQ(gradient->size(),
+           n_segments + n_free_constraints * gradient_free_constraints.size());
+  std::copy(gradient_segment_times.begin(), gradient_segment_times.end(),
+            gradient->begin());
+  for (size_t d = 0; d < gradient_free_constraints.size(); ++d) {
+    const size_t idx_start = n_segments + d * n_free_constraints;
+    for (size_t i = 0; i < n_free_constraints; ++i) {
+      (*gradient)[idx_start + i] = gradient_free_constraints[d][i];
+    }
+  }
+}
+
 template <int _N>
 void
 PolynomialOptimizationNonLinear<_N>::setFreeEndpointDerivativeHardConstraints(
@@ -0,0 +1,131 @@
+/*
+ * Copyright (c) 2016, Markus Achtelik, ASL, ETH Zurich, Switzerland
+ * Copyright (c) 2016, Michael Burri, ASL, ETH Zurich, Switzerland
+ * Copyright (c) 2016, Helen Oleynikova, ASL, ETH Zurich, Switzerland
+ * Copyright (c) 2016, Rik Bähnemann, ASL, ETH Zurich, Switzerland
+ * Copyright (c) 2016, Marija Popovic, ASL, ETH Zurich, Switzerland
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef MAV_TRAJECTORY_GENERATION_IMPL_POLYNOMIAL_OPTIMIZATION_WINDOWED_IMPL_H_
+#define MAV_TRAJECTORY_GENERATION_IMPL_POLYNOMIAL_OPTIMIZATION_WINDOWED_IMPL_H_
+
+#include <glog/logging.h>
+#include <algorithm>
+
+namespace mav_trajectory_generation {
+
+template <int _N>
+PolynomialOptimizationWindowed<_N>::PolynomialOptimizationWindowed(
+    size_t dimension, const WindowedOptimizationParameters& parameters)
+    : dimension_(dimension),
+      parameters_(parameters),
+      derivative_to_optimize_(derivative_order::INVALID),
+      n_windows_(0),
+      window_optimizer_(dimension) {
+  CHECK_GT(parameters_.window_segments, parameters_.overlap_segments)
+      << "Windows have to be longer than their overlap.";
+}
+
+template <int _N>
+bool PolynomialOptimizationWindowed<_N>::setupFromVertices(
+    const Vertex::Vector& vertices, const std::vector<double>& segment_times,
+    int derivative_to_optimize) {
+  CHECK_GE(vertices.size(), 2u);
+  CHECK_EQ(vertices.size(), segment_times.size() + 1)
+      << "Size of times must be one less than positions.";
+  CHECK(derivative_to_optimize >= 0 &&
+        derivative_to_optimize <=
+            PolynomialOptimization<N>::kHighestDerivativeToOptimize);
+  vertices_ = vertices;
+  segment_times_ = segment_times;
+  derivative_to_optimize_ = derivative_to_optimize;
+  segments_.clear();
+  n_windows_ = 0;
+  return true;
+}
+
+template <int _N>
+bool PolynomialOptimizationWindowed<_N>::solveLinear() {
+  CHECK(!vertices_.empty()) << "setupFromVertices() has to be called first.";
+  const size_t n_segments = segment_times_.size();
+  segments_.clear();
+  segments_.reserve(n_segments);
+  n_windows_ = 0;
+
+  size_t window_start = 0;
+  while (window_start < n_segments) {
+    const size_t window_end =
+        std::min(window_start + parameters_.window_segments, n_segments);
+    window_vertices_.assign(vertices_.begin() + window_start,
+                            vertices_.begin() + window_end + 1);
+    window_segment_times_.assign(segment_times_.begin() + window_start,
+                                 segment_times_.begin() + window_end);
+
+    // Continue from the end of the previous window.
+    if (window_start > 0) {
+      const Segment& seam_segment = segments_.back();
+      for (int derivative = 0;
+           derivative <=
+           PolynomialOptimization<N>::kHighestDerivativeToOptimize;
+           ++derivative) {
+        window_vertices_.front().addConstraint(
+            derivative,
+            seam_segment.evaluate(seam_segment.getTime(), derivative));
+      }
+    }
+
+    if (!window_optimizer_.setupFromVertices(window_vertices_,
+                                             window_segment_times_,
+                                             derivative_to_optimize_) ||
+        !window_optimizer_.solveLinear()) {
+      LOG(WARNING) << "Could not solve the window of segments " << window_start
+                   << " to " << window_end << ".";
+      return false;
+    }
+    window_optimizer_.getSegments(&window_segments_);
+
+    // The last window is kept completely.
+    const size_t n_keep =
+        window_end == n_segments
+            ? window_end - window_start
+            : parameters_.window_segments - parameters_.overlap_segments;
+    segments_.insert(segments_.end(), window_segments_.begin(),
+                     window_segments_.begin() + n_keep);
+    window_start += n_keep;
+    ++n_windows_;
+  }
+  return true;
+}
+
+template <int _N>
+double PolynomialOptimizationWindowed<_N>::computeCost() const {
+  typename PolynomialOptimization<N>::SquareMatrix inverse_mapping_matrix, Q;
+  double cost = 0.0;
+  for (const Segment& segment : segments_) {
+    PolynomialOptimization<N>::computeTimeScaledMatrices(
+        derivative_to_optimize_, segment.getTime(), &inverse_mapping_matrix,
+        &Q);
+    for (size_t dimension_idx = 0; dimension_idx < dimension_;
+         ++dimension_idx) {
+      const Eigen::VectorXd& c = segment[dimension_idx].getCoefficientsRef();
+      cost += c.transpose() * Q * c;
+    }
+  }
+  return 0.5 * cost;  // cost = 0.5 * c^T * Q * c
+}
+
+}  // namespace mav_trajectory_generation
+
+#endif  // MAV_TRAJECTORY_GENERATION_IMPL_POLYNOMIAL_OPTIMIZATION_WINDOWED_IMPL_H_
@@ -21,6 +21,10 @@
 #ifndef MAV_TRAJECTORY_GENERATION_YAML_IO_H_
 #define MAV_TRAJECTORY_GENERATION_YAML_IO_H_
 
+#include <cstdint>
+#include <ostream>
+#include <string>
+
 #include "mav_trajectory_generation/segment.h"
 #include "mav_trajectory_generation/trajectory.h"
 
@@ -49,6 +53,50 @@ inline bool trajectoryFromFile(
   return success;
 }
 
+// Output formats of the sampled states.
+enum class SampledStatesFormat {
+  kText,    // Space separated values, one sample per line.
+  kCsv,     // Comma separated values with a header line.
+  kBinary,  // SampledStatesHeader followed by the samples as doubles.
+};
+
+struct SampledStatesHeader {
+  static constexpr uint32_t kMagic = 0x5354534d;  // "MSTS"
+  static constexpr uint32_t kVersion = 1;
+
+  uint32_t magic;
+  uint32_t version;
+  // Number of doubles per sample.
+  uint32_t sample_size;
+  uint32_t D;
+  uint32_t max_derivative;
+  uint32_t reserved;
+  uint64_t n_samples;
+  double sampling_interval;
+};
+
+// Default number of samples that are evaluated at a time.
+constexpr size_t kSampledStatesChunkSize = 1024;
+
+// Samples the trajectory from start to end every sampling_interval and
+// writes one row per sample:
+// [t, derivative 0 (D values), ..., derivative max_derivative (D values)].
+// The samples are evaluated and written chunk_size at a time, so memory use
+// does not depend on the duration of the trajectory.
+bool sampledTrajectoryStatesToStream(
+    const Trajectory& trajectory, double sampling_interval, int max_derivative,
+    SampledStatesFormat format, std::ostream* out,
+    size_t chunk_size = kSampledStatesChunkSize);
+
+bool sampledTrajectoryStatesToFile(const std::string& filename,
+                                   const Trajectory& trajectory,
+                                   double sampling_interval,
+                                   int max_derivative,
+                                   SampledStatesFormat format);
+
+// Samples at 100 Hz up to snap and writes a text file for Matlab:
+// [t [ns], derivative 0 ... 4 (D values each), end time of segment i on row
+// i, 0 on all rows >= K].
 bool sampledTrajectoryStatesToFile(const std::string& filename,
                                    const Trajectory& trajectory);
 
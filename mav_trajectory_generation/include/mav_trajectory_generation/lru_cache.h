@@ -0,0 +1,130 @@
+/*
+ * Copyright (c) 2016, Markus Achtelik, ASL, ETH Zurich, Switzerland
+ * Copyright (c) 2016, Michael Burri, ASL, ETH Zurich, Switzerland
+ * Copyright (c) 2016, Helen Oleynikova, ASL, ETH Zurich, Switzerland
+ * Copyright (c) 2016, Rik Bähnemann, ASL, ETH Zurich, Switzerland
+ * Copyright (c) 2016, Marija Popovic, ASL, ETH Zurich, Switzerland
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef MAV_TRAJECTORY_GENERATION_LRU_CACHE_H_
+#define MAV_TRAJECTORY_GENERATION_LRU_CACHE_H_
+
+#include <glog/logging.h>
+#include <cstdint>
+#include <list>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+namespace mav_trajectory_generation {
+
+namespace internal {
+
+// Serialized problem of SolutionCache and FeasibilityCache.
+typedef std::vector<int64_t> CacheKey;
+
+struct CacheKeyHash {
+  size_t operator()(const CacheKey& key) const {
+    // FNV-1a over the raw bytes.
+    size_t hash = 14695981039346656037ull;
+    for (const int64_t value : key) {
+      const uint64_t bits = static_cast<uint64_t>(value);
+      for (int byte = 0; byte < 8; ++byte) {
+        hash ^= (bits >> (8 * byte)) & 0xff;
+        hash *= 1099511628211ull;
+      }
+    }
+    return hash;
+  }
+};
+
+// Least recently used map of at most capacity values with hit and miss
+// counters. Not thread-safe, the caches guard it with their mutex.
+template <typename Value>
+class LruCache {
+ public:
+  explicit LruCache(size_t capacity)
+      : capacity_(capacity), num_hits_(0), num_misses_(0) {
+    CHECK_GT(capacity_, 0u);
+    index_.reserve(capacity_);
+  }
+
+  // Returns the value of key and marks it as most recently used, nullptr if
+  // the key is not cached. The value is valid until the next insert() or
+  // clear().
+  const Value* find(const CacheKey& key) {
+    typename Index::iterator it = index_.find(key);
+    if (it == index_.end()) {
+      num_misses_++;
+      return nullptr;
+    }
+    num_hits_++;
+    // Move to the front.
+    entries_.splice(entries_.begin(), entries_, it->second);
+    return &it->second->second;
+  }
+
+  // Adds value as the most recently used entry and evicts the least recently
+  // used one beyond the capacity. Keeps the value of a key that is already
+  // cached, e.g., inserted concurrently by another thread.
+  void insert(const CacheKey& key, Value value) {
+    typename Index::iterator it = index_.find(key);
+    if (it != index_.end()) {
+      entries_.splice(entries_.begin(), entries_, it->second);
+      return;
+    }
+    entries_.emplace_front(key, std::move(value));
+    index_[key] = entries_.begin();
+    if (entries_.size() > capacity_) {
+      index_.erase(entries_.back().first);
+      entries_.pop_back();
+    }
+  }
+
+  // Removes all entries, keeps the counters.
+  void clear() {
+    entries_.clear();
+    index_.clear();
+  }
+
+  void resetCounters() {
+    num_hits_ = 0;
+    num_misses_ = 0;
+  }
+
+  size_t size() const { return entries_.size(); }
+  size_t getCapacity() const { return capacity_; }
+  size_t getNumHits() const { return num_hits_; }
+  size_t getNumMisses() const { return num_misses_; }
+
+ private:
+  typedef std::list<std::pair<CacheKey, Value> > EntryList;
+  typedef std::unordered_map<CacheKey, typename EntryList::iterator,
+                             CacheKeyHash>
+      Index;
+
+  size_t capacity_;
+  // Most recently used entry first.
+  EntryList entries_;
+  Index index_;
+  size_t num_hits_;
+  size_t num_misses_;
+};
+
+}  // namespace internal
+
+}  // namespace mav_trajectory_generation
+
+#endif  // MAV_TRAJECTORY_GENERATION_LRU_CACHE_H_
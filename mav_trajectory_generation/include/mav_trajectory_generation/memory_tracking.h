@@ -0,0 +1,98 @@
+/*
+ * Copyright (c) 2016, Markus Achtelik, ASL, ETH Zurich, Switzerland
+ * Copyright (c) 2016, Michael Burri, ASL, ETH Zurich, Switzerland
+ * Copyright (c) 2016, Helen Oleynikova, ASL, ETH Zurich, Switzerland
+ * Copyright (c) 2016, Rik Bähnemann, ASL, ETH Zurich, Switzerland
+ * Copyright (c) 2016, Marija Popovic, ASL, ETH Zurich, Switzerland
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef MAV_TRAJECTORY_GENERATION_MEMORY_TRACKING_H_
+#define MAV_TRAJECTORY_GENERATION_MEMORY_TRACKING_H_
+
+#include <cstddef>
+#include <cstdint>
+
+namespace mav_trajectory_generation {
+namespace memory_tracking {
+
+// Optional heap instrumentation. If the library is compiled with
+// MAV_TRAJECTORY_GENERATION_TRACK_ALLOCATIONS (CMake option of the same
+// name), it replaces the allocation functions of the C library (glibc only).
+// This counts the allocations of Eigen, which calls malloc directly, as well
+// as those of the std containers through operator new. Otherwise all counters
+// stay zero at no cost.
+//
+// Replaced are malloc, calloc, realloc, reallocarray, free and the aligned
+// variants memalign, aligned_alloc, posix_memalign, valloc and pvalloc.
+// Not counted are memory mapped directly with mmap() and any allocator that
+// takes precedence over the replacement, e.g. one loaded with LD_PRELOAD.
+
+// Heap statistics of the process since it started.
+struct AllocationStatistics {
+  AllocationStatistics()
+      : num_allocations(0),
+        allocated_bytes(0),
+        current_bytes(0),
+        peak_bytes(0) {}
+  // Calls of malloc, calloc, realloc, reallocarray or the aligned variants.
+  size_t num_allocations;
+  // Sum of the sizes of all allocations.
+  size_t allocated_bytes;
+  size_t current_bytes;
+  // Largest current_bytes since start or resetPeakBytes().
+  size_t peak_bytes;
+};
+
+// Whether the allocation functions are replaced. False if the library is
+// built without tracking or is loaded with dlopen() (e.g. as a nodelet),
+// because the replacement then does not take effect.
+bool isEnabled();
+
+AllocationStatistics getAllocationStatistics();
+
+// Restarts the peak of the process at the currently allocated bytes.
+void resetPeakBytes();
+
+// Counts the heap allocations of the calling thread between start() and
+// stop() and the peak of its allocated bytes above those at start(). Scopes of
+// the same thread can be nested. Memory is attributed to the thread that
+// allocates or frees it, so allocations of worker threads are not included.
+class AllocationScope {
+ public:
+  AllocationScope(bool construct_stopped = false);
+  ~AllocationScope();
+
+  void start();
+  void stop();
+  bool isRunning() const { return running_; }
+
+  // Of the current run if running, otherwise of the last one.
+  size_t getNumAllocations() const;
+  size_t getPeakBytes() const;
+
+ private:
+  bool running_;
+  size_t start_allocations_;
+  int64_t start_bytes_;
+  // Peak of the enclosing scope, restored by stop().
+  int64_t outer_peak_bytes_;
+  size_t num_allocations_;
+  size_t peak_bytes_;
+};
+
+}  // namespace memory_tracking
+}  // namespace mav_trajectory_generation
+
+#endif  // MAV_TRAJECTORY_GENERATION_MEMORY_TRACKING_H_
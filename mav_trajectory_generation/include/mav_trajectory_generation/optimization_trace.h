@@ -0,0 +1,141 @@
+/*
+ * Copyright (c) 2016, Markus Achtelik, ASL, ETH Zurich, Switzerland
+ * Copyright (c) 2016, Michael Burri, ASL, ETH Zurich, Switzerland
+ * Copyright (c) 2016, Helen Oleynikova, ASL, ETH Zurich, Switzerland
+ * Copyright (c) 2016, Rik Bähnemann, ASL, ETH Zurich, Switzerland
+ * Copyright (c) 2016, Marija Popovic, ASL, ETH Zurich, Switzerland
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef MAV_TRAJECTORY_GENERATION_OPTIMIZATION_TRACE_H_
+#define MAV_TRAJECTORY_GENERATION_OPTIMIZATION_TRACE_H_
+
+#include <chrono>
+#include <ostream>
+#include <string>
+#include <vector>
+
+namespace mav_trajectory_generation {
+
+namespace internal {
+
+// Number of root findings for extrema (Polynomial::computeMinMaxCandidates()
+// and the magnitude candidates of PolynomialOptimization) on the calling
+// thread so far. Read by the trace of the nonlinear optimization.
+size_t getNumRootFindingCalls();
+void countRootFindingCall();
+
+}  // namespace internal
+
+// One objective evaluation of the nonlinear optimization.
+struct OptimizationTraceEntry {
+  OptimizationTraceEntry()
+      : iteration(0),
+        cost_trajectory(0.0),
+        cost_time(0.0),
+        cost_soft_constraints(0.0),
+        total_time(0.0),
+        time_linear_solve(0.0),
+        time_gradient(0.0),
+        time_constraints(0.0),
+        n_root_finding_calls(0) {}
+
+  int iteration;
+  double cost_trajectory;
+  double cost_time;
+  double cost_soft_constraints;
+  double total_time;
+  // Time spent in seconds updating the segment times, solving the linear
+  // problem and computing its cost.
+  double time_linear_solve;
+  // Time spent in seconds computing the cost gradient.
+  double time_gradient;
+  // Time spent in seconds evaluating the soft or hard magnitude constraints
+  // since the previous entry.
+  double time_constraints;
+  // Root finder calls since the previous entry.
+  size_t n_root_finding_calls;
+};
+
+// Fixed capacity ring buffer of the objective evaluations of an
+// optimization. All memory is allocated in reset(), such that recording does
+// not allocate. Once full, the oldest entries are overwritten.
+class OptimizationTrace {
+ public:
+  OptimizationTrace() : n_segments_(0), n_recorded_(0) {}
+
+  // Clears the trace and preallocates capacity entries of n_segments segment
+  // times. A capacity of 0 disables recording.
+  void reset(size_t capacity, size_t n_segments);
+
+  bool enabled() const { return !entries_.empty(); }
+  size_t capacity() const { return entries_.size(); }
+  // Number of entries held, at most capacity().
+  size_t size() const;
+  // Number of entries that were overwritten.
+  size_t getNumDropped() const { return n_recorded_ - size(); }
+
+  void add(const OptimizationTraceEntry& entry,
+           const std::vector<double>& segment_times);
+
+  // Entry i, 0 is the oldest entry held.
+  const OptimizationTraceEntry& getEntry(size_t i) const;
+  // Segment times of entry i, n_segments values.
+  const double* getSegmentTimes(size_t i) const;
+  size_t getNumSegments() const { return n_segments_; }
+
+  // Writes one CSV row per entry, oldest first, with the segment times as
+  // columns t_0 ... t_{K-1}.
+  void writeCsv(std::ostream* stream) const;
+  bool writeCsvFile(const std::string& filename) const;
+
+ private:
+  size_t getIndex(size_t i) const;
+
+  size_t n_segments_;
+  size_t n_recorded_;
+  std::vector<OptimizationTraceEntry> entries_;
+  std::vector<double> segment_times_;
+};
+
+// Measures consecutive sections of an objective evaluation if enabled.
+class OptimizationTraceTimer {
+ public:
+  explicit OptimizationTraceTimer(bool enabled) : enabled_(enabled) {
+    if (enabled_) {
+      last_ = std::chrono::steady_clock::now();
+    }
+  }
+
+  // Returns the seconds since the previous call or construction, 0 if
+  // disabled.
+  double lap() {
+    if (!enabled_) {
+      return 0.0;
+    }
+    const std::chrono::steady_clock::time_point now =
+        std::chrono::steady_clock::now();
+    const double seconds = std::chrono::duration<double>(now - last_).count();
+    last_ = now;
+    return seconds;
+  }
+
+ private:
+  bool enabled_;
+  std::chrono::steady_clock::time_point last_;
+};
+
+}  // namespace mav_trajectory_generation
+
+#endif  // MAV_TRAJECTORY_GENERATION_OPTIMIZATION_TRACE_H_
@@ -27,6 +27,7 @@
 #include <utility>
 #include <vector>
 
+#include "mav_trajectory_generation/real_roots.h"
 #include "mav_trajectory_generation/rpoly.h"
 
 namespace mav_trajectory_generation {
@@ -50,6 +51,15 @@ class Polynomial {
   // One static shared across all members of the class, computed up to order
   // kMaxConvolutionSize.
   static Eigen::MatrixXd base_coefficients_;
+  static_assert(kMaxConvolutionSize - 1 <=
+                    JenkinsTraubSolver::kMaxInlineDegree,
+                "Roots of convolutions have to fit the inline scratch memory.");
+  // Coefficients of at most kMaxConvolutionSize entries, stored inline, e.g.,
+  // of the product of a polynomial and its derivative.
+  typedef Eigen::Matrix<double, Eigen::Dynamic, 1,
+                        Eigen::ColMajor | Eigen::DontAlign,
+                        kMaxConvolutionSize, 1>
+      ConvolutionCoefficients;
 
   Polynomial(int N) : N_(N), coefficients_(N) { coefficients_.setZero(); }
 
@@ -90,11 +100,18 @@ class Polynomial {
   // Sets up the internal representation from coefficients.
   // Coefficients are stored in increasing order with the power of t,
   // i.e. c1 + c2*t + c3*t^2 ==> coeffs = [c1 c2 c3]
-  void setCoefficients(const Eigen::VectorXd& coeffs) {
+  // Takes any Eigen vector, such that fixed-size coefficients are copied
+  // without a temporary.
+  template <typename Derived>
+  void setCoefficients(const Eigen::MatrixBase<Derived>& coeffs) {
     CHECK_EQ(N_, coeffs.size()) << "Number of coefficients has to match.";
     coefficients_ = coeffs;
   }
 
+  // Returns a const reference to the coefficients of the polynomial itself,
+  // without copying.
+  const Eigen::VectorXd& getCoefficientsRef() const { return coefficients_; }
+
   // Returns the coefficients for the specified derivative of the
   // polynomial as a ROW vector.
   Eigen::VectorXd getCoefficients(int derivative = 0) const {
@@ -123,11 +140,10 @@ class Polynomial {
 
     const int tmp = N_ - 1;
     for (int i = 0; i < max_deg; i++) {
-      Eigen::RowVectorXd row = base_coefficients_.block(i, 0, 1, N_);
-      double acc = row[tmp] * coefficients_[tmp];
+      double acc = base_coefficients_(i, tmp) * coefficients_[tmp];
       for (int j = tmp - 1; j >= i; --j) {
         acc *= t;
-        acc += row[j] * coefficients_[j];
+        acc += base_coefficients_(i, j) * coefficients_[j];
       }
       (*result)[i] = acc;
     }
@@ -141,11 +157,35 @@ class Polynomial {
     }
     double result;
     const int tmp = N_ - 1;
-    Eigen::RowVectorXd row = base_coefficients_.block(derivative, 0, 1, N_);
-    result = row[tmp] * coefficients_[tmp];
+    result = base_coefficients_(derivative, tmp) * coefficients_[tmp];
     for (int j = tmp - 1; j >= derivative; --j) {
       result *= t;
-      result += row[j] * coefficients_[j];
+      result += base_coefficients_(derivative, j) * coefficients_[j];
+    }
+    return result;
+  }
+
+  // Shifts N coefficients stored elsewhere in time, such that
+  // new(t) = old(t + t_offset), by repeated synthetic division.
+  static void shiftCoefficients(double t_offset, int N, double* coefficients) {
+    for (int i = 0; i < N - 1; ++i) {
+      for (int j = N - 2; j >= i; --j) {
+        coefficients[j] += t_offset * coefficients[j + 1];
+      }
+    }
+  }
+
+  // Same as evaluate(t, derivative) for N coefficients stored elsewhere, e.g.
+  // in a flat buffer.
+  static double evaluateCoefficients(const double* coefficients, int N,
+                                     double t, int derivative) {
+    if (derivative >= N) {
+      return 0.0;
+    }
+    double result = base_coefficients_(derivative, N - 1) * coefficients[N - 1];
+    for (int j = N - 2; j >= derivative; --j) {
+      result *= t;
+      result += base_coefficients_(derivative, j) * coefficients[j];
     }
     return result;
   }
@@ -173,15 +213,34 @@ class Polynomial {
 
   // Finds all candidates for the minimum and maximum between t_start and t_end
   // by evaluating the roots of the polynomial's derivative.
-  bool selectMinMaxCandidatesFromRoots(
+  static bool selectMinMaxCandidatesFromRoots(
       double t_start, double t_end,
       const Eigen::VectorXcd& roots_derivative_of_derivative,
-      std::vector<double>* candidates) const;
+      std::vector<double>* candidates);
 
   // Finds all candidates for the minimum and maximum between t_start and t_end
   // by computing the roots of the derivative polynomial.
-  bool computeMinMaxCandidates(double t_start, double t_end, int derivative,
-                               std::vector<double>* candidates) const;
+  // Input: method = Root finder, see RootFindingMethod.
+  bool computeMinMaxCandidates(
+      double t_start, double t_end, int derivative,
+      std::vector<double>* candidates,
+      RootFindingMethod method = kJenkinsTraub) const;
+
+  // Same as computeMinMaxCandidates(), but from the coefficients of the
+  // derivative itself, e.g., of a magnitude.
+  static bool computeMinMaxCandidatesFromDerivative(
+      const Eigen::Ref<const Eigen::VectorXd>& derivative_coefficients,
+      double t_start, double t_end, std::vector<double>* candidates,
+      RootFindingMethod method = kJenkinsTraub);
+
+  // Adds the product of the derivative and the next derivative of this
+  // polynomial to result, i.e., half the derivative of the squared
+  // derivative. Summed over the dimensions of a segment, the roots are the
+  // candidates for the magnitude extrema. Fuses the derivatives and the
+  // convolution without temporaries.
+  // Input: result = Of size 2 * (N - derivative) - 2.
+  void addMagnitudeDerivativeCoefficients(
+      int derivative, Eigen::Ref<Eigen::VectorXd> result) const;
 
   // Evaluates the minimum and maximum of a polynomial between time t_start and
   // t_end given the roots of the derivative.
@@ -199,6 +258,13 @@ class Polynomial {
                      std::pair<double, double>* minimum,
                      std::pair<double, double>* maximum) const;
 
+  // Bounds the derivative between time t_start and t_end by the smallest and
+  // largest coefficient of its Bernstein basis on that interval (convex hull
+  // property). The bounds are conservative but need no root finding. The
+  // first and last coefficient are the values at t_start and t_end.
+  void computeBernsteinBounds(double t_start, double t_end, int derivative,
+                              double* minimum, double* maximum) const;
+
   // Selects the minimum and maximum of a polynomial among a candidate set.
   // Returns the minimum and maximum as pair<t, value>.
   bool selectMinMaxFromCandidates(const std::vector<double>& candidates,
@@ -251,6 +317,24 @@ class Polynomial {
   static Eigen::VectorXd convolve(const Eigen::VectorXd& data,
                                   const Eigen::VectorXd& kernel);
 
+  // Same as convolve(), but without allocating. The convolution has to fit
+  // into kMaxConvolutionSize.
+  template <typename DerivedData, typename DerivedKernel>
+  static void convolve(const Eigen::MatrixBase<DerivedData>& data,
+                       const Eigen::MatrixBase<DerivedKernel>& kernel,
+                       ConvolutionCoefficients* convolved) {
+    CHECK_NOTNULL(convolved);
+    const int convolution_dimension =
+        getConvolutionLength(data.size(), kernel.size());
+    CHECK_LE(convolution_dimension, kMaxConvolutionSize);
+    convolved->setZero(convolution_dimension);
+    for (int i = 0; i < data.size(); ++i) {
+      for (int j = 0; j < kernel.size(); ++j) {
+        (*convolved)[i + j] += data[i] * kernel[j];
+      }
+    }
+  }
+
   static inline int getConvolutionLength(int data_size, int kernel_size) {
     return data_size + kernel_size - 1;
   }
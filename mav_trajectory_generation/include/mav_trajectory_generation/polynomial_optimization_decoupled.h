@@ -0,0 +1,114 @@
+/*
+ * Copyright (c) 2016, Markus Achtelik, ASL, ETH Zurich, Switzerland
+ * Copyright (c) 2016, Michael Burri, ASL, ETH Zurich, Switzerland
+ * Copyright (c) 2016, Helen Oleynikova, ASL, ETH Zurich, Switzerland
+ * Copyright (c) 2016, Rik Bähnemann, ASL, ETH Zurich, Switzerland
+ * Copyright (c) 2016, Marija Popovic, ASL, ETH Zurich, Switzerland
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef MAV_TRAJECTORY_GENERATION_POLYNOMIAL_OPTIMIZATION_DECOUPLED_H_
+#define MAV_TRAJECTORY_GENERATION_POLYNOMIAL_OPTIMIZATION_DECOUPLED_H_
+
+#include <vector>
+
+#include "mav_trajectory_generation/polynomial_optimization_linear.h"
+#include "mav_trajectory_generation/polynomial_optimization_nonlinear.h"
+
+namespace mav_trajectory_generation {
+
+class ThreadPool;
+
+// Optimizes the position and the yaw of a path as two problems over the same
+// segment times. The dimensions only interact through the segment times,
+// thus the yaw can use fewer coefficients, e.g. _N_yaw = 6 for the
+// acceleration, and both linear problems can be solved concurrently. The last
+// dimension of the vertices is the yaw, all other dimensions are the
+// position.
+template <int _N = 10, int _N_yaw = 6>
+class PolynomialOptimizationDecoupledYaw {
+  static_assert(_N_yaw % 2 == 0, "The number of coefficients has to be even.");
+
+ public:
+  enum { N = _N, N_yaw = _N_yaw };
+
+  // Input: dimension = Dimension of the vertices including the yaw, usually
+  // 4.
+  // Input: parameters, optimize_time_only = Of the nonlinear optimization of
+  // the position, see PolynomialOptimizationNonLinear.
+  PolynomialOptimizationDecoupledYaw(
+      size_t dimension, const NonlinearOptimizationParameters& parameters,
+      bool optimize_time_only);
+
+  // Splits the vertices into position and yaw. Yaw constraints of
+  // derivatives that N_yaw coefficients cannot meet are ignored.
+  bool setupFromVertices(
+      const Vertex::Vector& vertices, const std::vector<double>& segment_times,
+      int derivative_to_optimize =
+          PolynomialOptimization<N>::kHighestDerivativeToOptimize,
+      int yaw_derivative_to_optimize =
+          PolynomialOptimization<N_yaw>::kHighestDerivativeToOptimize);
+
+  // Adds a maximum magnitude constraint on the position, see
+  // PolynomialOptimizationNonLinear::addMaximumMagnitudeConstraint().
+  bool addMaximumMagnitudeConstraint(int derivative_order,
+                                     double maximum_value);
+
+  // Solves both linear problems at the current segment times.
+  // Input: thread_pool = Solves the position and the yaw concurrently.
+  // Optional, can be set to nullptr to run in the calling thread.
+  bool solveLinear(ThreadPool* thread_pool = nullptr);
+
+  // Optimizes the segment times for the sum of the position and the yaw cost.
+  // The yaw is solved in every objective evaluation at the segment times of
+  // the position and its free constraints are not optimization variables.
+  // Input: thread_pool = Solves the yaw concurrently with the position in
+  // every objective evaluation. Optional, can be set to nullptr to run in
+  // the calling thread.
+  // Output: return = The nlopt result, see
+  // PolynomialOptimizationNonLinear::optimize().
+  int optimize(ThreadPool* thread_pool = nullptr);
+
+  // Merges the position and the yaw by
+  // Trajectory::getTrajectoryWithAppendedDimension(), the yaw is padded to N
+  // coefficients.
+  bool getTrajectory(Trajectory* trajectory) const;
+
+  const PolynomialOptimizationNonLinear<N>& getPositionOptimizationRef()
+      const {
+    return position_opt_;
+  }
+  PolynomialOptimizationNonLinear<N>& getPositionOptimizationRef() {
+    return position_opt_;
+  }
+  const PolynomialOptimization<N_yaw>& getYawOptimizationRef() const {
+    return yaw_opt_;
+  }
+
+ private:
+  // Cost of the yaw at segment_times, a
+  // PolynomialOptimizationNonLinear::CoupledCost.
+  double computeYawCost(const std::vector<double>& segment_times,
+                        std::vector<double>* gradient);
+
+  size_t dimension_;
+  PolynomialOptimizationNonLinear<N> position_opt_;
+  PolynomialOptimization<N_yaw> yaw_opt_;
+};
+
+}  // namespace mav_trajectory_generation
+
+#endif  // MAV_TRAJECTORY_GENERATION_POLYNOMIAL_OPTIMIZATION_DECOUPLED_H_
+
+#include "mav_trajectory_generation/impl/polynomial_optimization_decoupled_impl.h"
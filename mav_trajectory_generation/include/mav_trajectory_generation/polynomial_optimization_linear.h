@@ -22,11 +22,15 @@
 #define MAV_TRAJECTORY_GENERATION_POLYNOMIAL_OPTIMIZATION_LINEAR_H_
 
 #include <glog/logging.h>
+#include <Eigen/Dense>
 #include <Eigen/Sparse>
 #include <tuple>
+#include <utility>
 
 #include "mav_trajectory_generation/extremum.h"
+#include "mav_trajectory_generation/fixed_polynomial.h"
 #include "mav_trajectory_generation/motion_defines.h"
+#include "mav_trajectory_generation/optimization_trace.h"
 #include "mav_trajectory_generation/polynomial.h"
 #include "mav_trajectory_generation/segment.h"
 #include "mav_trajectory_generation/trajectory.h"
@@ -35,6 +39,24 @@
 namespace mav_trajectory_generation
 {
 
+class ThreadPool;
+
+// Backend used by PolynomialOptimization::solveLinear() to factorize the
+// free-free block of the cost matrix (Rpp in [1]).
+enum LinearSolverType
+{
+  // Dense LDLT for small problems, sparse LDLT otherwise.
+  kLinearSolverDefault = 0,
+  // Dense LDLT with pivoting.
+  kLinearSolverDenseLDLT,
+  // Sparse LDLT without reordering. Free constraints are sorted by vertex,
+  // thus Rpp of a chain of segments is banded and the factor stays within
+  // the band.
+  kLinearSolverBandedLDLT,
+  // Sparse QR with COLAMD ordering. Slowest, but also handles singular Rpp.
+  kLinearSolverSparseQR
+};
+
 // Implements the unconstrained optimization of paths consisting of
 // polynomial segments as described in [1]
 // [1]: Polynomial Trajectory Planning for Aggressive Quadrotor Flight in Dense
@@ -47,6 +69,8 @@ template <int _N = 10>
 class PolynomialOptimization
 {
   static_assert(_N % 2 == 0, "The number of coefficients has to be even.");
+  static_assert(_N <= Polynomial::kMaxN,
+                "The number of coefficients has to be at most kMaxN.");
 
 public:
   enum
@@ -57,6 +81,9 @@ public:
   typedef Eigen::Matrix<double, N, N> SquareMatrix;
   typedef std::vector<SquareMatrix, Eigen::aligned_allocator<SquareMatrix>>
       SquareMatrixVector;
+  // Element (derivative, vertex) is true if the derivative is fixed at the
+  // vertex.
+  typedef Eigen::Array<bool, Eigen::Dynamic, Eigen::Dynamic> ConstraintMask;
 
   // Sets up the optimization problem for the specified dimension.
   PolynomialOptimization(size_t dimension);
@@ -73,6 +100,21 @@ public:
       const Vertex::Vector &vertices, const std::vector<double> &segment_times,
       int derivative_to_optimize = kHighestDerivativeToOptimize);
 
+  // Same as setupFromVertices(), but from dense matrices, e.g. for thousands
+  // of waypoints. The constraints are indexed directly, without building the
+  // vertices, which are only created if they are needed, e.g. by
+  // getVertices().
+  // Input: derivatives = One (dimension x n_vertices) matrix per derivative,
+  // starting at the position. Values of free constraints are ignored.
+  // Input: constraint_mask = (derivatives.size() x n_vertices), true for the
+  // fixed constraints. Derivatives above kHighestDerivativeToOptimize are
+  // ignored.
+  bool setupFromMatrices(
+      const std::vector<Eigen::MatrixXd> &derivatives,
+      const ConstraintMask &constraint_mask,
+      const std::vector<double> &segment_times,
+      int derivative_to_optimize = kHighestDerivativeToOptimize);
+
   // Sets up the optimization problem from a vector of positions and a
   // vector of times between the via points.
   // The optimized derivative is set to the maximum possible based on the given
@@ -84,6 +126,42 @@ public:
   bool setupFromPositons(const std::vector<double> &positions,
                          const std::vector<double> &times);
 
+  // Receding-horizon updates of a problem that was set up with
+  // setupFromVertices(). They change the vertices at the ends of the problem
+  // without a new setup, keep the derivative to optimize and the segment
+  // times of the remaining segments, and carry the free constraints of the
+  // remaining vertices over to the new problem. New free constraints start at
+  // zero. The trajectory is updated to this warm start, which is the initial
+  // guess of the nonlinear optimization, until solveLinear() is called.
+
+  // Removes vertices at the start and the end of the problem. At least two
+  // vertices have to remain.
+  bool removeVertices(size_t n_front, size_t n_back);
+
+  // Inserts vertices before the start of the problem.
+  // Input: segment_times = Time of the segment from each vertex to the next
+  // one. Thus, its size is size(vertices).
+  bool prependVertices(const Vertex::Vector &vertices,
+                       const std::vector<double> &segment_times);
+
+  // Appends vertices after the end of the problem.
+  // Input: segment_times = Time of the segment leading to each vertex. Thus,
+  // its size is size(vertices).
+  bool appendVertices(const Vertex::Vector &vertices,
+                      const std::vector<double> &segment_times);
+
+  // Pins the derivatives up to the derivative to optimize of the start
+  // vertex to the state of a trajectory at time t, e.g. the state that is
+  // currently commanded from the previous solution.
+  bool pinStartToTrajectory(const Trajectory &trajectory, double t);
+
+  // Moves the start of the problem to time t of the trajectory, which has to
+  // be the current solution of this problem, e.g. from getTrajectory().
+  // Removes the vertices that are passed before t, shortens the first
+  // remaining segment to the time left from t and pins the start to the
+  // state of the trajectory at t.
+  bool advanceStart(const Trajectory &trajectory, double t);
+
   // Wrapper that inverts the mapping matrix (A in [1]) to take advantage
   // of its structure.
   // Input: A matrix
@@ -93,16 +171,72 @@ public:
 
   static void setupMappingMatrix(double segment_time, SquareMatrix *A);
 
+  // Computes the inverse mapping matrix and the cost matrix of a segment by
+  // diagonal scaling of the matrices for unit segment time, avoiding the
+  // inversion: A^{-1}(T) = diag(T^-k) * A^{-1}(1) * diag(T^d), where d is the
+  // derivative of the respective constraint, and
+  // Q(T) = T^(1-2r) * diag(T^k) * Q(1) * diag(T^k), where r is the derivative
+  // to optimize.
+  // Input: derivative = Derivative used to compute the cost.
+  // Input: segment_time = Time of the segment.
+  // Output: inverse_mapping_matrix = A^{-1}(segment_time)
+  // Output: cost_matrix = Q(segment_time)
+  static void computeTimeScaledMatrices(int derivative, double segment_time,
+                                        SquareMatrix *inverse_mapping_matrix,
+                                        SquareMatrix *cost_matrix);
+
+  // Computes the cost block H = A^{-T} * Q * A^{-1} of a segment from the
+  // block for unit segment time. The scaling with T^k cancels between A^{-1}
+  // and Q, leaving H(T) = T^(1-2r) * diag(T^d) * H(1) * diag(T^d).
+  // Output: cost_block = H(segment_time)
+  static void computeTimeScaledCostBlock(int derivative, double segment_time,
+                                         SquareMatrix *cost_block);
+
   // Computes the cost in the derivative that was specified during
   // setupFromVertices().
   // The cost is computed as: 0.5*c^T*Q*c
   // where c are the coefficients and Q is the cost matrix of each segment.
   double computeCost() const;
 
+  // Gradients for gradient-based nonlinear optimization. They are partial
+  // derivatives w.r.t. the segment times at constant constraints and w.r.t.
+  // the free constraints of every dimension (d_p in [1]).
+
+  // Computes the gradient of computeCost().
+  // Output: gradient_segment_times = dJ/dT for every segment.
+  // Output: gradient_free_constraints = dJ/dd_p for every dimension, which is
+  // zero after solveLinear(). Optional, can be set to nullptr.
+  void computeCostGradient(
+      std::vector<double> *gradient_segment_times,
+      std::vector<Eigen::VectorXd> *gradient_free_constraints) const;
+
+  // Computes the gradient of the magnitude of the specified derivative at
+  // the time of the extremum. The time of the extremum is assumed to scale
+  // with the time of its segment.
+  // Output: gradient_segment_times = dF/dT for every segment.
+  // Output: gradient_free_constraints = dF/dd_p for every dimension.
+  void computeMagnitudeGradient(
+      int derivative, const Extremum &extremum,
+      std::vector<double> *gradient_segment_times,
+      std::vector<Eigen::VectorXd> *gradient_free_constraints) const;
+
+  // Adds the change of the free constraints computed by solveLinear() with
+  // the segment times to a gradient w.r.t. the segment times by the adjoint
+  // of the linear solve: dF/dT += -lambda^T * dRp/dT * d with
+  // Rpp * lambda = dF/dd_p. Only valid after solveLinear() with the current
+  // segment times.
+  // Input: gradient_free_constraints = dF/dd_p for every dimension.
+  // Input/Output: gradient_segment_times = dF/dT for every segment.
+  // Returns false if the adjoint system could not be solved.
+  bool addFreeConstraintSensitivity(
+      const std::vector<Eigen::VectorXd> &gradient_free_constraints,
+      std::vector<double> *gradient_segment_times) const;
+
   // Updates the segment times. The number of times has to be equal to
   // the number of vertices that was initially passed during the problem setup.
-  // This recomputes all cost- and inverse mapping block-matrices and is meant
-  // to be called during non-linear optimization procedures.
+  // This recomputes the cost- and inverse mapping block-matrices of segments
+  // whose time changed and is meant to be called during non-linear
+  // optimization procedures.
   void updateSegmentTimes(const std::vector<double> &segment_times);
 
   // Solves the linear optimization problem according to [1].
@@ -110,8 +244,40 @@ public:
   //  - segment times are equal for each dimension.
   //  - each dimension has the same type/set of constraints. Their values can of
   //    course differ.
+  // Rpp is factorized by the backend set with setLinearSolverType(). If the
+  // LDLT backends fail, e.g. because Rpp is singular, SparseQR is used.
+  // Repeated calls after updateSegmentTimes() only update the blocks of R of
+  // the changed segments and re-use the sparsity pattern of R and the
+  // symbolic factorization of Rpp.
   bool solveLinear();
 
+  // Selects the backend used by solveLinear().
+  void setLinearSolverType(LinearSolverType linear_solver_type)
+  {
+    linear_solver_type_ = linear_solver_type;
+  }
+  LinearSolverType getLinearSolverType() const { return linear_solver_type_; }
+
+  // Solves for the free constraints in normalized units, such that Rpp has a
+  // unit diagonal. The free derivatives of a vertex scale with powers of the
+  // times of its segments, which makes Rpp badly conditioned for segment
+  // times far from 1, e.g. a derivative of order k enters with T^(1-2r+2k).
+  // The solution is the same up to rounding. Disabled by default, such that
+  // existing problems keep their numerics.
+  void setNormalization(bool normalize) { normalize_ = normalize; }
+  bool getNormalization() const { return normalize_; }
+
+  // Estimate of the condition number of the factorized, normalized if
+  // enabled, Rpp of the last solveLinear(). It is the ratio of the largest
+  // to the smallest pivot of the factorization, which bounds the condition
+  // number from below. 0 if not available, e.g. if there are no free
+  // constraints.
+  double getConditionEstimate() const { return condition_estimate_; }
+
+  // Problems up to this number of free constraints are solved densely by
+  // kLinearSolverDefault.
+  static constexpr size_t kMaxFreeConstraintsDenseSolver = 48;
+
   // Returns the trajectory created by the optimization.
   // Only valid after solveLinear() is called. This is the preferred external
   // interface for getting information back out of the solver.
@@ -138,13 +304,15 @@ public:
   // Input: t_start = Only maxima >= t_start are returned. Usually set to 0.
   // Input: t_stop = Only maxima <= t_stop are returned. Usually set to
   // segment time.
+  // Input: method = Root finder, see RootFindingMethod.
   // Output: candidates = Vector containing the candidate times for a maximum.
   // Returns whether the computation succeeded -- false means no candidates
-  // were found by Jenkins-Traub.
+  // were found by the root finder.
   template <int Derivative>
   static bool computeSegmentMaximumMagnitudeCandidates(
       const Segment &segment, double t_start, double t_stop,
-      std::vector<double> *candidates);
+      std::vector<double> *candidates,
+      RootFindingMethod method = kRealIntervalRoots);
 
   // Computes the candidates for the maximum magnitude of a single
   // segment in the specified derivative.
@@ -172,10 +340,31 @@ public:
   template <int Derivative>
   Extremum computeMaximumOfMagnitude(std::vector<Extremum> *candidates) const;
 
+  // Computes the global maxima of the magnitude of the path for several
+  // derivatives in one pass over the segments, see
+  // computeMaximumOfMagnitude(). The derivative coefficients of a segment
+  // are computed once and shared by all derivatives.
+  // Input: derivatives = Derivatives of position, each in [POSITION, SNAP]
+  // and below N - 1.
+  // Input: thread_pool = Processes the segments in parallel. Optional, can
+  // be set to nullptr to run in the calling thread.
+  // Output: maxima = The global maximum per derivative, in the order of
+  // derivatives.
+  void computeMaximaOfMagnitude(const std::vector<int> &derivatives,
+                                std::vector<Extremum> *maxima,
+                                ThreadPool *thread_pool = nullptr) const;
+
   void getVertices(Vertex::Vector *vertices) const
   {
     CHECK_NOTNULL(vertices);
-    *vertices = vertices_;
+    if (vertices_valid_)
+    {
+      *vertices = vertices_;
+    }
+    else
+    {
+      getVerticesFromConstraints(vertices);
+    }
   }
 
   // Only for internal use -- always use getTrajectory() instead if you can!
@@ -195,16 +384,40 @@ public:
       std::vector<Eigen::VectorXd> *free_constraints) const
   {
     CHECK(free_constraints != nullptr);
-    *free_constraints = free_constraints_compact_;
+    getColumns(free_constraints_compact_, free_constraints);
+  }
+
+  // Returns the free constraints with one column per dimension. They are
+  // stored contiguously in the order of the free constraints of
+  // PolynomialOptimizationNonLinear.
+  const Eigen::MatrixXd &getFreeConstraintsRef() const
+  {
+    return free_constraints_compact_;
   }
 
   void setFreeConstraints(const std::vector<Eigen::VectorXd> &free_constraints);
 
+  // Sets the free constraints from a matrix with one column per dimension,
+  // e.g. an Eigen::Map of the optimization variables. Only the segments
+  // adjacent to changed free constraints or segment times are recomputed.
+  void setFreeConstraints(
+      const Eigen::Ref<const Eigen::MatrixXd> &free_constraints);
+
+  // Returns whether the free constraints were set for the current problem by
+  // solveLinear(), setFreeConstraints() or a receding-horizon update.
+  bool hasFreeConstraints() const { return free_constraints_set_; }
+
   void getFixedConstraints(
       std::vector<Eigen::VectorXd> *fixed_constraints) const
   {
     CHECK(fixed_constraints != nullptr);
-    *fixed_constraints = fixed_constraints_compact_;
+    getColumns(fixed_constraints_compact_, fixed_constraints);
+  }
+
+  // Returns the fixed constraints with one column per dimension.
+  const Eigen::MatrixXd &getFixedConstraintsRef() const
+  {
+    return fixed_constraints_compact_;
   }
 
   // Computes the Jacobian of the integral over the squared derivative
@@ -233,25 +446,140 @@ public:
   void printReorderingMatrix(std::ostream &stream) const;
 
 private:
+  // Vertex index and derivative of a constraint.
+  typedef std::pair<size_t, int> ConstraintKey;
+
+  // Maxima of computeMaximaOfMagnitude() for a single segment, without the
+  // segment end.
+  // Input: extrema_times = Scratch memory.
+  // Output: maxima = One per derivative.
+  static void computeSegmentMaximaOfMagnitude(
+      const Segment &segment, int segment_idx,
+      const std::vector<int> &derivatives, std::vector<double> *extrema_times,
+      Extremum *maxima);
+
+  // Sets up the problem from vertices_, which have to be set. Removes
+  // constraints of invalid derivatives from the vertices.
+  void setupFromCurrentVertices(const std::vector<double> &segment_times);
+
+  // Sets up the problem from fixed_constraint_mask_ and
+  // fixed_constraints_compact_, which have to be set.
+  void setupFromCurrentConstraints(const std::vector<double> &segment_times);
+
+  // Vertices with the fixed constraints of fixed_constraint_mask_ and
+  // fixed_constraints_compact_.
+  void getVerticesFromConstraints(Vertex::Vector *vertices) const;
+
+  // Creates vertices_ if the problem was set up from matrices.
+  void updateVertices();
+
+  // Replaces vertices and segment times by a receding-horizon update.
+  // Vertex i of the new problem is vertex i + vertex_offset of the current
+  // problem, whose free constraints are kept.
+  void updateHorizon(const Vertex::Vector &vertices,
+                     const std::vector<double> &segment_times,
+                     int vertex_offset);
+
+  // Returns the vertex and derivative of every free constraint in the order
+  // of d_p.
+  void getFreeConstraintKeys(std::vector<ConstraintKey> *keys) const;
+
   // Constructs the sparse R (cost) matrix.
   void constructR(Eigen::SparseMatrix<double> *R) const;
 
+  // Sets up the sparsity patterns of Rpp and Rpf and the location of every
+  // element of the block H of each segment in their values.
+  void setupCachedRPattern();
+
+  // Updates the values of the cached Rpp and Rpf that depend on segments with
+  // changed segment times.
+  void updateCachedR();
+
   // Sets up the matrix (C in [1]) that reorders constraints for the
-  // optimization problem.
+  // optimization problem from fixed_constraint_mask_.
   // This matrix is the same for each dimension, i.e. each dimension must have
   // the same fixed and free parameters.
   void setupConstraintReorderingMatrix();
 
-  // Updates the segments stored internally from the set of compact fixed
-  // and free constraints.
+  // Updates the outdated segments stored internally from the set of compact
+  // fixed and free constraints.
   void updateSegmentsFromCompactConstraints();
 
+  // Marks the segments as outdated whose free constraints differ from the
+  // given ones.
+  void markSegmentsOfChangedFreeConstraints(
+      const Eigen::Ref<const Eigen::MatrixXd> &free_constraints);
+
+  // Inverse mapping matrix and cost matrices for unit segment time, computed
+  // once per N.
+  static const SquareMatrix &getUnitInverseMappingMatrix();
+  static const SquareMatrix &getUnitCostMatrix(int derivative);
+  static const SquareMatrix &getUnitCostBlock(int derivative);
+
+  // Rpp to factorize, normalized if enabled. Only valid after
+  // updateCachedR().
+  const Eigen::SparseMatrix<double> &getRppToFactorize() const;
+  // Updates free_constraint_scaling_ and Rpp_normalized_ from Rpp_cached_.
+  void normalizeRpp();
+  // Ratio of the largest to the smallest absolute pivot, infinity if
+  // singular and 0 if empty. Takes any expression, e.g. the diagonal of a
+  // factorization, without copying it.
+  template <typename Derived>
+  static double computePivotRatio(const Eigen::MatrixBase<Derived> &pivots);
+
+  // Computes the free constraints of every dimension from the factorization
+  // of Rpp: dp = -Rpp^-1 * Rpf * df.
+  // Returns false if the solver failed.
+  template <typename Solver>
+  bool solveFreeConstraints(const Solver &solver);
+
+  // Solves Rpp * x = rhs with the factorization of the last solveLinear().
+  // Solves all columns of rhs at once.
+  bool solveFactorizedRpp(const Eigen::MatrixXd &rhs, Eigen::MatrixXd *x) const;
+  // Solves with the factorization of getRppToFactorize(), i.e. without
+  // undoing the normalization.
+  bool solveFactorizedRppToFactorize(const Eigen::MatrixXd &rhs,
+                                     Eigen::MatrixXd *x) const;
+
+  // Gathers the constraints of a segment (C * d in [1]) from the compact
+  // fixed and free constraints of one dimension.
+  void getSegmentConstraints(size_t segment_idx,
+                             const Eigen::Ref<const Eigen::VectorXd> &df,
+                             const Eigen::Ref<const Eigen::VectorXd> &dp,
+                             Eigen::Matrix<double, N, 1> *d_segment) const;
+
+  // Copies the columns of a matrix into a vector of vectors.
+  static void getColumns(const Eigen::MatrixXd &matrix,
+                         std::vector<Eigen::VectorXd> *columns);
+
+  // Adds the entries of a gradient w.r.t. the constraints of a segment that
+  // belong to free constraints to the gradient w.r.t. d_p (C^T in [1]).
+  void addToFreeConstraintGradient(
+      size_t segment_idx, const Eigen::Matrix<double, N, 1> &gradient_segment,
+      Eigen::VectorXd *gradient_free_constraints) const;
+
+  // Computes y^T * dH/dT * x for the block H = A^{-T}QA^{-1} of a segment,
+  // where x and y are constraints of the segment.
+  double computeCostBlockTimeDerivative(
+      size_t segment_idx, const Eigen::Matrix<double, N, 1> &x,
+      const Eigen::Matrix<double, N, 1> &y) const;
+
   // Matrix consisting of entries with value 1 to reorder free and fixed
   // constraints (C in [1]).
   Eigen::SparseMatrix<double> constraint_reordering_;
 
-  // Original vertices containing the constraints.
+  // Column of the single non-zero in every row of constraint_reordering_,
+  // i.e. the index of every segment constraint in [d_f; d_p].
+  std::vector<int> constraint_reordered_indices_;
+
+  // Original vertices containing the constraints. Only valid if
+  // vertices_valid_, after a setup from matrices they are created on demand.
   Vertex::Vector vertices_;
+  bool vertices_valid_;
+
+  // (N / 2 x n_vertices), true for the fixed constraints. Free and fixed
+  // constraints are ordered by vertex, then derivative.
+  ConstraintMask fixed_constraint_mask_;
 
   // The actual segments containing the solution.
   Segment::Vector segments_;
@@ -264,12 +592,12 @@ private:
   SquareMatrixVector cost_matrices_;
 
   // Contains the compact form of fixed constraints for each dimension
-  // (d_f in [1]).
-  std::vector<Eigen::VectorXd> fixed_constraints_compact_;
+  // (d_f in [1]), one column per dimension.
+  Eigen::MatrixXd fixed_constraints_compact_;
 
   // Contains the compact form of free constraints to optimize for each
-  // dimension (d_p in [1]).
-  std::vector<Eigen::VectorXd> free_constraints_compact_;
+  // dimension (d_p in [1]), one column per dimension.
+  Eigen::MatrixXd free_constraints_compact_;
 
   std::vector<double> segment_times_;
 
@@ -283,6 +611,84 @@ private:
   size_t n_all_constraints_;
   size_t n_fixed_constraints_;
   size_t n_free_constraints_;
+
+  // Whether free_constraints_compact_ is set for the current problem.
+  bool free_constraints_set_;
+
+  LinearSolverType linear_solver_type_;
+
+  // Cache for repeated solveLinear() calls with changing segment times.
+  // Segments whose block of R has to be updated.
+  std::vector<bool> segment_changed_;
+  // Segments whose coefficients have to be recomputed from the compact
+  // constraints, because their segment time or constraints changed.
+  std::vector<bool> segment_outdated_;
+  std::vector<bool> free_constraint_changed_;
+  // Block H = A^{-T}QA^{-1} of each segment.
+  SquareMatrixVector cost_unconstrained_blocks_;
+  // Blocks Rpp and Rpf of the cost matrix R = C^T * H * C, whose sparsity
+  // patterns only change with the constraints.
+  Eigen::SparseMatrix<double> Rpp_cached_;
+  Eigen::SparseMatrix<double> Rpf_cached_;
+  // Index into the values of Rpp_cached_, followed by the values of
+  // Rpf_cached_, for every element of the block H of each segment, stored as
+  // [segment_idx * N * N + col * N + row]. -1 for elements in rows of fixed
+  // constraints, which are not needed.
+  std::vector<int> cost_block_value_indices_;
+  bool R_pattern_valid_;
+  // Scratch memory of solveLinear(), which keeps its capacity such that
+  // repeated solves of the same problem do not allocate.
+  std::vector<bool> R_element_changed_;
+  std::vector<bool> segment_to_add_;
+  Eigen::MatrixXd Rpp_dense_;
+  Eigen::MatrixXd rhs_;
+  // Normalization of the free constraints, dp = S * dp_normalized with
+  // S = diag(free_constraint_scaling_), and S * Rpp * S.
+  bool normalize_;
+  Eigen::VectorXd free_constraint_scaling_;
+  Eigen::SparseMatrix<double> Rpp_normalized_;
+  double condition_estimate_;
+  // Sparse LDLT, whose symbolic factorization is re-used as long as the
+  // sparsity pattern of Rpp does not change. Reading the upper triangle lets
+  // Eigen factorize Rpp without copying it.
+  struct BandedLDLTCache
+  {
+    BandedLDLTCache() : analyzed(false) {}
+    // Eigen's solvers are not copyable, copies start without factorization.
+    BandedLDLTCache(const BandedLDLTCache &) : analyzed(false) {}
+    BandedLDLTCache &operator=(const BandedLDLTCache &)
+    {
+      analyzed = false;
+      return *this;
+    }
+
+    // SimplicialLDLT::vectorD() returns a copy of D.
+    class Solver
+        : public Eigen::SimplicialLDLT<Eigen::SparseMatrix<double>,
+                                       Eigen::Upper,
+                                       Eigen::NaturalOrdering<int>>
+    {
+     public:
+      const VectorType &diagonal() const { return m_diag; }
+      // Same as factorize() without ordering, which reads the upper triangle
+      // of a in place, but without the empty temporary matrix factorize()
+      // allocates on every call. The work vectors of Eigen stay on the stack
+      // up to EIGEN_STACK_ALLOCATION_LIMIT, i.e. 16384 free constraints.
+      void factorizeInPlace(const Eigen::SparseMatrix<double> &a)
+      {
+        factorize_preordered<true>(a);
+      }
+    };
+
+    Solver solver;
+    bool analyzed;
+  };
+  BandedLDLTCache banded_ldlt_;
+  // Dense LDLT of the last solveLinear().
+  Eigen::LDLT<Eigen::MatrixXd> dense_ldlt_;
+  // Backend that factorized Rpp in the last solveLinear(),
+  // kLinearSolverDefault if there is none.
+  LinearSolverType factorized_solver_type_;
 };
 
 // Constraint class that aggregates all constraints from incoming Vertices.
@@ -316,4 +722,14 @@ struct Constraint
 
 #include "mav_trajectory_generation/impl/polynomial_optimization_linear_impl.h"
 
+namespace mav_trajectory_generation {
+
+// The common configurations (7th, 9th and 11th order polynomials) are
+// compiled once in the library, see src/polynomial_optimization_linear.cpp.
+extern template class PolynomialOptimization<8>;
+extern template class PolynomialOptimization<10>;
+extern template class PolynomialOptimization<12>;
+
+} // namespace mav_trajectory_generation
+
 #endif // MAV_TRAJECTORY_GENERATION_POLYNOMIAL_OPTIMIZATION_LINEAR_H_
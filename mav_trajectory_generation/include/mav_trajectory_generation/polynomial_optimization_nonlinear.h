@@ -21,9 +21,13 @@
 #ifndef MAV_TRAJECTORY_GENERATION_POLYNOMIAL_OPTIMIZATION_NONLINEAR_H_
 #define MAV_TRAJECTORY_GENERATION_POLYNOMIAL_OPTIMIZATION_NONLINEAR_H_
 
+#include <atomic>
+#include <chrono>
+#include <functional>
 #include <memory>
 #include <nlopt.hpp>
 
+#include "mav_trajectory_generation/optimization_trace.h"
 #include "mav_trajectory_generation/polynomial_optimization_linear.h"
 
 namespace mav_trajectory_generation {
@@ -46,7 +50,10 @@ struct NonlinearOptimizationParameters {
         random_seed(0),
         use_soft_constraints(true),
         soft_constraint_weight(100.0),
-        print_debug_info(false) {}
+        print_debug_info(false),
+        trace_capacity(0),
+        max_time(-1.0),
+        n_constraint_threads(1) {}
 
   // Stopping criteria, if objective function changes less than absolute value.
   // Disabled if negative.
@@ -97,6 +104,58 @@ struct NonlinearOptimizationParameters {
   double soft_constraint_weight;
 
   bool print_debug_info;
+
+  // Number of objective evaluations recorded in the OptimizationTrace of
+  // every optimize() call, the latest ones are kept. Disabled if 0.
+  size_t trace_capacity;
+
+  // Wall-clock budget of optimize() in seconds. Once exceeded, the best
+  // iterate meeting the constraints is returned, see
+  // OptimizationInfo::deadline_reached. For optimizeMultiStart(), the budget
+  // is shared by all starts. Disabled if not positive.
+  double max_time;
+
+  // Number of threads computing the maxima of the magnitude constraints,
+  // split by segments. Uses the number of hardware threads if 0. Only pays
+  // off for many segments.
+  size_t n_constraint_threads;
+};
+
+// Perturbation of the initial segment times for the starts of a multi-start
+// optimization.
+enum MultiStartPerturbation {
+  // Every segment time is scaled by an independent random factor.
+  kPerturbSegmentTimes = 0,
+  // All segment times are scaled by the same random factor.
+  kScaleTotalTime
+};
+
+// Parameters for PolynomialOptimizationNonLinear::optimizeMultiStart().
+struct MultiStartParameters {
+  MultiStartParameters()
+      : n_starts(4),
+        perturbation(kPerturbSegmentTimes),
+        perturbation_magnitude(0.5),
+        target_cost(-1.0),
+        n_threads(0) {}
+
+  // Number of starts, including the unperturbed initial guess.
+  int n_starts;
+
+  MultiStartPerturbation perturbation;
+
+  // Segment times are scaled by factors drawn uniformly from
+  // [1 / (1 + magnitude), 1 + magnitude].
+  double perturbation_magnitude;
+
+  // All starts stop as soon as one start reaches a cost below this value.
+  // Disabled if negative. Hard constraints are not considered, thus this is
+  // meant for soft constraints.
+  double target_cost;
+
+  // Number of threads running the starts. Uses the number of hardware
+  // threads if 0.
+  size_t n_threads;
 };
 
 class OptimizationInfo {
@@ -107,7 +166,12 @@ class OptimizationInfo {
         cost_trajectory(0),
         cost_time(0),
         cost_soft_constraints(0),
-        optimization_time(0) {}
+        optimization_time(0),
+        max_condition_estimate(0),
+        deadline_reached(false),
+        cancelled(false),
+        n_allocations(0),
+        peak_heap_bytes(0) {}
   void print(std::ostream& stream) const;
   int n_iterations;
   int stopping_reason;
@@ -115,7 +179,20 @@ class OptimizationInfo {
   double cost_time;
   double cost_soft_constraints;
   double optimization_time;
+  // Largest PolynomialOptimization::getConditionEstimate() of the linear
+  // solves during the optimization. Large values, e.g. above 1e12, indicate
+  // that the costs seen by nlopt are dominated by rounding errors.
+  double max_condition_estimate;
   std::map<int, Extremum> maxima;
+  // Set if the optimization was stopped by
+  // NonlinearOptimizationParameters::max_time or the cancellation token.
+  bool deadline_reached;
+  bool cancelled;
+  // Heap allocations of the calling thread during the optimization and the
+  // peak of its allocated bytes above those at the start. Zero unless built
+  // with allocation tracking, see memory_tracking.h.
+  size_t n_allocations;
+  size_t peak_heap_bytes;
 };
 
 // Implements a nonlinear optimization of the unconstrained optimization
@@ -176,8 +253,28 @@ class PolynomialOptimizationNonLinear {
 
   // Runs the optimization until one of the stopping criteria in
   // NonlinearOptimizationParameters and the constraints are met.
+  // The optimization starts from the segment times and, if set, the free
+  // constraints of the linear problem. Thus, after receding-horizon updates
+  // of getPolynomialOptimizationRef(), e.g. advanceStart(), it is warm
+  // started from the previous solution.
+  // If stopped by NonlinearOptimizationParameters::max_time or the
+  // cancellation token, the solution is the best iterate seen so far that
+  // meets the maximum magnitude constraints (within
+  // inequality_constraint_tolerance), or nlopt's best one if there is none.
+  // Output: return = nlopt::MAXTIME_REACHED or nlopt::FORCED_STOP in these
+  // cases.
   int optimize();
 
+  // Runs optimize() concurrently from several perturbations of the initial
+  // segment times and keeps the start with the lowest cost. The
+  // perturbations are seeded by NonlinearOptimizationParameters::random_seed.
+  // Input: multi_start_parameters = Number of starts and perturbation.
+  // Output: start_infos = OptimizationInfo of every start. Optional, can be
+  // set to nullptr.
+  // Output: return = The nlopt result of the best start.
+  int optimizeMultiStart(const MultiStartParameters& multi_start_parameters,
+                         std::vector<OptimizationInfo>* start_infos = nullptr);
+
   // Get the resulting trajectory out -- prefer this as the main method
   // to get the results of the optimization, over getting the reference
   // to the linear optimizer.
@@ -199,6 +296,37 @@ class PolynomialOptimizationNonLinear {
 
   OptimizationInfo getOptimizationInfo() const { return optimization_info_; }
 
+  // Running optimizations stop at the next objective evaluation once
+  // *cancel is true, e.g., set from another thread. Not owned, has to
+  // outlive the optimization. nullptr disables cancellation.
+  void setCancellationToken(const std::atomic<bool>* cancel) {
+    cancel_token_ = cancel;
+  }
+
+  // Per objective evaluation trace of the last optimize() call, see
+  // NonlinearOptimizationParameters::trace_capacity.
+  const OptimizationTrace& getOptimizationTrace() const { return trace_; }
+
+  // Cost of an independent problem over the same segment times, e.g. the yaw
+  // with its own number of coefficients. Returns the cost at segment_times
+  // and, if gradient is not nullptr, adds its derivative w.r.t. the segment
+  // times to gradient.
+  typedef std::function<double(const std::vector<double>& segment_times,
+                               std::vector<double>* gradient)>
+      CoupledCost;
+
+  // Adds coupled_cost to the objective, such that the segment times are
+  // optimized for both problems. OptimizationInfo::cost_trajectory includes
+  // it. With a thread_pool of at least two threads, it is evaluated
+  // concurrently with the cost of this problem in every objective
+  // evaluation. The pool is not owned and has to outlive the optimization.
+  // Not used by the starts of optimizeMultiStart().
+  void setCoupledCost(const CoupledCost& coupled_cost,
+                      ThreadPool* thread_pool = nullptr) {
+    coupled_cost_ = coupled_cost;
+    coupled_cost_thread_pool_ = thread_pool;
+  }
+
  private:
   // Holds the data for constraint evaluation, since these methods are
   // static.
@@ -210,9 +338,9 @@ class PolynomialOptimizationNonLinear {
 
   // Objective function for the time-only version.
   // Input: segment_times = Segment times in the current iteration.
-  // Input: gradient = Gradient of the objective function w.r.t. changes of
-  // parameters. We can't compute the gradient analytically here.
-  // Thus, only gradient-free optimization methods are possible.
+  // Output: gradient = Gradient of the objective function w.r.t. the segment
+  // times. Only computed if non-empty, i.e. for gradient-based optimization
+  // methods.
   // Input: Custom data pointer = In our case, it's an ConstraintData object.
   // Output: Cost = based on the parameters passed in.
   static double objectiveFunctionTime(const std::vector<double>& segment_times,
@@ -225,9 +353,9 @@ class PolynomialOptimizationNonLinear {
   // current iteration.
   // The variables (time, derivatives) are stacked as follows: [segment_times
   // derivatives_dim_0 ... derivatives_dim_N]
-  // Input: gradient = Gradient of the objective function wrt. changes of
-  // parameters. We can't compute the gradient analytically here.
-  // Thus, only gradient free optimization methods are possible.
+  // Output: gradient = Gradient of the objective function wrt. the
+  // optimization variables. Only computed if non-empty, i.e. for
+  // gradient-based optimization methods.
   // Input: data = Custom data pointer. In our case, it's an ConstraintData
   // object.
   // Output: Cost based on the parameters passed in.
@@ -237,11 +365,38 @@ class PolynomialOptimizationNonLinear {
 
   // Evaluates the maximum magnitude constraint at the current value of
   // the optimization variables.
-  // All input parameters are ignored, all information is contained in data.
+  // The optimization variables are ignored, all information is contained in
+  // data. The gradient is only computed if non-empty.
   static double evaluateMaximumMagnitudeConstraint(
       const std::vector<double>& optimization_variables,
       std::vector<double>& gradient, void* data);
 
+  // Computes the maxima of all constrained derivatives of the current
+  // solution at once and stores them in optimization_info_.maxima. Reused
+  // by all constraints until the next objective evaluation.
+  void computeConstraintMaxima();
+
+  // Runs evaluate_cost, which evaluates the cost of this problem, and the
+  // coupled cost at segment_times, concurrently if possible.
+  // Output: coupled_cost = 0 without a coupled cost.
+  // Output: coupled_gradient = Its gradient w.r.t. the segment times if
+  // compute_gradient is set, empty otherwise.
+  void evaluateWithCoupledCost(const std::function<void()>& evaluate_cost,
+                               const std::vector<double>& segment_times,
+                               bool compute_gradient, double* coupled_cost,
+                               std::vector<double>* coupled_gradient);
+
+  // Returns the number of optimization variables of the current problem.
+  size_t getNumberOptimizationVariables() const;
+
+  // Creates the nlopt object for the current problem size and adds the hard
+  // inequality constraints.
+  void setupNlopt();
+
+  // optimize() with an absolute deadline. Disabled if has_deadline is false.
+  int optimizeUntil(bool has_deadline,
+                    const std::chrono::steady_clock::time_point& deadline);
+
   // Does the actual optimization work for the time-only version.
   int optimizeTime();
 
@@ -255,13 +410,56 @@ class PolynomialOptimizationNonLinear {
   // Input: inequality_constraints = Vector of ConstraintData shared_ptrs,
   // describing the constraints.
   // Input: weight = Multiplicative weight of the constraint violation.
+  // Output: gradient_segment_times, gradient_free_constraints = If not
+  // nullptr, the partial derivatives of the cost w.r.t. the segment times and
+  // the free constraints are added.
   // Input: maximum_cost = Upper bound of the cost. Necessary, since exp of a
   // high violation can end up in inf.
   // Output: Sum of the costs per constraint.
   double evaluateMaximumMagnitudeAsSoftConstraint(
       const std::vector<std::shared_ptr<ConstraintData> >&
           inequality_constraints,
-      double weight, double maximum_cost = 1.0e12) const;
+      double weight, std::vector<double>* gradient_segment_times = nullptr,
+      std::vector<Eigen::VectorXd>* gradient_free_constraints = nullptr,
+      double maximum_cost = 1.0e12) const;
+
+  // Computes the gradient w.r.t. the optimization variables from the partial
+  // derivatives w.r.t. the segment times and the free constraints. In the
+  // time-only version, the free constraints follow the segment times through
+  // the linear solve.
+  void computeOptimizationVariableGradient(
+      const std::vector<double>& gradient_segment_times,
+      const std::vector<Eigen::VectorXd>& gradient_free_constraints,
+      std::vector<double>* gradient) const;
+
+  // Re-evaluates the objective at the optimization variables returned by
+  // nlopt, such that the solution corresponds to the best iterate instead of
+  // the last one.
+  void restoreSolution(const std::vector<double>& optimization_variables);
+
+  // Completes entry with the iteration, the constraint time and the root
+  // finder calls since the previous entry and adds it to the trace.
+  void addTraceEntry(const std::vector<double>& segment_times,
+                     OptimizationTraceEntry* entry);
+
+  // Called by endObjectiveEvaluation(). Signals the other starts of a
+  // multi-start optimization to stop once the target cost is reached, and
+  // stops this optimization if another start did so.
+  void checkMultiStartStop(double cost);
+
+  // Called at the beginning and the end of every objective evaluation to
+  // track the best feasible iterate and to stop at the deadline or on
+  // cancellation. The constraints of an iterate are evaluated in between or,
+  // for hard constraints, after the objective, so the iterate is only
+  // compared in the next objective evaluation or by keepBestIterate().
+  void beginObjectiveEvaluation();
+  void endObjectiveEvaluation(const std::vector<double>& optimization_variables,
+                              double cost);
+  void keepBestIterate();
+
+  // Keeps the largest condition estimate of the linear solves in
+  // optimization_info_.
+  void updateConditionEstimate();
 
   // Set lower and upper bounds on the optimization parameters
   void setFreeEndpointDerivativeHardConstraints(
@@ -288,6 +486,41 @@ class PolynomialOptimizationNonLinear {
   bool optimize_time_only_;
 
   OptimizationInfo optimization_info_;
+
+  OptimizationTrace trace_;
+  // Disabled while re-evaluating the solution.
+  bool record_trace_;
+  // Constraint evaluation time and root finder call count not yet assigned
+  // to a trace entry.
+  double trace_time_constraints_;
+  size_t trace_root_finding_calls_;
+
+  // Shared by all starts of a multi-start optimization, nullptr otherwise.
+  std::atomic<bool>* multi_start_stop_;
+  double multi_start_target_cost_;
+
+  const std::atomic<bool>* cancel_token_;
+  bool has_deadline_;
+  std::chrono::steady_clock::time_point deadline_;
+  // Set while a deadline or cancellation token is active. Disabled while
+  // re-evaluating the solution.
+  bool track_iterates_;
+  // Last evaluated iterate and whether its constraints are met.
+  std::vector<double> iterate_;
+  double iterate_cost_;
+  bool iterate_feasible_;
+  // Whether optimization_info_.maxima belong to the current solution.
+  bool maxima_valid_;
+  // Created on first use if n_constraint_threads != 1.
+  std::shared_ptr<ThreadPool> constraint_thread_pool_;
+
+  CoupledCost coupled_cost_;
+  // Not owned, nullptr evaluates the coupled cost in the calling thread.
+  ThreadPool* coupled_cost_thread_pool_;
+
+  // Best feasible iterate of the current optimization, empty if none.
+  std::vector<double> best_iterate_;
+  double best_iterate_cost_;
 };
 
 }  // namespace mav_trajectory_generation
@@ -0,0 +1,115 @@
+/*
+ * Copyright (c) 2016, Markus Achtelik, ASL, ETH Zurich, Switzerland
+ * Copyright (c) 2016, Michael Burri, ASL, ETH Zurich, Switzerland
+ * Copyright (c) 2016, Helen Oleynikova, ASL, ETH Zurich, Switzerland
+ * Copyright (c) 2016, Rik Bähnemann, ASL, ETH Zurich, Switzerland
+ * Copyright (c) 2016, Marija Popovic, ASL, ETH Zurich, Switzerland
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef MAV_TRAJECTORY_GENERATION_POLYNOMIAL_OPTIMIZATION_WINDOWED_H_
+#define MAV_TRAJECTORY_GENERATION_POLYNOMIAL_OPTIMIZATION_WINDOWED_H_
+
+#include <vector>
+
+#include "mav_trajectory_generation/polynomial_optimization_linear.h"
+
+namespace mav_trajectory_generation {
+
+struct WindowedOptimizationParameters {
+  WindowedOptimizationParameters()
+      : window_segments(100), overlap_segments(20) {}
+
+  // Number of segments that are optimized together.
+  size_t window_segments;
+
+  // Number of segments at the end of a window that are discarded and
+  // optimized again by the next window. Larger overlaps bring the solution
+  // closer to the one of the whole path, since the free end of a window
+  // influences the segments close to it.
+  size_t overlap_segments;
+};
+
+// Solves long paths as a sequence of overlapping windows of
+// PolynomialOptimization, such that run time and memory scale linearly in the
+// number of segments. Every window starts at the last segment kept from the
+// previous window and its start derivatives up to N/2-1 are pinned to that
+// segment, thus the path is as continuous at the seams as at every other
+// vertex.
+// _N specifies the number of coefficients for the underlying polynomials.
+template <int _N = 10>
+class PolynomialOptimizationWindowed {
+  static_assert(_N % 2 == 0, "The number of coefficients has to be even.");
+
+ public:
+  enum { N = _N };
+
+  PolynomialOptimizationWindowed(
+      size_t dimension, const WindowedOptimizationParameters& parameters);
+
+  // Sets up the optimization problem, see
+  // PolynomialOptimization::setupFromVertices().
+  bool setupFromVertices(
+      const Vertex::Vector& vertices, const std::vector<double>& segment_times,
+      int derivative_to_optimize =
+          PolynomialOptimization<N>::kHighestDerivativeToOptimize);
+
+  // Solves the linear optimization problem of every window in sequence.
+  bool solveLinear();
+
+  // Returns the trajectory of all windows. Only valid after solveLinear().
+  void getTrajectory(Trajectory* trajectory) const {
+    CHECK_NOTNULL(trajectory);
+    trajectory->setSegments(segments_);
+  }
+
+  void getSegments(Segment::Vector* segments) const {
+    CHECK_NOTNULL(segments);
+    *segments = segments_;
+  }
+
+  // Computes the cost of the whole path in the derivative to optimize, see
+  // PolynomialOptimization::computeCost().
+  double computeCost() const;
+
+  // Number of windows solved by the last solveLinear().
+  size_t getNumberWindows() const { return n_windows_; }
+
+  // Returns the linear optimizer that is re-used for every window.
+  PolynomialOptimization<N>& getWindowOptimizerRef() {
+    return window_optimizer_;
+  }
+
+ private:
+  size_t dimension_;
+  WindowedOptimizationParameters parameters_;
+  int derivative_to_optimize_;
+
+  Vertex::Vector vertices_;
+  std::vector<double> segment_times_;
+  Segment::Vector segments_;
+  size_t n_windows_;
+
+  PolynomialOptimization<N> window_optimizer_;
+  // Problem of the current window.
+  Vertex::Vector window_vertices_;
+  std::vector<double> window_segment_times_;
+  Segment::Vector window_segments_;
+};
+
+}  // namespace mav_trajectory_generation
+
+#endif  // MAV_TRAJECTORY_GENERATION_POLYNOMIAL_OPTIMIZATION_WINDOWED_H_
+
+#include "mav_trajectory_generation/impl/polynomial_optimization_windowed_impl.h"
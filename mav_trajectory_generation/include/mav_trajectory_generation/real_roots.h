@@ -0,0 +1,65 @@
+/*
+ * Copyright (c) 2016, Markus Achtelik, ASL, ETH Zurich, Switzerland
+ * Copyright (c) 2016, Michael Burri, ASL, ETH Zurich, Switzerland
+ * Copyright (c) 2016, Helen Oleynikova, ASL, ETH Zurich, Switzerland
+ * Copyright (c) 2016, Rik Bähnemann, ASL, ETH Zurich, Switzerland
+ * Copyright (c) 2016, Marija Popovic, ASL, ETH Zurich, Switzerland
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef MAV_TRAJECTORY_GENERATION_REAL_ROOTS_H_
+#define MAV_TRAJECTORY_GENERATION_REAL_ROOTS_H_
+
+#include <Eigen/Core>
+#include <vector>
+
+namespace mav_trajectory_generation {
+
+// Selects the root finder for extrema queries, which only need the real roots
+// inside a time interval.
+enum RootFindingMethod {
+  // Computes all complex roots with Jenkins-Traub and discards the complex and
+  // out-of-range ones afterwards.
+  kJenkinsTraub = 0,
+  // Only isolates the real roots inside the interval: closed-form up to degree
+  // 2, bracketing between critical points up to degree 4 and Descartes'
+  // rule of signs bisection (in Bernstein basis) above. Every isolated root is
+  // polished with safeguarded Newton iterations.
+  kRealIntervalRoots
+};
+
+// Finds the real roots of a polynomial inside [t_start, t_end] without
+// computing the complex roots.
+// Roots of even multiplicity may be missed, as there is no sign change. This
+// is fine for extrema candidates, since these are no extrema. Likewise,
+// roots that cannot be told apart from t_start or t_end within rounding noise
+// are not reported.
+// Input: coefficients_increasing = Coefficients of the polynomial in
+// INCREASING order.
+// Input: n_coefficients = Number of coefficients.
+// Input: t_start, t_end = Interval in which to search the roots.
+// Output: roots = The roots found are APPENDED in ascending order.
+// Output: return = false if t_start > t_end.
+bool findRealRootsInInterval(const double* coefficients_increasing,
+                             int n_coefficients, double t_start, double t_end,
+                             std::vector<double>* roots);
+
+// Eigen wrapper for convenience.
+bool findRealRootsInInterval(
+    const Eigen::Ref<const Eigen::VectorXd>& coefficients_increasing,
+    double t_start, double t_end, std::vector<double>* roots);
+
+}  // namespace mav_trajectory_generation
+
+#endif  // MAV_TRAJECTORY_GENERATION_REAL_ROOTS_H_
@@ -23,9 +23,60 @@
 
 #include <Eigen/Core>
 #include <iostream>
+#include <vector>
 
 namespace mav_trajectory_generation {
 
+// Reentrant Jenkins-Traub root finder. Holds all working state of the
+// algorithm, such that concurrent root finding only requires one instance per
+// thread. An instance can be reused for many polynomials; scratch memory is
+// inline up to kMaxInlineDegree and only allocated for larger polynomials.
+// The free findRootsJenkinsTraub functions below use a temporary instance and
+// are therefore thread-safe as well.
+// See findRootsJenkinsTraub for the interfaces.
+class JenkinsTraubSolver {
+ public:
+  // Covers the convolution of two polynomials with Polynomial::kMaxN
+  // coefficients, as needed for the extrema of magnitudes.
+  static constexpr int kMaxInlineDegree = 24;
+
+  JenkinsTraubSolver();
+
+  int findRoots(const double* coefficients_decreasing, int degree,
+                double* roots_real, double* roots_imag, int info[]);
+
+  bool findRoots(
+      const Eigen::Ref<const Eigen::VectorXd>& coefficients_increasing,
+      Eigen::VectorXcd* roots);
+
+ private:
+  static constexpr int kNumScratchBuffers = 7;
+
+  // Translation of TOMS493, variable names follow the original.
+  int rpoly(const double* op, int degree, double* zeror, double* zeroi,
+            int info[]);
+  void fxshfr(int l2, int* nz);
+  void quadit(double* uu, double* vv, int* nz);
+  void realit(double sss, int* nz, int* iflag);
+  void calcsc(int* type);
+  void nextk(int* type);
+  void newest(int type, double* uu, double* vv);
+
+  double *p, *qp, *k, *qk, *svk;
+  double sr, si, u, v, a, b, c, d, a1, a2;
+  double a3, a6, a7, e, f, g, h, szr, szi, lzr, lzi;
+  double eta, are, mre;
+  int n, nn, nmi, zerok;
+  int itercnt;
+
+  double inline_scratch_[kNumScratchBuffers * (kMaxInlineDegree + 1)];
+  double inline_coefficients_[kMaxInlineDegree + 1];
+  double inline_roots_real_[kMaxInlineDegree + 1];
+  double inline_roots_imag_[kMaxInlineDegree + 1];
+  std::vector<double> heap_scratch_;
+  std::vector<double> heap_roots_;
+};
+
 // Finds the roots of a polynomial with real coefficients, using the
 // Jenkins-Traub method. Interface to the original implementation.
 // http://en.wikipedia.org/wiki/Jenkins–Traub_algorithm
@@ -48,17 +99,19 @@ int findRootsJenkinsTraub(const double* coefficients_decreasing, int degree,
 // INDECREASING! order.
 // Output: roots = Complex roots of the polynomial.
 // Output: return = Root calculation success.
-bool findRootsJenkinsTraub(const Eigen::VectorXd& coefficients_increasing,
-                           Eigen::VectorXcd* roots);
+bool findRootsJenkinsTraub(
+    const Eigen::Ref<const Eigen::VectorXd>& coefficients_increasing,
+    Eigen::VectorXcd* roots);
 
 // Finds the roots of a polynomial with real coefficients, using the
 // Jenkins-Traub method. Convenience method.
 Eigen::VectorXcd findRootsJenkinsTraub(
-    const Eigen::VectorXd& coefficients_increasing);
+    const Eigen::Ref<const Eigen::VectorXd>& coefficients_increasing);
 
 // Find the last non-zero entry in a vector and returns its index. Returns -1 in
 // case of all zeros.
-int findLastNonZeroCoeff(const Eigen::VectorXd& coefficients);
+int findLastNonZeroCoeff(
+    const Eigen::Ref<const Eigen::VectorXd>& coefficients);
 
 }  // namespace mav_trajectory_generation
 
@@ -25,6 +25,7 @@
 #include <Eigen/Core>
 #include <chrono>
 #include <map>
+#include <memory>
 #include <vector>
 
 #include "mav_trajectory_generation/extremum.h"
@@ -44,10 +45,16 @@ class Segment {
  public:
   typedef std::vector<Segment> Vector;
 
+  // Highest derivative, for which the coefficients are cached. The magnitude
+  // extrema up to snap also need the next derivative.
+  static constexpr int kMaxCachedDerivative = derivative_order::SNAP + 1;
+
   Segment(int N, int D) : time_(0.0), N_(N), D_(D) {
     polynomials_.resize(D_, Polynomial(N_));
   }
-  Segment(const Segment& segment) = default;
+  // Copies share the cache until one of them is modified.
+  Segment(const Segment& segment);
+  Segment& operator=(const Segment& segment);
 
   bool operator==(const Segment& rhs) const;
   inline bool operator!=(const Segment& rhs) const { return !operator==(rhs); }
@@ -62,15 +69,31 @@ class Segment {
   void setTime(double time_sec) { time_ = time_sec; }
   void setTimeNSec(uint64_t time_ns) { time_ = time_ns * kNumSecPerNsec; }
 
+  // Invalidates the cached derivatives. Thus, the returned reference must
+  // not be kept to modify the segment after later queries.
   Polynomial& operator[](size_t idx);
 
   const Polynomial& operator[](size_t idx) const;
 
+  // Same as (*this)[dimension].getCoefficients(derivative), but computed
+  // once for all dimensions and derivatives up to kMaxCachedDerivative on
+  // first use and cached until the segment is modified. The reference is
+  // valid until then.
+  const Eigen::VectorXd& getDerivativeCoefficientsRef(int dimension,
+                                                      int derivative) const;
+
   const Polynomial::Vector& getPolynomialsRef() const { return polynomials_; }
 
   Eigen::VectorXd evaluate(
       double t, int derivative_order = derivative_order::POSITION) const;
 
+  // Evaluates all derivatives from position up to max_derivative at time t in
+  // one pass, sharing the powers of t across dimensions and derivatives.
+  // Output: result = D x (max_derivative + 1) matrix, column k holds
+  // derivative k. Has to be sized by the caller, nothing is allocated.
+  void evaluateDerivatives(double t, int max_derivative,
+                           Eigen::Ref<Eigen::MatrixXd> result) const;
+
   // Computes the candidates for the minimum and maximum magnitude of a single
   // segment in the specified derivative. In the 1D case, it simply returns the
   // roots of the derivative of the segment-polynomial. For higher dimensions,
@@ -87,19 +110,23 @@ class Segment {
   // time.
   // Input: dimensions = Vector containing the dimensions that are evaluated.
   // Usually [0, 1, 2] for position, [3] for yaw.
+  // Input: method = Root finder, see RootFindingMethod.
   // Output: candidates = Vector containing the candidate extrema times.
   // Returns whether the computation succeeded -- false means no candidates
-  // were found by Jenkins-Traub.
+  // were found by the root finder.
+  // The convolved polynomial and the candidates of the last interval are
+  // cached per derivative and set of dimensions, such that repeated queries
+  // are cheap.
   bool computeMinMaxMagnitudeCandidateTimes(
       int derivative, double t_start, double t_end,
-      const std::vector<int>& dimensions,
-      std::vector<double>* candidate_times) const;
+      const std::vector<int>& dimensions, std::vector<double>* candidate_times,
+      RootFindingMethod method = kRealIntervalRoots) const;
 
   // Convenience function. Additionally evaluates the candidate times.
   bool computeMinMaxMagnitudeCandidates(
       int derivative, double t_start, double t_end,
-      const std::vector<int>& dimensions,
-      std::vector<Extremum>* candidates) const;
+      const std::vector<int>& dimensions, std::vector<Extremum>* candidates,
+      RootFindingMethod method = kRealIntervalRoots) const;
 
   // Convenience function. Evaluates the magnitudes between t_start and t_end
   // for a set of candidates for given dimensions.
@@ -119,8 +146,23 @@ class Segment {
   double time_;
 
  private:
+  struct Cache;
+
+  // Returns the cache, creates it if necessary. Thread-safe for const
+  // access.
+  std::shared_ptr<Cache> getCache() const;
+
+  bool computeMinMaxMagnitudeCandidateTimesUncached(
+      int derivative, double t_start, double t_end,
+      const std::vector<int>& dimensions, std::vector<double>* candidate_times,
+      RootFindingMethod method) const;
+
   int N_;  // Number of coefficients.
   int D_;  // Number of dimensions.
+
+  // Derived from polynomials_ only, thus shared by copies. Reset on
+  // modification, lazily created by getCache().
+  mutable std::shared_ptr<Cache> cache_;
 };
 
 // Prints the properties of the segment.
@@ -0,0 +1,116 @@
+/*
+ * Copyright (c) 2016, Markus Achtelik, ASL, ETH Zurich, Switzerland
+ * Copyright (c) 2016, Michael Burri, ASL, ETH Zurich, Switzerland
+ * Copyright (c) 2016, Helen Oleynikova, ASL, ETH Zurich, Switzerland
+ * Copyright (c) 2016, Rik Bähnemann, ASL, ETH Zurich, Switzerland
+ * Copyright (c) 2016, Marija Popovic, ASL, ETH Zurich, Switzerland
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef MAV_TRAJECTORY_GENERATION_SEGMENT_TIME_INITIALIZER_H_
+#define MAV_TRAJECTORY_GENERATION_SEGMENT_TIME_INITIALIZER_H_
+
+#include <mutex>
+#include <vector>
+
+#include "mav_trajectory_generation/vertex.h"
+
+namespace mav_trajectory_generation {
+
+// Initial guess of the segment times of a problem, e.g. for the nonlinear
+// optimization of the segment times.
+class SegmentTimeInitializer {
+ public:
+  virtual ~SegmentTimeInitializer() {}
+
+  // Output: segment_times = One time per segment, i.e. vertices.size() - 1.
+  // Returns false if the vertices lack the required constraints.
+  virtual bool estimateSegmentTimes(
+      const Vertex::Vector& vertices,
+      std::vector<double>* segment_times) const = 0;
+};
+
+// The distance based estimate of estimateSegmentTimes().
+class FabianSegmentTimeInitializer : public SegmentTimeInitializer {
+ public:
+  FabianSegmentTimeInitializer(double v_max, double a_max,
+                               double magic_fabian_constant = 6.5)
+      : v_max_(v_max),
+        a_max_(a_max),
+        magic_fabian_constant_(magic_fabian_constant) {}
+
+  virtual bool estimateSegmentTimes(const Vertex::Vector& vertices,
+                                    std::vector<double>* segment_times) const;
+
+ private:
+  double v_max_;
+  double a_max_;
+  double magic_fabian_constant_;
+};
+
+// Times of a velocity profile along the straight lines between the vertices,
+// accelerating and braking with a_max up to v_max. A corner is passed on a
+// circle touching both lines at a quarter of the shorter one, at the speed
+// of a centripetal acceleration of a_max. That is v_max on straight lines
+// and 0 when turning back, unless the vertex constrains the velocity, e.g. to
+// 0 at start and end. The speeds are then lowered where a_max does not
+// allow to reach them within a segment. The times of the profile are scaled
+// by time_factor, as the polynomials overshoot the speed of the profile.
+// With the default, their maximum velocity is around v_max.
+class CornerAwareSegmentTimeInitializer : public SegmentTimeInitializer {
+ public:
+  CornerAwareSegmentTimeInitializer(double v_max, double a_max,
+                                    double time_factor = 2.0);
+
+  virtual bool estimateSegmentTimes(const Vertex::Vector& vertices,
+                                    std::vector<double>* segment_times) const;
+
+ private:
+  double v_max_;
+  double a_max_;
+  double time_factor_;
+};
+
+// Seeds the times from the converged times of a previously solved, similar
+// problem with the same number of segments. Every previous time is scaled by
+// how much the estimate of the fallback changed for that segment, such that
+// the corrections of the previous optimization carry over. Other problems
+// are estimated by the fallback. Thread-safe.
+class WarmStartSegmentTimeInitializer : public SegmentTimeInitializer {
+ public:
+  // The fallback is not owned and has to outlive this initializer.
+  explicit WarmStartSegmentTimeInitializer(
+      const SegmentTimeInitializer* fallback);
+
+  // Stores the problem and its converged segment times as the seed.
+  void setPreviousSolution(const Vertex::Vector& vertices,
+                           const std::vector<double>& segment_times);
+  void clear();
+  bool hasPreviousSolution() const;
+
+  virtual bool estimateSegmentTimes(const Vertex::Vector& vertices,
+                                    std::vector<double>* segment_times) const;
+
+ private:
+  const SegmentTimeInitializer* fallback_;
+
+  mutable std::mutex mutex_;
+  std::vector<double> previous_times_;
+  // Estimate of the fallback for the previous problem.
+  std::vector<double> previous_estimates_;
+};
+
+}  // namespace mav_trajectory_generation
+
+#endif  // MAV_TRAJECTORY_GENERATION_SEGMENT_TIME_INITIALIZER_H_
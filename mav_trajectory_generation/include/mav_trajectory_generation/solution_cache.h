@@ -0,0 +1,96 @@
+/*
+ * Copyright (c) 2016, Markus Achtelik, ASL, ETH Zurich, Switzerland
+ * Copyright (c) 2016, Michael Burri, ASL, ETH Zurich, Switzerland
+ * Copyright (c) 2016, Helen Oleynikova, ASL, ETH Zurich, Switzerland
+ * Copyright (c) 2016, Rik Bähnemann, ASL, ETH Zurich, Switzerland
+ * Copyright (c) 2016, Marija Popovic, ASL, ETH Zurich, Switzerland
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef MAV_TRAJECTORY_GENERATION_SOLUTION_CACHE_H_
+#define MAV_TRAJECTORY_GENERATION_SOLUTION_CACHE_H_
+
+#include <mutex>
+#include <vector>
+
+#include "mav_trajectory_generation/lru_cache.h"
+#include "mav_trajectory_generation/trajectory.h"
+#include "mav_trajectory_generation/vertex.h"
+
+namespace mav_trajectory_generation {
+
+// Least recently used cache of optimized trajectories for repeated problems,
+// e.g. the same waypoint pattern flown by many vehicles. Problems are keyed
+// by their vertex constraints relative to the position of the first vertex,
+// the segment times and any further parameters, all rounded to a resolution,
+// such that translated copies of a problem share an entry. The optimal
+// trajectory translates with the position constraints, so a hit returns the
+// stored trajectory moved to the query. All methods are thread-safe.
+class SolutionCache {
+ public:
+  typedef internal::CacheKey Key;
+
+  // Values closer than resolution may share an entry.
+  explicit SolutionCache(size_t capacity, double resolution = 1.0e-9);
+
+  // Serializes a problem. parameters are any further inputs the solution
+  // depends on, e.g. the optimizer settings. translation is the position of
+  // the first vertex, zero if it has no position constraint.
+  void computeKey(const Vertex::Vector& vertices,
+                  const std::vector<double>& segment_times,
+                  int derivative_to_optimize,
+                  const std::vector<double>& parameters, Key* key,
+                  Eigen::VectorXd* translation) const;
+
+  // Returns true, the cached trajectory moved by translation and the status
+  // stored with it if the key is cached.
+  bool lookup(const Key& key, const Eigen::VectorXd& translation,
+              Trajectory* trajectory, int* status = nullptr);
+  // Stores the solution of the problem with the given key and translation.
+  void insert(const Key& key, const Eigen::VectorXd& translation,
+              const Trajectory& trajectory, int status = 0);
+
+  // Removes all entries, keeps the counters.
+  void clear();
+  // Resets the hit and miss counters.
+  void resetCounters();
+
+  size_t size() const;
+  size_t getCapacity() const { return cache_.getCapacity(); }
+  double getResolution() const { return resolution_; }
+  size_t getNumHits() const;
+  size_t getNumMisses() const;
+
+ private:
+  struct Entry {
+    // Solution for the vertices relative to the first one.
+    Trajectory trajectory;
+    int status;
+  };
+
+  int64_t quantize(double value) const;
+
+  double resolution_;
+
+  mutable std::mutex mutex_;
+  internal::LruCache<Entry> cache_;
+};
+
+// Returns the trajectory moved by translation in every dimension.
+Trajectory translateTrajectory(const Trajectory& trajectory,
+                               const Eigen::VectorXd& translation);
+
+}  // namespace mav_trajectory_generation
+
+#endif  // MAV_TRAJECTORY_GENERATION_SOLUTION_CACHE_H_
@@ -0,0 +1,94 @@
+/*
+ * Copyright (c) 2016, Markus Achtelik, ASL, ETH Zurich, Switzerland
+ * Copyright (c) 2016, Michael Burri, ASL, ETH Zurich, Switzerland
+ * Copyright (c) 2016, Helen Oleynikova, ASL, ETH Zurich, Switzerland
+ * Copyright (c) 2016, Rik Bähnemann, ASL, ETH Zurich, Switzerland
+ * Copyright (c) 2016, Marija Popovic, ASL, ETH Zurich, Switzerland
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef MAV_TRAJECTORY_GENERATION_THREAD_POOL_H_
+#define MAV_TRAJECTORY_GENERATION_THREAD_POOL_H_
+
+#include <condition_variable>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace mav_trajectory_generation {
+
+// Fixed-size pool of worker threads for batches of independent jobs.
+// The jobs of a batch are split into one contiguous range per worker. A
+// worker that runs out of jobs steals the upper half of the largest
+// remaining range of another worker, which balances jobs of uneven cost.
+class ThreadPool {
+ public:
+  // Type of a job: job_idx in [0, n_jobs), worker_idx in
+  // [0, getNumberThreads()). The worker index allows keeping per-worker
+  // state without locking.
+  typedef std::function<void(size_t job_idx, size_t worker_idx)> Job;
+
+  // Input: n_threads = Number of worker threads. Uses the number of hardware
+  // threads if 0.
+  explicit ThreadPool(size_t n_threads = 0);
+  ~ThreadPool();
+
+  ThreadPool(const ThreadPool&) = delete;
+  ThreadPool& operator=(const ThreadPool&) = delete;
+
+  size_t getNumberThreads() const { return threads_.size(); }
+
+  // Runs job for every index in [0, n_jobs) and blocks until all jobs are
+  // done. Concurrent calls are serialized. Must not be called from within a
+  // job. The first exception thrown by a job is re-thrown here after the
+  // batch finished.
+  void parallelFor(size_t n_jobs, const Job& job);
+
+ private:
+  struct WorkerRange {
+    WorkerRange() : begin(0), end(0) {}
+    std::mutex mutex;
+    size_t begin;
+    size_t end;
+  };
+
+  void workerLoop(size_t worker_idx);
+
+  // Takes the next job of the worker, or steals jobs from other workers.
+  // Returns false if there are no jobs left.
+  bool nextJob(size_t worker_idx, size_t* job_idx);
+
+  std::vector<std::thread> threads_;
+  std::vector<std::unique_ptr<WorkerRange> > ranges_;
+
+  // Serializes calls to parallelFor().
+  std::mutex batch_mutex_;
+
+  // Guards the batch state below.
+  std::mutex mutex_;
+  std::condition_variable batch_started_;
+  std::condition_variable batch_finished_;
+  const Job* job_;
+  size_t batch_idx_;
+  size_t n_busy_workers_;
+  std::exception_ptr exception_;
+  bool stop_;
+};
+
+}  // namespace mav_trajectory_generation
+
+#endif  // MAV_TRAJECTORY_GENERATION_THREAD_POOL_H_
@@ -27,9 +27,12 @@
 #include <chrono>
 #include <limits>
 #include <map>
+#include <mutex>
 #include <string>
 #include <vector>
 
+#include "mav_trajectory_generation/memory_tracking.h"
+
 namespace mav_trajectory_generation {
 namespace timing {
 
@@ -44,15 +47,25 @@ class Accumulator {
         min_(std::numeric_limits<T>::max()),
         max_(std::numeric_limits<T>::min()) {}
 
-  void Add(T sample) {
-    if (window_samples_ < N) {
-      samples_[window_samples_++] = sample;
-      window_sum_ += sample;
-    } else {
-      T& oldest = samples_[window_samples_++ % N];
-      window_sum_ += sample - oldest;
-      oldest = sample;
+  // Adds the samples of another accumulator. The rolling window afterwards
+  // holds the most recent samples of this one, followed by the other's in
+  // the order they were added.
+  void Merge(const Accumulator& other) {
+    const int num_window_samples = std::min(other.window_samples_, N);
+    // The oldest sample of a full window is the next one to be overwritten.
+    const int oldest =
+        other.window_samples_ < N ? 0 : other.window_samples_ % N;
+    for (int i = 0; i < num_window_samples; ++i) {
+      AddToWindow(other.samples_[(oldest + i) % N]);
     }
+    sum_ += other.sum_;
+    total_samples_ += other.total_samples_;
+    max_ = std::max(max_, other.max_);
+    min_ = std::min(min_, other.min_);
+  }
+
+  void Add(T sample) {
+    AddToWindow(sample);
     sum_ += sample;
     ++total_samples_;
     if (sample > max_) {
@@ -91,6 +104,17 @@ class Accumulator {
   }
 
  private:
+  void AddToWindow(T sample) {
+    if (window_samples_ < N) {
+      samples_[window_samples_++] = sample;
+      window_sum_ += sample;
+    } else {
+      T& oldest = samples_[window_samples_++ % N];
+      window_sum_ += sample - oldest;
+      oldest = sample;
+    }
+  }
+
   int window_samples_;
   int total_samples_;
   Total window_sum_;
@@ -101,10 +125,14 @@ class Accumulator {
 };
 
 struct TimerMapValue {
-  TimerMapValue() {}
+  TimerMapValue() : num_allocations_(0), peak_bytes_(0) {}
 
   // Create an accumulator with specified window size.
   Accumulator<double, double, 50> acc_;
+  // Heap allocations of all samples and the largest peak of a sample, see
+  // memory_tracking::AllocationScope. Zero without allocation tracking.
+  size_t num_allocations_;
+  size_t peak_bytes_;
 };
 
 // A class that has the timer interface but does nothing. Swapping this in in
@@ -121,6 +149,10 @@ class DummyTimer {
   bool IsTiming() { return false; }
 };
 
+// Measures with the monotonic steady_clock. Times are accumulated per thread
+// without contention and merged when the Timing statistics are read, so
+// timers can stay in code that runs concurrently. With allocation tracking,
+// also records the heap allocations of the timed thread.
 class Timer {
  public:
   Timer(size_t handle, bool constructStopped = false);
@@ -132,7 +164,8 @@ class Timer {
   bool IsTiming() const;
 
  private:
-  std::chrono::time_point<std::chrono::system_clock> time_;
+  std::chrono::steady_clock::time_point time_;
+  memory_tracking::AllocationScope allocations_;
 
   bool timing_;
   size_t handle_;
@@ -159,6 +192,10 @@ class Timing {
   static double GetMaxSeconds(std::string const& tag);
   static double GetHz(size_t handle);
   static double GetHz(std::string const& tag);
+  static size_t GetNumAllocations(size_t handle);
+  static size_t GetNumAllocations(std::string const& tag);
+  static size_t GetPeakBytes(size_t handle);
+  static size_t GetPeakBytes(std::string const& tag);
   static void Print(std::ostream& out);
   static std::string Print();
   static std::string SecondsToTimeString(double seconds);
@@ -166,18 +203,37 @@ class Timing {
   static const map_t& GetTimers() { return Instance().tag_map_; }
 
  private:
-  void AddTime(size_t handle, double seconds);
+  typedef std::vector<TimerMapValue> list_t;
+
+  // Accumulators of one thread. Only the owning thread adds times, the
+  // mutex is uncontended except while the statistics are read.
+  struct ThreadTimers {
+    ThreadTimers();
+    // Merges the times into the retired accumulators.
+    ~ThreadTimers();
+    std::mutex mutex;
+    list_t timers;
+  };
+
+  void AddTime(size_t handle, double seconds, size_t num_allocations,
+               size_t peak_bytes);
+  // Merged accumulator of all threads.
+  TimerMapValue GetMerged(size_t handle);
 
   static Timing& Instance();
+  static ThreadTimers& GetThreadTimers();
 
   Timing();
   ~Timing();
 
-  typedef std::vector<TimerMapValue> list_t;
-
+  // Times of threads that already exited.
   list_t timers_;
+  std::vector<ThreadTimers*> threads_;
   map_t tag_map_;
+  size_t num_handles_;
   size_t max_tag_length_;
+  // Guards the handles, the thread registry and the retired times.
+  std::mutex mutex_;
 };
 
 #if DISABLE_TIMING
@@ -186,6 +242,36 @@ typedef DummyTimer DebugTimer;
 typedef Timer DebugTimer;
 #endif
 
+#define MAV_TRAJECTORY_GENERATION_TIMING_CONCAT_(a, b) a##b
+#define MAV_TRAJECTORY_GENERATION_TIMING_CONCAT(a, b) \
+  MAV_TRAJECTORY_GENERATION_TIMING_CONCAT_(a, b)
+
+// Times the enclosing scope. The handle is looked up once per call site.
+// Compiles to nothing with DISABLE_TIMING, which the CMake option
+// MAV_TRAJECTORY_GENERATION_DISABLE_TIMING defines. Each sample reads the
+// clock twice, thus keep it out of the innermost loops.
+#if DISABLE_TIMING
+#define MAV_TRAJECTORY_GENERATION_SCOPED_TIMER(tag)
+#else
+#define MAV_TRAJECTORY_GENERATION_SCOPED_TIMER(tag)                        \
+  static const size_t MAV_TRAJECTORY_GENERATION_TIMING_CONCAT(             \
+      timer_handle_, __LINE__) =                                           \
+      ::mav_trajectory_generation::timing::Timing::GetHandle(tag);         \
+  ::mav_trajectory_generation::timing::Timer                               \
+      MAV_TRAJECTORY_GENERATION_TIMING_CONCAT(scoped_timer_, __LINE__)(    \
+          MAV_TRAJECTORY_GENERATION_TIMING_CONCAT(timer_handle_, __LINE__))
+#endif
+
+// Times a phase of which only the heap allocations are of interest. Like
+// MAV_TRAJECTORY_GENERATION_SCOPED_TIMER, but compiles to nothing unless
+// built with MAV_TRAJECTORY_GENERATION_TRACK_ALLOCATIONS.
+#ifdef MAV_TRAJECTORY_GENERATION_TRACK_ALLOCATIONS
+#define MAV_TRAJECTORY_GENERATION_ALLOCATION_PHASE(tag) \
+  MAV_TRAJECTORY_GENERATION_SCOPED_TIMER(tag)
+#else
+#define MAV_TRAJECTORY_GENERATION_ALLOCATION_PHASE(tag)
+#endif
+
 }  // namespace timing
 }  // namespace mav_trajectory_generation
 
@@ -21,16 +21,24 @@
 #ifndef MAV_TRAJECTORY_GENERATION_TRAJECTORY_H_
 #define MAV_TRAJECTORY_GENERATION_TRAJECTORY_H_
 
+#include <memory>
+#include <mutex>
+
 #include "mav_trajectory_generation/extremum.h"
 #include "mav_trajectory_generation/segment.h"
 
 namespace mav_trajectory_generation {
 
+class ArcLengthTable;
+class ThreadPool;
+
 // Holder class for trajectories of D dimensions, of K segments, and
 // polynomial order N-1. (N=12 -> 11th order polynomial, with 12 coefficients).
+// The segments are held in a shared buffer, so copies are O(1) and safe to
+// hand to other threads. Modifications copy the buffer if it is shared.
 class Trajectory {
  public:
-  Trajectory() : D_(0), N_(0), max_time_(0.0) {}
+  Trajectory() : D_(0), N_(0), max_time_(0.0), storage_(emptyStorage()) {}
   ~Trajectory() {}
 
   bool operator==(const Trajectory& rhs) const;
@@ -40,11 +48,11 @@ class Trajectory {
 
   int D() const { return D_; }
   int N() const { return N_; }
-  int K() const { return segments_.size(); }
+  int K() const { return storage_->segments.size(); }
 
-  bool empty() const { return segments_.empty(); }
+  bool empty() const { return storage_->segments.empty(); }
   void clear() {
-    segments_.clear();
+    storage_ = emptyStorage();
     D_ = 0;
     N_ = 0;
     max_time_ = 0.0;
@@ -52,27 +60,68 @@ class Trajectory {
 
   void setSegments(const Segment::Vector& segments) {
     CHECK(!segments.empty());
-    segments_ = segments;
-    D_ = segments_.front().D();
-    N_ = segments_.front().N();
+    std::shared_ptr<Storage> storage = std::make_shared<Storage>();
+    storage->segments = segments;
+    storage_ = storage;
+    updateSegmentStartTimes();
+  }
 
-    // Cache the max time.
-    max_time_ = 0.0;
-    for (const Segment& segment : segments) {
-      CHECK_EQ(segment.D(), D_);
-      max_time_ += segment.getTime();
-    }
+  // Takes over the segments without copying them, e.g. after converting a
+  // message. segments is left empty.
+  void setSegments(Segment::Vector&& segments) {
+    CHECK(!segments.empty());
+    std::shared_ptr<Storage> storage = std::make_shared<Storage>();
+    storage->segments.swap(segments);
+    storage_ = storage;
+    updateSegmentStartTimes();
   }
 
   void getSegments(Segment::Vector* segments) const {
     CHECK_NOTNULL(segments);
-    *segments = segments_;
+    *segments = storage_->segments;
   }
 
-  const Segment::Vector& segments() const { return segments_; }
+  const Segment::Vector& segments() const { return storage_->segments; }
+
+  // True if both trajectories hold the same segment buffer, i.e. one is an
+  // unmodified copy of the other.
+  bool sharesSegmentsWith(const Trajectory& rhs) const {
+    return storage_ == rhs.storage_;
+  }
 
   double getMinTime() const { return 0.0; }
   double getMaxTime() const { return max_time_; }
+  double getSegmentStartTime(int segment_idx) const {
+    return storage_->segment_start_times[segment_idx];
+  }
+
+  // Returns the index of the segment containing t in O(log K). In case t
+  // falls on a vertex, the segment right of the vertex is chosen. Times
+  // before the start or after the end map to the first or last segment.
+  int getSegmentIndex(double t) const;
+
+  // Keeps the segment of the last query, so that looking up monotonic times
+  // is amortized O(1), and falls back to a binary search for jumps. Only
+  // valid as long as the trajectory is not modified.
+  class Cursor {
+   public:
+    Cursor() : trajectory_(nullptr), segment_idx_(0) {}
+    explicit Cursor(const Trajectory& trajectory)
+        : trajectory_(&trajectory), segment_idx_(0) {}
+
+    // Moves to the segment containing t, see getSegmentIndex().
+    int seek(double t);
+
+    // Same as Trajectory::evaluate().
+    Eigen::VectorXd evaluate(
+        double t, int derivative_order = derivative_order::POSITION);
+
+    int getSegmentIndex() const { return segment_idx_; }
+
+   private:
+    const Trajectory* trajectory_;
+    int segment_idx_;
+  };
 
   // Functions to create new trajectories by splitting (getting a NEW trajectory
   // with a single dimension) or compositing (create a new trajectory with
@@ -81,6 +130,18 @@ class Trajectory {
   bool getTrajectoryWithAppendedDimension(
       const Trajectory& trajectory_to_append, Trajectory* new_trajectory) const;
 
+  // Appends the segments of trajectory_to_append, which needs the same
+  // dimension, behind the end of this trajectory. Extends the buffer in place
+  // if it is not shared, and shares the other buffer if this is empty.
+  void append(const Trajectory& trajectory_to_append);
+
+  // Gets the part of the trajectory between t_start and t_end. The first and
+  // last segment are cut to the range, the polynomials of a cut start are
+  // shifted to start at 0. The whole range returns a copy with the shared
+  // buffer. Returns false if the range is not within the trajectory.
+  bool getSubTrajectory(double t_start, double t_end,
+                        Trajectory* sub_trajectory) const;
+
   // Evaluation functions.
   // Evaluate at a single time, and a single derivative. Return type of
   // dimension D.
@@ -94,20 +155,93 @@ class Trajectory {
                      int derivative_order, std::vector<Eigen::VectorXd>* result,
                      std::vector<double>* sampling_times = nullptr) const;
 
+  // Evaluates all derivatives from position up to max_derivative at times
+  // t_start + i * dt, i = 0 ... floor((t_end - t_start) / dt), in a single
+  // pass over the segments.
+  // Output: result = (D * (max_derivative + 1)) x n_samples matrix. Column i
+  // is a contiguous, column-major D x (max_derivative + 1) block for sample
+  // i, i.e. result->col(i).segment(k * D, D) is derivative k. The matrix is
+  // only reallocated if its size changes, so it can be reused.
+  // Output: sampling_times = Optional sampling times.
+  // Returns false if the range is not within the trajectory.
+  bool evaluateRangeAllDerivatives(
+      double t_start, double t_end, double dt, int max_derivative,
+      Eigen::MatrixXd* result,
+      std::vector<double>* sampling_times = nullptr) const;
+
+  // Arc length table of the position with the default tolerance, built on
+  // the first call and shared by all copies of the trajectory.
+  std::shared_ptr<const ArcLengthTable> getArcLengthTable() const;
+
   // Compute the analytic minimum and maximum of magnitude for a given
   // derivative and dimensions, e.g., [0, 1, 2] for position or [3] for yaw.
+  // Input: thread_pool = Processes the segments in parallel. Optional, can
+  // be set to nullptr to run in the calling thread. The result is the same.
   // Returns false in case of extremum calculation failure.
   bool computeMinMaxMagnitude(int derivative,
                               const std::vector<int>& dimensions,
-                              Extremum* minimum, Extremum* maximum) const;
+                              Extremum* minimum, Extremum* maximum,
+                              ThreadPool* thread_pool = nullptr) const;
+
+  // Returns whether the magnitude of the derivative exceeds limit anywhere,
+  // e.g. whether the velocity is above v_max. Every segment is first bounded
+  // by the Bernstein coefficients of its dimensions, only segments whose
+  // bound is above the limit are checked by their extremum candidates. Stops
+  // at the first segment above the limit. Returns true as well if a segment
+  // cannot be checked, e.g. for empty or invalid dimensions or if the root
+  // finding fails.
+  // Output: violation = A candidate above the limit in the first segment
+  // that exceeds it, with the time within that segment. Optional. Has an
+  // infinite value if the segment could not be checked.
+  bool exceedsMagnitude(int derivative, const std::vector<int>& dimensions,
+                        double limit, Extremum* violation = nullptr) const;
 
  private:
+  struct Storage {
+    Storage() {}
+    // Copies only the segments, as the copy is about to be modified.
+    Storage(const Storage& other)
+        : segments(other.segments),
+          segment_start_times(other.segment_start_times) {}
+
+    // K is number of segments...
+    Segment::Vector segments;
+    // Start time of every segment.
+    std::vector<double> segment_start_times;
+
+    // Built on demand, guarded by the mutex.
+    std::mutex arc_length_mutex;
+    std::shared_ptr<const ArcLengthTable> arc_length_table;
+  };
+
+  // Shared by all empty trajectories.
+  static const std::shared_ptr<Storage>& emptyStorage();
+
+  // Storage that can be modified, copied first if it is shared.
+  Storage* mutableStorage();
+
+  // Caches the dimension, the segment start times and the max time of the
+  // segments. Only called on an unshared storage_.
+  void updateSegmentStartTimes() {
+    Storage* storage = storage_.get();
+    D_ = storage->segments.front().D();
+    N_ = storage->segments.front().N();
+    storage->segment_start_times.resize(storage->segments.size());
+    storage->arc_length_table.reset();
+    max_time_ = 0.0;
+    for (size_t i = 0; i < storage->segments.size(); ++i) {
+      CHECK_EQ(storage->segments[i].D(), D_);
+      storage->segment_start_times[i] = max_time_;
+      max_time_ += storage->segments[i].getTime();
+    }
+  }
+
   int D_;            // Number of dimensions.
   int N_;            // Number of coefficients.
   double max_time_;  // Time at the end of the trajectory.
 
-  // K is number of segments...
-  Segment::Vector segments_;
+  // Never null and never modified while shared with another trajectory.
+  std::shared_ptr<Storage> storage_;
 };
 
 }  // namespace mav_trajectory_generation
@@ -0,0 +1,97 @@
+/*
+ * Copyright (c) 2016, Markus Achtelik, ASL, ETH Zurich, Switzerland
+ * Copyright (c) 2016, Michael Burri, ASL, ETH Zurich, Switzerland
+ * Copyright (c) 2016, Helen Oleynikova, ASL, ETH Zurich, Switzerland
+ * Copyright (c) 2016, Rik Bähnemann, ASL, ETH Zurich, Switzerland
+ * Copyright (c) 2016, Marija Popovic, ASL, ETH Zurich, Switzerland
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef MAV_TRAJECTORY_GENERATION_TRAJECTORY_BATCH_H_
+#define MAV_TRAJECTORY_GENERATION_TRAJECTORY_BATCH_H_
+
+#include <vector>
+
+#include "mav_trajectory_generation/thread_pool.h"
+#include "mav_trajectory_generation/trajectory.h"
+
+namespace mav_trajectory_generation {
+
+// Packed copy of many trajectories of equal dimension for evaluating large
+// batches of samples, e.g. (trajectory, time) pairs of a whole fleet.
+// All data lies in a few flat, index-based buffers without pointers, such
+// that the tables can be uploaded as is to an accelerator. evaluate() is the
+// CPU reference implementation of the batch evaluation.
+class TrajectoryBatch {
+ public:
+  TrajectoryBatch() : N_(0), D_(0), max_derivative_(0) {}
+  // Trajectories of lower order are padded with zero coefficients to the
+  // highest N of the batch.
+  TrajectoryBatch(const std::vector<Trajectory>& trajectories,
+                  int max_derivative);
+
+  int N() const { return N_; }
+  int D() const { return D_; }
+  int getMaxDerivative() const { return max_derivative_; }
+  size_t getNumberTrajectories() const { return max_times_.size(); }
+  double getMaxTime(size_t trajectory_idx) const {
+    return max_times_[trajectory_idx];
+  }
+
+  // Number of doubles written per sample, D * (max_derivative + 1).
+  int getSampleSize() const { return D_ * (max_derivative_ + 1); }
+
+  // Evaluates all derivatives up to max_derivative of trajectory
+  // trajectory_indices[i] at time times[i] for every sample i.
+  // Output: result = n_samples consecutive, column-major
+  // D x (max_derivative + 1) blocks, i.e. n_samples * getSampleSize()
+  // doubles, the same layout as VectorizedSegment::evaluate().
+  // Samples after the end of their trajectory are set to zero, as by
+  // Trajectory::evaluate(). Splits the samples across the threads of
+  // thread_pool if given.
+  // Returns false if any sample was out of range.
+  bool evaluate(const int* trajectory_indices, const double* times,
+                size_t n_samples, double* result,
+                ThreadPool* thread_pool = nullptr) const;
+
+  // Packed tables, see the members below.
+  const std::vector<double>& getCoefficients() const { return coefficients_; }
+  const std::vector<double>& getSegmentStartTimes() const {
+    return segment_start_times_;
+  }
+  const std::vector<int>& getTrajectorySegmentOffsets() const {
+    return trajectory_segment_offsets_;
+  }
+
+ private:
+  // Evaluates the samples [begin, end).
+  bool evaluateSamples(const int* trajectory_indices, const double* times,
+                       size_t begin, size_t end, double* result) const;
+
+  int N_;
+  int D_;
+  int max_derivative_;
+  // Derivative coefficients of all segments, indexed by
+  // [segment][derivative][power of t][dimension].
+  std::vector<double> coefficients_;
+  // Start time of every segment relative to the start of its trajectory.
+  std::vector<double> segment_start_times_;
+  // The segments of trajectory i are [offsets[i], offsets[i + 1]).
+  std::vector<int> trajectory_segment_offsets_;
+  std::vector<double> max_times_;
+};
+
+}  // namespace mav_trajectory_generation
+
+#endif  // MAV_TRAJECTORY_GENERATION_TRAJECTORY_BATCH_H_
@@ -0,0 +1,114 @@
+/*
+ * Copyright (c) 2016, Markus Achtelik, ASL, ETH Zurich, Switzerland
+ * Copyright (c) 2016, Michael Burri, ASL, ETH Zurich, Switzerland
+ * Copyright (c) 2016, Helen Oleynikova, ASL, ETH Zurich, Switzerland
+ * Copyright (c) 2016, Rik Bähnemann, ASL, ETH Zurich, Switzerland
+ * Copyright (c) 2016, Marija Popovic, ASL, ETH Zurich, Switzerland
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef MAV_TRAJECTORY_GENERATION_TRAJECTORY_BVH_H_
+#define MAV_TRAJECTORY_GENERATION_TRAJECTORY_BVH_H_
+
+#include <Eigen/Geometry>
+#include <vector>
+
+#include "mav_trajectory_generation/trajectory.h"
+
+namespace mav_trajectory_generation {
+
+// Bounding volume hierarchy over the position, i.e. the first three
+// dimensions, of a trajectory for collision and proximity queries without
+// dense sampling. Every leaf bounds one segment by the Bernstein coefficients
+// of its polynomials, inner nodes bound consecutive segments. Queries descend
+// the tree and bisect segments in time only where needed, until the answer
+// is known up to the tolerance.
+class TrajectoryBvh {
+ public:
+  TrajectoryBvh() : tolerance_(0.0) {}
+  // Boxes with a diagonal below tolerance [m] are not refined further: they
+  // count as touching a query, and distances may be up to tolerance larger
+  // than the true minimum.
+  explicit TrajectoryBvh(const Trajectory& trajectory,
+                         double tolerance = 1.0e-3);
+
+  bool empty() const { return nodes_.empty(); }
+  double getTolerance() const { return tolerance_; }
+  const Trajectory& getTrajectory() const { return trajectory_; }
+  // Box containing the whole trajectory.
+  const Eigen::AlignedBox3d& getBoundingBox() const {
+    return nodes_.front().box;
+  }
+
+  // Returns true if the position enters the box or sphere, and optionally
+  // the first time it does.
+  bool intersectsBox(const Eigen::AlignedBox3d& box,
+                     double* t_first = nullptr) const;
+  bool intersectsSphere(const Eigen::Vector3d& center, double radius,
+                        double* t_first = nullptr) const;
+
+  // Returns the minimum distance from the position to point, and optionally
+  // the time of the closest point.
+  double getDistance(const Eigen::Vector3d& point,
+                     double* t_closest = nullptr) const;
+
+  // Returns the minimum distance between the positions of both trajectories
+  // at equal times, e.g. of two vehicles, and optionally the time of the
+  // closest approach. Only times within both trajectories are compared.
+  double getClosestApproach(const TrajectoryBvh& other,
+                            double* t_closest = nullptr) const;
+
+ private:
+  struct Node {
+    Eigen::AlignedBox3d box;
+    double t_start;
+    double t_end;
+    // Segment of a leaf, -1 for inner nodes.
+    int segment_idx;
+    int left;
+    int right;
+  };
+
+  // Part of the trajectory during a query: a node or a time interval of a
+  // segment.
+  struct Piece {
+    Eigen::AlignedBox3d box;
+    double t_start;
+    double t_end;
+    // Node of the piece, -1 below the leaves.
+    int node_idx;
+    // Segment of leaves and below, -1 for inner nodes.
+    int segment_idx;
+  };
+
+  // Builds the subtree over the segments [first, last] and returns its index.
+  int build(int first_segment, int last_segment);
+
+  Piece getNodePiece(int node_idx) const;
+  Piece getSegmentPiece(int segment_idx, double t_start, double t_end) const;
+  // Children of piece, bisecting it in time below the leaves.
+  void split(const Piece& piece, Piece* first, Piece* second) const;
+  // True if piece does not need to be split any further.
+  bool isSmall(const Piece& piece) const;
+  Eigen::Vector3d getPosition(int segment_idx, double t) const;
+
+  Trajectory trajectory_;
+  double tolerance_;
+  // The root is nodes_[0].
+  std::vector<Node> nodes_;
+};
+
+}  // namespace mav_trajectory_generation
+
+#endif  // MAV_TRAJECTORY_GENERATION_TRAJECTORY_BVH_H_
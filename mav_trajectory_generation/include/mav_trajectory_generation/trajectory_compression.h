@@ -0,0 +1,118 @@
+/*
+ * Copyright (c) 2016, Markus Achtelik, ASL, ETH Zurich, Switzerland
+ * Copyright (c) 2016, Michael Burri, ASL, ETH Zurich, Switzerland
+ * Copyright (c) 2016, Helen Oleynikova, ASL, ETH Zurich, Switzerland
+ * Copyright (c) 2016, Rik Bähnemann, ASL, ETH Zurich, Switzerland
+ * Copyright (c) 2016, Marija Popovic, ASL, ETH Zurich, Switzerland
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef MAV_TRAJECTORY_GENERATION_TRAJECTORY_COMPRESSION_H_
+#define MAV_TRAJECTORY_GENERATION_TRAJECTORY_COMPRESSION_H_
+
+#include <cstdint>
+#include <vector>
+
+#include "mav_trajectory_generation/motion_defines.h"
+#include "mav_trajectory_generation/trajectory.h"
+
+namespace mav_trajectory_generation {
+
+// Lossy compression of a trajectory for bandwidth-limited links. Adjacent
+// segments are merged and refit with the lowest order that stays within the
+// tolerance, the coefficients are quantized and entropy coded as varints.
+//
+// Every compressed segment is a Hermite polynomial interpolating the
+// derivatives up to continuity_derivative at both ends, plus a bubble
+// polynomial tau^(c+1) * (1 - tau)^(c+1) * sum_j b_j * T_j(2 * tau - 1) in the
+// normalized time tau in [0, 1], with the Chebyshev polynomials T_j. The
+// boundary derivatives are shared by adjacent segments, so the decoded
+// trajectory stays continuous up to continuity_derivative after quantization.
+//
+// Wire format, little endian:
+// [uint32 magic "MTRC"][uint8 version][uint8 D][uint8 c][uint8 N]
+// [c + 2 float quantization steps: boundary derivatives 0..c, bubble]
+// [varint K]
+// [boundary 0]
+// K times: [varint duration in us][uint8 number of bubble coefficients]
+//          [end boundary][bubble coefficients, ordered by dimension]
+// A boundary holds the quantized derivatives 0..c of all dimensions as zigzag
+// varints, relative to the previous boundary. The bubble coefficients are
+// zigzag varints of the quantized values. All decoded segments have N
+// coefficients.
+struct CompressionParameters {
+  CompressionParameters()
+      : tolerance(0.01),
+        continuity_derivative(derivative_order::ACCELERATION),
+        max_N(Polynomial::kMaxN),
+        merge_segments(true),
+        quantization_share(0.5),
+        samples_per_segment(32) {}
+
+  // Maximum absolute error of every dimension of the position, in the units
+  // of the trajectory (e.g. m and rad), checked at the sample times.
+  double tolerance;
+  // Highest derivative, which is continuous across segments. Should not
+  // exceed the continuity of the input trajectory.
+  int continuity_derivative;
+  // Highest number of coefficients of a compressed segment. Segments with up
+  // to max_N coefficients are represented exactly before quantization.
+  int max_N;
+  bool merge_segments;
+  // Part of the tolerance given to the quantization, the rest to the refit.
+  double quantization_share;
+  // Uniformly spaced samples per input segment to fit and check the error.
+  int samples_per_segment;
+};
+
+struct CompressionReport {
+  CompressionReport()
+      : num_segments_in(0),
+        num_segments_out(0),
+        uncompressed_bytes(0),
+        compressed_bytes(0) {}
+
+  double getCompressionRatio() const {
+    return compressed_bytes == 0
+               ? 0.0
+               : static_cast<double>(uncompressed_bytes) / compressed_bytes;
+  }
+
+  size_t num_segments_in;
+  size_t num_segments_out;
+  // Segment times and coefficients as double, as in PolynomialTrajectory4D
+  // and the binary file format.
+  size_t uncompressed_bytes;
+  size_t compressed_bytes;
+  // Maximum absolute error of the decoded trajectory over all dimensions, for
+  // the derivatives up to continuity_derivative, at twice the sample density
+  // used for fitting.
+  std::vector<double> max_error;
+};
+
+// Compresses the trajectory into data. Returns false if the trajectory is
+// empty or the decoded trajectory exceeds the tolerance, e.g. because the
+// input is less continuous than continuity_derivative.
+bool compressTrajectory(const Trajectory& trajectory,
+                        const CompressionParameters& parameters,
+                        std::vector<uint8_t>* data,
+                        CompressionReport* report = nullptr);
+
+// Returns false if data is not a valid compressed trajectory.
+bool decompressTrajectory(const std::vector<uint8_t>& data,
+                          Trajectory* trajectory);
+
+}  // namespace mav_trajectory_generation
+
+#endif  // MAV_TRAJECTORY_GENERATION_TRAJECTORY_COMPRESSION_H_
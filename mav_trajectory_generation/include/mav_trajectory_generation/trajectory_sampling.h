@@ -26,6 +26,8 @@
 
 namespace mav_trajectory_generation {
 
+class VectorizedTrajectory;
+
 // All of these functions sample a trajectory at a time, or a range of times,
 // into an EigenTrajectoryPoint (or vector). These support 3D or 4D
 // trajectories. If the trajectories are 4D, the 4th dimension is assumed to
@@ -47,6 +49,17 @@ bool sampleWholeTrajectory(const Trajectory& trajectory,
                            double sampling_interval,
                            mav_msgs::EigenTrajectoryPoint::Vector* states);
 
+// Samples up to n_samples states from start_time on at sampling_interval with
+// the vectorized evaluation, e.g. the look-ahead horizon of a controller.
+// Fewer states are returned if the horizon reaches past the end of the
+// trajectory. The trajectory has to be created with max_derivative SNAP.
+// samples and states keep their memory, such that sampling a horizon of the
+// same size again does not allocate.
+bool sampleTrajectoryHorizon(const VectorizedTrajectory& trajectory,
+                             double start_time, size_t n_samples,
+                             double sampling_interval, Eigen::MatrixXd* samples,
+                             mav_msgs::EigenTrajectoryPointVector* states);
+
 bool sampleSegmentAtTime(const Segment& segment, double sample_time,
                          mav_msgs::EigenTrajectoryPoint* state);
 
@@ -54,6 +67,45 @@ template<class T>
 bool sampleFlatStateAtTime(const T& type, double sample_time,
                            mav_msgs::EigenTrajectoryPoint* state);
 
+// Samples a trajectory one state at a time, e.g., from a timer callback.
+// Keeps a cursor to the current segment and the derivative coefficients of
+// that segment, so that stepping forward is O(1) and does not allocate.
+// The trajectory has to outlive the sampler and must not be modified.
+class TrajectoryStreamSampler {
+ public:
+  TrajectoryStreamSampler();
+
+  // Starts sampling the trajectory at start_time. Returns false if the
+  // trajectory is not 3D or 4D or start_time is out of range.
+  bool setTrajectory(const Trajectory& trajectory, double start_time = 0.0);
+
+  // Samples at time t, forward or backward.
+  // Returns false if t is not within the trajectory, the state is unchanged
+  // in that case.
+  bool seek(double t);
+
+  // Advances the sample time by dt.
+  bool next(double dt) { return seek(time_ + dt); }
+
+  bool valid() const { return trajectory_ != nullptr; }
+  double getTime() const { return time_; }
+  const mav_msgs::EigenTrajectoryPoint& getState() const { return state_; }
+
+ private:
+  // Scales the coefficients of the segment by the base coefficients.
+  void loadSegment(int segment_idx);
+
+  const Trajectory* trajectory_;
+  Trajectory::Cursor cursor_;
+  int segment_idx_;
+  double time_;
+  // Row (k * D + d) holds the coefficients of derivative k of dimension d.
+  Eigen::MatrixXd derivative_coefficients_;
+  Eigen::VectorXd t_powers_;
+  Eigen::VectorXd values_;
+  mav_msgs::EigenTrajectoryPoint state_;
+};
+
 }  // namespace mav_trajectory_generation
 
 #endif  // MAV_TRAJECTORY_GENERATION_TRAJECTORY_SAMPLING_H_
@@ -0,0 +1,157 @@
+/*
+ * Copyright (c) 2016, Markus Achtelik, ASL, ETH Zurich, Switzerland
+ * Copyright (c) 2016, Michael Burri, ASL, ETH Zurich, Switzerland
+ * Copyright (c) 2016, Helen Oleynikova, ASL, ETH Zurich, Switzerland
+ * Copyright (c) 2016, Rik Bähnemann, ASL, ETH Zurich, Switzerland
+ * Copyright (c) 2016, Marija Popovic, ASL, ETH Zurich, Switzerland
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef MAV_TRAJECTORY_GENERATION_TRAJECTORY_TABLE_H_
+#define MAV_TRAJECTORY_GENERATION_TRAJECTORY_TABLE_H_
+
+#include <glog/logging.h>
+#include <Eigen/Core>
+#include <algorithm>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "mav_trajectory_generation/motion_defines.h"
+#include "mav_trajectory_generation/trajectory.h"
+
+namespace mav_trajectory_generation {
+
+// Trajectory table file, in native byte order:
+// [TrajectoryTableHeader]
+// [num_samples * (max_derivative + 2) * D samples (float), ordered by sample
+//  time, then derivative, then dimension]
+// Sample i is at time i * dt. Every derivative is stored together with the
+// next one, which is its slope for the cubic Hermite interpolation.
+struct TrajectoryTableHeader {
+  static constexpr uint32_t kMagic = 0x544c544d;  // "MTLT"
+  static constexpr uint32_t kVersion = 1;
+  static constexpr int kMaxDerivative = derivative_order::SNAP;
+  static constexpr int kMaxD = 64;
+
+  uint32_t magic;
+  uint32_t version;
+  uint32_t D;
+  uint32_t max_derivative;
+  uint64_t num_samples;
+  double dt;
+  double max_time;
+  // See TrajectoryTable::getErrorBound().
+  double error_bounds[kMaxDerivative + 1];
+};
+
+// Trajectory baked into a table of samples on a fixed time grid, for
+// consumers that cannot evaluate polynomials, e.g. a controller on a
+// microcontroller. A query interpolates the two neighboring samples with a
+// cubic Hermite polynomial, which takes constant time and does not allocate.
+// The table is either baked in memory or mapped read-only from a file.
+class TrajectoryTable {
+ public:
+  TrajectoryTable();
+  ~TrajectoryTable();
+
+  TrajectoryTable(const TrajectoryTable&) = delete;
+  TrajectoryTable& operator=(const TrajectoryTable&) = delete;
+
+  // Samples the derivatives up to max_derivative + 1 every dt. Returns false
+  // if the trajectory is empty or has more than kMaxD dimensions, dt is not
+  // positive or max_derivative is larger than kMaxDerivative.
+  bool bake(const Trajectory& trajectory, double dt,
+            int max_derivative = derivative_order::SNAP);
+
+  bool toFile(const std::string& filename) const;
+  // Maps the file, closing a previously opened or baked table. Returns false
+  // if the file cannot be mapped or is not a valid table file.
+  bool open(const std::string& filename);
+  void close();
+
+  bool empty() const { return samples_ == nullptr; }
+  int D() const { return header_.D; }
+  int getMaxDerivative() const { return header_.max_derivative; }
+  size_t getNumSamples() const { return header_.num_samples; }
+  double getDt() const { return header_.dt; }
+  double getMinTime() const { return 0.0; }
+  double getMaxTime() const { return header_.max_time; }
+  size_t getSizeBytes() const {
+    return sizeof(header_) + header_.num_samples * stride_ * sizeof(float);
+  }
+
+  // Upper bound on the absolute error of every dimension of the derivative,
+  // compared to the double precision trajectory within [0, getMaxTime()].
+  // Covers the interpolation, also across segment boundaries, and the
+  // rounding to float.
+  double getErrorBound(int derivative_order) const {
+    CHECK_GE(derivative_order, 0);
+    CHECK_LE(derivative_order, getMaxDerivative());
+    return header_.error_bounds[derivative_order];
+  }
+
+  // Writes D values of the derivative at t, which is clamped to
+  // [0, getMaxTime()].
+  void evaluate(double t, int derivative_order, float* result) const {
+    DCHECK(!empty());
+    DCHECK_GE(derivative_order, 0);
+    DCHECK_LE(derivative_order, getMaxDerivative());
+    const double s_total =
+        std::min(std::max(t, 0.0), header_.max_time) * inverse_dt_;
+    const size_t i = std::min(static_cast<size_t>(s_total),
+                              static_cast<size_t>(header_.num_samples - 2));
+    const float s = static_cast<float>(s_total - i);
+    const float s2 = s * s;
+    const float s3 = s2 * s;
+    const float h00 = 2.0f * s3 - 3.0f * s2 + 1.0f;
+    const float h01 = 1.0f - h00;
+    const float h10 = (s3 - 2.0f * s2 + s) * dt_;
+    const float h11 = (s3 - s2) * dt_;
+
+    const int D = header_.D;
+    const float* p0 = samples_ + i * stride_ + derivative_order * D;
+    const float* m0 = p0 + D;
+    const float* p1 = p0 + stride_;
+    const float* m1 = p1 + D;
+    for (int d = 0; d < D; ++d) {
+      result[d] = h00 * p0[d] + h10 * m0[d] + h01 * p1[d] + h11 * m1[d];
+    }
+  }
+
+  Eigen::VectorXf evaluate(
+      double t, int derivative_order = derivative_order::POSITION) const {
+    Eigen::VectorXf result(D());
+    evaluate(t, derivative_order, result.data());
+    return result;
+  }
+
+ private:
+  // Sets the header and the members derived from it.
+  void setHeader(const TrajectoryTableHeader& header);
+
+  TrajectoryTableHeader header_;
+  // Floats per sample time.
+  size_t stride_;
+  float dt_;
+  double inverse_dt_;
+  const float* samples_;
+  std::vector<float> buffer_;
+  void* mapped_data_;
+  size_t mapped_size_;
+};
+
+}  // namespace mav_trajectory_generation
+
+#endif  // MAV_TRAJECTORY_GENERATION_TRAJECTORY_TABLE_H_
@@ -0,0 +1,107 @@
+/*
+ * Copyright (c) 2016, Markus Achtelik, ASL, ETH Zurich, Switzerland
+ * Copyright (c) 2016, Michael Burri, ASL, ETH Zurich, Switzerland
+ * Copyright (c) 2016, Helen Oleynikova, ASL, ETH Zurich, Switzerland
+ * Copyright (c) 2016, Rik Bähnemann, ASL, ETH Zurich, Switzerland
+ * Copyright (c) 2016, Marija Popovic, ASL, ETH Zurich, Switzerland
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef MAV_TRAJECTORY_GENERATION_VECTORIZED_SEGMENT_H_
+#define MAV_TRAJECTORY_GENERATION_VECTORIZED_SEGMENT_H_
+
+#include <Eigen/Core>
+#include <vector>
+
+#include "mav_trajectory_generation/motion_defines.h"
+#include "mav_trajectory_generation/segment.h"
+#include "mav_trajectory_generation/trajectory.h"
+
+namespace mav_trajectory_generation {
+
+// Copy of a segment for dense sampling. The coefficients of all derivatives
+// up to max_derivative are precomputed and stored as structure of arrays,
+// i.e. the coefficients of all dimensions for the same power of t lie side by
+// side. Evaluation runs Horner's scheme on kNumLanes sample times at once
+// using Eigen's packet math, which maps to AVX, SSE2 or NEON depending on the
+// compile flags and falls back to scalar code with EIGEN_DONT_VECTORIZE.
+class VectorizedSegment {
+ public:
+  typedef std::vector<VectorizedSegment> Vector;
+  static constexpr int kNumLanes = 4;
+
+  VectorizedSegment() : N_(0), D_(0), max_derivative_(0), time_(0.0) {}
+  VectorizedSegment(const Segment& segment, int max_derivative);
+
+  // Reinitializes from a segment, reusing the storage of the coefficients.
+  void setSegment(const Segment& segment, int max_derivative);
+
+  int D() const { return D_; }
+  int N() const { return N_; }
+  int getMaxDerivative() const { return max_derivative_; }
+  double getTime() const { return time_; }
+
+  // Number of doubles written per sample, D * (max_derivative + 1).
+  int getSampleSize() const { return D_ * (max_derivative_ + 1); }
+
+  // Evaluates all derivatives up to max_derivative at n_times times, relative
+  // to the segment start.
+  // Output: result = n_times consecutive, column-major
+  // D x (max_derivative + 1) blocks, i.e. n_times * getSampleSize() doubles.
+  void evaluate(const double* times, size_t n_times, double* result) const;
+
+ private:
+  inline double coefficient(int derivative, int j, int d) const {
+    return coefficients_[(derivative * N_ + j) * D_ + d];
+  }
+
+  int N_;
+  int D_;
+  int max_derivative_;
+  double time_;
+  // Derivative coefficients, indexed by [derivative][power of t][dimension].
+  std::vector<double> coefficients_;
+};
+
+// Structure of arrays copy of a trajectory for dense sampling. See
+// VectorizedSegment.
+class VectorizedTrajectory {
+ public:
+  VectorizedTrajectory() : D_(0), max_derivative_(0), max_time_(0.0) {}
+  VectorizedTrajectory(const Trajectory& trajectory, int max_derivative);
+
+  int D() const { return D_; }
+  int K() const { return segments_.size(); }
+  int getMaxDerivative() const { return max_derivative_; }
+  double getMaxTime() const { return max_time_; }
+
+  // Same interface and output layout as
+  // Trajectory::evaluateRangeAllDerivatives(), evaluating all derivatives up
+  // to the max_derivative this object was created with.
+  bool evaluateRangeAllDerivatives(
+      double t_start, double t_end, double dt, Eigen::MatrixXd* result,
+      std::vector<double>* sampling_times = nullptr) const;
+
+ private:
+  int D_;
+  int max_derivative_;
+  double max_time_;
+  VectorizedSegment::Vector segments_;
+  // Start time of every segment.
+  std::vector<double> segment_start_times_;
+};
+
+}  // namespace mav_trajectory_generation
+
+#endif  // MAV_TRAJECTORY_GENERATION_VECTORIZED_SEGMENT_H_
@@ -101,6 +101,10 @@ class Vertex {
   // Checks if both lhs and rhs are equal up to tol in case of double values.
   bool isEqualTol(const Vertex& rhs, double tol) const;
 
+  // Returns a vertex with the constraints of n_dimensions dimensions starting
+  // at first_dimension, e.g. to optimize the yaw separately.
+  Vertex getVertexWithDimensions(int first_dimension, int n_dimensions) const;
+
  private:
   int D_;
   Constraints constraints_;
@@ -0,0 +1,238 @@
+/*
+ * Copyright (c) 2016, Markus Achtelik, ASL, ETH Zurich, Switzerland
+ * Copyright (c) 2016, Michael Burri, ASL, ETH Zurich, Switzerland
+ * Copyright (c) 2016, Helen Oleynikova, ASL, ETH Zurich, Switzerland
+ * Copyright (c) 2016, Rik Bähnemann, ASL, ETH Zurich, Switzerland
+ * Copyright (c) 2016, Marija Popovic, ASL, ETH Zurich, Switzerland
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "mav_trajectory_generation/arc_length_table.h"
+
+#include <algorithm>
+#include <cmath>
+
+namespace mav_trajectory_generation {
+
+namespace {
+// Every segment is split at least 2^kMinDepth times, such that a single
+// quadrature cannot agree with its halves by chance.
+constexpr int kMinDepth = 2;
+constexpr int kMaxDepth = 30;
+constexpr int kMaxInversionIterations = 50;
+
+// 5 point Gauss-Legendre quadrature on [-1, 1].
+const double kGaussNodes[5] = {0.0, -0.5384693101056831, 0.5384693101056831,
+                               -0.9061798459386640, 0.9061798459386640};
+const double kGaussWeights[5] = {0.5688888888888889, 0.4786286704993665,
+                                 0.4786286704993665, 0.2369268850561891,
+                                 0.2369268850561891};
+
+double computeSpeed(const Segment& segment, double t) {
+  double squared_speed = 0.0;
+  for (int d = 0; d < std::min(segment.D(), 3); ++d) {
+    const double velocity = segment[d].evaluate(t, derivative_order::VELOCITY);
+    squared_speed += velocity * velocity;
+  }
+  return std::sqrt(squared_speed);
+}
+
+double integrateSpeed(const Segment& segment, double t_start, double t_end) {
+  const double half_width = 0.5 * (t_end - t_start);
+  const double center = 0.5 * (t_start + t_end);
+  double integral = 0.0;
+  for (int i = 0; i < 5; ++i) {
+    integral += kGaussWeights[i] *
+                computeSpeed(segment, center + half_width * kGaussNodes[i]);
+  }
+  return half_width * integral;
+}
+
+// Fritsch-Carlson limit on the slopes of a cubic Hermite interpolation from
+// s_start to s_end over dt, such that it is monotone.
+void limitSlopes(double s_start, double s_end, double dt, double* m_start,
+                 double* m_end) {
+  const double secant = (s_end - s_start) / dt;
+  if (secant <= 0.0) {
+    *m_start = 0.0;
+    *m_end = 0.0;
+    return;
+  }
+  const double alpha = *m_start / secant;
+  const double beta = *m_end / secant;
+  const double norm_squared = alpha * alpha + beta * beta;
+  if (norm_squared > 9.0) {
+    const double tau = 3.0 / std::sqrt(norm_squared);
+    *m_start = tau * alpha * secant;
+    *m_end = tau * beta * secant;
+  }
+}
+
+double hermite(double s_start, double s_end, double m_start, double m_end,
+               double dt, double u, double* derivative) {
+  const double u2 = u * u;
+  const double u3 = u2 * u;
+  if (derivative != nullptr) {
+    *derivative = (6.0 * u2 - 6.0 * u) * (s_start - s_end) +
+                  (3.0 * u2 - 4.0 * u + 1.0) * dt * m_start +
+                  (3.0 * u2 - 2.0 * u) * dt * m_end;
+  }
+  return (2.0 * u3 - 3.0 * u2 + 1.0) * s_start +
+         (u3 - 2.0 * u2 + u) * dt * m_start + (3.0 * u2 - 2.0 * u3) * s_end +
+         (u3 - u2) * dt * m_end;
+}
+}  // namespace
+
+ArcLengthTable::ArcLengthTable(const Trajectory& trajectory, double tolerance)
+    : length_(0.0), time_bucket_width_(0.0), arc_length_bucket_width_(0.0) {
+  CHECK(!trajectory.empty());
+  CHECK_GT(trajectory.getMaxTime(), 0.0);
+  CHECK_GT(tolerance, 0.0);
+  const double tolerance_per_time = tolerance / trajectory.getMaxTime();
+
+  times_.push_back(0.0);
+  arc_lengths_.push_back(0.0);
+  for (int k = 0; k < trajectory.K(); ++k) {
+    const Segment& segment = trajectory.segments()[k];
+    if (segment.getTime() <= 0.0) {
+      continue;
+    }
+    addKnots(segment, trajectory.getSegmentStartTime(k), 0.0,
+             segment.getTime(), integrateSpeed(segment, 0.0, segment.getTime()),
+             tolerance_per_time, 0);
+  }
+  length_ = arc_lengths_.back();
+
+  const int n_intervals = times_.size() - 1;
+  time_bucket_width_ = times_.back() / n_intervals;
+  arc_length_bucket_width_ = length_ > 0.0 ? length_ / n_intervals : 1.0;
+  setupBuckets(times_, time_bucket_width_, &time_buckets_);
+  setupBuckets(arc_lengths_, arc_length_bucket_width_, &arc_length_buckets_);
+}
+
+void ArcLengthTable::addKnots(const Segment& segment, double t_segment,
+                              double t_start, double t_end, double integral,
+                              double tolerance_per_time, int depth) {
+  const double t_middle = 0.5 * (t_start + t_end);
+  const double first_half = integrateSpeed(segment, t_start, t_middle);
+  const double second_half = integrateSpeed(segment, t_middle, t_end);
+  const double dt = t_end - t_start;
+
+  const double s_start = arc_lengths_.back();
+  const double s_end = s_start + first_half + second_half;
+  double m_start = computeSpeed(segment, t_start);
+  double m_end = computeSpeed(segment, t_end);
+  limitSlopes(s_start, s_end, dt, &m_start, &m_end);
+
+  const double tolerance = tolerance_per_time * dt;
+  const bool accurate =
+      std::abs(first_half + second_half - integral) <= tolerance &&
+      std::abs(hermite(s_start, s_end, m_start, m_end, dt, 0.5, nullptr) -
+               (s_start + first_half)) <= tolerance;
+  if (depth >= kMaxDepth || (depth >= kMinDepth && accurate)) {
+    times_.push_back(t_segment + t_end);
+    arc_lengths_.push_back(s_end);
+    start_slopes_.push_back(m_start);
+    end_slopes_.push_back(m_end);
+    return;
+  }
+  addKnots(segment, t_segment, t_start, t_middle, first_half,
+           tolerance_per_time, depth + 1);
+  addKnots(segment, t_segment, t_middle, t_end, second_half,
+           tolerance_per_time, depth + 1);
+}
+
+void ArcLengthTable::setupBuckets(const std::vector<double>& values,
+                                  double bucket_width,
+                                  std::vector<int>* buckets) const {
+  const int n_intervals = values.size() - 1;
+  buckets->resize(n_intervals);
+  int i = 0;
+  for (int bucket = 0; bucket < n_intervals; ++bucket) {
+    while (i + 1 < n_intervals && values[i + 1] < bucket * bucket_width) {
+      ++i;
+    }
+    (*buckets)[bucket] = i;
+  }
+}
+
+int ArcLengthTable::findInterval(const std::vector<double>& values,
+                                 const std::vector<int>& buckets,
+                                 double bucket_width, double value) {
+  const int bucket = std::min(static_cast<int>(value / bucket_width),
+                              static_cast<int>(buckets.size()) - 1);
+  int i = buckets[bucket];
+  while (i + 2 < static_cast<int>(values.size()) && values[i + 1] < value) {
+    ++i;
+  }
+  return i;
+}
+
+double ArcLengthTable::interpolate(int i, double u, double* derivative) const {
+  return hermite(arc_lengths_[i], arc_lengths_[i + 1], start_slopes_[i],
+                 end_slopes_[i], times_[i + 1] - times_[i], u, derivative);
+}
+
+double ArcLengthTable::getArcLength(double t) const {
+  CHECK(!empty());
+  t = std::min(std::max(t, 0.0), times_.back());
+  const int i = findInterval(times_, time_buckets_, time_bucket_width_, t);
+  return interpolate(i, (t - times_[i]) / (times_[i + 1] - times_[i]));
+}
+
+double ArcLengthTable::getTimeAtArcLength(double arc_length) const {
+  CHECK(!empty());
+  arc_length = std::min(std::max(arc_length, 0.0), length_);
+  const int i = findInterval(arc_lengths_, arc_length_buckets_,
+                             arc_length_bucket_width_, arc_length);
+  const double ds = arc_lengths_[i + 1] - arc_lengths_[i];
+  if (ds <= 0.0) {
+    return times_[i];
+  }
+
+  // Newton on the monotone interpolation, falling back to bisection.
+  double u_min = 0.0;
+  double u_max = 1.0;
+  double u = (arc_length - arc_lengths_[i]) / ds;
+  for (int iteration = 0; iteration < kMaxInversionIterations; ++iteration) {
+    double derivative = 0.0;
+    const double error = interpolate(i, u, &derivative) - arc_length;
+    if (std::abs(error) <= 1.0e-12 * (1.0 + length_)) {
+      break;
+    }
+    if (error > 0.0) {
+      u_max = u;
+    } else {
+      u_min = u;
+    }
+    u -= error / derivative;
+    if (!(u > u_min && u < u_max)) {
+      u = 0.5 * (u_min + u_max);
+    }
+  }
+  return times_[i] + u * (times_[i + 1] - times_[i]);
+}
+
+void ArcLengthTable::sampleByArcLength(double ds,
+                                       std::vector<double>* times) const {
+  CHECK_NOTNULL(times);
+  CHECK_GT(ds, 0.0);
+  const size_t n_samples = static_cast<size_t>(length_ / ds) + 1;
+  times->resize(n_samples);
+  for (size_t i = 0; i < n_samples; ++i) {
+    (*times)[i] = getTimeAtArcLength(i * ds);
+  }
+}
+
+}  // namespace mav_trajectory_generation
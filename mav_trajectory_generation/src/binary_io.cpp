@@ -0,0 +1,271 @@
+/*
+ * Copyright (c) 2016, Markus Achtelik, ASL, ETH Zurich, Switzerland
+ * Copyright (c) 2016, Michael Burri, ASL, ETH Zurich, Switzerland
+ * Copyright (c) 2016, Helen Oleynikova, ASL, ETH Zurich, Switzerland
+ * Copyright (c) 2016, Rik Bähnemann, ASL, ETH Zurich, Switzerland
+ * Copyright (c) 2016, Marija Popovic, ASL, ETH Zurich, Switzerland
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "mav_trajectory_generation/binary_io.h"
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <algorithm>
+#include <fstream>
+#include <limits>
+
+#include "mav_trajectory_generation/io.h"
+
+namespace mav_trajectory_generation {
+
+constexpr uint32_t BinaryTrajectoryHeader::kMagic;
+constexpr uint32_t BinaryTrajectoryHeader::kVersion;
+
+bool segmentsToBinaryFile(const std::string& filename,
+                          const Segment::Vector& segments) {
+  BinaryTrajectoryHeader header;
+  header.magic = BinaryTrajectoryHeader::kMagic;
+  header.version = BinaryTrajectoryHeader::kVersion;
+  header.N = segments.empty() ? 0 : segments.front().N();
+  header.D = segments.empty() ? 0 : segments.front().D();
+  header.K = segments.size();
+  header.reserved = 0;
+  for (const Segment& segment : segments) {
+    if (segment.N() != static_cast<int>(header.N) ||
+        segment.D() != static_cast<int>(header.D)) {
+      return false;  // The format requires the same N and D for all segments.
+    }
+  }
+
+  std::ofstream out(filename, std::ios::out | std::ios::binary);
+  if (!out) {
+    return false;
+  }
+  out.write(reinterpret_cast<const char*>(&header), sizeof(header));
+  for (const Segment& segment : segments) {
+    const double time = segment.getTime();
+    out.write(reinterpret_cast<const char*>(&time), sizeof(time));
+  }
+  for (const Segment& segment : segments) {
+    for (int d = 0; d < segment.D(); ++d) {
+      out.write(
+          reinterpret_cast<const char*>(segment[d].getCoefficientsRef().data()),
+          segment.N() * sizeof(double));
+    }
+  }
+  out.close();
+  return out.good();
+}
+
+bool segmentsFromBinaryFile(const std::string& filename,
+                            Segment::Vector* segments) {
+  CHECK_NOTNULL(segments);
+  MappedTrajectory mapped_trajectory;
+  if (!mapped_trajectory.open(filename)) {
+    return false;
+  }
+  mapped_trajectory.getSegments(segments);
+  return true;
+}
+
+bool yamlToBinaryFile(const std::string& yaml_filename,
+                      const std::string& binary_filename) {
+  Segment::Vector segments;
+  if (!segmentsFromFile(yaml_filename, &segments)) {
+    return false;
+  }
+  return segmentsToBinaryFile(binary_filename, segments);
+}
+
+bool binaryToYamlFile(const std::string& binary_filename,
+                      const std::string& yaml_filename) {
+  Segment::Vector segments;
+  if (!segmentsFromBinaryFile(binary_filename, &segments)) {
+    return false;
+  }
+  return segmentsToFile(yaml_filename, segments);
+}
+
+MappedTrajectory::MappedTrajectory()
+    : data_(nullptr),
+      size_(0),
+      N_(0),
+      D_(0),
+      K_(0),
+      max_time_(0.0),
+      times_(nullptr),
+      coefficients_(nullptr) {}
+
+MappedTrajectory::~MappedTrajectory() { close(); }
+
+bool MappedTrajectory::open(const std::string& filename) {
+  close();
+
+  const int fd = ::open(filename.c_str(), O_RDONLY);
+  if (fd < 0) {
+    return false;
+  }
+  struct stat file_stat;
+  if (fstat(fd, &file_stat) != 0 ||
+      static_cast<size_t>(file_stat.st_size) <
+          sizeof(BinaryTrajectoryHeader)) {
+    ::close(fd);
+    return false;
+  }
+  const size_t size = file_stat.st_size;
+  void* data = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+  // The mapping stays valid after closing the file descriptor.
+  ::close(fd);
+  if (data == MAP_FAILED) {
+    return false;
+  }
+
+  BinaryTrajectoryHeader header;
+  std::copy(static_cast<const char*>(data),
+            static_cast<const char*>(data) + sizeof(header),
+            reinterpret_cast<char*>(&header));
+  // The sizes are checked in 64 bit before anything is multiplied, such that
+  // a crafted header can neither wrap the expected file size nor N, D or K.
+  // With N and D bounded, the doubles per segment cannot overflow.
+  const uint64_t max_doubles = (size - sizeof(header)) / sizeof(double);
+  const uint64_t doubles_per_segment =
+      1 + static_cast<uint64_t>(header.D) * header.N;
+  const bool valid_sizes =
+      header.N <= static_cast<uint32_t>(Polynomial::kMaxN) &&
+      header.D <= static_cast<uint32_t>(std::numeric_limits<int>::max()) &&
+      header.K <= static_cast<uint64_t>(std::numeric_limits<int>::max()) &&
+      (header.K == 0 || (header.N > 0 && header.D > 0)) &&
+      header.K <= max_doubles / doubles_per_segment;
+  if (header.magic != BinaryTrajectoryHeader::kMagic ||
+      header.version != BinaryTrajectoryHeader::kVersion || !valid_sizes ||
+      size - sizeof(header) !=
+          header.K * doubles_per_segment * sizeof(double)) {
+    munmap(data, size);
+    return false;
+  }
+
+  data_ = data;
+  size_ = size;
+  N_ = header.N;
+  D_ = header.D;
+  K_ = header.K;
+  times_ = reinterpret_cast<const double*>(static_cast<const char*>(data) +
+                                           sizeof(header));
+  coefficients_ = times_ + K_;
+
+  segment_start_times_.resize(K_);
+  max_time_ = 0.0;
+  for (int k = 0; k < K_; ++k) {
+    segment_start_times_[k] = max_time_;
+    max_time_ += times_[k];
+  }
+  return true;
+}
+
+void MappedTrajectory::close() {
+  if (data_ != nullptr) {
+    munmap(data_, size_);
+  }
+  data_ = nullptr;
+  size_ = 0;
+  N_ = 0;
+  D_ = 0;
+  K_ = 0;
+  max_time_ = 0.0;
+  times_ = nullptr;
+  coefficients_ = nullptr;
+  segment_start_times_.clear();
+}
+
+double MappedTrajectory::getSegmentTime(int segment_idx) const {
+  CHECK_GE(segment_idx, 0);
+  CHECK_LT(segment_idx, K_);
+  return times_[segment_idx];
+}
+
+Eigen::Map<const Eigen::VectorXd> MappedTrajectory::getCoefficients(
+    int segment_idx, int dimension) const {
+  CHECK_GE(segment_idx, 0);
+  CHECK_LT(segment_idx, K_);
+  CHECK_GE(dimension, 0);
+  CHECK_LT(dimension, D_);
+  return Eigen::Map<const Eigen::VectorXd>(
+      coefficients_ + (static_cast<size_t>(segment_idx) * D_ + dimension) * N_,
+      N_);
+}
+
+Eigen::VectorXd MappedTrajectory::evaluate(double t,
+                                           int derivative_order) const {
+  CHECK(!empty());
+  if (t < 0.0 || t > max_time_) {
+    LOG(ERROR) << "Time out of range of the trajectory!";
+    return Eigen::VectorXd::Zero(D_);
+  }
+
+  // Same convention as Trajectory::evaluate(): on a vertex, the segment right
+  // of it is chosen, except at the end of the trajectory.
+  const int segment_idx =
+      std::max<int>(std::upper_bound(segment_start_times_.begin(),
+                                     segment_start_times_.end(), t) -
+                        segment_start_times_.begin() - 1,
+                    0);
+  const double t_segment = t - segment_start_times_[segment_idx];
+
+  Eigen::VectorXd result(D_);
+  for (int d = 0; d < D_; ++d) {
+    result[d] = Polynomial::evaluateCoefficients(
+        coefficients_ + (static_cast<size_t>(segment_idx) * D_ + d) * N_, N_,
+        t_segment, derivative_order);
+  }
+  return result;
+}
+
+void MappedTrajectory::getSegments(Segment::Vector* segments) const {
+  CHECK_NOTNULL(segments);
+  segments->clear();
+  segments->reserve(K_);
+  for (int k = 0; k < K_; ++k) {
+    Segment segment(N_, D_);
+    segment.setTime(times_[k]);
+    for (int d = 0; d < D_; ++d) {
+      segment[d].setCoefficients(getCoefficients(k, d));
+    }
+    segments->push_back(segment);
+  }
+}
+
+bool MappedTrajectory::getTrajectory(Trajectory* trajectory) const {
+  CHECK_NOTNULL(trajectory);
+  if (empty()) {
+    return false;
+  }
+  Segment::Vector segments;
+  getSegments(&segments);
+  trajectory->setSegments(segments);
+  return true;
+}
+
+bool MappedTrajectory::getFlatTrajectory(FlatTrajectory* trajectory) const {
+  CHECK_NOTNULL(trajectory);
+  if (empty()) {
+    return false;
+  }
+  *trajectory = FlatTrajectory(N_, D_, K_, times_, coefficients_);
+  return true;
+}
+
+}  // namespace mav_trajectory_generation
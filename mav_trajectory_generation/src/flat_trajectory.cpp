@@ -0,0 +1,130 @@
+/*
+ * Copyright (c) 2016, Markus Achtelik, ASL, ETH Zurich, Switzerland
+ * Copyright (c) 2016, Michael Burri, ASL, ETH Zurich, Switzerland
+ * Copyright (c) 2016, Helen Oleynikova, ASL, ETH Zurich, Switzerland
+ * Copyright (c) 2016, Rik Bähnemann, ASL, ETH Zurich, Switzerland
+ * Copyright (c) 2016, Marija Popovic, ASL, ETH Zurich, Switzerland
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "mav_trajectory_generation/flat_trajectory.h"
+
+#include <algorithm>
+
+namespace mav_trajectory_generation {
+
+Eigen::VectorXd FlatTrajectory::SegmentView::evaluate(
+    double t, int derivative_order) const {
+  Eigen::VectorXd result(D_);
+  for (int d = 0; d < D_; ++d) {
+    result[d] = Polynomial::evaluateCoefficients(coefficients_ + d * N_, N_, t,
+                                                 derivative_order);
+  }
+  return result;
+}
+
+FlatTrajectory::FlatTrajectory(const Trajectory& trajectory)
+    : FlatTrajectory(trajectory.segments()) {}
+
+FlatTrajectory::FlatTrajectory(const Segment::Vector& segments)
+    : N_(0), D_(0) {
+  if (segments.empty()) {
+    return;
+  }
+  D_ = segments.front().D();
+  for (const Segment& segment : segments) {
+    CHECK_EQ(segment.D(), D_) << "All segments need the same dimension.";
+    N_ = std::max(N_, segment.N());
+  }
+
+  times_.reserve(segments.size());
+  coefficients_.assign(segments.size() * D_ * N_, 0.0);
+  double* block = coefficients_.data();
+  for (const Segment& segment : segments) {
+    times_.push_back(segment.getTime());
+    for (int d = 0; d < D_; ++d) {
+      const Eigen::VectorXd& c = segment[d].getCoefficientsRef();
+      std::copy(c.data(), c.data() + c.size(), block);
+      block += N_;
+    }
+  }
+  setSegmentStartTimes();
+}
+
+FlatTrajectory::FlatTrajectory(int N, int D, int K, const double* times,
+                               const double* coefficients)
+    : N_(N),
+      D_(D),
+      times_(times, times + K),
+      coefficients_(coefficients, coefficients + K * D * N) {
+  CHECK_GT(N_, 0);
+  CHECK_GT(D_, 0);
+  CHECK_GE(K, 0);
+  setSegmentStartTimes();
+}
+
+void FlatTrajectory::setSegmentStartTimes() {
+  segment_start_times_.resize(times_.size());
+  double t = 0.0;
+  for (size_t k = 0; k < times_.size(); ++k) {
+    segment_start_times_[k] = t;
+    t += times_[k];
+  }
+}
+
+Eigen::VectorXd FlatTrajectory::evaluate(double t,
+                                         int derivative_order) const {
+  CHECK(!empty());
+  if (t < 0.0 || t > getMaxTime()) {
+    LOG(ERROR) << "Time out of range of the trajectory!";
+    return Eigen::VectorXd::Zero(D_);
+  }
+
+  // Same convention as Trajectory::evaluate(): on a vertex, the segment right
+  // of it is chosen, except at the end of the trajectory.
+  const int segment_idx =
+      std::max<int>(std::upper_bound(segment_start_times_.begin(),
+                                     segment_start_times_.end(), t) -
+                        segment_start_times_.begin() - 1,
+                    0);
+  return getSegment(segment_idx)
+      .evaluate(t - segment_start_times_[segment_idx], derivative_order);
+}
+
+void FlatTrajectory::getSegments(Segment::Vector* segments) const {
+  CHECK_NOTNULL(segments);
+  segments->clear();
+  segments->reserve(K());
+  for (int k = 0; k < K(); ++k) {
+    const SegmentView view = getSegment(k);
+    segments->emplace_back(N_, D_);
+    segments->back().setTime(view.getTime());
+    for (int d = 0; d < D_; ++d) {
+      segments->back()[d].setCoefficients(view[d]);
+    }
+  }
+}
+
+bool FlatTrajectory::getTrajectory(Trajectory* trajectory) const {
+  CHECK_NOTNULL(trajectory);
+  if (empty()) {
+    return false;
+  }
+  Segment::Vector segments;
+  getSegments(&segments);
+  trajectory->setSegments(std::move(segments));
+  return true;
+}
+
+}  // namespace mav_trajectory_generation
@@ -0,0 +1,208 @@
+/*
+ * Copyright (c) 2016, Markus Achtelik, ASL, ETH Zurich, Switzerland
+ * Copyright (c) 2016, Michael Burri, ASL, ETH Zurich, Switzerland
+ * Copyright (c) 2016, Helen Oleynikova, ASL, ETH Zurich, Switzerland
+ * Copyright (c) 2016, Rik Bähnemann, ASL, ETH Zurich, Switzerland
+ * Copyright (c) 2016, Marija Popovic, ASL, ETH Zurich, Switzerland
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "mav_trajectory_generation/float_trajectory.h"
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+namespace mav_trajectory_generation {
+
+constexpr int FloatSegment::kNumLanes;
+
+FloatSegment::FloatSegment(const Segment& segment, int max_derivative)
+    : N_(segment.N()),
+      D_(segment.D()),
+      max_derivative_(max_derivative),
+      time_(segment.getTime()) {
+  CHECK_GE(max_derivative_, 0);
+  CHECK_LE(N_, Polynomial::kMaxConvolutionSize);
+  coefficients_.resize((max_derivative_ + 1) * N_ * D_, 0.0f);
+  error_bounds_.resize(max_derivative_ + 1, 0.0);
+
+  // Unit roundoff of float.
+  const double u = 0.5 * std::numeric_limits<float>::epsilon();
+  const double half_time = 0.5 * time_;
+  std::vector<double> shifted(N_);
+  for (int d = 0; d < D_; ++d) {
+    const Eigen::VectorXd& coeffs = segment[d].getCoefficientsRef();
+    std::copy(coeffs.data(), coeffs.data() + N_, shifted.begin());
+    Polynomial::shiftCoefficients(half_time, N_, shifted.data());
+    for (int k = 0; k <= max_derivative_; ++k) {
+      // First order bound with |tau| <= half_time: Horner's scheme of degree
+      // n rounds 2n times and the coefficients once, the rounded tau changes
+      // the value by at most u * sum_j j * |b_j| * |tau|^j.
+      double magnitude = 0.0;
+      double tau_sensitivity = 0.0;
+      double tau_power = 1.0;
+      for (int j = k; j < N_; ++j) {
+        const double b = Polynomial::base_coefficients_(k, j) * shifted[j];
+        coefficients_[(k * N_ + j) * D_ + d] = static_cast<float>(b);
+        magnitude += std::abs(b) * tau_power;
+        tau_sensitivity += (j - k) * std::abs(b) * tau_power;
+        tau_power *= half_time;
+      }
+      const int degree = std::max(N_ - 1 - k, 0);
+      // The factor covers the higher order terms.
+      const double bound =
+          1.01 * u * ((2 * degree + 1) * magnitude + tau_sensitivity);
+      error_bounds_[k] = std::max(error_bounds_[k], bound);
+    }
+  }
+}
+
+Eigen::VectorXf FloatSegment::evaluate(double t, int derivative_order) const {
+  CHECK_LE(derivative_order, max_derivative_);
+  const float tau = static_cast<float>(t - 0.5 * time_);
+  Eigen::VectorXf result(D_);
+  for (int d = 0; d < D_; ++d) {
+    float acc = 0.0f;
+    for (int j = N_ - 1; j >= derivative_order; --j) {
+      acc = acc * tau + coefficient(derivative_order, j, d);
+    }
+    result[d] = acc;
+  }
+  return result;
+}
+
+void FloatSegment::evaluate(const double* times, size_t n_times,
+                            int derivative_order, float* result) const {
+  CHECK_NOTNULL(times);
+  CHECK_NOTNULL(result);
+  CHECK_LE(derivative_order, max_derivative_);
+  typedef Eigen::Array<float, kNumLanes, 1> Lanes;
+  const double half_time = 0.5 * time_;
+
+  for (size_t first = 0; first < n_times; first += kNumLanes) {
+    const int n_lanes =
+        static_cast<int>(std::min<size_t>(kNumLanes, n_times - first));
+    // Pad the last block with the last valid time.
+    Lanes tau;
+    for (int lane = 0; lane < kNumLanes; ++lane) {
+      tau[lane] = static_cast<float>(
+          times[first + std::min(lane, n_lanes - 1)] - half_time);
+    }
+
+    for (int d = 0; d < D_; ++d) {
+      Lanes acc = Lanes::Zero();
+      for (int j = N_ - 1; j >= derivative_order; --j) {
+        acc = acc * tau + coefficient(derivative_order, j, d);
+      }
+      for (int lane = 0; lane < n_lanes; ++lane) {
+        result[(first + lane) * D_ + d] = acc[lane];
+      }
+    }
+  }
+}
+
+double FloatSegment::getErrorBound(int derivative_order) const {
+  CHECK_LE(derivative_order, max_derivative_);
+  return error_bounds_[derivative_order];
+}
+
+FloatTrajectory::FloatTrajectory(const Trajectory& trajectory,
+                                 int max_derivative)
+    : D_(trajectory.D()),
+      max_derivative_(max_derivative),
+      max_time_(trajectory.getMaxTime()) {
+  segments_.reserve(trajectory.K());
+  segment_start_times_.reserve(trajectory.K());
+  double segment_start = 0.0;
+  for (const Segment& segment : trajectory.segments()) {
+    segments_.emplace_back(segment, max_derivative_);
+    segment_start_times_.push_back(segment_start);
+    segment_start += segment.getTime();
+  }
+}
+
+int FloatTrajectory::getSegmentIndex(double t) const {
+  // In case t falls on a vertex, the segment right of the vertex is chosen.
+  const int i = std::upper_bound(segment_start_times_.begin(),
+                                 segment_start_times_.end(), t) -
+                segment_start_times_.begin() - 1;
+  return std::min(std::max(i, 0), K() - 1);
+}
+
+Eigen::VectorXf FloatTrajectory::evaluate(double t,
+                                          int derivative_order) const {
+  CHECK(!empty());
+  const int i = getSegmentIndex(t);
+  return segments_[i].evaluate(t - segment_start_times_[i], derivative_order);
+}
+
+void FloatTrajectory::evaluateRange(double t_start, double t_end, double dt,
+                                    int derivative_order,
+                                    std::vector<Eigen::VectorXf>* result,
+                                    std::vector<double>* sampling_times) const {
+  CHECK_NOTNULL(result);
+  CHECK_GT(dt, 0.0);
+  if (empty() || t_start > max_time_) {
+    LOG(ERROR) << "Start time out of range of the trajectory!";
+    result->clear();
+    if (sampling_times != nullptr) {
+      sampling_times->clear();
+    }
+    return;
+  }
+
+  std::vector<double> times;
+  for (double t = t_start; t < t_end && t <= max_time_; t += dt) {
+    times.push_back(t);
+  }
+  if (sampling_times != nullptr) {
+    *sampling_times = times;
+  }
+
+  // Relative times of the consecutive samples of each segment, evaluated in
+  // one call per segment.
+  std::vector<float> values(times.size() * D_);
+  size_t first = 0;
+  while (first < times.size()) {
+    const int i = getSegmentIndex(times[first]);
+    const double segment_end =
+        i + 1 < K() ? segment_start_times_[i + 1]
+                    : std::numeric_limits<double>::infinity();
+    size_t last = first;
+    while (last < times.size() && times[last] < segment_end) {
+      times[last] -= segment_start_times_[i];
+      ++last;
+    }
+    segments_[i].evaluate(&times[first], last - first, derivative_order,
+                          &values[first * D_]);
+    first = last;
+  }
+
+  result->resize(times.size());
+  for (size_t sample = 0; sample < times.size(); ++sample) {
+    (*result)[sample] =
+        Eigen::Map<const Eigen::VectorXf>(&values[sample * D_], D_);
+  }
+}
+
+double FloatTrajectory::getErrorBound(int derivative_order) const {
+  double bound = 0.0;
+  for (const FloatSegment& segment : segments_) {
+    bound = std::max(bound, segment.getErrorBound(derivative_order));
+  }
+  return bound;
+}
+
+}  // namespace mav_trajectory_generation
@@ -19,10 +19,11 @@
  */
 
 #include "mav_trajectory_generation/io.h"
-#include "mav_trajectory_generation/trajectory_sampling.h"
 
 #include <yaml-cpp/yaml.h>
+#include <algorithm>
 #include <fstream>
+#include <vector>
 
 const std::string kSegments = "segments";
 const std::string kNumCoefficients = "N";
@@ -125,52 +126,176 @@ bool segmentsFromFile(const std::string& filename,
   return true;
 }
 
-bool sampledTrajectoryStatesToFile(const std::string& filename,
-                                   const Trajectory& trajectory) {
+namespace {
 
-  // Print to file for matlab
-  const double sampling_time = 0.01;
-  mav_msgs::EigenTrajectoryPoint::Vector flat_states;
-  bool success = sampleWholeTrajectory(trajectory, sampling_time,
-                                       &flat_states);
-
-  // Layout: [t, x, y, z, vx, vy, vz, jx, jy, jz, sx, sy, sz, tm]
-  const unsigned int dim = trajectory.D();
-  Eigen::MatrixXd output(flat_states.size(), 5*dim + 2);
-  output.setZero();
-  for (int i = 0; i < flat_states.size(); ++i) {
-    const mav_msgs::EigenTrajectoryPoint state = flat_states[i];
-
-    if (trajectory.D() > 3) {
-      double yaw = state.getYaw();
-      double yaw_rate = state.getYawRate();
-      double yaw_acc = state.getYawAcc();
+// Buffer of the file streams of the sampled states.
+constexpr size_t kFileBufferSize = 1 << 16;
+
+// Writes the sampled states, see sampledTrajectoryStatesToStream(). The
+// Matlab layout has the time in nanoseconds and the segment end times as
+// last column.
+bool writeSampledStates(const Trajectory& trajectory, double sampling_interval,
+                        int max_derivative, SampledStatesFormat format,
+                        size_t chunk_size, bool matlab_layout,
+                        std::ostream* out) {
+  CHECK_NOTNULL(out);
+  CHECK_GT(chunk_size, 0u);
+  if (trajectory.empty() || sampling_interval <= 0.0 || max_derivative < 0) {
+    return false;
+  }
+
+  const Segment::Vector& segments = trajectory.segments();
+  const int D = trajectory.D();
+  const int n_derivatives = max_derivative + 1;
+  const int n_values = D * n_derivatives;
+  const double max_time = trajectory.getMaxTime();
+  const size_t n_samples =
+      static_cast<size_t>(max_time / sampling_interval) + 1;
+  const char separator = format == SampledStatesFormat::kCsv ? ',' : ' ';
+
+  if (format == SampledStatesFormat::kBinary) {
+    SampledStatesHeader header;
+    header.magic = SampledStatesHeader::kMagic;
+    header.version = SampledStatesHeader::kVersion;
+    header.sample_size = 1 + n_values + (matlab_layout ? 1 : 0);
+    header.D = D;
+    header.max_derivative = max_derivative;
+    header.reserved = 0;
+    header.n_samples = n_samples;
+    header.sampling_interval = sampling_interval;
+    out->write(reinterpret_cast<const char*>(&header), sizeof(header));
+  } else {
+    out->precision(17);
+    if (format == SampledStatesFormat::kCsv) {
+      *out << (matlab_layout ? "t_ns" : "t");
+      for (int derivative = 0; derivative < n_derivatives; ++derivative) {
+        for (int d = 0; d < D; ++d) {
+          *out << separator << 'd' << derivative << '_' << d;
+        }
+      }
+      if (matlab_layout) {
+        *out << separator << "segment_end_time";
+      }
+      *out << '\n';
     }
+  }
 
-    if (i < output.rows()) {
-      output(i, 0) = state.time_from_start_ns;
-      output.row(i).segment(1, dim) = state.position_W;
-      output.row(i).segment(1+dim, dim) = state.velocity_W;
-      output.row(i).segment(1+2*dim, dim) = state.acceleration_W;
-      output.row(i).segment(1+3*dim, dim) = state.jerk_W;
-      output.row(i).segment(1+4*dim, dim) = state.snap_W;
+  // Evaluate chunk_size samples at a time into a reused buffer, walking
+  // forward through the segments.
+  Eigen::MatrixXd values(n_values, chunk_size);
+  std::vector<double> times(chunk_size);
+  size_t segment_idx = 0;
+  double segment_start = 0.0;
+  double segment_end_time = 0.0;
+  for (size_t chunk_start = 0; chunk_start < n_samples;
+       chunk_start += chunk_size) {
+    const size_t n_chunk = std::min(chunk_size, n_samples - chunk_start);
+    for (size_t i = 0; i < n_chunk; ++i) {
+      const double t =
+          std::min((chunk_start + i) * sampling_interval, max_time);
+      // In case t falls on a vertex, the segment right of the vertex is
+      // chosen.
+      while (segment_idx + 1 < segments.size() &&
+             t >= segment_start + segments[segment_idx].getTime()) {
+        segment_start += segments[segment_idx].getTime();
+        ++segment_idx;
+      }
+      Eigen::Map<Eigen::MatrixXd> state(values.col(i).data(), D,
+                                        n_derivatives);
+      segments[segment_idx].evaluateDerivatives(t - segment_start,
+                                                max_derivative, state);
+      times[i] = t;
+    }
+
+    for (size_t i = 0; i < n_chunk; ++i) {
+      const size_t sample = chunk_start + i;
+      double time = times[i];
+      if (matlab_layout) {
+        time = static_cast<double>(static_cast<uint64_t>(
+            times[i] * kNumNSecPerSec));
+        segment_end_time = sample < segments.size()
+                               ? segment_end_time + segments[sample].getTime()
+                               : 0.0;
+      }
+      if (format == SampledStatesFormat::kBinary) {
+        out->write(reinterpret_cast<const char*>(&time), sizeof(time));
+        out->write(reinterpret_cast<const char*>(values.col(i).data()),
+                   n_values * sizeof(double));
+        if (matlab_layout) {
+          out->write(reinterpret_cast<const char*>(&segment_end_time),
+                     sizeof(segment_end_time));
+        }
+        continue;
+      }
+      *out << time;
+      for (int j = 0; j < n_values; ++j) {
+        *out << separator << values(j, i);
+      }
+      if (matlab_layout) {
+        *out << separator << segment_end_time;
+      }
+      *out << '\n';
+    }
+    if (!out->good()) {
+      return false;
     }
   }
+  return true;
+}
 
-  // Set the segment times
-  mav_trajectory_generation::Segment::Vector segments;
-  trajectory.getSegments(&segments);
-  double current_segment_time = 0.0;
-  for (int j = 0; j < segments.size(); ++j) {
-    double segment_time = segments[j].getTime();
-    current_segment_time += segment_time;
-    output(j, 1+5*dim) = current_segment_time;
+bool writeSampledStatesToFile(const std::string& filename,
+                              const Trajectory& trajectory,
+                              double sampling_interval, int max_derivative,
+                              SampledStatesFormat format, bool matlab_layout) {
+  std::vector<char> buffer(kFileBufferSize);
+  std::ofstream out;
+  out.rdbuf()->pubsetbuf(buffer.data(), buffer.size());
+  const std::ios::openmode mode =
+      format == SampledStatesFormat::kBinary
+          ? std::ios::out | std::ios::binary
+          : std::ios::out;
+  out.open(filename, mode);
+  if (!out) {
+    return false;
   }
+  const bool success =
+      writeSampledStates(trajectory, sampling_interval, max_derivative,
+                         format, kSampledStatesChunkSize, matlab_layout,
+                         &out);
+  out.close();
+  return success && out.good();
+}
+
+}  // namespace
 
-  std::fstream fs;
-  fs.open(filename, std::fstream::out);
-  fs << output;
-  fs.close();
+constexpr uint32_t SampledStatesHeader::kMagic;
+constexpr uint32_t SampledStatesHeader::kVersion;
+
+bool sampledTrajectoryStatesToStream(const Trajectory& trajectory,
+                                     double sampling_interval,
+                                     int max_derivative,
+                                     SampledStatesFormat format,
+                                     std::ostream* out, size_t chunk_size) {
+  return writeSampledStates(trajectory, sampling_interval, max_derivative,
+                            format, chunk_size, false, out);
+}
+
+bool sampledTrajectoryStatesToFile(const std::string& filename,
+                                   const Trajectory& trajectory,
+                                   double sampling_interval,
+                                   int max_derivative,
+                                   SampledStatesFormat format) {
+  return writeSampledStatesToFile(filename, trajectory, sampling_interval,
+                                  max_derivative, format, false);
+}
+
+bool sampledTrajectoryStatesToFile(const std::string& filename,
+                                   const Trajectory& trajectory) {
+  // Print to file for matlab.
+  const double sampling_time = 0.01;
+  return writeSampledStatesToFile(filename, trajectory, sampling_time,
+                                  derivative_order::SNAP,
+                                  SampledStatesFormat::kText, true);
 }
 
 }  // namespace mav_trajectory_generation
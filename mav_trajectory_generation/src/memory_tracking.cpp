@@ -0,0 +1,265 @@
+/*
+ * Copyright (c) 2016, Markus Achtelik, ASL, ETH Zurich, Switzerland
+ * Copyright (c) 2016, Michael Burri, ASL, ETH Zurich, Switzerland
+ * Copyright (c) 2016, Helen Oleynikova, ASL, ETH Zurich, Switzerland
+ * Copyright (c) 2016, Rik Bähnemann, ASL, ETH Zurich, Switzerland
+ * Copyright (c) 2016, Marija Popovic, ASL, ETH Zurich, Switzerland
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "mav_trajectory_generation/memory_tracking.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cstdlib>
+
+#ifdef MAV_TRAJECTORY_GENERATION_TRACK_ALLOCATIONS
+#include <errno.h>
+#include <malloc.h>
+
+// The allocator of glibc, called by the replacements below.
+extern "C" {
+void* __libc_malloc(size_t size);
+void* __libc_calloc(size_t count, size_t size);
+void* __libc_realloc(void* pointer, size_t size);
+void* __libc_memalign(size_t alignment, size_t size);
+void* __libc_valloc(size_t size);
+void* __libc_pvalloc(size_t size);
+void __libc_free(void* pointer);
+}
+
+// Initial-exec, so that accessing the counters inside malloc never allocates.
+#define MAV_TRAJECTORY_GENERATION_ALLOCATION_TLS \
+  static __thread __attribute__((tls_model("initial-exec")))
+#else
+#define MAV_TRAJECTORY_GENERATION_ALLOCATION_TLS static thread_local
+#endif
+
+namespace mav_trajectory_generation {
+namespace memory_tracking {
+namespace {
+
+std::atomic<size_t> g_num_allocations(0);
+std::atomic<size_t> g_allocated_bytes(0);
+std::atomic<int64_t> g_current_bytes(0);
+std::atomic<int64_t> g_peak_bytes(0);
+
+// Counters of the calling thread for AllocationScope. The current bytes can
+// become negative if the thread frees memory of other threads.
+MAV_TRAJECTORY_GENERATION_ALLOCATION_TLS size_t t_num_allocations = 0;
+MAV_TRAJECTORY_GENERATION_ALLOCATION_TLS int64_t t_current_bytes = 0;
+MAV_TRAJECTORY_GENERATION_ALLOCATION_TLS int64_t t_peak_bytes = 0;
+
+#ifdef MAV_TRAJECTORY_GENERATION_TRACK_ALLOCATIONS
+// Counts the usable size, which is also known when the block is freed.
+inline void addAllocation(void* pointer) {
+  if (pointer == nullptr) {
+    return;
+  }
+  const int64_t size = malloc_usable_size(pointer);
+  ++t_num_allocations;
+  t_current_bytes += size;
+  t_peak_bytes = std::max(t_peak_bytes, t_current_bytes);
+
+  g_num_allocations.fetch_add(1, std::memory_order_relaxed);
+  g_allocated_bytes.fetch_add(size, std::memory_order_relaxed);
+  const int64_t current =
+      g_current_bytes.fetch_add(size, std::memory_order_relaxed) + size;
+  int64_t peak = g_peak_bytes.load(std::memory_order_relaxed);
+  while (current > peak &&
+         !g_peak_bytes.compare_exchange_weak(peak, current,
+                                             std::memory_order_relaxed)) {
+  }
+}
+
+inline void removeBytes(int64_t size) {
+  t_current_bytes -= size;
+  g_current_bytes.fetch_sub(size, std::memory_order_relaxed);
+}
+
+bool probeReplacement() {
+  const size_t num_allocations = t_num_allocations;
+  // Volatile, so that the compiler cannot elide the allocation.
+  void* volatile pointer = std::malloc(1);
+  std::free(pointer);
+  return t_num_allocations != num_allocations;
+}
+#endif
+
+}  // namespace
+
+bool isEnabled() {
+#ifdef MAV_TRAJECTORY_GENERATION_TRACK_ALLOCATIONS
+  static const bool enabled = probeReplacement();
+  return enabled;
+#else
+  return false;
+#endif
+}
+
+AllocationStatistics getAllocationStatistics() {
+  AllocationStatistics statistics;
+  statistics.num_allocations =
+      g_num_allocations.load(std::memory_order_relaxed);
+  statistics.allocated_bytes =
+      g_allocated_bytes.load(std::memory_order_relaxed);
+  statistics.current_bytes = std::max<int64_t>(
+      g_current_bytes.load(std::memory_order_relaxed), 0);
+  statistics.peak_bytes =
+      std::max<int64_t>(g_peak_bytes.load(std::memory_order_relaxed), 0);
+  return statistics;
+}
+
+void resetPeakBytes() {
+  g_peak_bytes.store(g_current_bytes.load(std::memory_order_relaxed),
+                     std::memory_order_relaxed);
+}
+
+AllocationScope::AllocationScope(bool construct_stopped)
+    : running_(false),
+      start_allocations_(0),
+      start_bytes_(0),
+      outer_peak_bytes_(0),
+      num_allocations_(0),
+      peak_bytes_(0) {
+  if (!construct_stopped) start();
+}
+
+AllocationScope::~AllocationScope() {
+  if (running_) stop();
+}
+
+void AllocationScope::start() {
+  if (running_) stop();
+  start_allocations_ = t_num_allocations;
+  start_bytes_ = t_current_bytes;
+  outer_peak_bytes_ = t_peak_bytes;
+  t_peak_bytes = t_current_bytes;
+  running_ = true;
+}
+
+void AllocationScope::stop() {
+  if (!running_) {
+    return;
+  }
+  num_allocations_ = getNumAllocations();
+  peak_bytes_ = getPeakBytes();
+  t_peak_bytes = std::max(outer_peak_bytes_, t_peak_bytes);
+  running_ = false;
+}
+
+size_t AllocationScope::getNumAllocations() const {
+  if (!running_) {
+    return num_allocations_;
+  }
+  return t_num_allocations - start_allocations_;
+}
+
+size_t AllocationScope::getPeakBytes() const {
+  if (!running_) {
+    return peak_bytes_;
+  }
+  return std::max<int64_t>(t_peak_bytes - start_bytes_, 0);
+}
+
+}  // namespace memory_tracking
+}  // namespace mav_trajectory_generation
+
+#ifdef MAV_TRAJECTORY_GENERATION_TRACK_ALLOCATIONS
+// Replacements of the glibc allocation functions, which glibc supports for
+// all of them. Every call of the process, including those from within the C
+// and C++ libraries, ends up here. Each function that allocates is replaced,
+// since glibc would otherwise serve it from its own allocator unseen.
+namespace mtg_memory = mav_trajectory_generation::memory_tracking;
+
+extern "C" {
+
+void* malloc(size_t size) noexcept {
+  void* pointer = __libc_malloc(size);
+  mtg_memory::addAllocation(pointer);
+  return pointer;
+}
+
+void* calloc(size_t count, size_t size) noexcept {
+  void* pointer = __libc_calloc(count, size);
+  mtg_memory::addAllocation(pointer);
+  return pointer;
+}
+
+void* realloc(void* pointer, size_t size) noexcept {
+  const size_t old_size = pointer == nullptr ? 0 : malloc_usable_size(pointer);
+  void* result = __libc_realloc(pointer, size);
+  if (result == nullptr && size != 0) {
+    // Failed, the old block is still allocated.
+    return result;
+  }
+  mtg_memory::removeBytes(old_size);
+  mtg_memory::addAllocation(result);
+  return result;
+}
+
+void* reallocarray(void* pointer, size_t count, size_t size) noexcept {
+  size_t bytes;
+  if (__builtin_mul_overflow(count, size, &bytes)) {
+    errno = ENOMEM;
+    return nullptr;
+  }
+  return realloc(pointer, bytes);
+}
+
+void free(void* pointer) noexcept {
+  if (pointer == nullptr) {
+    return;
+  }
+  mtg_memory::removeBytes(malloc_usable_size(pointer));
+  __libc_free(pointer);
+}
+
+void* memalign(size_t alignment, size_t size) noexcept {
+  void* pointer = __libc_memalign(alignment, size);
+  mtg_memory::addAllocation(pointer);
+  return pointer;
+}
+
+void* aligned_alloc(size_t alignment, size_t size) noexcept {
+  return memalign(alignment, size);
+}
+
+int posix_memalign(void** pointer, size_t alignment, size_t size) noexcept {
+  if (alignment % sizeof(void*) != 0 ||
+      (alignment & (alignment - 1)) != 0) {
+    return EINVAL;
+  }
+  void* result = memalign(alignment, size);
+  if (result == nullptr) {
+    return ENOMEM;
+  }
+  *pointer = result;
+  return 0;
+}
+
+void* valloc(size_t size) noexcept {
+  void* pointer = __libc_valloc(size);
+  mtg_memory::addAllocation(pointer);
+  return pointer;
+}
+
+void* pvalloc(size_t size) noexcept {
+  void* pointer = __libc_pvalloc(size);
+  mtg_memory::addAllocation(pointer);
+  return pointer;
+}
+
+}  // extern "C"
+#endif
@@ -0,0 +1,113 @@
+/*
+ * Copyright (c) 2016, Markus Achtelik, ASL, ETH Zurich, Switzerland
+ * Copyright (c) 2016, Michael Burri, ASL, ETH Zurich, Switzerland
+ * Copyright (c) 2016, Helen Oleynikova, ASL, ETH Zurich, Switzerland
+ * Copyright (c) 2016, Rik Bähnemann, ASL, ETH Zurich, Switzerland
+ * Copyright (c) 2016, Marija Popovic, ASL, ETH Zurich, Switzerland
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "mav_trajectory_generation/optimization_trace.h"
+
+#include <glog/logging.h>
+#include <algorithm>
+#include <fstream>
+
+namespace mav_trajectory_generation {
+
+namespace internal {
+namespace {
+thread_local size_t num_root_finding_calls = 0;
+}  // namespace
+
+size_t getNumRootFindingCalls() { return num_root_finding_calls; }
+
+void countRootFindingCall() { num_root_finding_calls++; }
+
+}  // namespace internal
+
+void OptimizationTrace::reset(size_t capacity, size_t n_segments) {
+  n_segments_ = n_segments;
+  n_recorded_ = 0;
+  entries_.assign(capacity, OptimizationTraceEntry());
+  segment_times_.assign(capacity * n_segments, 0.0);
+}
+
+size_t OptimizationTrace::size() const {
+  return std::min(n_recorded_, entries_.size());
+}
+
+void OptimizationTrace::add(const OptimizationTraceEntry& entry,
+                            const std::vector<double>& segment_times) {
+  if (!enabled()) {
+    return;
+  }
+  CHECK_EQ(segment_times.size(), n_segments_);
+  const size_t index = n_recorded_ % entries_.size();
+  entries_[index] = entry;
+  std::copy(segment_times.begin(), segment_times.end(),
+            segment_times_.begin() + index * n_segments_);
+  n_recorded_++;
+}
+
+size_t OptimizationTrace::getIndex(size_t i) const {
+  CHECK_LT(i, size());
+  const size_t oldest =
+      n_recorded_ > entries_.size() ? n_recorded_ % entries_.size() : 0;
+  return (oldest + i) % entries_.size();
+}
+
+const OptimizationTraceEntry& OptimizationTrace::getEntry(size_t i) const {
+  return entries_[getIndex(i)];
+}
+
+const double* OptimizationTrace::getSegmentTimes(size_t i) const {
+  return segment_times_.data() + getIndex(i) * n_segments_;
+}
+
+void OptimizationTrace::writeCsv(std::ostream* stream) const {
+  CHECK_NOTNULL(stream);
+  *stream << "iteration,cost_trajectory,cost_time,cost_soft_constraints,"
+             "total_time,time_linear_solve,time_gradient,time_constraints,"
+             "n_root_finding_calls";
+  for (size_t k = 0; k < n_segments_; ++k) {
+    *stream << ",t_" << k;
+  }
+  *stream << "\n";
+  for (size_t i = 0; i < size(); ++i) {
+    const OptimizationTraceEntry& entry = getEntry(i);
+    *stream << entry.iteration << "," << entry.cost_trajectory << ","
+            << entry.cost_time << "," << entry.cost_soft_constraints << ","
+            << entry.total_time << "," << entry.time_linear_solve << ","
+            << entry.time_gradient << "," << entry.time_constraints << ","
+            << entry.n_root_finding_calls;
+    const double* segment_times = getSegmentTimes(i);
+    for (size_t k = 0; k < n_segments_; ++k) {
+      *stream << "," << segment_times[k];
+    }
+    *stream << "\n";
+  }
+}
+
+bool OptimizationTrace::writeCsvFile(const std::string& filename) const {
+  std::ofstream file(filename);
+  if (!file.is_open()) {
+    LOG(ERROR) << "Unable to open " << filename << ".";
+    return false;
+  }
+  writeCsv(&file);
+  return file.good();
+}
+
+}  // namespace mav_trajectory_generation
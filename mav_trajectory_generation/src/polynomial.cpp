@@ -22,12 +22,14 @@
 #include <algorithm>
 #include <limits>
 
+#include "mav_trajectory_generation/optimization_trace.h"
+
 namespace mav_trajectory_generation {
 
 bool Polynomial::selectMinMaxCandidatesFromRoots(
     double t_start, double t_end,
     const Eigen::VectorXcd& roots_derivative_of_derivative,
-    std::vector<double>* candidates) const {
+    std::vector<double>* candidates) {
   CHECK_NOTNULL(candidates);
   if (t_start > t_end) {
     LOG(WARNING) << "t_start is greater than t_end.";
@@ -57,23 +59,84 @@ bool Polynomial::selectMinMaxCandidatesFromRoots(
 
 bool Polynomial::computeMinMaxCandidates(
     double t_start, double t_end, int derivative,
-    std::vector<double>* candidates) const {
+    std::vector<double>* candidates, RootFindingMethod method) const {
   CHECK_NOTNULL(candidates);
   candidates->clear();
   if (N_ - derivative - 1 < 0) {
     LOG(WARNING) << "N - derivative - 1 has to be at least 0.";
     return false;
   }
+  if (derivative == -1) {
+    return computeMinMaxCandidatesFromDerivative(coefficients_, t_start, t_end,
+                                                 candidates, method);
+  }
+  if (N_ > kMaxConvolutionSize) {
+    return computeMinMaxCandidatesFromDerivative(
+        getCoefficients(derivative + 1), t_start, t_end, candidates, method);
+  }
+  // Same as getCoefficients(derivative + 1), without allocating.
+  const int n_derivative = N_ - derivative - 1;
+  ConvolutionCoefficients derivative_coefficients;
+  derivative_coefficients.setZero(N_);
+  derivative_coefficients.head(n_derivative) =
+      coefficients_.tail(n_derivative)
+          .cwiseProduct(base_coefficients_
+                            .block(derivative + 1, derivative + 1, 1,
+                                   n_derivative)
+                            .transpose());
+  return computeMinMaxCandidatesFromDerivative(
+      derivative_coefficients, t_start, t_end, candidates, method);
+}
+
+bool Polynomial::computeMinMaxCandidatesFromDerivative(
+    const Eigen::Ref<const Eigen::VectorXd>& derivative_coefficients,
+    double t_start, double t_end, std::vector<double>* candidates,
+    RootFindingMethod method) {
+  internal::countRootFindingCall();
+  CHECK_NOTNULL(candidates);
+  candidates->clear();
+  if (method == kRealIntervalRoots) {
+    if (t_start > t_end) {
+      LOG(WARNING) << "t_start is greater than t_end.";
+      return false;
+    }
+    candidates->reserve(derivative_coefficients.size() + 2);
+    candidates->push_back(t_start);
+    candidates->push_back(t_end);
+    return findRealRootsInInterval(derivative_coefficients, t_start, t_end,
+                                   candidates);
+  }
   Eigen::VectorXcd roots_derivative_of_derivative;
-  if (!findRootsJenkinsTraub(getCoefficients(derivative + 1),
+  if (!findRootsJenkinsTraub(derivative_coefficients,
                              &roots_derivative_of_derivative)) {
     return false;
-  } else {
-    if (!selectMinMaxCandidatesFromRoots(
-            t_start, t_end, roots_derivative_of_derivative, candidates)) {
-      return false;
-    } else {
-      return true;
+  }
+  return selectMinMaxCandidatesFromRoots(
+      t_start, t_end, roots_derivative_of_derivative, candidates);
+}
+
+void Polynomial::addMagnitudeDerivativeCoefficients(
+    int derivative, Eigen::Ref<Eigen::VectorXd> result) const {
+  CHECK_GE(derivative, 0);
+  CHECK_LE(N_, kMaxN);
+  const int n_d = N_ - derivative;
+  const int n_dd = n_d - 1;
+  CHECK_GE(n_dd, 1) << "N - derivative - 1 has to be at least 1.";
+  CHECK_EQ(result.size(), getConvolutionLength(n_d, n_dd));
+
+  double d[kMaxN];
+  double dd[kMaxN];
+  for (int i = 0; i < n_d; ++i) {
+    d[i] = base_coefficients_(derivative, i + derivative) *
+           coefficients_[i + derivative];
+  }
+  for (int i = 0; i < n_dd; ++i) {
+    dd[i] = base_coefficients_(derivative + 1, i + derivative + 1) *
+            coefficients_[i + derivative + 1];
+  }
+  for (int i = 0; i < n_d; ++i) {
+    for (int j = 0; j < n_dd; ++j) {
+      result[i + j] += d[i] * dd[j];
     }
   }
 }
@@ -109,6 +172,55 @@ bool Polynomial::computeMinMax(double t_start, double t_end, int derivative,
   return selectMinMaxFromCandidates(candidates, derivative, minimum, maximum);
 }
 
+void Polynomial::computeBernsteinBounds(double t_start, double t_end,
+                                        int derivative, double* minimum,
+                                        double* maximum) const {
+  CHECK_NOTNULL(minimum);
+  CHECK_NOTNULL(maximum);
+  CHECK_GE(derivative, 0);
+  CHECK_LE(N_, kMaxN);
+  // Degree of the derivative.
+  const int m = N_ - 1 - derivative;
+  if (m < 0) {
+    *minimum = 0.0;
+    *maximum = 0.0;
+    return;
+  }
+
+  // Coefficients of the derivative in u = (t - t_start) / (t_end - t_start),
+  // i.e., the Taylor expansion around t_start.
+  const double h = t_end - t_start;
+  double monomial[kMaxN];
+  double h_power = 1.0;
+  double factorial = 1.0;
+  for (int k = 0; k <= m; ++k) {
+    if (k > 0) {
+      h_power *= h;
+      factorial *= k;
+    }
+    monomial[k] = evaluate(t_start, derivative + k) * h_power / factorial;
+  }
+
+  // Bernstein coefficient i = sum_k binomial(i, k) / binomial(m, k) * a_k.
+  double binomial_m[kMaxN];
+  binomial_m[0] = 1.0;
+  for (int k = 1; k <= m; ++k) {
+    binomial_m[k] = binomial_m[k - 1] * (m - k + 1) / k;
+  }
+  *minimum = monomial[0];
+  *maximum = monomial[0];
+  for (int i = 1; i <= m; ++i) {
+    double bernstein = 0.0;
+    double binomial_i = 1.0;
+    for (int k = 0; k <= i; ++k) {
+      bernstein += binomial_i / binomial_m[k] * monomial[k];
+      binomial_i = binomial_i * (i - k) / (k + 1);
+    }
+    *minimum = std::min(*minimum, bernstein);
+    *maximum = std::max(*maximum, bernstein);
+  }
+}
+
 bool Polynomial::selectMinMaxFromCandidates(
     const std::vector<double>& candidates, int derivative,
     std::pair<double, double>* minimum,
@@ -18,18 +18,89 @@
  * limitations under the License.
  */
 
+// Benchmark harness for the optimization, sampling and IO. Every result is
+// written as one CSV row or JSON object, such that runs can be compared, e.g.,
+// to detect performance regressions.
+// Usage: polynomial_timing_evaluation [--format=csv|json] [--output=file]
+//        [--filter=substring] [--max_segments=10000] [--repetitions=100]
+//        [--nonlinear_max_segments=100]
+
+#include <sys/resource.h>
+#include <algorithm>
 #include <chrono>
+#include <cstdio>
+#include <fstream>
 #include <iostream>
 #include <limits>
 #include <random>
+#include <string>
+#include <vector>
 
+#include <mav_trajectory_generation/binary_io.h>
+#include <mav_trajectory_generation/io.h>
 #include <mav_trajectory_generation/polynomial_optimization_linear.h>
-#include <mav_trajectory_generation/timing.h>
+#include <mav_trajectory_generation/polynomial_optimization_nonlinear.h>
+#include <mav_trajectory_generation/polynomial_optimization_windowed.h>
+
+namespace {
+
+struct Options {
+  Options()
+      : format("csv"),
+        max_segments(10000),
+        nonlinear_max_segments(100),
+        repetitions(100) {}
+  std::string format;
+  std::string output;
+  std::string filter;
+  int max_segments;
+  int nonlinear_max_segments;
+  int repetitions;
+};
+
+struct BenchmarkResult {
+  std::string name;
+  int N;
+  int D;
+  int K;
+  int repetitions;
+  double median_us;
+  double p99_us;
+  // Mean solver iterations, 0 for benchmarks without iterations.
+  double iterations;
+  // High-water mark of the resident memory of the process after the
+  // benchmark. Benchmarks run with increasing K, use --filter to measure a
+  // single benchmark in isolation.
+  long max_rss_kb;
+};
+
+typedef std::chrono::steady_clock Clock;
+
+class Latencies {
+ public:
+  void add(const Clock::time_point& start) {
+    durations_us_.push_back(
+        std::chrono::duration<double, std::micro>(Clock::now() - start)
+            .count());
+  }
+  double percentile(double p) {
+    CHECK(!durations_us_.empty());
+    std::sort(durations_us_.begin(), durations_us_.end());
+    const size_t index = std::min(
+        durations_us_.size() - 1,
+        static_cast<size_t>(p * (durations_us_.size() - 1) + 0.5));
+    return durations_us_[index];
+  }
+
+ private:
+  std::vector<double> durations_us_;
+};
 
-const int N = 10;
-const int max_derivative = mav_trajectory_generation::derivative_order::SNAP;
-const size_t derivative_to_optimize =
-    mav_trajectory_generation::derivative_order::SNAP;
+long getMaxRssKb() {
+  struct rusage usage;
+  getrusage(RUSAGE_SELF, &usage);
+  return usage.ru_maxrss;
+}
 
 mav_trajectory_generation::Vertex::Vector createRandomVerticesPath(
     int dimension, size_t n_segments, double average_distance,
@@ -90,39 +161,261 @@ mav_trajectory_generation::Vertex::Vector createRandomVerticesPath(
   return vertices;
 }
 
-bool timeEval(int n_segments, double average_distance, size_t seed) {
-  mav_trajectory_generation::Vertex::Vector vertices;
-  vertices = createRandomVerticesPath(3, n_segments, average_distance,
-                                      max_derivative, seed);
-
-  const double approximate_v_max = 2.0;
-  const double approximate_a_max = 2.0;
-  const double magic_fabian_constant = 6.5;
-  std::vector<double> segment_times = estimateSegmentTimes(
-      vertices, approximate_v_max, approximate_a_max, magic_fabian_constant);
-
-  mav_trajectory_generation::timing::Timer timer_solve(
-      "polynomial_optimization_template_" + std::to_string(n_segments));
-  mav_trajectory_generation::PolynomialOptimization<N> opt(3);
-  opt.setupFromVertices(vertices, segment_times, derivative_to_optimize);
-
-  opt.solveLinear();
-  timer_solve.Stop();
-  return true;
+class Benchmark {
+ public:
+  Benchmark(const Options& options, std::vector<BenchmarkResult>* results)
+      : options_(options), results_(CHECK_NOTNULL(results)) {}
+
+  // Returns false if the benchmark is filtered out.
+  bool enabled(const std::string& name) const {
+    return options_.filter.empty() ||
+           name.find(options_.filter) != std::string::npos;
+  }
+
+  // Long trajectories are evaluated less often.
+  int getRepetitions(int n_segments) const {
+    return n_segments <= 100
+               ? options_.repetitions
+               : std::max(3, options_.repetitions * 100 / n_segments);
+  }
+
+  // Runs function(repetition, &iterations) and records its latency.
+  template <typename Function>
+  void run(const std::string& name, int N, int D, int K, Function function) {
+    if (!enabled(name)) {
+      return;
+    }
+    const int repetitions = getRepetitions(K);
+    Latencies latencies;
+    double iterations = 0.0;
+    for (int i = 0; i < repetitions; ++i) {
+      int n_iterations = 0;
+      const Clock::time_point start = Clock::now();
+      function(i, &n_iterations);
+      latencies.add(start);
+      iterations += n_iterations;
+    }
+    BenchmarkResult result;
+    result.name = name;
+    result.N = N;
+    result.D = D;
+    result.K = K;
+    result.repetitions = repetitions;
+    result.median_us = latencies.percentile(0.5);
+    result.p99_us = latencies.percentile(0.99);
+    result.iterations = iterations / repetitions;
+    result.max_rss_kb = getMaxRssKb();
+    results_->push_back(result);
+    std::cerr << name << " N=" << N << " D=" << D << " K=" << K
+              << " median=" << result.median_us << "us" << std::endl;
+  }
+
+  const Options& options() const { return options_; }
+
+ private:
+  const Options& options_;
+  std::vector<BenchmarkResult>* results_;
+};
+
+template <int _N>
+void benchmarkOrder(Benchmark* benchmark) {
+  using namespace mav_trajectory_generation;
+  // Highest derivative that can be optimized with _N coefficients.
+  const int derivative_to_optimize =
+      std::min<int>(derivative_order::SNAP, _N / 2 - 1);
+  const double kAverageDistance = 5.0;
+  const double kVMax = 2.0;
+  const double kAMax = 2.0;
+  const int kDimensions[] = {1, 3, 4};
+  const int kSegments[] = {2, 10, 100, 1000, 10000};
+  const std::string kFilename = "polynomial_timing_evaluation_tmp";
+
+  for (int D : kDimensions) {
+    for (int K : kSegments) {
+      if (K > benchmark->options().max_segments) {
+        continue;
+      }
+      // One random problem per repetition.
+      auto createVertices = [&](int repetition) {
+        return createRandomVerticesPath(D, K, kAverageDistance,
+                                        derivative_to_optimize, repetition);
+      };
+
+      benchmark->run("linear", _N, D, K, [&](int repetition, int*) {
+        const Vertex::Vector vertices = createVertices(repetition);
+        const std::vector<double> segment_times =
+            estimateSegmentTimes(vertices, kVMax, kAMax);
+        PolynomialOptimization<_N> opt(D);
+        opt.setupFromVertices(vertices, segment_times, derivative_to_optimize);
+        opt.solveLinear();
+      });
+
+      benchmark->run("linear_windowed", _N, D, K, [&](int repetition, int*) {
+        const Vertex::Vector vertices = createVertices(repetition);
+        const std::vector<double> segment_times =
+            estimateSegmentTimes(vertices, kVMax, kAMax);
+        PolynomialOptimizationWindowed<_N> opt(
+            D, WindowedOptimizationParameters());
+        opt.setupFromVertices(vertices, segment_times, derivative_to_optimize);
+        opt.solveLinear();
+      });
+
+      if (K <= benchmark->options().nonlinear_max_segments) {
+        for (const bool time_only : {true, false}) {
+          const std::string name = time_only
+                                       ? "nonlinear_time_only"
+                                       : "nonlinear_time_and_derivatives";
+          benchmark->run(name, _N, D, K,
+                         [&](int repetition, int* iterations) {
+            const Vertex::Vector vertices = createVertices(repetition);
+            const std::vector<double> segment_times =
+                estimateSegmentTimes(vertices, kVMax, kAMax);
+            NonlinearOptimizationParameters parameters;
+            PolynomialOptimizationNonLinear<_N> opt(D, parameters, time_only);
+            opt.setupFromVertices(vertices, segment_times,
+                                  derivative_to_optimize);
+            opt.addMaximumMagnitudeConstraint(derivative_order::VELOCITY,
+                                              kVMax);
+            opt.addMaximumMagnitudeConstraint(derivative_order::ACCELERATION,
+                                              kAMax);
+            opt.optimize();
+            *iterations = opt.getOptimizationInfo().n_iterations;
+          });
+        }
+      }
+
+      // Sampling and IO of one trajectory.
+      const Vertex::Vector vertices = createVertices(0);
+      const std::vector<double> segment_times =
+          estimateSegmentTimes(vertices, kVMax, kAMax);
+      PolynomialOptimization<_N> opt(D);
+      opt.setupFromVertices(vertices, segment_times, derivative_to_optimize);
+      opt.solveLinear();
+      Trajectory trajectory;
+      opt.getTrajectory(&trajectory);
+
+      Eigen::MatrixXd samples;
+      benchmark->run("sampling", _N, D, K, [&](int, int*) {
+        trajectory.evaluateRangeAllDerivatives(0.0, trajectory.getMaxTime(),
+                                               0.01, derivative_order::SNAP,
+                                               &samples);
+      });
+
+      benchmark->run("io_yaml_write", _N, D, K, [&](int, int*) {
+        CHECK(trajectoryToFile(kFilename + ".yaml", trajectory));
+      });
+      benchmark->run("io_yaml_read", _N, D, K, [&](int, int*) {
+        Trajectory loaded;
+        CHECK(trajectoryFromFile(kFilename + ".yaml", &loaded));
+      });
+      benchmark->run("io_binary_write", _N, D, K, [&](int, int*) {
+        CHECK(trajectoryToBinaryFile(kFilename + ".bin", trajectory));
+      });
+      benchmark->run("io_binary_read", _N, D, K, [&](int, int*) {
+        Trajectory loaded;
+        CHECK(trajectoryFromBinaryFile(kFilename + ".bin", &loaded));
+      });
+      std::remove((kFilename + ".yaml").c_str());
+      std::remove((kFilename + ".bin").c_str());
+    }
+  }
+}
+
+void writeCsv(const std::vector<BenchmarkResult>& results,
+              std::ostream* stream) {
+  *stream << "benchmark,N,D,K,repetitions,median_us,p99_us,iterations,"
+             "max_rss_kb\n";
+  for (const BenchmarkResult& result : results) {
+    *stream << result.name << "," << result.N << "," << result.D << ","
+            << result.K << "," << result.repetitions << ","
+            << result.median_us << "," << result.p99_us << ","
+            << result.iterations << "," << result.max_rss_kb << "\n";
+  }
 }
 
+void writeJson(const std::vector<BenchmarkResult>& results,
+               std::ostream* stream) {
+  *stream << "[\n";
+  for (size_t i = 0; i < results.size(); ++i) {
+    const BenchmarkResult& result = results[i];
+    *stream << "  {\"benchmark\": \"" << result.name << "\", \"N\": "
+            << result.N << ", \"D\": " << result.D << ", \"K\": " << result.K
+            << ", \"repetitions\": " << result.repetitions
+            << ", \"median_us\": " << result.median_us
+            << ", \"p99_us\": " << result.p99_us
+            << ", \"iterations\": " << result.iterations
+            << ", \"max_rss_kb\": " << result.max_rss_kb << "}"
+            << (i + 1 < results.size() ? "," : "") << "\n";
+  }
+  *stream << "]\n";
+}
+
+// Parses --key=value arguments.
+bool parseOptions(int argc, char** argv, Options* options) {
+  CHECK_NOTNULL(options);
+  for (int i = 1; i < argc; ++i) {
+    const std::string argument(argv[i]);
+    const size_t equal = argument.find('=');
+    if (argument.compare(0, 2, "--") != 0 || equal == std::string::npos) {
+      LOG(ERROR) << "Invalid argument " << argument << ".";
+      return false;
+    }
+    const std::string key = argument.substr(2, equal - 2);
+    const std::string value = argument.substr(equal + 1);
+    if (key == "format") {
+      options->format = value;
+    } else if (key == "output") {
+      options->output = value;
+    } else if (key == "filter") {
+      options->filter = value;
+    } else if (key == "max_segments") {
+      options->max_segments = std::stoi(value);
+    } else if (key == "nonlinear_max_segments") {
+      options->nonlinear_max_segments = std::stoi(value);
+    } else if (key == "repetitions") {
+      options->repetitions = std::stoi(value);
+    } else {
+      LOG(ERROR) << "Unknown argument " << argument << ".";
+      return false;
+    }
+  }
+  if (options->format != "csv" && options->format != "json") {
+    LOG(ERROR) << "Unknown format " << options->format << ".";
+    return false;
+  }
+  return options->repetitions > 0;
+}
+
+}  // namespace
+
 int main(int argc, char** argv) {
   google::InitGoogleLogging(argv[0]);
 
-  int n_segments_to_test[4] = {2, 10, 50, 100};
-  double average_distance = 5;
-  unsigned long seed = 1;
+  Options options;
+  if (!parseOptions(argc, argv, &options)) {
+    return 1;
+  }
+  std::vector<BenchmarkResult> results;
+  Benchmark benchmark(options, &results);
+  benchmarkOrder<6>(&benchmark);
+  benchmarkOrder<8>(&benchmark);
+  benchmarkOrder<10>(&benchmark);
+  benchmarkOrder<12>(&benchmark);
 
-  for (int j = 0; j < 4; ++j) {
-    for (int i = 0; i < 1000; ++i) {
-      int n_segments = n_segments_to_test[j];
-      timeEval(n_segments, average_distance, seed);
+  std::ofstream file;
+  std::ostream* stream = &std::cout;
+  if (!options.output.empty()) {
+    file.open(options.output);
+    if (!file.is_open()) {
+      LOG(ERROR) << "Unable to open " << options.output << ".";
+      return 1;
     }
+    stream = &file;
+  }
+  if (options.format == "json") {
+    writeJson(results, stream);
+  } else {
+    writeCsv(results, stream);
   }
-  mav_trajectory_generation::timing::Timing::Print(std::cout);
+  return 0;
 }
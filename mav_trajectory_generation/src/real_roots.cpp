@@ -0,0 +1,467 @@
+/*
+ * Copyright (c) 2016, Markus Achtelik, ASL, ETH Zurich, Switzerland
+ * Copyright (c) 2016, Michael Burri, ASL, ETH Zurich, Switzerland
+ * Copyright (c) 2016, Helen Oleynikova, ASL, ETH Zurich, Switzerland
+ * Copyright (c) 2016, Rik Bähnemann, ASL, ETH Zurich, Switzerland
+ * Copyright (c) 2016, Marija Popovic, ASL, ETH Zurich, Switzerland
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "mav_trajectory_generation/real_roots.h"
+
+#include <glog/logging.h>
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <limits>
+
+#include "mav_trajectory_generation/rpoly.h"
+
+namespace mav_trajectory_generation {
+
+namespace {
+
+// Polynomials up to this degree are solved with stack memory only. Higher
+// degrees fall back to Jenkins-Traub.
+constexpr int kMaxDegree = 24;
+// Maximum number of halvings of the interval before a cluster of roots is
+// reported as a single root.
+constexpr int kMaxBisectionDepth = 48;
+constexpr int kMaxPolishingIterations = 100;
+// Tolerance of the roots on the normalized interval [0, 1].
+constexpr double kRootTolerance = 1.0e-15;
+// Leading coefficients below this fraction of the largest coefficient do not
+// contribute on the normalized interval and are dropped.
+constexpr double kNegligibleCoefficient = 1.0e-14;
+
+typedef std::array<double, kMaxDegree + 1> Coefficients;
+
+// Holds the roots of polynomials up to degree 4 on the stack. Leaves some
+// headroom for spurious sign changes due to round-off.
+struct LowDegreeRoots {
+  LowDegreeRoots() : size(0) {}
+  void push_back(double root) {
+    if (size < static_cast<int>(data.size())) data[size++] = root;
+  }
+  std::array<double, 6> data;
+  int size;
+};
+
+template <class T>
+inline int sgn(T val) {
+  return (T(0) < val) - (val < T(0));
+}
+
+inline void evaluateWithDerivative(const double* a, int degree, double s,
+                                   double* value, double* derivative) {
+  *value = a[degree];
+  *derivative = 0.0;
+  for (int i = degree - 1; i >= 0; --i) {
+    *derivative = *derivative * s + *value;
+    *value = *value * s + a[i];
+  }
+}
+
+inline double evaluate(const double* a, int degree, double s) {
+  double value = a[degree];
+  for (int i = degree - 1; i >= 0; --i) {
+    value = value * s + a[i];
+  }
+  return value;
+}
+
+// Safeguarded Newton iterations for the root in (lo, hi). The polynomial has
+// to change its sign between lo and hi, value_lo is its value at lo.
+double solveBracketedRoot(const double* a, int degree, double lo, double hi,
+                          double value_lo, double tolerance) {
+  // Orient the polynomial such that it is negative at lo.
+  const double orientation = value_lo < 0.0 ? 1.0 : -1.0;
+  double step_old = hi - lo;
+  double step = step_old;
+  double s = 0.5 * (lo + hi);
+  double value, derivative;
+  evaluateWithDerivative(a, degree, s, &value, &derivative);
+  value *= orientation;
+  derivative *= orientation;
+  for (int i = 0; i < kMaxPolishingIterations; ++i) {
+    if (((s - hi) * derivative - value) * ((s - lo) * derivative - value) >=
+            0.0 ||
+        std::abs(2.0 * value) > std::abs(step_old * derivative)) {
+      // Newton leaves the bracket or converges too slowly: bisect.
+      step_old = step;
+      step = 0.5 * (hi - lo);
+      s = lo + step;
+    } else {
+      step_old = step;
+      step = value / derivative;
+      s -= step;
+    }
+    if (std::abs(step) < tolerance) {
+      break;
+    }
+    evaluateWithDerivative(a, degree, s, &value, &derivative);
+    value *= orientation;
+    derivative *= orientation;
+    if (value == 0.0) {
+      break;
+    } else if (value < 0.0) {
+      lo = s;
+    } else {
+      hi = s;
+    }
+  }
+  return s;
+}
+
+// Polishes roots that were isolated on the normalized interval. Converting to
+// the normalized interval loses some accuracy, thus the final iterations use
+// the original coefficients whenever the bracket is still valid there.
+class RootPolisher {
+ public:
+  RootPolisher(const double* coefficients, int degree, double t_start,
+               double interval, const double* a, int degree_normalized)
+      : coefficients_(coefficients),
+        degree_(degree),
+        t_start_(t_start),
+        interval_(interval),
+        a_(a),
+        degree_normalized_(degree_normalized) {}
+
+  // Returns the root in (lo, hi) on the normalized interval, value_lo is the
+  // value of the normalized polynomial at lo.
+  double polish(double lo, double hi, double value_lo) const {
+    const double t_lo = t_start_ + lo * interval_;
+    const double t_hi = t_start_ + hi * interval_;
+    const double value_t_lo = evaluate(coefficients_, degree_, t_lo);
+    const double value_t_hi = evaluate(coefficients_, degree_, t_hi);
+    if (sgn(value_t_lo) * sgn(value_t_hi) < 0) {
+      const double t = solveBracketedRoot(
+          coefficients_, degree_, t_lo, t_hi, value_t_lo,
+          kRootTolerance * std::max(1.0, std::abs(t_lo) + std::abs(t_hi)));
+      return (t - t_start_) / interval_;
+    }
+    return solveBracketedRoot(a_, degree_normalized_, lo, hi, value_lo,
+                              kRootTolerance);
+  }
+
+ private:
+  const double* coefficients_;
+  int degree_;
+  double t_start_;
+  double interval_;
+  const double* a_;
+  int degree_normalized_;
+};
+
+// Appends the roots of a linear or quadratic polynomial inside [lo, hi].
+void findRootsClosedForm(const double* a, int degree, double lo, double hi,
+                         LowDegreeRoots* roots) {
+  double r_1, r_2;
+  int n_roots = 0;
+  if (degree == 2 && a[2] != 0.0) {
+    const double discriminant = a[1] * a[1] - 4.0 * a[2] * a[0];
+    if (discriminant < 0.0) {
+      return;
+    }
+    // Numerically stable form, avoids cancellation.
+    const double q =
+        -0.5 * (a[1] + std::copysign(std::sqrt(discriminant), a[1]));
+    r_1 = q / a[2];
+    r_2 = q != 0.0 ? a[0] / q : r_1;
+    if (r_1 > r_2) {
+      std::swap(r_1, r_2);
+    }
+    n_roots = r_1 == r_2 ? 1 : 2;
+  } else if (degree >= 1 && a[1] != 0.0) {
+    r_1 = -a[0] / a[1];
+    n_roots = 1;
+  }
+  if (n_roots >= 1 && r_1 >= lo && r_1 <= hi) {
+    roots->push_back(r_1);
+  }
+  if (n_roots == 2 && r_2 >= lo && r_2 <= hi) {
+    roots->push_back(r_2);
+  }
+}
+
+// Appends the roots inside [lo, hi] of a polynomial up to degree 4. The
+// critical points, i.e. the roots of the derivative, split the interval into
+// monotone pieces that contain at most one root each.
+// The roots of the polynomial itself are refined by the optional polisher.
+void findRootsLowDegree(const double* a, int degree, double lo, double hi,
+                        const RootPolisher* polisher, LowDegreeRoots* roots) {
+  if (degree <= 2) {
+    findRootsClosedForm(a, degree, lo, hi, roots);
+    return;
+  }
+  std::array<double, 4> derivative;
+  for (int i = 0; i < degree; ++i) {
+    derivative[i] = (i + 1) * a[i + 1];
+  }
+  LowDegreeRoots critical_points;
+  findRootsLowDegree(derivative.data(), degree - 1, lo, hi, nullptr,
+                     &critical_points);
+  critical_points.push_back(hi);
+
+  double s_left = lo;
+  double value_left = evaluate(a, degree, lo);
+  if (value_left == 0.0) {
+    roots->push_back(lo);
+  }
+  for (int i = 0; i < critical_points.size; ++i) {
+    const double s_right = critical_points.data[i];
+    const double value_right = evaluate(a, degree, s_right);
+    if (value_right == 0.0) {
+      if (roots->size == 0 || roots->data[roots->size - 1] != s_right) {
+        roots->push_back(s_right);
+      }
+    } else if (sgn(value_left) * sgn(value_right) < 0) {
+      roots->push_back(
+          polisher != nullptr
+              ? polisher->polish(s_left, s_right, value_left)
+              : solveBracketedRoot(a, degree, s_left, s_right, value_left,
+                                   kRootTolerance));
+    }
+    s_left = s_right;
+    value_left = value_right;
+  }
+}
+
+int countSignVariations(const double* b, int degree) {
+  int n_variations = 0;
+  int last_sign = 0;
+  for (int i = 0; i <= degree; ++i) {
+    const int sign = sgn(b[i]);
+    if (sign != 0) {
+      if (last_sign != 0 && sign != last_sign) {
+        ++n_variations;
+      }
+      last_sign = sign;
+    }
+  }
+  return n_variations;
+}
+
+// De Casteljau subdivision of Bernstein coefficients at the midpoint.
+void splitBernstein(const double* b, int degree, double* left, double* right) {
+  Coefficients tmp;
+  std::copy(b, b + degree + 1, tmp.begin());
+  left[0] = tmp[0];
+  right[degree] = tmp[degree];
+  for (int r = 1; r <= degree; ++r) {
+    for (int i = 0; i <= degree - r; ++i) {
+      tmp[i] = 0.5 * (tmp[i] + tmp[i + 1]);
+    }
+    left[r] = tmp[0];
+    right[degree - r] = tmp[degree - r];
+  }
+}
+
+// Appends the roots in (lo, hi) of the polynomial a, whose Bernstein
+// coefficients on [lo, hi] are b. By Descartes' rule of signs, the number of
+// sign variations of b bounds the number of roots in (lo, hi).
+void isolateRootsBernstein(const RootPolisher& polisher, const double* b,
+                           int degree, double lo, double hi, int depth,
+                           std::vector<double>* roots) {
+  const int n_variations = countSignVariations(b, degree);
+  if (n_variations == 0) {
+    return;
+  }
+  if (n_variations == 1 && b[0] != 0.0 && b[degree] != 0.0) {
+    roots->push_back(polisher.polish(lo, hi, b[0]));
+    return;
+  }
+  const double mid = 0.5 * (lo + hi);
+  if (depth >= kMaxBisectionDepth) {
+    roots->push_back(mid);
+    return;
+  }
+  Coefficients left, right;
+  splitBernstein(b, degree, left.data(), right.data());
+  isolateRootsBernstein(polisher, left.data(), degree, lo, mid, depth + 1,
+                        roots);
+  if (right[0] == 0.0) {
+    roots->push_back(mid);
+  }
+  isolateRootsBernstein(polisher, right.data(), degree, mid, hi, depth + 1,
+                        roots);
+}
+
+// Binomial coefficients up to kMaxDegree, exact in double precision.
+const std::array<Coefficients, kMaxDegree + 1>& binomialCoefficients() {
+  static const std::array<Coefficients, kMaxDegree + 1> binomials = []() {
+    std::array<Coefficients, kMaxDegree + 1> table;
+    for (int n = 0; n <= kMaxDegree; ++n) {
+      table[n].fill(0.0);
+      table[n][0] = 1.0;
+      for (int k = 1; k <= n; ++k) {
+        table[n][k] = table[n - 1][k - 1] + (k < n ? table[n - 1][k] : 0.0);
+      }
+    }
+    return table;
+  }();
+  return binomials;
+}
+
+void findRootsBernstein(const double* a, int degree,
+                        const RootPolisher& polisher,
+                        std::vector<double>* roots) {
+  const std::array<Coefficients, kMaxDegree + 1>& binomials =
+      binomialCoefficients();
+  Coefficients b;
+  for (int i = 0; i <= degree; ++i) {
+    b[i] = 0.0;
+    for (int k = 0; k <= i; ++k) {
+      b[i] += binomials[i][k] / binomials[degree][k] * a[k];
+    }
+  }
+  if (b[0] == 0.0) {
+    roots->push_back(0.0);
+  }
+  isolateRootsBernstein(polisher, b.data(), degree, 0.0, 1.0, 0, roots);
+  if (b[degree] == 0.0) {
+    roots->push_back(1.0);
+  }
+}
+
+// Returns whether the polynomial vanishes within rounding noise between t and
+// t_bound, checked at a few samples. Horner's rounding error is bounded by
+// 2 * n * epsilon * sum(|c_k| * |t|^k).
+bool vanishesBetween(const double* c, int degree, double t, double t_bound) {
+  constexpr int kNumSamples = 8;
+  for (int i = 0; i <= kNumSamples; ++i) {
+    const double t_sample = t + (t_bound - t) * i / kNumSamples;
+    double magnitude = 0.0;
+    for (int k = degree; k >= 0; --k) {
+      magnitude = magnitude * std::abs(t_sample) + std::abs(c[k]);
+    }
+    if (std::abs(evaluate(c, degree, t_sample)) >
+        2.0 * (degree + 1) * std::numeric_limits<double>::epsilon() *
+            magnitude) {
+      return false;
+    }
+  }
+  return true;
+}
+
+bool findRealRootsJenkinsTraub(const double* coefficients_increasing,
+                               int n_coefficients, double t_start, double t_end,
+                               std::vector<double>* roots) {
+  Eigen::VectorXcd complex_roots;
+  if (!findRootsJenkinsTraub(
+          Eigen::Map<const Eigen::VectorXd>(coefficients_increasing,
+                                            n_coefficients),
+          &complex_roots)) {
+    return false;
+  }
+  const size_t n_roots_before = roots->size();
+  for (int i = 0; i < complex_roots.size(); ++i) {
+    const double t = complex_roots[i].real();
+    if (std::abs(complex_roots[i].imag()) <=
+            std::numeric_limits<double>::epsilon() &&
+        t >= t_start && t <= t_end) {
+      roots->push_back(t);
+    }
+  }
+  std::sort(roots->begin() + n_roots_before, roots->end());
+  return true;
+}
+
+}  // namespace
+
+bool findRealRootsInInterval(const double* coefficients_increasing,
+                             int n_coefficients, double t_start, double t_end,
+                             std::vector<double>* roots) {
+  CHECK_NOTNULL(coefficients_increasing);
+  CHECK_NOTNULL(roots);
+  if (t_start > t_end) {
+    LOG(WARNING) << "t_start is greater than t_end.";
+    return false;
+  }
+  int degree = n_coefficients - 1;
+  if (degree > kMaxDegree) {
+    return findRealRootsJenkinsTraub(coefficients_increasing, n_coefficients,
+                                     t_start, t_end, roots);
+  }
+  if (degree < 1) {
+    return true;
+  }
+
+  // Substitute t = t_start + s * (t_end - t_start), such that we only have to
+  // search s in [0, 1]. Taylor shift by t_start, then scale.
+  Coefficients a;
+  std::copy(coefficients_increasing, coefficients_increasing + degree + 1,
+            a.begin());
+  for (int i = 0; i < degree; ++i) {
+    for (int j = degree - 1; j >= i; --j) {
+      a[j] += t_start * a[j + 1];
+    }
+  }
+  const double interval = t_end - t_start;
+  double scale = 1.0;
+  double max_coefficient = std::abs(a[0]);
+  for (int i = 1; i <= degree; ++i) {
+    scale *= interval;
+    a[i] *= scale;
+    max_coefficient = std::max(max_coefficient, std::abs(a[i]));
+  }
+  if (max_coefficient == 0.0) {
+    // Zero polynomial, there are no isolated roots.
+    return true;
+  }
+  while (degree > 0 &&
+         std::abs(a[degree]) <= kNegligibleCoefficient * max_coefficient) {
+    --degree;
+  }
+
+  const RootPolisher polisher(coefficients_increasing, n_coefficients - 1,
+                              t_start, interval, a.data(), degree);
+  const size_t n_roots_before = roots->size();
+  if (degree <= 4) {
+    LowDegreeRoots low_degree_roots;
+    findRootsLowDegree(a.data(), degree, 0.0, 1.0, &polisher,
+                       &low_degree_roots);
+    roots->insert(roots->end(), low_degree_roots.data.begin(),
+                  low_degree_roots.data.begin() + low_degree_roots.size);
+  } else {
+    findRootsBernstein(a.data(), degree, polisher, roots);
+  }
+  for (size_t i = n_roots_before; i < roots->size(); ++i) {
+    (*roots)[i] =
+        std::max(t_start, std::min(t_start + (*roots)[i] * interval, t_end));
+  }
+  // A root of high multiplicity at an interval end, e.g. from constrained
+  // end derivatives, dissolves into spurious sign changes in rounding noise
+  // close to that end. These are no separate roots.
+  const double t_mid = 0.5 * (t_start + t_end);
+  roots->erase(
+      std::remove_if(roots->begin() + n_roots_before, roots->end(),
+                     [&](double t) {
+                       return vanishesBetween(coefficients_increasing,
+                                              n_coefficients - 1, t,
+                                              t < t_mid ? t_start : t_end);
+                     }),
+      roots->end());
+  return true;
+}
+
+bool findRealRootsInInterval(
+    const Eigen::Ref<const Eigen::VectorXd>& coefficients_increasing,
+    double t_start, double t_end, std::vector<double>* roots) {
+  return findRealRootsInInterval(coefficients_increasing.data(),
+                                 coefficients_increasing.size(), t_start,
+                                 t_end, roots);
+}
+
+}  // namespace mav_trajectory_generation
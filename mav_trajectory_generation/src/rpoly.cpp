@@ -6,6 +6,9 @@
  *        - made *op const
  *        - fixed ambiguous compare statement
  *        - added check for info != NULL in _99 label
+ *      (C) 2026, moved the working state from globals into
+ *        JenkinsTraubSolver to make the solver reentrant, scratch memory
+ *        is inline for small degrees
  *
  *      Translation of TOMS493 from FORTRAN to C. This
  *      implementation of Jenkins-Traub partially adapts
@@ -37,11 +40,14 @@
 #include <time.h>
 #include <limits>
 
+#include <glog/logging.h>
+
 #include "mav_trajectory_generation/rpoly.h"
 
 namespace mav_trajectory_generation {
 
-int findLastNonZeroCoeff(const Eigen::VectorXd& coefficients) {
+int findLastNonZeroCoeff(
+    const Eigen::Ref<const Eigen::VectorXd>& coefficients) {
   int last_non_zero_coefficient = -1;
 
   // Find last non-zero coefficient:
@@ -54,8 +60,48 @@ int findLastNonZeroCoeff(const Eigen::VectorXd& coefficients) {
   return last_non_zero_coefficient;
 }
 
-bool findRootsJenkinsTraub(const Eigen::VectorXd& coefficients_increasing,
-                           Eigen::VectorXcd* roots) {
+bool findRootsJenkinsTraub(
+    const Eigen::Ref<const Eigen::VectorXd>& coefficients_increasing,
+    Eigen::VectorXcd* roots) {
+  JenkinsTraubSolver solver;
+  return solver.findRoots(coefficients_increasing, roots);
+}
+
+Eigen::VectorXcd findRootsJenkinsTraub(
+    const Eigen::Ref<const Eigen::VectorXd>& coefficients_increasing) {
+  Eigen::VectorXcd roots;
+  findRootsJenkinsTraub(coefficients_increasing, &roots);
+  return roots;
+}
+
+namespace rpoly_impl {
+
+void quad(double a, double b1, double c, double* sr, double* si, double* lr,
+          double* li);
+void quadsd(int n, double* u, double* v, double* p, double* q, double* a,
+            double* b);
+
+}  // namespace rpoly_impl
+
+constexpr int JenkinsTraubSolver::kMaxInlineDegree;
+constexpr int JenkinsTraubSolver::kNumScratchBuffers;
+
+JenkinsTraubSolver::JenkinsTraubSolver()
+    : p(NULL),
+      qp(NULL),
+      k(NULL),
+      qk(NULL),
+      svk(NULL),
+      n(0),
+      nn(0),
+      nmi(0),
+      zerok(0),
+      itercnt(0) {}
+
+bool JenkinsTraubSolver::findRoots(
+    const Eigen::Ref<const Eigen::VectorXd>& coefficients_increasing,
+    Eigen::VectorXcd* roots) {
+  CHECK_NOTNULL(roots);
   // Remove trailing zeros.
   const int last_non_zero_coefficient =
       findLastNonZeroCoeff(coefficients_increasing);
@@ -65,22 +111,34 @@ bool findRootsJenkinsTraub(const Eigen::VectorXd& coefficients_increasing,
     return true;
   }
 
-  // Reverse coefficients in descending order.
-  Eigen::VectorXd coefficients_decreasing =
-      coefficients_increasing.head(last_non_zero_coefficient + 1).reverse();
-
-  const int n_coefficients = coefficients_decreasing.size();
+  const int n_coefficients = last_non_zero_coefficient + 1;
   if (n_coefficients < 2) {
     // The polynomial is 0th order and has no roots.
     roots->resize(0);
     return true;
   }
-  double* roots_real = new double[n_coefficients];
-  double* roots_imag = new double[n_coefficients];
 
-  int ret =
-      findRootsJenkinsTraub(coefficients_decreasing.data(), n_coefficients - 1,
-                            roots_real, roots_imag, NULL);
+  // Reverse coefficients in descending order.
+  double* coefficients_decreasing;
+  double* roots_real;
+  double* roots_imag;
+  if (n_coefficients <= kMaxInlineDegree + 1) {
+    coefficients_decreasing = inline_coefficients_;
+    roots_real = inline_roots_real_;
+    roots_imag = inline_roots_imag_;
+  } else {
+    heap_roots_.resize(3 * n_coefficients);
+    coefficients_decreasing = heap_roots_.data();
+    roots_real = coefficients_decreasing + n_coefficients;
+    roots_imag = roots_real + n_coefficients;
+  }
+  for (int i = 0; i < n_coefficients; ++i) {
+    coefficients_decreasing[i] =
+        coefficients_increasing[n_coefficients - 1 - i];
+  }
+
+  int ret = findRoots(coefficients_decreasing, n_coefficients - 1, roots_real,
+                      roots_imag, NULL);
   if (ret > -1) {
     roots->resize(ret);
     for (int i = 0; i < ret; ++i) {
@@ -88,9 +146,6 @@ bool findRootsJenkinsTraub(const Eigen::VectorXd& coefficients_increasing,
     }
   }
 
-  delete[] roots_real;
-  delete[] roots_imag;
-
   if (ret > -1) {
     return true;
   } else {
@@ -98,34 +153,14 @@ bool findRootsJenkinsTraub(const Eigen::VectorXd& coefficients_increasing,
   }
 }
 
-Eigen::VectorXcd findRootsJenkinsTraub(
-    const Eigen::VectorXd& coefficients_increasing) {
-  Eigen::VectorXcd roots;
-  findRootsJenkinsTraub(coefficients_increasing, &roots);
-  return roots;
+int JenkinsTraubSolver::findRoots(const double* coefficients_decreasing,
+                                  int degree, double* roots_real,
+                                  double* roots_imag, int info[]) {
+  return rpoly(coefficients_decreasing, degree, roots_real, roots_imag, info);
 }
 
-namespace rpoly_impl {
-
-void quad(double a, double b1, double c, double* sr, double* si, double* lr,
-          double* li);
-void fxshfr(int l2, int* nz);
-void quadit(double* uu, double* vv, int* nz);
-void realit(double sss, int* nz, int* iflag);
-void calcsc(int* type);
-void nextk(int* type);
-void newest(int type, double* uu, double* vv);
-void quadsd(int n, double* u, double* v, double* p, double* q, double* a,
-            double* b);
-double *p, *qp, *k, *qk, *svk;
-double sr, si, u, v, a, b, c, d, a1, a2;
-double a3, a6, a7, e, f, g, h, szr, szi, lzr, lzi;
-double eta, are, mre;
-int n, nn, nmi, zerok;
-static int itercnt;
-
-int rpoly(const double* op, int degree, double* zeror, double* zeroi,
-          int info[]) {
+int JenkinsTraubSolver::rpoly(const double* op, int degree, double* zeror,
+                              double* zeroi, int info[]) {
   double t, aa, bb, cc, *temp, factor, rot;
   double* pt;
   double lo, max, min, xx, yy, cosr, sinr, xxx, x, sc, bnd;
@@ -163,15 +198,20 @@ int rpoly(const double* op, int degree, double* zeror, double* zeroi,
   }
   if (n < 1) return degree;
   /*
-   *  Allocate memory here
+   *  Assign scratch memory, inline for small degrees.
    */
-  temp = new double[degree + 1];
-  pt = new double[degree + 1];
-  p = new double[degree + 1];
-  qp = new double[degree + 1];
-  k = new double[degree + 1];
-  qk = new double[degree + 1];
-  svk = new double[degree + 1];
+  double* scratch = inline_scratch_;
+  if (degree > kMaxInlineDegree) {
+    heap_scratch_.resize(kNumScratchBuffers * (degree + 1));
+    scratch = heap_scratch_.data();
+  }
+  temp = scratch;
+  pt = temp + degree + 1;
+  p = pt + degree + 1;
+  qp = p + degree + 1;
+  k = qp + degree + 1;
+  qk = k + degree + 1;
+  svk = qk + degree + 1;
   /*  Make a copy of the coefficients. */
   for (i = 0; i <= n; i++) p[i] = op[i];
 /*  Start the algorithm for one zero. */
@@ -187,7 +227,7 @@ _40:
   }
   /*  Calculate the final zero or pair of zeros. */
   if (n == 2) {
-    quad(p[0], p[1], p[2], &zeror[degree - 2], &zeroi[degree - 2],
+    rpoly_impl::quad(p[0], p[1], p[2], &zeror[degree - 2], &zeroi[degree - 2],
          &zeror[degree - 1], &zeroi[degree - 1]);
     n -= 2;
     if (info != NULL) info[degree] = info[degree - 1] = 0;
@@ -332,13 +372,6 @@ _110:
   }
 /*  Return with failure if no convergence after 20 shifts. */
 _99:
-  delete[] svk;
-  delete[] qk;
-  delete[] k;
-  delete[] qp;
-  delete[] p;
-  delete[] pt;
-  delete[] temp;
 
   if (info != NULL) {
     info[0] = clock() - sec;
@@ -354,7 +387,7 @@ _99:
  *  iterations and returns with the number of zeros
  *  found.
  */
-void fxshfr(int l2, int* nz) {
+void JenkinsTraubSolver::fxshfr(int l2, int* nz) {
   double svu, svv, ui, vi, s;
   double betas, betav, oss, ovv, ss, vv, ts, tv;
   double ots, otv, tvv, tss;
@@ -366,7 +399,7 @@ void fxshfr(int l2, int* nz) {
   oss = sr;
   ovv = v;
   /*  Evaluate polynomial by synthetic division. */
-  quadsd(n, &u, &v, p, qp, &a, &b);
+  rpoly_impl::quadsd(n, &u, &v, p, qp, &a, &b);
   calcsc(&type);
   for (j = 0; j < l2; j++) {
     /*  Calculate next k polynomial and estimate v. */
@@ -451,7 +484,7 @@ void fxshfr(int l2, int* nz) {
     /*  Recompute QP and scalar values to continue the
      *  second stage.
      */
-    quadsd(n, &u, &v, p, qp, &a, &b);
+    rpoly_impl::quadsd(n, &u, &v, p, qp, &a, &b);
     calcsc(&type);
   _70:
     ovv = vv;
@@ -466,7 +499,7 @@ void fxshfr(int l2, int* nz) {
  *  uu, vv - coefficients of starting quadratic.
  *  nz - number of zeros found.
  */
-void quadit(double* uu, double* vv, int* nz) {
+void JenkinsTraubSolver::quadit(double* uu, double* vv, int* nz) {
   double ui, vi;
   double mp, omp, ee, relstp, t, zm;
   int type, i, j, tried;
@@ -479,14 +512,14 @@ void quadit(double* uu, double* vv, int* nz) {
 /*  Main loop. */
 _10:
   itercnt++;
-  quad(1.0, u, v, &szr, &szi, &lzr, &lzi);
+  rpoly_impl::quad(1.0, u, v, &szr, &szi, &lzr, &lzi);
   /*  Return if roots of the quadratic are real and not
    *  close to multiple or nearly equal and of opposite
    *  sign.
    */
   if (fabs(fabs(szr) - fabs(lzr)) > 0.01 * fabs(lzr)) return;
   /*  Evaluate polynomial by quadratic synthetic division. */
-  quadsd(n, &u, &v, p, qp, &a, &b);
+  rpoly_impl::quadsd(n, &u, &v, p, qp, &a, &b);
   mp = fabs(a - szr * b) + fabs(szi * b);
   /*  Compute a rigorous bound on the rounding error in
    *  evaluating p.
@@ -521,7 +554,7 @@ _10:
   relstp = sqrt(relstp);
   u = u - u * relstp;
   v = v + v * relstp;
-  quadsd(n, &u, &v, p, qp, &a, &b);
+  rpoly_impl::quadsd(n, &u, &v, p, qp, &a, &b);
   for (i = 0; i < 5; i++) {
     calcsc(&type);
     nextk(&type);
@@ -547,7 +580,7 @@ _50:
  *  nz  - number of zeros found
  *  iflag - flag to indicate a pair of zeros near real axis.
  */
-void realit(double sss, int* nz, int* iflag) {
+void JenkinsTraubSolver::realit(double sss, int* nz, int* iflag) {
   double pv, kv, t, s;
   double ms, mp, omp, ee;
   int i, j;
@@ -636,9 +669,9 @@ void realit(double sss, int* nz, int* iflag) {
  *  type - integer variable set here indicating how the
  *  calculations are normalized to avoid overflow.
  */
-void calcsc(int* type) {
+void JenkinsTraubSolver::calcsc(int* type) {
   /*  Synthetic division of k by the quadratic 1,u,v */
-  quadsd(n - 1, &u, &v, k, qk, &c, &d);
+  rpoly_impl::quadsd(n - 1, &u, &v, k, qk, &c, &d);
   if (fabs(c) > fabs(k[n - 1] * 100.0 * eta)) goto _10;
   if (fabs(d) > fabs(k[n - 2] * 100.0 * eta)) goto _10;
   *type = 3;
@@ -670,7 +703,7 @@ _10:
 /*  Computes the next k polynomials using scalars
  *  computed in calcsc.
  */
-void nextk(int* type) {
+void JenkinsTraubSolver::nextk(int* type) {
   double temp;
   int i;
 
@@ -708,7 +741,7 @@ void nextk(int* type) {
 /*  Compute new estimates of the quadratic coefficients
  *  using the scalars computed in calcsc.
  */
-void newest(int type, double* uu, double* vv) {
+void JenkinsTraubSolver::newest(int type, double* uu, double* vv) {
   double a4, a5, b1, b2, c1, c2, c3, c4, temp;
 
   /* Use formulas appropriate to setting of type. */
@@ -743,6 +776,8 @@ void newest(int type, double* uu, double* vv) {
   return;
 }
 
+namespace rpoly_impl {
+
 /*  Divides p by the quadratic 1,u,v placing the quotient
  *  in q and the remainder in a,b.
  */
@@ -821,8 +856,9 @@ void quad(double a, double b1, double c, double* sr, double* si, double* lr,
 
 int findRootsJenkinsTraub(const double* coefficients_decreasing, int degree,
                           double* roots_real, double* roots_imag, int info[]) {
-  return rpoly_impl::rpoly(coefficients_decreasing, degree, roots_real,
-                           roots_imag, info);
+  JenkinsTraubSolver solver;
+  return solver.findRoots(coefficients_decreasing, degree, roots_real,
+                          roots_imag, info);
 }
 
 }  // namespace mav_trajectory_generation
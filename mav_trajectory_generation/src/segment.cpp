@@ -20,11 +20,102 @@
 
 #include "mav_trajectory_generation/segment.h"
 
+#include <atomic>
 #include <cmath>
 #include <limits>
+#include <iterator>
+#include <list>
+#include <mutex>
 
 namespace mav_trajectory_generation {
 
+struct Segment::Cache {
+  // Candidates of the magnitude extrema for one derivative and set of
+  // dimensions, see computeMinMaxMagnitudeCandidateTimes().
+  struct MagnitudeCandidates {
+    MagnitudeCandidates(int derivative, uint64_t dimension_mask)
+        : derivative(derivative),
+          dimension_mask(dimension_mask),
+          has_candidates(false),
+          t_start(0.0),
+          t_end(0.0),
+          method(kJenkinsTraub),
+          success(false) {}
+
+    int derivative;
+    uint64_t dimension_mask;
+    // The candidates are the roots of this polynomial.
+    Polynomial::ConvolutionCoefficients root_coefficients;
+    // Candidates of the last query.
+    bool has_candidates;
+    double t_start;
+    double t_end;
+    RootFindingMethod method;
+    bool success;
+    std::vector<double> candidate_times;
+  };
+
+  Cache() : has_derivatives(false) {}
+
+  static int index(int dimension, int derivative) {
+    return dimension * (kMaxCachedDerivative + 1) + derivative;
+  }
+
+  // Has to be called with the mutex locked.
+  void computeDerivatives(const Polynomial::Vector& polynomials, int N) {
+    if (has_derivatives) {
+      return;
+    }
+    derivatives.resize(polynomials.size() * (kMaxCachedDerivative + 1));
+    for (size_t dim = 0; dim < polynomials.size(); ++dim) {
+      for (int derivative = 0; derivative <= kMaxCachedDerivative;
+           ++derivative) {
+        derivatives[index(dim, derivative)] =
+            derivative <= N ? polynomials[dim].getCoefficients(derivative)
+                            : Eigen::VectorXd::Zero(N);
+      }
+    }
+    has_derivatives = true;
+  }
+
+  std::mutex mutex;
+  bool has_derivatives;
+  std::vector<Eigen::VectorXd> derivatives;
+  // std::list, such that entries are never moved.
+  std::list<MagnitudeCandidates> magnitude_candidates;
+};
+
+Segment::Segment(const Segment& segment)
+    : polynomials_(segment.polynomials_),
+      time_(segment.time_),
+      N_(segment.N_),
+      D_(segment.D_),
+      cache_(std::atomic_load(&segment.cache_)) {}
+
+Segment& Segment::operator=(const Segment& segment) {
+  if (this != &segment) {
+    polynomials_ = segment.polynomials_;
+    time_ = segment.time_;
+    N_ = segment.N_;
+    D_ = segment.D_;
+    cache_ = std::atomic_load(&segment.cache_);
+  }
+  return *this;
+}
+
+std::shared_ptr<Segment::Cache> Segment::getCache() const {
+  std::shared_ptr<Cache> cache = std::atomic_load(&cache_);
+  if (!cache) {
+    std::shared_ptr<Cache> new_cache = std::make_shared<Cache>();
+    // Otherwise, another thread created the cache in the meantime, which is
+    // loaded into cache.
+    if (std::atomic_compare_exchange_strong(&cache_, &cache, new_cache)) {
+      cache = new_cache;
+    }
+  }
+  return cache;
+}
+
 bool Segment::operator==(const Segment& rhs) const {
   if (D_ != rhs.D_ || time_ != rhs.time_) {
     return false;
@@ -40,6 +131,7 @@ bool Segment::operator==(const Segment& rhs) const {
 
 Polynomial& Segment::operator[](size_t idx) {
   CHECK_LT(idx, static_cast<size_t>(D_));
+  cache_.reset();
   return polynomials_[idx];
 }
 
@@ -48,6 +140,20 @@ const Polynomial& Segment::operator[](size_t idx) const {
   return polynomials_[idx];
 }
 
+const Eigen::VectorXd& Segment::getDerivativeCoefficientsRef(
+    int dimension, int derivative) const {
+  CHECK_GE(dimension, 0);
+  CHECK_LT(dimension, D_);
+  CHECK_GE(derivative, 0);
+  CHECK_LE(derivative, kMaxCachedDerivative);
+  // The derivatives are never changed once computed, thus the reference
+  // stays valid after unlocking.
+  std::shared_ptr<Cache> cache = getCache();
+  std::lock_guard<std::mutex> lock(cache->mutex);
+  cache->computeDerivatives(polynomials_, N_);
+  return cache->derivatives[Cache::index(dimension, derivative)];
+}
+
 Eigen::VectorXd Segment::evaluate(double t, int derivative) const {
   Eigen::VectorXd result(D_);
   result.setZero();
@@ -57,6 +163,34 @@ Eigen::VectorXd Segment::evaluate(double t, int derivative) const {
   return result;
 }
 
+void Segment::evaluateDerivatives(double t, int max_derivative,
+                                  Eigen::Ref<Eigen::MatrixXd> result) const {
+  CHECK_GE(max_derivative, 0);
+  CHECK_EQ(result.rows(), D_);
+  CHECK_EQ(result.cols(), max_derivative + 1);
+  CHECK_LE(N_, Polynomial::kMaxConvolutionSize);
+
+  double t_powers[Polynomial::kMaxConvolutionSize];
+  if (N_ > 0) {
+    t_powers[0] = 1.0;
+  }
+  for (int j = 1; j < N_; ++j) {
+    t_powers[j] = t_powers[j - 1] * t;
+  }
+
+  const Eigen::MatrixXd& base = Polynomial::base_coefficients_;
+  for (int d = 0; d < D_; ++d) {
+    const Eigen::VectorXd& coeffs = polynomials_[d].getCoefficientsRef();
+    for (int k = 0; k <= max_derivative; ++k) {
+      double value = 0.0;
+      for (int j = k; j < N_; ++j) {
+        value += base(k, j) * coeffs[j] * t_powers[j - k];
+      }
+      result(d, k) = value;
+    }
+  }
+}
+
 void printSegment(std::ostream& stream, const Segment& s, int derivative) {
   CHECK(derivative >= 0 && derivative < s.N());
   stream << "t: " << s.getTime() << std::endl;
@@ -81,9 +215,72 @@ std::ostream& operator<<(std::ostream& stream,
 
 bool Segment::computeMinMaxMagnitudeCandidateTimes(
     int derivative, double t_start, double t_end,
-    const std::vector<int>& dimensions,
-    std::vector<double>* candidate_times) const {
+    const std::vector<int>& dimensions, std::vector<double>* candidate_times,
+    RootFindingMethod method) const {
   CHECK_NOTNULL(candidate_times);
+  // The cache is keyed by a bit mask of distinct dimensions.
+  bool cacheable = !dimensions.empty() && derivative >= 0 &&
+                   derivative + 1 <= kMaxCachedDerivative &&
+                   N_ - derivative - 1 >= 1;
+  uint64_t dimension_mask = 0;
+  for (int dim : dimensions) {
+    if (dim < 0 || dim >= D_ || dim >= 64 ||
+        (dimension_mask & (uint64_t(1) << dim))) {
+      cacheable = false;
+      break;
+    }
+    dimension_mask |= uint64_t(1) << dim;
+  }
+  if (!cacheable) {
+    return computeMinMaxMagnitudeCandidateTimesUncached(
+        derivative, t_start, t_end, dimensions, candidate_times, method);
+  }
+
+  std::shared_ptr<Cache> cache = getCache();
+  std::lock_guard<std::mutex> lock(cache->mutex);
+  std::list<Cache::MagnitudeCandidates>::iterator entry =
+      cache->magnitude_candidates.begin();
+  while (entry != cache->magnitude_candidates.end() &&
+         (entry->derivative != derivative ||
+          entry->dimension_mask != dimension_mask)) {
+    ++entry;
+  }
+  if (entry == cache->magnitude_candidates.end()) {
+    cache->magnitude_candidates.emplace_back(derivative, dimension_mask);
+    entry = std::prev(cache->magnitude_candidates.end());
+    if (dimensions.size() > 1) {
+      const int n_d = N_ - derivative;
+      entry->root_coefficients.setZero(
+          Polynomial::getConvolutionLength(n_d, n_d - 1));
+      for (int dim : dimensions) {
+        polynomials_[dim].addMagnitudeDerivativeCoefficients(
+            derivative, entry->root_coefficients);
+      }
+    } else {
+      cache->computeDerivatives(polynomials_, N_);
+      entry->root_coefficients =
+          cache->derivatives[Cache::index(dimensions[0], derivative + 1)];
+    }
+  }
+
+  if (!entry->has_candidates || entry->t_start != t_start ||
+      entry->t_end != t_end || entry->method != method) {
+    entry->success = Polynomial::computeMinMaxCandidatesFromDerivative(
+        entry->root_coefficients, t_start, t_end, &entry->candidate_times,
+        method);
+    entry->has_candidates = true;
+    entry->t_start = t_start;
+    entry->t_end = t_end;
+    entry->method = method;
+  }
+  *candidate_times = entry->candidate_times;
+  return entry->success;
+}
+
+bool Segment::computeMinMaxMagnitudeCandidateTimesUncached(
+    int derivative, double t_start, double t_end,
+    const std::vector<int>& dimensions, std::vector<double>* candidate_times,
+    RootFindingMethod method) const {
   candidate_times->clear();
   // Compute magnitude derivative roots.
   if (dimensions.empty()) {
@@ -94,8 +291,15 @@ bool Segment::computeMinMaxMagnitudeCandidateTimes(
     const int n_dd = n_d - 1;
     const int convolved_coefficients_length =
         Polynomial::getConvolutionLength(n_d, n_dd);
-    Eigen::VectorXd convolved_coefficients(convolved_coefficients_length);
-    convolved_coefficients.setZero();
+    // The fused kernel covers all but degenerate and very long polynomials.
+    const bool fused = n_dd >= 1 && N_ <= Polynomial::kMaxN;
+    Polynomial::ConvolutionCoefficients convolved_coefficients;
+    Eigen::VectorXd convolved_coefficients_dynamic;
+    if (fused) {
+      convolved_coefficients.setZero(convolved_coefficients_length);
+    } else {
+      convolved_coefficients_dynamic.setZero(convolved_coefficients_length);
+    }
     for (int dim : dimensions) {
       if (dim < 0 || dim >= D_) {
         LOG(WARNING) << "Specified dimensions " << dim
@@ -103,6 +307,11 @@ bool Segment::computeMinMaxMagnitudeCandidateTimes(
                      << std::endl;
         return false;
       }
+      if (fused) {
+        polynomials_[dim].addMagnitudeDerivativeCoefficients(
+            derivative, convolved_coefficients);
+        continue;
+      }
       // Our coefficients are INCREASING, so when you take the derivative,
       // only the lower powers of t have non-zero coefficients.
       // So we take the head.
@@ -110,21 +319,22 @@ bool Segment::computeMinMaxMagnitudeCandidateTimes(
           polynomials_[dim].getCoefficients(derivative).head(n_d);
       Eigen::VectorXd dd =
           polynomials_[dim].getCoefficients(derivative + 1).head(n_dd);
-      convolved_coefficients += Polynomial::convolve(d, dd);
+      convolved_coefficients_dynamic += Polynomial::convolve(d, dd);
     }
-    Polynomial polynomial_convolved(convolved_coefficients);
-    // derivative = -1 because the convolved polynomial is the derivative
-    // already. We wish to find the minimum and maximum candidates for the
-    // integral.
-    if (!polynomial_convolved.computeMinMaxCandidates(t_start, t_end, -1,
-                                                      candidate_times)) {
+    // The convolved polynomial is the derivative already. We wish to find
+    // the minimum and maximum candidates for the integral.
+    if (!Polynomial::computeMinMaxCandidatesFromDerivative(
+            fused ? Eigen::Ref<const Eigen::VectorXd>(convolved_coefficients)
+                  : Eigen::Ref<const Eigen::VectorXd>(
+                        convolved_coefficients_dynamic),
+            t_start, t_end, candidate_times, method)) {
       return false;
     }
   } else {
     // For dimension.size() == 1  we can simply evaluate the roots of the
     // derivative.
     if (!polynomials_[dimensions[0]].computeMinMaxCandidates(
-            t_start, t_end, derivative, candidate_times)) {
+            t_start, t_end, derivative, candidate_times, method)) {
       return false;
     }
   }
@@ -133,13 +343,13 @@ bool Segment::computeMinMaxMagnitudeCandidateTimes(
 
 bool Segment::computeMinMaxMagnitudeCandidates(
     int derivative, double t_start, double t_end,
-    const std::vector<int>& dimensions,
-    std::vector<Extremum>* candidates) const {
+    const std::vector<int>& dimensions, std::vector<Extremum>* candidates,
+    RootFindingMethod method) const {
   CHECK_NOTNULL(candidates);
   // Find candidate times (roots + start + end).
   std::vector<double> candidate_times;
   computeMinMaxMagnitudeCandidateTimes(derivative, t_start, t_end, dimensions,
-                                       &candidate_times);
+                                       &candidate_times, method);
 
   // Evaluate candidate times.
   candidates->resize(candidate_times.size());
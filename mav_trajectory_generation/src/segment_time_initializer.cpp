@@ -0,0 +1,206 @@
+/*
+ * Copyright (c) 2016, Markus Achtelik, ASL, ETH Zurich, Switzerland
+ * Copyright (c) 2016, Michael Burri, ASL, ETH Zurich, Switzerland
+ * Copyright (c) 2016, Helen Oleynikova, ASL, ETH Zurich, Switzerland
+ * Copyright (c) 2016, Rik Bähnemann, ASL, ETH Zurich, Switzerland
+ * Copyright (c) 2016, Marija Popovic, ASL, ETH Zurich, Switzerland
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "mav_trajectory_generation/segment_time_initializer.h"
+
+#include <algorithm>
+#include <cmath>
+
+namespace mav_trajectory_generation {
+
+namespace {
+// Lower bound of every estimated segment time [s], e.g. for duplicate
+// vertices.
+constexpr double kMinSegmentTime = 0.01;
+// Corners are rounded by a circle touching both lines at this fraction of the
+// shorter one.
+constexpr double kCornerCutFraction = 0.25;
+// Smaller turning angles [rad] are passed at full speed.
+constexpr double kMinTurningAngle = 1.0e-6;
+
+bool getPositions(const Vertex::Vector& vertices,
+                  std::vector<Eigen::VectorXd>* positions) {
+  positions->resize(vertices.size());
+  for (size_t i = 0; i < vertices.size(); ++i) {
+    if (!vertices[i].getConstraint(derivative_order::POSITION,
+                                   &(*positions)[i])) {
+      LOG(WARNING) << "Vertex " << i << " has no position constraint.";
+      return false;
+    }
+  }
+  return true;
+}
+
+// Time to travel distance starting at v_start and ending at v_end, with
+// acceleration and speed bounded by a_max and v_max.
+double computeRampTime(double distance, double v_start, double v_end,
+                       double v_max, double a_max) {
+  if (std::abs(v_end * v_end - v_start * v_start) > 2.0 * a_max * distance) {
+    // The speeds are fixed by constraints and cannot be reached within the
+    // distance, assume a constant acceleration instead.
+    return v_start + v_end > 0.0 ? 2.0 * distance / (v_start + v_end) : 0.0;
+  }
+  const double v_peak_squared =
+      a_max * distance + 0.5 * (v_start * v_start + v_end * v_end);
+  if (v_peak_squared <= v_max * v_max) {
+    return (2.0 * std::sqrt(v_peak_squared) - v_start - v_end) / a_max;
+  }
+  const double distance_ramps =
+      (2.0 * v_max * v_max - v_start * v_start - v_end * v_end) /
+      (2.0 * a_max);
+  return (2.0 * v_max - v_start - v_end) / a_max +
+         (distance - distance_ramps) / v_max;
+}
+}  // namespace
+
+bool FabianSegmentTimeInitializer::estimateSegmentTimes(
+    const Vertex::Vector& vertices, std::vector<double>* segment_times) const {
+  CHECK_NOTNULL(segment_times);
+  std::vector<Eigen::VectorXd> positions;
+  if (vertices.size() < 2 || !getPositions(vertices, &positions)) {
+    return false;
+  }
+  *segment_times = mav_trajectory_generation::estimateSegmentTimes(
+      vertices, v_max_, a_max_, magic_fabian_constant_);
+  return true;
+}
+
+CornerAwareSegmentTimeInitializer::CornerAwareSegmentTimeInitializer(
+    double v_max, double a_max, double time_factor)
+    : v_max_(v_max), a_max_(a_max), time_factor_(time_factor) {
+  CHECK_GT(v_max_, 0.0);
+  CHECK_GT(a_max_, 0.0);
+  CHECK_GT(time_factor_, 0.0);
+}
+
+bool CornerAwareSegmentTimeInitializer::estimateSegmentTimes(
+    const Vertex::Vector& vertices, std::vector<double>* segment_times) const {
+  CHECK_NOTNULL(segment_times);
+  std::vector<Eigen::VectorXd> positions;
+  if (vertices.size() < 2 || !getPositions(vertices, &positions)) {
+    return false;
+  }
+  const size_t n_vertices = vertices.size();
+  std::vector<double> distances(n_vertices - 1);
+  for (size_t i = 0; i + 1 < n_vertices; ++i) {
+    distances[i] = (positions[i + 1] - positions[i]).norm();
+  }
+
+  // Speed through every vertex from its constraint or the turning angle.
+  // Duplicate vertices stop.
+  std::vector<double> speeds(n_vertices, v_max_);
+  std::vector<bool> is_fixed(n_vertices, false);
+  for (size_t i = 0; i < n_vertices; ++i) {
+    Eigen::VectorXd velocity;
+    if (vertices[i].getConstraint(derivative_order::VELOCITY, &velocity)) {
+      speeds[i] = std::min(velocity.norm(), v_max_);
+      is_fixed[i] = true;
+    } else if (i > 0 && i + 1 < n_vertices) {
+      if (distances[i - 1] <= 0.0 || distances[i] <= 0.0) {
+        speeds[i] = 0.0;
+        continue;
+      }
+      const double cos_angle = (positions[i] - positions[i - 1])
+                                   .dot(positions[i + 1] - positions[i]) /
+                               (distances[i - 1] * distances[i]);
+      const double angle =
+          std::acos(std::min(std::max(cos_angle, -1.0), 1.0));
+      if (angle > kMinTurningAngle) {
+        const double radius = kCornerCutFraction *
+                              std::min(distances[i - 1], distances[i]) /
+                              std::tan(0.5 * angle);
+        speeds[i] = std::min(v_max_, std::sqrt(a_max_ * radius));
+      }
+    }
+  }
+
+  // Lower the free speeds that cannot be reached from the neighbors.
+  for (size_t i = 1; i < n_vertices; ++i) {
+    const double v_reachable = std::sqrt(speeds[i - 1] * speeds[i - 1] +
+                                         2.0 * a_max_ * distances[i - 1]);
+    if (!is_fixed[i]) {
+      speeds[i] = std::min(speeds[i], v_reachable);
+    }
+  }
+  for (size_t i = n_vertices - 1; i-- > 0;) {
+    const double v_reachable = std::sqrt(speeds[i + 1] * speeds[i + 1] +
+                                         2.0 * a_max_ * distances[i]);
+    if (!is_fixed[i]) {
+      speeds[i] = std::min(speeds[i], v_reachable);
+    }
+  }
+
+  segment_times->resize(n_vertices - 1);
+  for (size_t i = 0; i + 1 < n_vertices; ++i) {
+    (*segment_times)[i] = std::max(
+        time_factor_ * computeRampTime(distances[i], speeds[i], speeds[i + 1],
+                                       v_max_, a_max_),
+        kMinSegmentTime);
+  }
+  return true;
+}
+
+WarmStartSegmentTimeInitializer::WarmStartSegmentTimeInitializer(
+    const SegmentTimeInitializer* fallback)
+    : fallback_(CHECK_NOTNULL(fallback)) {}
+
+void WarmStartSegmentTimeInitializer::setPreviousSolution(
+    const Vertex::Vector& vertices, const std::vector<double>& segment_times) {
+  CHECK_EQ(vertices.size(), segment_times.size() + 1);
+  std::vector<double> estimates;
+  if (!fallback_->estimateSegmentTimes(vertices, &estimates)) {
+    return;
+  }
+  std::lock_guard<std::mutex> lock(mutex_);
+  previous_times_ = segment_times;
+  previous_estimates_.swap(estimates);
+}
+
+void WarmStartSegmentTimeInitializer::clear() {
+  std::lock_guard<std::mutex> lock(mutex_);
+  previous_times_.clear();
+  previous_estimates_.clear();
+}
+
+bool WarmStartSegmentTimeInitializer::hasPreviousSolution() const {
+  std::lock_guard<std::mutex> lock(mutex_);
+  return !previous_times_.empty();
+}
+
+bool WarmStartSegmentTimeInitializer::estimateSegmentTimes(
+    const Vertex::Vector& vertices, std::vector<double>* segment_times) const {
+  CHECK_NOTNULL(segment_times);
+  if (!fallback_->estimateSegmentTimes(vertices, segment_times)) {
+    return false;
+  }
+  std::lock_guard<std::mutex> lock(mutex_);
+  if (previous_times_.size() != segment_times->size()) {
+    return true;
+  }
+  for (size_t i = 0; i < segment_times->size(); ++i) {
+    if (previous_estimates_[i] > 0.0) {
+      (*segment_times)[i] =
+          previous_times_[i] * (*segment_times)[i] / previous_estimates_[i];
+    }
+  }
+  return true;
+}
+
+}  // namespace mav_trajectory_generation
@@ -0,0 +1,150 @@
+/*
+ * Copyright (c) 2016, Markus Achtelik, ASL, ETH Zurich, Switzerland
+ * Copyright (c) 2016, Michael Burri, ASL, ETH Zurich, Switzerland
+ * Copyright (c) 2016, Helen Oleynikova, ASL, ETH Zurich, Switzerland
+ * Copyright (c) 2016, Rik Bähnemann, ASL, ETH Zurich, Switzerland
+ * Copyright (c) 2016, Marija Popovic, ASL, ETH Zurich, Switzerland
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "mav_trajectory_generation/solution_cache.h"
+
+#include <cmath>
+#include <utility>
+
+namespace mav_trajectory_generation {
+
+SolutionCache::SolutionCache(size_t capacity, double resolution)
+    : resolution_(resolution), cache_(capacity) {
+  CHECK_GT(resolution_, 0.0);
+}
+
+int64_t SolutionCache::quantize(double value) const {
+  return std::llround(value / resolution_);
+}
+
+void SolutionCache::computeKey(const Vertex::Vector& vertices,
+                               const std::vector<double>& segment_times,
+                               int derivative_to_optimize,
+                               const std::vector<double>& parameters, Key* key,
+                               Eigen::VectorXd* translation) const {
+  CHECK_NOTNULL(key);
+  CHECK_NOTNULL(translation);
+  CHECK(!vertices.empty());
+  const int dimension = vertices.front().D();
+  if (!vertices.front().getConstraint(derivative_order::POSITION,
+                                      translation)) {
+    *translation = Eigen::VectorXd::Zero(dimension);
+  }
+
+  key->clear();
+  key->push_back(dimension);
+  key->push_back(vertices.size());
+  key->push_back(derivative_to_optimize);
+  for (const Vertex& vertex : vertices) {
+    CHECK_EQ(vertex.D(), dimension);
+    key->push_back(vertex.getNumberOfConstraints());
+    for (Vertex::Constraints::const_iterator it = vertex.cBegin();
+         it != vertex.cEnd(); ++it) {
+      key->push_back(it->first);
+      for (int d = 0; d < dimension; ++d) {
+        const double offset =
+            it->first == derivative_order::POSITION ? (*translation)[d] : 0.0;
+        key->push_back(quantize(it->second[d] - offset));
+      }
+    }
+  }
+  key->push_back(segment_times.size());
+  for (double segment_time : segment_times) {
+    key->push_back(quantize(segment_time));
+  }
+  key->push_back(parameters.size());
+  for (double parameter : parameters) {
+    key->push_back(quantize(parameter));
+  }
+}
+
+bool SolutionCache::lookup(const Key& key, const Eigen::VectorXd& translation,
+                           Trajectory* trajectory, int* status) {
+  CHECK_NOTNULL(trajectory);
+  Trajectory relative_trajectory;
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    const Entry* entry = cache_.find(key);
+    if (entry == nullptr) {
+      return false;
+    }
+    relative_trajectory = entry->trajectory;
+    if (status != nullptr) {
+      *status = entry->status;
+    }
+  }
+  *trajectory = translateTrajectory(relative_trajectory, translation);
+  return true;
+}
+
+void SolutionCache::insert(const Key& key, const Eigen::VectorXd& translation,
+                           const Trajectory& trajectory, int status) {
+  CHECK(!trajectory.empty());
+  Entry entry{translateTrajectory(trajectory, -translation), status};
+
+  std::lock_guard<std::mutex> lock(mutex_);
+  cache_.insert(key, std::move(entry));
+}
+
+void SolutionCache::clear() {
+  std::lock_guard<std::mutex> lock(mutex_);
+  cache_.clear();
+}
+
+void SolutionCache::resetCounters() {
+  std::lock_guard<std::mutex> lock(mutex_);
+  cache_.resetCounters();
+}
+
+size_t SolutionCache::size() const {
+  std::lock_guard<std::mutex> lock(mutex_);
+  return cache_.size();
+}
+
+size_t SolutionCache::getNumHits() const {
+  std::lock_guard<std::mutex> lock(mutex_);
+  return cache_.getNumHits();
+}
+
+size_t SolutionCache::getNumMisses() const {
+  std::lock_guard<std::mutex> lock(mutex_);
+  return cache_.getNumMisses();
+}
+
+Trajectory translateTrajectory(const Trajectory& trajectory,
+                               const Eigen::VectorXd& translation) {
+  if (trajectory.empty()) {
+    return trajectory;
+  }
+  CHECK_EQ(translation.size(), trajectory.D());
+  Segment::Vector segments = trajectory.segments();
+  for (Segment& segment : segments) {
+    for (int d = 0; d < segment.D(); ++d) {
+      Eigen::VectorXd coefficients = segment[d].getCoefficientsRef();
+      coefficients[0] += translation[d];
+      segment[d].setCoefficients(coefficients);
+    }
+  }
+  Trajectory translated;
+  translated.setSegments(std::move(segments));
+  return translated;
+}
+
+}  // namespace mav_trajectory_generation
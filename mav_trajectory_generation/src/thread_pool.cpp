@@ -0,0 +1,169 @@
+/*
+ * Copyright (c) 2016, Markus Achtelik, ASL, ETH Zurich, Switzerland
+ * Copyright (c) 2016, Michael Burri, ASL, ETH Zurich, Switzerland
+ * Copyright (c) 2016, Helen Oleynikova, ASL, ETH Zurich, Switzerland
+ * Copyright (c) 2016, Rik Bähnemann, ASL, ETH Zurich, Switzerland
+ * Copyright (c) 2016, Marija Popovic, ASL, ETH Zurich, Switzerland
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "mav_trajectory_generation/thread_pool.h"
+
+#include <glog/logging.h>
+#include <algorithm>
+
+namespace mav_trajectory_generation {
+
+ThreadPool::ThreadPool(size_t n_threads)
+    : job_(nullptr),
+      batch_idx_(0),
+      n_busy_workers_(0),
+      stop_(false) {
+  if (n_threads == 0) {
+    n_threads = std::max(1u, std::thread::hardware_concurrency());
+  }
+  ranges_.reserve(n_threads);
+  for (size_t i = 0; i < n_threads; ++i) {
+    ranges_.emplace_back(new WorkerRange);
+  }
+  threads_.reserve(n_threads);
+  for (size_t i = 0; i < n_threads; ++i) {
+    threads_.emplace_back(&ThreadPool::workerLoop, this, i);
+  }
+}
+
+ThreadPool::~ThreadPool() {
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    stop_ = true;
+  }
+  batch_started_.notify_all();
+  for (std::thread& thread : threads_) {
+    thread.join();
+  }
+}
+
+void ThreadPool::parallelFor(size_t n_jobs, const Job& job) {
+  if (n_jobs == 0) {
+    return;
+  }
+  std::lock_guard<std::mutex> batch_lock(batch_mutex_);
+
+  const size_t n_workers = threads_.size();
+  for (size_t i = 0; i < n_workers; ++i) {
+    std::lock_guard<std::mutex> lock(ranges_[i]->mutex);
+    ranges_[i]->begin = n_jobs * i / n_workers;
+    ranges_[i]->end = n_jobs * (i + 1) / n_workers;
+  }
+
+  std::unique_lock<std::mutex> lock(mutex_);
+  job_ = &job;
+  exception_ = nullptr;
+  n_busy_workers_ = n_workers;
+  ++batch_idx_;
+  batch_started_.notify_all();
+  batch_finished_.wait(lock, [this] { return n_busy_workers_ == 0; });
+  job_ = nullptr;
+
+  if (exception_) {
+    std::rethrow_exception(exception_);
+  }
+}
+
+bool ThreadPool::nextJob(size_t worker_idx, size_t* job_idx) {
+  CHECK_NOTNULL(job_idx);
+  WorkerRange& own_range = *ranges_[worker_idx];
+  {
+    std::lock_guard<std::mutex> lock(own_range.mutex);
+    if (own_range.begin < own_range.end) {
+      *job_idx = own_range.begin++;
+      return true;
+    }
+  }
+
+  // Steal from the worker with the most remaining jobs. Ranges only shrink
+  // during a batch, so an empty scan means the batch is done.
+  while (true) {
+    size_t victim_idx = worker_idx;
+    size_t victim_size = 0;
+    for (size_t i = 0; i < ranges_.size(); ++i) {
+      if (i == worker_idx) continue;
+      std::lock_guard<std::mutex> lock(ranges_[i]->mutex);
+      const size_t size = ranges_[i]->end - ranges_[i]->begin;
+      if (size > victim_size) {
+        victim_size = size;
+        victim_idx = i;
+      }
+    }
+    if (victim_size == 0) {
+      return false;
+    }
+
+    size_t steal_begin, steal_end;
+    {
+      WorkerRange& victim_range = *ranges_[victim_idx];
+      std::lock_guard<std::mutex> lock(victim_range.mutex);
+      const size_t size = victim_range.end - victim_range.begin;
+      if (size == 0) {
+        continue;  // The victim finished in the meantime.
+      }
+      steal_end = victim_range.end;
+      steal_begin = victim_range.end - (size + 1) / 2;
+      victim_range.end = steal_begin;
+    }
+
+    std::lock_guard<std::mutex> lock(own_range.mutex);
+    own_range.begin = steal_begin + 1;
+    own_range.end = steal_end;
+    *job_idx = steal_begin;
+    return true;
+  }
+}
+
+void ThreadPool::workerLoop(size_t worker_idx) {
+  size_t last_batch_idx = 0;
+  while (true) {
+    const Job* job = nullptr;
+    {
+      std::unique_lock<std::mutex> lock(mutex_);
+      batch_started_.wait(lock, [this, last_batch_idx] {
+        return stop_ || batch_idx_ != last_batch_idx;
+      });
+      if (stop_) {
+        return;
+      }
+      last_batch_idx = batch_idx_;
+      job = job_;
+    }
+
+    size_t job_idx;
+    while (nextJob(worker_idx, &job_idx)) {
+      try {
+        (*job)(job_idx, worker_idx);
+      } catch (...) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (!exception_) {
+          exception_ = std::current_exception();
+        }
+      }
+    }
+
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (--n_busy_workers_ == 0) {
+      batch_finished_.notify_one();
+    }
+  }
+}
+
+}  // namespace mav_trajectory_generation
@@ -37,19 +37,46 @@ Timing& Timing::Instance() {
   return t;
 }
 
-Timing::Timing() : max_tag_length_(0) {}
+Timing::ThreadTimers& Timing::GetThreadTimers() {
+  thread_local ThreadTimers thread_timers;
+  return thread_timers;
+}
+
+Timing::ThreadTimers::ThreadTimers() {
+  Timing& timing = Instance();
+  std::lock_guard<std::mutex> lock(timing.mutex_);
+  timing.threads_.push_back(this);
+}
+
+Timing::ThreadTimers::~ThreadTimers() {
+  Timing& timing = Instance();
+  std::lock_guard<std::mutex> lock(timing.mutex_);
+  if (timing.timers_.size() < timers.size()) {
+    timing.timers_.resize(timers.size());
+  }
+  for (size_t i = 0; i < timers.size(); ++i) {
+    timing.timers_[i].acc_.Merge(timers[i].acc_);
+    timing.timers_[i].num_allocations_ += timers[i].num_allocations_;
+    timing.timers_[i].peak_bytes_ =
+        std::max(timing.timers_[i].peak_bytes_, timers[i].peak_bytes_);
+  }
+  timing.threads_.erase(
+      std::find(timing.threads_.begin(), timing.threads_.end(), this));
+}
+
+Timing::Timing() : num_handles_(0), max_tag_length_(0) {}
 
 Timing::~Timing() {}
 
 // Static functions to query the timers:
 size_t Timing::GetHandle(std::string const& tag) {
+  std::lock_guard<std::mutex> lock(Instance().mutex_);
   // Search for an existing tag.
   map_t::iterator i = Instance().tag_map_.find(tag);
   if (i == Instance().tag_map_.end()) {
     // If it is not there, create a tag.
-    size_t handle = Instance().timers_.size();
+    size_t handle = Instance().num_handles_++;
     Instance().tag_map_[tag] = handle;
-    Instance().timers_.push_back(TimerMapValue());
     // Track the maximum tag length to help printing a table of timing values
     // later.
     Instance().max_tag_length_ =
@@ -74,12 +101,12 @@ std::string Timing::GetTag(size_t handle) {
 
 // Class functions used for timing.
 Timer::Timer(size_t handle, bool constructStopped)
-    : timing_(false), handle_(handle) {
+    : allocations_(true), timing_(false), handle_(handle) {
   if (!constructStopped) Start();
 }
 
 Timer::Timer(std::string const& tag, bool constructStopped)
-    : timing_(false), handle_(Timing::GetHandle(tag)) {
+    : allocations_(true), timing_(false), handle_(Timing::GetHandle(tag)) {
   if (!constructStopped) Start();
 }
 
@@ -89,67 +116,112 @@ Timer::~Timer() {
 
 void Timer::Start() {
   timing_ = true;
-  time_ = std::chrono::system_clock::now();
+  allocations_.start();
+  time_ = std::chrono::steady_clock::now();
 }
 
 void Timer::Stop() {
-  std::chrono::time_point<std::chrono::system_clock> now =
-      std::chrono::system_clock::now();
+  const std::chrono::steady_clock::time_point now =
+      std::chrono::steady_clock::now();
   double dt = std::chrono::duration<double>(now - time_).count();
+  allocations_.stop();
 
-  Timing::Instance().AddTime(handle_, dt);
+  Timing::Instance().AddTime(handle_, dt, allocations_.getNumAllocations(),
+                             allocations_.getPeakBytes());
   timing_ = false;
 }
 
 bool Timer::IsTiming() const { return timing_; }
 
-void Timing::AddTime(size_t handle, double seconds) {
-  timers_[handle].acc_.Add(seconds);
+void Timing::AddTime(size_t handle, double seconds, size_t num_allocations,
+                     size_t peak_bytes) {
+  ThreadTimers& thread_timers = GetThreadTimers();
+  std::lock_guard<std::mutex> lock(thread_timers.mutex);
+  if (handle >= thread_timers.timers.size()) {
+    thread_timers.timers.resize(handle + 1);
+  }
+  TimerMapValue& timer = thread_timers.timers[handle];
+  timer.acc_.Add(seconds);
+  timer.num_allocations_ += num_allocations;
+  timer.peak_bytes_ = std::max(timer.peak_bytes_, peak_bytes);
+}
+
+TimerMapValue Timing::GetMerged(size_t handle) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  TimerMapValue merged;
+  if (handle < timers_.size()) {
+    merged.acc_.Merge(timers_[handle].acc_);
+    merged.num_allocations_ = timers_[handle].num_allocations_;
+    merged.peak_bytes_ = timers_[handle].peak_bytes_;
+  }
+  for (ThreadTimers* thread_timers : threads_) {
+    std::lock_guard<std::mutex> thread_lock(thread_timers->mutex);
+    if (handle < thread_timers->timers.size()) {
+      const TimerMapValue& timer = thread_timers->timers[handle];
+      merged.acc_.Merge(timer.acc_);
+      merged.num_allocations_ += timer.num_allocations_;
+      merged.peak_bytes_ = std::max(merged.peak_bytes_, timer.peak_bytes_);
+    }
+  }
+  return merged;
 }
 
 double Timing::GetTotalSeconds(size_t handle) {
-  return Instance().timers_[handle].acc_.Sum();
+  return Instance().GetMerged(handle).acc_.Sum();
 }
 double Timing::GetTotalSeconds(std::string const& tag) {
   return GetTotalSeconds(GetHandle(tag));
 }
 double Timing::GetMeanSeconds(size_t handle) {
-  return Instance().timers_[handle].acc_.Mean();
+  return Instance().GetMerged(handle).acc_.Mean();
 }
 double Timing::GetMeanSeconds(std::string const& tag) {
   return GetMeanSeconds(GetHandle(tag));
 }
 size_t Timing::GetNumSamples(size_t handle) {
-  return Instance().timers_[handle].acc_.TotalSamples();
+  return Instance().GetMerged(handle).acc_.TotalSamples();
 }
 size_t Timing::GetNumSamples(std::string const& tag) {
   return GetNumSamples(GetHandle(tag));
 }
 double Timing::GetVarianceSeconds(size_t handle) {
-  return Instance().timers_[handle].acc_.LazyVariance();
+  return Instance().GetMerged(handle).acc_.LazyVariance();
 }
 double Timing::GetVarianceSeconds(std::string const& tag) {
   return GetVarianceSeconds(GetHandle(tag));
 }
 double Timing::GetMinSeconds(size_t handle) {
-  return Instance().timers_[handle].acc_.Min();
+  return Instance().GetMerged(handle).acc_.Min();
 }
 double Timing::GetMinSeconds(std::string const& tag) {
   return GetMinSeconds(GetHandle(tag));
 }
 double Timing::GetMaxSeconds(size_t handle) {
-  return Instance().timers_[handle].acc_.Max();
+  return Instance().GetMerged(handle).acc_.Max();
 }
 double Timing::GetMaxSeconds(std::string const& tag) {
   return GetMaxSeconds(GetHandle(tag));
 }
 
 double Timing::GetHz(size_t handle) {
-  return 1.0 / Instance().timers_[handle].acc_.RollingMean();
+  return 1.0 / Instance().GetMerged(handle).acc_.RollingMean();
 }
 
 double Timing::GetHz(std::string const& tag) { return GetHz(GetHandle(tag)); }
 
+size_t Timing::GetNumAllocations(size_t handle) {
+  return Instance().GetMerged(handle).num_allocations_;
+}
+size_t Timing::GetNumAllocations(std::string const& tag) {
+  return GetNumAllocations(GetHandle(tag));
+}
+size_t Timing::GetPeakBytes(size_t handle) {
+  return Instance().GetMerged(handle).peak_bytes_;
+}
+size_t Timing::GetPeakBytes(std::string const& tag) {
+  return GetPeakBytes(GetHandle(tag));
+}
+
 std::string Timing::SecondsToTimeString(double seconds) {
   char buffer[256];
   snprintf(buffer, sizeof(buffer), "%09.6f", seconds);
@@ -187,6 +259,13 @@ void Timing::Print(std::ostream& out) {
       // The min or max are out of bounds.
       out << "[" << SecondsToTimeString(minsec) << ","
           << SecondsToTimeString(maxsec) << "]";
+
+      // Mean allocations per sample and the largest peak of a sample.
+      if (memory_tracking::isEnabled()) {
+        out << "\t" << static_cast<double>(GetNumAllocations(i)) /
+                           GetNumSamples(i)
+            << " allocs, peak " << GetPeakBytes(i) << " B";
+      }
     }
     out << std::endl;
   }
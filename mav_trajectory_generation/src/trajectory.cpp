@@ -20,61 +20,96 @@
 
 #include "mav_trajectory_generation/trajectory.h"
 
+#include <algorithm>
+#include <cmath>
 #include <limits>
 
+#include "mav_trajectory_generation/arc_length_table.h"
+#include "mav_trajectory_generation/thread_pool.h"
+#include "mav_trajectory_generation/timing.h"
+
 namespace mav_trajectory_generation {
 
-bool Trajectory::operator==(const Trajectory& rhs) const {
-  if (segments_.size() != rhs.segments_.size()) {
-    // Different number of segments.
-    return false;
-  } else {
-    for (int i = 0; i < K(); i++) {
-      if (segments_ != rhs.segments_) {
-        return false;
-      }
-    }
-    return true;
+const std::shared_ptr<Trajectory::Storage>& Trajectory::emptyStorage() {
+  static const std::shared_ptr<Storage> kEmptyStorage =
+      std::make_shared<Storage>();
+  return kEmptyStorage;
+}
+
+Trajectory::Storage* Trajectory::mutableStorage() {
+  if (storage_.use_count() > 1) {
+    storage_ = std::make_shared<Storage>(*storage_);
   }
+  return storage_.get();
+}
+
+bool Trajectory::operator==(const Trajectory& rhs) const {
+  return storage_ == rhs.storage_ || segments() == rhs.segments();
+}
+
+int Trajectory::getSegmentIndex(double t) const {
+  CHECK(!empty());
+  const std::vector<double>& start_times = storage_->segment_start_times;
+  // |<--t_start -->|
+  // x----------x---------x
+  //               ^t
+  //            |chosen it|
+  // The last segment starting at or before t.
+  const int i = std::upper_bound(start_times.begin(), start_times.end(), t) -
+                start_times.begin() - 1;
+  return std::max(i, 0);
 }
 
 Eigen::VectorXd Trajectory::evaluate(double t, int derivative_order) const {
-  double accumulated_time = 0.0;
-
-  // Look for the correct segment.
-  size_t i = 0;
-  for (i = 0; i < segments_.size(); ++i) {
-    accumulated_time += segments_[i].getTime();
-    // |<--t_accumulated -->|
-    // x----------x---------x
-    //               ^t_start
-    //            |chosen it|
-    // in case t_start falls on a vertex, the iterator right of the vertex is
-    // chosen, hence accumulated_segment_time_ns > t_start
-    if (accumulated_time > t) {
-      break;
-    }
-  }
-  if (t > accumulated_time) {
+  if (t > max_time_) {
     LOG(ERROR) << "Time out of range of the trajectory!";
     return Eigen::VectorXd::Zero(D(), 1);
   }
+  const int i = getSegmentIndex(t);
+  return storage_->segments[i].evaluate(
+      t - storage_->segment_start_times[i], derivative_order);
+}
 
-  // Make sure we don't go off the end of the segments (can happen if t is
-  // equal to trajectory max time).
-  if (i >= segments_.size()) {
-    i = segments_.size() - 1;
+int Trajectory::Cursor::seek(double t) {
+  const Segment::Vector& segments = trajectory_->segments();
+  const std::vector<double>& start_times =
+      trajectory_->storage_->segment_start_times;
+  CHECK(!segments.empty());
+  const int last_idx = segments.size() - 1;
+  segment_idx_ = std::min(segment_idx_, last_idx);
+
+  // Check the current and the next segment before searching.
+  for (int step = 0; step < 2; ++step) {
+    const bool after_start = segment_idx_ == 0 || t >= start_times[segment_idx_];
+    const bool before_end =
+        segment_idx_ == last_idx || t < start_times[segment_idx_ + 1];
+    if (after_start && before_end) {
+      return segment_idx_;
+    }
+    if (!after_start) {
+      break;
+    }
+    ++segment_idx_;
   }
-  // Go back to the start of this segment.
-  accumulated_time -= segments_[i].getTime();
+  segment_idx_ = trajectory_->getSegmentIndex(t);
+  return segment_idx_;
+}
 
-  return segments_[i].evaluate(t - accumulated_time, derivative_order);
+Eigen::VectorXd Trajectory::Cursor::evaluate(double t, int derivative_order) {
+  if (t > trajectory_->max_time_) {
+    LOG(ERROR) << "Time out of range of the trajectory!";
+    return Eigen::VectorXd::Zero(trajectory_->D(), 1);
+  }
+  const int i = seek(t);
+  return trajectory_->segments()[i].evaluate(
+      t - trajectory_->getSegmentStartTime(i), derivative_order);
 }
 
 void Trajectory::evaluateRange(double t_start, double t_end, double dt,
                                int derivative_order,
                                std::vector<Eigen::VectorXd>* result,
                                std::vector<double>* sampling_times) const {
+  MAV_TRAJECTORY_GENERATION_ALLOCATION_PHASE("trajectory_evaluate_range");
   const size_t expected_number_of_samples = (t_end - t_start) / dt + 1;
 
   result->clear();
@@ -85,44 +120,30 @@ void Trajectory::evaluateRange(double t_start, double t_end, double dt,
     sampling_times->reserve(expected_number_of_samples);
   }
 
-  double accumulated_time = 0.0;
-
-  // Look for the correct segment to start.
-  size_t i = 0;
-  for (i = 0; i < segments_.size(); ++i) {
-    accumulated_time += segments_[i].getTime();
-    // |<--t_accumulated -->|
-    // x----------x---------x
-    //               ^t_start
-    //            |chosen it|
-    // in case t_start falls on a vertex, the iterator right of the vertex is
-    // chosen, hence accumulated_segment_time_ns > t_start
-    if (accumulated_time > t_start) {
-      break;
-    }
-  }
-  if (t_start > accumulated_time) {
+  if (empty() || t_start > max_time_) {
     LOG(ERROR) << "Start time out of range of the trajectory!";
     return;
   }
+  const Segment::Vector& segments = storage_->segments;
 
-  // Go back to the start of this segment.
-  accumulated_time -= segments_[i].getTime();
+  // Look for the correct segment to start.
+  size_t i = getSegmentIndex(t_start);
+  double accumulated_time = storage_->segment_start_times[i];
   double time_in_segment = t_start - accumulated_time;
 
   // Get all the samples, incrementing the segments as we go.
   while (accumulated_time < t_end) {
-    if (time_in_segment > segments_[i].getTime()) {
-      time_in_segment = time_in_segment - segments_[i].getTime();
+    if (time_in_segment > segments[i].getTime()) {
+      time_in_segment = time_in_segment - segments[i].getTime();
       i++;
       // Make sure we don't access segments that don't exist!
-      if (i >= segments_.size()) {
+      if (i >= segments.size()) {
         break;
       }
       continue;
     }
 
-    result->push_back(segments_[i].evaluate(time_in_segment, derivative_order));
+    result->push_back(segments[i].evaluate(time_in_segment, derivative_order));
 
     if (sampling_times != nullptr) {
       sampling_times->push_back(accumulated_time);
@@ -133,21 +154,63 @@ void Trajectory::evaluateRange(double t_start, double t_end, double dt,
   }
 }
 
+bool Trajectory::evaluateRangeAllDerivatives(
+    double t_start, double t_end, double dt, int max_derivative,
+    Eigen::MatrixXd* result, std::vector<double>* sampling_times) const {
+  CHECK_NOTNULL(result);
+  CHECK_GT(dt, 0.0);
+  CHECK_GE(max_derivative, 0);
+  if (empty() || t_start < getMinTime() || t_end > max_time_ ||
+      t_start > t_end) {
+    LOG(ERROR) << "Range [" << t_start << " " << t_end
+               << "] out of range of the trajectory!";
+    return false;
+  }
+
+  const size_t n_samples = static_cast<size_t>((t_end - t_start) / dt) + 1;
+  const int n_derivatives = max_derivative + 1;
+  result->resize(D_ * n_derivatives, n_samples);
+  if (sampling_times != nullptr) {
+    sampling_times->resize(n_samples);
+  }
+
+  // Walk forward through the segments, the samples are ordered in time.
+  const Segment::Vector& segments = storage_->segments;
+  size_t i = getSegmentIndex(t_start);
+  double segment_start = storage_->segment_start_times[i];
+  for (size_t sample = 0; sample < n_samples; ++sample) {
+    const double t = std::min(t_start + sample * dt, t_end);
+    // In case t falls on a vertex, the segment right of the vertex is chosen.
+    while (i + 1 < segments.size() &&
+           t >= segment_start + segments[i].getTime()) {
+      segment_start += segments[i].getTime();
+      ++i;
+    }
+    Eigen::Map<Eigen::MatrixXd> state(result->col(sample).data(), D_,
+                                      n_derivatives);
+    segments[i].evaluateDerivatives(t - segment_start, max_derivative, state);
+    if (sampling_times != nullptr) {
+      (*sampling_times)[sample] = t;
+    }
+  }
+  return true;
+}
+
 Trajectory Trajectory::getTrajectoryWithSingleDimension(int dimension) const {
   CHECK_LT(dimension, D_);
 
   // Create a new set of segments with just 1 dimension.
   Segment::Vector segments;
-  segments.reserve(segments_.size());
+  segments.reserve(K());
 
-  for (size_t k = 0; k < segments_.size(); ++k) {
-    Segment segment(N_, 1);
-    segment[0] = (segments_[k])[dimension];
-    segments.push_back(segment);
+  for (const Segment& source : storage_->segments) {
+    segments.emplace_back(N_, 1);
+    segments.back().setTime(source.getTime());
+    segments.back()[0] = source[dimension];
   }
 
   Trajectory traj;
-  traj.setSegments(segments);
+  traj.setSegments(std::move(segments));
   return traj;
 }
 
@@ -162,61 +225,221 @@ bool Trajectory::getTrajectoryWithAppendedDimension(
     *new_trajectory = *this;
     return true;
   }
-  CHECK_EQ(static_cast<int>(segments_.size()), trajectory_to_append.K());
+  CHECK_EQ(K(), trajectory_to_append.K());
 
   // Create a new set of segments with all of the dimensions.
   Segment::Vector segments;
-  segments.reserve(segments_.size());
+  segments.reserve(K());
 
-  for (size_t k = 0; k < segments_.size(); ++k) {
+  for (int k = 0; k < K(); ++k) {
     Segment new_segment(0, 0);
-    if (!segments_[k].getSegmentWithAppendedDimension(
+    if (!storage_->segments[k].getSegmentWithAppendedDimension(
             trajectory_to_append.segments()[k], &new_segment)) {
       return false;
     }
     segments.push_back(new_segment);
   }
 
-  new_trajectory->setSegments(segments);
+  new_trajectory->setSegments(std::move(segments));
+  return true;
+}
+
+void Trajectory::append(const Trajectory& trajectory_to_append) {
+  if (trajectory_to_append.empty()) {
+    return;
+  }
+  if (empty()) {
+    *this = trajectory_to_append;
+    return;
+  }
+  CHECK_EQ(D_, trajectory_to_append.D());
+  // Holding a reference forces a copy in case of appending to itself.
+  const std::shared_ptr<const Storage> appended = trajectory_to_append.storage_;
+  Storage* storage = mutableStorage();
+  storage->segments.insert(storage->segments.end(), appended->segments.begin(),
+                           appended->segments.end());
+  updateSegmentStartTimes();
+}
+
+namespace {
+// Shifts the polynomial in time, such that new(t) = old(t + t_offset).
+void shiftPolynomial(double t_offset, Polynomial* polynomial) {
+  Eigen::VectorXd coefficients = polynomial->getCoefficientsRef();
+  Polynomial::shiftCoefficients(t_offset, coefficients.size(),
+                                coefficients.data());
+  polynomial->setCoefficients(coefficients);
+}
+}  // namespace
+
+bool Trajectory::getSubTrajectory(double t_start, double t_end,
+                                  Trajectory* sub_trajectory) const {
+  CHECK_NOTNULL(sub_trajectory);
+  if (empty() || t_start < getMinTime() || t_end > max_time_ ||
+      t_start >= t_end) {
+    LOG(ERROR) << "Range [" << t_start << " " << t_end
+               << "] out of range of the trajectory!";
+    return false;
+  }
+  if (t_start == getMinTime() && t_end == max_time_) {
+    *sub_trajectory = *this;
+    return true;
+  }
+
+  const std::vector<double>& start_times = storage_->segment_start_times;
+  const int first = getSegmentIndex(t_start);
+  // Unlike for t_start, a t_end on a vertex ends the segment left of it.
+  int last = getSegmentIndex(t_end);
+  if (last > first && t_end <= start_times[last]) {
+    --last;
+  }
+
+  Segment::Vector segments(storage_->segments.begin() + first,
+                           storage_->segments.begin() + last + 1);
+  for (int k = first; k <= last; ++k) {
+    Segment& segment = segments[k - first];
+    const double begin = std::max(t_start - start_times[k], 0.0);
+    const double end = std::min(t_end - start_times[k], segment.getTime());
+    if (begin > 0.0) {
+      for (int d = 0; d < D_; ++d) {
+        shiftPolynomial(begin, &segment[d]);
+      }
+    }
+    segment.setTime(end - begin);
+  }
+  sub_trajectory->setSegments(std::move(segments));
   return true;
 }
 
+std::shared_ptr<const ArcLengthTable> Trajectory::getArcLengthTable() const {
+  CHECK(!empty());
+  std::lock_guard<std::mutex> lock(storage_->arc_length_mutex);
+  if (!storage_->arc_length_table) {
+    storage_->arc_length_table = std::make_shared<ArcLengthTable>(*this);
+  }
+  return storage_->arc_length_table;
+}
+
 bool Trajectory::computeMinMaxMagnitude(int derivative,
                                         const std::vector<int>& dimensions,
-                                        Extremum* minimum,
-                                        Extremum* maximum) const {
+                                        Extremum* minimum, Extremum* maximum,
+                                        ThreadPool* thread_pool) const {
+  MAV_TRAJECTORY_GENERATION_ALLOCATION_PHASE("trajectory_min_max_magnitude");
   CHECK_NOTNULL(minimum);
   CHECK_NOTNULL(maximum);
   minimum->value = std::numeric_limits<double>::max();
   maximum->value = std::numeric_limits<double>::lowest();
 
-  // For all segments in the trajectory:
-  for (size_t segment_idx = 0; segment_idx < segments_.size(); segment_idx++) {
+  // Reduced in segment order below, such that ties are resolved the same
+  // with and without thread pool.
+  const Segment::Vector& segments = storage_->segments;
+  std::vector<Extremum> segment_minima(segments.size());
+  std::vector<Extremum> segment_maxima(segments.size());
+  std::vector<char> success(segments.size(), false);
+  const ThreadPool::Job job = [&](size_t segment_idx, size_t) {
+    const Segment& segment = segments[segment_idx];
     // Compute candidates.
     std::vector<Extremum> candidates;
-    if (!segments_[segment_idx].computeMinMaxMagnitudeCandidates(
-            derivative, 0.0, segments_[segment_idx].getTime(), dimensions,
-            &candidates)) {
-      return false;
+    if (!segment.computeMinMaxMagnitudeCandidates(
+            derivative, 0.0, segment.getTime(), dimensions, &candidates)) {
+      return;
     }
     // Evaluate candidates.
-    Extremum minimum_candidate, maximum_candidate;
-    if (!segments_[segment_idx].selectMinMaxMagnitudeFromCandidates(
-            0.0, segments_[segment_idx].getTime(), derivative, dimensions,
-            candidates, &minimum_candidate, &maximum_candidate)) {
+    success[segment_idx] = segment.selectMinMaxMagnitudeFromCandidates(
+        0.0, segment.getTime(), derivative, dimensions, candidates,
+        &segment_minima[segment_idx], &segment_maxima[segment_idx]);
+  };
+  if (thread_pool != nullptr && segments.size() > 1) {
+    thread_pool->parallelFor(segments.size(), job);
+  } else {
+    for (size_t segment_idx = 0; segment_idx < segments.size();
+         ++segment_idx) {
+      job(segment_idx, 0);
+    }
+  }
+
+  // Select minimum / maximum.
+  for (size_t segment_idx = 0; segment_idx < segments.size(); segment_idx++) {
+    if (!success[segment_idx]) {
       return false;
     }
-    // Select minimum / maximum.
-    if (minimum_candidate < *minimum) {
-      *minimum = minimum_candidate;
+    if (segment_minima[segment_idx] < *minimum) {
+      *minimum = segment_minima[segment_idx];
       minimum->segment_idx = static_cast<int>(segment_idx);
     }
-    if (maximum_candidate > *maximum) {
-      *maximum = maximum_candidate;
+    if (segment_maxima[segment_idx] > *maximum) {
+      *maximum = segment_maxima[segment_idx];
       maximum->segment_idx = static_cast<int>(segment_idx);
     }
   }
   return true;
 }
 
+bool Trajectory::exceedsMagnitude(int derivative,
+                                  const std::vector<int>& dimensions,
+                                  double limit, Extremum* violation) const {
+  const Segment::Vector& segments = storage_->segments;
+  // If a segment cannot be checked, it is reported as exceeding the limit.
+  auto reportUnchecked = [violation](size_t segment_idx) {
+    if (violation != nullptr) {
+      *violation = Extremum(0.0, std::numeric_limits<double>::infinity(),
+                            static_cast<int>(segment_idx));
+    }
+    return true;
+  };
+  if (segments.empty()) {
+    return false;
+  }
+  if (dimensions.empty()) {
+    LOG(WARNING) << "No dimensions specified.";
+    return reportUnchecked(0);
+  }
+  for (int dim : dimensions) {
+    if (dim < 0 || dim >= D()) {
+      LOG(WARNING) << "Dimension " << dim << " out of range.";
+      return reportUnchecked(0);
+    }
+  }
+
+  std::vector<double> candidate_times;
+  for (size_t segment_idx = 0; segment_idx < segments.size(); ++segment_idx) {
+    const Segment& segment = segments[segment_idx];
+    const double segment_time = segment.getTime();
+    // The magnitude is at most the norm of the largest absolute bound of
+    // every dimension.
+    double bound_squared = 0.0;
+    for (int dim : dimensions) {
+      double minimum, maximum;
+      segment[dim].computeBernsteinBounds(0.0, segment_time, derivative,
+                                          &minimum, &maximum);
+      const double bound = std::max(-minimum, maximum);
+      bound_squared += bound * bound;
+    }
+    if (bound_squared <= limit * limit) {
+      continue;
+    }
+
+    // The candidates include the start and the end of the segment. Without
+    // them, e.g. if the root finding fails, the bound has to be trusted.
+    if (!segment.computeMinMaxMagnitudeCandidateTimes(
+            derivative, 0.0, segment_time, dimensions, &candidate_times)) {
+      return reportUnchecked(segment_idx);
+    }
+    for (const double t : candidate_times) {
+      double magnitude_squared = 0.0;
+      for (int dim : dimensions) {
+        const double value = segment[dim].evaluate(t, derivative);
+        magnitude_squared += value * value;
+      }
+      const double magnitude = std::sqrt(magnitude_squared);
+      if (magnitude > limit) {
+        if (violation != nullptr) {
+          *violation = Extremum(t, magnitude, static_cast<int>(segment_idx));
+        }
+        return true;
+      }
+    }
+  }
+  return false;
+}
+
 }  // namespace mav_trajectory_generation
@@ -0,0 +1,144 @@
+/*
+ * Copyright (c) 2016, Markus Achtelik, ASL, ETH Zurich, Switzerland
+ * Copyright (c) 2016, Michael Burri, ASL, ETH Zurich, Switzerland
+ * Copyright (c) 2016, Helen Oleynikova, ASL, ETH Zurich, Switzerland
+ * Copyright (c) 2016, Rik Bähnemann, ASL, ETH Zurich, Switzerland
+ * Copyright (c) 2016, Marija Popovic, ASL, ETH Zurich, Switzerland
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "mav_trajectory_generation/trajectory_batch.h"
+
+#include <algorithm>
+
+namespace mav_trajectory_generation {
+
+namespace {
+// Number of samples evaluated by one job of the thread pool.
+constexpr size_t kSamplesPerJob = 1024;
+}  // namespace
+
+TrajectoryBatch::TrajectoryBatch(const std::vector<Trajectory>& trajectories,
+                                 int max_derivative)
+    : N_(0), D_(0), max_derivative_(max_derivative) {
+  CHECK_GE(max_derivative_, 0);
+  int n_segments = 0;
+  for (const Trajectory& trajectory : trajectories) {
+    CHECK(!trajectory.empty());
+    if (D_ == 0) {
+      D_ = trajectory.D();
+    }
+    CHECK_EQ(trajectory.D(), D_) << "All trajectories need the same dimension.";
+    N_ = std::max(N_, trajectory.N());
+    n_segments += trajectory.K();
+  }
+
+  const int block_size = (max_derivative_ + 1) * N_ * D_;
+  coefficients_.assign(n_segments * block_size, 0.0);
+  segment_start_times_.reserve(n_segments);
+  trajectory_segment_offsets_.reserve(trajectories.size() + 1);
+  max_times_.reserve(trajectories.size());
+
+  int segment_idx = 0;
+  trajectory_segment_offsets_.push_back(0);
+  for (const Trajectory& trajectory : trajectories) {
+    for (int i = 0; i < trajectory.K(); ++i) {
+      const Segment& segment = trajectory.segments()[i];
+      double* block = &coefficients_[segment_idx * block_size];
+      for (int d = 0; d < D_; ++d) {
+        const Eigen::VectorXd& coeffs = segment[d].getCoefficientsRef();
+        for (int k = 0; k <= max_derivative_; ++k) {
+          for (int j = k; j < segment.N(); ++j) {
+            block[(k * N_ + j) * D_ + d] =
+                Polynomial::base_coefficients_(k, j) * coeffs[j];
+          }
+        }
+      }
+      segment_start_times_.push_back(trajectory.getSegmentStartTime(i));
+      ++segment_idx;
+    }
+    trajectory_segment_offsets_.push_back(segment_idx);
+    max_times_.push_back(trajectory.getMaxTime());
+  }
+}
+
+bool TrajectoryBatch::evaluate(const int* trajectory_indices,
+                               const double* times, size_t n_samples,
+                               double* result, ThreadPool* thread_pool) const {
+  CHECK_NOTNULL(trajectory_indices);
+  CHECK_NOTNULL(times);
+  CHECK_NOTNULL(result);
+  if (thread_pool == nullptr || n_samples <= kSamplesPerJob) {
+    return evaluateSamples(trajectory_indices, times, 0, n_samples, result);
+  }
+
+  const size_t n_jobs = (n_samples + kSamplesPerJob - 1) / kSamplesPerJob;
+  std::vector<char> in_range(n_jobs, true);
+  thread_pool->parallelFor(n_jobs, [&](size_t job_idx, size_t) {
+    const size_t begin = job_idx * kSamplesPerJob;
+    const size_t end = std::min(begin + kSamplesPerJob, n_samples);
+    in_range[job_idx] =
+        evaluateSamples(trajectory_indices, times, begin, end, result);
+  });
+  return std::find(in_range.begin(), in_range.end(), false) == in_range.end();
+}
+
+bool TrajectoryBatch::evaluateSamples(const int* trajectory_indices,
+                                      const double* times, size_t begin,
+                                      size_t end, double* result) const {
+  const int sample_size = getSampleSize();
+  const int block_size = (max_derivative_ + 1) * N_ * D_;
+  const size_t n_trajectories = max_times_.size();
+  bool all_in_range = true;
+  for (size_t sample = begin; sample < end; ++sample) {
+    double* sample_result = result + sample * sample_size;
+    const int trajectory_idx = trajectory_indices[sample];
+    CHECK(trajectory_idx >= 0 &&
+          static_cast<size_t>(trajectory_idx) < n_trajectories)
+        << "Trajectory index " << trajectory_idx << " out of range.";
+    const double t = times[sample];
+    if (t > max_times_[trajectory_idx]) {
+      std::fill(sample_result, sample_result + sample_size, 0.0);
+      all_in_range = false;
+      continue;
+    }
+
+    // In case t falls on a vertex, the segment right of the vertex is chosen,
+    // as by Trajectory::getSegmentIndex().
+    const double* first_start =
+        &segment_start_times_[trajectory_segment_offsets_[trajectory_idx]];
+    const double* last_start =
+        &segment_start_times_[0] +
+        trajectory_segment_offsets_[trajectory_idx + 1];
+    const int segment_idx =
+        std::upper_bound(first_start + 1, last_start, t) - first_start - 1 +
+        trajectory_segment_offsets_[trajectory_idx];
+    const double t_segment = t - segment_start_times_[segment_idx];
+
+    const double* block = &coefficients_[segment_idx * block_size];
+    for (int k = 0; k <= max_derivative_; ++k) {
+      for (int d = 0; d < D_; ++d) {
+        // Horner's scheme, derivative k has powers t^0 ... t^{N-1-k}.
+        double value = 0.0;
+        for (int j = N_ - 1; j >= k; --j) {
+          value = value * t_segment + block[(k * N_ + j) * D_ + d];
+        }
+        sample_result[k * D_ + d] = value;
+      }
+    }
+  }
+  return all_in_range;
+}
+
+}  // namespace mav_trajectory_generation
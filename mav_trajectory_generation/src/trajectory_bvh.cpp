@@ -0,0 +1,295 @@
+/*
+ * Copyright (c) 2016, Markus Achtelik, ASL, ETH Zurich, Switzerland
+ * Copyright (c) 2016, Michael Burri, ASL, ETH Zurich, Switzerland
+ * Copyright (c) 2016, Helen Oleynikova, ASL, ETH Zurich, Switzerland
+ * Copyright (c) 2016, Rik Bähnemann, ASL, ETH Zurich, Switzerland
+ * Copyright (c) 2016, Marija Popovic, ASL, ETH Zurich, Switzerland
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "mav_trajectory_generation/trajectory_bvh.h"
+
+#include <algorithm>
+#include <limits>
+#include <queue>
+
+namespace mav_trajectory_generation {
+
+namespace {
+// Pieces shorter than this [s] are not bisected any further.
+constexpr double kMinPieceTime = 1.0e-9;
+
+bool overlapInTime(double a_start, double a_end, double b_start,
+                   double b_end) {
+  return std::max(a_start, b_start) <= std::min(a_end, b_end);
+}
+}  // namespace
+
+TrajectoryBvh::TrajectoryBvh(const Trajectory& trajectory, double tolerance)
+    : trajectory_(trajectory), tolerance_(tolerance) {
+  CHECK(!trajectory_.empty());
+  CHECK_GE(trajectory_.D(), 3) << "Needs a position in the first 3 dimensions.";
+  CHECK_GT(tolerance_, 0.0);
+  nodes_.reserve(2 * trajectory_.K() - 1);
+  build(0, trajectory_.K() - 1);
+}
+
+int TrajectoryBvh::build(int first_segment, int last_segment) {
+  const int node_idx = nodes_.size();
+  nodes_.emplace_back();
+  Node node;
+  if (first_segment == last_segment) {
+    const Piece leaf = getSegmentPiece(
+        first_segment, trajectory_.getSegmentStartTime(first_segment),
+        trajectory_.getSegmentStartTime(first_segment) +
+            trajectory_.segments()[first_segment].getTime());
+    node.box = leaf.box;
+    node.t_start = leaf.t_start;
+    node.t_end = leaf.t_end;
+    node.segment_idx = first_segment;
+    node.left = -1;
+    node.right = -1;
+  } else {
+    const int middle = (first_segment + last_segment) / 2;
+    node.left = build(first_segment, middle);
+    node.right = build(middle + 1, last_segment);
+    node.box = nodes_[node.left].box.merged(nodes_[node.right].box);
+    node.t_start = nodes_[node.left].t_start;
+    node.t_end = nodes_[node.right].t_end;
+    node.segment_idx = -1;
+  }
+  nodes_[node_idx] = node;
+  return node_idx;
+}
+
+TrajectoryBvh::Piece TrajectoryBvh::getNodePiece(int node_idx) const {
+  const Node& node = nodes_[node_idx];
+  Piece piece;
+  piece.box = node.box;
+  piece.t_start = node.t_start;
+  piece.t_end = node.t_end;
+  piece.node_idx = node_idx;
+  piece.segment_idx = node.segment_idx;
+  return piece;
+}
+
+TrajectoryBvh::Piece TrajectoryBvh::getSegmentPiece(int segment_idx,
+                                                    double t_start,
+                                                    double t_end) const {
+  const Segment& segment = trajectory_.segments()[segment_idx];
+  const double t_segment = trajectory_.getSegmentStartTime(segment_idx);
+  Piece piece;
+  for (int d = 0; d < 3; ++d) {
+    segment[d].computeBernsteinBounds(t_start - t_segment, t_end - t_segment, 0,
+                                      &piece.box.min()[d],
+                                      &piece.box.max()[d]);
+  }
+  piece.t_start = t_start;
+  piece.t_end = t_end;
+  piece.node_idx = -1;
+  piece.segment_idx = segment_idx;
+  return piece;
+}
+
+void TrajectoryBvh::split(const Piece& piece, Piece* first,
+                          Piece* second) const {
+  if (piece.segment_idx >= 0) {
+    const double t_middle = 0.5 * (piece.t_start + piece.t_end);
+    *first = getSegmentPiece(piece.segment_idx, piece.t_start, t_middle);
+    *second = getSegmentPiece(piece.segment_idx, t_middle, piece.t_end);
+    return;
+  }
+  const Node& node = nodes_[piece.node_idx];
+  *first = getNodePiece(node.left);
+  *second = getNodePiece(node.right);
+}
+
+bool TrajectoryBvh::isSmall(const Piece& piece) const {
+  return piece.box.diagonal().norm() <= tolerance_ ||
+         piece.t_end - piece.t_start <= kMinPieceTime;
+}
+
+Eigen::Vector3d TrajectoryBvh::getPosition(int segment_idx, double t) const {
+  const Segment& segment = trajectory_.segments()[segment_idx];
+  const double t_segment = t - trajectory_.getSegmentStartTime(segment_idx);
+  return Eigen::Vector3d(segment[0].evaluate(t_segment, 0),
+                         segment[1].evaluate(t_segment, 0),
+                         segment[2].evaluate(t_segment, 0));
+}
+
+bool TrajectoryBvh::intersectsBox(const Eigen::AlignedBox3d& box,
+                                  double* t_first) const {
+  // Depth first with the earlier piece on top, so the first hit is the
+  // earliest.
+  CHECK(!empty());
+  std::vector<Piece> stack(1, getNodePiece(0));
+  while (!stack.empty()) {
+    const Piece piece = stack.back();
+    stack.pop_back();
+    if (!box.intersects(piece.box)) {
+      continue;
+    }
+    if (box.contains(piece.box) || isSmall(piece)) {
+      if (t_first != nullptr) {
+        *t_first = piece.t_start;
+      }
+      return true;
+    }
+    Piece first, second;
+    split(piece, &first, &second);
+    stack.push_back(second);
+    stack.push_back(first);
+  }
+  return false;
+}
+
+bool TrajectoryBvh::intersectsSphere(const Eigen::Vector3d& center,
+                                     double radius, double* t_first) const {
+  CHECK(!empty());
+  std::vector<Piece> stack(1, getNodePiece(0));
+  while (!stack.empty()) {
+    const Piece piece = stack.back();
+    stack.pop_back();
+    if (piece.box.exteriorDistance(center) > radius) {
+      continue;
+    }
+    const Eigen::Vector3d farthest_corner =
+        (piece.box.min() - center).cwiseAbs().cwiseMax(
+            (piece.box.max() - center).cwiseAbs());
+    if (farthest_corner.norm() <= radius || isSmall(piece)) {
+      if (t_first != nullptr) {
+        *t_first = piece.t_start;
+      }
+      return true;
+    }
+    Piece first, second;
+    split(piece, &first, &second);
+    stack.push_back(second);
+    stack.push_back(first);
+  }
+  return false;
+}
+
+double TrajectoryBvh::getDistance(const Eigen::Vector3d& point,
+                                  double* t_closest) const {
+  // Best first by the distance to the box, a lower bound for the piece.
+  // Pieces of segments are evaluated in the middle for an upper bound.
+  typedef std::pair<double, Piece> Candidate;
+  auto further = [](const Candidate& a, const Candidate& b) {
+    return a.first > b.first;
+  };
+  std::priority_queue<Candidate, std::vector<Candidate>, decltype(further)>
+      queue(further);
+  CHECK(!empty());
+  const Piece root = getNodePiece(0);
+  queue.emplace(root.box.exteriorDistance(point), root);
+
+  double best = std::numeric_limits<double>::max();
+  double t_best = 0.0;
+  while (!queue.empty() && queue.top().first < best - tolerance_) {
+    const Piece piece = queue.top().second;
+    queue.pop();
+    if (piece.segment_idx >= 0) {
+      const double t_middle = 0.5 * (piece.t_start + piece.t_end);
+      const double distance =
+          (getPosition(piece.segment_idx, t_middle) - point).norm();
+      if (distance < best) {
+        best = distance;
+        t_best = t_middle;
+      }
+    }
+    if (isSmall(piece)) {
+      continue;
+    }
+    Piece first, second;
+    split(piece, &first, &second);
+    queue.emplace(first.box.exteriorDistance(point), first);
+    queue.emplace(second.box.exteriorDistance(point), second);
+  }
+  if (t_closest != nullptr) {
+    *t_closest = t_best;
+  }
+  return best;
+}
+
+double TrajectoryBvh::getClosestApproach(const TrajectoryBvh& other,
+                                         double* t_closest) const {
+  CHECK(!empty());
+  CHECK(!other.empty());
+  struct Candidate {
+    double lower_bound;
+    Piece piece;
+    Piece other_piece;
+  };
+  auto further = [](const Candidate& a, const Candidate& b) {
+    return a.lower_bound > b.lower_bound;
+  };
+  std::priority_queue<Candidate, std::vector<Candidate>, decltype(further)>
+      queue(further);
+  auto push = [&queue](const Piece& piece, const Piece& other_piece) {
+    if (overlapInTime(piece.t_start, piece.t_end, other_piece.t_start,
+                      other_piece.t_end)) {
+      queue.push(Candidate{piece.box.exteriorDistance(other_piece.box), piece,
+                           other_piece});
+    }
+  };
+  push(getNodePiece(0), other.getNodePiece(0));
+
+  double best = std::numeric_limits<double>::max();
+  double t_best = 0.0;
+  while (!queue.empty() && queue.top().lower_bound < best - tolerance_) {
+    const Candidate candidate = queue.top();
+    queue.pop();
+    const Piece& piece = candidate.piece;
+    const Piece& other_piece = candidate.other_piece;
+    if (piece.segment_idx >= 0 && other_piece.segment_idx >= 0) {
+      const double t_middle = 0.5 * (std::max(piece.t_start,
+                                              other_piece.t_start) +
+                                     std::min(piece.t_end, other_piece.t_end));
+      const double distance =
+          (getPosition(piece.segment_idx, t_middle) -
+           other.getPosition(other_piece.segment_idx, t_middle))
+              .norm();
+      if (distance < best) {
+        best = distance;
+        t_best = t_middle;
+      }
+    }
+
+    // Split the longer piece, or the other one if it is small enough.
+    const bool small = isSmall(piece);
+    const bool other_small = other.isSmall(other_piece);
+    if (small && other_small) {
+      continue;
+    }
+    const bool longer = piece.t_end - piece.t_start >=
+                        other_piece.t_end - other_piece.t_start;
+    Piece first, second;
+    if (other_small || (!small && longer)) {
+      split(piece, &first, &second);
+      push(first, other_piece);
+      push(second, other_piece);
+    } else {
+      other.split(other_piece, &first, &second);
+      push(piece, first);
+      push(piece, second);
+    }
+  }
+  if (t_closest != nullptr) {
+    *t_closest = t_best;
+  }
+  return best;
+}
+
+}  // namespace mav_trajectory_generation
@@ -0,0 +1,645 @@
+/*
+ * Copyright (c) 2016, Markus Achtelik, ASL, ETH Zurich, Switzerland
+ * Copyright (c) 2016, Michael Burri, ASL, ETH Zurich, Switzerland
+ * Copyright (c) 2016, Helen Oleynikova, ASL, ETH Zurich, Switzerland
+ * Copyright (c) 2016, Rik Bähnemann, ASL, ETH Zurich, Switzerland
+ * Copyright (c) 2016, Marija Popovic, ASL, ETH Zurich, Switzerland
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "mav_trajectory_generation/trajectory_compression.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+#include <Eigen/LU>
+#include <Eigen/QR>
+
+namespace mav_trajectory_generation {
+
+namespace {
+
+constexpr uint32_t kCompressionMagic = 0x4352544d;  // "MTRC"
+constexpr uint8_t kCompressionVersion = 1;
+// Resolution of the segment durations.
+constexpr double kTimeResolution = 1.0e-6;
+// Number of times the quantization steps are halved before giving up.
+constexpr int kMaxQuantizationRetries = 8;
+// Largest quantized magnitude, keeps the decoded values exact in double.
+constexpr double kMaxQuantized = 9.0e15;
+
+void writeUint8(uint8_t value, std::vector<uint8_t>* data) {
+  data->push_back(value);
+}
+
+void writeUint32(uint32_t value, std::vector<uint8_t>* data) {
+  for (int i = 0; i < 4; ++i) {
+    data->push_back(static_cast<uint8_t>(value >> (8 * i)));
+  }
+}
+
+void writeFloat(float value, std::vector<uint8_t>* data) {
+  uint32_t bits;
+  std::memcpy(&bits, &value, sizeof(bits));
+  writeUint32(bits, data);
+}
+
+void writeVarint(uint64_t value, std::vector<uint8_t>* data) {
+  while (value >= 0x80) {
+    data->push_back(static_cast<uint8_t>(value | 0x80));
+    value >>= 7;
+  }
+  data->push_back(static_cast<uint8_t>(value));
+}
+
+// Zigzag encoding keeps small negative values short.
+void writeSignedVarint(int64_t value, std::vector<uint8_t>* data) {
+  writeVarint((static_cast<uint64_t>(value) << 1) ^
+                  static_cast<uint64_t>(value >> 63),
+              data);
+}
+
+// Reads from data at *pos and advances *pos. Return false at the end of data.
+class Reader {
+ public:
+  explicit Reader(const std::vector<uint8_t>& data) : data_(data), pos_(0) {}
+
+  bool atEnd() const { return pos_ == data_.size(); }
+
+  bool readUint8(uint8_t* value) {
+    if (pos_ >= data_.size()) {
+      return false;
+    }
+    *value = data_[pos_++];
+    return true;
+  }
+
+  bool readUint32(uint32_t* value) {
+    if (pos_ + 4 > data_.size()) {
+      return false;
+    }
+    *value = 0;
+    for (int i = 0; i < 4; ++i) {
+      *value |= static_cast<uint32_t>(data_[pos_++]) << (8 * i);
+    }
+    return true;
+  }
+
+  bool readFloat(float* value) {
+    uint32_t bits;
+    if (!readUint32(&bits)) {
+      return false;
+    }
+    std::memcpy(value, &bits, sizeof(bits));
+    return true;
+  }
+
+  bool readVarint(uint64_t* value) {
+    *value = 0;
+    for (int shift = 0; shift < 64; shift += 7) {
+      uint8_t byte;
+      if (!readUint8(&byte)) {
+        return false;
+      }
+      *value |= static_cast<uint64_t>(byte & 0x7f) << shift;
+      if ((byte & 0x80) == 0) {
+        return true;
+      }
+    }
+    return false;
+  }
+
+  bool readSignedVarint(int64_t* value) {
+    uint64_t zigzag;
+    if (!readVarint(&zigzag)) {
+      return false;
+    }
+    *value = static_cast<int64_t>(zigzag >> 1) ^
+             -static_cast<int64_t>(zigzag & 1);
+    return true;
+  }
+
+ private:
+  const std::vector<uint8_t>& data_;
+  size_t pos_;
+};
+
+// Coefficients in powers of the normalized time tau of the Hermite and the
+// bubble part of a compressed segment.
+class SegmentBasis {
+ public:
+  SegmentBasis(int continuity_derivative, int N)
+      : c_(continuity_derivative), n_hermite_(2 * (c_ + 1)), N_(N) {
+    CHECK_GE(N_, n_hermite_);
+    // Maps the normalized derivatives at tau = 0 and tau = 1 to the
+    // coefficients.
+    Eigen::MatrixXd constraints(n_hermite_, n_hermite_);
+    for (int k = 0; k <= c_; ++k) {
+      constraints.row(k) =
+          Polynomial::baseCoeffsWithTime(n_hermite_, k, 0.0).transpose();
+      constraints.row(c_ + 1 + k) =
+          Polynomial::baseCoeffsWithTime(n_hermite_, k, 1.0).transpose();
+    }
+    hermite_ = constraints.fullPivLu().inverse();
+
+    // Weight tau^(c+1) * (1 - tau)^(c+1).
+    Eigen::VectorXd weight = Eigen::VectorXd::Zero(n_hermite_ + 1);
+    double binomial = 1.0;
+    for (int j = 0; j <= c_ + 1; ++j) {
+      weight[c_ + 1 + j] = (j % 2 == 0 ? 1.0 : -1.0) * binomial;
+      binomial = binomial * (c_ + 1 - j) / (j + 1);
+    }
+    // Chebyshev polynomials in 2 * tau - 1, T_j+1 = 2 * (2 * tau - 1) * T_j
+    // - T_j-1.
+    const int n_bubble = N_ - n_hermite_;
+    bubble_ = Eigen::MatrixXd::Zero(N_, n_bubble);
+    Eigen::VectorXd chebyshev_prev = Eigen::VectorXd::Zero(N_);
+    Eigen::VectorXd chebyshev = Eigen::VectorXd::Zero(N_);
+    chebyshev[0] = 1.0;
+    for (int j = 0; j < n_bubble; ++j) {
+      for (int i = 0; i < n_bubble; ++i) {
+        bubble_.col(j).segment(i, n_hermite_ + 1) += chebyshev[i] * weight;
+      }
+      Eigen::VectorXd chebyshev_next = -chebyshev_prev;
+      for (int i = 0; i + 1 < N_; ++i) {
+        const double factor = j == 0 ? 1.0 : 2.0;
+        chebyshev_next[i] -= factor * chebyshev[i];
+        chebyshev_next[i + 1] += 2.0 * factor * chebyshev[i];
+      }
+      chebyshev_prev = chebyshev;
+      chebyshev = chebyshev_next;
+    }
+  }
+
+  int getNumHermite() const { return n_hermite_; }
+  int getMaxNumBubble() const { return N_ - n_hermite_; }
+
+  // Values of the first n_bubble bubble basis functions at tau.
+  void evaluateBubble(double tau, int n_bubble, double* values) const {
+    const double weight = std::pow(tau * (1.0 - tau), c_ + 1);
+    const double x = 2.0 * tau - 1.0;
+    double chebyshev_prev = 1.0;
+    double chebyshev = x;
+    for (int j = 0; j < n_bubble; ++j) {
+      if (j == 0) {
+        values[j] = weight;
+        continue;
+      }
+      values[j] = weight * chebyshev;
+      const double chebyshev_next = 2.0 * x * chebyshev - chebyshev_prev;
+      chebyshev_prev = chebyshev;
+      chebyshev = chebyshev_next;
+    }
+  }
+
+  // Normalized coefficients of the Hermite part from the physical boundary
+  // derivatives (c + 1 x D) of a segment with the given duration.
+  Eigen::MatrixXd getHermiteCoefficients(const Eigen::MatrixXd& start,
+                                         const Eigen::MatrixXd& end,
+                                         double duration) const {
+    Eigen::MatrixXd normalized(n_hermite_, start.cols());
+    double scale = 1.0;
+    for (int k = 0; k <= c_; ++k) {
+      normalized.row(k) = start.row(k) * scale;
+      normalized.row(c_ + 1 + k) = end.row(k) * scale;
+      scale *= duration;
+    }
+    return hermite_ * normalized;
+  }
+
+  // Segment with N coefficients in powers of the segment time.
+  void getSegment(const Eigen::MatrixXd& hermite_coefficients,
+                  const Eigen::MatrixXd& bubble_coefficients, double duration,
+                  Segment* segment) const {
+    const int D = hermite_coefficients.cols();
+    const int n_bubble = bubble_coefficients.rows();
+    *segment = Segment(N_, D);
+    segment->setTime(duration);
+    for (int d = 0; d < D; ++d) {
+      Eigen::VectorXd coefficients = Eigen::VectorXd::Zero(N_);
+      coefficients.head(n_hermite_) = hermite_coefficients.col(d);
+      if (n_bubble > 0) {
+        coefficients += bubble_.leftCols(n_bubble) * bubble_coefficients.col(d);
+      }
+      double scale = 1.0;
+      for (int j = 0; j < N_; ++j) {
+        coefficients[j] *= scale;
+        scale /= duration;
+      }
+      (*segment)[d].setCoefficients(coefficients);
+    }
+  }
+
+ private:
+  int c_;
+  int n_hermite_;
+  int N_;
+  Eigen::MatrixXd hermite_;
+  Eigen::MatrixXd bubble_;
+};
+
+// Evaluates the trajectory, extrapolating the last segment beyond the end.
+Eigen::VectorXd evaluateExtrapolated(const Trajectory& trajectory, double t,
+                                     int derivative) {
+  const int i = trajectory.getSegmentIndex(t);
+  return trajectory.segments()[i].evaluate(
+      t - trajectory.getSegmentStartTime(i), derivative);
+}
+
+// Derivatives 0..c of the trajectory at the times, (c + 1 x D) each.
+std::vector<Eigen::MatrixXd> getBoundaryDerivatives(
+    const Trajectory& trajectory, const std::vector<double>& times, int c) {
+  std::vector<Eigen::MatrixXd> derivatives(times.size());
+  for (size_t i = 0; i < times.size(); ++i) {
+    derivatives[i].resize(c + 1, trajectory.D());
+    for (int k = 0; k <= c; ++k) {
+      derivatives[i].row(k) =
+          evaluateExtrapolated(trajectory, times[i], k).transpose();
+    }
+  }
+  return derivatives;
+}
+
+// Fits a segment to the trajectory. The fit is over the intervals
+// [boundary_begin, boundary_end) of the boundary times, each sampled
+// uniformly.
+class SegmentFitter {
+ public:
+  SegmentFitter(const Trajectory& trajectory, const SegmentBasis& basis,
+                const std::vector<double>& boundary_times,
+                int samples_per_interval)
+      : trajectory_(trajectory),
+        basis_(basis),
+        boundary_times_(boundary_times),
+        samples_per_interval_(samples_per_interval) {}
+
+  // Least squares fit of the bubble coefficients (n_bubble x D) with the
+  // given boundary derivatives. Returns the maximum absolute error at the
+  // samples.
+  double fit(size_t boundary_begin, size_t boundary_end,
+             const Eigen::MatrixXd& start, const Eigen::MatrixXd& end,
+             int n_bubble, Eigen::MatrixXd* bubble_coefficients) const {
+    const double t_start = boundary_times_[boundary_begin];
+    const double duration = boundary_times_[boundary_end] - t_start;
+    const int D = trajectory_.D();
+    const Eigen::MatrixXd hermite =
+        basis_.getHermiteCoefficients(start, end, duration);
+
+    const int n_samples =
+        (boundary_end - boundary_begin) * samples_per_interval_ + 1;
+    Eigen::MatrixXd residuals(n_samples, D);
+    Eigen::MatrixXd bubble_basis(n_samples, n_bubble);
+    Eigen::VectorXd bubble_values(n_bubble);
+    int sample = 0;
+    for (size_t b = boundary_begin; b < boundary_end; ++b) {
+      const double interval_start = boundary_times_[b];
+      const double interval = boundary_times_[b + 1] - interval_start;
+      const int n = b + 1 == boundary_end ? samples_per_interval_ + 1
+                                          : samples_per_interval_;
+      for (int i = 0; i < n; ++i, ++sample) {
+        const double t = interval_start + interval * i / samples_per_interval_;
+        const double tau = (t - t_start) / duration;
+        residuals.row(sample) =
+            evaluateExtrapolated(trajectory_, t, derivative_order::POSITION)
+                .transpose();
+        double tau_power = 1.0;
+        for (int j = 0; j < hermite.rows(); ++j) {
+          residuals.row(sample) -= tau_power * hermite.row(j);
+          tau_power *= tau;
+        }
+        if (n_bubble > 0) {
+          basis_.evaluateBubble(tau, n_bubble, bubble_values.data());
+          bubble_basis.row(sample) = bubble_values.transpose();
+        }
+      }
+    }
+
+    if (n_bubble == 0) {
+      bubble_coefficients->resize(0, D);
+      return residuals.cwiseAbs().maxCoeff();
+    }
+    *bubble_coefficients = bubble_basis.colPivHouseholderQr().solve(residuals);
+    return (bubble_basis * (*bubble_coefficients) - residuals)
+        .cwiseAbs()
+        .maxCoeff();
+  }
+
+ private:
+  const Trajectory& trajectory_;
+  const SegmentBasis& basis_;
+  const std::vector<double>& boundary_times_;
+  int samples_per_interval_;
+};
+
+bool quantize(double value, double step, int64_t* quantized) {
+  const double scaled = std::round(value / step);
+  if (!std::isfinite(scaled) || std::abs(scaled) > kMaxQuantized) {
+    return false;
+  }
+  *quantized = static_cast<int64_t>(scaled);
+  return true;
+}
+
+// Maximum absolute error of the derivatives 0..c over all dimensions,
+// sampled uniformly on every segment of the original trajectory.
+std::vector<double> computeMaxErrors(const Trajectory& original,
+                                     const Trajectory& compressed, int c,
+                                     int samples_per_segment) {
+  std::vector<double> max_errors(c + 1, 0.0);
+  const double t_max = std::min(original.getMaxTime(), compressed.getMaxTime());
+  for (int i = 0; i < original.K(); ++i) {
+    const double segment_start = original.getSegmentStartTime(i);
+    const double segment_time = original.segments()[i].getTime();
+    for (int j = 0; j <= samples_per_segment; ++j) {
+      const double t = std::min(
+          segment_start + segment_time * j / samples_per_segment, t_max);
+      for (int k = 0; k <= c; ++k) {
+        const double error = (evaluateExtrapolated(original, t, k) -
+                              evaluateExtrapolated(compressed, t, k))
+                                 .cwiseAbs()
+                                 .maxCoeff();
+        max_errors[k] = std::max(max_errors[k], error);
+      }
+    }
+  }
+  return max_errors;
+}
+
+}  // namespace
+
+bool compressTrajectory(const Trajectory& trajectory,
+                        const CompressionParameters& parameters,
+                        std::vector<uint8_t>* data,
+                        CompressionReport* report) {
+  CHECK_NOTNULL(data);
+  CHECK_GT(parameters.tolerance, 0.0);
+  CHECK_GE(parameters.continuity_derivative, 0);
+  CHECK_GT(parameters.quantization_share, 0.0);
+  CHECK_LT(parameters.quantization_share, 1.0);
+  CHECK_GT(parameters.samples_per_segment, 0);
+  const int c = parameters.continuity_derivative;
+  if (trajectory.empty() || parameters.max_N < 2 * (c + 1) ||
+      parameters.max_N > Polynomial::kMaxN) {
+    return false;
+  }
+  const int D = trajectory.D();
+  const SegmentBasis basis(c, parameters.max_N);
+
+  // Segment boundaries rounded to the time resolution. Rounding the absolute
+  // times keeps the rounding errors from accumulating.
+  std::vector<int64_t> boundary_ticks;
+  for (int i = 0; i <= trajectory.K(); ++i) {
+    const double t = i == trajectory.K() ? trajectory.getMaxTime()
+                                         : trajectory.getSegmentStartTime(i);
+    const int64_t ticks = std::llround(t / kTimeResolution);
+    if (boundary_ticks.empty() || ticks > boundary_ticks.back()) {
+      boundary_ticks.push_back(ticks);
+    }
+  }
+  if (boundary_ticks.size() < 2) {
+    return false;
+  }
+  std::vector<double> boundary_times(boundary_ticks.size());
+  for (size_t i = 0; i < boundary_ticks.size(); ++i) {
+    boundary_times[i] = boundary_ticks[i] * kTimeResolution;
+  }
+  const size_t num_intervals = boundary_times.size() - 1;
+  const std::vector<Eigen::MatrixXd> boundary_derivatives =
+      getBoundaryDerivatives(trajectory, boundary_times, c);
+  const SegmentFitter fitter(trajectory, basis, boundary_times,
+                             parameters.samples_per_segment);
+
+  // Greedily merge intervals while a segment with the most coefficients
+  // fits, then lower its order as far as possible.
+  const double refit_tolerance =
+      (1.0 - parameters.quantization_share) * parameters.tolerance;
+  auto fits = [&](size_t begin, size_t end, int n_bubble) {
+    Eigen::MatrixXd bubble_coefficients;
+    return fitter.fit(begin, end, boundary_derivatives[begin],
+                      boundary_derivatives[end], n_bubble,
+                      &bubble_coefficients) <= refit_tolerance;
+  };
+  std::vector<size_t> segment_boundaries(1, 0);
+  std::vector<int> segment_n_bubble;
+  const int max_n_bubble = basis.getMaxNumBubble();
+  for (size_t begin = 0; begin < num_intervals;) {
+    size_t end = begin + 1;
+    while (parameters.merge_segments && end < num_intervals &&
+           fits(begin, end + 1, max_n_bubble)) {
+      ++end;
+    }
+    int n_bubble = max_n_bubble;
+    while (n_bubble > 0 && fits(begin, end, n_bubble - 1)) {
+      --n_bubble;
+    }
+    segment_boundaries.push_back(end);
+    segment_n_bubble.push_back(n_bubble);
+    begin = end;
+  }
+  const size_t K = segment_n_bubble.size();
+  const int N = basis.getNumHermite() +
+                *std::max_element(segment_n_bubble.begin(),
+                                  segment_n_bubble.end());
+  const SegmentBasis output_basis(c, N);
+
+  // Quantization steps. The derivative steps are scaled with the longest
+  // segment, so that their effect on the position is comparable.
+  double longest_segment = 0.0;
+  for (size_t i = 0; i < K; ++i) {
+    longest_segment = std::max(
+        longest_segment, boundary_times[segment_boundaries[i + 1]] -
+                             boundary_times[segment_boundaries[i]]);
+  }
+  const double position_step =
+      parameters.quantization_share * parameters.tolerance;
+  std::vector<float> steps(c + 2);
+  for (int k = 0; k <= c; ++k) {
+    steps[k] = position_step / std::pow(longest_segment, k);
+  }
+  // |T_j| <= 1 and the bubble weight is at most 4^-(c+1).
+  steps[c + 1] = position_step * std::pow(4.0, c + 1) / std::max(1, N);
+
+  Trajectory decoded;
+  std::vector<double> max_errors;
+  for (int attempt = 0; attempt <= kMaxQuantizationRetries; ++attempt) {
+    if (attempt > 0) {
+      for (float& step : steps) {
+        step *= 0.5f;
+      }
+    }
+    data->clear();
+    writeUint32(kCompressionMagic, data);
+    writeUint8(kCompressionVersion, data);
+    writeUint8(static_cast<uint8_t>(D), data);
+    writeUint8(static_cast<uint8_t>(c), data);
+    writeUint8(static_cast<uint8_t>(N), data);
+    for (float step : steps) {
+      writeFloat(step, data);
+    }
+    writeVarint(K, data);
+
+    // Quantized boundary derivatives.
+    bool valid = true;
+    std::vector<Eigen::MatrixXd> quantized_boundaries(K + 1);
+    Eigen::Matrix<int64_t, Eigen::Dynamic, Eigen::Dynamic> previous =
+        Eigen::Matrix<int64_t, Eigen::Dynamic, Eigen::Dynamic>::Zero(c + 1, D);
+    std::vector<std::vector<int64_t>> boundary_deltas(K + 1);
+    for (size_t i = 0; i <= K && valid; ++i) {
+      const Eigen::MatrixXd& derivatives =
+          boundary_derivatives[segment_boundaries[i]];
+      quantized_boundaries[i].resize(c + 1, D);
+      for (int k = 0; k <= c && valid; ++k) {
+        for (int d = 0; d < D && valid; ++d) {
+          int64_t quantized = 0;
+          valid = quantize(derivatives(k, d), steps[k], &quantized);
+          boundary_deltas[i].push_back(quantized - previous(k, d));
+          previous(k, d) = quantized;
+          quantized_boundaries[i](k, d) =
+              quantized * static_cast<double>(steps[k]);
+        }
+      }
+    }
+    if (!valid) {
+      return false;
+    }
+    for (int64_t delta : boundary_deltas[0]) {
+      writeSignedVarint(delta, data);
+    }
+
+    for (size_t i = 0; i < K && valid; ++i) {
+      const size_t begin = segment_boundaries[i];
+      const size_t end = segment_boundaries[i + 1];
+      writeVarint(boundary_ticks[end] - boundary_ticks[begin], data);
+      writeUint8(static_cast<uint8_t>(segment_n_bubble[i]), data);
+      for (int64_t delta : boundary_deltas[i + 1]) {
+        writeSignedVarint(delta, data);
+      }
+      // Refit the bubble to the quantized boundaries, which compensates part
+      // of their quantization error.
+      Eigen::MatrixXd bubble_coefficients;
+      fitter.fit(begin, end, quantized_boundaries[i],
+                 quantized_boundaries[i + 1], segment_n_bubble[i],
+                 &bubble_coefficients);
+      for (int d = 0; d < D && valid; ++d) {
+        for (int j = 0; j < segment_n_bubble[i] && valid; ++j) {
+          int64_t quantized = 0;
+          valid = quantize(bubble_coefficients(j, d), steps[c + 1], &quantized);
+          writeSignedVarint(quantized, data);
+        }
+      }
+    }
+    if (!valid || !decompressTrajectory(*data, &decoded)) {
+      return false;
+    }
+    max_errors = computeMaxErrors(trajectory, decoded, c,
+                                  2 * parameters.samples_per_segment);
+    if (max_errors[derivative_order::POSITION] <= parameters.tolerance) {
+      break;
+    }
+  }
+
+  if (report != nullptr) {
+    report->num_segments_in = trajectory.K();
+    report->num_segments_out = K;
+    report->uncompressed_bytes = 0;
+    for (const Segment& segment : trajectory.segments()) {
+      report->uncompressed_bytes +=
+          sizeof(double) * (1 + segment.D() * segment.N());
+    }
+    report->compressed_bytes = data->size();
+    report->max_error = max_errors;
+  }
+  return max_errors[derivative_order::POSITION] <= parameters.tolerance;
+}
+
+bool decompressTrajectory(const std::vector<uint8_t>& data,
+                          Trajectory* trajectory) {
+  CHECK_NOTNULL(trajectory);
+  Reader reader(data);
+  uint32_t magic;
+  uint8_t version, D, c, N;
+  if (!reader.readUint32(&magic) || magic != kCompressionMagic ||
+      !reader.readUint8(&version) || version != kCompressionVersion ||
+      !reader.readUint8(&D) || !reader.readUint8(&c) || !reader.readUint8(&N) ||
+      D == 0 || N < 2 * (c + 1) || N > Polynomial::kMaxN) {
+    return false;
+  }
+  std::vector<double> steps(c + 2);
+  for (double& step : steps) {
+    float value;
+    if (!reader.readFloat(&value) || !std::isfinite(value) || value <= 0.0f) {
+      return false;
+    }
+    step = value;
+  }
+  uint64_t K;
+  if (!reader.readVarint(&K) || K == 0 || K > data.size()) {
+    return false;
+  }
+
+  const SegmentBasis basis(c, N);
+  Eigen::Matrix<int64_t, Eigen::Dynamic, Eigen::Dynamic> quantized =
+      Eigen::Matrix<int64_t, Eigen::Dynamic, Eigen::Dynamic>::Zero(c + 1, D);
+  auto read_boundary = [&](Eigen::MatrixXd* boundary) {
+    boundary->resize(c + 1, D);
+    for (int k = 0; k <= c; ++k) {
+      for (int d = 0; d < D; ++d) {
+        int64_t delta;
+        if (!reader.readSignedVarint(&delta)) {
+          return false;
+        }
+        quantized(k, d) += delta;
+        (*boundary)(k, d) = quantized(k, d) * steps[k];
+      }
+    }
+    return true;
+  };
+
+  Eigen::MatrixXd start, end;
+  if (!read_boundary(&start)) {
+    return false;
+  }
+  Segment::Vector segments(K, Segment(N, D));
+  for (Segment& segment : segments) {
+    uint64_t ticks;
+    uint8_t n_bubble;
+    if (!reader.readVarint(&ticks) || ticks == 0 ||
+        !reader.readUint8(&n_bubble) ||
+        n_bubble > basis.getMaxNumBubble() || !read_boundary(&end)) {
+      return false;
+    }
+    const double duration = ticks * kTimeResolution;
+    Eigen::MatrixXd bubble_coefficients(n_bubble, D);
+    for (int d = 0; d < D; ++d) {
+      for (int j = 0; j < n_bubble; ++j) {
+        int64_t value;
+        if (!reader.readSignedVarint(&value)) {
+          return false;
+        }
+        bubble_coefficients(j, d) = value * steps[c + 1];
+      }
+    }
+    basis.getSegment(basis.getHermiteCoefficients(start, end, duration),
+                     bubble_coefficients, duration, &segment);
+    start = end;
+  }
+  if (!reader.atEnd()) {
+    return false;
+  }
+  trajectory->setSegments(segments);
+  return true;
+}
+
+}  // namespace mav_trajectory_generation
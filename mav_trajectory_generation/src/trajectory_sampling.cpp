@@ -20,9 +20,47 @@
 
 #include "mav_trajectory_generation/trajectory_sampling.h"
 
+#include <algorithm>
+
+#include "mav_trajectory_generation/vectorized_segment.h"
+
 namespace mav_trajectory_generation {
 
 const double kNumNanosecondsPerSecond = 1.e9;
+const int kMaxDerivative = derivative_order::SNAP;
+
+namespace {
+
+// Converts the output of evaluateRangeAllDerivatives() (up to snap) into
+// flat states.
+void statesFromSamples(const Eigen::MatrixXd& samples, int dimension,
+                       double min_time, double sampling_interval,
+                       mav_msgs::EigenTrajectoryPointVector* states) {
+  size_t n_samples = samples.cols();
+
+  states->resize(n_samples);
+  for (size_t i = 0; i < n_samples; ++i) {
+    mav_msgs::EigenTrajectoryPoint& state = (*states)[i];
+    Eigen::Map<const Eigen::MatrixXd> sample(samples.col(i).data(),
+                                             dimension, kMaxDerivative + 1);
+
+    state.position_W = sample.col(derivative_order::POSITION).head<3>();
+    state.velocity_W = sample.col(derivative_order::VELOCITY).head<3>();
+    state.acceleration_W =
+        sample.col(derivative_order::ACCELERATION).head<3>();
+    state.jerk_W = sample.col(derivative_order::JERK).head<3>();
+    state.snap_W = sample.col(derivative_order::SNAP).head<3>();
+    state.time_from_start_ns = static_cast<int64_t>(
+        (min_time + sampling_interval * i) * kNumNanosecondsPerSecond);
+    if (dimension > 3) {
+      state.setFromYaw(sample(3, derivative_order::POSITION));
+      state.setFromYawRate(sample(3, derivative_order::VELOCITY));
+      state.setFromYawAcc(sample(3, derivative_order::ACCELERATION));
+    }
+  }
+}
+
+}  // namespace
 
 bool sampleTrajectoryAtTime(const Trajectory& trajectory, double sample_time,
                             mav_msgs::EigenTrajectoryPoint* state) {
@@ -59,39 +97,15 @@ bool sampleTrajectoryInRange(const Trajectory& trajectory, double min_time,
     return false;
   }
 
-  std::vector<Eigen::VectorXd> position, velocity, acceleration, jerk, snap,
-      yaw, yaw_rate;
-
-  trajectory.evaluateRange(min_time, max_time, sampling_interval,
-                           derivative_order::POSITION, &position);
-  trajectory.evaluateRange(min_time, max_time, sampling_interval,
-                           derivative_order::VELOCITY, &velocity);
-  trajectory.evaluateRange(min_time, max_time, sampling_interval,
-                           derivative_order::ACCELERATION, &acceleration);
-  trajectory.evaluateRange(min_time, max_time, sampling_interval,
-                           derivative_order::JERK, &jerk);
-  trajectory.evaluateRange(min_time, max_time, sampling_interval,
-                           derivative_order::SNAP, &snap);
-
-  size_t n_samples = position.size();
-
-  states->resize(n_samples);
-  for (size_t i = 0; i < n_samples; ++i) {
-    mav_msgs::EigenTrajectoryPoint& state = (*states)[i];
-
-    state.position_W = position[i].head<3>();
-    state.velocity_W = velocity[i].head<3>();
-    state.acceleration_W = acceleration[i].head<3>();
-    state.jerk_W = jerk[i].head<3>();
-    state.snap_W = snap[i].head<3>();
-    state.time_from_start_ns = static_cast<int64_t>(
-        (min_time + sampling_interval * i) * kNumNanosecondsPerSecond);
-    if (trajectory.D() > 3) {
-      state.setFromYaw(position[i](3));
-      state.setFromYawRate(velocity[i](3));
-      state.setFromYawAcc(acceleration[i](3));
-    }
+  Eigen::MatrixXd samples;
+  if (!trajectory.evaluateRangeAllDerivatives(min_time, max_time,
+                                              sampling_interval,
+                                              kMaxDerivative, &samples)) {
+    return false;
   }
+
+  statesFromSamples(samples, trajectory.D(), min_time, sampling_interval,
+                    states);
   return true;
 }
 
@@ -105,11 +119,57 @@ bool sampleTrajectoryStartDuration(
 bool sampleWholeTrajectory(const Trajectory& trajectory,
                            double sampling_interval,
                            mav_msgs::EigenTrajectoryPoint::Vector* states) {
+  CHECK_NOTNULL(states);
+  if (trajectory.D() < 3) {
+    LOG(ERROR) << "Dimension has to be 3 or 4, but is " << trajectory.D();
+    return false;
+  }
   const double min_time = trajectory.getMinTime();
   const double max_time = trajectory.getMaxTime();
 
-  return sampleTrajectoryInRange(trajectory, min_time, max_time,
-                                 sampling_interval, states);
+  // Dense sampling of the whole trajectory goes through the vectorized
+  // evaluation.
+  VectorizedTrajectory vectorized_trajectory(trajectory, kMaxDerivative);
+  Eigen::MatrixXd samples;
+  if (!vectorized_trajectory.evaluateRangeAllDerivatives(
+          min_time, max_time, sampling_interval, &samples)) {
+    return false;
+  }
+  statesFromSamples(samples, trajectory.D(), min_time, sampling_interval,
+                    states);
+  return true;
+}
+
+bool sampleTrajectoryHorizon(const VectorizedTrajectory& trajectory,
+                             double start_time, size_t n_samples,
+                             double sampling_interval, Eigen::MatrixXd* samples,
+                             mav_msgs::EigenTrajectoryPointVector* states) {
+  CHECK_NOTNULL(samples);
+  CHECK_NOTNULL(states);
+  CHECK_GT(n_samples, 0u);
+  CHECK_EQ(trajectory.getMaxDerivative(), kMaxDerivative);
+  if (trajectory.D() < 3) {
+    LOG(ERROR) << "Dimension has to be 3 or 4, but is " << trajectory.D();
+    return false;
+  }
+  if (start_time < 0.0 || start_time > trajectory.getMaxTime()) {
+    LOG(ERROR) << "Sample time should be within [0 " << trajectory.getMaxTime()
+               << "] but is " << start_time;
+    return false;
+  }
+
+  // Half a sampling interval beyond the last sample, such that rounding does
+  // not drop it.
+  const double end_time =
+      std::min(start_time + (n_samples - 0.5) * sampling_interval,
+               trajectory.getMaxTime());
+  if (!trajectory.evaluateRangeAllDerivatives(start_time, end_time,
+                                              sampling_interval, samples)) {
+    return false;
+  }
+  statesFromSamples(*samples, trajectory.D(), start_time, sampling_interval,
+                    states);
+  return true;
 }
 
 bool sampleSegmentAtTime(const Segment& segment, double sample_time,
@@ -155,4 +215,85 @@ bool sampleFlatStateAtTime(const T& type, double sample_time,
   return true;
 }
 
+TrajectoryStreamSampler::TrajectoryStreamSampler()
+    : trajectory_(nullptr), segment_idx_(-1), time_(0.0) {}
+
+bool TrajectoryStreamSampler::setTrajectory(const Trajectory& trajectory,
+                                            double start_time) {
+  trajectory_ = nullptr;
+  if (trajectory.empty() || trajectory.D() < 3) {
+    LOG(ERROR) << "Dimension has to be 3 or 4, but is " << trajectory.D();
+    return false;
+  }
+  const int N = trajectory.N();
+  const int D = trajectory.D();
+  derivative_coefficients_.setZero((kMaxDerivative + 1) * D, N);
+  t_powers_.resize(N);
+  values_.resize((kMaxDerivative + 1) * D);
+  state_ = mav_msgs::EigenTrajectoryPoint();
+
+  trajectory_ = &trajectory;
+  cursor_ = Trajectory::Cursor(trajectory);
+  segment_idx_ = -1;
+  if (!seek(start_time)) {
+    trajectory_ = nullptr;
+    return false;
+  }
+  return true;
+}
+
+bool TrajectoryStreamSampler::seek(double t) {
+  if (trajectory_ == nullptr) {
+    return false;
+  }
+  if (t < trajectory_->getMinTime() || t > trajectory_->getMaxTime()) {
+    return false;
+  }
+
+  const int segment_idx = cursor_.seek(t);
+  if (segment_idx != segment_idx_) {
+    loadSegment(segment_idx);
+  }
+  const double t_segment = t - trajectory_->getSegmentStartTime(segment_idx);
+  const int N = trajectory_->N();
+  const int D = trajectory_->D();
+  t_powers_[0] = 1.0;
+  for (int j = 1; j < N; ++j) {
+    t_powers_[j] = t_powers_[j - 1] * t_segment;
+  }
+  values_.noalias() = derivative_coefficients_ * t_powers_;
+
+  state_.position_W = values_.segment<3>(derivative_order::POSITION * D);
+  state_.velocity_W = values_.segment<3>(derivative_order::VELOCITY * D);
+  state_.acceleration_W =
+      values_.segment<3>(derivative_order::ACCELERATION * D);
+  state_.jerk_W = values_.segment<3>(derivative_order::JERK * D);
+  state_.snap_W = values_.segment<3>(derivative_order::SNAP * D);
+  if (D > 3) {
+    state_.setFromYaw(values_[derivative_order::POSITION * D + 3]);
+    state_.setFromYawRate(values_[derivative_order::VELOCITY * D + 3]);
+    state_.setFromYawAcc(values_[derivative_order::ACCELERATION * D + 3]);
+  }
+  state_.time_from_start_ns =
+      static_cast<int64_t>(t * kNumNanosecondsPerSecond);
+  time_ = t;
+  return true;
+}
+
+void TrajectoryStreamSampler::loadSegment(int segment_idx) {
+  const Segment& segment = trajectory_->segments()[segment_idx];
+  const int N = segment.N();
+  const int D = segment.D();
+  for (int k = 0; k <= kMaxDerivative && k < N; ++k) {
+    for (int d = 0; d < D; ++d) {
+      const Eigen::VectorXd& coefficients = segment[d].getCoefficientsRef();
+      for (int j = 0; j < N - k; ++j) {
+        derivative_coefficients_(k * D + d, j) =
+            Polynomial::base_coefficients_(k, j + k) * coefficients[j + k];
+      }
+    }
+  }
+  segment_idx_ = segment_idx;
+}
+
 }  // namespace mav_trajectory_generation
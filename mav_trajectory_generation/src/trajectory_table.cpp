@@ -0,0 +1,280 @@
+/*
+ * Copyright (c) 2016, Markus Achtelik, ASL, ETH Zurich, Switzerland
+ * Copyright (c) 2016, Michael Burri, ASL, ETH Zurich, Switzerland
+ * Copyright (c) 2016, Helen Oleynikova, ASL, ETH Zurich, Switzerland
+ * Copyright (c) 2016, Rik Bähnemann, ASL, ETH Zurich, Switzerland
+ * Copyright (c) 2016, Marija Popovic, ASL, ETH Zurich, Switzerland
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "mav_trajectory_generation/trajectory_table.h"
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <cmath>
+#include <fstream>
+#include <limits>
+
+namespace mav_trajectory_generation {
+
+namespace {
+
+// Upper bound on the magnitude of every dimension of the derivative of the
+// segment within [-margin, T + margin], from the coefficients about the
+// midpoint.
+double maxDerivativeMagnitude(const Segment& segment, int derivative,
+                              double margin) {
+  if (derivative >= segment.N()) {
+    return 0.0;
+  }
+  const double half_time = 0.5 * segment.getTime();
+  const double radius = half_time + margin;
+  double max_magnitude = 0.0;
+  for (int d = 0; d < segment.D(); ++d) {
+    Eigen::VectorXd coefficients = segment[d].getCoefficients(derivative);
+    Polynomial::shiftCoefficients(half_time, segment.N(), coefficients.data());
+    double magnitude = 0.0;
+    double radius_power = 1.0;
+    for (int j = 0; j < segment.N(); ++j) {
+      magnitude += std::abs(coefficients[j]) * radius_power;
+      radius_power *= radius;
+    }
+    max_magnitude = std::max(max_magnitude, magnitude);
+  }
+  return max_magnitude;
+}
+
+// Maximum difference over all dimensions between the derivatives of two
+// segments at t, each extrapolated beyond its bounds.
+double derivativeDifference(const Trajectory& trajectory, int segment_a,
+                            int segment_b, double t, int derivative) {
+  if (segment_a == segment_b) {
+    return 0.0;
+  }
+  const Segment::Vector& segments = trajectory.segments();
+  return (segments[segment_a].evaluate(
+              t - trajectory.getSegmentStartTime(segment_a), derivative) -
+          segments[segment_b].evaluate(
+              t - trajectory.getSegmentStartTime(segment_b), derivative))
+      .cwiseAbs()
+      .maxCoeff();
+}
+
+}  // namespace
+
+constexpr uint32_t TrajectoryTableHeader::kMagic;
+constexpr uint32_t TrajectoryTableHeader::kVersion;
+constexpr int TrajectoryTableHeader::kMaxDerivative;
+constexpr int TrajectoryTableHeader::kMaxD;
+
+TrajectoryTable::TrajectoryTable()
+    : header_(),
+      stride_(0),
+      dt_(0.0f),
+      inverse_dt_(0.0),
+      samples_(nullptr),
+      mapped_data_(nullptr),
+      mapped_size_(0) {}
+
+TrajectoryTable::~TrajectoryTable() { close(); }
+
+void TrajectoryTable::setHeader(const TrajectoryTableHeader& header) {
+  header_ = header;
+  stride_ = (header_.max_derivative + 2) * header_.D;
+  dt_ = static_cast<float>(header_.dt);
+  inverse_dt_ = header_.dt > 0.0 ? 1.0 / header_.dt : 0.0;
+}
+
+bool TrajectoryTable::bake(const Trajectory& trajectory, double dt,
+                           int max_derivative) {
+  if (trajectory.empty() || trajectory.D() > TrajectoryTableHeader::kMaxD ||
+      !(dt > 0.0) || max_derivative < 0 ||
+      max_derivative > TrajectoryTableHeader::kMaxDerivative) {
+    return false;
+  }
+  close();
+
+  const int D = trajectory.D();
+  const int num_derivatives = max_derivative + 2;
+  TrajectoryTableHeader header = TrajectoryTableHeader();
+  header.magic = TrajectoryTableHeader::kMagic;
+  header.version = TrajectoryTableHeader::kVersion;
+  header.D = D;
+  header.max_derivative = max_derivative;
+  // The last sample is at or after the end of the trajectory.
+  header.num_samples = std::max<uint64_t>(
+      2, static_cast<uint64_t>(
+             std::ceil(trajectory.getMaxTime() / dt - 1.0e-9)) + 1);
+  header.dt = dt;
+  header.max_time = trajectory.getMaxTime();
+  setHeader(header);
+
+  // Samples past the end extrapolate the last segment.
+  const Segment::Vector& segments = trajectory.segments();
+  buffer_.resize(header.num_samples * stride_);
+  std::vector<int> segment_indices(header.num_samples);
+  std::vector<double> max_values(num_derivatives, 0.0);
+  Trajectory::Cursor cursor(trajectory);
+  for (size_t i = 0; i < header.num_samples; ++i) {
+    const double t = i * dt;
+    const int segment_idx = cursor.seek(t);
+    segment_indices[i] = segment_idx;
+    const double t_segment = t - trajectory.getSegmentStartTime(segment_idx);
+    for (int k = 0; k < num_derivatives; ++k) {
+      const Eigen::VectorXd value =
+          segments[segment_idx].evaluate(t_segment, k);
+      max_values[k] = std::max(max_values[k], value.cwiseAbs().maxCoeff());
+      float* sample = buffer_.data() + i * stride_ + k * D;
+      for (int d = 0; d < D; ++d) {
+        sample[d] = static_cast<float>(value[d]);
+      }
+    }
+  }
+  samples_ = buffer_.data();
+
+  // Within a segment, the error of the cubic Hermite interpolation is at
+  // most dt^4 / 384 * max|f''''|. In an interval overlapping several
+  // segments, the samples of one segment differ from the extrapolation of
+  // another one. max(h00 + h01) = 1 and max|h10| = max|h11| = 4 / 27 bound
+  // the effect of these differences.
+  const float kUnitRoundoff = 0.5f * std::numeric_limits<float>::epsilon();
+  for (int k = 0; k <= max_derivative; ++k) {
+    double interpolation_error = 0.0;
+    for (const Segment& segment : segments) {
+      interpolation_error =
+          std::max(interpolation_error,
+                   std::pow(dt, 4) / 384.0 *
+                       maxDerivativeMagnitude(segment, k + 4, dt));
+    }
+    double boundary_error = 0.0;
+    for (size_t i = 0; i + 1 < header.num_samples; ++i) {
+      const int first_segment = segment_indices[i];
+      const int last_segment = segment_indices[i + 1];
+      if (first_segment == last_segment) {
+        continue;
+      }
+      const double t0 = i * dt;
+      const double t1 = t0 + dt;
+      for (int s = first_segment; s <= last_segment; ++s) {
+        const double value_error = std::max(
+            derivativeDifference(trajectory, s, first_segment, t0, k),
+            derivativeDifference(trajectory, s, last_segment, t1, k));
+        const double slope_error =
+            derivativeDifference(trajectory, s, first_segment, t0, k + 1) +
+            derivativeDifference(trajectory, s, last_segment, t1, k + 1);
+        boundary_error = std::max(boundary_error,
+                                  value_error + 4.0 / 27.0 * dt * slope_error);
+      }
+    }
+    // Rounding of the samples, the interpolation weights and the sum.
+    const double rounding_error =
+        8.0 * kUnitRoundoff * (max_values[k] + dt * max_values[k + 1]);
+    header_.error_bounds[k] =
+        interpolation_error + boundary_error + rounding_error;
+  }
+  return true;
+}
+
+bool TrajectoryTable::toFile(const std::string& filename) const {
+  if (empty()) {
+    return false;
+  }
+  std::ofstream out(filename, std::ios::out | std::ios::binary);
+  if (!out) {
+    return false;
+  }
+  out.write(reinterpret_cast<const char*>(&header_), sizeof(header_));
+  out.write(reinterpret_cast<const char*>(samples_),
+            header_.num_samples * stride_ * sizeof(float));
+  out.close();
+  return out.good();
+}
+
+bool TrajectoryTable::open(const std::string& filename) {
+  close();
+
+  const int fd = ::open(filename.c_str(), O_RDONLY);
+  if (fd < 0) {
+    return false;
+  }
+  struct stat file_stat;
+  if (fstat(fd, &file_stat) != 0 ||
+      static_cast<size_t>(file_stat.st_size) < sizeof(TrajectoryTableHeader)) {
+    ::close(fd);
+    return false;
+  }
+  const size_t size = file_stat.st_size;
+  void* data = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+  // The mapping stays valid after closing the file descriptor.
+  ::close(fd);
+  if (data == MAP_FAILED) {
+    return false;
+  }
+
+  TrajectoryTableHeader header;
+  std::copy(static_cast<const char*>(data),
+            static_cast<const char*>(data) + sizeof(header),
+            reinterpret_cast<char*>(&header));
+  // D and max_derivative are bounded before the stride is computed, such
+  // that a crafted header cannot wrap the expected file size.
+  if (header.magic != TrajectoryTableHeader::kMagic ||
+      header.version != TrajectoryTableHeader::kVersion || header.D == 0 ||
+      header.D > static_cast<uint32_t>(TrajectoryTableHeader::kMaxD) ||
+      header.max_derivative >
+          static_cast<uint32_t>(TrajectoryTableHeader::kMaxDerivative)) {
+    munmap(data, size);
+    return false;
+  }
+  const uint64_t max_floats = (size - sizeof(header)) / sizeof(float);
+  const uint64_t stride =
+      (static_cast<uint64_t>(header.max_derivative) + 2) * header.D;
+  // The samples have to cover [0, max_time], as baked: the last sample is
+  // at or after max_time, the one before it is not.
+  const double max_time_samples = header.max_time / header.dt;
+  const double kTolerance = 1.0e-6;
+  const bool valid_layout =
+      header.num_samples >= 2 && header.num_samples <= max_floats / stride &&
+      header.dt > 0.0 && std::isfinite(header.dt) && header.max_time >= 0.0 &&
+      std::isfinite(max_time_samples) &&
+      max_time_samples <= header.num_samples - 1 + kTolerance &&
+      (header.num_samples == 2 ||
+       max_time_samples >= header.num_samples - 2 - kTolerance);
+  if (!valid_layout ||
+      size - sizeof(header) != header.num_samples * stride * sizeof(float)) {
+    munmap(data, size);
+    return false;
+  }
+
+  mapped_data_ = data;
+  mapped_size_ = size;
+  setHeader(header);
+  samples_ = reinterpret_cast<const float*>(static_cast<const char*>(data) +
+                                            sizeof(header));
+  return true;
+}
+
+void TrajectoryTable::close() {
+  if (mapped_data_ != nullptr) {
+    munmap(mapped_data_, mapped_size_);
+  }
+  mapped_data_ = nullptr;
+  mapped_size_ = 0;
+  buffer_.clear();
+  samples_ = nullptr;
+  setHeader(TrajectoryTableHeader());
+}
+
+}  // namespace mav_trajectory_generation
@@ -0,0 +1,149 @@
+/*
+ * Copyright (c) 2016, Markus Achtelik, ASL, ETH Zurich, Switzerland
+ * Copyright (c) 2016, Michael Burri, ASL, ETH Zurich, Switzerland
+ * Copyright (c) 2016, Helen Oleynikova, ASL, ETH Zurich, Switzerland
+ * Copyright (c) 2016, Rik Bähnemann, ASL, ETH Zurich, Switzerland
+ * Copyright (c) 2016, Marija Popovic, ASL, ETH Zurich, Switzerland
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "mav_trajectory_generation/vectorized_segment.h"
+
+#include <algorithm>
+
+namespace mav_trajectory_generation {
+
+constexpr int VectorizedSegment::kNumLanes;
+
+VectorizedSegment::VectorizedSegment(const Segment& segment, int max_derivative)
+    : N_(0), D_(0), max_derivative_(0), time_(0.0) {
+  setSegment(segment, max_derivative);
+}
+
+void VectorizedSegment::setSegment(const Segment& segment,
+                                   int max_derivative) {
+  N_ = segment.N();
+  D_ = segment.D();
+  max_derivative_ = max_derivative;
+  time_ = segment.getTime();
+  CHECK_GE(max_derivative_, 0);
+  CHECK_LE(N_, Polynomial::kMaxConvolutionSize);
+  coefficients_.assign((max_derivative_ + 1) * N_ * D_, 0.0);
+  for (int d = 0; d < D_; ++d) {
+    const Eigen::VectorXd& coeffs = segment[d].getCoefficientsRef();
+    for (int k = 0; k <= max_derivative_; ++k) {
+      for (int j = k; j < N_; ++j) {
+        coefficients_[(k * N_ + j) * D_ + d] =
+            Polynomial::base_coefficients_(k, j) * coeffs[j];
+      }
+    }
+  }
+}
+
+void VectorizedSegment::evaluate(const double* times, size_t n_times,
+                                 double* result) const {
+  CHECK_NOTNULL(times);
+  CHECK_NOTNULL(result);
+  typedef Eigen::Array<double, kNumLanes, 1> Lanes;
+  const int sample_size = getSampleSize();
+
+  for (size_t first = 0; first < n_times; first += kNumLanes) {
+    const int n_lanes =
+        static_cast<int>(std::min<size_t>(kNumLanes, n_times - first));
+    // Pad the last block with the last valid time.
+    Lanes t;
+    for (int lane = 0; lane < kNumLanes; ++lane) {
+      t[lane] = times[first + std::min(lane, n_lanes - 1)];
+    }
+
+    for (int k = 0; k <= max_derivative_; ++k) {
+      for (int d = 0; d < D_; ++d) {
+        Lanes acc = Lanes::Zero();
+        // Horner's scheme, derivative k has powers t^0 ... t^{N-1-k}.
+        for (int j = N_ - 1; j >= k; --j) {
+          acc = acc * t + coefficient(k, j, d);
+        }
+        for (int lane = 0; lane < n_lanes; ++lane) {
+          result[(first + lane) * sample_size + k * D_ + d] = acc[lane];
+        }
+      }
+    }
+  }
+}
+
+VectorizedTrajectory::VectorizedTrajectory(const Trajectory& trajectory,
+                                           int max_derivative)
+    : D_(trajectory.D()),
+      max_derivative_(max_derivative),
+      max_time_(trajectory.getMaxTime()) {
+  segments_.reserve(trajectory.K());
+  segment_start_times_.reserve(trajectory.K());
+  double segment_start = 0.0;
+  for (const Segment& segment : trajectory.segments()) {
+    segments_.emplace_back(segment, max_derivative_);
+    segment_start_times_.push_back(segment_start);
+    segment_start += segment.getTime();
+  }
+}
+
+bool VectorizedTrajectory::evaluateRangeAllDerivatives(
+    double t_start, double t_end, double dt, Eigen::MatrixXd* result,
+    std::vector<double>* sampling_times) const {
+  CHECK_NOTNULL(result);
+  CHECK_GT(dt, 0.0);
+  if (segments_.empty() || t_start < 0.0 || t_end > max_time_ ||
+      t_start > t_end) {
+    LOG(ERROR) << "Range [" << t_start << " " << t_end
+               << "] out of range of the trajectory!";
+    return false;
+  }
+
+  const size_t n_samples = static_cast<size_t>((t_end - t_start) / dt) + 1;
+  const int sample_size = D_ * (max_derivative_ + 1);
+  result->resize(sample_size, n_samples);
+
+  // Sample times and segment relative times, such that each segment can
+  // evaluate its samples in one contiguous call.
+  std::vector<double> times(n_samples);
+  for (size_t sample = 0; sample < n_samples; ++sample) {
+    times[sample] = std::min(t_start + sample * dt, t_end);
+  }
+  if (sampling_times != nullptr) {
+    *sampling_times = times;
+  }
+
+  size_t i = 0;
+  size_t first = 0;
+  while (first < n_samples) {
+    // In case a sample falls on a vertex, the segment right of the vertex is
+    // chosen.
+    while (i + 1 < segments_.size() &&
+           times[first] >= segment_start_times_[i + 1]) {
+      ++i;
+    }
+    size_t last = first;
+    while (last < n_samples &&
+           (i + 1 == segments_.size() ||
+            times[last] < segment_start_times_[i + 1])) {
+      times[last] -= segment_start_times_[i];
+      ++last;
+    }
+    segments_[i].evaluate(&times[first], last - first,
+                          result->data() + first * sample_size);
+    first = last;
+  }
+  return true;
+}
+
+}  // namespace mav_trajectory_generation
@@ -126,6 +126,20 @@ bool Vertex::hasConstraint(int derivative_order) const {
   return it != constraints_.end();
 }
 
+Vertex Vertex::getVertexWithDimensions(int first_dimension,
+                                       int n_dimensions) const {
+  CHECK_GE(first_dimension, 0);
+  CHECK_GE(n_dimensions, 0);
+  CHECK_LE(first_dimension + n_dimensions, D_);
+  Vertex vertex(n_dimensions);
+  for (const Constraints::value_type& constraint : constraints_) {
+    vertex.addConstraint(constraint.first,
+                         constraint.second.segment(first_dimension,
+                                                   n_dimensions));
+  }
+  return vertex;
+}
+
 bool Vertex::isEqualTol(const Vertex& rhs, double tol) const {
   if (constraints_.size() != rhs.constraints_.size()) return false;
   // loop through lhs constraint map
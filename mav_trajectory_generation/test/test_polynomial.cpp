@@ -18,16 +18,21 @@
  * limitations under the License.
  */
 
+#include <algorithm>
 #include <cmath>
 #include <iostream>
 #include <random>
+#include <thread>
 
 #include <eigen-checks/entrypoint.h>
 #include <eigen-checks/glog.h>
 #include <eigen-checks/gtest.h>
 
+#include "mav_trajectory_generation/fixed_segment.h"
 #include "mav_trajectory_generation/motion_defines.h"
+#include "mav_trajectory_generation/optimization_trace.h"
 #include "mav_trajectory_generation/polynomial.h"
+#include "mav_trajectory_generation/segment.h"
 #include "mav_trajectory_generation/test_utils.h"
 #include "mav_trajectory_generation/timing.h"
 
@@ -77,6 +82,38 @@ TEST(MavTrajectoryGeneration, Convolution) {
   CHECK_EIGEN_MATRIX_EQUAL(expected_convolution, convolution.getCoefficients());
 }
 
+TEST(MavTrajectoryGeneration, MagnitudeDerivativeConvolution) {
+  std::srand(1234567);
+  const int kN = Polynomial::kMaxN;
+  for (int derivative = 0; derivative <= derivative_order::SNAP;
+       derivative++) {
+    const int n_d = kN - derivative;
+    const int n_dd = n_d - 1;
+    Eigen::VectorXd expected =
+        Eigen::VectorXd::Zero(Polynomial::getConvolutionLength(n_d, n_dd));
+    Polynomial::ConvolutionCoefficients fused;
+    fused.setZero(expected.size());
+    for (int dim = 0; dim < 3; dim++) {
+      Eigen::VectorXd coeffs(kN);
+      for (int i = 0; i < kN; i++) {
+        coeffs[i] = createRandomDouble(-10.0, 10.0);
+      }
+      const Polynomial p(coeffs);
+      const Eigen::VectorXd d = p.getCoefficients(derivative).head(n_d);
+      const Eigen::VectorXd dd = p.getCoefficients(derivative + 1).head(n_dd);
+      expected += Polynomial::convolve(d, dd);
+
+      Polynomial::ConvolutionCoefficients convolved;
+      Polynomial::convolve(d, dd, &convolved);
+      EXPECT_TRUE(Polynomial::convolve(d, dd) == convolved);
+
+      p.addMagnitudeDerivativeCoefficients(derivative, fused);
+    }
+    EXPECT_TRUE(EIGEN_MATRIX_NEAR(expected, fused,
+                                  1.0e-12 * expected.cwiseAbs().maxCoeff()));
+  }
+}
+
 TEST(PolynomialTest, FindMinMax) {
   const double kTMin = -100.0;
   const double kTMax = 100.0;
@@ -128,6 +165,278 @@ TEST(PolynomialTest, FindMinMax) {
             << kNumPolynomials << " polynomials." << std::endl;
 }
 
+TEST(PolynomialTest, RealRootsInInterval) {
+  const double kTStart = 0.0;
+  const double kTEnd = 2.0;
+  const double kRootTolerance = 1.0e-6;
+  std::srand(1234567);
+  const int kNumPolynomials = 1e3;
+  for (int i = 0; i < kNumPolynomials; i++) {
+    // Build the polynomial from its roots, some of them outside the interval,
+    // multiplied with a factor without real roots. Many clustered roots are
+    // ill-conditioned for any root finder, thus keep the degree moderate.
+    const int num_real_roots = std::rand() % (Polynomial::kMaxN - 2) + 1;
+    std::vector<double> expected_roots;
+    Eigen::VectorXd coeffs(3);
+    coeffs << 1.0 + createRandomDouble(0.0, 1.0), 0.0, 1.0;
+    for (int j = 0; j < num_real_roots; j++) {
+      const double root = createRandomDouble(kTStart - 1.0, kTEnd + 1.0);
+      if (root >= kTStart && root <= kTEnd) {
+        expected_roots.push_back(root);
+      }
+      Eigen::VectorXd factor(2);
+      factor << -root, 1.0;
+      coeffs = Polynomial::convolve(coeffs, factor);
+    }
+    std::sort(expected_roots.begin(), expected_roots.end());
+    // Roots that are too close cannot be told apart.
+    bool separated = true;
+    for (size_t j = 1; j < expected_roots.size(); j++) {
+      separated &= expected_roots[j] - expected_roots[j - 1] > 1.0e-2;
+    }
+    if (!separated) continue;
+
+    std::vector<double> roots;
+    EXPECT_TRUE(findRealRootsInInterval(coeffs, kTStart, kTEnd, &roots));
+    ASSERT_EQ(expected_roots.size(), roots.size()) << coeffs.transpose();
+    for (size_t j = 0; j < roots.size(); j++) {
+      EXPECT_NEAR(expected_roots[j], roots[j], kRootTolerance);
+    }
+  }
+
+  // Segment extrema have to agree with Jenkins-Traub.
+  const int kD = 3;
+  const std::vector<int> dimensions = {0, 1, 2};
+  for (int i = 0; i < 100; i++) {
+    Segment segment(Polynomial::kMaxN, kD);
+    segment.setTime(createRandomDouble(0.1, 10.0));
+    for (int d = 0; d < kD; d++) {
+      Eigen::VectorXd segment_coeffs(Polynomial::kMaxN);
+      for (int j = 0; j < segment_coeffs.size(); j++) {
+        segment_coeffs[j] = createRandomDouble(-1.0, 1.0);
+      }
+      segment[d].setCoefficients(segment_coeffs);
+    }
+    for (int derivative = derivative_order::VELOCITY;
+         derivative <= derivative_order::SNAP; derivative++) {
+      std::vector<Extremum> candidates_jenkins_traub, candidates_real;
+      timing::Timer timer_jenkins_traub("min_max_magnitude_jenkins_traub");
+      EXPECT_TRUE(segment.computeMinMaxMagnitudeCandidates(
+          derivative, 0.0, segment.getTime(), dimensions,
+          &candidates_jenkins_traub, kJenkinsTraub));
+      timer_jenkins_traub.Stop();
+      timing::Timer timer_real("min_max_magnitude_real_roots");
+      EXPECT_TRUE(segment.computeMinMaxMagnitudeCandidates(
+          derivative, 0.0, segment.getTime(), dimensions, &candidates_real,
+          kRealIntervalRoots));
+      timer_real.Stop();
+      Extremum min_jenkins_traub, max_jenkins_traub, min_real, max_real;
+      EXPECT_TRUE(segment.selectMinMaxMagnitudeFromCandidates(
+          0.0, segment.getTime(), derivative, dimensions,
+          candidates_jenkins_traub, &min_jenkins_traub, &max_jenkins_traub));
+      EXPECT_TRUE(segment.selectMinMaxMagnitudeFromCandidates(
+          0.0, segment.getTime(), derivative, dimensions, candidates_real,
+          &min_real, &max_real));
+      EXPECT_NEAR(max_jenkins_traub.value, max_real.value,
+                  1.0e-9 * std::max(1.0, max_real.value));
+      EXPECT_NEAR(min_jenkins_traub.value, min_real.value,
+                  1.0e-9 * std::max(1.0, max_real.value));
+    }
+  }
+}
+
+TEST(PolynomialTest, FixedSizeEvaluation) {
+  // The compile-time table has to match the dynamic base coefficients.
+  for (int n = 0; n < Polynomial::kMaxN; n++) {
+    for (int i = 0; i < Polynomial::kMaxN; i++) {
+      EXPECT_EQ(Polynomial::base_coefficients_(n, i),
+                fixedBaseCoefficient(n, i));
+    }
+  }
+
+  std::srand(1234567);
+  const int kN = 10;
+  const int kD = 3;
+  const int kNumSegments = 1e2;
+  for (int i = 0; i < kNumSegments; i++) {
+    Segment segment(kN, kD);
+    segment.setTime(createRandomDouble(0.1, 10.0));
+    for (int d = 0; d < kD; d++) {
+      Eigen::VectorXd coeffs(kN);
+      for (int j = 0; j < kN; j++) {
+        coeffs[j] = createRandomDouble(-100.0, 100.0);
+      }
+      segment[d].setCoefficients(coeffs);
+    }
+    FixedSegment<kN, kD> fixed_segment(segment);
+    EXPECT_EQ(segment, fixed_segment.toSegment());
+
+    const int kSnapLength = kN - derivative_order::SNAP;
+    const Eigen::VectorXd expected_snap =
+        segment[0].getCoefficients(derivative_order::SNAP).head(kSnapLength);
+    const Eigen::Matrix<double, kSnapLength, 1> actual_snap =
+        fixedDerivativeCoefficients<kN, derivative_order::SNAP>(
+            segment[0].getCoefficientsRef());
+    EXPECT_TRUE(EIGEN_MATRIX_NEAR(expected_snap, actual_snap, 1.0e-9));
+
+    const double t = createRandomDouble(0.0, segment.getTime());
+    for (int derivative = 0; derivative <= kN; derivative++) {
+      timing::Timer timer_dynamic("evaluate_dynamic");
+      Eigen::VectorXd expected = segment.evaluate(t, derivative);
+      timer_dynamic.Stop();
+      timing::Timer timer_fixed("evaluate_fixed");
+      FixedSegment<kN, kD>::Point actual =
+          fixed_segment.evaluate(t, derivative);
+      timer_fixed.Stop();
+      EXPECT_TRUE(EIGEN_MATRIX_NEAR(expected, actual,
+                                    1.0e-9 * (1.0 + expected.norm())));
+    }
+
+    Eigen::VectorXd expected_derivatives(5);
+    segment[0].evaluate(t, &expected_derivatives);
+    Eigen::Matrix<double, 5, 1> actual_derivatives;
+    fixed_segment[0].evaluate(t, &actual_derivatives);
+    EXPECT_TRUE(EIGEN_MATRIX_NEAR(
+        expected_derivatives, actual_derivatives,
+        1.0e-9 * (1.0 + expected_derivatives.norm())));
+  }
+}
+
+TEST(PolynomialTest, BernsteinBounds) {
+  // The Bernstein coefficients of a line are its end points.
+  Eigen::VectorXd line(2);
+  line << 1.0, -2.0;
+  double minimum, maximum;
+  Polynomial(line).computeBernsteinBounds(0.5, 1.5, derivative_order::POSITION,
+                                          &minimum, &maximum);
+  EXPECT_NEAR(-2.0, minimum, 1.0e-12);
+  EXPECT_NEAR(0.0, maximum, 1.0e-12);
+
+  // The bounds contain the exact extrema.
+  std::srand(1234567);
+  const int kNumPolynomials = 1e3;
+  for (int i = 0; i < kNumPolynomials; i++) {
+    Eigen::VectorXd coeffs(Polynomial::kMaxN);
+    for (int j = 0; j < coeffs.size(); j++) {
+      coeffs[j] = createRandomDouble(-1.0, 1.0);
+    }
+    const Polynomial polynomial(coeffs);
+    const double t_start = createRandomDouble(0.0, 1.0);
+    const double t_end = t_start + createRandomDouble(0.1, 1.0);
+    for (int derivative = 0; derivative <= derivative_order::SNAP;
+         derivative++) {
+      std::pair<double, double> exact_min, exact_max;
+      ASSERT_TRUE(polynomial.computeMinMax(t_start, t_end, derivative,
+                                           &exact_min, &exact_max));
+      polynomial.computeBernsteinBounds(t_start, t_end, derivative, &minimum,
+                                        &maximum);
+      const double tolerance = 1.0e-9 * (1.0 + std::abs(exact_max.second) +
+                                         std::abs(exact_min.second));
+      EXPECT_LE(minimum, exact_min.second + tolerance);
+      EXPECT_GE(maximum, exact_max.second - tolerance);
+    }
+  }
+}
+
+TEST(PolynomialTest, ConcurrentRootFinding) {
+  std::srand(1234567);
+  const int kNumPolynomials = 200;
+  const int kNumThreads = 4;
+  std::vector<Eigen::VectorXd> coefficients(kNumPolynomials);
+  for (Eigen::VectorXd& coeffs : coefficients) {
+    coeffs.resize(Polynomial::kMaxConvolutionSize);
+    for (int i = 0; i < coeffs.size(); i++) {
+      coeffs[i] = createRandomDouble(-100.0, 100.0);
+    }
+  }
+
+  // Serial reference.
+  std::vector<Eigen::VectorXcd> expected(kNumPolynomials);
+  for (int i = 0; i < kNumPolynomials; i++) {
+    ASSERT_TRUE(findRootsJenkinsTraub(coefficients[i], &expected[i]));
+  }
+
+  // Every thread solves all polynomials with its own solver.
+  std::vector<std::vector<Eigen::VectorXcd>> actual(
+      kNumThreads, std::vector<Eigen::VectorXcd>(kNumPolynomials));
+  std::vector<std::thread> threads;
+  for (int t = 0; t < kNumThreads; t++) {
+    threads.emplace_back([&coefficients, &actual, t]() {
+      JenkinsTraubSolver solver;
+      for (size_t i = 0; i < coefficients.size(); i++) {
+        solver.findRoots(coefficients[i], &actual[t][i]);
+      }
+    });
+  }
+  for (std::thread& thread : threads) {
+    thread.join();
+  }
+
+  for (int t = 0; t < kNumThreads; t++) {
+    for (int i = 0; i < kNumPolynomials; i++) {
+      ASSERT_EQ(expected[i].size(), actual[t][i].size());
+      EXPECT_TRUE(expected[i] == actual[t][i]);
+    }
+  }
+}
+
+TEST(SegmentTest, CachedDerivatives) {
+  std::srand(1234567);
+  const int kN = 10;
+  const int kD = 3;
+  Segment segment(kN, kD);
+  segment.setTime(2.0);
+  for (int d = 0; d < kD; d++) {
+    Eigen::VectorXd coeffs(kN);
+    for (int i = 0; i < kN; i++) {
+      coeffs[i] = createRandomDouble(-10.0, 10.0);
+    }
+    segment[d].setCoefficients(coeffs);
+  }
+
+  for (int d = 0; d < kD; d++) {
+    for (int k = 0; k <= Segment::kMaxCachedDerivative; k++) {
+      EXPECT_TRUE(segment.getDerivativeCoefficientsRef(d, k) ==
+                  segment[d].getCoefficients(k));
+    }
+  }
+
+  // Repeated queries hit the cache.
+  const std::vector<int> dimensions = {0, 1, 2};
+  std::vector<double> candidates, candidates_cached;
+  for (int k = derivative_order::POSITION; k <= derivative_order::SNAP; k++) {
+    const Segment copy = segment;
+    ASSERT_TRUE(segment.computeMinMaxMagnitudeCandidateTimes(
+        k, 0.0, segment.getTime(), dimensions, &candidates));
+    const size_t n_root_finding_calls = internal::getNumRootFindingCalls();
+    ASSERT_TRUE(copy.computeMinMaxMagnitudeCandidateTimes(
+        k, 0.0, segment.getTime(), dimensions, &candidates_cached));
+    EXPECT_EQ(n_root_finding_calls, internal::getNumRootFindingCalls());
+    EXPECT_TRUE(candidates == candidates_cached);
+  }
+
+  // Modification invalidates the cache.
+  const Segment original = segment;
+  segment[1].setCoefficients(segment[1].getCoefficients() * 2.0);
+  EXPECT_TRUE(segment.getDerivativeCoefficientsRef(1, 1) ==
+              segment[1].getCoefficients(1));
+  EXPECT_TRUE(original.getDerivativeCoefficientsRef(1, 1) ==
+              original[1].getCoefficients(1));
+  const Segment& modified = segment;
+  Segment fresh(kN, kD);
+  fresh.setTime(segment.getTime());
+  for (int d = 0; d < kD; d++) {
+    fresh[d] = modified[d];
+  }
+  for (int k = derivative_order::POSITION; k <= derivative_order::SNAP; k++) {
+    ASSERT_TRUE(segment.computeMinMaxMagnitudeCandidateTimes(
+        k, 0.0, segment.getTime(), dimensions, &candidates));
+    ASSERT_TRUE(fresh.computeMinMaxMagnitudeCandidateTimes(
+        k, 0.0, fresh.getTime(), dimensions, &candidates_cached));
+    EXPECT_TRUE(candidates == candidates_cached);
+  }
+}
+
 int main(int argc, char** argv) {
   testing::InitGoogleTest(&argc, argv);
 
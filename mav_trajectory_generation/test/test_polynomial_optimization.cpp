@@ -18,17 +18,45 @@
  * limitations under the License.
  */
 
+#include <malloc.h>
+
+#include <algorithm>
+#include <atomic>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
 #include <iostream>
 #include <limits>
+#include <numeric>
 #include <random>
+#include <sstream>
+#include <thread>
 
 #include <eigen-checks/entrypoint.h>
 #include <eigen-checks/glog.h>
 #include <eigen-checks/gtest.h>
 
+#include "mav_trajectory_generation/arc_length_table.h"
+#include "mav_trajectory_generation/batch_planner.h"
+#include "mav_trajectory_generation/binary_io.h"
+#include "mav_trajectory_generation/flat_trajectory.h"
+#include "mav_trajectory_generation/float_trajectory.h"
+#include "mav_trajectory_generation/io.h"
+#include "mav_trajectory_generation/memory_tracking.h"
+#include "mav_trajectory_generation/polynomial_optimization_decoupled.h"
 #include "mav_trajectory_generation/polynomial_optimization_linear.h"
 #include "mav_trajectory_generation/polynomial_optimization_nonlinear.h"
+#include "mav_trajectory_generation/polynomial_optimization_windowed.h"
+#include "mav_trajectory_generation/segment_time_initializer.h"
+#include "mav_trajectory_generation/solution_cache.h"
+#include "mav_trajectory_generation/thread_pool.h"
 #include "mav_trajectory_generation/timing.h"
+#include "mav_trajectory_generation/trajectory_batch.h"
+#include "mav_trajectory_generation/trajectory_bvh.h"
+#include "mav_trajectory_generation/trajectory_compression.h"
+#include "mav_trajectory_generation/trajectory_sampling.h"
+#include "mav_trajectory_generation/trajectory_table.h"
+#include "mav_trajectory_generation/vectorized_segment.h"
 
 using namespace mav_trajectory_generation;
 
@@ -203,6 +231,27 @@ TEST(MavTrajectoryGeneration, PathPlanning_A_matrix_inversion) {
   }
 }
 
+TEST(MavTrajectoryGeneration, PathPlanning_time_scaled_matrices) {
+  for (int derivative = 0;
+       derivative <= PolynomialOptimization<N>::kHighestDerivativeToOptimize;
+       ++derivative) {
+    for (double t = 0.1; t <= 60.0; t *= 1.5) {
+      Eigen::Matrix<double, N, N> A, Ai, Q, Ai_scaled, Q_scaled;
+      PolynomialOptimization<N>::setupMappingMatrix(t, &A);
+      PolynomialOptimization<N>::invertMappingMatrix(A, &Ai);
+      PolynomialOptimization<N>::computeQuadraticCostJacobian(derivative, t,
+                                                              &Q);
+      PolynomialOptimization<N>::computeTimeScaledMatrices(derivative, t,
+                                                           &Ai_scaled,
+                                                           &Q_scaled);
+      EXPECT_TRUE(EIGEN_MATRIX_NEAR(Ai, Ai_scaled, 1.0e-10 * Ai.norm()))
+          << "time was " << t << std::endl;
+      EXPECT_TRUE(EIGEN_MATRIX_NEAR(Q, Q_scaled, 1.0e-10 * Q.norm()))
+          << "time was " << t << ", derivative " << derivative << std::endl;
+    }
+  }
+}
+
 TEST(MavTrajectoryGeneration, PathPlanningUnconstrained_1D_10_segments) {
   Vertex::Vector vertices;
   vertices = createRandomVertices1D(max_derivative, 10, -10, 10, 12);
@@ -811,11 +860,12 @@ TEST(MavTrajectoryGeneration, ConstraintPacking) {
     opt.getFreeConstraints(&free_constraints);
 
     // Get the mapping matrices.
-    Eigen::MatrixXd M, A_inv, A, M_pinv;
+    Eigen::MatrixXd M, A_inv, A, M_pinv, R;
     opt.getM(&M);
     opt.getAInverse(&A_inv);
     opt.getA(&A);
     opt.getMpinv(&M_pinv);
+    opt.getR(&R);
 
     ASSERT_EQ(fixed_constraints.size(), 3);
     ASSERT_EQ(free_constraints.size(), 3);
@@ -830,15 +880,1706 @@ TEST(MavTrajectoryGeneration, ConstraintPacking) {
       Eigen::VectorXd d_reordered = M_pinv * d_unordered;
       EXPECT_TRUE(EIGEN_MATRIX_NEAR(d_all_ordered, d_reordered, 1e-6));
 
+      // The solution is optimal: Rpf * df + Rpp * dp = 0.
+      const Eigen::VectorXd optimality =
+          R.bottomRows(free_constraints[i].size()) * d_all_ordered;
+      EXPECT_LT(optimality.lpNorm<Eigen::Infinity>(),
+                1.0e-6 * R.lpNorm<Eigen::Infinity>());
+
       // Now also check for each segment.
       for (size_t j = 0; j < segments.size(); ++j) {
         Eigen::VectorXd p_seg = segments[j][i].getCoefficients(0);
         EXPECT_TRUE(EIGEN_MATRIX_NEAR(p_seg, p.segment<N>(j * N), 1e-6));
       }
+
+      // The constraints of a dimension are the columns of the matrices.
+      EXPECT_TRUE(EIGEN_MATRIX_NEAR(fixed_constraints[i],
+                                    opt.getFixedConstraintsRef().col(i), 0.0));
+      EXPECT_TRUE(EIGEN_MATRIX_NEAR(free_constraints[i],
+                                    opt.getFreeConstraintsRef().col(i), 0.0));
+    }
+
+    // Free constraints stacked by dimension can be set without a copy into
+    // vectors.
+    const Eigen::MatrixXd free_constraints_matrix = opt.getFreeConstraintsRef();
+    opt.setFreeConstraints(Eigen::Map<const Eigen::MatrixXd>(
+        free_constraints_matrix.data(), free_constraints_matrix.rows(), 3));
+    Segment::Vector segments_mapped;
+    opt.getSegments(&segments_mapped);
+    for (size_t j = 0; j < segments.size(); ++j) {
+      EXPECT_TRUE(segments[j] == segments_mapped[j]);
+    }
+  }
+}
+
+TEST(MavTrajectoryGeneration, SetupFromMatrices) {
+  const int kDim = 3;
+  const int kNumSegments = 100;
+  Eigen::VectorXd min_pos = Eigen::VectorXd::Constant(kDim, -50.0);
+  Eigen::VectorXd max_pos = -min_pos;
+  Vertex::Vector vertices = createRandomVertices(max_derivative, kNumSegments,
+                                                 min_pos, max_pos, 2345);
+  vertices[kNumSegments / 2].addConstraint(derivative_order::VELOCITY,
+                                           Eigen::Vector3d(1.0, 2.0, 3.0));
+  std::vector<double> segment_times = estimateSegmentTimes(vertices, 3.0, 5.0);
+
+  // One extra row for an invalid derivative, which is ignored.
+  const int kNumDerivatives = N / 2 + 1;
+  std::vector<Eigen::MatrixXd> derivatives(
+      kNumDerivatives, Eigen::MatrixXd::Zero(kDim, vertices.size()));
+  PolynomialOptimization<N>::ConstraintMask mask =
+      PolynomialOptimization<N>::ConstraintMask::Constant(
+          kNumDerivatives, vertices.size(), false);
+  for (size_t i = 0; i < vertices.size(); ++i) {
+    for (int derivative = 0; derivative < N / 2; ++derivative) {
+      Eigen::VectorXd value;
+      if (vertices[i].getConstraint(derivative, &value)) {
+        derivatives[derivative].col(i) = value;
+        mask(derivative, i) = true;
+      }
+    }
+  }
+  mask(N / 2, 0) = true;
+
+  PolynomialOptimization<N> opt_vertices(kDim);
+  opt_vertices.setupFromVertices(vertices, segment_times,
+                                 derivative_to_optimize);
+  PolynomialOptimization<N> opt_matrices(kDim);
+  EXPECT_TRUE(opt_matrices.setupFromMatrices(derivatives, mask, segment_times,
+                                             derivative_to_optimize));
+  EXPECT_EQ(opt_vertices.getNumberAllConstraints(),
+            opt_matrices.getNumberAllConstraints());
+  EXPECT_EQ(opt_vertices.getNumberFixedConstraints(),
+            opt_matrices.getNumberFixedConstraints());
+  EXPECT_TRUE(EIGEN_MATRIX_NEAR(opt_vertices.getFixedConstraintsRef(),
+                                opt_matrices.getFixedConstraintsRef(), 0.0));
+  Eigen::MatrixXd M_vertices, M_matrices;
+  opt_vertices.getM(&M_vertices);
+  opt_matrices.getM(&M_matrices);
+  EXPECT_TRUE(EIGEN_MATRIX_NEAR(M_vertices, M_matrices, 0.0));
+
+  EXPECT_TRUE(opt_vertices.solveLinear());
+  EXPECT_TRUE(opt_matrices.solveLinear());
+  EXPECT_TRUE(EIGEN_MATRIX_NEAR(opt_vertices.getFreeConstraintsRef(),
+                                opt_matrices.getFreeConstraintsRef(), 0.0));
+
+  // The vertices are created on demand.
+  Vertex::Vector vertices_matrices;
+  opt_matrices.getVertices(&vertices_matrices);
+  ASSERT_EQ(vertices.size(), vertices_matrices.size());
+  for (size_t i = 0; i < vertices.size(); ++i) {
+    for (int derivative = 0; derivative <= N / 2; ++derivative) {
+      Eigen::VectorXd expected, value;
+      ASSERT_EQ(vertices[i].getConstraint(derivative, &expected),
+                vertices_matrices[i].getConstraint(derivative, &value));
+      if (vertices[i].hasConstraint(derivative)) {
+        EXPECT_TRUE(EIGEN_MATRIX_NEAR(expected, value, 0.0));
+      }
+    }
+  }
+
+  // Receding-horizon updates work on both setups.
+  EXPECT_TRUE(opt_vertices.removeVertices(1, 2));
+  EXPECT_TRUE(opt_matrices.removeVertices(1, 2));
+  EXPECT_TRUE(opt_vertices.solveLinear());
+  EXPECT_TRUE(opt_matrices.solveLinear());
+  Segment::Vector segments_vertices, segments_matrices;
+  opt_vertices.getSegments(&segments_vertices);
+  opt_matrices.getSegments(&segments_matrices);
+  ASSERT_EQ(kNumSegments - 3, segments_matrices.size());
+  for (size_t i = 0; i < segments_vertices.size(); ++i) {
+    EXPECT_TRUE(segments_vertices[i] == segments_matrices[i]);
+  }
+}
+
+TEST(MavTrajectoryGeneration, EvaluateRangeAllDerivatives) {
+  Vertex::Vector vertices;
+  const int kDim = 4;
+  Eigen::VectorXd min_pos = Eigen::VectorXd::Constant(kDim, -10.0);
+  Eigen::VectorXd max_pos = -min_pos;
+  vertices = createRandomVertices(max_derivative, 10, min_pos, max_pos, 1234);
+  std::vector<double> segment_times = estimateSegmentTimes(vertices, 3.0, 5.0);
+
+  PolynomialOptimization<N> opt(kDim);
+  opt.setupFromVertices(vertices, segment_times, derivative_to_optimize);
+  opt.solveLinear();
+  Trajectory trajectory;
+  opt.getTrajectory(&trajectory);
+
+  const double kDt = 0.01;
+  Eigen::MatrixXd samples;
+  std::vector<double> sampling_times;
+  timing::Timer timer_all("evaluate_range_all_derivatives");
+  ASSERT_TRUE(trajectory.evaluateRangeAllDerivatives(
+      0.0, trajectory.getMaxTime(), kDt, derivative_order::SNAP, &samples,
+      &sampling_times));
+  timer_all.Stop();
+  ASSERT_EQ(samples.rows(), kDim * (derivative_order::SNAP + 1));
+  ASSERT_EQ(static_cast<size_t>(samples.cols()), sampling_times.size());
+
+  for (size_t i = 0; i < sampling_times.size(); ++i) {
+    for (int derivative = 0; derivative <= derivative_order::SNAP;
+         ++derivative) {
+      Eigen::VectorXd expected =
+          trajectory.evaluate(sampling_times[i], derivative);
+      EXPECT_TRUE(EIGEN_MATRIX_NEAR(
+          expected, samples.col(i).segment(derivative * kDim, kDim),
+          1.0e-8 * (1.0 + expected.norm())))
+          << "at t = " << sampling_times[i] << ", derivative " << derivative;
+    }
+  }
+
+  // The vectorized evaluation has to give the same samples.
+  VectorizedTrajectory vectorized_trajectory(trajectory,
+                                             derivative_order::SNAP);
+  Eigen::MatrixXd vectorized_samples;
+  timing::Timer timer_vectorized("evaluate_range_vectorized");
+  ASSERT_TRUE(vectorized_trajectory.evaluateRangeAllDerivatives(
+      0.0, trajectory.getMaxTime(), kDt, &vectorized_samples));
+  timer_vectorized.Stop();
+  ASSERT_EQ(samples.rows(), vectorized_samples.rows());
+  ASSERT_EQ(samples.cols(), vectorized_samples.cols());
+  for (int i = 0; i < samples.cols(); ++i) {
+    EXPECT_TRUE(EIGEN_MATRIX_NEAR(samples.col(i), vectorized_samples.col(i),
+                                  1.0e-8 * (1.0 + samples.col(i).norm())))
+        << "at t = " << sampling_times[i];
+  }
+
+  // Out of range.
+  EXPECT_FALSE(trajectory.evaluateRangeAllDerivatives(
+      0.0, trajectory.getMaxTime() + 1.0, kDt, derivative_order::SNAP,
+      &samples));
+}
+
+TEST(MavTrajectoryGeneration, TrajectoryBatchEvaluation) {
+  const int kDim = 3;
+  const int kNumTrajectories = 8;
+  Eigen::VectorXd min_pos = Eigen::VectorXd::Constant(kDim, -10.0);
+  Eigen::VectorXd max_pos = -min_pos;
+  std::vector<Trajectory> trajectories(kNumTrajectories);
+  for (int i = 0; i < kNumTrajectories; ++i) {
+    Vertex::Vector vertices = createRandomVertices(
+        derivative_order::JERK, 2 + i, min_pos, max_pos, 1234 + i);
+    std::vector<double> segment_times =
+        estimateSegmentTimes(vertices, 3.0, 5.0);
+    // Mix polynomial orders, which the batch pads to the highest one.
+    if (i % 2 == 0) {
+      PolynomialOptimization<N> opt(kDim);
+      opt.setupFromVertices(vertices, segment_times, derivative_to_optimize);
+      opt.solveLinear();
+      opt.getTrajectory(&trajectories[i]);
+    } else {
+      PolynomialOptimization<8> opt(kDim);
+      opt.setupFromVertices(vertices, segment_times,
+                            derivative_order::JERK);
+      opt.solveLinear();
+      opt.getTrajectory(&trajectories[i]);
+    }
+  }
+
+  TrajectoryBatch batch(trajectories, derivative_order::SNAP);
+  EXPECT_EQ(N, batch.N());
+  ASSERT_EQ(static_cast<size_t>(kNumTrajectories),
+            batch.getNumberTrajectories());
+
+  const size_t kNumSamples = 5000;
+  std::mt19937 generator(1234);
+  std::uniform_int_distribution<int> trajectory_distribution(
+      0, kNumTrajectories - 1);
+  std::uniform_real_distribution<double> time_distribution(0.0, 1.0);
+  std::vector<int> trajectory_indices(kNumSamples);
+  std::vector<double> times(kNumSamples);
+  for (size_t i = 0; i < kNumSamples; ++i) {
+    trajectory_indices[i] = trajectory_distribution(generator);
+    times[i] = time_distribution(generator) *
+               trajectories[trajectory_indices[i]].getMaxTime();
+  }
+
+  ThreadPool thread_pool(4);
+  for (ThreadPool* pool : {static_cast<ThreadPool*>(nullptr), &thread_pool}) {
+    std::vector<double> result(kNumSamples * batch.getSampleSize());
+    ASSERT_TRUE(batch.evaluate(trajectory_indices.data(), times.data(),
+                               kNumSamples, result.data(), pool));
+    for (size_t i = 0; i < kNumSamples; ++i) {
+      const Trajectory& trajectory = trajectories[trajectory_indices[i]];
+      for (int derivative = 0; derivative <= derivative_order::SNAP;
+           ++derivative) {
+        const Eigen::VectorXd expected =
+            trajectory.evaluate(times[i], derivative);
+        const Eigen::Map<const Eigen::VectorXd> actual(
+            &result[i * batch.getSampleSize() + derivative * kDim], kDim);
+        EXPECT_TRUE(EIGEN_MATRIX_NEAR(expected, actual,
+                                      1.0e-8 * (1.0 + expected.norm())))
+            << "sample " << i << ", derivative " << derivative;
+      }
+    }
+  }
+
+  // Samples after the end are set to zero.
+  times[0] = trajectories[trajectory_indices[0]].getMaxTime() + 1.0;
+  std::vector<double> result(batch.getSampleSize(), 1.0);
+  EXPECT_FALSE(batch.evaluate(trajectory_indices.data(), times.data(), 1,
+                              result.data()));
+  for (double value : result) {
+    EXPECT_EQ(0.0, value);
+  }
+}
+
+TEST(MavTrajectoryGeneration, LinearSolverBackends) {
+  const int kDim = 3;
+  Eigen::VectorXd min_pos = Eigen::VectorXd::Constant(kDim, -10.0);
+  Eigen::VectorXd max_pos = -min_pos;
+  const std::vector<LinearSolverType> solver_types = {
+      kLinearSolverDefault, kLinearSolverDenseLDLT, kLinearSolverBandedLDLT};
+  const std::vector<std::string> solver_names = {"default", "dense_ldlt",
+                                                 "banded_ldlt"};
+
+  for (int n_segments : {3, 100}) {
+    Vertex::Vector vertices = createRandomVertices(
+        max_derivative, n_segments, min_pos, max_pos, 1234);
+    std::vector<double> segment_times =
+        estimateSegmentTimes(vertices, 3.0, 5.0);
+
+    // Reference solution.
+    PolynomialOptimization<N> opt_qr(kDim);
+    opt_qr.setLinearSolverType(kLinearSolverSparseQR);
+    opt_qr.setupFromVertices(vertices, segment_times, derivative_to_optimize);
+    timing::Timer timer_qr("solve_linear_sparse_qr_" +
+                           std::to_string(n_segments) + "s");
+    EXPECT_TRUE(opt_qr.solveLinear());
+    timer_qr.Stop();
+    std::vector<Eigen::VectorXd> free_constraints_qr;
+    opt_qr.getFreeConstraints(&free_constraints_qr);
+
+    for (size_t i = 0; i < solver_types.size(); ++i) {
+      PolynomialOptimization<N> opt(kDim);
+      opt.setLinearSolverType(solver_types[i]);
+      opt.setupFromVertices(vertices, segment_times, derivative_to_optimize);
+      timing::Timer timer("solve_linear_" + solver_names[i] + "_" +
+                          std::to_string(n_segments) + "s");
+      EXPECT_TRUE(opt.solveLinear());
+      timer.Stop();
+      std::vector<Eigen::VectorXd> free_constraints;
+      opt.getFreeConstraints(&free_constraints);
+      ASSERT_EQ(free_constraints_qr.size(), free_constraints.size());
+      for (size_t d = 0; d < free_constraints.size(); ++d) {
+        EXPECT_TRUE(EIGEN_MATRIX_NEAR(
+            free_constraints_qr[d], free_constraints[d],
+            1.0e-6 * (1.0 + free_constraints_qr[d].norm())))
+            << solver_names[i] << " with " << n_segments << " segments.";
+      }
+    }
+  }
+}
+
+TEST(MavTrajectoryGeneration, TimeNormalization) {
+  const int kN = 12;
+  const int kDim = 3;
+  typedef PolynomialOptimization<kN> Optimization;
+  for (int derivative = 0;
+       derivative <= Optimization::kHighestDerivativeToOptimize;
+       ++derivative) {
+    for (double t = 0.1; t <= 100.0; t *= 3.0) {
+      Optimization::SquareMatrix Ai, Q, H;
+      Optimization::computeTimeScaledMatrices(derivative, t, &Ai, &Q);
+      Optimization::computeTimeScaledCostBlock(derivative, t, &H);
+      const Optimization::SquareMatrix H_expected = Ai.transpose() * Q * Ai;
+      // Compared at unit diagonal, as the elements span many magnitudes.
+      const Eigen::Matrix<double, kN, 1> scaling =
+          H_expected.diagonal().cwiseSqrt().cwiseInverse();
+      EXPECT_TRUE(EIGEN_MATRIX_NEAR(
+          scaling.asDiagonal() * H_expected * scaling.asDiagonal(),
+          scaling.asDiagonal() * H * scaling.asDiagonal(), 1.0e-6))
+          << "time was " << t << ", derivative " << derivative;
+    }
+  }
+
+  // Segment times from 0.1 s to 100 s.
+  Eigen::VectorXd min_pos = Eigen::VectorXd::Constant(kDim, -10.0);
+  Eigen::VectorXd max_pos = -min_pos;
+  Vertex::Vector vertices =
+      createRandomVertices(max_derivative, 20, min_pos, max_pos, 4321);
+  std::mt19937 generator(4321);
+  std::uniform_real_distribution<double> log_time(std::log(0.1),
+                                                  std::log(100.0));
+  std::vector<double> segment_times;
+  for (size_t i = 0; i + 1 < vertices.size(); ++i) {
+    segment_times.push_back(std::exp(log_time(generator)));
+  }
+
+  for (LinearSolverType solver_type :
+       {kLinearSolverDenseLDLT, kLinearSolverBandedLDLT,
+        kLinearSolverSparseQR}) {
+    Optimization opt(kDim), opt_raw(kDim);
+    EXPECT_FALSE(opt_raw.getNormalization());
+    opt.setNormalization(true);
+    for (Optimization* o : {&opt, &opt_raw}) {
+      o->setLinearSolverType(solver_type);
+      o->setupFromVertices(vertices, segment_times, derivative_order::SNAP);
+      EXPECT_TRUE(o->solveLinear());
+    }
+    const double condition = opt.getConditionEstimate();
+    const double condition_raw = opt_raw.getConditionEstimate();
+    const double cost = opt.computeCost();
+    const double cost_raw = opt_raw.computeCost();
+    EXPECT_GT(condition, 0.0);
+    EXPECT_LT(condition * 1.0e3, condition_raw);
+    EXPECT_LT(cost, cost_raw * (1.0 + 1.0e-6));
+  }
+}
+
+TEST(MavTrajectoryGeneration, IncrementalSegmentTimeUpdates) {
+  const int kDim = 3;
+  const int kNumSegments = 100;
+  Eigen::VectorXd min_pos = Eigen::VectorXd::Constant(kDim, -10.0);
+  Eigen::VectorXd max_pos = -min_pos;
+  Vertex::Vector vertices = createRandomVertices(max_derivative, kNumSegments,
+                                                 min_pos, max_pos, 1234);
+  std::vector<double> segment_times = estimateSegmentTimes(vertices, 3.0, 5.0);
+
+  PolynomialOptimization<N> opt_incremental(kDim);
+  opt_incremental.setupFromVertices(vertices, segment_times,
+                                    derivative_to_optimize);
+  EXPECT_TRUE(opt_incremental.solveLinear());
+
+  std::mt19937 generator(1234);
+  std::uniform_int_distribution<int> segment_distribution(0, kNumSegments - 1);
+  std::uniform_real_distribution<double> scale_distribution(0.5, 2.0);
+  for (int i = 0; i < 50; ++i) {
+    // Perturb a single segment time, as subplex does.
+    segment_times[segment_distribution(generator)] *=
+        scale_distribution(generator);
+
+    timing::Timer timer_incremental("solve_linear_incremental_100s");
+    opt_incremental.updateSegmentTimes(segment_times);
+    EXPECT_TRUE(opt_incremental.solveLinear());
+    timer_incremental.Stop();
+
+    timing::Timer timer_full("solve_linear_full_100s");
+    PolynomialOptimization<N> opt_full(kDim);
+    opt_full.setupFromVertices(vertices, segment_times,
+                               derivative_to_optimize);
+    EXPECT_TRUE(opt_full.solveLinear());
+    timer_full.Stop();
+
+    std::vector<Eigen::VectorXd> free_incremental, free_full;
+    opt_incremental.getFreeConstraints(&free_incremental);
+    opt_full.getFreeConstraints(&free_full);
+    for (int d = 0; d < kDim; ++d) {
+      EXPECT_TRUE(EIGEN_MATRIX_NEAR(free_full[d], free_incremental[d],
+                                    1.0e-8 * (1.0 + free_full[d].norm())));
+    }
+    EXPECT_NEAR(opt_full.computeCost(), opt_incremental.computeCost(),
+                1.0e-8 * opt_full.computeCost());
+  }
+}
+
+TEST(MavTrajectoryGeneration, IncrementalFreeConstraintUpdates) {
+  const int kDim = 3;
+  const int kNumSegments = 50;
+  Eigen::VectorXd min_pos = Eigen::VectorXd::Constant(kDim, -10.0);
+  Eigen::VectorXd max_pos = -min_pos;
+  Vertex::Vector vertices = createRandomVertices(max_derivative, kNumSegments,
+                                                 min_pos, max_pos, 4321);
+  std::vector<double> segment_times = estimateSegmentTimes(vertices, 3.0, 5.0);
+
+  PolynomialOptimization<N> opt_incremental(kDim);
+  opt_incremental.setupFromVertices(vertices, segment_times,
+                                    derivative_to_optimize);
+  EXPECT_TRUE(opt_incremental.solveLinear());
+  Eigen::MatrixXd free_constraints = opt_incremental.getFreeConstraintsRef();
+
+  std::mt19937 generator(4321);
+  std::uniform_int_distribution<int> segment_distribution(0, kNumSegments - 1);
+  std::uniform_int_distribution<int> free_distribution(
+      0, free_constraints.rows() - 1);
+  std::normal_distribution<double> step_distribution(0.0, 0.1);
+  for (int i = 0; i < 20; ++i) {
+    // Perturb a single variable of the time and free constraint optimization.
+    if (i % 2 == 0) {
+      segment_times[segment_distribution(generator)] *= 1.1;
+    } else {
+      free_constraints(free_distribution(generator), i % kDim) +=
+          step_distribution(generator);
+    }
+    opt_incremental.updateSegmentTimes(segment_times);
+    opt_incremental.setFreeConstraints(free_constraints);
+
+    PolynomialOptimization<N> opt_full(kDim);
+    opt_full.setupFromVertices(vertices, segment_times,
+                               derivative_to_optimize);
+    std::vector<Eigen::VectorXd> free_constraints_columns;
+    for (int d = 0; d < kDim; ++d) {
+      free_constraints_columns.push_back(free_constraints.col(d));
+    }
+    opt_full.setFreeConstraints(free_constraints_columns);
+
+    Segment::Vector segments_incremental, segments_full;
+    opt_incremental.getSegments(&segments_incremental);
+    opt_full.getSegments(&segments_full);
+    ASSERT_EQ(segments_full.size(), segments_incremental.size());
+    for (size_t j = 0; j < segments_full.size(); ++j) {
+      EXPECT_EQ(segments_full[j].getTime(), segments_incremental[j].getTime());
+      for (int d = 0; d < kDim; ++d) {
+        EXPECT_TRUE(EIGEN_MATRIX_NEAR(
+            segments_full[j][d].getCoefficients(0),
+            segments_incremental[j][d].getCoefficients(0), 0.0));
+      }
     }
   }
 }
 
+TEST(MavTrajectoryGeneration, AnalyticGradients) {
+  const int kDim = 3;
+  const int kNumSegments = 5;
+  Eigen::VectorXd min_pos = Eigen::VectorXd::Constant(kDim, -10.0);
+  Eigen::VectorXd max_pos = -min_pos;
+  Vertex::Vector vertices = createRandomVertices(max_derivative, kNumSegments,
+                                                 min_pos, max_pos, 1234);
+  const std::vector<double> segment_times =
+      estimateSegmentTimes(vertices, 3.0, 5.0);
+
+  PolynomialOptimization<N> opt(kDim);
+  opt.setupFromVertices(vertices, segment_times, derivative_to_optimize);
+  EXPECT_TRUE(opt.solveLinear());
+
+  // Time-only: the free constraints follow the segment times.
+  std::vector<double> gradient_cost, gradient_velocity;
+  std::vector<Eigen::VectorXd> gradient_free_cost, gradient_free_velocity;
+  opt.computeCostGradient(&gradient_cost, &gradient_free_cost);
+  EXPECT_TRUE(opt.addFreeConstraintSensitivity(gradient_free_cost,
+                                               &gradient_cost));
+  const Extremum v_max =
+      opt.computeMaximumOfMagnitude<derivative_order::VELOCITY>(nullptr);
+  opt.computeMagnitudeGradient(derivative_order::VELOCITY, v_max,
+                               &gradient_velocity, &gradient_free_velocity);
+  EXPECT_TRUE(opt.addFreeConstraintSensitivity(gradient_free_velocity,
+                                               &gradient_velocity));
+
+  std::vector<Eigen::VectorXd> free_constraints;
+  opt.getFreeConstraints(&free_constraints);
+
+  for (int i = 0; i < kNumSegments; ++i) {
+    const double h = 1.0e-4 * segment_times[i];
+    std::vector<double> cost(2), velocity(2);
+    for (int j = 0; j < 2; ++j) {
+      std::vector<double> times = segment_times;
+      times[i] += j == 0 ? h : -h;
+      PolynomialOptimization<N> opt_perturbed(kDim);
+      opt_perturbed.setupFromVertices(vertices, times, derivative_to_optimize);
+      EXPECT_TRUE(opt_perturbed.solveLinear());
+      cost[j] = opt_perturbed.computeCost();
+      velocity[j] = opt_perturbed
+                        .computeMaximumOfMagnitude<derivative_order::VELOCITY>(
+                            nullptr)
+                        .value;
+    }
+    const double gradient_cost_numeric = (cost[0] - cost[1]) / (2.0 * h);
+    const double gradient_velocity_numeric =
+        (velocity[0] - velocity[1]) / (2.0 * h);
+    EXPECT_NEAR(gradient_cost_numeric, gradient_cost[i],
+                1.0e-4 * std::abs(gradient_cost_numeric) + 1.0e-6);
+    EXPECT_NEAR(gradient_velocity_numeric, gradient_velocity[i],
+                1.0e-4 * std::abs(gradient_velocity_numeric) + 1.0e-6);
+  }
+
+  // Segment times and free constraints as independent variables.
+  std::mt19937 generator(1234);
+  std::uniform_real_distribution<double> distribution(-0.5, 0.5);
+  for (Eigen::VectorXd& dp : free_constraints) {
+    for (int i = 0; i < dp.size(); ++i) dp[i] += distribution(generator);
+  }
+  opt.setFreeConstraints(free_constraints);
+  opt.computeCostGradient(&gradient_cost, &gradient_free_cost);
+
+  for (int i = 0; i < kNumSegments; ++i) {
+    const double h = 1.0e-6 * segment_times[i];
+    std::vector<double> cost(2);
+    for (int j = 0; j < 2; ++j) {
+      std::vector<double> times = segment_times;
+      times[i] += j == 0 ? h : -h;
+      opt.updateSegmentTimes(times);
+      opt.setFreeConstraints(free_constraints);
+      cost[j] = opt.computeCost();
+    }
+    const double gradient_numeric = (cost[0] - cost[1]) / (2.0 * h);
+    EXPECT_NEAR(gradient_numeric, gradient_cost[i],
+                1.0e-4 * std::abs(gradient_numeric) + 1.0e-6);
+  }
+  opt.updateSegmentTimes(segment_times);
+
+  for (int d = 0; d < kDim; ++d) {
+    for (int i = 0; i < free_constraints[d].size(); ++i) {
+      const double h = 1.0e-4 * (1.0 + std::abs(free_constraints[d][i]));
+      std::vector<double> cost(2);
+      for (int j = 0; j < 2; ++j) {
+        std::vector<Eigen::VectorXd> perturbed = free_constraints;
+        perturbed[d][i] += j == 0 ? h : -h;
+        opt.setFreeConstraints(perturbed);
+        cost[j] = opt.computeCost();
+      }
+      const double gradient_numeric = (cost[0] - cost[1]) / (2.0 * h);
+      EXPECT_NEAR(gradient_numeric, gradient_free_cost[d][i],
+                  1.0e-4 * std::abs(gradient_numeric) + 1.0e-6);
+    }
+  }
+}
+
+TEST(MavTrajectoryGeneration, ThreadPoolParallelFor) {
+  ThreadPool thread_pool(4);
+  EXPECT_EQ(4u, thread_pool.getNumberThreads());
+  for (size_t n_jobs : {0, 1, 3, 1000}) {
+    std::vector<std::atomic<int> > counts(n_jobs);
+    for (std::atomic<int>& count : counts) count = 0;
+    // Uneven jobs, such that workers have to steal.
+    thread_pool.parallelFor(n_jobs, [&counts](size_t job_idx, size_t) {
+      if (job_idx < 10) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+      }
+      ++counts[job_idx];
+    });
+    for (const std::atomic<int>& count : counts) EXPECT_EQ(1, count);
+  }
+}
+
+TEST(MavTrajectoryGeneration, BatchPlanner) {
+  const int kDim = 3;
+  const int kNumJobs = 200;
+  Eigen::VectorXd min_pos = Eigen::VectorXd::Constant(kDim, -10.0);
+  Eigen::VectorXd max_pos = -min_pos;
+  std::vector<BatchPlanner<N>::Job> jobs(kNumJobs);
+  for (int i = 0; i < kNumJobs; ++i) {
+    jobs[i].vertices =
+        createRandomVertices(max_derivative, 10 + i % 20, min_pos, max_pos, i);
+    jobs[i].segment_times = estimateSegmentTimes(jobs[i].vertices, 3.0, 5.0);
+  }
+  // Some nonlinear jobs in between.
+  for (int i = 0; i < kNumJobs; i += 50) {
+    jobs[i].optimize_nonlinear = true;
+    jobs[i].parameters.max_iterations = 100;
+    jobs[i].maximum_magnitude_constraints[derivative_order::VELOCITY] = 3.0;
+  }
+
+  std::vector<BatchPlanner<N>::Result> results_sequential, results_parallel;
+  BatchPlanner<N> planner_sequential(1);
+  timing::Timer timer_sequential("batch_planner_1_thread");
+  planner_sequential.solve(jobs, &results_sequential);
+  timer_sequential.Stop();
+
+  BatchPlanner<N> planner_parallel;
+  timing::Timer timer_parallel(
+      "batch_planner_" + std::to_string(planner_parallel.getNumberThreads()) +
+      "_threads");
+  planner_parallel.solve(jobs, &results_parallel);
+  timer_parallel.Stop();
+
+  ASSERT_EQ(jobs.size(), results_sequential.size());
+  ASSERT_EQ(jobs.size(), results_parallel.size());
+  for (int i = 0; i < kNumJobs; ++i) {
+    EXPECT_TRUE(results_parallel[i].success);
+    EXPECT_EQ(results_sequential[i].success, results_parallel[i].success);
+
+    Segment::Vector segments_sequential, segments_parallel;
+    results_sequential[i].trajectory.getSegments(&segments_sequential);
+    results_parallel[i].trajectory.getSegments(&segments_parallel);
+    ASSERT_EQ(jobs[i].segment_times.size(), segments_parallel.size());
+    ASSERT_EQ(segments_sequential.size(), segments_parallel.size());
+    if (jobs[i].optimize_nonlinear) continue;
+
+    PolynomialOptimization<N> opt(kDim);
+    opt.setupFromVertices(jobs[i].vertices, jobs[i].segment_times);
+    EXPECT_TRUE(opt.solveLinear());
+    Segment::Vector segments;
+    opt.getSegments(&segments);
+    for (size_t s = 0; s < segments.size(); ++s) {
+      for (int d = 0; d < kDim; ++d) {
+        EXPECT_TRUE(
+            EIGEN_MATRIX_NEAR(segments[s][d].getCoefficients(0),
+                              segments_parallel[s][d].getCoefficients(0),
+                              1.0e-8 * (1.0 + segments[s][d]
+                                                  .getCoefficients(0)
+                                                  .norm())));
+      }
+    }
+  }
+}
+
+TEST(MavTrajectoryGeneration, SolutionCache) {
+  const int kDim = 3;
+  const int kNumPatterns = 4;
+  const int kNumCopies = 25;
+  Eigen::VectorXd min_pos = Eigen::VectorXd::Constant(kDim, -10.0);
+  Eigen::VectorXd max_pos = -min_pos;
+
+  // Translated copies of a few patterns.
+  std::mt19937 generator(42);
+  std::uniform_real_distribution<double> offset_distribution(-100.0, 100.0);
+  std::vector<BatchPlanner<N>::Job> jobs;
+  for (int copy = 0; copy < kNumCopies; ++copy) {
+    for (int pattern = 0; pattern < kNumPatterns; ++pattern) {
+      BatchPlanner<N>::Job job;
+      job.vertices =
+          createRandomVertices(max_derivative, 10, min_pos, max_pos, pattern);
+      job.segment_times = estimateSegmentTimes(job.vertices, 3.0, 5.0);
+      const double offset = offset_distribution(generator);
+      for (Vertex& vertex : job.vertices) {
+        Eigen::VectorXd position;
+        EXPECT_TRUE(vertex.getConstraint(derivative_order::POSITION,
+                                         &position));
+        vertex.addConstraint(derivative_order::POSITION,
+                             (position.array() + offset).matrix());
+      }
+      if (pattern == 0) {
+        job.optimize_nonlinear = true;
+        job.parameters.max_iterations = 100;
+        job.maximum_magnitude_constraints[derivative_order::VELOCITY] = 3.0;
+      }
+      jobs.push_back(job);
+    }
+  }
+
+  // Resolution above the rounding errors of the translation.
+  SolutionCache cache(100, 1.0e-6);
+  BatchPlanner<N> planner(1);
+  planner.setSolutionCache(&cache);
+  std::vector<BatchPlanner<N>::Result> results;
+  timing::Timer timer_cached("batch_planner_cached");
+  planner.solve(jobs, &results);
+  timer_cached.Stop();
+  EXPECT_EQ(static_cast<size_t>(kNumPatterns), cache.size());
+  EXPECT_EQ(static_cast<size_t>(kNumPatterns), cache.getNumMisses());
+  EXPECT_EQ(jobs.size() - kNumPatterns, cache.getNumHits());
+
+  BatchPlanner<N> uncached_planner(1);
+  std::vector<BatchPlanner<N>::Result> uncached_results;
+  timing::Timer timer_uncached("batch_planner_uncached");
+  uncached_planner.solve(jobs, &uncached_results);
+  timer_uncached.Stop();
+  for (size_t i = 0; i < jobs.size(); ++i) {
+    EXPECT_TRUE(results[i].success);
+    EXPECT_EQ(i >= static_cast<size_t>(kNumPatterns), results[i].from_cache);
+    const Trajectory& expected = uncached_results[i].trajectory;
+    for (double t = 0.0; t < expected.getMaxTime(); t += 0.5) {
+      EXPECT_TRUE(EIGEN_MATRIX_NEAR(expected.evaluate(t),
+                                    results[i].trajectory.evaluate(t),
+                                    1.0e-4));
+    }
+  }
+
+  // A position magnitude constraint is not translation invariant, thus a
+  // translated copy of a job is solved again.
+  std::vector<BatchPlanner<N>::Job> position_jobs = {jobs[0],
+                                                     jobs[kNumPatterns]};
+  for (BatchPlanner<N>::Job& job : position_jobs) {
+    job.maximum_magnitude_constraints[derivative_order::POSITION] = 200.0;
+  }
+  SolutionCache position_cache(100, 1.0e-6);
+  planner.setSolutionCache(&position_cache);
+  std::vector<BatchPlanner<N>::Result> position_results;
+  planner.solve(position_jobs, &position_results);
+  EXPECT_FALSE(position_results[0].from_cache);
+  EXPECT_FALSE(position_results[1].from_cache);
+  EXPECT_EQ(0u, position_cache.size());
+  EXPECT_EQ(0u, position_cache.getNumHits());
+
+  // Least recently used entries are evicted.
+  SolutionCache small_cache(2);
+  Eigen::VectorXd translation;
+  SolutionCache::Key keys[3];
+  for (int i = 0; i < 3; ++i) {
+    small_cache.computeKey(jobs[i].vertices, jobs[i].segment_times, 4,
+                           std::vector<double>(), &keys[i], &translation);
+    small_cache.insert(keys[i], translation, results[i].trajectory, i);
+  }
+  EXPECT_EQ(2u, small_cache.size());
+  Trajectory trajectory;
+  int status = -1;
+  EXPECT_FALSE(small_cache.lookup(keys[0], translation, &trajectory));
+  EXPECT_TRUE(small_cache.lookup(keys[2], translation, &trajectory, &status));
+  EXPECT_EQ(2, status);
+  EXPECT_TRUE(EIGEN_MATRIX_NEAR(results[2].trajectory.evaluate(1.0),
+                                trajectory.evaluate(1.0), 1.0e-9));
+}
+
+TEST(MavTrajectoryGeneration, SegmentTimeInitializer) {
+  const double v_max = 2.0;
+  const double a_max = 2.0;
+  Eigen::VectorXd min_pos = Eigen::VectorXd::Constant(3, -10.0);
+  Eigen::VectorXd max_pos = -min_pos;
+  Vertex::Vector vertices =
+      createRandomVertices(max_derivative, 10, min_pos, max_pos, 1234);
+
+  FabianSegmentTimeInitializer fabian(v_max, a_max);
+  std::vector<double> fabian_times;
+  EXPECT_TRUE(fabian.estimateSegmentTimes(vertices, &fabian_times));
+  EXPECT_EQ(estimateSegmentTimes(vertices, v_max, a_max), fabian_times);
+
+  CornerAwareSegmentTimeInitializer corner_aware(v_max, a_max);
+  std::vector<double> corner_times;
+  EXPECT_TRUE(corner_aware.estimateSegmentTimes(vertices, &corner_times));
+  ASSERT_EQ(vertices.size() - 1, corner_times.size());
+  for (double time : corner_times) {
+    EXPECT_GT(time, 0.0);
+  }
+
+  // The middle segment is passed at full speed on a straight line and slower
+  // when turning back.
+  Vertex::Vector straight(4, Vertex(3)), turning(4, Vertex(3));
+  const Eigen::Vector3d positions[] = {
+      Eigen::Vector3d(0, 0, 0), Eigen::Vector3d(10, 0, 0),
+      Eigen::Vector3d(20, 0, 0), Eigen::Vector3d(10, 0.1, 0)};
+  for (int i = 0; i < 4; ++i) {
+    straight[i].addConstraint(derivative_order::POSITION,
+                              Eigen::Vector3d(10.0 * i, 0, 0));
+    turning[i].addConstraint(derivative_order::POSITION, positions[i]);
+  }
+  straight.front().makeStartOrEnd(Eigen::Vector3d(0, 0, 0), max_derivative);
+  straight.back().makeStartOrEnd(Eigen::Vector3d(30, 0, 0), max_derivative);
+  turning.front().makeStartOrEnd(positions[0], max_derivative);
+  turning.back().makeStartOrEnd(positions[3], max_derivative);
+  std::vector<double> straight_times, turning_times;
+  EXPECT_TRUE(corner_aware.estimateSegmentTimes(straight, &straight_times));
+  EXPECT_TRUE(corner_aware.estimateSegmentTimes(turning, &turning_times));
+  EXPECT_NEAR(2.0 * 10.0 / v_max, straight_times[1], 1.0e-9);
+  EXPECT_LT(straight_times[1], turning_times[1]);
+
+  PolynomialOptimization<N> opt(3);
+  EXPECT_TRUE(
+      opt.setupFromVertices(vertices, corner_times, derivative_to_optimize));
+  EXPECT_TRUE(opt.solveLinear());
+  Trajectory trajectory;
+  opt.getTrajectory(&trajectory);
+  Extremum v_min_traj, v_max_traj;
+  EXPECT_TRUE(trajectory.computeMinMaxMagnitude(derivative_order::VELOCITY,
+                                                std::vector<int>{0, 1, 2},
+                                                &v_min_traj, &v_max_traj));
+  EXPECT_LT(v_max_traj.value, 1.5 * v_max);
+
+  // The same problem is seeded with the previous solution, problems with
+  // another number of segments fall back to the estimate.
+  WarmStartSegmentTimeInitializer warm_start(&corner_aware);
+  EXPECT_FALSE(warm_start.hasPreviousSolution());
+  std::vector<double> previous_times = corner_times;
+  previous_times[2] *= 1.5;
+  warm_start.setPreviousSolution(vertices, previous_times);
+  EXPECT_TRUE(warm_start.hasPreviousSolution());
+  std::vector<double> warm_times;
+  EXPECT_TRUE(warm_start.estimateSegmentTimes(vertices, &warm_times));
+  ASSERT_EQ(previous_times.size(), warm_times.size());
+  for (size_t i = 0; i < warm_times.size(); ++i) {
+    EXPECT_NEAR(previous_times[i], warm_times[i], 1.0e-9);
+  }
+  EXPECT_TRUE(warm_start.estimateSegmentTimes(straight, &warm_times));
+  EXPECT_EQ(straight_times, warm_times);
+  warm_start.clear();
+  EXPECT_FALSE(warm_start.hasPreviousSolution());
+
+  // Jobs without segment times are estimated by their initializer.
+  BatchPlanner<N>::Job job;
+  job.vertices = vertices;
+  job.segment_time_initializer = &corner_aware;
+  BatchPlanner<N> planner(1);
+  std::vector<BatchPlanner<N>::Result> results;
+  planner.solve(std::vector<BatchPlanner<N>::Job>(1, job), &results);
+  ASSERT_EQ(1u, results.size());
+  EXPECT_TRUE(results[0].success);
+  EXPECT_NEAR(trajectory.getMaxTime(), results[0].trajectory.getMaxTime(),
+              1.0e-9);
+}
+
+TEST(MavTrajectoryGeneration, NonlinearMultiStart) {
+  Eigen::VectorXd pos_min(3), pos_max(3);
+  pos_min << -10.0, -20.0, -10.0;
+  pos_max << 10.0, 20.0, 10.0;
+  Vertex::Vector vertices = createRandomVertices(
+      max_derivative, 10, pos_min * 0.2, pos_max * 0.2, 12345);
+  const double approximate_v_max = 4.0;
+  const double approximate_a_max = 5.0;
+  std::vector<double> segment_times =
+      estimateSegmentTimes(vertices, approximate_v_max / 4, approximate_a_max);
+
+  NonlinearOptimizationParameters parameters;
+  parameters.max_iterations = 1000;
+  parameters.x_rel = 0.1;
+  parameters.random_seed = 12345678;
+
+  PolynomialOptimizationNonLinear<N> opt_single(3, parameters, true);
+  opt_single.setupFromVertices(vertices, segment_times, derivative_to_optimize);
+  opt_single.addMaximumMagnitudeConstraint(derivative_order::VELOCITY,
+                                           approximate_v_max);
+  opt_single.addMaximumMagnitudeConstraint(derivative_order::ACCELERATION,
+                                           approximate_a_max);
+  timing::Timer timer_single("solve_3D_10s_nonlinear_single_start");
+  opt_single.optimize();
+  timer_single.Stop();
+  const OptimizationInfo info_single = opt_single.getOptimizationInfo();
+  const double cost_single = info_single.cost_trajectory +
+                             info_single.cost_time +
+                             info_single.cost_soft_constraints;
+
+  PolynomialOptimizationNonLinear<N> opt_multi(3, parameters, true);
+  opt_multi.setupFromVertices(vertices, segment_times, derivative_to_optimize);
+  opt_multi.addMaximumMagnitudeConstraint(derivative_order::VELOCITY,
+                                          approximate_v_max);
+  opt_multi.addMaximumMagnitudeConstraint(derivative_order::ACCELERATION,
+                                          approximate_a_max);
+  MultiStartParameters multi_start_parameters;
+  multi_start_parameters.n_starts = 4;
+  std::vector<OptimizationInfo> start_infos;
+  timing::Timer timer_multi("solve_3D_10s_nonlinear_4_starts");
+  const int result =
+      opt_multi.optimizeMultiStart(multi_start_parameters, &start_infos);
+  timer_multi.Stop();
+  EXPECT_GT(result, 0);
+  ASSERT_EQ(4u, start_infos.size());
+
+  // The first start is the unperturbed initial guess.
+  const OptimizationInfo info_multi = opt_multi.getOptimizationInfo();
+  const double cost_multi = info_multi.cost_trajectory + info_multi.cost_time +
+                            info_multi.cost_soft_constraints;
+  EXPECT_LE(cost_multi, cost_single * (1.0 + 1.0e-9));
+  for (const OptimizationInfo& info : start_infos) {
+    EXPECT_LE(cost_multi, info.cost_trajectory + info.cost_time +
+                              info.cost_soft_constraints);
+  }
+  EXPECT_NEAR(cost_multi - info_multi.cost_soft_constraints,
+              opt_multi.getPolynomialOptimizationRef().computeCost() +
+                  info_multi.cost_time,
+              1.0e-6 * cost_multi);
+
+  Segment::Vector segments;
+  opt_multi.getPolynomialOptimizationRef().getSegments(&segments);
+  checkPath(vertices, segments);
+
+  // Every start is stopped once a start reaches the target cost.
+  multi_start_parameters.target_cost = std::numeric_limits<double>::max();
+  EXPECT_NE(nlopt::FAILURE,
+            opt_multi.optimizeMultiStart(multi_start_parameters, nullptr));
+}
+
+TEST(MavTrajectoryGeneration, RecedingHorizon) {
+  const int kDim = 3;
+  const int kNumSegments = 10;
+  Eigen::VectorXd min_pos = Eigen::VectorXd::Constant(kDim, -10.0);
+  Eigen::VectorXd max_pos = -min_pos;
+  Vertex::Vector vertices = createRandomVertices(max_derivative, kNumSegments,
+                                                 min_pos, max_pos, 1234);
+  std::vector<double> segment_times = estimateSegmentTimes(vertices, 3.0, 5.0);
+
+  PolynomialOptimization<N> opt(kDim);
+  opt.setupFromVertices(vertices, segment_times, derivative_to_optimize);
+  EXPECT_TRUE(opt.solveLinear());
+  Trajectory previous;
+  opt.getTrajectory(&previous);
+  Segment::Vector previous_segments;
+  opt.getSegments(&previous_segments);
+
+  // Advance into the third segment.
+  const double t =
+      segment_times[0] + segment_times[1] + 0.5 * segment_times[2];
+  EXPECT_TRUE(opt.advanceStart(previous, t));
+  EXPECT_EQ(static_cast<size_t>(kNumSegments - 2), opt.getNumberSegments());
+  EXPECT_TRUE(opt.hasFreeConstraints());
+
+  // The warm start keeps the segments behind the new first segment.
+  Segment::Vector warm_start_segments;
+  opt.getSegments(&warm_start_segments);
+  for (size_t i = 1; i < warm_start_segments.size(); ++i) {
+    for (int d = 0; d < kDim; ++d) {
+      EXPECT_TRUE(EIGEN_MATRIX_NEAR(
+          previous_segments[i + 2][d].getCoefficients(),
+          warm_start_segments[i][d].getCoefficients(), 1.0e-8));
+    }
+  }
+
+  EXPECT_TRUE(opt.solveLinear());
+  Trajectory trajectory;
+  opt.getTrajectory(&trajectory);
+  EXPECT_NEAR(previous.getMaxTime() - t, trajectory.getMaxTime(), 1.0e-9);
+  for (int derivative = 0; derivative <= max_derivative; ++derivative) {
+    EXPECT_TRUE(EIGEN_MATRIX_NEAR(previous.evaluate(t, derivative),
+                                  trajectory.evaluate(0.0, derivative),
+                                  1.0e-6));
+  }
+
+  // Replace the end vertex and compare to a setup from scratch.
+  Vertex end(kDim);
+  end.makeStartOrEnd(Eigen::VectorXd::Constant(kDim, 1.0), max_derivative);
+  EXPECT_TRUE(opt.removeVertices(0, 1));
+  EXPECT_TRUE(opt.appendVertices(Vertex::Vector(1, end),
+                                 std::vector<double>(1, 2.0)));
+  EXPECT_FALSE(opt.removeVertices(kNumSegments, 0));
+  EXPECT_TRUE(opt.solveLinear());
+
+  Vertex::Vector horizon_vertices;
+  std::vector<double> horizon_segment_times;
+  opt.getVertices(&horizon_vertices);
+  opt.getSegmentTimes(&horizon_segment_times);
+  ASSERT_EQ(static_cast<size_t>(kNumSegments - 1), horizon_vertices.size());
+  PolynomialOptimization<N> opt_full(kDim);
+  opt_full.setupFromVertices(horizon_vertices, horizon_segment_times,
+                             derivative_to_optimize);
+  EXPECT_TRUE(opt_full.solveLinear());
+  std::vector<Eigen::VectorXd> free_horizon, free_full;
+  opt.getFreeConstraints(&free_horizon);
+  opt_full.getFreeConstraints(&free_full);
+  for (int d = 0; d < kDim; ++d) {
+    EXPECT_TRUE(EIGEN_MATRIX_NEAR(free_full[d], free_horizon[d],
+                                  1.0e-8 * (1.0 + free_full[d].norm())));
+  }
+
+  // The nonlinear optimization adapts to the new problem size.
+  NonlinearOptimizationParameters parameters;
+  parameters.max_iterations = 100;
+  PolynomialOptimizationNonLinear<N> opt_nonlinear(kDim, parameters, false);
+  opt_nonlinear.setupFromVertices(vertices, segment_times,
+                                  derivative_to_optimize);
+  opt_nonlinear.optimize();
+  opt_nonlinear.getTrajectory(&previous);
+  EXPECT_TRUE(opt_nonlinear.getPolynomialOptimizationRef().advanceStart(
+      previous, 0.5 * segment_times[0]));
+  EXPECT_NE(nlopt::FAILURE, opt_nonlinear.optimize());
+  opt_nonlinear.getTrajectory(&trajectory);
+  EXPECT_TRUE(EIGEN_MATRIX_NEAR(previous.evaluate(0.5 * segment_times[0]),
+                                trajectory.evaluate(0.0), 1.0e-6));
+}
+
+TEST(MavTrajectoryGeneration, WindowedOptimization) {
+  const int kDim = 3;
+  const int kNumSegments = 300;
+  Eigen::VectorXd min_pos = Eigen::VectorXd::Constant(kDim, -10.0);
+  Eigen::VectorXd max_pos = -min_pos;
+  Vertex::Vector vertices = createRandomVertices(max_derivative, kNumSegments,
+                                                 min_pos, max_pos, 1234);
+  std::vector<double> segment_times = estimateSegmentTimes(vertices, 3.0, 5.0);
+
+  timing::Timer timer_full("solve_linear_full_300s");
+  PolynomialOptimization<N> opt_full(kDim);
+  opt_full.setupFromVertices(vertices, segment_times, derivative_to_optimize);
+  EXPECT_TRUE(opt_full.solveLinear());
+  timer_full.Stop();
+  const double cost_full = opt_full.computeCost();
+
+  WindowedOptimizationParameters parameters;
+  parameters.window_segments = 60;
+  parameters.overlap_segments = 20;
+  timing::Timer timer_windowed("solve_linear_windowed_300s");
+  PolynomialOptimizationWindowed<N> opt_windowed(kDim, parameters);
+  opt_windowed.setupFromVertices(vertices, segment_times,
+                                 derivative_to_optimize);
+  EXPECT_TRUE(opt_windowed.solveLinear());
+  timer_windowed.Stop();
+  EXPECT_EQ(7u, opt_windowed.getNumberWindows());
+
+  Segment::Vector segments;
+  opt_windowed.getSegments(&segments);
+  checkPath(vertices, segments);
+  Trajectory trajectory;
+  opt_windowed.getTrajectory(&trajectory);
+  EXPECT_NEAR(std::accumulate(segment_times.begin(), segment_times.end(), 0.0),
+              trajectory.getMaxTime(), 1.0e-9);
+
+  // The whole path is optimal, the overlap keeps the windows close to it.
+  const double cost_windowed = opt_windowed.computeCost();
+  EXPECT_GE(cost_windowed, cost_full * (1.0 - 1.0e-9));
+  EXPECT_LE(cost_windowed, cost_full * (1.0 + 1.0e-6));
+
+  // Without overlap, the seams are still continuous.
+  parameters.overlap_segments = 0;
+  PolynomialOptimizationWindowed<N> opt_no_overlap(kDim, parameters);
+  opt_no_overlap.setupFromVertices(vertices, segment_times,
+                                   derivative_to_optimize);
+  EXPECT_TRUE(opt_no_overlap.solveLinear());
+  EXPECT_EQ(5u, opt_no_overlap.getNumberWindows());
+  opt_no_overlap.getSegments(&segments);
+  checkPath(vertices, segments);
+  EXPECT_GE(opt_no_overlap.computeCost(), cost_windowed * (1.0 - 1.0e-9));
+}
+
+TEST(MavTrajectoryGeneration, SegmentLookup) {
+  const int kDim = 3;
+  const int kNumSegments = 500;
+  Eigen::VectorXd min_pos = Eigen::VectorXd::Constant(kDim, -10.0);
+  Eigen::VectorXd max_pos = -min_pos;
+  Vertex::Vector vertices = createRandomVertices(max_derivative, kNumSegments,
+                                                 min_pos, max_pos, 1234);
+  std::vector<double> segment_times = estimateSegmentTimes(vertices, 3.0, 5.0);
+  PolynomialOptimization<N> opt(kDim);
+  opt.setupFromVertices(vertices, segment_times, derivative_to_optimize);
+  EXPECT_TRUE(opt.solveLinear());
+  Trajectory trajectory;
+  opt.getTrajectory(&trajectory);
+
+  // Vertices belong to the segment on their right, the end to the last one.
+  double t_vertex = 0.0;
+  for (int i = 0; i < trajectory.K(); i++) {
+    EXPECT_EQ(i, trajectory.getSegmentIndex(t_vertex));
+    EXPECT_EQ(t_vertex, trajectory.getSegmentStartTime(i));
+    t_vertex += segment_times[i];
+  }
+  EXPECT_EQ(trajectory.K() - 1,
+            trajectory.getSegmentIndex(trajectory.getMaxTime()));
+
+  std::mt19937 generator(1234);
+  std::uniform_real_distribution<double> time_distribution(
+      0.0, trajectory.getMaxTime());
+  std::vector<double> times(1000);
+  for (double& t : times) {
+    t = time_distribution(generator);
+  }
+
+  // Random access, with the cursor jumping back and forth.
+  Trajectory::Cursor cursor(trajectory);
+  for (double t : times) {
+    const int i = trajectory.getSegmentIndex(t);
+    EXPECT_LE(trajectory.getSegmentStartTime(i), t);
+    EXPECT_GT(trajectory.getSegmentStartTime(i) + segment_times[i], t);
+    EXPECT_EQ(i, cursor.seek(t));
+    const Eigen::VectorXd expected = trajectory.segments()[i].evaluate(
+        t - trajectory.getSegmentStartTime(i), derivative_order::VELOCITY);
+    EXPECT_TRUE(EIGEN_MATRIX_NEAR(
+        expected, trajectory.evaluate(t, derivative_order::VELOCITY), 1e-12));
+  }
+
+  // Monotonic queries.
+  std::sort(times.begin(), times.end());
+  Trajectory::Cursor monotonic_cursor(trajectory);
+  timing::Timer timer_cursor("evaluate_monotonic_500s");
+  for (double t : times) {
+    const Eigen::VectorXd expected = trajectory.evaluate(t);
+    EXPECT_TRUE(
+        EIGEN_MATRIX_NEAR(expected, monotonic_cursor.evaluate(t), 1e-12));
+  }
+  timer_cursor.Stop();
+}
+
+TEST(MavTrajectoryGeneration, SharedTrajectorySegments) {
+  const int kDim = 3;
+  const int kNumSegments = 20;
+  Eigen::VectorXd min_pos = Eigen::VectorXd::Constant(kDim, -10.0);
+  Eigen::VectorXd max_pos = -min_pos;
+  Vertex::Vector vertices = createRandomVertices(max_derivative, kNumSegments,
+                                                 min_pos, max_pos, 2468);
+  std::vector<double> segment_times = estimateSegmentTimes(vertices, 3.0, 5.0);
+  PolynomialOptimization<N> opt(kDim);
+  opt.setupFromVertices(vertices, segment_times, derivative_to_optimize);
+  EXPECT_TRUE(opt.solveLinear());
+  Trajectory trajectory;
+  opt.getTrajectory(&trajectory);
+  const double t_max = trajectory.getMaxTime();
+
+  // Copies share the segments until one of them is modified.
+  Trajectory copy = trajectory;
+  EXPECT_TRUE(copy.sharesSegmentsWith(trajectory));
+  EXPECT_EQ(&trajectory.segments(), &copy.segments());
+  copy.append(trajectory);
+  EXPECT_FALSE(copy.sharesSegmentsWith(trajectory));
+  EXPECT_EQ(kNumSegments, trajectory.K());
+  EXPECT_EQ(2 * kNumSegments, copy.K());
+  EXPECT_NEAR(2.0 * t_max, copy.getMaxTime(), 1.0e-9);
+  EXPECT_TRUE(EIGEN_MATRIX_NEAR(trajectory.evaluate(1.0),
+                                copy.evaluate(t_max + 1.0), 1.0e-9));
+
+  // Appending to an empty trajectory shares the appended one.
+  Trajectory appended;
+  appended.append(trajectory);
+  EXPECT_TRUE(appended.sharesSegmentsWith(trajectory));
+
+  // The whole range is shared, parts are cut and shifted.
+  Trajectory sub;
+  EXPECT_TRUE(trajectory.getSubTrajectory(0.0, t_max, &sub));
+  EXPECT_TRUE(sub.sharesSegmentsWith(trajectory));
+  const double t_start = 0.3 * t_max;
+  const double t_end = 0.7 * t_max;
+  EXPECT_TRUE(trajectory.getSubTrajectory(t_start, t_end, &sub));
+  EXPECT_FALSE(sub.sharesSegmentsWith(trajectory));
+  EXPECT_NEAR(t_end - t_start, sub.getMaxTime(), 1.0e-9);
+  for (double t = 0.0; t <= sub.getMaxTime(); t += 0.13) {
+    for (int derivative = 0; derivative <= max_derivative; derivative++) {
+      const Eigen::VectorXd expected =
+          trajectory.evaluate(t_start + t, derivative);
+      EXPECT_TRUE(EIGEN_MATRIX_NEAR(expected, sub.evaluate(t, derivative),
+                                    1.0e-6 * (1.0 + expected.norm())));
+    }
+  }
+
+  // Cutting on vertices keeps whole segments.
+  const double t_vertex_start = trajectory.getSegmentStartTime(2);
+  const double t_vertex_end = trajectory.getSegmentStartTime(5);
+  EXPECT_TRUE(
+      trajectory.getSubTrajectory(t_vertex_start, t_vertex_end, &sub));
+  EXPECT_EQ(3, sub.K());
+  EXPECT_TRUE(trajectory.segments()[2] == sub.segments()[0]);
+  EXPECT_FALSE(trajectory.getSubTrajectory(t_end, t_start, &sub));
+  EXPECT_FALSE(trajectory.getSubTrajectory(0.0, 2.0 * t_max, &sub));
+
+  // Single dimensions keep the segment times.
+  const Trajectory single = trajectory.getTrajectoryWithSingleDimension(1);
+  EXPECT_NEAR(t_max, single.getMaxTime(), 1.0e-9);
+  EXPECT_NEAR(trajectory.evaluate(1.0)[1], single.evaluate(1.0)[0], 1.0e-12);
+}
+
+TEST(MavTrajectoryGeneration, TrajectoryBvh) {
+  const int kDim = 3;
+  const int kNumSegments = 50;
+  const double kTolerance = 1.0e-3;
+  const double kDt = 1.0e-3;
+  Eigen::VectorXd min_pos = Eigen::VectorXd::Constant(kDim, -10.0);
+  Eigen::VectorXd max_pos = -min_pos;
+  Trajectory trajectories[2];
+  for (int i = 0; i < 2; ++i) {
+    Vertex::Vector vertices = createRandomVertices(
+        max_derivative, kNumSegments, min_pos, max_pos, 1357 + i);
+    std::vector<double> segment_times =
+        estimateSegmentTimes(vertices, 3.0, 5.0);
+    PolynomialOptimization<N> opt(kDim);
+    opt.setupFromVertices(vertices, segment_times, derivative_to_optimize);
+    EXPECT_TRUE(opt.solveLinear());
+    opt.getTrajectory(&trajectories[i]);
+  }
+  const Trajectory& trajectory = trajectories[0];
+
+  timing::Timer timer_build("bvh_build_50s");
+  TrajectoryBvh bvh(trajectory, kTolerance);
+  TrajectoryBvh other_bvh(trajectories[1], kTolerance);
+  timer_build.Stop();
+
+  std::vector<Eigen::VectorXd> positions;
+  std::vector<Eigen::VectorXd> other_positions;
+  std::vector<double> times;
+  trajectory.evaluateRange(0.0, trajectory.getMaxTime(), kDt,
+                           derivative_order::POSITION, &positions, &times);
+  trajectories[1].evaluateRange(0.0, trajectories[1].getMaxTime(), kDt,
+                                derivative_order::POSITION,
+                                &other_positions);
+  for (const Eigen::VectorXd& position : positions) {
+    EXPECT_TRUE(bvh.getBoundingBox().contains(position));
+  }
+
+  // Closest point to a query, against dense sampling.
+  const Eigen::Vector3d point(1.0, -2.0, 3.0);
+  double sampled_distance = std::numeric_limits<double>::max();
+  for (const Eigen::VectorXd& position : positions) {
+    sampled_distance = std::min(sampled_distance, (position - point).norm());
+  }
+  timing::Timer timer_distance("bvh_distance_50s");
+  double t_closest = 0.0;
+  const double distance = bvh.getDistance(point, &t_closest);
+  timer_distance.Stop();
+  EXPECT_NEAR(sampled_distance, distance, 2.0 * kTolerance);
+  EXPECT_NEAR(distance, (trajectory.evaluate(t_closest) - point).norm(),
+              1.0e-9);
+
+  // Boxes and spheres around a sampled position are hit, no later than its
+  // time. Those beyond the closest distance are not.
+  const size_t sample = positions.size() / 3;
+  const Eigen::Vector3d position = positions[sample];
+  const Eigen::Vector3d extent = Eigen::Vector3d::Constant(0.1);
+  double t_first = 0.0;
+  EXPECT_TRUE(bvh.intersectsBox(
+      Eigen::AlignedBox3d(position - extent, position + extent), &t_first));
+  EXPECT_LE(t_first, times[sample]);
+  EXPECT_TRUE(bvh.intersectsSphere(position, 0.1, &t_first));
+  EXPECT_LE(t_first, times[sample]);
+  EXPECT_FALSE(bvh.intersectsSphere(point, distance - 2.0 * kTolerance));
+  const Eigen::Vector3d corner = point + Eigen::Vector3d::Constant(
+                                             0.5 * (distance - kTolerance));
+  EXPECT_FALSE(bvh.intersectsBox(Eigen::AlignedBox3d(point, corner)));
+  const Eigen::Vector3d far_point(100.0, 100.0, 100.0);
+  EXPECT_FALSE(bvh.intersectsBox(
+      Eigen::AlignedBox3d(far_point - extent, far_point + extent)));
+
+  // Closest approach at equal times.
+  double sampled_approach = std::numeric_limits<double>::max();
+  for (size_t i = 0; i < std::min(positions.size(), other_positions.size());
+       ++i) {
+    sampled_approach = std::min(sampled_approach,
+                                (positions[i] - other_positions[i]).norm());
+  }
+  timing::Timer timer_approach("bvh_approach_50s");
+  const double approach = bvh.getClosestApproach(other_bvh, &t_closest);
+  timer_approach.Stop();
+  EXPECT_NEAR(sampled_approach, approach, 2.0 * kTolerance);
+  EXPECT_NEAR(approach,
+              (trajectory.evaluate(t_closest) -
+               trajectories[1].evaluate(t_closest))
+                  .norm(),
+              1.0e-9);
+}
+
+TEST(MavTrajectoryGeneration, ArcLengthTable) {
+  const int kDim = 3;
+  const int kNumSegments = 20;
+  const double kDt = 1.0e-4;
+  Eigen::VectorXd min_pos = Eigen::VectorXd::Constant(kDim, -10.0);
+  Eigen::VectorXd max_pos = -min_pos;
+  Vertex::Vector vertices = createRandomVertices(max_derivative, kNumSegments,
+                                                 min_pos, max_pos, 9753);
+  std::vector<double> segment_times = estimateSegmentTimes(vertices, 3.0, 5.0);
+  PolynomialOptimization<N> opt(kDim);
+  opt.setupFromVertices(vertices, segment_times, derivative_to_optimize);
+  EXPECT_TRUE(opt.solveLinear());
+  Trajectory trajectory;
+  opt.getTrajectory(&trajectory);
+
+  timing::Timer timer_build("arc_length_build_20s");
+  std::shared_ptr<const ArcLengthTable> table =
+      trajectory.getArcLengthTable();
+  timer_build.Stop();
+  EXPECT_EQ(table, trajectory.getArcLengthTable());
+  const Trajectory copy = trajectory;
+  EXPECT_EQ(table, copy.getArcLengthTable());
+  EXPECT_NEAR(trajectory.getMaxTime(), table->getMaxTime(), 1.0e-9);
+
+  // Against the chord lengths of dense samples.
+  std::vector<Eigen::VectorXd> positions;
+  std::vector<double> times;
+  trajectory.evaluateRange(0.0, trajectory.getMaxTime(), kDt,
+                           derivative_order::POSITION, &positions, &times);
+  double sampled_length = 0.0;
+  for (size_t i = 1; i < positions.size(); ++i) {
+    sampled_length += (positions[i] - positions[i - 1]).norm();
+    if (i % 10000 == 0) {
+      EXPECT_NEAR(sampled_length, table->getArcLength(times[i]), 1.0e-3);
+    }
+  }
+  EXPECT_NEAR(sampled_length, table->getLength(), 1.0e-3);
+
+  // Inverse lookup.
+  for (double s = 0.0; s <= table->getLength(); s += 0.77) {
+    EXPECT_NEAR(s, table->getArcLength(table->getTimeAtArcLength(s)), 1.0e-8);
+  }
+  EXPECT_DOUBLE_EQ(0.0, table->getTimeAtArcLength(-1.0));
+  EXPECT_NEAR(trajectory.getMaxTime(),
+              table->getTimeAtArcLength(table->getLength() + 1.0), 1.0e-9);
+
+  // Equal spacing along the path.
+  const double kDs = 0.5;
+  std::vector<double> sample_times;
+  timing::Timer timer_sample("arc_length_sample_20s");
+  table->sampleByArcLength(kDs, &sample_times);
+  timer_sample.Stop();
+  EXPECT_EQ(static_cast<size_t>(table->getLength() / kDs) + 1,
+            sample_times.size());
+  for (size_t i = 1; i < sample_times.size(); ++i) {
+    EXPECT_LT(sample_times[i - 1], sample_times[i]);
+    EXPECT_NEAR(kDs, table->getArcLength(sample_times[i]) -
+                         table->getArcLength(sample_times[i - 1]),
+                1.0e-8);
+    EXPECT_LE((trajectory.evaluate(sample_times[i]) -
+               trajectory.evaluate(sample_times[i - 1]))
+                  .norm(),
+              kDs + 1.0e-4);
+  }
+
+  // Modifying the trajectory drops the table.
+  Trajectory appended = trajectory;
+  appended.append(trajectory);
+  EXPECT_NE(table, appended.getArcLengthTable());
+  EXPECT_NEAR(2.0 * table->getLength(),
+              appended.getArcLengthTable()->getLength(), 1.0e-3);
+}
+
+TEST(MavTrajectoryGeneration, TrajectoryStreamSampler) {
+  const int kDim = 4;
+  Eigen::VectorXd min_pos = Eigen::VectorXd::Constant(kDim, -10.0);
+  Eigen::VectorXd max_pos = -min_pos;
+  Vertex::Vector vertices =
+      createRandomVertices(max_derivative, 50, min_pos, max_pos, 1234);
+  std::vector<double> segment_times = estimateSegmentTimes(vertices, 3.0, 5.0);
+  PolynomialOptimization<N> opt(kDim);
+  opt.setupFromVertices(vertices, segment_times, derivative_to_optimize);
+  EXPECT_TRUE(opt.solveLinear());
+  Trajectory trajectory;
+  opt.getTrajectory(&trajectory);
+
+  auto expectStateNear = [](const mav_msgs::EigenTrajectoryPoint& expected,
+                            const mav_msgs::EigenTrajectoryPoint& actual) {
+    EXPECT_EQ(expected.time_from_start_ns, actual.time_from_start_ns);
+    EXPECT_TRUE(EIGEN_MATRIX_NEAR(expected.position_W, actual.position_W,
+                                  1.0e-9));
+    EXPECT_TRUE(EIGEN_MATRIX_NEAR(expected.velocity_W, actual.velocity_W,
+                                  1.0e-9));
+    EXPECT_TRUE(EIGEN_MATRIX_NEAR(expected.acceleration_W,
+                                  actual.acceleration_W, 1.0e-9));
+    EXPECT_TRUE(EIGEN_MATRIX_NEAR(expected.jerk_W, actual.jerk_W, 1.0e-8));
+    EXPECT_TRUE(EIGEN_MATRIX_NEAR(expected.snap_W, actual.snap_W, 1.0e-8));
+    EXPECT_NEAR(expected.getYaw(), actual.getYaw(), 1.0e-9);
+    EXPECT_NEAR(expected.getYawRate(), actual.getYawRate(), 1.0e-9);
+    EXPECT_NEAR(expected.getYawAcc(), actual.getYawAcc(), 1.0e-9);
+  };
+
+  const double kDt = 0.01;
+  TrajectoryStreamSampler sampler;
+  EXPECT_FALSE(sampler.valid());
+  ASSERT_TRUE(sampler.setTrajectory(trajectory));
+  mav_msgs::EigenTrajectoryPoint expected;
+  size_t n_samples = 0;
+  bool sampled = true;
+  while (sampled) {
+    ASSERT_TRUE(sampleTrajectoryAtTime(trajectory, sampler.getTime(),
+                                       &expected));
+    expectStateNear(expected, sampler.getState());
+    n_samples++;
+    sampled = sampler.next(kDt);
+  }
+  EXPECT_EQ(static_cast<size_t>(trajectory.getMaxTime() / kDt) + 1,
+            n_samples);
+  EXPECT_LE(sampler.getTime(), trajectory.getMaxTime());
+  EXPECT_GT(sampler.getTime() + kDt, trajectory.getMaxTime());
+
+  // Jumping back.
+  EXPECT_TRUE(sampler.seek(1.0));
+  ASSERT_TRUE(sampleTrajectoryAtTime(trajectory, 1.0, &expected));
+  expectStateNear(expected, sampler.getState());
+  EXPECT_FALSE(sampler.seek(-1.0));
+  EXPECT_EQ(1.0, sampler.getTime());
+
+  // Look-ahead horizons, which are cut off at the end of the trajectory.
+  const size_t kHorizon = 20;
+  VectorizedTrajectory vectorized_trajectory(trajectory,
+                                             derivative_order::SNAP);
+  Eigen::MatrixXd samples;
+  mav_msgs::EigenTrajectoryPointVector states;
+  for (double start_time :
+       {0.0, 1.0, trajectory.getMaxTime() - 5.5 * kDt,
+        trajectory.getMaxTime()}) {
+    ASSERT_TRUE(sampleTrajectoryHorizon(vectorized_trajectory, start_time,
+                                        kHorizon, kDt, &samples, &states));
+    const size_t n_expected = std::min(
+        kHorizon,
+        static_cast<size_t>((trajectory.getMaxTime() - start_time) / kDt) + 1);
+    ASSERT_EQ(n_expected, states.size()) << "start time " << start_time;
+    for (size_t i = 0; i < states.size(); ++i) {
+      ASSERT_TRUE(sampleTrajectoryAtTime(trajectory, start_time + kDt * i,
+                                         &expected));
+      expectStateNear(expected, states[i]);
+    }
+  }
+  EXPECT_FALSE(sampleTrajectoryHorizon(vectorized_trajectory, -1.0, kHorizon,
+                                       kDt, &samples, &states));
+}
+
+TEST(MavTrajectoryGeneration, BinaryTrajectoryFile) {
+  const int kDim = 3;
+  const int kNumSegments = 200;
+  Eigen::VectorXd min_pos = Eigen::VectorXd::Constant(kDim, -10.0);
+  Eigen::VectorXd max_pos = -min_pos;
+  Vertex::Vector vertices = createRandomVertices(max_derivative, kNumSegments,
+                                                 min_pos, max_pos, 1234);
+  std::vector<double> segment_times = estimateSegmentTimes(vertices, 3.0, 5.0);
+  PolynomialOptimization<N> opt(kDim);
+  opt.setupFromVertices(vertices, segment_times, derivative_to_optimize);
+  EXPECT_TRUE(opt.solveLinear());
+  Trajectory trajectory;
+  opt.getTrajectory(&trajectory);
+
+  const std::string kBinaryFile = "test_trajectory.bin";
+  const std::string kYamlFile = "test_trajectory.yaml";
+  timing::Timer timer_write("binary_write_200s");
+  EXPECT_TRUE(trajectoryToBinaryFile(kBinaryFile, trajectory));
+  timer_write.Stop();
+
+  // Loading is lossless.
+  timing::Timer timer_read("binary_read_200s");
+  Trajectory loaded;
+  EXPECT_TRUE(trajectoryFromBinaryFile(kBinaryFile, &loaded));
+  timer_read.Stop();
+  EXPECT_EQ(trajectory, loaded);
+
+  // The mapped view evaluates like the trajectory.
+  timing::Timer timer_map("binary_map_200s");
+  MappedTrajectory mapped;
+  EXPECT_TRUE(mapped.open(kBinaryFile));
+  timer_map.Stop();
+  EXPECT_EQ(trajectory.N(), mapped.N());
+  EXPECT_EQ(trajectory.D(), mapped.D());
+  EXPECT_EQ(trajectory.K(), mapped.K());
+  EXPECT_NEAR(trajectory.getMaxTime(), mapped.getMaxTime(), 1.0e-9);
+  for (double t = 0.0; t <= trajectory.getMaxTime(); t += 0.37) {
+    for (int derivative = 0; derivative <= max_derivative; derivative++) {
+      const Eigen::VectorXd expected = trajectory.evaluate(t, derivative);
+      EXPECT_TRUE(EIGEN_MATRIX_NEAR(expected, mapped.evaluate(t, derivative),
+                                    1.0e-9 * (1.0 + expected.norm())));
+    }
+  }
+  const Eigen::VectorXd expected_end =
+      trajectory.evaluate(trajectory.getMaxTime());
+  EXPECT_TRUE(EIGEN_MATRIX_NEAR(expected_end,
+                                mapped.evaluate(mapped.getMaxTime()),
+                                1.0e-9 * (1.0 + expected_end.norm())));
+
+  // Round trip through YAML, which stores the times in nanoseconds.
+  EXPECT_TRUE(binaryToYamlFile(kBinaryFile, kYamlFile));
+  EXPECT_TRUE(yamlToBinaryFile(kYamlFile, kBinaryFile));
+  EXPECT_TRUE(mapped.open(kBinaryFile));
+  EXPECT_NEAR(trajectory.getMaxTime(), mapped.getMaxTime(),
+              kNumSegments * 1.0e-9);
+  EXPECT_TRUE(EIGEN_MATRIX_NEAR(trajectory.segments()[10][1].getCoefficients(),
+                                mapped.getCoefficients(10, 1), 1.0e-9));
+
+  // Other files are rejected.
+  EXPECT_FALSE(mapped.open(kYamlFile));
+  EXPECT_FALSE(mapped.isOpen());
+  std::remove(kBinaryFile.c_str());
+  std::remove(kYamlFile.c_str());
+}
+
+// Writes a header followed by n_doubles doubles.
+void writeBinaryTrajectory(const std::string& filename,
+                           const BinaryTrajectoryHeader& header,
+                           size_t n_doubles) {
+  std::ofstream out(filename, std::ios::binary | std::ios::trunc);
+  out.write(reinterpret_cast<const char*>(&header), sizeof(header));
+  const std::vector<double> data(n_doubles, 1.0);
+  out.write(reinterpret_cast<const char*>(data.data()),
+            n_doubles * sizeof(double));
+}
+
+TEST(MavTrajectoryGeneration, BinaryTrajectoryMalformedHeader) {
+  const std::string kBinaryFile = "test_malformed_trajectory.bin";
+  BinaryTrajectoryHeader header;
+  header.magic = BinaryTrajectoryHeader::kMagic;
+  header.version = BinaryTrajectoryHeader::kVersion;
+  header.N = 2;
+  header.D = 1;
+  header.K = 1;
+  header.reserved = 0;
+  MappedTrajectory mapped;
+
+  // Well formed: 1 time and 2 coefficients.
+  writeBinaryTrajectory(kBinaryFile, header, 3);
+  EXPECT_TRUE(mapped.open(kBinaryFile));
+  EXPECT_EQ(1, mapped.D());
+
+  // Truncated data and truncated header.
+  writeBinaryTrajectory(kBinaryFile, header, 2);
+  EXPECT_FALSE(mapped.open(kBinaryFile));
+  EXPECT_FALSE(mapped.isOpen());
+  {
+    std::ofstream out(kBinaryFile, std::ios::binary | std::ios::trunc);
+    out.write(reinterpret_cast<const char*>(&header), sizeof(header) / 2);
+  }
+  EXPECT_FALSE(mapped.open(kBinaryFile));
+
+  // D * N wraps to 0 in 32 bit, which would match a file with only a time.
+  header.D = 0x80000000u;
+  writeBinaryTrajectory(kBinaryFile, header, 1);
+  EXPECT_FALSE(mapped.open(kBinaryFile));
+  header.D = std::numeric_limits<uint32_t>::max();
+  writeBinaryTrajectory(kBinaryFile, header, 1);
+  EXPECT_FALSE(mapped.open(kBinaryFile));
+
+  // K * (1 + D * N) wraps in 64 bit, or K does not fit in an int.
+  header.D = 1;
+  header.K = (std::numeric_limits<uint64_t>::max() / 3) + 1;
+  writeBinaryTrajectory(kBinaryFile, header, 3);
+  EXPECT_FALSE(mapped.open(kBinaryFile));
+  header.K = static_cast<uint64_t>(std::numeric_limits<int>::max()) + 1;
+  writeBinaryTrajectory(kBinaryFile, header, 3);
+  EXPECT_FALSE(mapped.open(kBinaryFile));
+
+  // N beyond the supported polynomial order.
+  header.K = 1;
+  header.N = Polynomial::kMaxN + 1;
+  writeBinaryTrajectory(kBinaryFile, header, 1 + header.N);
+  EXPECT_FALSE(mapped.open(kBinaryFile));
+  EXPECT_FALSE(mapped.isOpen());
+  std::remove(kBinaryFile.c_str());
+}
+
+TEST(MavTrajectoryGeneration, FlatTrajectory) {
+  const int kDim = 3;
+  const int kNumSegments = 100;
+  Eigen::VectorXd min_pos = Eigen::VectorXd::Constant(kDim, -10.0);
+  Eigen::VectorXd max_pos = -min_pos;
+  Vertex::Vector vertices = createRandomVertices(max_derivative, kNumSegments,
+                                                 min_pos, max_pos, 4321);
+  std::vector<double> segment_times = estimateSegmentTimes(vertices, 3.0, 5.0);
+  PolynomialOptimization<N> opt(kDim);
+  opt.setupFromVertices(vertices, segment_times, derivative_to_optimize);
+  EXPECT_TRUE(opt.solveLinear());
+  Trajectory trajectory;
+  opt.getTrajectory(&trajectory);
+
+  timing::Timer timer_flatten("flatten_100s");
+  FlatTrajectory flat(trajectory);
+  timer_flatten.Stop();
+  EXPECT_EQ(trajectory.N(), flat.N());
+  EXPECT_EQ(trajectory.D(), flat.D());
+  EXPECT_EQ(trajectory.K(), flat.K());
+  EXPECT_EQ(static_cast<size_t>(flat.K() * flat.D() * flat.N()),
+            flat.coefficients().size());
+  EXPECT_NEAR(trajectory.getMaxTime(), flat.getMaxTime(), 1.0e-9);
+  EXPECT_TRUE(EIGEN_MATRIX_EQUAL(trajectory.segments()[10][1].getCoefficients(),
+                                 flat.getSegment(10)[1]));
+  for (double t = 0.0; t <= trajectory.getMaxTime(); t += 0.37) {
+    for (int derivative = 0; derivative <= max_derivative; derivative++) {
+      const Eigen::VectorXd expected = trajectory.evaluate(t, derivative);
+      EXPECT_TRUE(EIGEN_MATRIX_NEAR(expected, flat.evaluate(t, derivative),
+                                    1.0e-9 * (1.0 + expected.norm())));
+    }
+  }
+  const Eigen::VectorXd expected_end =
+      trajectory.evaluate(trajectory.getMaxTime());
+  EXPECT_TRUE(EIGEN_MATRIX_NEAR(expected_end, flat.evaluate(flat.getMaxTime()),
+                                1.0e-9 * (1.0 + expected_end.norm())));
+
+  // Copies share nothing with the original.
+  timing::Timer timer_copy("flat_copy_100s");
+  FlatTrajectory copy = flat;
+  timer_copy.Stop();
+  EXPECT_NE(flat.coefficients().data(), copy.coefficients().data());
+  Trajectory restored;
+  EXPECT_TRUE(copy.getTrajectory(&restored));
+  EXPECT_EQ(trajectory, restored);
+
+  // Segments of lower order are padded.
+  Segment::Vector segments = trajectory.segments();
+  segments[1] = Segment(4, kDim);
+  segments[1].setTime(1.0);
+  segments[1][0].setCoefficients(Eigen::Vector4d(1.0, 2.0, 3.0, 4.0));
+  FlatTrajectory padded(segments);
+  EXPECT_EQ(N, padded.N());
+  EXPECT_DOUBLE_EQ(4.0, padded.getSegment(1)[0][3]);
+  EXPECT_DOUBLE_EQ(0.0, padded.getSegment(1)[0][4]);
+  EXPECT_TRUE(EIGEN_MATRIX_NEAR(segments[1].evaluate(0.5, 1),
+                                padded.getSegment(1).evaluate(0.5, 1),
+                                1.0e-12));
+
+  // Loading from a mapped binary file.
+  const std::string kBinaryFile = "test_flat_trajectory.bin";
+  EXPECT_TRUE(trajectoryToBinaryFile(kBinaryFile, trajectory));
+  MappedTrajectory mapped;
+  EXPECT_TRUE(mapped.open(kBinaryFile));
+  FlatTrajectory loaded;
+  EXPECT_TRUE(mapped.getFlatTrajectory(&loaded));
+  mapped.close();
+  std::remove(kBinaryFile.c_str());
+  EXPECT_TRUE(flat.coefficients() == loaded.coefficients());
+  EXPECT_TRUE(flat.times() == loaded.times());
+}
+
+TEST(MavTrajectoryGeneration, FloatTrajectory) {
+  const int kDim = 4;
+  const int kNumSegments = 100;
+  Eigen::VectorXd min_pos = Eigen::VectorXd::Constant(kDim, -10.0);
+  Eigen::VectorXd max_pos = -min_pos;
+  Vertex::Vector vertices = createRandomVertices(max_derivative, kNumSegments,
+                                                 min_pos, max_pos, 2468);
+  std::vector<double> segment_times = estimateSegmentTimes(vertices, 3.0, 5.0);
+  PolynomialOptimization<N> opt(kDim);
+  opt.setupFromVertices(vertices, segment_times, derivative_to_optimize);
+  EXPECT_TRUE(opt.solveLinear());
+  Trajectory trajectory;
+  opt.getTrajectory(&trajectory);
+
+  FloatTrajectory float_trajectory(trajectory);
+  EXPECT_EQ(trajectory.D(), float_trajectory.D());
+  EXPECT_EQ(trajectory.K(), float_trajectory.K());
+  EXPECT_NEAR(trajectory.getMaxTime(), float_trajectory.getMaxTime(), 1.0e-9);
+
+  // The error stays within the bound, which is small enough for commands.
+  const double dt = 0.01;
+  for (int derivative = 0; derivative <= derivative_order::SNAP;
+       derivative++) {
+    std::vector<Eigen::VectorXd> expected;
+    std::vector<double> expected_times;
+    trajectory.evaluateRange(0.0, trajectory.getMaxTime(), dt, derivative,
+                             &expected, &expected_times);
+    std::vector<Eigen::VectorXf> result;
+    std::vector<double> sampling_times;
+    timing::Timer timer("float_evaluate_range");
+    float_trajectory.evaluateRange(0.0, trajectory.getMaxTime(), dt,
+                                   derivative, &result, &sampling_times);
+    timer.Stop();
+    ASSERT_EQ(expected.size(), result.size());
+    EXPECT_TRUE(expected_times == sampling_times);
+
+    double max_error = 0.0;
+    double max_magnitude = 0.0;
+    for (size_t i = 0; i < result.size(); ++i) {
+      max_error = std::max(
+          max_error,
+          (expected[i] - result[i].cast<double>()).lpNorm<Eigen::Infinity>());
+      max_magnitude =
+          std::max(max_magnitude, expected[i].lpNorm<Eigen::Infinity>());
+    }
+    const double bound = float_trajectory.getErrorBound(derivative);
+    EXPECT_LE(max_error, bound) << "derivative " << derivative;
+    EXPECT_LT(bound, 1.0e-5 * (1.0 + max_magnitude))
+        << "derivative " << derivative;
+    EXPECT_GT(max_error, 0.0);
+
+    for (size_t i = 0; i < result.size(); i += 37) {
+      const double t = sampling_times[i];
+      const int segment_idx = trajectory.getSegmentIndex(t);
+      const Eigen::VectorXd exact = trajectory.evaluate(t, derivative);
+      EXPECT_TRUE(EIGEN_MATRIX_NEAR(
+          exact, float_trajectory.evaluate(t, derivative).cast<double>(),
+          float_trajectory.getSegment(segment_idx).getErrorBound(derivative)));
+    }
+  }
+}
+
+TEST(MavTrajectoryGeneration, StreamingSampledStates) {
+  const int kDim = 3;
+  Eigen::VectorXd min_pos = Eigen::VectorXd::Constant(kDim, -10.0);
+  Eigen::VectorXd max_pos = -min_pos;
+  Vertex::Vector vertices =
+      createRandomVertices(max_derivative, 20, min_pos, max_pos, 1234);
+  std::vector<double> segment_times = estimateSegmentTimes(vertices, 3.0, 5.0);
+  PolynomialOptimization<N> opt(kDim);
+  opt.setupFromVertices(vertices, segment_times, derivative_to_optimize);
+  EXPECT_TRUE(opt.solveLinear());
+  Trajectory trajectory;
+  opt.getTrajectory(&trajectory);
+
+  const double kDt = 0.01;
+  const int kMaxDerivative = derivative_order::SNAP;
+  Eigen::MatrixXd expected;
+  std::vector<double> expected_times;
+  EXPECT_TRUE(trajectory.evaluateRangeAllDerivatives(
+      0.0, trajectory.getMaxTime(), kDt, kMaxDerivative, &expected,
+      &expected_times));
+  const int kSampleSize = expected.rows() + 1;
+
+  // Chunks that do not divide the number of samples.
+  std::stringstream binary;
+  EXPECT_TRUE(sampledTrajectoryStatesToStream(trajectory, kDt, kMaxDerivative,
+                                              SampledStatesFormat::kBinary,
+                                              &binary, 37));
+  SampledStatesHeader header;
+  binary.read(reinterpret_cast<char*>(&header), sizeof(header));
+  EXPECT_EQ(SampledStatesHeader::kMagic, header.magic);
+  EXPECT_EQ(kSampleSize, header.sample_size);
+  ASSERT_EQ(expected.cols(), header.n_samples);
+  Eigen::MatrixXd actual(kSampleSize, header.n_samples);
+  binary.read(reinterpret_cast<char*>(actual.data()),
+              actual.size() * sizeof(double));
+  EXPECT_TRUE(binary.good());
+  EXPECT_EQ(std::char_traits<char>::eof(), binary.peek());
+  for (size_t i = 0; i < header.n_samples; i++) {
+    EXPECT_NEAR(expected_times[i], actual(0, i), 1.0e-9);
+  }
+  EXPECT_TRUE(EIGEN_MATRIX_NEAR(
+      expected, actual.bottomRows(expected.rows()), 1.0e-9));
+
+  std::stringstream csv;
+  EXPECT_TRUE(sampledTrajectoryStatesToStream(trajectory, kDt, kMaxDerivative,
+                                              SampledStatesFormat::kCsv, &csv,
+                                              100));
+  std::string line;
+  std::getline(csv, line);
+  EXPECT_EQ(0u, line.find("t,d0_0,d0_1,d0_2,d1_0"));
+  size_t n_lines = 0;
+  while (std::getline(csv, line)) {
+    EXPECT_EQ(kSampleSize - 1, std::count(line.begin(), line.end(), ','));
+    n_lines++;
+  }
+  EXPECT_EQ(expected.cols(), n_lines);
+}
+
 void createTestPolynomials() {
   Vertex::Vector vertices;
   vertices = createRandomVertices1D(max_derivative, 100, -50, 50, 12345);
@@ -866,6 +2607,701 @@ void createTestPolynomials() {
   }
 }
 
+TEST(MavTrajectoryGeneration, MaximaOfMagnitude) {
+  const int kNumSegments = 20;
+  ThreadPool thread_pool(4);
+  for (int dim : {1, 3}) {
+    Eigen::VectorXd min_pos = Eigen::VectorXd::Constant(dim, -10.0);
+    Eigen::VectorXd max_pos = -min_pos;
+    Vertex::Vector vertices = createRandomVertices(
+        max_derivative, kNumSegments, min_pos, max_pos, 12345 + dim);
+    PolynomialOptimization<N> opt(dim);
+    opt.setupFromVertices(vertices, estimateSegmentTimes(vertices, 3.0, 5.0),
+                          derivative_to_optimize);
+    opt.solveLinear();
+
+    std::vector<Extremum> expected;
+    expected.push_back(
+        opt.computeMaximumOfMagnitude<derivative_order::POSITION>(nullptr));
+    expected.push_back(
+        opt.computeMaximumOfMagnitude<derivative_order::VELOCITY>(nullptr));
+    expected.push_back(
+        opt.computeMaximumOfMagnitude<derivative_order::ACCELERATION>(
+            nullptr));
+    expected.push_back(
+        opt.computeMaximumOfMagnitude<derivative_order::JERK>(nullptr));
+    expected.push_back(
+        opt.computeMaximumOfMagnitude<derivative_order::SNAP>(nullptr));
+    const std::vector<int> derivatives = {
+        derivative_order::POSITION, derivative_order::VELOCITY,
+        derivative_order::ACCELERATION, derivative_order::JERK,
+        derivative_order::SNAP};
+
+    for (ThreadPool* pool : {static_cast<ThreadPool*>(nullptr), &thread_pool}) {
+      std::vector<Extremum> maxima;
+      opt.computeMaximaOfMagnitude(derivatives, &maxima, pool);
+      ASSERT_EQ(expected.size(), maxima.size());
+      for (size_t i = 0; i < maxima.size(); ++i) {
+        EXPECT_NEAR(expected[i].value, maxima[i].value,
+                    1.0e-9 * expected[i].value);
+        EXPECT_NEAR(expected[i].time, maxima[i].time, 1.0e-9);
+        EXPECT_EQ(expected[i].segment_idx, maxima[i].segment_idx);
+      }
+    }
+  }
+}
+
+TEST(MavTrajectoryGeneration, ExceedsMagnitude) {
+  const int kDim = 3;
+  const int kNumSegments = 50;
+  Eigen::VectorXd min_pos = Eigen::VectorXd::Constant(kDim, -10.0);
+  Eigen::VectorXd max_pos = -min_pos;
+  Vertex::Vector vertices = createRandomVertices(
+      max_derivative, kNumSegments, min_pos, max_pos, 2468);
+  PolynomialOptimization<N> opt(kDim);
+  opt.setupFromVertices(vertices, estimateSegmentTimes(vertices, 3.0, 5.0),
+                        derivative_to_optimize);
+  opt.solveLinear();
+  Trajectory trajectory;
+  opt.getTrajectory(&trajectory);
+  const std::vector<int> dimensions = {0, 1, 2};
+
+  Extremum minimum, maximum;
+  timing::Timer timer_min_max("trajectory_min_max_magnitude");
+  EXPECT_TRUE(trajectory.computeMinMaxMagnitude(
+      derivative_order::VELOCITY, dimensions, &minimum, &maximum));
+  timer_min_max.Stop();
+
+  ThreadPool thread_pool(4);
+  Extremum parallel_minimum, parallel_maximum;
+  EXPECT_TRUE(trajectory.computeMinMaxMagnitude(
+      derivative_order::VELOCITY, dimensions, &parallel_minimum,
+      &parallel_maximum, &thread_pool));
+  EXPECT_EQ(minimum.value, parallel_minimum.value);
+  EXPECT_EQ(minimum.segment_idx, parallel_minimum.segment_idx);
+  EXPECT_EQ(maximum.value, parallel_maximum.value);
+  EXPECT_EQ(maximum.time, parallel_maximum.time);
+  EXPECT_EQ(maximum.segment_idx, parallel_maximum.segment_idx);
+
+  timing::Timer timer_exceeds("trajectory_exceeds_magnitude");
+  EXPECT_FALSE(trajectory.exceedsMagnitude(derivative_order::VELOCITY,
+                                           dimensions, 1.01 * maximum.value));
+  timer_exceeds.Stop();
+
+  // Stops at the first segment above the limit.
+  const double limit = 0.9 * maximum.value;
+  Extremum violation;
+  EXPECT_TRUE(trajectory.exceedsMagnitude(derivative_order::VELOCITY,
+                                          dimensions, limit, &violation));
+  EXPECT_GT(violation.value, limit);
+  EXPECT_LE(violation.segment_idx, maximum.segment_idx);
+  EXPECT_NEAR(violation.value,
+              trajectory.segments()[violation.segment_idx]
+                  .evaluate(violation.time, derivative_order::VELOCITY)
+                  .norm(),
+              1.0e-9);
+  for (int i = 0; i < violation.segment_idx; ++i) {
+    const Segment& segment = trajectory.segments()[i];
+    for (double t = 0.0; t < segment.getTime(); t += 0.01) {
+      EXPECT_LE(segment.evaluate(t, derivative_order::VELOCITY).norm(),
+                limit + 1.0e-9);
+    }
+  }
+
+  // Segments that cannot be checked are reported, even below the limit.
+  for (const std::vector<int>& invalid_dimensions :
+       {std::vector<int>{0, 1, kDim}, std::vector<int>{-1},
+        std::vector<int>()}) {
+    Extremum unchecked;
+    EXPECT_TRUE(trajectory.exceedsMagnitude(derivative_order::VELOCITY,
+                                            invalid_dimensions,
+                                            1.01 * maximum.value, &unchecked));
+    EXPECT_EQ(std::numeric_limits<double>::infinity(), unchecked.value);
+  }
+}
+
+TEST(MavTrajectoryGeneration, NonlinearDeadline) {
+  const int kDim = 3;
+  const int kNumSegments = 5;
+  Eigen::VectorXd min_pos = Eigen::VectorXd::Constant(kDim, -10.0);
+  Eigen::VectorXd max_pos = -min_pos;
+  Vertex::Vector vertices = createRandomVertices(max_derivative, kNumSegments,
+                                                 min_pos, max_pos, 4321);
+  const std::vector<double> segment_times =
+      estimateSegmentTimes(vertices, 3.0, 5.0);
+
+  // The initial guess meets the velocity constraint.
+  PolynomialOptimization<N> linear_opt(kDim);
+  linear_opt.setupFromVertices(vertices, segment_times,
+                               derivative_to_optimize);
+  linear_opt.solveLinear();
+  const double v_max =
+      linear_opt.computeMaximumOfMagnitude<derivative_order::VELOCITY>(nullptr)
+          .value;
+
+  NonlinearOptimizationParameters parameters;
+  parameters.max_time = 1.0e-9;
+  PolynomialOptimizationNonLinear<N> opt(kDim, parameters, true);
+  opt.setupFromVertices(vertices, segment_times, derivative_to_optimize);
+  opt.addMaximumMagnitudeConstraint(derivative_order::VELOCITY, v_max);
+  EXPECT_EQ(nlopt::MAXTIME_REACHED, opt.optimize());
+
+  OptimizationInfo info = opt.getOptimizationInfo();
+  EXPECT_TRUE(info.deadline_reached);
+  EXPECT_FALSE(info.cancelled);
+  EXPECT_EQ(nlopt::MAXTIME_REACHED, info.stopping_reason);
+  EXPECT_GE(info.n_iterations, 1);
+  EXPECT_LE(opt.getPolynomialOptimizationRef()
+                .computeMaximumOfMagnitude<derivative_order::VELOCITY>(nullptr)
+                .value,
+            v_max + parameters.inequality_constraint_tolerance);
+
+  // Cancelled before the start, stops after the first evaluation.
+  std::atomic<bool> cancel(true);
+  parameters.max_time = -1.0;
+  PolynomialOptimizationNonLinear<N> opt_cancel(kDim, parameters, true);
+  opt_cancel.setupFromVertices(vertices, segment_times,
+                               derivative_to_optimize);
+  opt_cancel.addMaximumMagnitudeConstraint(derivative_order::VELOCITY, v_max);
+  opt_cancel.setCancellationToken(&cancel);
+  EXPECT_EQ(nlopt::FORCED_STOP, opt_cancel.optimize());
+  info = opt_cancel.getOptimizationInfo();
+  EXPECT_TRUE(info.cancelled);
+  EXPECT_FALSE(info.deadline_reached);
+  EXPECT_EQ(1, info.n_iterations);
+
+  Trajectory trajectory;
+  opt_cancel.getTrajectory(&trajectory);
+  EXPECT_EQ(static_cast<size_t>(kNumSegments), trajectory.K());
+
+  cancel = false;
+  EXPECT_NE(nlopt::FORCED_STOP, opt_cancel.optimize());
+  EXPECT_FALSE(opt_cancel.getOptimizationInfo().cancelled);
+}
+
+TEST(MavTrajectoryGeneration, OptimizationTrace) {
+  // Ring buffer keeps the latest entries.
+  OptimizationTrace trace;
+  EXPECT_FALSE(trace.enabled());
+  trace.reset(3, 2);
+  for (int i = 0; i < 5; ++i) {
+    OptimizationTraceEntry entry;
+    entry.iteration = i;
+    trace.add(entry, std::vector<double>(2, static_cast<double>(i)));
+  }
+  ASSERT_EQ(3u, trace.size());
+  EXPECT_EQ(2u, trace.getNumDropped());
+  for (size_t i = 0; i < trace.size(); ++i) {
+    EXPECT_EQ(static_cast<int>(i) + 2, trace.getEntry(i).iteration);
+    EXPECT_EQ(i + 2.0, trace.getSegmentTimes(i)[1]);
+  }
+
+  // Trace of a nonlinear optimization.
+  const int kDim = 3;
+  const int kNumSegments = 5;
+  Eigen::VectorXd min_pos = Eigen::VectorXd::Constant(kDim, -10.0);
+  Eigen::VectorXd max_pos = -min_pos;
+  Vertex::Vector vertices = createRandomVertices(max_derivative, kNumSegments,
+                                                 min_pos, max_pos, 1234);
+  const std::vector<double> segment_times =
+      estimateSegmentTimes(vertices, 3.0, 5.0);
+  NonlinearOptimizationParameters parameters;
+  parameters.trace_capacity = 16;
+  PolynomialOptimizationNonLinear<N> opt(kDim, parameters, true);
+  opt.setupFromVertices(vertices, segment_times, derivative_to_optimize);
+  opt.addMaximumMagnitudeConstraint(derivative_order::VELOCITY, 3.0);
+  opt.optimize();
+
+  const OptimizationInfo info = opt.getOptimizationInfo();
+  const OptimizationTrace& optimization_trace = opt.getOptimizationTrace();
+  EXPECT_EQ(std::min<size_t>(parameters.trace_capacity, info.n_iterations),
+            optimization_trace.size());
+  ASSERT_GT(optimization_trace.size(), 0u);
+  EXPECT_EQ(static_cast<size_t>(kNumSegments),
+            optimization_trace.getNumSegments());
+  for (size_t i = 0; i < optimization_trace.size(); ++i) {
+    const OptimizationTraceEntry& entry = optimization_trace.getEntry(i);
+    EXPECT_EQ(info.n_iterations - static_cast<int>(optimization_trace.size()) +
+                  static_cast<int>(i) + 1,
+              entry.iteration);
+    EXPECT_GT(entry.cost_trajectory, 0.0);
+    EXPECT_GT(entry.n_root_finding_calls, 0u);
+    EXPECT_GE(entry.time_linear_solve, 0.0);
+  }
+
+  std::stringstream csv;
+  optimization_trace.writeCsv(&csv);
+  std::string line;
+  size_t n_lines = 0;
+  while (std::getline(csv, line)) {
+    n_lines++;
+  }
+  EXPECT_EQ(optimization_trace.size() + 1, n_lines);
+}
+
+TEST(MavTrajectoryGeneration, DecoupledYaw) {
+  const int kDim = 4;
+  const int kNumSegments = 20;
+  const int kNYaw = 6;
+  Eigen::VectorXd min_pos = Eigen::VectorXd::Constant(kDim, -10.0);
+  Eigen::VectorXd max_pos = -min_pos;
+  Vertex::Vector vertices = createRandomVertices(max_derivative, kNumSegments,
+                                                 min_pos, max_pos, 1357);
+  const std::vector<double> segment_times =
+      estimateSegmentTimes(vertices, 3.0, 5.0);
+  Vertex::Vector position_vertices, yaw_vertices;
+  for (const Vertex& vertex : vertices) {
+    position_vertices.push_back(vertex.getVertexWithDimensions(0, kDim - 1));
+    yaw_vertices.push_back(vertex.getVertexWithDimensions(kDim - 1, 1));
+  }
+  EXPECT_EQ(kDim - 1, position_vertices.front().D());
+
+  // At fixed times, both problems are solved as if they were separate.
+  ThreadPool thread_pool(2);
+  NonlinearOptimizationParameters parameters;
+  PolynomialOptimizationDecoupledYaw<N, kNYaw> opt(kDim, parameters, true);
+  EXPECT_TRUE(opt.setupFromVertices(vertices, segment_times,
+                                    derivative_to_optimize,
+                                    derivative_order::ACCELERATION));
+  EXPECT_TRUE(opt.solveLinear(&thread_pool));
+  PolynomialOptimization<N> position_opt(kDim - 1);
+  position_opt.setupFromVertices(position_vertices, segment_times,
+                                 derivative_to_optimize);
+  EXPECT_TRUE(position_opt.solveLinear());
+  PolynomialOptimization<kNYaw> yaw_opt(1);
+  yaw_opt.setupFromVertices(yaw_vertices, segment_times,
+                            derivative_order::ACCELERATION);
+  EXPECT_TRUE(yaw_opt.solveLinear());
+
+  Trajectory trajectory, position_trajectory, yaw_trajectory;
+  EXPECT_TRUE(opt.getTrajectory(&trajectory));
+  position_opt.getTrajectory(&position_trajectory);
+  yaw_opt.getTrajectory(&yaw_trajectory);
+  EXPECT_EQ(kDim, trajectory.D());
+  EXPECT_EQ(N, trajectory.N());
+  EXPECT_EQ(kNumSegments, trajectory.K());
+  for (double t = 0.0; t < trajectory.getMaxTime(); t += 0.1) {
+    for (int derivative = 0; derivative <= derivative_order::SNAP;
+         ++derivative) {
+      const Eigen::VectorXd result = trajectory.evaluate(t, derivative);
+      EXPECT_TRUE(EIGEN_MATRIX_NEAR(
+          position_trajectory.evaluate(t, derivative), result.head(kDim - 1),
+          1.0e-9));
+      EXPECT_NEAR(yaw_trajectory.evaluate(t, derivative)[0],
+                  result[kDim - 1], 1.0e-9);
+    }
+  }
+
+  // The segment times are optimized for the sum of both costs.
+  timing::Timer timer_decoupled("decoupled_yaw_optimize");
+  opt.optimize(&thread_pool);
+  timer_decoupled.Stop();
+  std::vector<double> optimized_times;
+  opt.getPositionOptimizationRef().getPolynomialOptimizationRef()
+      .getSegmentTimes(&optimized_times);
+  const OptimizationInfo info =
+      opt.getPositionOptimizationRef().getOptimizationInfo();
+  EXPECT_NEAR(opt.getPositionOptimizationRef()
+                      .getPolynomialOptimizationRef()
+                      .computeCost() +
+                  opt.getYawOptimizationRef().computeCost(),
+              info.cost_trajectory, 1.0e-9 * info.cost_trajectory);
+  std::vector<double> yaw_times;
+  opt.getYawOptimizationRef().getSegmentTimes(&yaw_times);
+  EXPECT_TRUE(optimized_times == yaw_times);
+  EXPECT_TRUE(opt.getTrajectory(&trajectory));
+  EXPECT_NEAR(
+      std::accumulate(optimized_times.begin(), optimized_times.end(), 0.0),
+      trajectory.getMaxTime(), 1.0e-9);
+
+  // Same result without the thread pool.
+  PolynomialOptimizationDecoupledYaw<N, kNYaw> opt_serial(kDim, parameters,
+                                                          true);
+  opt_serial.setupFromVertices(vertices, segment_times,
+                               derivative_to_optimize,
+                               derivative_order::ACCELERATION);
+  opt_serial.optimize();
+  Trajectory trajectory_serial;
+  EXPECT_TRUE(opt_serial.getTrajectory(&trajectory_serial));
+  EXPECT_EQ(trajectory, trajectory_serial);
+
+  // Comparison to optimizing all dimensions with N coefficients.
+  PolynomialOptimizationNonLinear<N> opt_coupled(kDim, parameters, true);
+  opt_coupled.setupFromVertices(vertices, segment_times,
+                                derivative_to_optimize);
+  timing::Timer timer_coupled("coupled_yaw_optimize");
+  opt_coupled.optimize();
+  timer_coupled.Stop();
+}
+
+TEST(MavTrajectoryGeneration, TrajectoryCompression) {
+  const int kDim = 4;
+  const int kNumSegments = 100;
+  Eigen::VectorXd min_pos = Eigen::VectorXd::Constant(kDim, -10.0);
+  Eigen::VectorXd max_pos = -min_pos;
+  Vertex::Vector vertices = createRandomVertices(max_derivative, kNumSegments,
+                                                 min_pos, max_pos, 1357);
+  std::vector<double> segment_times = estimateSegmentTimes(vertices, 3.0, 5.0);
+  PolynomialOptimization<N> opt(kDim);
+  opt.setupFromVertices(vertices, segment_times, derivative_to_optimize);
+  EXPECT_TRUE(opt.solveLinear());
+  Trajectory trajectory;
+  opt.getTrajectory(&trajectory);
+
+  CompressionParameters parameters;
+  parameters.tolerance = 0.01;
+  std::vector<uint8_t> data;
+  CompressionReport report;
+  timing::Timer timer("compress_trajectory");
+  EXPECT_TRUE(compressTrajectory(trajectory, parameters, &data, &report));
+  timer.Stop();
+  EXPECT_EQ(kNumSegments, report.num_segments_in);
+  EXPECT_LT(report.num_segments_out, report.num_segments_in);
+  EXPECT_EQ(data.size(), report.compressed_bytes);
+  EXPECT_GT(report.getCompressionRatio(), 5.0);
+  ASSERT_EQ(parameters.continuity_derivative + 1, report.max_error.size());
+  EXPECT_LE(report.max_error[derivative_order::POSITION], parameters.tolerance);
+  std::cout << "Compressed " << report.uncompressed_bytes << " to "
+            << report.compressed_bytes << " bytes, " << report.num_segments_in
+            << " to " << report.num_segments_out
+            << " segments, max. position error "
+            << report.max_error[derivative_order::POSITION] << std::endl;
+
+  Trajectory decoded;
+  ASSERT_TRUE(decompressTrajectory(data, &decoded));
+  EXPECT_EQ(report.num_segments_out, decoded.K());
+  EXPECT_NEAR(trajectory.getMaxTime(), decoded.getMaxTime(), 1.0e-6);
+  const double t_max = std::min(trajectory.getMaxTime(), decoded.getMaxTime());
+  for (double t = 0.0; t < t_max; t += 0.01) {
+    EXPECT_TRUE(EIGEN_MATRIX_NEAR(trajectory.evaluate(t), decoded.evaluate(t),
+                                  parameters.tolerance));
+  }
+  // The quantized boundary derivatives are shared by adjacent segments.
+  for (int i = 1; i < decoded.K(); ++i) {
+    const Segment& previous = decoded.segments()[i - 1];
+    for (int derivative = 0;
+         derivative <= parameters.continuity_derivative; ++derivative) {
+      EXPECT_TRUE(EIGEN_MATRIX_NEAR(
+          previous.evaluate(previous.getTime(), derivative),
+          decoded.segments()[i].evaluate(0.0, derivative), 1.0e-6));
+    }
+  }
+
+  // A tighter tolerance needs more bytes.
+  parameters.tolerance = 0.001;
+  std::vector<uint8_t> data_fine;
+  EXPECT_TRUE(compressTrajectory(trajectory, parameters, &data_fine));
+  EXPECT_GT(data_fine.size(), data.size());
+
+  // Truncated data is rejected.
+  data.pop_back();
+  EXPECT_FALSE(decompressTrajectory(data, &decoded));
+}
+
+TEST(MavTrajectoryGeneration, TrajectoryTable) {
+  const int kDim = 4;
+  const int kNumSegments = 100;
+  Eigen::VectorXd min_pos = Eigen::VectorXd::Constant(kDim, -10.0);
+  Eigen::VectorXd max_pos = -min_pos;
+  Vertex::Vector vertices = createRandomVertices(max_derivative, kNumSegments,
+                                                 min_pos, max_pos, 8642);
+  std::vector<double> segment_times = estimateSegmentTimes(vertices, 3.0, 5.0);
+  PolynomialOptimization<N> opt(kDim);
+  opt.setupFromVertices(vertices, segment_times, derivative_to_optimize);
+  EXPECT_TRUE(opt.solveLinear());
+  Trajectory trajectory;
+  opt.getTrajectory(&trajectory);
+
+  const double kDt = 0.01;
+  TrajectoryTable table;
+  EXPECT_FALSE(table.bake(trajectory, 0.0));
+  timing::Timer timer_bake("trajectory_table_bake");
+  ASSERT_TRUE(table.bake(trajectory, kDt));
+  timer_bake.Stop();
+  EXPECT_EQ(kDim, table.D());
+  EXPECT_EQ(derivative_order::SNAP, table.getMaxDerivative());
+  EXPECT_DOUBLE_EQ(trajectory.getMaxTime(), table.getMaxTime());
+  EXPECT_GE((table.getNumSamples() - 1) * kDt, trajectory.getMaxTime());
+
+  // The error stays within the bound, also across segment boundaries.
+  const std::string kTableFile = "test_trajectory_table.bin";
+  EXPECT_TRUE(table.toFile(kTableFile));
+  TrajectoryTable mapped_table;
+  ASSERT_TRUE(mapped_table.open(kTableFile));
+  EXPECT_EQ(table.getSizeBytes(), mapped_table.getSizeBytes());
+  for (int derivative = 0; derivative <= derivative_order::SNAP;
+       ++derivative) {
+    const double bound = table.getErrorBound(derivative);
+    EXPECT_DOUBLE_EQ(bound, mapped_table.getErrorBound(derivative));
+    double max_error = 0.0;
+    double max_magnitude = 0.0;
+    std::vector<float> result(kDim);
+    for (double t = 0.0; t <= trajectory.getMaxTime(); t += 0.00137) {
+      const Eigen::VectorXd exact = trajectory.evaluate(t, derivative);
+      table.evaluate(t, derivative, result.data());
+      const Eigen::VectorXf mapped = mapped_table.evaluate(t, derivative);
+      for (int d = 0; d < kDim; ++d) {
+        max_error = std::max(max_error, std::abs(exact[d] - result[d]));
+        EXPECT_EQ(result[d], mapped[d]);
+      }
+      max_magnitude = std::max(max_magnitude, exact.cwiseAbs().maxCoeff());
+    }
+    EXPECT_LE(max_error, bound) << "derivative " << derivative;
+    // The slope of the snap, the crackle, jumps at the segment boundaries.
+    const double relative_bound =
+        derivative < derivative_order::SNAP ? 1.0e-4 : 1.0e-2;
+    EXPECT_LT(bound, relative_bound * (1.0 + max_magnitude))
+        << "derivative " << derivative;
+  }
+  EXPECT_TRUE(EIGEN_MATRIX_NEAR(
+      trajectory.evaluate(trajectory.getMaxTime()).cast<float>(),
+      table.evaluate(trajectory.getMaxTime() + 1.0),
+      table.getErrorBound(derivative_order::POSITION)));
+
+  Eigen::VectorXf result(kDim);
+  const int kNumQueries = 100000;
+  timing::Timer timer_query("trajectory_table_query");
+  for (int i = 0; i < kNumQueries; ++i) {
+    table.evaluate(i * trajectory.getMaxTime() / kNumQueries,
+                   derivative_order::POSITION, result.data());
+  }
+  timer_query.Stop();
+
+  mapped_table.close();
+  EXPECT_TRUE(mapped_table.empty());
+  std::remove(kTableFile.c_str());
+  EXPECT_FALSE(mapped_table.open(kTableFile));
+}
+
+// Writes a header followed by n_floats samples.
+void writeTrajectoryTable(const std::string& filename,
+                          const TrajectoryTableHeader& header,
+                          size_t n_floats) {
+  std::ofstream out(filename, std::ios::binary | std::ios::trunc);
+  out.write(reinterpret_cast<const char*>(&header), sizeof(header));
+  const std::vector<float> samples(n_floats, 1.0f);
+  out.write(reinterpret_cast<const char*>(samples.data()),
+            n_floats * sizeof(float));
+}
+
+TEST(MavTrajectoryGeneration, TrajectoryTableMalformedHeader) {
+  const std::string kTableFile = "test_malformed_table.bin";
+  TrajectoryTableHeader header = TrajectoryTableHeader();
+  header.magic = TrajectoryTableHeader::kMagic;
+  header.version = TrajectoryTableHeader::kVersion;
+  header.D = 3;
+  header.max_derivative = derivative_order::SNAP;
+  header.num_samples = 11;
+  header.dt = 0.1;
+  header.max_time = 1.0;
+  const size_t stride = (header.max_derivative + 2) * header.D;
+  TrajectoryTable table;
+
+  // Well formed.
+  writeTrajectoryTable(kTableFile, header, header.num_samples * stride);
+  EXPECT_TRUE(table.open(kTableFile));
+  EXPECT_EQ(3, table.D());
+
+  // Truncated samples and truncated header.
+  writeTrajectoryTable(kTableFile, header, header.num_samples * stride - 1);
+  EXPECT_FALSE(table.open(kTableFile));
+  EXPECT_TRUE(table.empty());
+  {
+    std::ofstream out(kTableFile, std::ios::binary | std::ios::trunc);
+    out.write(reinterpret_cast<const char*>(&header), sizeof(header) / 2);
+  }
+  EXPECT_FALSE(table.open(kTableFile));
+
+  // The stride (max_derivative + 2) * D wraps to 0 in 32 bit.
+  header.D = 0x80000000u;
+  writeTrajectoryTable(kTableFile, header, 0);
+  EXPECT_FALSE(table.open(kTableFile));
+  header.D = TrajectoryTableHeader::kMaxD + 1;
+  writeTrajectoryTable(kTableFile, header,
+                       header.num_samples * (header.max_derivative + 2) *
+                           header.D);
+  EXPECT_FALSE(table.open(kTableFile));
+
+  // num_samples * stride wraps in 64 bit.
+  header.D = 3;
+  header.num_samples = std::numeric_limits<uint64_t>::max() / stride + 2;
+  writeTrajectoryTable(kTableFile, header, 11 * stride);
+  EXPECT_FALSE(table.open(kTableFile));
+
+  // max_time beyond the last sample, or before the second to last one.
+  header.num_samples = 11;
+  header.max_time = 1.5;
+  writeTrajectoryTable(kTableFile, header, header.num_samples * stride);
+  EXPECT_FALSE(table.open(kTableFile));
+  header.max_time = 0.5;
+  writeTrajectoryTable(kTableFile, header, header.num_samples * stride);
+  EXPECT_FALSE(table.open(kTableFile));
+  header.max_time = std::numeric_limits<double>::quiet_NaN();
+  writeTrajectoryTable(kTableFile, header, header.num_samples * stride);
+  EXPECT_FALSE(table.open(kTableFile));
+  EXPECT_TRUE(table.empty());
+  std::remove(kTableFile.c_str());
+}
+
+TEST(MavTrajectoryGeneration, TimingThreads) {
+  const std::string kTag = "test_timing_threads";
+  const int kNumThreads = 4;
+  const int kNumSamples = 100;
+  auto addSamples = [&kTag, kNumSamples]() {
+    for (int i = 0; i < kNumSamples; ++i) {
+      timing::Timer timer(kTag);
+    }
+  };
+  // Times of running and exited threads are both merged.
+  addSamples();
+  std::vector<std::thread> threads;
+  for (int i = 0; i < kNumThreads; ++i) {
+    threads.emplace_back(addSamples);
+  }
+  for (std::thread& thread : threads) {
+    thread.join();
+  }
+  EXPECT_EQ(static_cast<size_t>((kNumThreads + 1) * kNumSamples),
+            timing::Timing::GetNumSamples(kTag));
+  EXPECT_GE(timing::Timing::GetMinSeconds(kTag), 0.0);
+  EXPECT_LE(timing::Timing::GetMinSeconds(kTag),
+            timing::Timing::GetMaxSeconds(kTag));
+  EXPECT_NEAR(timing::Timing::GetTotalSeconds(kTag),
+              timing::Timing::GetMeanSeconds(kTag) * (kNumThreads + 1) *
+                  kNumSamples,
+              1.0e-9);
+}
+
+TEST(MavTrajectoryGeneration, TimingAccumulatorMerge) {
+  // The window of 4 wraps around, it holds 5, 6, 3, 4 with 3 the oldest.
+  timing::Accumulator<double, double, 4> wrapped;
+  for (int i = 1; i <= 6; ++i) {
+    wrapped.Add(i);
+  }
+  EXPECT_DOUBLE_EQ(4.5, wrapped.RollingMean());
+
+  timing::Accumulator<double, double, 4> merged;
+  merged.Add(0.0);
+  merged.Merge(wrapped);
+  EXPECT_EQ(7, merged.TotalSamples());
+  EXPECT_DOUBLE_EQ(21.0, merged.Sum());
+  EXPECT_DOUBLE_EQ(0.0, merged.Min());
+  EXPECT_DOUBLE_EQ(6.0, merged.Max());
+  EXPECT_DOUBLE_EQ(4.5, merged.RollingMean());
+  // Merged in time order, the next sample replaces the oldest one, 3.
+  merged.Add(7.0);
+  EXPECT_DOUBLE_EQ(5.5, merged.RollingMean());
+}
+
+TEST(MavTrajectoryGeneration, AllocationTracking) {
+  memory_tracking::AllocationScope outer;
+  {
+    memory_tracking::AllocationScope inner;
+    Eigen::VectorXd block(1000);
+    block.setZero();
+    inner.stop();
+    if (memory_tracking::isEnabled()) {
+      EXPECT_EQ(1u, inner.getNumAllocations());
+      EXPECT_GE(inner.getPeakBytes(), 1000 * sizeof(double));
+    } else {
+      EXPECT_EQ(0u, inner.getNumAllocations());
+      EXPECT_EQ(0u, inner.getPeakBytes());
+    }
+  }
+
+  // The array and aligned variants of malloc are replaced as well, see
+  // memory_tracking.h for what is not counted.
+  {
+    memory_tracking::AllocationScope scope;
+    void* volatile array = reallocarray(nullptr, 16, sizeof(double));
+    void* volatile aligned = aligned_alloc(64, 128);
+    void* volatile memaligned = memalign(64, 128);
+    void* posix_aligned = nullptr;
+    EXPECT_EQ(0, posix_memalign(&posix_aligned, 64, 128));
+    scope.stop();
+    EXPECT_EQ(memory_tracking::isEnabled() ? 4u : 0u,
+              scope.getNumAllocations());
+    free(array);
+    free(aligned);
+    free(memaligned);
+    free(posix_aligned);
+  }
+
+  // The phases of the linear optimization are reported by the timers.
+  const int kN = 10;
+  const int kDim = 3;
+  const Eigen::Vector3d pos_min(-10.0, -10.0, -10.0);
+  const Eigen::Vector3d pos_max(10.0, 10.0, 10.0);
+  const Vertex::Vector vertices = createRandomVertices(
+      derivative_order::SNAP, 100, pos_min, pos_max, 12345);
+  const std::vector<double> segment_times =
+      estimateSegmentTimes(vertices, 2.0, 2.0);
+  const std::string kTag = "test_allocation_phase";
+  {
+    timing::Timer timer(kTag);
+    PolynomialOptimization<kN> opt(kDim);
+    opt.setupFromVertices(vertices, segment_times, derivative_order::SNAP);
+    EXPECT_TRUE(opt.solveLinear());
+  }
+  outer.stop();
+
+  const memory_tracking::AllocationStatistics statistics =
+      memory_tracking::getAllocationStatistics();
+  if (memory_tracking::isEnabled()) {
+    EXPECT_GT(timing::Timing::GetNumAllocations(kTag), 0u);
+    EXPECT_GT(timing::Timing::GetPeakBytes(kTag), 0u);
+    // The outer scope includes the block and the optimization.
+    EXPECT_GT(outer.getNumAllocations(),
+              timing::Timing::GetNumAllocations(kTag));
+    EXPECT_GE(outer.getPeakBytes(), timing::Timing::GetPeakBytes(kTag));
+    EXPECT_GE(statistics.peak_bytes, statistics.current_bytes);
+    EXPECT_GE(statistics.allocated_bytes, statistics.current_bytes);
+    std::cout << "Linear optimization of 100 segments: "
+              << timing::Timing::GetNumAllocations(kTag) << " allocations, "
+              << timing::Timing::GetPeakBytes(kTag) << " peak bytes."
+              << std::endl;
+  } else {
+    EXPECT_EQ(0u, timing::Timing::GetNumAllocations(kTag));
+    EXPECT_EQ(0u, outer.getNumAllocations());
+    EXPECT_EQ(0u, statistics.num_allocations);
+  }
+}
+
+TEST(MavTrajectoryGeneration, SteadyStateSolveAllocations) {
+  const int kN = 10;
+  const int kDim = 3;
+  const Eigen::Vector3d pos_min(-10.0, -10.0, -10.0);
+  const Eigen::Vector3d pos_max(10.0, 10.0, 10.0);
+  const Vertex::Vector vertices = createRandomVertices(
+      derivative_order::SNAP, 20, pos_min, pos_max, 12345);
+  for (LinearSolverType solver_type :
+       {kLinearSolverDenseLDLT, kLinearSolverBandedLDLT}) {
+    for (bool normalize : {false, true}) {
+      std::vector<double> segment_times =
+          estimateSegmentTimes(vertices, 2.0, 2.0);
+      PolynomialOptimization<kN> opt(kDim);
+      opt.setLinearSolverType(solver_type);
+      opt.setNormalization(normalize);
+      opt.setupFromVertices(vertices, segment_times, derivative_order::SNAP);
+      EXPECT_TRUE(opt.solveLinear());
+
+      // Counts malloc, which Eigen calls directly, if the library is built
+      // with MAV_TRAJECTORY_GENERATION_TRACK_ALLOCATIONS.
+      memory_tracking::AllocationScope scope;
+      for (int i = 0; i < 10; ++i) {
+        for (double& segment_time : segment_times) {
+          segment_time *= 1.01;
+        }
+        opt.updateSegmentTimes(segment_times);
+        EXPECT_TRUE(opt.solveLinear());
+      }
+      scope.stop();
+      EXPECT_EQ(0u, scope.getNumAllocations())
+          << "solver " << solver_type << ", normalization " << normalize;
+    }
+  }
+}
+
 int main(int argc, char** argv) {
   ::testing::InitGoogleTest(&argc, argv);
 
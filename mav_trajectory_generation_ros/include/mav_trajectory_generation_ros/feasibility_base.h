@@ -26,6 +26,7 @@
 #include <Eigen/Core>
 #include <Eigen/StdVector>
 
+#include <mav_trajectory_generation/thread_pool.h>
 #include <mav_trajectory_generation/trajectory.h>
 
 #include "input_constraints.h"
@@ -70,6 +71,21 @@ class HalfPlane {
   Eigen::Vector3d normal;
 };
 
+// A convex polytope {x | normals * x >= offsets}, the intersection of a set of
+// half planes, stored as matrix for checking all planes at once.
+class Polytope {
+ public:
+  typedef std::vector<Polytope> Vector;
+  Polytope() {}
+  Polytope(const HalfPlane::Vector& half_planes);
+
+  int numHalfPlanes() const { return normals.rows(); }
+
+  // One normal per row.
+  Eigen::Matrix<double, Eigen::Dynamic, 3> normals;
+  Eigen::VectorXd offsets;
+};
+
 // A base class for different implementations for dynamic and position
 // feasibility checks.
 class FeasibilityBase {
@@ -82,13 +98,29 @@ class FeasibilityBase {
   // Checks a trajectory for input feasibility.
   InputFeasibilityResult checkInputFeasibility(
       const Trajectory& trajectory) const;
-  // Checks a segment for input feasibility.
+  // Checks the segments of a trajectory concurrently on the thread pool and
+  // returns the same result as the sequential check. Segments after a
+  // segment that failed are skipped.
+  // Output: segment_idx = Optional index of the first segment that is not
+  // feasible, K if all segments are feasible.
+  InputFeasibilityResult checkInputFeasibilityParallel(
+      const Trajectory& trajectory, ThreadPool* thread_pool,
+      int* segment_idx = nullptr) const;
+  // Checks a segment for input feasibility. Has to be thread-safe.
   inline virtual InputFeasibilityResult checkInputFeasibility(
       const Segment& segment) const {
     ROS_ERROR_STREAM("Input feasibility check not implemented.");
     return InputFeasibilityResult::kInputIndeterminable;
   }
 
+  // Conservative check of a segment with the Bernstein bounds of velocity,
+  // acceleration, jerk and yaw derivatives, without root finding. The
+  // constraints are checked in the order thrust, velocity, roll/pitch rates,
+  // yaw rates and yaw acceleration. Returns kInputIndeterminable as soon as a
+  // constraint can neither be proven satisfied nor violated.
+  InputFeasibilityResult checkInputFeasibilityBernstein(
+      const Segment& segment) const;
+
   // Checks if a trajectory stays within a set of half planes.
   bool checkHalfPlaneFeasibility(const Trajectory& trajectory) const;
   // Checks if a segment stays within a set of half planes.
@@ -97,11 +129,27 @@ class FeasibilityBase {
   // https://github.com/markwmuller/RapidQuadrocopterTrajectories/blob/master/C%2B%2B/RapidTrajectoryGenerator.cpp#L149
   bool checkHalfPlaneFeasibility(const Segment& segment) const;
 
+  // Checks if a segment stays within a polytope. The position is projected
+  // onto all normals at once and the Bernstein bounds of the projections
+  // decide most planes; only the remaining planes need root finding.
+  bool checkPolytopeFeasibility(const Segment& segment,
+                                const Polytope& polytope) const;
+  // Checks a corridor trajectory, where segment i has to stay within
+  // corridor[i].
+  // Output: segment_idx = Optional index of the first segment that leaves its
+  // polytope, K if the trajectory stays within the corridor.
+  bool checkCorridorFeasibility(const Trajectory& trajectory,
+                                const Polytope::Vector& corridor,
+                                int* segment_idx = nullptr) const;
+
   // Input constraints.
   InputConstraints input_constraints_;
   // Half plane constraints, e.g., the ground plane or a box.
   HalfPlane::Vector half_plane_constraints_;
   Eigen::Vector3d gravity_;
+  // Whether the checks first try to classify a segment with the Bernstein
+  // bounds and only fall back to the exact check for undecided segments.
+  bool use_bernstein_pre_filter_;
 };
 }  // namespace mav_trajectory_generation
 
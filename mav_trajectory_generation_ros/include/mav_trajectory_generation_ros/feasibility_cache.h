@@ -0,0 +1,81 @@
+/*
+ * Copyright (c) 2016, Markus Achtelik, ASL, ETH Zurich, Switzerland
+ * Copyright (c) 2016, Michael Burri, ASL, ETH Zurich, Switzerland
+ * Copyright (c) 2016, Helen Oleynikova, ASL, ETH Zurich, Switzerland
+ * Copyright (c) 2016, Rik Bähnemann, ASL, ETH Zurich, Switzerland
+ * Copyright (c) 2016, Marija Popovic, ASL, ETH Zurich, Switzerland
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef MAV_TRAJECTORY_GENERATION_ROS_FEASIBILITY_CACHE_H_
+#define MAV_TRAJECTORY_GENERATION_ROS_FEASIBILITY_CACHE_H_
+
+#include <mutex>
+
+#include <mav_trajectory_generation/lru_cache.h>
+#include <mav_trajectory_generation/segment.h>
+
+#include "mav_trajectory_generation_ros/feasibility_base.h"
+
+namespace mav_trajectory_generation {
+
+// Least recently used cache in front of the segment checks of a feasibility
+// check. Entries are keyed by the bits of the segment coefficients and time
+// and of the input and half plane constraints, the gravity and the Bernstein
+// pre-filter flag of the check at the time of the query, so changing them
+// does not return stale results. Changing the settings of a derived check,
+// e.g., the minimum section time, requires clear().
+// All methods are thread-safe.
+class FeasibilityCache {
+ public:
+  // The feasibility check is not owned and has to outlive the cache.
+  FeasibilityCache(const FeasibilityBase* feasibility_check, size_t capacity);
+
+  // Cached FeasibilityBase::checkInputFeasibility(segment).
+  InputFeasibilityResult checkInputFeasibility(const Segment& segment);
+  // Cached FeasibilityBase::checkInputFeasibility(trajectory).
+  InputFeasibilityResult checkInputFeasibility(const Trajectory& trajectory);
+  // Cached FeasibilityBase::checkHalfPlaneFeasibility(segment).
+  bool checkHalfPlaneFeasibility(const Segment& segment);
+
+  // Removes all entries, keeps the counters.
+  void clear();
+  // Resets the hit and miss counters.
+  void resetCounters();
+
+  size_t size() const;
+  size_t getCapacity() const { return cache_.getCapacity(); }
+  size_t getNumHits() const;
+  size_t getNumMisses() const;
+
+ private:
+  enum CheckType { kInput = 0, kHalfPlane };
+  // Bit patterns of the doubles, see computeKey().
+  typedef internal::CacheKey Key;
+
+  // Serializes everything the result of a check depends on.
+  void computeKey(CheckType type, const Segment& segment, Key* key) const;
+  // Returns true and the result if the key is cached.
+  bool lookup(const Key& key, int* result);
+  void insert(const Key& key, int result);
+
+  const FeasibilityBase* feasibility_check_;
+
+  mutable std::mutex mutex_;
+  internal::LruCache<int> cache_;
+};
+
+}  // namespace mav_trajectory_generation
+
+#endif  // MAV_TRAJECTORY_GENERATION_ROS_FEASIBILITY_CACHE_H_
@@ -29,7 +29,11 @@
 
 namespace mav_trajectory_generation {
 
-// Sampling based input feasibility checks.
+// Sampling based input feasibility checks. The check evaluates the flat
+// state in chunks with VectorizedSegment, whose storage is reused by every
+// check of a thread, and computes only the full state quantities needed by
+// the configured input constraints. The body yaw rate and acceleration are
+// computed with mav_msgs.
 class FeasibilitySampling : public FeasibilityBase {
  public:
   class Settings {
@@ -41,8 +45,29 @@ class FeasibilitySampling : public FeasibilityBase {
     }
     inline double getSamplingIntervalS() const { return sampling_interval_s_; }
 
+    // With adaptive sampling the step after every sample is extended to the
+    // time the thrust, velocity and roll/pitch rates need at least to reach
+    // their limits, given bounds on their rate of change over the segment.
+    // The sampling interval stays the smallest step, and is always used while
+    // yaw rate or yaw acceleration constraints are set.
+    inline void setAdaptiveSampling(bool adaptive_sampling) {
+      adaptive_sampling_ = adaptive_sampling;
+    }
+    inline bool getAdaptiveSampling() const { return adaptive_sampling_; }
+
+    // Evaluates the flat state in single precision about the segment
+    // midpoint, see FloatSegment. The constraints are still checked in
+    // double, so only states within the float error bound of a limit can be
+    // classified differently.
+    inline void setSinglePrecision(bool single_precision) {
+      single_precision_ = single_precision;
+    }
+    inline bool getSinglePrecision() const { return single_precision_; }
+
    private:
     double sampling_interval_s_;
+    bool adaptive_sampling_;
+    bool single_precision_;
   };
 
   FeasibilitySampling() {}
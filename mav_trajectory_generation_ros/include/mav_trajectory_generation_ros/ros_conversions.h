@@ -28,11 +28,14 @@
 
 namespace mav_trajectory_generation {
 
-// Converts a trajectory into a ROS polynomial trajectory msg.
+// Converts a trajectory into a ROS polynomial trajectory msg. The
+// coefficients of every polynomial are copied in one block into the message.
 bool trajectoryToPolynomialTrajectoryMsg(
     const Trajectory& trajectory, planning_msgs::PolynomialTrajectory4D* msg);
 
-// Converts a ROS polynomial trajectory msg into a Trajectory.
+// Converts a ROS polynomial trajectory msg into a Trajectory. The
+// coefficients of every polynomial are copied in one block from the message.
+// Returns false if the number of coefficients of a segment is inconsistent.
 bool polynomialTrajectoryMsgToTrajectory(
     const planning_msgs::PolynomialTrajectory4D& msg, Trajectory* trajectory);
 
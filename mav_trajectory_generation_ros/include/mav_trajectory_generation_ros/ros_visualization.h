@@ -21,6 +21,9 @@
 #ifndef MAV_TRAJECTORY_GENERATION_ROS_ROS_VISUALIZATION_H_
 #define MAV_TRAJECTORY_GENERATION_ROS_ROS_VISUALIZATION_H_
 
+#include <string>
+#include <vector>
+
 #include <mav_msgs/eigen_mav_msgs.h>
 #include <mav_visualization/marker_group.h>
 #include <visualization_msgs/MarkerArray.h>
@@ -30,8 +33,9 @@
 
 namespace mav_trajectory_generation {
 
-// Draws the trajectory of the MAV, with additional markers spaced by distance.
-// If distance = 0.0, then these additional markers are disabled.
+// Draws the trajectory of the MAV, with additional markers spaced by distance
+// along the path. If distance = 0.0, then these additional markers are
+// disabled.
 void drawMavTrajectory(const Trajectory& trajectory, double distance,
                        const std::string& frame_id,
                        visualization_msgs::MarkerArray* marker_array);
@@ -60,6 +64,90 @@ void drawMavSampledTrajectoryWithMavMarker(
 void drawVertices(const Vertex::Vector& vertices, const std::string& frame_id,
                   visualization_msgs::MarkerArray* marker_array);
 
+// Draws trajectories incrementally, e.g. at the replanning rate. Keeps the
+// markers of the last trajectory per segment, such that update() only
+// regenerates and outputs the markers of segments that changed, and deletes
+// the markers that are gone. The path is drawn with one line strip per
+// segment, subdivided until it deviates less than a tolerance from the
+// trajectory instead of sampling at a fixed interval. State markers are
+// spaced by distance along the path from the start of their segment, such
+// that they do not depend on other segments.
+class TrajectoryVisualizer {
+ public:
+  // Input: distance = Spacing of the state markers along the path, 0.0
+  // disables them.
+  // Input: tolerance = Maximum distance of the drawn path to the trajectory.
+  TrajectoryVisualizer(const std::string& frame_id, double distance,
+                       double tolerance);
+
+  // Drawn at every state marker, e.g. a mav_visualization::HexacopterMarker.
+  // Applies to segments drawn from now on.
+  void setAdditionalMarker(const mav_visualization::MarkerGroup& marker) {
+    additional_marker_ = marker;
+  }
+
+  // Turns the tolerance into a screen-space error, i.e. an angle in radians
+  // seen from the viewpoint, e.g. the camera of RViz. The path is drawn
+  // coarser far from the viewpoint. Applies to segments drawn from now on.
+  void setViewpoint(const Eigen::Vector3d& viewpoint,
+                    double angular_tolerance);
+
+  // Output: marker_array = Markers of the changed segments and deletions of
+  // markers that are gone, to be published. Empty if nothing changed. Its
+  // memory is reused if passed again.
+  void update(const Trajectory& trajectory,
+              visualization_msgs::MarkerArray* marker_array);
+
+  // All current markers, e.g. for a subscriber that connects later.
+  void getAllMarkers(visualization_msgs::MarkerArray* marker_array) const;
+
+  // Deletes all markers, the next update() draws all segments.
+  // Output: marker_array = Deletions of all current markers.
+  void clear(visualization_msgs::MarkerArray* marker_array);
+
+  // Marker ids are segment_idx * kMaxMarkersPerSegment + marker_idx.
+  static constexpr int kMaxMarkersPerSegment = 4096;
+
+ private:
+  struct SegmentMarkers {
+    explicit SegmentMarkers(const Segment& segment) : segment(segment) {}
+    Segment segment;
+    std::vector<visualization_msgs::Marker> markers;
+  };
+
+  // Draws the markers of a segment into markers, reusing its memory.
+  void drawSegment(const Segment& segment, int segment_idx,
+                   const std_msgs::Header& header,
+                   std::vector<visualization_msgs::Marker>* markers) const;
+
+  // Appends the points of the path after t_start up to t_end, subdividing
+  // while the midpoint deviates more than the tolerance from the chord.
+  void appendPathPoints(const Segment& segment, double t_start,
+                        const Eigen::Vector3d& p_start, double t_end,
+                        const Eigen::Vector3d& p_end, int depth,
+                        std::vector<double>* times,
+                        std::vector<Eigen::Vector3d>* points) const;
+
+  double getTolerance(const Eigen::Vector3d& position) const;
+
+  std::string frame_id_;
+  double distance_;
+  double tolerance_;
+  bool has_viewpoint_;
+  Eigen::Vector3d viewpoint_;
+  double angular_tolerance_;
+  mav_visualization::MarkerGroup additional_marker_;
+
+  // The last trajectory, whose segments are compared by their storage
+  // first.
+  Trajectory trajectory_;
+  std::vector<SegmentMarkers> segments_;
+  // Scratch memory for drawing a segment.
+  mutable std::vector<double> times_;
+  mutable std::vector<Eigen::Vector3d> points_;
+  std::vector<std::string> previous_namespaces_;
+};
+
 }  // namespace mav_trajectory_generation
 
 #endif  // MAV_TRAJECTORY_GENERATION_ROS_ROS_CONVERSIONS_H_
@@ -21,11 +21,15 @@
 #ifndef TRAJECTORY_SAMPLER_NODE_H
 #define TRAJECTORY_SAMPLER_NODE_H
 
+#include <atomic>
+#include <memory>
+
 #include <mav_msgs/conversions.h>
 #include <mav_msgs/default_topics.h>
 #include <mav_msgs/eigen_mav_msgs.h>
 #include <planning_msgs/PolynomialSegment4D.h>
 #include <planning_msgs/PolynomialTrajectory4D.h>
+#include <ros/callback_queue.h>
 #include <ros/ros.h>
 #include <std_srvs/Empty.h>
 #include <trajectory_msgs/MultiDOFJointTrajectory.h>
@@ -33,7 +37,16 @@
 #include <mav_trajectory_generation/polynomial.h>
 #include <mav_trajectory_generation_ros/ros_conversions.h>
 #include <mav_trajectory_generation/trajectory_sampling.h>
+#include <mav_trajectory_generation/vectorized_segment.h>
 
+// Samples the latest trajectory and publishes it as commands.
+// Trajectories are converted on their own thread and handed over to the
+// command timer through an atomic pointer, such that the timer never waits
+// for a conversion and never reads a trajectory that is being replaced.
+// Time alignment: time 0 of a trajectory is the stamp of its message, or
+// its reception if unstamped. The timer takes over a new trajectory on its
+// next tick and continues sampling at the current time since that start,
+// i.e. the handover delay is skipped, not added.
 class TrajectorySamplerNode {
  public:
   TrajectorySamplerNode(const ros::NodeHandle& nh,
@@ -41,30 +54,71 @@ class TrajectorySamplerNode {
   ~TrajectorySamplerNode();
 
  private:
+  // Takes the message as shared pointer, such that messages published
+  // within the same process, e.g. between nodelets, are not serialized.
   void pathSegmentsCallback(
-      const planning_msgs::PolynomialTrajectory4D& segments_message);
+      const planning_msgs::PolynomialTrajectory4D::ConstPtr& segments_message);
   bool stopSamplingCallback(std_srvs::Empty::Request& request,
                             std_srvs::Empty::Response& response);
   void commandTimerCallback(const ros::TimerEvent&);
 
+  // A converted trajectory and its samplers. Never moved, as the stream
+  // sampler points into the trajectory.
+  struct SamplingState {
+    EIGEN_MAKE_ALIGNED_OPERATOR_NEW
+
+    mav_trajectory_generation::Trajectory trajectory;
+    // Holds the time and the state of the currently published sample.
+    mav_trajectory_generation::TrajectoryStreamSampler stream_sampler;
+    // Batched evaluation of the horizon.
+    mav_trajectory_generation::VectorizedTrajectory vectorized_trajectory;
+    // Time 0 of the trajectory.
+    ros::Time start_time;
+  };
+
+  // Called by the timer. Takes over the latest converted trajectory, if
+  // any, and drops the active one if sampling was stopped.
+  void updateActiveState(const ros::Time& now);
+  // Hands a replaced state to the conversion thread for deletion.
+  void retireState(SamplingState* state);
+  // Publishes the look-ahead horizon from the current time on.
+  // Returns false past the end of the trajectory.
+  bool publishHorizon(const ros::Time& now);
+
   ros::NodeHandle nh_;
   ros::NodeHandle nh_private_;
 
   ros::Timer publish_timer_;
+  // Trajectories are received and converted on this queue.
+  ros::CallbackQueue trajectory_queue_;
+  std::unique_ptr<ros::AsyncSpinner> trajectory_spinner_;
   ros::Subscriber trajectory_sub_;
   ros::Publisher command_pub_;
   ros::ServiceServer stop_srv_;
-  ros::Time start_time_;
 
   // Flag whether to publish entire trajectory at once or not.
   bool publish_whole_trajectory_;
   // Trajectory sampling interval.
   double dt_;
-  // Time at currently published trajectory sample.
-  double current_sample_time_;
+  // Number of points, spaced by dt_, of the look-ahead horizon published
+  // every horizon_period_ seconds. Publishes single points if 0.
+  int horizon_points_;
+  double horizon_period_;
+
+  // Single producer, single consumer handover. The conversion thread stores
+  // new states in incoming_ and deletes the states in retired_, the timer
+  // takes incoming_ over as active_ and retires the replaced state. Each
+  // pointer is owned by whoever exchanged it out of its slot.
+  std::atomic<SamplingState*> incoming_;
+  std::atomic<SamplingState*> retired_;
+  std::atomic<bool> stop_requested_;
+  // Only accessed by the timer.
+  std::unique_ptr<SamplingState> active_;
 
-  // The trajectory to sub-sample.
-  mav_trajectory_generation::Trajectory trajectory_;
+  // Buffers that are reused for every horizon.
+  Eigen::MatrixXd horizon_samples_;
+  mav_msgs::EigenTrajectoryPointVector horizon_states_;
+  trajectory_msgs::MultiDOFJointTrajectory::Ptr horizon_msg_;
 };
 
 #endif  // TRAJECTORY_SAMPLER_NODE_H
@@ -0,0 +1,115 @@
+/*
+ * Copyright (c) 2017, Markus Achtelik, ASL, ETH Zurich, Switzerland
+ * Copyright (c) 2017, Michael Burri, ASL, ETH Zurich, Switzerland
+ * Copyright (c) 2017, Helen Oleynikova, ASL, ETH Zurich, Switzerland
+ * Copyright (c) 2017, Rik Bähnemann, ASL, ETH Zurich, Switzerland
+ * Copyright (c) 2017, Marija Popovic, ASL, ETH Zurich, Switzerland
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef WAYPOINT_NODE_H
+#define WAYPOINT_NODE_H
+
+#include <atomic>
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+#include <thread>
+
+#include <geometry_msgs/PoseArray.h>
+#include <nav_msgs/Path.h>
+#include <planning_msgs/PolynomialTrajectory4D.h>
+#include <ros/ros.h>
+#include <visualization_msgs/MarkerArray.h>
+
+#include <mav_trajectory_generation/segment_time_initializer.h>
+#include <mav_trajectory_generation/trajectory.h>
+#include <mav_trajectory_generation_ros/ros_visualization.h>
+
+// Optimizes a trajectory through the poses of the latest planned path and
+// publishes its visualization, its poses with yaw along the path and its
+// polynomial segments for the trajectory sampler.
+// Planning runs on a worker thread, such that the callbacks never block. A
+// new path replaces a path that is still waiting and cancels the running
+// optimization, whose result is dropped.
+class WaypointNode {
+ public:
+  WaypointNode(const ros::NodeHandle& nh, const ros::NodeHandle& nh_private);
+  ~WaypointNode();
+
+ private:
+  void pathCallback(const nav_msgs::Path::ConstPtr& msg);
+
+  // Plans the latest path until the node shuts down.
+  void plannerLoop();
+
+  // Returns false if planning was cancelled by a newer path.
+  bool planTrajectory(const nav_msgs::Path& path,
+                      mav_trajectory_generation::Trajectory* trajectory);
+  void publishTrajectory(
+      const mav_trajectory_generation::Trajectory& trajectory);
+
+  // Publishes poses sampled uniformly in time along the trajectory, with the
+  // yaw pointing along the path.
+  void publishTrajectoryWithYaw(
+      const mav_trajectory_generation::Trajectory& trajectory);
+
+  // Sends all current markers to a new subscriber, since only changes are
+  // published.
+  void visualizationConnectCallback(const ros::SingleSubscriberPublisher& pub);
+
+  ros::NodeHandle nh_;
+  ros::NodeHandle nh_private_;
+
+  ros::Subscriber path_sub_;
+  ros::Publisher vis_pub_;
+  ros::Publisher traj_with_yaw_pub_;
+  ros::Publisher path_segments_pub_;
+
+  // Optimize the segment times with the nonlinear optimization, otherwise
+  // only the linear problem is solved.
+  bool optimize_segment_times_;
+  double v_max_;
+  double a_max_;
+
+  // Estimates the segment times of a new path, "fabian" or "corner_aware".
+  std::unique_ptr<mav_trajectory_generation::SegmentTimeInitializer>
+      segment_time_estimate_;
+  // Seeds the nonlinear optimization with the converged times of the last
+  // path if it has the same number of segments, e.g. when replanning.
+  std::unique_ptr<mav_trajectory_generation::WarmStartSegmentTimeInitializer>
+      segment_time_warm_start_;
+
+  // Only draws the segments that changed since the last trajectory.
+  std::unique_ptr<mav_trajectory_generation::TrajectoryVisualizer>
+      visualizer_;
+  // Reused for every published change of the markers.
+  visualization_msgs::MarkerArray changed_markers_;
+  visualization_msgs::MarkerArray all_markers_;
+  // Guards the visualizer and the markers, which are also accessed by the
+  // connect callback.
+  std::mutex visualization_mutex_;
+
+  // Guards pending_path_ and shutdown_.
+  std::mutex mutex_;
+  std::condition_variable path_received_;
+  // The latest path that was not planned yet.
+  nav_msgs::Path::ConstPtr pending_path_;
+  bool shutdown_;
+  // Set by a new path to cancel the running optimization.
+  std::atomic<bool> cancel_planning_;
+  std::thread planner_thread_;
+};
+
+#endif  // WAYPOINT_NODE_H
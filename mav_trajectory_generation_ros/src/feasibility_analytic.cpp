@@ -23,6 +23,7 @@
 #include <limits>
 
 #include <mav_trajectory_generation/extremum.h>
+#include <mav_trajectory_generation/timing.h>
 std::vector<int> kPosDim = {0, 1, 2};
 
 namespace mav_trajectory_generation {
@@ -41,10 +42,18 @@ FeasibilityAnalytic::FeasibilityAnalytic(
 
 InputFeasibilityResult FeasibilityAnalytic::checkInputFeasibility(
     const Segment& segment) const {
+  MAV_TRAJECTORY_GENERATION_SCOPED_TIMER("feasibility_analytic");
   // Check user input.
   if (!(segment.D() == 3 || segment.D() == 4)) {
     return InputFeasibilityResult::kInputIndeterminable;
   }
+  if (use_bernstein_pre_filter_) {
+    const InputFeasibilityResult pre_filter_result =
+        checkInputFeasibilityBernstein(segment);
+    if (pre_filter_result != InputFeasibilityResult::kInputIndeterminable) {
+      return pre_filter_result;
+    }
+  }
   // Check constraints.
   // Thrust:
   std::vector<Extremum> thrust_candidates;
@@ -136,8 +145,7 @@ InputFeasibilityResult FeasibilityAnalytic::analyticThrustFeasibility(
   thrust_segment->setTime(segment.getTime());
   for (int i = 0; i < thrust_segment->D(); i++) {
     Eigen::VectorXd thrust_coeffs =
-        segment[i]
-            .getCoefficients(derivative_order::ACCELERATION)
+        segment.getDerivativeCoefficientsRef(i, derivative_order::ACCELERATION)
             .head(thrust_segment->N());
     thrust_coeffs(0) += gravity_[i];
     Polynomial p_thrust(thrust_coeffs);
@@ -20,11 +20,18 @@
 
 #include "mav_trajectory_generation_ros/feasibility_base.h"
 
+#include <algorithm>
+#include <atomic>
 #include <cmath>
 #include <limits>
+#include <utility>
+#include <vector>
 
 #include <Eigen/Geometry>
 
+#include <mav_trajectory_generation/motion_defines.h>
+#include <mav_trajectory_generation/timing.h>
+
 #include <mav_msgs/default_values.h>
 
 namespace mav_trajectory_generation {
@@ -85,19 +92,28 @@ HalfPlane::Vector HalfPlane::createBoundingBox(
   return bounding_box;
 }
 
-FeasibilityBase::FeasibilityBase()
-    : gravity_((Eigen::Vector3d() << 0.0, 0.0, mav_msgs::kGravity).finished()) {
+Polytope::Polytope(const HalfPlane::Vector& half_planes)
+    : normals(half_planes.size(), 3), offsets(half_planes.size()) {
+  for (size_t i = 0; i < half_planes.size(); i++) {
+    normals.row(i) = half_planes[i].normal.transpose();
+    offsets(i) = half_planes[i].normal.dot(half_planes[i].point);
+  }
 }
 
+FeasibilityBase::FeasibilityBase()
+    : gravity_((Eigen::Vector3d() << 0.0, 0.0, mav_msgs::kGravity).finished()),
+      use_bernstein_pre_filter_(true) {}
+
 FeasibilityBase::FeasibilityBase(const InputConstraints& input_constraints)
     : input_constraints_(input_constraints),
-      gravity_((Eigen::Vector3d() << 0.0, 0.0, mav_msgs::kGravity).finished()) {
-}
+      gravity_((Eigen::Vector3d() << 0.0, 0.0, mav_msgs::kGravity).finished()),
+      use_bernstein_pre_filter_(true) {}
 
 InputFeasibilityResult FeasibilityBase::checkInputFeasibility(
     const Trajectory& trajectory) const {
+  MAV_TRAJECTORY_GENERATION_ALLOCATION_PHASE("feasibility_trajectory");
   InputFeasibilityResult result = InputFeasibilityResult::kInputIndeterminable;
-  for (const Segment segment : trajectory.segments()) {
+  for (const Segment& segment : trajectory.segments()) {
     result = checkInputFeasibility(segment);
     if (result != InputFeasibilityResult::kInputFeasible) {
       return result;
@@ -106,6 +122,328 @@ InputFeasibilityResult FeasibilityBase::checkInputFeasibility(
   return result;
 }
 
+InputFeasibilityResult FeasibilityBase::checkInputFeasibilityParallel(
+    const Trajectory& trajectory, ThreadPool* thread_pool,
+    int* segment_idx) const {
+  CHECK_NOTNULL(thread_pool);
+  const Segment::Vector& segments = trajectory.segments();
+  std::vector<InputFeasibilityResult> results(
+      segments.size(), InputFeasibilityResult::kInputIndeterminable);
+  // Lowest index of a segment that failed so far. Only segments before it
+  // can still change the result.
+  std::atomic<size_t> first_failed(segments.size());
+  thread_pool->parallelFor(
+      segments.size(), [&](size_t job_idx, size_t /*worker_idx*/) {
+        if (job_idx > first_failed.load(std::memory_order_relaxed)) {
+          return;
+        }
+        results[job_idx] = checkInputFeasibility(segments[job_idx]);
+        if (results[job_idx] == InputFeasibilityResult::kInputFeasible) {
+          return;
+        }
+        size_t current = first_failed.load(std::memory_order_relaxed);
+        while (job_idx < current &&
+               !first_failed.compare_exchange_weak(current, job_idx)) {
+        }
+      });
+
+  const size_t failed_idx = first_failed.load();
+  if (segment_idx != nullptr) {
+    *segment_idx = failed_idx;
+  }
+  if (failed_idx < segments.size()) {
+    return results[failed_idx];
+  }
+  return segments.empty() ? InputFeasibilityResult::kInputIndeterminable
+                          : InputFeasibilityResult::kInputFeasible;
+}
+
+namespace {
+
+// Number of equal sections the Bernstein pre-filter splits a segment into.
+// The bounds of high order polynomials get much tighter on shorter sections.
+constexpr int kNumBernsteinSections = 8;
+
+// Bernstein bounds of one axis of a derivative on a section.
+struct AxisBounds {
+  double minimum;
+  double maximum;
+  // Largest absolute value.
+  double upper() const {
+    return std::max(std::abs(minimum), std::abs(maximum));
+  }
+  // Smallest absolute value, zero if the sign may change.
+  double lower() const {
+    return minimum * maximum <= 0.0
+               ? 0.0
+               : std::min(std::abs(minimum), std::abs(maximum));
+  }
+};
+
+}  // namespace
+
+InputFeasibilityResult FeasibilityBase::checkInputFeasibilityBernstein(
+    const Segment& segment) const {
+  if (!(segment.D() == 3 || segment.D() == 4) ||
+      segment.N() > Polynomial::kMaxN) {
+    return InputFeasibilityResult::kInputIndeterminable;
+  }
+  const double section_time = segment.getTime() / kNumBernsteinSections;
+  auto computeAxisBounds = [&segment, section_time](
+      int axis, int derivative, int section, double offset) {
+    AxisBounds bounds;
+    segment[axis].computeBernsteinBounds(
+        section * section_time, (section + 1) * section_time, derivative,
+        &bounds.minimum, &bounds.maximum);
+    bounds.minimum += offset;
+    bounds.maximum += offset;
+    return bounds;
+  };
+  // Exact norm of the first three axes at the start of a section, or at the
+  // end of the segment for section = kNumBernsteinSections.
+  auto evaluateNorm = [&segment, section_time](
+      int derivative, int section, const Eigen::Vector3d& offset) {
+    Eigen::Vector3d value;
+    for (int i = 0; i < 3; i++) {
+      value[i] = segment[i].evaluate(section * section_time, derivative);
+    }
+    return (value + offset).norm();
+  };
+
+  // Thrust, also needed for the roll and pitch rates.
+  double f_min_sqr[kNumBernsteinSections];
+  const bool check_thrust =
+      input_constraints_.hasConstraint(InputConstraintType::kFMin) ||
+      input_constraints_.hasConstraint(InputConstraintType::kFMax);
+  if (check_thrust ||
+      input_constraints_.hasConstraint(InputConstraintType::kOmegaXYMax)) {
+    double f_max_sqr[kNumBernsteinSections];
+    for (int section = 0; section < kNumBernsteinSections; section++) {
+      f_min_sqr[section] = 0.0;
+      f_max_sqr[section] = 0.0;
+      for (int i = 0; i < 3; i++) {
+        const AxisBounds f_i = computeAxisBounds(
+            i, derivative_order::ACCELERATION, section, gravity_[i]);
+        f_min_sqr[section] += std::pow(f_i.lower(), 2);
+        f_max_sqr[section] += std::pow(f_i.upper(), 2);
+      }
+    }
+    double f_lower_bound = std::numeric_limits<double>::max();
+    double f_upper_bound = 0.0;
+    // Smallest upper bound of all sections.
+    double f_min_upper_bound = std::numeric_limits<double>::max();
+    // Largest lower bound of all sections.
+    double f_max_lower_bound = 0.0;
+    for (int section = 0; section < kNumBernsteinSections; section++) {
+      f_lower_bound = std::min(f_lower_bound, std::sqrt(f_min_sqr[section]));
+      f_upper_bound = std::max(f_upper_bound, std::sqrt(f_max_sqr[section]));
+      f_min_upper_bound =
+          std::min(f_min_upper_bound, std::sqrt(f_max_sqr[section]));
+      f_max_lower_bound =
+          std::max(f_max_lower_bound, std::sqrt(f_min_sqr[section]));
+    }
+    double f_min = std::numeric_limits<double>::max();
+    double f_max = 0.0;
+    for (int section = 0; section <= kNumBernsteinSections; section++) {
+      const double f =
+          evaluateNorm(derivative_order::ACCELERATION, section, gravity_);
+      f_min = std::min(f_min, f);
+      f_max = std::max(f_max, f);
+    }
+
+    double f_min_limit;
+    if (input_constraints_.getConstraint(InputConstraintType::kFMin,
+                                         &f_min_limit)) {
+      if (f_min < f_min_limit || f_min_upper_bound < f_min_limit) {
+        return InputFeasibilityResult::kInputInfeasibleThrustLow;
+      }
+      if (f_lower_bound < f_min_limit) {
+        return InputFeasibilityResult::kInputIndeterminable;
+      }
+    }
+    double f_max_limit;
+    if (input_constraints_.getConstraint(InputConstraintType::kFMax,
+                                         &f_max_limit)) {
+      if (f_max > f_max_limit || f_max_lower_bound > f_max_limit) {
+        return InputFeasibilityResult::kInputInfeasibleThrustHigh;
+      }
+      if (f_upper_bound > f_max_limit) {
+        return InputFeasibilityResult::kInputIndeterminable;
+      }
+    }
+  }
+
+  // Velocity.
+  double v_max_limit;
+  if (input_constraints_.getConstraint(InputConstraintType::kVMax,
+                                       &v_max_limit)) {
+    for (int section = 0; section <= kNumBernsteinSections; section++) {
+      if (evaluateNorm(derivative_order::VELOCITY, section,
+                       Eigen::Vector3d::Zero()) > v_max_limit) {
+        return InputFeasibilityResult::kInputInfeasibleVelocity;
+      }
+    }
+    for (int section = 0; section < kNumBernsteinSections; section++) {
+      double v_max_sqr = 0.0;
+      for (int i = 0; i < 3; i++) {
+        v_max_sqr += std::pow(
+            computeAxisBounds(i, derivative_order::VELOCITY, section, 0.0)
+                .upper(),
+            2);
+      }
+      if (v_max_sqr > std::pow(v_max_limit, 2)) {
+        return InputFeasibilityResult::kInputIndeterminable;
+      }
+    }
+  }
+
+  // Roll and pitch rates, bounded by |jerk| / |thrust|.
+  double omega_xy_limit;
+  if (input_constraints_.getConstraint(InputConstraintType::kOmegaXYMax,
+                                       &omega_xy_limit)) {
+    for (int section = 0; section < kNumBernsteinSections; section++) {
+      // Divide-by-zero protection.
+      if (f_min_sqr[section] <= 1.0e-6) {
+        return InputFeasibilityResult::kInputIndeterminable;
+      }
+      double j_max_sqr = 0.0;
+      for (int i = 0; i < 3; i++) {
+        j_max_sqr += std::pow(
+            computeAxisBounds(i, derivative_order::JERK, section, 0.0).upper(),
+            2);
+      }
+      if (std::sqrt(j_max_sqr / f_min_sqr[section]) > omega_xy_limit) {
+        return InputFeasibilityResult::kInputIndeterminable;
+      }
+    }
+  }
+
+  if (segment.D() == 4) {
+    // Yaw rates and yaw acceleration.
+    const std::vector<std::pair<int, InputFeasibilityResult>> yaw_checks = {
+        {InputConstraintType::kOmegaZMax,
+         InputFeasibilityResult::kInputInfeasibleYawRates},
+        {InputConstraintType::kOmegaZDotMax,
+         InputFeasibilityResult::kInputInfeasibleYawAcc}};
+    for (size_t k = 0; k < yaw_checks.size(); k++) {
+      const int derivative = derivative_order::ANGULAR_VELOCITY + k;
+      double limit;
+      if (!input_constraints_.getConstraint(yaw_checks[k].first, &limit)) {
+        continue;
+      }
+      for (int section = 0; section <= kNumBernsteinSections; section++) {
+        if (std::abs(segment[3].evaluate(section * section_time,
+                                         derivative)) > limit) {
+          return yaw_checks[k].second;
+        }
+      }
+      for (int section = 0; section < kNumBernsteinSections; section++) {
+        if (computeAxisBounds(3, derivative, section, 0.0).upper() > limit) {
+          return InputFeasibilityResult::kInputIndeterminable;
+        }
+      }
+    }
+  }
+
+  // Segment definitely feasible.
+  return InputFeasibilityResult::kInputFeasible;
+}
+
+namespace {
+
+// Matrix M such that the coefficients of a polynomial with N power basis
+// coefficients c (row vector) are c * M in the Bernstein basis on [0, T].
+Eigen::MatrixXd computeBernsteinTransform(int N, double T) {
+  const int m = N - 1;
+  // Binomial coefficients C(i, k) up to i = m.
+  Eigen::MatrixXd binomial = Eigen::MatrixXd::Zero(N, N);
+  for (int i = 0; i < N; i++) {
+    binomial(i, 0) = 1.0;
+    for (int k = 1; k <= i; k++) {
+      binomial(i, k) = binomial(i - 1, k - 1) + binomial(i - 1, k);
+    }
+  }
+  // b_i = sum_{k <= i} C(i, k) / C(m, k) * c_k * T^k.
+  Eigen::MatrixXd transform = Eigen::MatrixXd::Zero(N, N);
+  double t_k = 1.0;
+  for (int k = 0; k < N; k++) {
+    for (int i = k; i < N; i++) {
+      transform(k, i) = binomial(i, k) / binomial(m, k) * t_k;
+    }
+    t_k *= T;
+  }
+  return transform;
+}
+
+}  // namespace
+
+bool FeasibilityBase::checkPolytopeFeasibility(const Segment& segment,
+                                               const Polytope& polytope) const {
+  // Check user input.
+  if (!(segment.D() == 3 || segment.D() == 4)) {
+    LOG(WARNING) << "Feasibility check only implemented for segment dimensions "
+                    "3 and 4. Got dimension "
+                 << segment.D() << ".";
+    return false;
+  }
+  if (polytope.numHalfPlanes() == 0) {
+    return true;
+  }
+  const int N = segment.N();
+  Eigen::Matrix<double, 3, Eigen::Dynamic> position(3, N);
+  for (int dim = 0; dim < 3; dim++) {
+    position.row(dim) = segment[dim].getCoefficientsRef().transpose();
+  }
+  // Distance to every plane as polynomial, one plane per row.
+  Eigen::MatrixXd distances = polytope.normals * position;
+  distances.col(0) -= polytope.offsets;
+  const Eigen::MatrixXd bernstein =
+      distances * computeBernsteinTransform(N, segment.getTime());
+
+  for (int i = 0; i < polytope.numHalfPlanes(); i++) {
+    // Convex hull inside the half plane.
+    if (bernstein.row(i).minCoeff() > 0.0) {
+      continue;
+    }
+    // Start or end outside the half plane.
+    if (bernstein(i, 0) <= 0.0 || bernstein(i, N - 1) <= 0.0) {
+      return false;
+    }
+    // Exact check at the extrema.
+    const Polynomial distance(distances.row(i).transpose());
+    std::vector<double> extrema_candidates;
+    distance.computeMinMaxCandidates(0.0, segment.getTime(),
+                                     derivative_order::POSITION,
+                                     &extrema_candidates);
+    for (double t : extrema_candidates) {
+      if (distance.evaluate(t, derivative_order::POSITION) <= 0.0) {
+        return false;
+      }
+    }
+  }
+  return true;
+}
+
+bool FeasibilityBase::checkCorridorFeasibility(const Trajectory& trajectory,
+                                               const Polytope::Vector& corridor,
+                                               int* segment_idx) const {
+  MAV_TRAJECTORY_GENERATION_ALLOCATION_PHASE("feasibility_corridor");
+  CHECK_EQ(corridor.size(), static_cast<size_t>(trajectory.K()))
+      << "One polytope per segment required.";
+  for (int i = 0; i < trajectory.K(); i++) {
+    if (!checkPolytopeFeasibility(trajectory.segments()[i], corridor[i])) {
+      if (segment_idx != nullptr) {
+        *segment_idx = i;
+      }
+      return false;
+    }
+  }
+  if (segment_idx != nullptr) {
+    *segment_idx = trajectory.K();
+  }
+  return true;
+}
+
 bool FeasibilityBase::checkHalfPlaneFeasibility(
     const Trajectory& trajectory) const {
   for (const Segment segment : trajectory.segments()) {
@@ -133,6 +471,25 @@ bool FeasibilityBase::checkHalfPlaneFeasibility(const Segment& segment) const {
     for (size_t dim = 0; dim < 3; dim++) {
       projection += segment[dim] * half_plane.normal(dim);
     }
+    // The convex hull of the projection proves most segments far from the
+    // boundary feasible, or infeasible at one of the ends.
+    if (use_bernstein_pre_filter_ && segment.N() <= Polynomial::kMaxN) {
+      const double offset = half_plane.point.dot(half_plane.normal);
+      double distance_min, distance_max;
+      projection.computeBernsteinBounds(0.0, segment.getTime(),
+                                        derivative_order::POSITION,
+                                        &distance_min, &distance_max);
+      if (distance_min - offset > 0.0) {
+        continue;
+      }
+      if (projection.evaluate(0.0, derivative_order::POSITION) - offset <=
+              0.0 ||
+          projection.evaluate(segment.getTime(), derivative_order::POSITION) -
+                  offset <=
+              0.0) {
+        return false;
+      }
+    }
     // Find critical times.
     // These are the points in the projected polynomial with zero velocity. The
     // MAV changes directions towards the boundary normal.
@@ -0,0 +1,173 @@
+/*
+ * Copyright (c) 2016, Markus Achtelik, ASL, ETH Zurich, Switzerland
+ * Copyright (c) 2016, Michael Burri, ASL, ETH Zurich, Switzerland
+ * Copyright (c) 2016, Helen Oleynikova, ASL, ETH Zurich, Switzerland
+ * Copyright (c) 2016, Rik Bähnemann, ASL, ETH Zurich, Switzerland
+ * Copyright (c) 2016, Marija Popovic, ASL, ETH Zurich, Switzerland
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "mav_trajectory_generation_ros/feasibility_cache.h"
+
+#include <cstdint>
+#include <cstring>
+#include <vector>
+
+namespace mav_trajectory_generation {
+namespace {
+
+// Appends the bit pattern of value, such that keys compare equal exactly if
+// their hashes are computed from the same bits. -0.0 is stored as 0.0, and a
+// NaN matches the same NaN.
+void appendToKey(double value, std::vector<int64_t>* key) {
+  if (value == 0.0) {
+    value = 0.0;
+  }
+  int64_t bits;
+  std::memcpy(&bits, &value, sizeof(bits));
+  key->push_back(bits);
+}
+
+void appendToKey(const double* values, int size, std::vector<int64_t>* key) {
+  for (int i = 0; i < size; ++i) {
+    appendToKey(values[i], key);
+  }
+}
+
+}  // namespace
+
+FeasibilityCache::FeasibilityCache(const FeasibilityBase* feasibility_check,
+                                   size_t capacity)
+    : feasibility_check_(CHECK_NOTNULL(feasibility_check)),
+      cache_(capacity) {}
+
+InputFeasibilityResult FeasibilityCache::checkInputFeasibility(
+    const Segment& segment) {
+  Key key;
+  computeKey(CheckType::kInput, segment, &key);
+  int result;
+  if (lookup(key, &result)) {
+    return static_cast<InputFeasibilityResult>(result);
+  }
+  // Run the check outside the lock, such that concurrent queries of
+  // different segments do not wait on each other.
+  const InputFeasibilityResult input_result =
+      feasibility_check_->checkInputFeasibility(segment);
+  insert(key, input_result);
+  return input_result;
+}
+
+InputFeasibilityResult FeasibilityCache::checkInputFeasibility(
+    const Trajectory& trajectory) {
+  InputFeasibilityResult result = InputFeasibilityResult::kInputIndeterminable;
+  for (const Segment& segment : trajectory.segments()) {
+    result = checkInputFeasibility(segment);
+    if (result != InputFeasibilityResult::kInputFeasible) {
+      return result;
+    }
+  }
+  return result;
+}
+
+bool FeasibilityCache::checkHalfPlaneFeasibility(const Segment& segment) {
+  Key key;
+  computeKey(CheckType::kHalfPlane, segment, &key);
+  int result;
+  if (lookup(key, &result)) {
+    return result != 0;
+  }
+  const bool feasible = feasibility_check_->checkHalfPlaneFeasibility(segment);
+  insert(key, feasible ? 1 : 0);
+  return feasible;
+}
+
+void FeasibilityCache::clear() {
+  std::lock_guard<std::mutex> lock(mutex_);
+  cache_.clear();
+}
+
+void FeasibilityCache::resetCounters() {
+  std::lock_guard<std::mutex> lock(mutex_);
+  cache_.resetCounters();
+}
+
+size_t FeasibilityCache::size() const {
+  std::lock_guard<std::mutex> lock(mutex_);
+  return cache_.size();
+}
+
+size_t FeasibilityCache::getNumHits() const {
+  std::lock_guard<std::mutex> lock(mutex_);
+  return cache_.getNumHits();
+}
+
+size_t FeasibilityCache::getNumMisses() const {
+  std::lock_guard<std::mutex> lock(mutex_);
+  return cache_.getNumMisses();
+}
+
+void FeasibilityCache::computeKey(CheckType type, const Segment& segment,
+                                  Key* key) const {
+  CHECK_NOTNULL(key);
+  key->clear();
+  key->reserve(8 + segment.D() * segment.N() + 2 * (kOmegaZDotMax + 1) +
+               6 * feasibility_check_->half_plane_constraints_.size());
+  key->push_back(type);
+  key->push_back(segment.D());
+  key->push_back(segment.N());
+  appendToKey(segment.getTime(), key);
+  for (int d = 0; d < segment.D(); ++d) {
+    const Eigen::VectorXd& coefficients = segment[d].getCoefficientsRef();
+    appendToKey(coefficients.data(), coefficients.size(), key);
+  }
+  // Settings of FeasibilityBase that change the results.
+  key->push_back(feasibility_check_->use_bernstein_pre_filter_ ? 1 : 0);
+  appendToKey(feasibility_check_->gravity_.data(), 3, key);
+  if (type == CheckType::kInput) {
+    // Unset constraints are marked with a flag, such that they differ from
+    // any value.
+    for (int constraint_type = kFMin; constraint_type <= kOmegaZDotMax;
+         ++constraint_type) {
+      double value = 0.0;
+      const bool is_set = feasibility_check_->input_constraints_.getConstraint(
+          constraint_type, &value);
+      key->push_back(is_set ? 1 : 0);
+      appendToKey(value, key);
+    }
+  } else {
+    for (const HalfPlane& half_plane :
+         feasibility_check_->half_plane_constraints_) {
+      appendToKey(half_plane.point.data(), 3, key);
+      appendToKey(half_plane.normal.data(), 3, key);
+    }
+  }
+}
+
+bool FeasibilityCache::lookup(const Key& key, int* result) {
+  CHECK_NOTNULL(result);
+  std::lock_guard<std::mutex> lock(mutex_);
+  const int* cached_result = cache_.find(key);
+  if (cached_result == nullptr) {
+    return false;
+  }
+  *result = *cached_result;
+  return true;
+}
+
+void FeasibilityCache::insert(const Key& key, int result) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  cache_.insert(key, result);
+}
+
+}  // namespace mav_trajectory_generation
@@ -26,6 +26,7 @@
 #include <Eigen/Core>
 
 #include <mav_trajectory_generation/motion_defines.h>
+#include <mav_trajectory_generation/timing.h>
 
 namespace mav_trajectory_generation {
 FeasibilityRecursive::Settings::Settings() : min_section_time_s_(0.05) {}
@@ -41,10 +42,18 @@ FeasibilityRecursive::FeasibilityRecursive(
 
 InputFeasibilityResult FeasibilityRecursive::checkInputFeasibility(
     const Segment& segment) const {
+  MAV_TRAJECTORY_GENERATION_SCOPED_TIMER("feasibility_recursive");
   // Check user input.
   if (!(segment.D() == 3 || segment.D() == 4)) {
     return InputFeasibilityResult::kInputIndeterminable;
   }
+  if (use_bernstein_pre_filter_) {
+    const InputFeasibilityResult pre_filter_result =
+        checkInputFeasibilityBernstein(segment);
+    if (pre_filter_result != InputFeasibilityResult::kInputIndeterminable) {
+      return pre_filter_result;
+    }
+  }
 
   // Find roots to determine single axis minima / maxima:
   Roots roots_acc, roots_jerk, roots_snap;
@@ -52,7 +61,8 @@ InputFeasibilityResult FeasibilityRecursive::checkInputFeasibility(
     roots_acc.resize(3);
     for (size_t i = 0; i < 3; i++) {
       if (!findRootsJenkinsTraub(
-              segment[i].getCoefficients(derivative_order::ACCELERATION),
+              segment.getDerivativeCoefficientsRef(
+                  i, derivative_order::ACCELERATION),
               &roots_acc[i])) {
         return InputFeasibilityResult::kInputIndeterminable;
       }
@@ -65,7 +75,7 @@ InputFeasibilityResult FeasibilityRecursive::checkInputFeasibility(
     roots_jerk.resize(3);
     for (size_t i = 0; i < 3; i++) {
       if (!findRootsJenkinsTraub(
-              segment[i].getCoefficients(derivative_order::JERK),
+              segment.getDerivativeCoefficientsRef(i, derivative_order::JERK),
               &roots_jerk[i])) {
         return InputFeasibilityResult::kInputIndeterminable;
       }
@@ -76,7 +86,7 @@ InputFeasibilityResult FeasibilityRecursive::checkInputFeasibility(
     roots_snap.resize(3);
     for (size_t i = 0; i < 3; i++) {
       if (!findRootsJenkinsTraub(
-              segment[i].getCoefficients(derivative_order::SNAP),
+              segment.getDerivativeCoefficientsRef(i, derivative_order::SNAP),
               &roots_snap[i])) {
         return InputFeasibilityResult::kInputIndeterminable;
       }
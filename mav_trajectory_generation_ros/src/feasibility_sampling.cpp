@@ -20,13 +20,21 @@
 
 #include "mav_trajectory_generation_ros/feasibility_sampling.h"
 
+#include <algorithm>
+#include <limits>
+
 #include <mav_msgs/conversions.h>
 #include <mav_msgs/eigen_mav_msgs.h>
+#include <mav_trajectory_generation/timing.h>
+#include <mav_trajectory_generation/vectorized_segment.h>
 
 namespace mav_trajectory_generation {
 const double kNumNanosecondsPerSecond = 1.0e9;
 
-FeasibilitySampling::Settings::Settings() : sampling_interval_s_(0.01) {}
+FeasibilitySampling::Settings::Settings()
+    : sampling_interval_s_(0.01),
+      adaptive_sampling_(false),
+      single_precision_(false) {}
 
 FeasibilitySampling::FeasibilitySampling(const Settings& settings)
     : FeasibilityBase(), settings_(settings) {}
@@ -39,94 +47,235 @@ FeasibilitySampling::FeasibilitySampling(
 
 InputFeasibilityResult FeasibilitySampling::checkInputFeasibility(
     const Segment& segment) const {
+  MAV_TRAJECTORY_GENERATION_SCOPED_TIMER("feasibility_sampling");
   // Check user input.
-  if (!(segment.D() == 3 || segment.D() == 4)) {
+  if (!(segment.D() == 3 || segment.D() == 4) ||
+      segment.N() > Polynomial::kMaxN) {
     return InputFeasibilityResult::kInputIndeterminable;
   }
+  const int kMaxD = 4;
+  const int kMaxDerivative = derivative_order::SNAP;
+  const int kMaxSampleSize = kMaxD * (kMaxDerivative + 1);
+  const size_t kChunkSize = 64;
+
+  // Only evaluate what the constraints need.
+  double f_min, f_max, v_max, omega_xy_max, omega_z_max, omega_z_dot_max;
+  const bool check_f_min =
+      input_constraints_.getConstraint(InputConstraintType::kFMin, &f_min);
+  const bool check_f_max =
+      input_constraints_.getConstraint(InputConstraintType::kFMax, &f_max);
+  const bool check_v_max =
+      input_constraints_.getConstraint(InputConstraintType::kVMax, &v_max);
+  const bool check_omega_xy = input_constraints_.getConstraint(
+      InputConstraintType::kOmegaXYMax, &omega_xy_max);
+  const bool check_omega_z = input_constraints_.getConstraint(
+      InputConstraintType::kOmegaZMax, &omega_z_max);
+  const bool check_omega_z_dot = input_constraints_.getConstraint(
+      InputConstraintType::kOmegaZDotMax, &omega_z_dot_max);
+  const bool check_thrust = check_f_min || check_f_max;
+  // The body yaw rate and acceleration depend on the full attitude. They are
+  // computed with mav_msgs from the whole flat state.
+  const bool check_yaw = check_omega_z || check_omega_z_dot;
+  const bool adaptive = settings_.getAdaptiveSampling();
+
+  int max_derivative = derivative_order::VELOCITY;
+  if (check_thrust) {
+    max_derivative = derivative_order::ACCELERATION;
+  }
+  if (check_omega_xy) {
+    max_derivative = derivative_order::JERK;
+  }
+  if (check_yaw) {
+    max_derivative = derivative_order::SNAP;
+  }
+  const int N = segment.N();
+  const int D = segment.D();
+  const int sample_size = D * (max_derivative + 1);
 
-  double t = 0.0;
-  while (t <= segment.getTime()) {
-    // Flat state:
-    Eigen::VectorXd position = segment.evaluate(t, derivative_order::POSITION);
-    Eigen::VectorXd velocity = segment.evaluate(t, derivative_order::VELOCITY);
-    Eigen::VectorXd acc = segment.evaluate(t, derivative_order::ACCELERATION);
-    Eigen::VectorXd jerk = segment.evaluate(t, derivative_order::JERK);
-    Eigen::VectorXd snap = segment.evaluate(t, derivative_order::SNAP);
-    int64_t time_from_start_ns =
-        static_cast<int64_t>(t * kNumNanosecondsPerSecond);
-    mav_msgs::EigenTrajectoryPoint flat_state;
-    flat_state.position_W = position.head<3>();
-    flat_state.velocity_W = velocity.head<3>();
-    flat_state.acceleration_W = acc.head<3>();
-    flat_state.jerk_W = jerk.head<3>();
-    flat_state.snap_W = snap.head<3>();
-    flat_state.time_from_start_ns = time_from_start_ns;
-    if (segment.D() == 4) {
-      flat_state.setFromYaw(position(3));
-      flat_state.setFromYawRate(velocity(3));
-      flat_state.setFromYawAcc(acc(3));
+  // Samples of the flat state, column-major D x (max_derivative + 1) blocks.
+  // In double precision they are evaluated in chunks with the vectorized
+  // kernel, such that an infeasible sample early in the segment ends the
+  // check early. The kernel storage is reused by every check of a thread.
+  thread_local VectorizedSegment vectorized_segment;
+  double samples[kChunkSize * kMaxSampleSize];
+  double times[kChunkSize];
+  size_t chunk_begin = 0;
+  size_t chunk_end = 0;
+
+  // In single precision the flat state is evaluated per sample. The powers
+  // are of the time relative to the segment midpoint.
+  const bool single_precision = settings_.getSinglePrecision();
+  const double t_offset = single_precision ? 0.5 * segment.getTime() : 0.0;
+  float coefficients_float[kMaxDerivative + 1][kMaxD][Polynomial::kMaxN];
+  if (single_precision) {
+    for (int d = 0; d < D; ++d) {
+      double coeffs[Polynomial::kMaxN];
+      const Eigen::VectorXd& unshifted = segment[d].getCoefficientsRef();
+      std::copy(unshifted.data(), unshifted.data() + N, coeffs);
+      Polynomial::shiftCoefficients(t_offset, N, coeffs);
+      for (int k = 0; k <= max_derivative && k < N; ++k) {
+        for (int j = k; j < N; ++j) {
+          coefficients_float[k][d][j] = static_cast<float>(
+              Polynomial::base_coefficients_(k, j) * coeffs[j]);
+        }
+      }
     }
+  } else {
+    vectorized_segment.setSegment(segment, max_derivative);
+  }
 
-    // Full state:
-    mav_msgs::EigenMavState state;
-    EigenMavStateFromEigenTrajectoryPoint(flat_state, &state);
+  const double dt = settings_.getSamplingIntervalS();
+  const size_t n_samples = static_cast<size_t>(segment.getTime() / dt) + 1;
+  // Adaptive steps mostly advance by one sample close to a limit, so a few
+  // lanes ahead are evaluated at once.
+  const size_t chunk_size =
+      adaptive ? static_cast<size_t>(VectorizedSegment::kNumLanes)
+               : kChunkSize;
+  auto evaluateFlatState = [&](size_t sample) -> const double* {
+    if (single_precision) {
+      const float tau = static_cast<float>(sample * dt - t_offset);
+      for (int k = 0; k <= max_derivative; ++k) {
+        for (int d = 0; d < D; ++d) {
+          float result = 0.0f;
+          for (int j = N - 1; j >= k; --j) {
+            result = result * tau + coefficients_float[k][d][j];
+          }
+          samples[k * D + d] = result;
+        }
+      }
+      return samples;
+    }
+    if (sample < chunk_begin || sample >= chunk_end) {
+      chunk_begin = sample;
+      chunk_end = std::min(sample + chunk_size, n_samples);
+      for (size_t i = chunk_begin; i < chunk_end; ++i) {
+        times[i - chunk_begin] = i * dt;
+      }
+      vectorized_segment.evaluate(times, chunk_end - chunk_begin, samples);
+    }
+    return samples + (sample - chunk_begin) * sample_size;
+  };
+
+  // Upper bounds on the magnitude of the derivatives over the whole segment,
+  // which bound the rate of change of the constrained quantities.
+  auto computeUpperBound = [&segment](int begin, int end, int derivative) {
+    double upper_sqr = 0.0;
+    for (int i = begin; i < end; ++i) {
+      double minimum, maximum;
+      segment[i].computeBernsteinBounds(0.0, segment.getTime(), derivative,
+                                        &minimum, &maximum);
+      upper_sqr += std::pow(std::max(std::abs(minimum), std::abs(maximum)), 2);
+    }
+    return std::sqrt(upper_sqr);
+  };
+  double a_upper = 0.0, j_upper = 0.0, s_upper = 0.0;
+  if (adaptive) {
+    a_upper = computeUpperBound(0, 3, derivative_order::ACCELERATION);
+    j_upper = computeUpperBound(0, 3, derivative_order::JERK);
+    s_upper = computeUpperBound(0, 3, derivative_order::SNAP);
+  }
+
+  size_t sample = 0;
+  while (sample < n_samples) {
+    const double t = sample * dt;
+    const double* flat = evaluateFlatState(sample);
+    auto flatVector = [flat, D](int derivative) {
+      return Eigen::Map<const Eigen::Vector3d>(flat + derivative * D);
+    };
+    // Time until the first constraint can be violated at the earliest.
+    double safe_time = std::numeric_limits<double>::max();
 
-    // Feasibility check:
     // Thrust.
-    if (input_constraints_.hasConstraint(InputConstraintType::kFMin) ||
-        input_constraints_.hasConstraint(InputConstraintType::kFMax)) {
-      const double thrust = state.acceleration_B.norm();
-
-      double f_min;
-      if (input_constraints_.getConstraint(InputConstraintType::kFMin,
-                                           &f_min) &&
-          thrust < f_min) {
+    Eigen::Vector3d thrust_W = Eigen::Vector3d::Zero();
+    double thrust = 0.0;
+    if (check_thrust || check_omega_xy) {
+      thrust_W = flatVector(derivative_order::ACCELERATION) + gravity_;
+      thrust = thrust_W.norm();
+    }
+    if (check_f_min) {
+      if (thrust < f_min) {
         return InputFeasibilityResult::kInputInfeasibleThrustLow;
       }
-
-      double f_max;
-      if (input_constraints_.getConstraint(InputConstraintType::kFMax,
-                                           &f_max) &&
-          thrust > f_max) {
+      safe_time = std::min(safe_time, (thrust - f_min) / j_upper);
+    }
+    if (check_f_max) {
+      if (thrust > f_max) {
         return InputFeasibilityResult::kInputInfeasibleThrustHigh;
       }
+      safe_time = std::min(safe_time, (f_max - thrust) / j_upper);
     }
 
     // Velocity.
-    double v_max;
-    if (input_constraints_.getConstraint(InputConstraintType::kVMax, &v_max) &&
-        state.velocity_W.norm() > v_max) {
-      return InputFeasibilityResult::kInputInfeasibleVelocity;
+    if (check_v_max) {
+      const double velocity = flatVector(derivative_order::VELOCITY).norm();
+      if (velocity > v_max) {
+        return InputFeasibilityResult::kInputInfeasibleVelocity;
+      }
+      safe_time = std::min(safe_time, (v_max - velocity) / a_upper);
     }
 
     // Evaluate roll/pitch rate and yaw rate assuming independency (rigid body
     // model).
-    // Roll/Pitch rates.
-    double omega_xy_max;
-    if (input_constraints_.getConstraint(InputConstraintType::kOmegaXYMax,
-                                         &omega_xy_max) &&
-        state.angular_velocity_B.head<2>().norm() > omega_xy_max) {
-      return InputFeasibilityResult::kInputInfeasibleRollPitchRates;
+    // Roll/Pitch rates, |omega_xy| = |jerk perpendicular to thrust| / thrust,
+    // which does not depend on the yaw.
+    if (check_omega_xy) {
+      const Eigen::Vector3d jerk = flatVector(derivative_order::JERK);
+      const Eigen::Vector3d z_B = thrust_W / thrust;
+      const double omega_xy = (jerk - z_B.dot(jerk) * z_B).norm() / thrust;
+      if (omega_xy > omega_xy_max) {
+        return InputFeasibilityResult::kInputInfeasibleRollPitchRates;
+      }
+      // Within tau, |omega_xy| <= (|jerk| + s_upper * tau) /
+      // (thrust - j_upper * tau).
+      safe_time = std::min(
+          safe_time, (omega_xy_max * thrust - jerk.norm()) /
+                         (s_upper + omega_xy_max * j_upper));
     }
 
-    // Yaw rates.
-    double omega_z_max;
-    if (input_constraints_.getConstraint(InputConstraintType::kOmegaZMax,
-                                         &omega_z_max) &&
-        std::fabs(state.angular_velocity_B(2)) > omega_z_max) {
-      return InputFeasibilityResult::kInputInfeasibleYawRates;
-    }
+    if (check_yaw) {
+      // Full state of the flat state.
+      mav_msgs::EigenTrajectoryPoint flat_state;
+      flat_state.position_W = flatVector(derivative_order::POSITION);
+      flat_state.velocity_W = flatVector(derivative_order::VELOCITY);
+      flat_state.acceleration_W = flatVector(derivative_order::ACCELERATION);
+      flat_state.jerk_W = flatVector(derivative_order::JERK);
+      flat_state.snap_W = flatVector(derivative_order::SNAP);
+      flat_state.time_from_start_ns =
+          static_cast<int64_t>(t * kNumNanosecondsPerSecond);
+      if (D == 4) {
+        flat_state.setFromYaw(flat[derivative_order::POSITION * D + 3]);
+        flat_state.setFromYawRate(flat[derivative_order::VELOCITY * D + 3]);
+        flat_state.setFromYawAcc(flat[derivative_order::ACCELERATION * D + 3]);
+      }
+      mav_msgs::EigenMavState state;
+      EigenMavStateFromEigenTrajectoryPoint(flat_state, &state);
+
+      // Yaw rates.
+      if (check_omega_z &&
+          std::fabs(state.angular_velocity_B(2)) > omega_z_max) {
+        return InputFeasibilityResult::kInputInfeasibleYawRates;
+      }
 
-    // Yaw acceleration.
-    double omega_z_dot_max;
-    if (input_constraints_.getConstraint(InputConstraintType::kOmegaZDotMax,
-                                         &omega_z_dot_max) &&
-        std::fabs(state.angular_acceleration_B(2)) > omega_z_dot_max) {
-      return InputFeasibilityResult::kInputInfeasibleYawAcc;
+      // Yaw acceleration.
+      if (check_omega_z_dot &&
+          std::fabs(state.angular_acceleration_B(2)) > omega_z_dot_max) {
+        return InputFeasibilityResult::kInputInfeasibleYawAcc;
+      }
+      // There are no cheap bounds on the rate of change of the body rates.
+      safe_time = 0.0;
     }
 
-    // Increment time.
-    t += settings_.getSamplingIntervalS();
+    // Skip the samples that cannot violate any constraint.
+    size_t step = 1;
+    if (adaptive && safe_time > dt) {
+      step = std::max<size_t>(
+          1, static_cast<size_t>(std::min(safe_time, segment.getTime()) / dt));
+    }
+    if (sample + 1 < n_samples) {
+      sample = std::min(sample + step, n_samples - 1);
+    } else {
+      ++sample;
+    }
   }
   return InputFeasibilityResult::kInputFeasible;
 }
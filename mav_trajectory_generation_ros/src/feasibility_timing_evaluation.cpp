@@ -0,0 +1,198 @@
+/*
+ * Copyright (c) 2016, Markus Achtelik, ASL, ETH Zurich, Switzerland
+ * Copyright (c) 2016, Michael Burri, ASL, ETH Zurich, Switzerland
+ * Copyright (c) 2016, Helen Oleynikova, ASL, ETH Zurich, Switzerland
+ * Copyright (c) 2016, Rik Bähnemann, ASL, ETH Zurich, Switzerland
+ * Copyright (c) 2016, Marija Popovic, ASL, ETH Zurich, Switzerland
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+// Compares the input feasibility checks on random trajectories for different
+// trajectory sizes, polynomial orders, constraint tightness and sampling
+// intervals. Reports the latency percentiles per trajectory check, the
+// throughput in segments per second and the heap allocations per check.
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <iostream>
+#include <new>
+#include <string>
+#include <vector>
+
+#include <mav_msgs/default_values.h>
+#include <mav_trajectory_generation/polynomial_optimization_linear.h>
+#include <mav_trajectory_generation/vertex.h>
+
+#include "mav_trajectory_generation_ros/feasibility_analytic.h"
+#include "mav_trajectory_generation_ros/feasibility_recursive.h"
+#include "mav_trajectory_generation_ros/feasibility_sampling.h"
+
+// Counts all heap allocations of this binary.
+static std::atomic<size_t> num_allocations(0);
+
+void* operator new(size_t size) {
+  num_allocations++;
+  void* pointer = std::malloc(size);
+  if (pointer == nullptr) {
+    throw std::bad_alloc();
+  }
+  return pointer;
+}
+
+void operator delete(void* pointer) noexcept { std::free(pointer); }
+
+namespace mav_trajectory_generation {
+
+const int kD = 4;
+const int kNumTrajectories = 50;
+
+struct Result {
+  double p50_us;
+  double p90_us;
+  double p99_us;
+  double segments_per_s;
+  double allocations_per_check;
+  double feasible_ratio;
+};
+
+template <int _N>
+std::vector<Trajectory> createRandomTrajectories(int n_segments) {
+  const Eigen::Vector4d kMinPos(-5.0, -5.0, -5.0, -M_PI);
+  const Eigen::Vector4d kMaxPos = -kMinPos;
+  // Highest derivative that can be optimized with _N coefficients.
+  const int derivative_to_optimize =
+      std::min<int>(derivative_order::SNAP, _N / 2 - 1);
+  std::vector<Trajectory> trajectories(kNumTrajectories);
+  for (int i = 0; i < kNumTrajectories; i++) {
+    Vertex::Vector vertices = createRandomVertices(
+        derivative_to_optimize, n_segments, kMinPos, kMaxPos, i);
+    std::vector<double> segment_times =
+        estimateSegmentTimes(vertices, 2.0, 2.0);
+    PolynomialOptimization<_N> opt(kD);
+    opt.setupFromVertices(vertices, segment_times, derivative_to_optimize);
+    opt.solveLinear();
+    opt.getTrajectory(&trajectories[i]);
+  }
+  return trajectories;
+}
+
+// scale < 1 tightens the default constraints, scale > 1 loosens them.
+InputConstraints createInputConstraints(double scale) {
+  InputConstraints input_constraints;
+  input_constraints.addConstraint(
+      InputConstraintType::kFMin,
+      mav_msgs::kGravity * std::max(0.0, 1.0 - 0.5 * scale));
+  input_constraints.addConstraint(InputConstraintType::kFMax,
+                                  mav_msgs::kGravity * (1.0 + 0.5 * scale));
+  input_constraints.addConstraint(InputConstraintType::kVMax, 3.0 * scale);
+  input_constraints.addConstraint(InputConstraintType::kOmegaXYMax,
+                                  M_PI / 2.0 * scale);
+  input_constraints.addConstraint(InputConstraintType::kOmegaZMax,
+                                  M_PI / 2.0 * scale);
+  input_constraints.addConstraint(InputConstraintType::kOmegaZDotMax,
+                                  2.0 * M_PI * scale);
+  return input_constraints;
+}
+
+Result evaluate(const FeasibilityBase& feasibility_check,
+                const std::vector<Trajectory>& trajectories) {
+  std::vector<double> durations_us;
+  durations_us.reserve(trajectories.size());
+  size_t n_segments = 0;
+  size_t n_feasible = 0;
+  double total_s = 0.0;
+  const size_t allocations_start = num_allocations;
+  for (const Trajectory& trajectory : trajectories) {
+    const auto start = std::chrono::steady_clock::now();
+    const InputFeasibilityResult result =
+        feasibility_check.checkInputFeasibility(trajectory);
+    const auto end = std::chrono::steady_clock::now();
+    const double duration_s = std::chrono::duration<double>(end - start).count();
+    durations_us.push_back(duration_s * 1.0e6);
+    total_s += duration_s;
+    n_segments += trajectory.K();
+    n_feasible += result == InputFeasibilityResult::kInputFeasible;
+  }
+  const size_t allocations = num_allocations - allocations_start;
+  std::sort(durations_us.begin(), durations_us.end());
+  auto percentile = [&durations_us](double p) {
+    return durations_us[std::min(durations_us.size() - 1,
+                                 static_cast<size_t>(p * durations_us.size()))];
+  };
+  Result result;
+  result.p50_us = percentile(0.5);
+  result.p90_us = percentile(0.9);
+  result.p99_us = percentile(0.99);
+  result.segments_per_s = n_segments / total_s;
+  result.allocations_per_check =
+      static_cast<double>(allocations) / trajectories.size();
+  result.feasible_ratio = static_cast<double>(n_feasible) / trajectories.size();
+  return result;
+}
+
+void printResult(const std::string& name, int n_segments, int N, double scale,
+                 double interval, const Result& result) {
+  std::printf(
+      "%-10s %5d %3d %6.2f %8.3f %10.1f %10.1f %10.1f %12.0f %10.1f %8.2f\n",
+      name.c_str(), n_segments, N, scale, interval, result.p50_us,
+      result.p90_us, result.p99_us, result.segments_per_s,
+      result.allocations_per_check, result.feasible_ratio);
+}
+
+template <int _N>
+void evaluateOrder() {
+  const int kNumSegments[] = {2, 10, 100};
+  const double kScales[] = {0.5, 1.0, 2.0};
+  const double kIntervals[] = {0.01, 0.05, 0.1};
+  for (int n_segments : kNumSegments) {
+    const std::vector<Trajectory> trajectories =
+        createRandomTrajectories<_N>(n_segments);
+    for (double scale : kScales) {
+      const InputConstraints input_constraints = createInputConstraints(scale);
+      for (double interval : kIntervals) {
+        FeasibilitySampling sampling(input_constraints);
+        sampling.settings_.setSamplingIntervalS(interval);
+        printResult("sampling", n_segments, _N, scale, interval,
+                    evaluate(sampling, trajectories));
+
+        FeasibilityRecursive recursive(input_constraints);
+        recursive.settings_.setMinSectionTimeS(interval);
+        printResult("recursive", n_segments, _N, scale, interval,
+                    evaluate(recursive, trajectories));
+
+        FeasibilityAnalytic analytic(input_constraints);
+        analytic.settings_.setMinSectionTimeS(interval);
+        printResult("analytic", n_segments, _N, scale, interval,
+                    evaluate(analytic, trajectories));
+      }
+    }
+  }
+}
+
+}  // namespace mav_trajectory_generation
+
+int main(int argc, char** argv) {
+  google::InitGoogleLogging(argv[0]);
+  // Interval is the sampling interval or the minimum section time.
+  std::printf("%-10s %5s %3s %6s %8s %10s %10s %10s %12s %10s %8s\n", "check",
+              "K", "N", "scale", "interval", "p50[us]", "p90[us]", "p99[us]",
+              "segments/s", "allocs", "feasible");
+  mav_trajectory_generation::evaluateOrder<8>();
+  mav_trajectory_generation::evaluateOrder<10>();
+  mav_trajectory_generation::evaluateOrder<12>();
+  return 0;
+}
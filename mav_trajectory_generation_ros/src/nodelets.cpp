@@ -0,0 +1,61 @@
+/*
+ * Copyright (c) 2017, Markus Achtelik, ASL, ETH Zurich, Switzerland
+ * Copyright (c) 2017, Michael Burri, ASL, ETH Zurich, Switzerland
+ * Copyright (c) 2017, Helen Oleynikova, ASL, ETH Zurich, Switzerland
+ * Copyright (c) 2017, Rik Bähnemann, ASL, ETH Zurich, Switzerland
+ * Copyright (c) 2017, Marija Popovic, ASL, ETH Zurich, Switzerland
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <memory>
+
+#include <nodelet/nodelet.h>
+#include <pluginlib/class_list_macros.h>
+
+#include <mav_trajectory_generation_ros/trajectory_sampler_node.h>
+#include <mav_trajectory_generation_ros/waypoint_node.h>
+
+namespace mav_trajectory_generation_ros {
+
+// Nodelet versions of the nodes. Nodelets in the same manager exchange
+// messages published as shared pointers without serialization, e.g. the
+// path segments from the waypoint nodelet to the sampler and the commands
+// of the sampler to a controller.
+class TrajectorySamplerNodelet : public nodelet::Nodelet {
+ private:
+  void onInit() override {
+    node_.reset(
+        new TrajectorySamplerNode(getNodeHandle(), getPrivateNodeHandle()));
+    NODELET_INFO("Initialized trajectory sampler nodelet.");
+  }
+
+  std::unique_ptr<TrajectorySamplerNode> node_;
+};
+
+class WaypointNodelet : public nodelet::Nodelet {
+ private:
+  void onInit() override {
+    node_.reset(new WaypointNode(getNodeHandle(), getPrivateNodeHandle()));
+    NODELET_INFO("Initialized waypoint nodelet.");
+  }
+
+  std::unique_ptr<WaypointNode> node_;
+};
+
+}  // namespace mav_trajectory_generation_ros
+
+PLUGINLIB_EXPORT_CLASS(mav_trajectory_generation_ros::TrajectorySamplerNodelet,
+                       nodelet::Nodelet)
+PLUGINLIB_EXPORT_CLASS(mav_trajectory_generation_ros::WaypointNodelet,
+                       nodelet::Nodelet)
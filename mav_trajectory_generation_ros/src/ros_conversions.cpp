@@ -20,74 +20,94 @@
 
 #include "mav_trajectory_generation_ros/ros_conversions.h"
 
+#include <utility>
+
 namespace mav_trajectory_generation {
 
+namespace {
+// Copies the coefficients of a polynomial into a message array in one block.
+void coefficientsToMsg(const Polynomial& polynomial,
+                       std::vector<double>* coefficients) {
+  const Eigen::VectorXd& c = polynomial.getCoefficientsRef();
+  coefficients->assign(c.data(), c.data() + c.size());
+}
+}  // namespace
+
 bool trajectoryToPolynomialTrajectoryMsg(
     const Trajectory& trajectory, planning_msgs::PolynomialTrajectory4D* msg) {
   CHECK_NOTNULL(msg);
   msg->segments.clear();
 
-  bool success = true;
-
-  Segment::Vector segments;
-  trajectory.getSegments(&segments);
-
-  msg->segments.reserve(segments.size());
+  // Segments are written in place, without an intermediate copy of the
+  // segments or Eigen representation of the message.
+  const Segment::Vector& segments = trajectory.segments();
   for (size_t i = 0; i < segments.size(); ++i) {
-    const Segment& segment = segments[i];
-
-    if (segment.D() < 3) {
+    if (segments[i].D() < 3) {
       LOG(ERROR) << "Dimension of position segment has to be 3 or 4, but is "
-                 << segment.D();
-      success = false;
-      break;
+                 << segments[i].D();
+      return false;
     }
+  }
 
-    planning_msgs::PolynomialSegment4D segment_msg;
-    planning_msgs::EigenPolynomialSegment eigen_segment;
-    eigen_segment.x = segment[0].getCoefficients();
-    eigen_segment.y = segment[1].getCoefficients();
-    eigen_segment.z = segment[2].getCoefficients();
+  msg->segments.resize(segments.size());
+  for (size_t i = 0; i < segments.size(); ++i) {
+    const Segment& segment = segments[i];
+    planning_msgs::PolynomialSegment4D& segment_msg = msg->segments[i];
+    coefficientsToMsg(segment[0], &segment_msg.x);
+    coefficientsToMsg(segment[1], &segment_msg.y);
+    coefficientsToMsg(segment[2], &segment_msg.z);
     if (segment.D() > 3) {
-      eigen_segment.yaw = segment[3].getCoefficients();
+      coefficientsToMsg(segment[3], &segment_msg.yaw);
     }
-    eigen_segment.num_coeffs = segment.N();
-    eigen_segment.segment_time_ns = segment.getTimeNSec();
-
-    planning_msgs::polynomialSegmentMsgFromEigen(eigen_segment, &segment_msg);
-    msg->segments.push_back(segment_msg);
+    segment_msg.num_coeffs = segment.N();
+    segment_msg.segment_time.fromNSec(segment.getTimeNSec());
   }
-
-  if (!success) msg->segments.clear();
-  return success;
+  return true;
 }
 
 // Converts a ROS polynomial trajectory msg into a Trajectory.
 bool polynomialTrajectoryMsgToTrajectory(
     const planning_msgs::PolynomialTrajectory4D& msg, Trajectory* trajectory) {
-  planning_msgs::EigenPolynomialTrajectory eigen_trajectory_msg;
-  planning_msgs::eigenPolynomialTrajectoryFromMsg(msg, &eigen_trajectory_msg);
-  // TODO(helenol): maybe add more error checking here.
+  CHECK_NOTNULL(trajectory);
+  // The coefficients are copied in one block per polynomial straight from the
+  // message arrays into segments constructed in place, which are then moved
+  // into the trajectory.
   Segment::Vector segment_vector;
-  for (const planning_msgs::EigenPolynomialSegment& msg_segment :
-       eigen_trajectory_msg) {
+  segment_vector.reserve(msg.segments.size());
+  for (const planning_msgs::PolynomialSegment4D& msg_segment : msg.segments) {
+    const int N = msg_segment.x.size();
     int D = 3;
     if (msg_segment.yaw.size() > 0) {
       D = 4;
     }
+    if (N == 0 || msg_segment.y.size() != msg_segment.x.size() ||
+        msg_segment.z.size() != msg_segment.x.size() ||
+        (D > 3 && msg_segment.yaw.size() != msg_segment.x.size())) {
+      LOG(ERROR) << "Segment " << segment_vector.size()
+                 << " of the message has an invalid number of coefficients.";
+      return false;
+    }
 
-    Segment segment(msg_segment.x.size(), D);
-    segment[0].setCoefficients(msg_segment.x);
-    segment[1].setCoefficients(msg_segment.y);
-    segment[2].setCoefficients(msg_segment.z);
+    segment_vector.emplace_back(N, D);
+    Segment& segment = segment_vector.back();
+    segment[0].setCoefficients(
+        Eigen::Map<const Eigen::VectorXd>(msg_segment.x.data(), N));
+    segment[1].setCoefficients(
+        Eigen::Map<const Eigen::VectorXd>(msg_segment.y.data(), N));
+    segment[2].setCoefficients(
+        Eigen::Map<const Eigen::VectorXd>(msg_segment.z.data(), N));
     if (D > 3) {
-      segment[3].setCoefficients(msg_segment.yaw);
+      segment[3].setCoefficients(
+          Eigen::Map<const Eigen::VectorXd>(msg_segment.yaw.data(), N));
     }
-    segment.setTimeNSec(msg_segment.segment_time_ns);
-    segment_vector.push_back(segment);
+    segment.setTimeNSec(msg_segment.segment_time.toNSec());
   }
 
-  trajectory->setSegments(segment_vector);
+  if (segment_vector.empty()) {
+    trajectory->clear();
+    return true;
+  }
+  trajectory->setSegments(std::move(segment_vector));
   return true;
 }
 
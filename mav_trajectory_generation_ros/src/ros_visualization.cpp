@@ -18,11 +18,14 @@
  * limitations under the License.
  */
 
+#include <algorithm>
+
 #include <eigen_conversions/eigen_msg.h>
 #include <mav_msgs/conversions.h>
 #include <mav_visualization/helpers.h>
 
 #include "mav_trajectory_generation_ros/ros_visualization.h"
+#include "mav_trajectory_generation/arc_length_table.h"
 #include "mav_trajectory_generation/trajectory_sampling.h"
 
 namespace mav_trajectory_generation {
@@ -58,6 +61,66 @@ void setMarkerProperties(const std_msgs::Header& header, double life_time,
   }
 }
 
+// Appends the pose, acceleration, velocity and additional marker at the
+// state.
+void appendMavStateMarkers(
+    const mav_msgs::EigenTrajectoryPoint& flat_state,
+    const mav_visualization::MarkerGroup& additional_marker,
+    visualization_msgs::MarkerArray* marker_array) {
+  mav_msgs::EigenMavState mav_state;
+  mav_msgs::EigenMavStateFromEigenTrajectoryPoint(flat_state, &mav_state);
+
+  visualization_msgs::MarkerArray axes_arrows;
+  mav_visualization::drawAxesArrows(mav_state.position_W,
+                                    mav_state.orientation_W_B, 0.3, 0.3,
+                                    &axes_arrows);
+  appendMarkers(axes_arrows, "pose", marker_array);
+
+  visualization_msgs::Marker arrow;
+  mav_visualization::drawArrowPoints(
+      flat_state.position_W, flat_state.position_W + flat_state.acceleration_W,
+      mav_visualization::Color((190.0 / 255.0), (81.0 / 255.0),
+                               (80.0 / 255.0)),
+      0.3, &arrow);
+  arrow.ns = positionDerivativeToString(derivative_order::ACCELERATION);
+  marker_array->markers.push_back(arrow);
+
+  mav_visualization::drawArrowPoints(
+      flat_state.position_W, flat_state.position_W + flat_state.velocity_W,
+      mav_visualization::Color((80.0 / 255.0), (172.0 / 255.0),
+                               (196.0 / 255.0)),
+      0.3, &arrow);
+  arrow.ns = positionDerivativeToString(derivative_order::VELOCITY);
+  marker_array->markers.push_back(arrow);
+
+  mav_visualization::MarkerGroup tmp_marker(additional_marker);
+  tmp_marker.transform(mav_state.position_W, mav_state.orientation_W_B);
+  tmp_marker.getMarkers(marker_array->markers, 1.0, true);
+}
+
+// Appends the path through the states and sets the header of all markers.
+void appendPathAndSetProperties(
+    const mav_msgs::EigenTrajectoryPoint::Vector& flat_states,
+    const std::string& frame_id,
+    visualization_msgs::MarkerArray* marker_array) {
+  visualization_msgs::Marker line_strip;
+  line_strip.type = visualization_msgs::Marker::LINE_STRIP;
+  line_strip.color = mav_visualization::Color::Orange();
+  line_strip.scale.x = 0.01;
+  line_strip.ns = "path";
+  line_strip.points.resize(flat_states.size());
+  for (size_t i = 0; i < flat_states.size(); ++i) {
+    tf::pointEigenToMsg(flat_states[i].position_W, line_strip.points[i]);
+  }
+  marker_array->markers.push_back(line_strip);
+
+  std_msgs::Header header;
+  header.frame_id = frame_id;
+  header.stamp = ros::Time::now();
+  setMarkerProperties(header, 0.0, visualization_msgs::Marker::ADD,
+                      marker_array);
+}
+
 }  // end namespace internal
 
 static constexpr double kDefaultSamplingTime = 0.1;
@@ -85,6 +148,9 @@ void drawMavTrajectoryWithMavMarker(
     const Trajectory& trajectory, double distance, const std::string& frame_id,
     const mav_visualization::MarkerGroup& additional_marker,
     visualization_msgs::MarkerArray* marker_array) {
+  CHECK_NOTNULL(marker_array);
+  marker_array->markers.clear();
+
   // Sample the trajectory.
   mav_msgs::EigenTrajectoryPoint::Vector flat_states;
 
@@ -93,9 +159,21 @@ void drawMavTrajectoryWithMavMarker(
   if (!success) {
     return;
   }
-  // Draw the trajectory.
-  drawMavSampledTrajectoryWithMavMarker(flat_states, distance, frame_id,
-                                        additional_marker, marker_array);
+
+  // Markers at equal distances along the path, from the arc length table
+  // instead of accumulating distances between the samples.
+  if (distance > 0.0) {
+    std::vector<double> marker_times;
+    trajectory.getArcLengthTable()->sampleByArcLength(distance, &marker_times);
+    for (double t : marker_times) {
+      mav_msgs::EigenTrajectoryPoint flat_state;
+      if (sampleTrajectoryAtTime(trajectory, t, &flat_state)) {
+        internal::appendMavStateMarkers(flat_state, additional_marker,
+                                        marker_array);
+      }
+    }
+  }
+  internal::appendPathAndSetProperties(flat_states, frame_id, marker_array);
 }
 
 void drawMavSampledTrajectoryWithMavMarker(
@@ -106,63 +184,18 @@ void drawMavSampledTrajectoryWithMavMarker(
   CHECK_NOTNULL(marker_array);
   marker_array->markers.clear();
 
-  visualization_msgs::Marker line_strip;
-  line_strip.type = visualization_msgs::Marker::LINE_STRIP;
-  line_strip.color = mav_visualization::Color::Orange();
-  line_strip.scale.x = 0.01;
-  line_strip.ns = "path";
-
   double accumulated_distance = 0.0;
   Eigen::Vector3d last_position = Eigen::Vector3d::Zero();
-  for (size_t i = 0; i < flat_states.size(); ++i) {
-    const mav_msgs::EigenTrajectoryPoint& flat_state = flat_states[i];
-
+  for (const mav_msgs::EigenTrajectoryPoint& flat_state : flat_states) {
     accumulated_distance += (last_position - flat_state.position_W).norm();
     if (accumulated_distance > distance) {
       accumulated_distance = 0.0;
-      mav_msgs::EigenMavState mav_state;
-      mav_msgs::EigenMavStateFromEigenTrajectoryPoint(flat_state, &mav_state);
-
-      visualization_msgs::MarkerArray axes_arrows;
-      mav_visualization::drawAxesArrows(mav_state.position_W,
-                                        mav_state.orientation_W_B, 0.3, 0.3,
-                                        &axes_arrows);
-      internal::appendMarkers(axes_arrows, "pose", marker_array);
-
-      visualization_msgs::Marker arrow;
-      mav_visualization::drawArrowPoints(
-          flat_state.position_W,
-          flat_state.position_W + flat_state.acceleration_W,
-          mav_visualization::Color((190.0 / 255.0), (81.0 / 255.0),
-                                   (80.0 / 255.0)),
-          0.3, &arrow);
-      arrow.ns = positionDerivativeToString(derivative_order::ACCELERATION);
-      marker_array->markers.push_back(arrow);
-
-      mav_visualization::drawArrowPoints(
-          flat_state.position_W, flat_state.position_W + flat_state.velocity_W,
-          mav_visualization::Color((80.0 / 255.0), (172.0 / 255.0),
-                                   (196.0 / 255.0)),
-          0.3, &arrow);
-      arrow.ns = positionDerivativeToString(derivative_order::VELOCITY);
-      marker_array->markers.push_back(arrow);
-
-      mav_visualization::MarkerGroup tmp_marker(additional_marker);
-      tmp_marker.transform(mav_state.position_W, mav_state.orientation_W_B);
-      tmp_marker.getMarkers(marker_array->markers, 1.0, true);
+      internal::appendMavStateMarkers(flat_state, additional_marker,
+                                      marker_array);
     }
     last_position = flat_state.position_W;
-    geometry_msgs::Point last_position_msg;
-    tf::pointEigenToMsg(last_position, last_position_msg);
-    line_strip.points.push_back(last_position_msg);
   }
-  marker_array->markers.push_back(line_strip);
-
-  std_msgs::Header header;
-  header.frame_id = frame_id;
-  header.stamp = ros::Time::now();
-  internal::setMarkerProperties(header, 0.0, visualization_msgs::Marker::ADD,
-                                marker_array);
+  internal::appendPathAndSetProperties(flat_states, frame_id, marker_array);
 }
 
 void drawVertices(const Vertex::Vector& vertices, const std::string& frame_id,
@@ -200,4 +233,205 @@ void drawVertices(const Vertex::Vector& vertices, const std::string& frame_id,
                                 marker_array);
 }
 
+constexpr int TrajectoryVisualizer::kMaxMarkersPerSegment;
+
+TrajectoryVisualizer::TrajectoryVisualizer(const std::string& frame_id,
+                                           double distance, double tolerance)
+    : frame_id_(frame_id),
+      distance_(distance),
+      tolerance_(tolerance),
+      has_viewpoint_(false),
+      viewpoint_(Eigen::Vector3d::Zero()),
+      angular_tolerance_(0.0) {
+  CHECK_GT(tolerance, 0.0);
+}
+
+void TrajectoryVisualizer::setViewpoint(const Eigen::Vector3d& viewpoint,
+                                        double angular_tolerance) {
+  CHECK_GT(angular_tolerance, 0.0);
+  has_viewpoint_ = true;
+  viewpoint_ = viewpoint;
+  angular_tolerance_ = angular_tolerance;
+}
+
+void TrajectoryVisualizer::update(
+    const Trajectory& trajectory,
+    visualization_msgs::MarkerArray* marker_array) {
+  CHECK_NOTNULL(marker_array);
+  marker_array->markers.clear();
+  if (trajectory.sharesSegmentsWith(trajectory_)) {
+    return;
+  }
+  if (!trajectory.empty() && trajectory.D() < 3) {
+    LOG(ERROR) << "Dimension has to be 3 or 4, but is " << trajectory.D();
+    return;
+  }
+
+  std_msgs::Header header;
+  header.frame_id = frame_id_;
+  header.stamp = ros::Time::now();
+  const Segment::Vector& segments = trajectory.segments();
+  const size_t n_segments = segments.size();
+  for (size_t i = 0; i < std::max(n_segments, segments_.size()); ++i) {
+    if (i >= segments_.size()) {
+      segments_.push_back(SegmentMarkers(segments[i]));
+    } else if (i < n_segments) {
+      const Segment& previous = segments_[i].segment;
+      if (previous.N() == segments[i].N() && previous == segments[i]) {
+        continue;
+      }
+      segments_[i].segment = segments[i];
+    }
+
+    // Markers that are not overwritten by a marker of the same namespace and
+    // id are deleted.
+    std::vector<visualization_msgs::Marker>& markers = segments_[i].markers;
+    previous_namespaces_.resize(markers.size());
+    for (size_t k = 0; k < markers.size(); ++k) {
+      previous_namespaces_[k] = markers[k].ns;
+    }
+    const size_t n_previous = markers.size();
+    if (i < n_segments) {
+      drawSegment(segments[i], i, header, &markers);
+    } else {
+      markers.clear();
+    }
+    for (size_t k = 0; k < n_previous; ++k) {
+      if (k < markers.size() && markers[k].ns == previous_namespaces_[k]) {
+        continue;
+      }
+      visualization_msgs::Marker deletion;
+      deletion.header = header;
+      deletion.ns = previous_namespaces_[k];
+      deletion.id = i * kMaxMarkersPerSegment + k;
+      deletion.action = visualization_msgs::Marker::DELETE;
+      marker_array->markers.push_back(deletion);
+    }
+    marker_array->markers.insert(marker_array->markers.end(), markers.begin(),
+                                 markers.end());
+  }
+  segments_.erase(segments_.begin() + n_segments, segments_.end());
+  trajectory_ = trajectory;
+}
+
+void TrajectoryVisualizer::getAllMarkers(
+    visualization_msgs::MarkerArray* marker_array) const {
+  CHECK_NOTNULL(marker_array);
+  marker_array->markers.clear();
+  for (const SegmentMarkers& segment_markers : segments_) {
+    marker_array->markers.insert(marker_array->markers.end(),
+                                 segment_markers.markers.begin(),
+                                 segment_markers.markers.end());
+  }
+}
+
+void TrajectoryVisualizer::clear(
+    visualization_msgs::MarkerArray* marker_array) {
+  update(Trajectory(), marker_array);
+}
+
+void TrajectoryVisualizer::drawSegment(
+    const Segment& segment, int segment_idx, const std_msgs::Header& header,
+    std::vector<visualization_msgs::Marker>* markers) const {
+  // Uniform intervals before subdividing, such that curves whose midpoint
+  // lies on the chord are not missed.
+  constexpr int kMinIntervals = 4;
+  const double segment_time = segment.getTime();
+  times_.assign(1, 0.0);
+  points_.assign(1, segment.evaluate(0.0).head<3>());
+  for (int i = 1; i <= kMinIntervals; ++i) {
+    const double t_start = times_.back();
+    const Eigen::Vector3d p_start = points_.back();
+    const double t_end = segment_time * i / kMinIntervals;
+    appendPathPoints(segment, t_start, p_start, t_end,
+                     segment.evaluate(t_end).head<3>(), 0, &times_,
+                     &points_);
+  }
+
+  // Keeps the memory of the markers of the last draw.
+  markers->resize(1);
+  visualization_msgs::Marker& line_strip = markers->front();
+  line_strip = visualization_msgs::Marker();
+  line_strip.type = visualization_msgs::Marker::LINE_STRIP;
+  line_strip.color = mav_visualization::Color::Orange();
+  line_strip.scale.x = 0.01;
+  line_strip.ns = "path";
+  line_strip.points.resize(points_.size());
+  for (size_t i = 0; i < points_.size(); ++i) {
+    tf::pointEigenToMsg(points_[i], line_strip.points[i]);
+  }
+
+  // State markers at multiples of distance along the drawn path, which is
+  // within the tolerance of the trajectory.
+  if (distance_ > 0.0) {
+    visualization_msgs::MarkerArray state_markers;
+    double arc_length = 0.0;
+    double next_marker = 0.0;
+    for (size_t i = 0; i + 1 < points_.size(); ++i) {
+      const double length = (points_[i + 1] - points_[i]).norm();
+      while (next_marker < arc_length + length) {
+        const double fraction =
+            length > 0.0 ? (next_marker - arc_length) / length : 0.0;
+        const double t = times_[i] + fraction * (times_[i + 1] - times_[i]);
+        mav_msgs::EigenTrajectoryPoint flat_state;
+        if (sampleSegmentAtTime(segment, t, &flat_state)) {
+          internal::appendMavStateMarkers(flat_state, additional_marker_,
+                                          &state_markers);
+        }
+        next_marker += distance_;
+      }
+      arc_length += length;
+    }
+    markers->insert(markers->end(), state_markers.markers.begin(),
+                    state_markers.markers.end());
+  }
+
+  if (markers->size() > static_cast<size_t>(kMaxMarkersPerSegment)) {
+    LOG(WARNING) << "Segment " << segment_idx << " has " << markers->size()
+                 << " markers, only drawing " << kMaxMarkersPerSegment << ".";
+    markers->resize(kMaxMarkersPerSegment);
+  }
+  for (size_t i = 0; i < markers->size(); ++i) {
+    visualization_msgs::Marker& marker = (*markers)[i];
+    marker.header = header;
+    marker.action = visualization_msgs::Marker::ADD;
+    marker.id = segment_idx * kMaxMarkersPerSegment + static_cast<int>(i);
+    marker.lifetime = ros::Duration(0.0);
+  }
+}
+
+void TrajectoryVisualizer::appendPathPoints(
+    const Segment& segment, double t_start, const Eigen::Vector3d& p_start,
+    double t_end, const Eigen::Vector3d& p_end, int depth,
+    std::vector<double>* times, std::vector<Eigen::Vector3d>* points) const {
+  constexpr int kMaxDepth = 8;
+  const double t_mid = 0.5 * (t_start + t_end);
+  const Eigen::Vector3d p_mid = segment.evaluate(t_mid).head<3>();
+  // Distance of the midpoint to the chord.
+  const Eigen::Vector3d chord = p_end - p_start;
+  const double chord_length_squared = chord.squaredNorm();
+  Eigen::Vector3d offset = p_mid - p_start;
+  if (chord_length_squared > 0.0) {
+    offset -= offset.dot(chord) / chord_length_squared * chord;
+  }
+  if (depth < kMaxDepth && offset.norm() > getTolerance(p_mid)) {
+    appendPathPoints(segment, t_start, p_start, t_mid, p_mid, depth + 1,
+                     times, points);
+    appendPathPoints(segment, t_mid, p_mid, t_end, p_end, depth + 1, times,
+                     points);
+    return;
+  }
+  times->push_back(t_end);
+  points->push_back(p_end);
+}
+
+double TrajectoryVisualizer::getTolerance(
+    const Eigen::Vector3d& position) const {
+  if (!has_viewpoint_) {
+    return tolerance_;
+  }
+  return std::max(angular_tolerance_ * (position - viewpoint_).norm(),
+                  tolerance_);
+}
+
 }  // namespace mav_trajectory_generation
@@ -20,37 +20,65 @@
 
 #include <mav_trajectory_generation_ros/trajectory_sampler_node.h>
 
+#include <algorithm>
+
 TrajectorySamplerNode::TrajectorySamplerNode(const ros::NodeHandle &nh,
                                              const ros::NodeHandle &nh_private)
     : nh_(nh),
       nh_private_(nh_private),
       publish_whole_trajectory_(false),
       dt_(0.01),
-      current_sample_time_(0.0)
+      horizon_points_(0),
+      horizon_period_(0.1),
+      incoming_(nullptr),
+      retired_(nullptr),
+      stop_requested_(false)
 {
   nh_private_.param("publish_whole_trajectory", publish_whole_trajectory_,
                     publish_whole_trajectory_);
   nh_private_.param("dt", dt_, dt_);
+  nh_private_.param("horizon_points", horizon_points_, horizon_points_);
+  nh_private_.param("horizon_period", horizon_period_, horizon_period_);
 
   command_pub_ = nh_.advertise<trajectory_msgs::MultiDOFJointTrajectory>(
       mav_msgs::default_topics::COMMAND_TRAJECTORY, 1);
-  trajectory_sub_ = nh_.subscribe(
-      "path_segments", 10, &TrajectorySamplerNode::pathSegmentsCallback, this);
   stop_srv_ = nh_.advertiseService(
       "stop_sampling", &TrajectorySamplerNode::stopSamplingCallback, this);
-  const bool oneshot = false;
-  const bool autostart = false;
-  publish_timer_ = nh_.createTimer(ros::Duration(dt_),
-                                   &TrajectorySamplerNode::commandTimerCallback,
-                                   this, oneshot, autostart);
+  // The timer keeps running and only checks for a new trajectory while
+  // there is nothing to sample, such that it never has to be restarted by
+  // the conversion thread.
+  if (!publish_whole_trajectory_)
+  {
+    const double timer_period = horizon_points_ > 0 ? horizon_period_ : dt_;
+    publish_timer_ = nh_.createTimer(
+        ros::Duration(timer_period),
+        &TrajectorySamplerNode::commandTimerCallback, this);
+  }
+
+  ros::NodeHandle trajectory_nh(nh_);
+  trajectory_nh.setCallbackQueue(&trajectory_queue_);
+  trajectory_sub_ = trajectory_nh.subscribe(
+      "path_segments", 10, &TrajectorySamplerNode::pathSegmentsCallback, this);
+  trajectory_spinner_.reset(new ros::AsyncSpinner(1, &trajectory_queue_));
+  trajectory_spinner_->start();
 }
 
-TrajectorySamplerNode::~TrajectorySamplerNode() { publish_timer_.stop(); }
+TrajectorySamplerNode::~TrajectorySamplerNode()
+{
+  trajectory_spinner_->stop();
+  trajectory_sub_.shutdown();
+  publish_timer_.stop();
+  delete incoming_.exchange(nullptr);
+  delete retired_.exchange(nullptr);
+}
 
 void TrajectorySamplerNode::pathSegmentsCallback(
-    const planning_msgs::PolynomialTrajectory4D &segments_message)
+    const planning_msgs::PolynomialTrajectory4D::ConstPtr &msg)
 {
-  std::cout<<segments_message.segments.size()<<std::endl;
+  // Runs on the conversion thread, which also frees replaced trajectories.
+  delete retired_.exchange(nullptr);
+
+  const planning_msgs::PolynomialTrajectory4D &segments_message = *msg;
   if (segments_message.segments.empty())
   {
     ROS_WARN("Trajectory sampler: received empty waypoint message");
@@ -62,8 +90,12 @@ void TrajectorySamplerNode::pathSegmentsCallback(
              segments_message.segments.size());
   }
 
+  std::unique_ptr<SamplingState> state(new SamplingState);
+  state->start_time = segments_message.header.stamp.isZero()
+                          ? ros::Time::now()
+                          : segments_message.header.stamp;
   bool success = mav_trajectory_generation::polynomialTrajectoryMsgToTrajectory(
-      segments_message, &trajectory_);
+      segments_message, &state->trajectory);
   if (!success)
   {
     return;
@@ -73,56 +105,128 @@ void TrajectorySamplerNode::pathSegmentsCallback(
   {
     // Publish the entire trajectory at once.
     mav_msgs::EigenTrajectoryPoint::Vector flat_states;
-    mav_trajectory_generation::sampleWholeTrajectory(trajectory_, dt_,
+    mav_trajectory_generation::sampleWholeTrajectory(state->trajectory, dt_,
                                                      &flat_states);
-    trajectory_msgs::MultiDOFJointTrajectory msg_pub;
-    msgMultiDofJointTrajectoryFromEigen(flat_states, &msg_pub);
+    trajectory_msgs::MultiDOFJointTrajectory::Ptr msg_pub(
+        new trajectory_msgs::MultiDOFJointTrajectory);
+    msgMultiDofJointTrajectoryFromEigen(flat_states, msg_pub.get());
     command_pub_.publish(msg_pub);
+    return;
   }
-  else
+
+  if (horizon_points_ > 0)
+  {
+    // Publish a sliding window of the trajectory every horizon_period_.
+    state->vectorized_trajectory =
+        mav_trajectory_generation::VectorizedTrajectory(
+            state->trajectory,
+            mav_trajectory_generation::derivative_order::SNAP);
+  }
+  else if (!state->stream_sampler.setTrajectory(state->trajectory))
   {
-    publish_timer_.start();
-    current_sample_time_ = 0.0;
-    start_time_ = ros::Time::now();
+    return;
   }
+
+  // Replaces a state that the timer did not take over yet.
+  delete incoming_.exchange(state.release());
 }
 
 bool TrajectorySamplerNode::stopSamplingCallback(
     std_srvs::EmptyRequest &request, std_srvs::EmptyResponse &response)
 {
-  publish_timer_.stop();
+  // A trajectory received after this call is sampled again.
+  stop_requested_ = true;
+  delete incoming_.exchange(nullptr);
   return true;
 }
 
+void TrajectorySamplerNode::retireState(SamplingState *state)
+{
+  // Deletes the previous one if the conversion thread did not collect it,
+  // which is rare as trajectories arrive much slower than timer ticks.
+  delete retired_.exchange(state);
+}
+
+void TrajectorySamplerNode::updateActiveState(const ros::Time &now)
+{
+  if (stop_requested_.exchange(false))
+  {
+    retireState(active_.release());
+  }
+  SamplingState *incoming = incoming_.exchange(nullptr);
+  if (incoming == nullptr)
+  {
+    return;
+  }
+  retireState(active_.release());
+  active_.reset(incoming);
+
+  // Continue at the current time of the new trajectory.
+  const double t = (now - active_->start_time).toSec();
+  if (horizon_points_ == 0 && t > 0.0 && !active_->stream_sampler.seek(t))
+  {
+    // Already past its end.
+    retireState(active_.release());
+  }
+}
+
 void TrajectorySamplerNode::commandTimerCallback(const ros::TimerEvent &)
 {
-  if (current_sample_time_ <= trajectory_.getMaxTime())
-  {
-    trajectory_msgs::MultiDOFJointTrajectory msg;
-    mav_msgs::EigenTrajectoryPoint flat_state;
-    bool success = mav_trajectory_generation::sampleTrajectoryAtTime(
-        trajectory_, current_sample_time_, &flat_state);
-    if (!success)
-    {
-      publish_timer_.stop();
-    }
-    mav_msgs::msgMultiDofJointTrajectoryFromEigen(flat_state, &msg);
-    msg.points[0].time_from_start = ros::Duration(current_sample_time_);
-    command_pub_.publish(msg);
-    current_sample_time_ += dt_;
+  const ros::Time now = ros::Time::now();
+  updateActiveState(now);
+  if (!active_)
+  {
+    return;
+  }
+
+  bool in_range = true;
+  if (horizon_points_ > 0)
+  {
+    in_range = publishHorizon(now);
   }
   else
   {
-    publish_timer_.stop();
+    mav_trajectory_generation::TrajectoryStreamSampler &stream_sampler =
+        active_->stream_sampler;
+    // Published as shared pointer, such that a controller in the same nodelet
+    // manager receives it without serialization.
+    trajectory_msgs::MultiDOFJointTrajectory::Ptr msg(
+        new trajectory_msgs::MultiDOFJointTrajectory);
+    mav_msgs::msgMultiDofJointTrajectoryFromEigen(stream_sampler.getState(),
+                                                  msg.get());
+    msg->points[0].time_from_start = ros::Duration(stream_sampler.getTime());
+    command_pub_.publish(msg);
+    in_range = stream_sampler.next(dt_);
+  }
+
+  if (!in_range)
+  {
+    // Past the end of the trajectory.
+    retireState(active_.release());
   }
 }
 
-int main(int argc, char **argv)
+bool TrajectorySamplerNode::publishHorizon(const ros::Time &now)
 {
-  ros::init(argc, argv, "trajectory_sampler_node");
-  ros::NodeHandle nh("");
-  ros::NodeHandle nh_private("~");
-  TrajectorySamplerNode trajectory_sampler_node(nh, nh_private);
-  ROS_INFO("Initialized trajectory sampler.");
-  ros::spin();
+  const mav_trajectory_generation::VectorizedTrajectory &trajectory =
+      active_->vectorized_trajectory;
+  const double t = std::max((now - active_->start_time).toSec(), 0.0);
+  if (t > trajectory.getMaxTime() ||
+      !mav_trajectory_generation::sampleTrajectoryHorizon(
+          trajectory, t, horizon_points_, dt_, &horizon_samples_,
+          &horizon_states_))
+  {
+    return false;
+  }
+
+  // Subscribers in the same process may still hold the last message, which
+  // must not be modified after publishing. Otherwise its memory is reused.
+  if (!horizon_msg_ || !horizon_msg_.unique())
+  {
+    horizon_msg_.reset(new trajectory_msgs::MultiDOFJointTrajectory);
+  }
+  mav_msgs::msgMultiDofJointTrajectoryFromEigen(horizon_states_,
+                                                horizon_msg_.get());
+  command_pub_.publish(horizon_msg_);
+  return true;
 }
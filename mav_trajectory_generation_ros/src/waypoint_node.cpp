@@ -1,151 +1,310 @@
-#include <mav_trajectory_generation/polynomial_optimization_linear.h>
-#include <mav_trajectory_generation/trajectory.h>
-#include <mav_trajectory_generation_ros/ros_visualization.h>
-#include <geometry_msgs/PoseArray.h>
-#include <nav_msgs/Path.h>
+/*
+ * Copyright (c) 2017, Markus Achtelik, ASL, ETH Zurich, Switzerland
+ * Copyright (c) 2017, Michael Burri, ASL, ETH Zurich, Switzerland
+ * Copyright (c) 2017, Helen Oleynikova, ASL, ETH Zurich, Switzerland
+ * Copyright (c) 2017, Rik Bähnemann, ASL, ETH Zurich, Switzerland
+ * Copyright (c) 2017, Marija Popovic, ASL, ETH Zurich, Switzerland
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <mav_trajectory_generation_ros/waypoint_node.h>
+
 #include <math.h>
+#include <string>
+#include <vector>
 #include <tf/transform_datatypes.h>
 
-#define PI 3.14159265
-nav_msgs::Path way_;
-geometry_msgs::PoseArray traj_with_yaw;
-geometry_msgs::Pose traj_pose;
-tf::Quaternion q;
+#include <mav_trajectory_generation/polynomial_optimization_linear.h>
+#include <mav_trajectory_generation/polynomial_optimization_nonlinear.h>
+#include <mav_trajectory_generation/trajectory_sampling.h>
+
+#include <mav_trajectory_generation_ros/ros_conversions.h>
+#include <mav_trajectory_generation_ros/ros_visualization.h>
+
+// Sampling interval of the poses published on /trajectory_with_yaw.
+static constexpr double kTrajectoryWithYawSamplingTime = 0.1;
+
+WaypointNode::WaypointNode(const ros::NodeHandle &nh,
+                           const ros::NodeHandle &nh_private)
+    : nh_(nh),
+      nh_private_(nh_private),
+      optimize_segment_times_(false),
+      v_max_(1.0),
+      a_max_(3.0),
+      shutdown_(false),
+      cancel_planning_(false)
+{
+  nh_private_.param("optimize_segment_times", optimize_segment_times_,
+                    optimize_segment_times_);
+  nh_private_.param("v_max", v_max_, v_max_);
+  nh_private_.param("a_max", a_max_, a_max_);
+  // Maximum distance of the drawn path to the trajectory.
+  double visualization_tolerance = 0.01;
+  nh_private_.param("visualization_tolerance", visualization_tolerance,
+                    visualization_tolerance);
+  std::string segment_time_initializer = "fabian";
+  nh_private_.param("segment_time_initializer", segment_time_initializer,
+                    segment_time_initializer);
+
+  if (segment_time_initializer == "corner_aware")
+  {
+    segment_time_estimate_.reset(
+        new mav_trajectory_generation::CornerAwareSegmentTimeInitializer(
+            v_max_, a_max_));
+  }
+  else
+  {
+    if (segment_time_initializer != "fabian")
+    {
+      ROS_WARN_STREAM("Unknown segment_time_initializer "
+                      << segment_time_initializer << ", using fabian.");
+    }
+    const double magic_fabian_constant = 6.5;  // A tuning parameter
+    segment_time_estimate_.reset(
+        new mav_trajectory_generation::FabianSegmentTimeInitializer(
+            v_max_, a_max_, magic_fabian_constant));
+  }
+  segment_time_warm_start_.reset(
+      new mav_trajectory_generation::WarmStartSegmentTimeInitializer(
+          segment_time_estimate_.get()));
+
+  // Distance by which to seperate additional markers. Set 0.0 to disable.
+  const double distance = 1.6;
+  visualizer_.reset(new mav_trajectory_generation::TrajectoryVisualizer(
+      "world", distance, visualization_tolerance));
+
+  vis_pub_ = nh_.advertise<visualization_msgs::MarkerArray>(
+      "/trajectory_vis", 10,
+      boost::bind(&WaypointNode::visualizationConnectCallback, this, _1));
+  traj_with_yaw_pub_ =
+      nh_.advertise<geometry_msgs::PoseArray>("/trajectory_with_yaw", 10);
+  path_segments_pub_ =
+      nh_.advertise<planning_msgs::PolynomialTrajectory4D>("path_segments", 1);
+  planner_thread_ = std::thread(&WaypointNode::plannerLoop, this);
+  path_sub_ = nh_.subscribe("/costmap_node/planner/plan", 10,
+                            &WaypointNode::pathCallback, this);
+}
+
+WaypointNode::~WaypointNode()
+{
+  path_sub_.shutdown();
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    shutdown_ = true;
+    cancel_planning_ = true;
+  }
+  path_received_.notify_one();
+  planner_thread_.join();
+}
+
+void WaypointNode::pathCallback(const nav_msgs::Path::ConstPtr &msg)
+{
+  if (msg->poses.empty())
+  {
+    return;
+  }
+  // Latest request wins: replaces a path that was not planned yet and
+  // cancels the running optimization. Keeps the shared message instead of
+  // copying it.
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    pending_path_ = msg;
+    cancel_planning_ = true;
+  }
+  path_received_.notify_one();
+}
+
+void WaypointNode::plannerLoop()
+{
+  while (true)
+  {
+    nav_msgs::Path::ConstPtr path;
+    {
+      std::unique_lock<std::mutex> lock(mutex_);
+      path_received_.wait(lock, [this] { return shutdown_ || pending_path_; });
+      if (shutdown_)
+      {
+        return;
+      }
+      path.swap(pending_path_);
+      cancel_planning_ = false;
+    }
+
+    mav_trajectory_generation::Trajectory trajectory;
+    if (planTrajectory(*path, &trajectory) && !cancel_planning_)
+    {
+      publishTrajectory(trajectory);
+    }
+  }
+}
 
-void waycb(const nav_msgs::Path::ConstPtr &msg)
+bool WaypointNode::planTrajectory(
+    const nav_msgs::Path &path,
+    mav_trajectory_generation::Trajectory *trajectory)
 {
-    way_ = *msg;
+  mav_trajectory_generation::Vertex::Vector vertices;
+  const int dimension = 3;
+  const int derivative_to_optimize =
+      mav_trajectory_generation::derivative_order::ANGULAR_ACCELERATION;
+  mav_trajectory_generation::Vertex start(dimension), middle(dimension),
+      end(dimension);
+
+  start.makeStartOrEnd(Eigen::Vector3d(path.poses[0].pose.position.x,
+                                       path.poses[0].pose.position.y, 0),
+                       derivative_to_optimize);
+  vertices.push_back(start);
+
+  for (size_t ii = 1; ii + 1 < path.poses.size(); ii = ii + 10)
+  {
+    middle.addConstraint(
+        mav_trajectory_generation::derivative_order::POSITION,
+        Eigen::Vector3d(path.poses[ii].pose.position.x,
+                        path.poses[ii].pose.position.y, 0));
+    vertices.push_back(middle);
+  }
+
+  end.makeStartOrEnd(Eigen::Vector3d(path.poses.back().pose.position.x,
+                                     path.poses.back().pose.position.y, 0),
+                     derivative_to_optimize);
+  vertices.push_back(end);
+
+  // Compute the segment times.
+  std::vector<double> segment_times;
+  const mav_trajectory_generation::SegmentTimeInitializer &initializer =
+      optimize_segment_times_ ? *segment_time_warm_start_
+                              : *segment_time_estimate_;
+  if (!initializer.estimateSegmentTimes(vertices, &segment_times))
+  {
+    ROS_WARN("Could not estimate the segment times.");
+    return false;
+  }
+
+  // N denotes the number of coefficients of the underlying polynomial.
+  // N has to be even. If we want the trajectories to be snap-continuous, N
+  // needs to be at least 10.
+  const int N = 10;
+  if (!optimize_segment_times_)
+  {
+    mav_trajectory_generation::PolynomialOptimization<N> opt(dimension);
+    opt.setupFromVertices(vertices, segment_times, derivative_to_optimize);
+    opt.solveLinear();
+    opt.getTrajectory(trajectory);
+    return true;
+  }
+
+  mav_trajectory_generation::NonlinearOptimizationParameters parameters;
+  mav_trajectory_generation::PolynomialOptimizationNonLinear<N> opt(
+      dimension, parameters, true);
+  opt.setupFromVertices(vertices, segment_times, derivative_to_optimize);
+  opt.addMaximumMagnitudeConstraint(
+      mav_trajectory_generation::derivative_order::VELOCITY, v_max_);
+  opt.addMaximumMagnitudeConstraint(
+      mav_trajectory_generation::derivative_order::ACCELERATION, a_max_);
+  opt.setCancellationToken(&cancel_planning_);
+  opt.optimize();
+  if (opt.getOptimizationInfo().cancelled)
+  {
+    return false;
+  }
+  opt.getTrajectory(trajectory);
+  std::vector<double> optimized_segment_times;
+  opt.getPolynomialOptimizationRef().getSegmentTimes(&optimized_segment_times);
+  segment_time_warm_start_->setPreviousSolution(vertices,
+                                                optimized_segment_times);
+  return true;
+}
+
+void WaypointNode::publishTrajectory(
+    const mav_trajectory_generation::Trajectory &trajectory)
+{
+  // Published as shared pointer, such that a sampler in the same nodelet
+  // manager receives it without serialization. The message must not be
+  // modified after publishing.
+  planning_msgs::PolynomialTrajectory4D::Ptr segments_msg(
+      new planning_msgs::PolynomialTrajectory4D);
+  if (mav_trajectory_generation::trajectoryToPolynomialTrajectoryMsg(
+          trajectory, segments_msg.get()))
+  {
+    segments_msg->header.stamp = ros::Time::now();
+    segments_msg->header.frame_id = "world";
+    path_segments_pub_.publish(segments_msg);
+  }
+
+  publishTrajectoryWithYaw(trajectory);
+
+  // Visualizing the changed segments of the trajectory.
+  std::lock_guard<std::mutex> lock(visualization_mutex_);
+  visualizer_->update(trajectory, &changed_markers_);
+  if (changed_markers_.markers.empty())
+  {
+    return;
+  }
+  vis_pub_.publish(changed_markers_);
 }
 
-int main(int argc, char **argv)
+void WaypointNode::visualizationConnectCallback(
+    const ros::SingleSubscriberPublisher &pub)
 {
-    ros::init(argc, argv, "waypoint_node");
-    ros::NodeHandle n;
-
-    ros::Subscriber way_sub = n.subscribe("/costmap_node/planner/plan", 10, waycb);
-
-    ros::Publisher vis_pub = n.advertise<visualization_msgs::MarkerArray>("/trajectory_vis", 10);
-    ros::Publisher traj_with_yaw_pub = n.advertise<geometry_msgs::PoseArray>("/trajectory_with_yaw", 10);
-    
-
-    ros::Rate sleep_rate(10);
-
-    while (ros::ok())
-    {   
-        mav_trajectory_generation::Vertex::Vector vertices;
-        const int dimension = 3;
-        const int derivative_to_optimize = mav_trajectory_generation::derivative_order::ANGULAR_ACCELERATION;
-        mav_trajectory_generation::Vertex start(dimension), middle(dimension), end(dimension);
-
-        // Time count
-        ros::Time t0 = ros::Time::now();
-
-        if(way_.poses.size()>0)
-        {
-            start.makeStartOrEnd(Eigen::Vector3d(way_.poses[0].pose.position.x, way_.poses[0].pose.position.y,0), derivative_to_optimize);
-            vertices.push_back(start);
-
-            // std::cout << "debug="  << "," << way_.poses.size() << std::endl;
-            
-            for(int ii=1;ii < way_.poses.size()-1; ii = ii+10 )
-            {
-    	        middle.addConstraint(mav_trajectory_generation::derivative_order::POSITION, Eigen::Vector3d(way_.poses[ii].pose.position.x, way_.poses[ii].pose.position.y, 0));
-                vertices.push_back(middle);
-            }
-
-            end.makeStartOrEnd(Eigen::Vector3d(way_.poses[way_.poses.size() - 1].pose.position.x, way_.poses[way_.poses.size() - 1].pose.position.y,0), derivative_to_optimize);
-            vertices.push_back(end);
-        
-            //compute the segment times
-            std::vector<double> segment_times;
-            const double v_max = 1.0;
-            const double a_max = 3.0;
-            const double magic_fabian_constant = 6.5; // A tuning parameter
-            segment_times = estimateSegmentTimes(vertices, v_max, a_max, magic_fabian_constant);
-
-            //N denotes the number of coefficients of the underlying polynomial
-            //N has to be even.
-            //If we want the trajectories to be snap-continuous, N needs to be at least 10.
-
-            const int N = 10;
-            mav_trajectory_generation::PolynomialOptimization<N> opt(dimension);
-            opt.setupFromVertices(vertices, segment_times, derivative_to_optimize);
-            opt.solveLinear();
-
-            //ROS_INFO("Take %f sec to get optimal traject", (ros::Time::now() - t0).toSec());
-
-            //Obtain the polynomial segments
-            mav_trajectory_generation::Segment::Vector segments;
-            opt.getSegments(&segments);
-
-            //creating Trajectories
-            
-            mav_trajectory_generation::Trajectory trajectory;
-            opt.getTrajectory(&trajectory);
-            mav_trajectory_generation::Trajectory x_trajectory = trajectory.getTrajectoryWithSingleDimension(1);
-
-            //evaluating the trajectory at particular instances of time
-            // Single sample:
-            double sampling_time = 2.0;
-            int derivative_order = mav_trajectory_generation::derivative_order::POSITION;
-            Eigen::VectorXd sample = trajectory.evaluate(sampling_time, derivative_order);
-
-            // Sample range:
-            double t_start = 2.0;
-            double t_end = 10.0;
-            double dt = 0.01;
-            std::vector<Eigen::VectorXd> result;
-            std::vector<double> sampling_times; // Optional.
-            trajectory.evaluateRange(t_start, t_end, dt, derivative_order, &result, &sampling_times);
-            //std::cout << result.size() << std::endl;
-            //std::cout << sampling_times.size() << std::endl;
-
-            //visualizing Trajectories
-            visualization_msgs::MarkerArray markers;
-            double distance = 1.6; // Distance by which to seperate additional markers. Set 0.0 to disable.
-            std::string frame_id = "world";
-            traj_with_yaw.header.stamp = ros::Time::now();
-            traj_with_yaw.header.frame_id = "world";
-            // From Trajectory class:
-            mav_trajectory_generation::drawMavTrajectory(trajectory, distance, frame_id, &markers);
-
-            float traj_marker_size = markers.markers.size();
-            float trajectory_size = markers.markers[traj_marker_size - 1].points.size();
-
-            for(int ii=0; ii < trajectory_size; ii++)
-            {
-                traj_pose.position.x = markers.markers[traj_marker_size - 1].points[ii].x;
-                traj_pose.position.y = markers.markers[traj_marker_size - 1].points[ii].y;
-                if(ii<trajectory_size-1)
-                {
-                    float y_diff = (markers.markers[traj_marker_size - 1].points[ii+1].y - markers.markers[traj_marker_size - 1].points[ii].y);
-                    float x_diff = (markers.markers[traj_marker_size - 1].points[ii+1].x - markers.markers[traj_marker_size - 1].points[ii].x);
-                    float yaw = atan2(y_diff,x_diff);
-                    q.setRPY(0, 0, yaw);
-                }
-                else
-                {
-                    float y_diff = (markers.markers[traj_marker_size - 1].points[ii].y - markers.markers[traj_marker_size - 1].points[ii-1].y);
-                    float x_diff = (markers.markers[traj_marker_size - 1].points[ii].x - markers.markers[traj_marker_size - 1].points[ii-1].x);
-                    float yaw = atan2(y_diff,x_diff);
-                    q.setRPY(0, 0, yaw);
-
-                }
-
-                
-                traj_pose.orientation.z = q.z();
-                traj_pose.orientation.w = q.w();
-                //yaw set
-                traj_with_yaw.poses.push_back(traj_pose);
-            }
-            
-            vis_pub.publish(markers);
-            traj_with_yaw_pub.publish(traj_with_yaw);
-            traj_with_yaw.poses.clear();
-        }
-        ros::spinOnce();
-        vertices.clear();
-        sleep_rate.sleep();
+  std::lock_guard<std::mutex> lock(visualization_mutex_);
+  visualizer_->getAllMarkers(&all_markers_);
+  if (!all_markers_.markers.empty())
+  {
+    pub.publish(all_markers_);
+  }
+}
+
+void WaypointNode::publishTrajectoryWithYaw(
+    const mav_trajectory_generation::Trajectory &trajectory)
+{
+  // Samples at a fixed time interval, independent of the visualization.
+  mav_msgs::EigenTrajectoryPoint::Vector flat_states;
+  if (!mav_trajectory_generation::sampleWholeTrajectory(
+          trajectory, kTrajectoryWithYawSamplingTime, &flat_states) ||
+      flat_states.empty())
+  {
+    return;
+  }
+  std::vector<geometry_msgs::Point> points(flat_states.size());
+  for (size_t ii = 0; ii < flat_states.size(); ii++)
+  {
+    points[ii].x = flat_states[ii].position_W.x();
+    points[ii].y = flat_states[ii].position_W.y();
+    points[ii].z = flat_states[ii].position_W.z();
+  }
+
+  geometry_msgs::PoseArray traj_with_yaw;
+  traj_with_yaw.header.stamp = ros::Time::now();
+  traj_with_yaw.header.frame_id = "world";
+  traj_with_yaw.poses.reserve(points.size());
+  tf::Quaternion q;
+  for (size_t ii = 0; ii < points.size(); ii++)
+  {
+    geometry_msgs::Pose traj_pose;
+    traj_pose.position.x = points[ii].x;
+    traj_pose.position.y = points[ii].y;
+    // The yaw points to the next point, and from the previous point at the
+    // end.
+    if (points.size() > 1)
+    {
+      const size_t from = ii + 1 < points.size() ? ii : ii - 1;
+      const float y_diff = points[from + 1].y - points[from].y;
+      const float x_diff = points[from + 1].x - points[from].x;
+      q.setRPY(0, 0, atan2(y_diff, x_diff));
     }
-    return 0;
+    traj_pose.orientation.z = q.z();
+    traj_pose.orientation.w = q.w();
+    traj_with_yaw.poses.push_back(traj_pose);
+  }
+  traj_with_yaw_pub_.publish(traj_with_yaw);
 }
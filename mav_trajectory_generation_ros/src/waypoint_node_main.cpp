@@ -0,0 +1,31 @@
+/*
+ * Copyright (c) 2017, Markus Achtelik, ASL, ETH Zurich, Switzerland
+ * Copyright (c) 2017, Michael Burri, ASL, ETH Zurich, Switzerland
+ * Copyright (c) 2017, Helen Oleynikova, ASL, ETH Zurich, Switzerland
+ * Copyright (c) 2017, Rik Bähnemann, ASL, ETH Zurich, Switzerland
+ * Copyright (c) 2017, Marija Popovic, ASL, ETH Zurich, Switzerland
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <mav_trajectory_generation_ros/waypoint_node.h>
+
+int main(int argc, char **argv)
+{
+  ros::init(argc, argv, "waypoint_node");
+  ros::NodeHandle nh("");
+  ros::NodeHandle nh_private("~");
+  WaypointNode waypoint_node(nh, nh_private);
+  ros::spin();
+  return 0;
+}
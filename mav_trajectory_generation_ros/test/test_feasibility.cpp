@@ -17,20 +17,26 @@
  * See the License for the specific language governing permissions and
  * limitations under the License.
  */
+#include <algorithm>
 #include <fstream>
 #include <iostream>
+#include <limits>
 #include <random>
 #include <string>
 
 #include <eigen-checks/gtest.h>
+#include <mav_msgs/conversions.h>
+#include <mav_msgs/eigen_mav_msgs.h>
 
 #include <mav_trajectory_generation/polynomial_optimization_linear.h>
 #include <mav_trajectory_generation/segment.h>
 #include <mav_trajectory_generation/test_utils.h>
+#include <mav_trajectory_generation/thread_pool.h>
 #include <mav_trajectory_generation/timing.h>
 #include <mav_trajectory_generation/vertex.h>
 
 #include "mav_trajectory_generation_ros/feasibility_analytic.h"
+#include "mav_trajectory_generation_ros/feasibility_cache.h"
 #include "mav_trajectory_generation_ros/feasibility_recursive.h"
 #include "mav_trajectory_generation_ros/feasibility_sampling.h"
 #include "mav_trajectory_generation_ros/feasibility_base.h"
@@ -279,6 +285,117 @@ TEST(FeasibilityTest, CompareFeasibilityTests)
         }
     }
 
+    // The Bernstein pre-filter only decides segments it can prove.
+    FeasibilityRecursive feasibility_exact(input_constraints);
+    feasibility_exact.settings_.setMinSectionTimeS(0.01);
+    feasibility_exact.use_bernstein_pre_filter_ = false;
+    timing::Timer time_pre_filter("time_bernstein_pre_filter", false);
+    size_t n_decided = 0;
+    for (size_t i = 0; i < segments.size(); i++)
+    {
+        time_pre_filter.Start();
+        const InputFeasibilityResult result_pre_filter =
+            feasibility_exact.checkInputFeasibilityBernstein(segments[i]);
+        time_pre_filter.Stop();
+        if (result_pre_filter == InputFeasibilityResult::kInputIndeterminable)
+        {
+            continue;
+        }
+        n_decided++;
+        const InputFeasibilityResult result_exact =
+            feasibility_exact.checkInputFeasibility(segments[i]);
+        if (result_pre_filter == InputFeasibilityResult::kInputFeasible)
+        {
+            EXPECT_TRUE(result_exact == InputFeasibilityResult::kInputFeasible ||
+                        result_exact ==
+                            InputFeasibilityResult::kInputIndeterminable);
+            EXPECT_EQ(InputFeasibilityResult::kInputFeasible,
+                      result_sampling_01[i]);
+        }
+        else
+        {
+            EXPECT_NE(InputFeasibilityResult::kInputFeasible, result_exact);
+        }
+    }
+    EXPECT_GT(n_decided, 0u);
+    std::cout << "Bernstein pre-filter decided " << n_decided << " / "
+              << segments.size() << " segments." << std::endl;
+
+    // Adaptive sampling only skips samples that cannot be infeasible.
+    FeasibilitySampling feasibility_adaptive_01(input_constraints);
+    feasibility_adaptive_01.settings_.setSamplingIntervalS(0.01);
+    feasibility_adaptive_01.settings_.setAdaptiveSampling(true);
+    timing::Timer time_adaptive_01("time_sampling_01_adaptive", false);
+    for (size_t i = 0; i < segments.size(); i++)
+    {
+        time_adaptive_01.Start();
+        const InputFeasibilityResult result_adaptive =
+            feasibility_adaptive_01.checkInputFeasibility(segments[i]);
+        time_adaptive_01.Stop();
+        EXPECT_EQ(result_sampling_01[i], result_adaptive);
+    }
+
+    // Single precision only differs for states within its error bound of a
+    // limit.
+    FeasibilitySampling feasibility_float_01(input_constraints);
+    feasibility_float_01.settings_.setSamplingIntervalS(0.01);
+    feasibility_float_01.settings_.setSinglePrecision(true);
+    timing::Timer time_float_01("time_sampling_01_float", false);
+    size_t n_float_differs = 0;
+    for (size_t i = 0; i < segments.size(); i++)
+    {
+        time_float_01.Start();
+        const InputFeasibilityResult result_float =
+            feasibility_float_01.checkInputFeasibility(segments[i]);
+        time_float_01.Stop();
+        if (result_float != result_sampling_01[i])
+        {
+            n_float_differs++;
+        }
+    }
+    EXPECT_LE(n_float_differs, segments.size() / 1000);
+
+    // The parallel check finds the same first infeasible segment.
+    Trajectory trajectory;
+    trajectory.setSegments(segments);
+    const size_t first_infeasible =
+        std::find_if(result_recursive_01.begin(), result_recursive_01.end(),
+                     [](InputFeasibilityResult result) {
+                         return result != InputFeasibilityResult::kInputFeasible;
+                     }) -
+        result_recursive_01.begin();
+    ThreadPool thread_pool(4);
+    timing::Timer time_recursive_parallel("time_recursive_01_parallel");
+    int segment_idx = -1;
+    const InputFeasibilityResult result_parallel =
+        feasibility_recursive_01.checkInputFeasibilityParallel(
+            trajectory, &thread_pool, &segment_idx);
+    time_recursive_parallel.Stop();
+    EXPECT_EQ(first_infeasible, segment_idx);
+    const FeasibilityBase& feasibility_base = feasibility_recursive_01;
+    EXPECT_EQ(feasibility_base.checkInputFeasibility(trajectory),
+              result_parallel);
+    if (first_infeasible < segments.size())
+    {
+        EXPECT_EQ(result_recursive_01[first_infeasible], result_parallel);
+    }
+
+    // The same without infeasible segments.
+    Segment::Vector feasible_segments;
+    for (size_t i = 0; i < segments.size(); i++)
+    {
+        if (result_recursive_01[i] == InputFeasibilityResult::kInputFeasible)
+        {
+            feasible_segments.push_back(segments[i]);
+        }
+    }
+    ASSERT_FALSE(feasible_segments.empty());
+    trajectory.setSegments(feasible_segments);
+    EXPECT_EQ(InputFeasibilityResult::kInputFeasible,
+              feasibility_recursive_01.checkInputFeasibilityParallel(
+                  trajectory, &thread_pool, &segment_idx));
+    EXPECT_EQ(trajectory.K(), segment_idx);
+
     // Write results to txt.
     writeResultsToFile("result_sampling_01.txt", result_sampling_01);
     writeResultsToFile("result_sampling_05.txt", result_sampling_05);
@@ -306,6 +423,124 @@ TEST(FeasibilityTest, CompareFeasibilityTests)
     }
 }
 
+// Yaw rate and yaw acceleration check on the body rates of the full state,
+// sampled like FeasibilitySampling.
+InputFeasibilityResult checkBodyYawRates(const Segment &segment,
+                                         const InputConstraints &constraints,
+                                         double dt)
+{
+    double omega_z_max, omega_z_dot_max;
+    const bool check_omega_z =
+        constraints.getConstraint(InputConstraintType::kOmegaZMax, &omega_z_max);
+    const bool check_omega_z_dot = constraints.getConstraint(
+        InputConstraintType::kOmegaZDotMax, &omega_z_dot_max);
+    const size_t n_samples = static_cast<size_t>(segment.getTime() / dt) + 1;
+    for (size_t i = 0; i < n_samples; i++)
+    {
+        const double t = i * dt;
+        mav_msgs::EigenTrajectoryPoint flat_state;
+        flat_state.position_W =
+            segment.evaluate(t, derivative_order::POSITION).head<3>();
+        flat_state.velocity_W =
+            segment.evaluate(t, derivative_order::VELOCITY).head<3>();
+        flat_state.acceleration_W =
+            segment.evaluate(t, derivative_order::ACCELERATION).head<3>();
+        flat_state.jerk_W = segment.evaluate(t, derivative_order::JERK).head<3>();
+        flat_state.snap_W = segment.evaluate(t, derivative_order::SNAP).head<3>();
+        if (segment.D() == 4)
+        {
+            flat_state.setFromYaw(segment.evaluate(t, derivative_order::POSITION)(3));
+            flat_state.setFromYawRate(
+                segment.evaluate(t, derivative_order::VELOCITY)(3));
+            flat_state.setFromYawAcc(
+                segment.evaluate(t, derivative_order::ACCELERATION)(3));
+        }
+        mav_msgs::EigenMavState state;
+        EigenMavStateFromEigenTrajectoryPoint(flat_state, &state);
+        if (check_omega_z && std::fabs(state.angular_velocity_B(2)) > omega_z_max)
+        {
+            return InputFeasibilityResult::kInputInfeasibleYawRates;
+        }
+        if (check_omega_z_dot &&
+            std::fabs(state.angular_acceleration_B(2)) > omega_z_dot_max)
+        {
+            return InputFeasibilityResult::kInputInfeasibleYawAcc;
+        }
+    }
+    return InputFeasibilityResult::kInputFeasible;
+}
+
+TEST(FeasibilityTest, SamplingYawBodyRates)
+{
+    std::srand(7654321);
+    const int kNumSegments = 200;
+    const int kN = 12;
+    Eigen::VectorXd min_pos(4), max_pos(4);
+    min_pos << -5.0, -5.0, -5.0, -M_PI;
+    max_pos = -min_pos;
+    Segment::Vector segments;
+    for (int i = 0; i < kNumSegments; i++)
+    {
+        Vertex::Vector vertices =
+            createRandomVertices(derivative_order::SNAP, 1, min_pos, max_pos);
+        // Tilt the thrust, such that body and world yaw rate differ.
+        vertices[0].addConstraint(
+            derivative_order::ACCELERATION,
+            Eigen::Vector4d(createRandomDouble(-5.0, 5.0),
+                            createRandomDouble(-5.0, 5.0), 0.0, 0.0));
+        PolynomialOptimization<kN> opt(4);
+        opt.setupFromVertices(vertices, {createRandomDouble(2.0, 6.0)},
+                              derivative_order::SNAP);
+        opt.solveLinear();
+        Segment::Vector opt_segments;
+        opt.getSegments(&opt_segments);
+        segments.push_back(opt_segments[0]);
+    }
+
+    const double kDt = 0.01;
+    for (int constraint_type : {InputConstraintType::kOmegaZMax,
+                                InputConstraintType::kOmegaZDotMax})
+    {
+        InputConstraints input_constraints;
+        input_constraints.addConstraint(constraint_type, 2.0);
+        FeasibilitySampling feasibility_sampling(input_constraints);
+        feasibility_sampling.settings_.setSamplingIntervalS(kDt);
+        FeasibilitySampling feasibility_adaptive(input_constraints);
+        feasibility_adaptive.settings_.setSamplingIntervalS(kDt);
+        feasibility_adaptive.settings_.setAdaptiveSampling(true);
+
+        // With yaw, the body yaw rates of the full state are checked.
+        size_t n_infeasible = 0;
+        for (const Segment &segment : segments)
+        {
+            const InputFeasibilityResult expected =
+                checkBodyYawRates(segment, input_constraints, kDt);
+            EXPECT_EQ(expected, feasibility_sampling.checkInputFeasibility(segment));
+            EXPECT_EQ(expected, feasibility_adaptive.checkInputFeasibility(segment));
+            if (expected != InputFeasibilityResult::kInputFeasible)
+            {
+                n_infeasible++;
+            }
+        }
+        EXPECT_GT(n_infeasible, 0u);
+        EXPECT_LT(n_infeasible, segments.size());
+
+        // Without yaw, the constraint is checked on the full state with zero
+        // yaw instead of being ignored.
+        for (const Segment &segment : segments)
+        {
+            Segment position_segment(kN, 3);
+            for (int d = 0; d < 3; d++)
+            {
+                position_segment[d] = segment[d];
+            }
+            position_segment.setTime(segment.getTime());
+            EXPECT_EQ(checkBodyYawRates(position_segment, input_constraints, kDt),
+                      feasibility_sampling.checkInputFeasibility(position_segment));
+        }
+    }
+}
+
 TEST(FeasibilityTest, HalfPlaneFeasibility)
 {
     FeasibilityBase half_space_check;
@@ -364,6 +599,181 @@ TEST(FeasibilityTest, HalfPlaneFeasibility)
     }
 }
 
+TEST(FeasibilityTest, PolytopeFeasibility)
+{
+    std::srand(1234);
+    // Random trajectory.
+    const int kN = 10;
+    const int kD = 3;
+    const Eigen::VectorXd kMinPos = Eigen::VectorXd::Constant(kD, -5.0);
+    const Eigen::VectorXd kMaxPos = -kMinPos;
+    Vertex::Vector vertices = createRandomVertices(
+        derivative_order::SNAP, 20, kMinPos, kMaxPos, 1234);
+    std::vector<double> segment_times = estimateSegmentTimes(vertices, 3.0, 5.0);
+    PolynomialOptimization<kN> opt(kD);
+    opt.setupFromVertices(vertices, segment_times, derivative_order::SNAP);
+    opt.solveLinear();
+    Trajectory trajectory;
+    opt.getTrajectory(&trajectory);
+
+    // Random planes around each segment.
+    const int kNumPlanes = 100;
+    std::mt19937 generator(1234);
+    std::uniform_real_distribution<double> distribution(-1.0, 1.0);
+    Polytope::Vector corridor;
+    std::vector<HalfPlane::Vector> half_planes(trajectory.K());
+    for (int i = 0; i < trajectory.K(); i++)
+    {
+        const Eigen::Vector3d center =
+            trajectory.segments()[i].evaluate(0.5 * trajectory.segments()[i].getTime());
+        for (int j = 0; j < kNumPlanes; j++)
+        {
+            Eigen::Vector3d normal(distribution(generator), distribution(generator),
+                                   distribution(generator));
+            normal.normalize();
+            const double distance = 8.0 + 4.0 * distribution(generator);
+            half_planes[i].emplace_back(center - distance * normal, normal);
+        }
+        corridor.emplace_back(half_planes[i]);
+    }
+
+    FeasibilityBase feasibility_check;
+    timing::Timer time_half_plane("time_half_plane_corridor", false);
+    timing::Timer time_polytope("time_polytope_corridor", false);
+    int n_feasible = 0;
+    for (int i = 0; i < trajectory.K(); i++)
+    {
+        const Segment &segment = trajectory.segments()[i];
+        feasibility_check.half_plane_constraints_ = half_planes[i];
+        time_half_plane.Start();
+        const bool feasible_half_plane =
+            feasibility_check.checkHalfPlaneFeasibility(segment);
+        time_half_plane.Stop();
+        time_polytope.Start();
+        const bool feasible_polytope =
+            feasibility_check.checkPolytopeFeasibility(segment, corridor[i]);
+        time_polytope.Stop();
+        EXPECT_EQ(feasible_half_plane, feasible_polytope) << i;
+        n_feasible += feasible_polytope;
+    }
+    EXPECT_GT(n_feasible, 0);
+    EXPECT_LT(n_feasible, trajectory.K());
+
+    int segment_idx = -1;
+    const bool feasible = feasibility_check.checkCorridorFeasibility(
+        trajectory, corridor, &segment_idx);
+    EXPECT_FALSE(feasible);
+    EXPECT_FALSE(feasibility_check.checkPolytopeFeasibility(
+        trajectory.segments()[segment_idx], corridor[segment_idx]));
+    for (int i = 0; i < segment_idx; i++)
+    {
+        EXPECT_TRUE(feasibility_check.checkPolytopeFeasibility(
+            trajectory.segments()[i], corridor[i]));
+    }
+}
+
+TEST(FeasibilityTest, FeasibilityCache)
+{
+    InputConstraints input_constraints;
+    input_constraints.setDefaultValues();
+    FeasibilityRecursive feasibility_check(input_constraints);
+    const size_t kCapacity = 2;
+    FeasibilityCache cache(&feasibility_check, kCapacity);
+
+    // Straight lines with different velocities.
+    Segment::Vector segments;
+    for (int i = 0; i < 3; i++)
+    {
+        Segment segment(3, 3);
+        Eigen::VectorXd coeffs_x(Eigen::Vector3d::Zero());
+        coeffs_x(1) = 1.0 + 2.0 * i;
+        segment[0] = Polynomial(coeffs_x);
+        segment[1] = Polynomial(Eigen::VectorXd(Eigen::Vector3d::Zero()));
+        segment[2] = Polynomial(Eigen::VectorXd(Eigen::Vector3d::Zero()));
+        segment.setTime(1.0);
+        segments.push_back(segment);
+    }
+
+    for (const Segment &segment : segments)
+    {
+        EXPECT_EQ(feasibility_check.checkInputFeasibility(segment),
+                  cache.checkInputFeasibility(segment));
+    }
+    EXPECT_EQ(0u, cache.getNumHits());
+    EXPECT_EQ(3u, cache.getNumMisses());
+    EXPECT_EQ(kCapacity, cache.size());
+
+    // The first segment was evicted, the last one is cached.
+    EXPECT_EQ(feasibility_check.checkInputFeasibility(segments[2]),
+              cache.checkInputFeasibility(segments[2]));
+    EXPECT_EQ(1u, cache.getNumHits());
+    cache.checkInputFeasibility(segments[0]);
+    EXPECT_EQ(1u, cache.getNumHits());
+    EXPECT_EQ(4u, cache.getNumMisses());
+
+    // Changing the constraints changes the key.
+    EXPECT_EQ(InputFeasibilityResult::kInputInfeasibleVelocity,
+              cache.checkInputFeasibility(segments[2]));
+    feasibility_check.input_constraints_.addConstraint(
+        InputConstraintType::kVMax, 10.0);
+    EXPECT_EQ(InputFeasibilityResult::kInputFeasible,
+              cache.checkInputFeasibility(segments[2]));
+    EXPECT_EQ(2u, cache.getNumHits());
+    EXPECT_EQ(5u, cache.getNumMisses());
+
+    // Half plane results are cached separately.
+    feasibility_check.half_plane_constraints_ = HalfPlane::createBoundingBox(
+        Eigen::Vector3d::Zero(), Eigen::Vector3d::Constant(4.0));
+    EXPECT_TRUE(cache.checkHalfPlaneFeasibility(segments[0]));
+    EXPECT_TRUE(cache.checkHalfPlaneFeasibility(segments[0]));
+    EXPECT_FALSE(cache.checkHalfPlaneFeasibility(segments[2]));
+    EXPECT_EQ(3u, cache.getNumHits());
+
+    // Changing the gravity or the pre-filter changes the key.
+    cache.resetCounters();
+    cache.checkInputFeasibility(segments[2]);
+    cache.checkInputFeasibility(segments[2]);
+    EXPECT_EQ(1u, cache.getNumHits());
+    feasibility_check.gravity_.z() = 1.62;
+    cache.checkInputFeasibility(segments[2]);
+    feasibility_check.use_bernstein_pre_filter_ = false;
+    cache.checkInputFeasibility(segments[2]);
+    EXPECT_EQ(1u, cache.getNumHits());
+    EXPECT_EQ(3u, cache.getNumMisses());
+
+    // -0.0 and 0.0 are the same key.
+    cache.resetCounters();
+    Segment negative_zero = segments[1];
+    Eigen::VectorXd coeffs_y(Eigen::Vector3d::Zero());
+    coeffs_y(2) = -0.0;
+    negative_zero[1].setCoefficients(coeffs_y);
+    cache.checkInputFeasibility(segments[1]);
+    cache.checkInputFeasibility(negative_zero);
+    EXPECT_EQ(1u, cache.getNumHits());
+
+    // A segment with NaN coefficients is found again and can be evicted.
+    cache.resetCounters();
+    Segment nan_segment = segments[0];
+    Eigen::VectorXd coeffs_nan(Eigen::Vector3d::Zero());
+    coeffs_nan(1) = std::numeric_limits<double>::quiet_NaN();
+    nan_segment[0].setCoefficients(coeffs_nan);
+    cache.checkInputFeasibility(nan_segment);
+    cache.checkInputFeasibility(nan_segment);
+    EXPECT_EQ(1u, cache.getNumHits());
+    for (const Segment &segment : segments)
+    {
+        cache.checkInputFeasibility(segment);
+    }
+    EXPECT_EQ(kCapacity, cache.size());
+    cache.checkInputFeasibility(nan_segment);
+    EXPECT_EQ(1u, cache.getNumHits());
+
+    cache.clear();
+    cache.resetCounters();
+    EXPECT_EQ(0u, cache.size());
+    EXPECT_EQ(0u, cache.getNumHits());
+}
+
 int main(int argc, char **argv)
 {
     testing::InitGoogleTest(&argc, argv);